@@ -7,5 +7,18 @@
 int
 main(void)
 {
-    _bench_mtb_hmap();
+    MtbArena corpusArena = {0};
+    MtbDynArr tokens = {0};
+    MtbStr corpus = _bench_mtb_corpus_load(&corpusArena, &tokens);
+
+    _bench_mtb_hmap(&tokens);
+    _bench_mtb_hset();
+    _bench_mtb_omap();
+    _bench_mtb_cache();
+    _bench_mtb_string(corpus, &tokens);
+    _bench_mtb_phash();
+    _bench_mtb_cmap(&tokens);
+    _bench_mtb_intern(&tokens);
+
+    mtb_arena_deinit(&corpusArena);
 }
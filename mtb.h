@@ -53,14 +53,15 @@
 #define mtb_is_pow2(s) ((bool)((s) != 0 && mtb_is_pow2_or_zero((s))))
 
 #define mtb_leading_zeros_count(n) __builtin_clzg(n)
+#define mtb_trailing_zeros_count(n) __builtin_ctzg(n)
 #define mtb_roundup_pow2(n) (u64_lit(1) << (sizeof(u64) * CHAR_BIT - mtb_leading_zeros_count(n - 1)))
 
 
 /* Memory Utils */
 
-#define kibi(n) ((u64)((n) * (1 << 10)))
-#define mebi(n) ((u64)((n) * (1 << 20)))
-#define gibi(n) ((u64)((n) * (1 << 30)))
+#define kibi(n) ((u64)(n) * ((u64)1 << 10))
+#define mebi(n) ((u64)(n) * ((u64)1 << 20))
+#define gibi(n) ((u64)(n) * ((u64)1 << 30))
 
 #define kb(n) kibi(n)
 #define mb(n) mebi(n)
@@ -69,6 +70,8 @@
 #define mtb_align_pow2(s, a) ((u64)(((s) + (a) - 1) & (~((a) - 1))))
 #define mtb_align_padding_pow2(s, a) ((u64)((-(s)) & ((a) - 1)))
 
+#define mtb_prefetch(p) __builtin_prefetch(p)
+
 #if defined(_MTB_COMPILER_GCC)
 # define mtb_alignof(T) __alignof__(T)
 #elif defined(_MTB_COMPILER_CLANG)
@@ -883,6 +886,11 @@ struct mtb_perf_profile
 func void mtb_perf_start();
 func void mtb_perf_print();
 
+// Same layout as the profile blocks, for reports of other modules.
+func void mtb_perf_print_block(const char *name);
+func void mtb_perf_print_u64(const char *label, u64 value);
+func void mtb_perf_print_f64(const char *label, f64 value);
+
 func u64 mtb_perf_cpu_time();
 func u64 mtb_perf_cpu_freq();
 
@@ -945,8 +953,8 @@ mtb_perf_print()
     for (u32 i = 1; i < MTB_PERF_BLOCKS_MAX; i++) {
         MtbPerfBlock *block = &_mtb_perf_global_profile.blocks[i];
         if (block->name) {
-            printf("[%s]\n", block->name);
-            printf("\thits: %lu\n", block->hitCount);
+            mtb_perf_print_block(block->name);
+            mtb_perf_print_u64("hits", block->hitCount);
             printf("\tcpu time: %lu (%.2f%%)\n",
                    block->cpuTimeElapsed,
                    (f32)block->cpuTimeElapsed / (f32)totalCpuTimeElapsed * 100.0f);
@@ -960,6 +968,24 @@ mtb_perf_print()
 #endif
 }
 
+func void
+mtb_perf_print_block(const char *name)
+{
+    printf("[%s]\n", name);
+}
+
+func void
+mtb_perf_print_u64(const char *label, u64 value)
+{
+    printf("\t%s: %lu\n", label, value);
+}
+
+func void
+mtb_perf_print_f64(const char *label, f64 value)
+{
+    printf("\t%s: %.2f\n", label, value);
+}
+
 func u64
 mtb_perf_cpu_time()
 {
@@ -1437,6 +1463,18 @@ struct mtb_arena_allocator
     void *ctx;                                      /* custom context */
     void *(*alloc)(void *ctx, void *ptr, u64 size); /* allocate if size > 0, free otherwise */
     u64 (*size)(void *ctx, void *ptr);              /* return allocation size */
+    /* optional, makes [ptr, ptr + size) usable past the committed bytes and returns the new committed size */
+    u64 (*commit)(void *ctx, void *ptr, u64 committed, u64 size);
+    /* optional, returns the pages past ptr + size to the OS and returns where they start from ptr,
+       past it memory is uncommitted w/ a commit hook, zero filled otherwise */
+    u64 (*decommit)(void *ctx, void *ptr, u64 committed, u64 size);
+    bool zeroed; /* fresh allocations read as zeros, e.g. mmap */
+    /* optional w/ zeroed, a u64 kept next to the allocation where the arena and its copies share
+       the high-water mark of the bytes handed out, single block arenas zero every bump without it */
+    u64 *(*mark)(void *ctx, void *ptr);
+    /* required w/ commit, a u64 kept next to the allocation where the arena and its copies share
+       the committed size */
+    u64 *(*commitMark)(void *ctx, void *ptr);
 };
 
 func u64 mtb_arena_def_size(void *ctx, void *ptr);
@@ -1444,6 +1482,17 @@ func void *mtb_arena_def_alloc(void *ctx, void *ptr, u64 size);
 
 func u64 mtb_arena_def_virt_size(void *ctx, void *ptr);
 func void *mtb_arena_def_virt_alloc(void *ctx, void *ptr, u64 size);
+func u64 mtb_arena_def_virt_decommit(void *ctx, void *ptr, u64 committed, u64 size);
+func u64 *mtb_arena_def_virt_mark(void *ctx, void *ptr);
+
+// Reserves the address space only, pages are committed in power of 2 chunks of *(u64 *)ctx bytes,
+// or MTB_ARENA_DEF_COMMIT_SIZE if ctx is nil, as the arena bumps past them.
+func u64 mtb_arena_def_reserve_size(void *ctx, void *ptr);
+func void *mtb_arena_def_reserve_alloc(void *ctx, void *ptr, u64 size);
+func u64 mtb_arena_def_reserve_commit(void *ctx, void *ptr, u64 committed, u64 size);
+func u64 mtb_arena_def_reserve_decommit(void *ctx, void *ptr, u64 committed, u64 size);
+func u64 *mtb_arena_def_reserve_mark(void *ctx, void *ptr);
+func u64 *mtb_arena_def_reserve_commit_mark(void *ctx, void *ptr);
 
 
 /* Arena */
@@ -1452,13 +1501,79 @@ func void *mtb_arena_def_virt_alloc(void *ctx, void *ptr, u64 size);
 #define MTB_ARENA_DEF_ALIGN sizeof(void *)
 #endif
 
+#ifndef MTB_ARENA_DEF_COMMIT_SIZE
+#define MTB_ARENA_DEF_COMMIT_SIZE mb(1) // a power of 2, at least the page size
+#endif
+
+#ifndef MTB_ARENA_DEF_RESERVE_SIZE
+#define MTB_ARENA_DEF_RESERVE_SIZE gb(64) // address space only, nothing is committed up front
+#endif
+
+#ifndef MTB_ARENA_DEF_MAX_BLOCK_SIZE
+#define MTB_ARENA_DEF_MAX_BLOCK_SIZE mb(64) // chained arenas stop doubling the block size here
+#endif
+
+typedef struct mtb_arena_block MtbArenaBlock;
+struct mtb_arena_block
+{
+    MtbArenaBlock *prev;
+    MtbArenaBlock *next;
+    u64 size;    // usable, past the header
+    u64 touched; // high-water mark, shared by the copies of the arena
+};
+
 typedef struct mtb_arena MtbArena;
 struct mtb_arena
 {
     u8 *base;
     u64 offset;
     u64 size;
+    u64 *committed; // usable bytes from base, shared by the copies of the arena, nil unless the allocator commits on demand
+    u64 *touched;  // high-water mark of the bytes handed out, past it memory is still zero, nil if every bump zeroes
     MtbArenaAllocator *allocator;
+
+    // chained arenas only, nil otherwise
+    MtbArenaBlock *first; // kept by clear
+    MtbArenaBlock *block; // the one base points into
+    MtbArenaBlock *cache; // released blocks kept for reuse (cacheBlocks)
+    u64 maxBlockSize;
+    bool cacheBlocks;
+
+    u64 tempDepth; // open temp scopes
+};
+
+// Saved position, see mtb_arena_temp_begin.
+typedef struct mtb_arena_temp MtbArenaTemp;
+struct mtb_arena_temp
+{
+    MtbArena *arena;
+    MtbArenaBlock *block; // nil w/ single block arenas
+    u64 offset;
+    u64 depth;
+};
+
+typedef struct mtb_arena_chain_options MtbArenaChainOptions;
+struct mtb_arena_chain_options
+{
+    u64 maxBlockSize; // every new block doubles the previous one up to this, MTB_ARENA_DEF_MAX_BLOCK_SIZE if 0
+    bool cacheBlocks; // clear keeps the chained blocks for reuse, instead of freeing them
+};
+
+typedef struct mtb_arena_clear_options MtbArenaClearOptions;
+struct mtb_arena_clear_options
+{
+    bool decommit; // return the pages past the new offset and keep to the OS, if the allocator can
+    u64 keep;      // high-water mark (from base) that stays resident
+};
+
+typedef struct mtb_arena_stats MtbArenaStats;
+struct mtb_arena_stats
+{
+    u64 offset;
+    u64 size;      // of every block w/ chained arenas, cached ones included
+    u64 committed; // of every block w/ chained arenas, cached ones included
+    u64 resident;  // of the committed bytes, rounded to pages (mincore)
+    u64 blocks;
 };
 
 typedef struct mtb_arena_bump_options MtbArenaBumpOptions;
@@ -1469,6 +1584,14 @@ struct mtb_arena_bump_options
 };
 
 func void mtb_arena_init(MtbArena *arena, u64 size, MtbArenaAllocator *allocator);
+// Reserves size bytes of address space and commits it as the arena grows, so the last allocation
+// can grow in place (mtb_arena_resize) and pointers stay stable, e.g. MtbDynArr and MtbHmap never relocate.
+func void mtb_arena_init_reserved(MtbArena *arena, u64 size);
+// Starts w/ a block of the given size and chains new blocks from the allocator when it's full,
+// instead of trapping. Blocks chained by a copy of the arena are not freed by the original.
+func void mtb_arena_init_chained_opt(MtbArena *arena, u64 size, MtbArenaAllocator *allocator, MtbArenaChainOptions opt);
+#define mtb_arena_init_chained(arena, size, allocator, ...) \
+    mtb_arena_init_chained_opt(arena, size, allocator, (MtbArenaChainOptions){ __VA_ARGS__ })
 func void mtb_arena_deinit(MtbArena *arena);
 
 func void *mtb_arena_bump_opt(MtbArena *arena, u64 size, MtbArenaBumpOptions opt);
@@ -1477,7 +1600,28 @@ func void *mtb_arena_bump_opt(MtbArena *arena, u64 size, MtbArenaBumpOptions opt
 #define mtb_arena_bump(arena, type, count, ...) \
     (type *)mtb_arena_bump_opt(arena, mtb_mul_u64(sizeof(type), (count)), (MtbArenaBumpOptions){ .align = mtb_alignof(type), __VA_ARGS__ })
 
-func void mtb_arena_clear(MtbArena *arena);
+func bool mtb_arena_resize(MtbArena *arena, void *ptr, u64 oldSize, u64 newSize); /* last allocation only, within its block */
+// Back to an earlier offset of the current block, e.g. a saved arena->offset.
+func void mtb_arena_rewind_opt(MtbArena *arena, u64 offset, MtbArenaClearOptions opt);
+#define mtb_arena_rewind(arena, offset, ...) \
+    mtb_arena_rewind_opt(arena, offset, (MtbArenaClearOptions){ __VA_ARGS__ })
+// Back to the first block, O(1) unless chained blocks are freed or pages are decommitted.
+// No temp scope may be open, MTB_DEBUG traps otherwise.
+func void mtb_arena_clear_opt(MtbArena *arena, MtbArenaClearOptions opt);
+#define mtb_arena_clear(arena, ...) \
+    mtb_arena_clear_opt(arena, (MtbArenaClearOptions){ __VA_ARGS__ })
+
+// Everything bumped between begin and end is released in O(1) at end, chained blocks included
+// (freed or cached like clear does). Scopes nest and must end in reverse order, MTB_DEBUG traps otherwise.
+func MtbArenaTemp mtb_arena_temp_begin(MtbArena *arena);
+func void mtb_arena_temp_end(MtbArenaTemp *temp);
+// Ends the scope when the enclosing block exits.
+#define _mtb_arena_temp_scope(arena, _t) \
+    MtbArenaTemp _t __attribute__((__cleanup__(mtb_arena_temp_end))) = mtb_arena_temp_begin(arena)
+#define mtb_arena_temp_scope(arena) _mtb_arena_temp_scope(arena, mtb_id(_t))
+
+func void mtb_arena_stats(MtbArena *arena, MtbArenaStats *stats);
+func void mtb_arena_stats_print(MtbArenaStats *stats, const char *name); // through the mtb_perf report format
 
 #endif //MTB_ARENA_H
 
@@ -1491,6 +1635,7 @@ func void mtb_arena_clear(MtbArena *arena);
 
 
 #define MTB_ARENA_DEF_ALLOCATOR_HEADER_SIZE sizeof(u64)
+#define MTB_ARENA_DEF_VIRT_HEADER_SIZE (2 * sizeof(u64)) // mark, size
 
 
 global MtbArenaAllocator MTB_ARENA_DEF_ALLOCATOR = {
@@ -1503,6 +1648,20 @@ global MtbArenaAllocator MTB_ARENA_DEF_VIRT_ALLOCATOR = {
     .ctx = nil,
     .alloc = mtb_arena_def_virt_alloc,
     .size = mtb_arena_def_virt_size,
+    .decommit = mtb_arena_def_virt_decommit,
+    .zeroed = true,
+    .mark = mtb_arena_def_virt_mark,
+};
+
+global MtbArenaAllocator MTB_ARENA_DEF_RESERVE_ALLOCATOR = {
+    .ctx = nil,
+    .alloc = mtb_arena_def_reserve_alloc,
+    .size = mtb_arena_def_reserve_size,
+    .commit = mtb_arena_def_reserve_commit,
+    .decommit = mtb_arena_def_reserve_decommit,
+    .zeroed = true,
+    .mark = mtb_arena_def_reserve_mark,
+    .commitMark = mtb_arena_def_reserve_commit_mark,
 };
 
 
@@ -1563,44 +1722,267 @@ mtb_arena_def_virt_alloc(void *ctx, void *ptr, u64 size)
     if (size == 0) {
         mtb_assert_always(base != nil);
         u64 allocSize = mtb_arena_def_virt_size(ctx, base);
-        mtb_assert(munmap(base - headerSize - pageSize, allocSize) == 0);
+        mtb_assert(munmap(base - MTB_ARENA_DEF_VIRT_HEADER_SIZE - pageSize, allocSize) == 0);
         return nil;
     }
 
     mtb_assert_always(base == nil);
 
     // Allocate enough memory to fit: arena, header, 2 guard pages.
-    u64 sizeWithHeader = mtb_add_u64(size, headerSize);
+    u64 sizeWithHeader = mtb_add_u64(size, MTB_ARENA_DEF_VIRT_HEADER_SIZE);
     u64 sizeWithHeaderAligned = mtb_align_pow2(sizeWithHeader, pageSize);
     u64 allocSize = mtb_add_u64(sizeWithHeaderAligned, 2 * pageSize);
     u8 *mmapAddr = (u8 *)mmap(nil, allocSize, PROT_NONE, MAP_ANON | MAP_PRIVATE, -1, 0);
     mtb_assert(mmapAddr != MAP_FAILED);
 
-    u64 *header = (u64 *)(mmapAddr + pageSize);
-    mtb_assert(mprotect(header, sizeWithHeaderAligned, PROT_READ | PROT_WRITE) == 0);
+    u8 *headerAddr = mmapAddr + pageSize;
+    mtb_assert(mprotect(headerAddr, sizeWithHeaderAligned, PROT_READ | PROT_WRITE) == 0);
+    u64 *header = (u64 *)(headerAddr + MTB_ARENA_DEF_VIRT_HEADER_SIZE - headerSize);
     *header = allocSize;
 
     return header + 1;
 }
 
+// Stays committed, the pages are zero filled on the next touch.
+func u64
+mtb_arena_def_virt_decommit(void *ctx, void *ptr, u64 committed, u64 size)
+{
+    u8 *base = (u8 *)ptr;
+    u64 pageSize = (u64)sysconf(_SC_PAGE_SIZE);
+
+    u8 *mmapAddr = base - MTB_ARENA_DEF_VIRT_HEADER_SIZE - pageSize;
+    u8 *end = mmapAddr + mtb_arena_def_virt_size(ctx, base) - pageSize; // before the guard page
+    u8 *beg = (u8 *)mtb_align_pow2((u64)(base + size), pageSize);
+    if (beg >= end) {
+        return (u64)(end - base);
+    }
+    // MADV_FREE would only drop the pages under memory pressure, so the RSS wouldn't go down
+    mtb_assert(madvise(beg, (u64)(end - beg), MADV_DONTNEED) == 0);
+    return (u64)(beg - base);
+}
+
+func u64 *
+mtb_arena_def_virt_mark(void *ctx, void *ptr)
+{
+    return (u64 *)((u8 *)ptr - MTB_ARENA_DEF_VIRT_HEADER_SIZE);
+}
+
+func u64
+mtb_arena_def_reserve_size(void *ctx, void *ptr)
+{
+    return mtb_arena_def_virt_size(ctx, ptr);
+}
+
+func void *
+mtb_arena_def_reserve_alloc(void *ctx, void *ptr, u64 size)
+{
+    u8 *base = (u8 *)ptr;
+    u64 headerSize = MTB_ARENA_DEF_ALLOCATOR_HEADER_SIZE;
+    u64 pageSize = (u64)sysconf(_SC_PAGE_SIZE);
+    mtb_assert(mtb_is_pow2(pageSize));
+
+    if (size == 0) {
+        mtb_assert_always(base != nil);
+        u64 allocSize = mtb_arena_def_reserve_size(ctx, base);
+        mtb_assert(munmap(base - pageSize, allocSize) == 0);
+        return nil;
+    }
+
+    mtb_assert_always(base == nil);
+
+    // Reserve: header page, arena, guard page. Only the header page is committed.
+    u64 sizeAligned = mtb_align_pow2(size, pageSize);
+    u64 allocSize = mtb_add_u64(sizeAligned, 2 * pageSize);
+    u8 *mmapAddr = (u8 *)mmap(nil, allocSize, PROT_NONE, MAP_ANON | MAP_PRIVATE | MAP_NORESERVE, -1, 0);
+    mtb_assert(mmapAddr != MAP_FAILED);
+    mtb_assert(mprotect(mmapAddr, pageSize, PROT_READ | PROT_WRITE) == 0);
+
+    u8 *result = mmapAddr + pageSize;
+    u64 *header = (u64 *)(result - headerSize);
+    *header = allocSize;
+
+    return result;
+}
+
+func u64
+mtb_arena_def_reserve_commit(void *ctx, void *ptr, u64 committed, u64 size)
+{
+    u8 *base = (u8 *)ptr;
+    u64 pageSize = (u64)sysconf(_SC_PAGE_SIZE);
+    u64 chunkSize = ctx != nil ? *(u64 *)ctx : MTB_ARENA_DEF_COMMIT_SIZE;
+    mtb_assert_always(mtb_is_pow2(chunkSize) && chunkSize >= pageSize);
+
+    u64 reserved = mtb_arena_def_reserve_size(ctx, base) - 2 * pageSize;
+    u64 newCommitted = mtb_min_u64(mtb_align_pow2(size, chunkSize), reserved);
+    if (newCommitted > committed) {
+        mtb_assert(mprotect(base + committed, newCommitted - committed, PROT_READ | PROT_WRITE) == 0);
+    }
+    return newCommitted;
+}
+
+func u64
+mtb_arena_def_reserve_decommit(void *ctx, void *ptr, u64 committed, u64 size)
+{
+    u8 *base = (u8 *)ptr;
+    u64 chunkSize = ctx != nil ? *(u64 *)ctx : MTB_ARENA_DEF_COMMIT_SIZE;
+
+    u64 newCommitted = mtb_align_pow2(size, chunkSize);
+    if (newCommitted < committed) {
+        mtb_assert(madvise(base + newCommitted, committed - newCommitted, MADV_DONTNEED) == 0);
+        mtb_assert(mprotect(base + newCommitted, committed - newCommitted, PROT_NONE) == 0);
+        return newCommitted;
+    }
+    return committed;
+}
+
+// In the header page, like the size.
+func u64 *
+mtb_arena_def_reserve_mark(void *ctx, void *ptr)
+{
+    return mtb_arena_def_virt_mark(ctx, ptr);
+}
+
+// In the header page, before the mark.
+func u64 *
+mtb_arena_def_reserve_commit_mark(void *ctx, void *ptr)
+{
+    return mtb_arena_def_reserve_mark(ctx, ptr) - 1;
+}
+
 func void
 mtb_arena_init(MtbArena *arena, u64 size, MtbArenaAllocator *allocator)
 {
+    *arena = (MtbArena){0};
     arena->allocator = allocator;
     arena->base = allocator->alloc(allocator->ctx, nil, size);
     arena->offset = 0;
     arena->size = size;
+    if (allocator->commit != nil) {
+        arena->committed = allocator->commitMark(allocator->ctx, arena->base);
+        *arena->committed = 0;
+    }
+    if (allocator->zeroed && allocator->mark != nil) {
+        arena->touched = allocator->mark(allocator->ctx, arena->base);
+        *arena->touched = 0;
+    }
+}
+
+func void
+mtb_arena_init_reserved(MtbArena *arena, u64 size)
+{
+    mtb_arena_init(arena, size == 0 ? MTB_ARENA_DEF_RESERVE_SIZE : size, &MTB_ARENA_DEF_RESERVE_ALLOCATOR);
+}
+
+func void
+_mtb_arena_commit(MtbArena *arena, u64 offset)
+{
+    if (arena->committed != nil && offset > *arena->committed) {
+        MtbArenaAllocator *allocator = arena->allocator;
+        *arena->committed = allocator->commit(allocator->ctx, arena->base, *arena->committed, offset);
+        mtb_assert_always(*arena->committed >= offset);
+    }
+}
+
+func void
+_mtb_arena_use_block(MtbArena *arena, MtbArenaBlock *block)
+{
+    arena->block = block;
+    arena->base = (u8 *)(block + 1);
+    arena->offset = 0;
+    arena->size = block->size;
+    arena->committed = nil;
+    arena->touched = &block->touched;
+}
+
+func u64
+_mtb_arena_committed(MtbArena *arena)
+{
+    return arena->committed != nil ? *arena->committed : arena->size;
+}
+
+// Bytes past it are still zero.
+func u64
+_mtb_arena_touched(MtbArena *arena)
+{
+    return arena->touched != nil ? *arena->touched : arena->size;
+}
+
+func void
+_mtb_arena_touch(MtbArena *arena, u64 offset)
+{
+    if (arena->touched != nil && offset > *arena->touched) {
+        *arena->touched = offset;
+    }
+}
+
+func MtbArenaBlock *
+_mtb_arena_alloc_block(MtbArena *arena, u64 size)
+{
+    MtbArenaAllocator *allocator = arena->allocator;
+    MtbArenaBlock *block = allocator->alloc(allocator->ctx, nil, mtb_add_u64(sizeof(MtbArenaBlock), size));
+    block->prev = nil;
+    block->next = nil;
+    block->size = size;
+    block->touched = allocator->zeroed ? 0 : size;
+    return block;
+}
+
+func void
+_mtb_arena_free_blocks(MtbArena *arena, MtbArenaBlock *block) // and every one before it
+{
+    MtbArenaAllocator *allocator = arena->allocator;
+    while (block != nil) {
+        MtbArenaBlock *prev = block->prev;
+        allocator->alloc(allocator->ctx, block, 0);
+        block = prev;
+    }
+}
+
+// Makes room for size more bytes in a new block, from the cache if the most recent one fits.
+func void
+_mtb_arena_chain(MtbArena *arena, u64 size)
+{
+    MtbArenaBlock *block = arena->cache;
+    bool fresh = block == nil || block->size < size;
+    if (!fresh) {
+        arena->cache = block->prev; // keeps its mark, only what was handed out is zeroed again
+    }
+    else {
+        u64 blockSize = mtb_max_u64(mtb_min_u64(mtb_mul_u64(arena->block->size, 2), arena->maxBlockSize), size);
+        block = _mtb_arena_alloc_block(arena, blockSize);
+    }
+    block->prev = arena->block;
+    block->next = nil;
+    arena->block->next = block;
+    _mtb_arena_use_block(arena, block);
+}
+
+func void
+mtb_arena_init_chained_opt(MtbArena *arena, u64 size, MtbArenaAllocator *allocator, MtbArenaChainOptions opt)
+{
+    mtb_assert_always(size > 0);
+    mtb_assert_always(allocator->commit == nil); // blocks are committed whole
+
+    *arena = (MtbArena){0};
+    arena->allocator = allocator;
+    arena->maxBlockSize = opt.maxBlockSize == 0 ? MTB_ARENA_DEF_MAX_BLOCK_SIZE : opt.maxBlockSize;
+    arena->cacheBlocks = opt.cacheBlocks;
+    arena->first = _mtb_arena_alloc_block(arena, size);
+    _mtb_arena_use_block(arena, arena->first);
 }
 
 func void
 mtb_arena_deinit(MtbArena *arena)
 {
     MtbArenaAllocator *allocator = arena->allocator;
-    allocator->alloc(allocator->ctx, arena->base, 0);
-    arena->base = nil;
-    arena->offset = 0;
-    arena->size = 0;
-    arena->allocator = nil;
+    if (arena->first != nil) {
+        _mtb_arena_free_blocks(arena, arena->block);
+        _mtb_arena_free_blocks(arena, arena->cache);
+    }
+    else {
+        allocator->alloc(allocator->ctx, arena->base, 0);
+    }
+    *arena = (MtbArena){0};
 }
 
 func void *
@@ -1614,18 +1996,186 @@ mtb_arena_bump_opt(MtbArena *arena, u64 size, MtbArenaBumpOptions opt)
     u64 padding = mtb_align_padding_pow2((u64)(arena->base + oldOffset), align);
     u64 oldOffsetAligned = mtb_add_u64(oldOffset, padding);
     u64 newOffset = mtb_add_u64(oldOffsetAligned, size);
-    mtb_assert_always(newOffset <= arena->size);
+    if (newOffset > arena->size) {
+        mtb_assert_always(arena->first != nil); // a single block arena is full
+        _mtb_arena_chain(arena, mtb_add_u64(size, align));
+        return mtb_arena_bump_opt(arena, size, opt);
+    }
+    _mtb_arena_commit(arena, newOffset);
     arena->offset = newOffset;
 
     u8 *result = arena->base + oldOffsetAligned;
+    u64 touched = _mtb_arena_touched(arena);
+    if (!opt.no_zero && oldOffsetAligned < touched) {
+        memset(result, 0, mtb_min_u64(newOffset, touched) - oldOffsetAligned); // the rest was never touched
+    }
+    _mtb_arena_touch(arena, newOffset);
 
-    return opt.no_zero ? result : memset(result, 0, size);
+    return result;
+}
+
+func bool
+mtb_arena_resize(MtbArena *arena, void *ptr, u64 oldSize, u64 newSize)
+{
+    mtb_assert_always(newSize > 0);
+
+    u8 *oldEnd = (u8 *)ptr + oldSize;
+    if (oldEnd != arena->base + arena->offset) {
+        return false;
+    }
+    u64 newOffset = mtb_add_u64((u64)((u8 *)ptr - arena->base), newSize);
+    if (newOffset > arena->size) {
+        return false;
+    }
+    _mtb_arena_commit(arena, newOffset);
+    u64 touched = _mtb_arena_touched(arena);
+    if (arena->offset < touched && newOffset > arena->offset) {
+        memset(oldEnd, 0, mtb_min_u64(newOffset, touched) - arena->offset);
+    }
+    _mtb_arena_touch(arena, newOffset);
+    arena->offset = newOffset;
+    return true;
+}
+
+// Frees, or caches, every block after the given one and goes back to it.
+func void
+_mtb_arena_unchain(MtbArena *arena, MtbArenaBlock *keep)
+{
+    // the chain is keep <-> next <-> ... <-> block
+    MtbArenaBlock *next = keep->next;
+    keep->next = nil;
+    next->prev = nil;
+    if (arena->cacheBlocks) {
+        next->prev = arena->cache;
+        arena->cache = arena->block;
+    }
+    else {
+        _mtb_arena_free_blocks(arena, arena->block);
+    }
+    _mtb_arena_use_block(arena, keep);
+}
+
+func void
+_mtb_arena_decommit(MtbArena *arena, u64 keep)
+{
+    MtbArenaAllocator *allocator = arena->allocator;
+    if (allocator->decommit == nil) {
+        return;
+    }
+    // chained blocks were allocated w/ their header
+    u8 *ptr = arena->first != nil ? (u8 *)arena->block : arena->base;
+    u64 headerSize = (u64)(arena->base - ptr);
+    u64 size = mtb_add_u64(mtb_max_u64(arena->offset, keep), headerSize);
+    u64 returned = allocator->decommit(allocator->ctx, ptr, _mtb_arena_committed(arena) + headerSize, size) - headerSize;
+    if (arena->touched != nil && returned < *arena->touched) {
+        *arena->touched = returned;
+    }
+    if (arena->committed != nil) {
+        *arena->committed = returned;
+    }
+}
+
+func void
+mtb_arena_rewind_opt(MtbArena *arena, u64 offset, MtbArenaClearOptions opt)
+{
+    mtb_assert_always(offset <= arena->offset);
+
+    arena->offset = offset;
+    if (opt.decommit) {
+        _mtb_arena_decommit(arena, opt.keep);
+    }
 }
 
 func void
-mtb_arena_clear(MtbArena *arena)
+mtb_arena_clear_opt(MtbArena *arena, MtbArenaClearOptions opt)
 {
+    mtb_assert(arena->tempDepth == 0); // a temp scope is still open, its end would restore a freed block
     arena->offset = 0;
+    if (arena->first != nil && arena->block != arena->first) {
+        _mtb_arena_unchain(arena, arena->first);
+    }
+    if (opt.decommit) {
+        _mtb_arena_decommit(arena, opt.keep);
+    }
+}
+
+func MtbArenaTemp
+mtb_arena_temp_begin(MtbArena *arena)
+{
+    return (MtbArenaTemp){
+        .arena = arena,
+        .block = arena->block,
+        .offset = arena->offset,
+        .depth = ++arena->tempDepth,
+    };
+}
+
+func void
+mtb_arena_temp_end(MtbArenaTemp *temp)
+{
+    MtbArena *arena = temp->arena;
+    mtb_assert(temp->depth == arena->tempDepth); // an inner scope is still open, or this one has ended
+
+    if (arena->block != temp->block) {
+        _mtb_arena_unchain(arena, temp->block);
+    }
+    else {
+        mtb_assert_always(temp->offset <= arena->offset);
+    }
+    arena->offset = temp->offset;
+    arena->tempDepth = temp->depth - 1;
+}
+
+func u64
+_mtb_arena_resident(u8 *ptr, u64 size)
+{
+    u64 pageSize = (u64)sysconf(_SC_PAGE_SIZE);
+    u8 *beg = (u8 *)((u64)ptr & ~(pageSize - 1));
+    u8 *end = (u8 *)mtb_align_pow2((u64)(ptr + size), pageSize);
+
+    u64 resident = 0;
+    unsigned char pages[256];
+    for (u8 *cur = beg; cur < end; cur += sizeof(pages) * pageSize) {
+        u64 count = mtb_min_u64((u64)(end - cur) / pageSize, sizeof(pages));
+        mtb_assert(mincore(cur, count * pageSize, pages) == 0);
+        for (u64 i = 0; i < count; i++) {
+            resident += pages[i] & 1;
+        }
+    }
+    return resident * pageSize;
+}
+
+func void
+mtb_arena_stats(MtbArena *arena, MtbArenaStats *stats)
+{
+    *stats = (MtbArenaStats){ .offset = arena->offset };
+    if (arena->first == nil) {
+        stats->size = arena->size;
+        stats->committed = _mtb_arena_committed(arena);
+        stats->resident = stats->committed > 0 ? _mtb_arena_resident(arena->base, stats->committed) : 0;
+        stats->blocks = 1;
+        return;
+    }
+    MtbArenaBlock *chains[] = { arena->block, arena->cache };
+    for (u64 i = 0; i < mtb_countof(chains); i++) {
+        for (MtbArenaBlock *block = chains[i]; block != nil; block = block->prev) {
+            stats->size += block->size;
+            stats->committed += block->size;
+            stats->resident += _mtb_arena_resident((u8 *)(block + 1), block->size);
+            stats->blocks++;
+        }
+    }
+}
+
+func void
+mtb_arena_stats_print(MtbArenaStats *stats, const char *name)
+{
+    mtb_perf_print_block(name);
+    mtb_perf_print_u64("offset", stats->offset);
+    mtb_perf_print_u64("size", stats->size);
+    mtb_perf_print_u64("committed", stats->committed);
+    mtb_perf_print_u64("resident", stats->resident);
+    mtb_perf_print_u64("blocks", stats->blocks);
 }
 
 #endif // MTB_ARENA_IMPLEMENTATION
@@ -1641,12 +2191,13 @@ _test_mtb_allocator(MtbArenaAllocator *allocator)
 {
     MtbArena arena = {0};
     u64 pageSize = (u64)sysconf(_SC_PAGE_SIZE);
-    u64 arenaSize = 2 * pageSize;
+    u64 arenaSize = 3 * pageSize;
 
     // init
     mtb_arena_init(&arena, arenaSize, allocator);
     assert(arena.size == arenaSize);
     assert(arena.allocator->size(arena.allocator->ctx, arena.base) >= arenaSize);
+    assert(_mtb_arena_touched(&arena) == (allocator->mark != nil ? 0 : arenaSize));
 
     // alloc
     u64 *tiny = mtb_arena_bump(&arena, u64, 1);
@@ -1663,13 +2214,42 @@ _test_mtb_allocator(MtbArenaAllocator *allocator)
     for (u32 i = 0; i < pageSize; i++) page[i] = U8_MAX;          // is writable
     for (u32 i = 0; i < pageSize; i++) assert(page[i] == U8_MAX); // is readable
 
+    // resize
+    u64 *last = mtb_arena_bump(&arena, u64, 2);
+    last[1] = U64_MAX;
+    u64 lastOffset = arena.offset;
+    assert(mtb_arena_resize(&arena, last, 2 * sizeof(u64), 4 * sizeof(u64)));
+    assert(arena.offset == lastOffset + 2 * sizeof(u64));
+    assert(last[1] == U64_MAX && last[2] == 0 && last[3] == 0); // keeps content, zeroes the rest
+    assert(mtb_arena_resize(&arena, last, 4 * sizeof(u64), sizeof(u64)));
+    assert(arena.offset == lastOffset - sizeof(u64));
+    assert(mtb_arena_resize(&arena, last, sizeof(u64), 2 * sizeof(u64)));
+    assert(last[1] == 0); // touched before, zeroed again
+    assert(mtb_arena_resize(&arena, last, 2 * sizeof(u64), sizeof(u64)));
+    assert(!mtb_arena_resize(&arena, page, pageSize, 2 * pageSize)); // not the last one
+    assert(!mtb_arena_resize(&arena, last, sizeof(u64), arenaSize)); // doesn't fit
+    assert(arena.offset == lastOffset - sizeof(u64));
+
     // clear
     assert(arena.offset != 0);
     mtb_arena_clear(&arena);
     assert(arena.offset == 0);
 
+    // reuse is zeroed
+    u64 *reused = mtb_arena_bump(&arena, u64, 1);
+    assert(reused == tiny && *reused == 0);
+
+    // a copy shares the high-water mark, what it handed out is zeroed for the original too
+    mtb_arena_clear(&arena);
+    mtb_arena_bump(&arena, u64, 1);
+    MtbArena copy = arena;
+    u8 *scribbled = mtb_arena_bump(&copy, u8, pageSize);
+    memset(scribbled, 1, pageSize);
+    u8 *bumped = mtb_arena_bump(&arena, u8, pageSize);
+    assert(bumped == scribbled);
+    for (u32 i = 0; i < pageSize; i++) assert(bumped[i] == 0);
+
     // deinit
-    assert(mtb_arena_bump(&arena, u32, 1) != nil);
     assert(arena.base != nil);
     assert(arena.offset != 0);
     assert(arena.size != 0);
@@ -1694,31 +2274,287 @@ _test_mtb_def_allocator(void)
 }
 
 func void
-_test_mtb_arena(void)
+_test_mtb_def_reserve_allocator(void)
 {
-    _test_mtb_def_virt_allocator();
-    _test_mtb_def_allocator();
+    _test_mtb_allocator(&MTB_ARENA_DEF_RESERVE_ALLOCATOR);
 }
 
-#endif // MTB_ARENA_TESTS
-#ifndef MTB_DYNARR_H
-#define MTB_DYNARR_H
+func void
+_test_mtb_arena_reserved(void)
+{
+    u64 pageSize = (u64)sysconf(_SC_PAGE_SIZE);
+    u64 chunkSize = 4 * pageSize;
+    MtbArenaAllocator allocator = MTB_ARENA_DEF_RESERVE_ALLOCATOR;
+    allocator.ctx = &chunkSize;
 
-#ifdef MTB_IMPLEMENTATION
-#define MTB_DYNARR_IMPLEMENTATION
-#endif
+    MtbArena arena = {0};
+    mtb_arena_init(&arena, gb(64), &allocator);
+    assert(arena.size == gb(64) && *arena.committed == 0);
+
+    // commits a chunk at a time
+    u8 *items = mtb_arena_bump(&arena, u8, 1);
+    assert(*arena.committed == chunkSize);
+    items[0] = 1;
+
+    // grows in place across chunks, content and pointer are kept
+    u64 size = 1;
+    for (u64 newSize = 2; newSize <= 64 * pageSize; newSize *= 2) {
+        assert(mtb_arena_resize(&arena, items, size, newSize));
+        assert(*arena.committed == mtb_align_pow2(newSize, chunkSize));
+        for (u64 i = size; i < newSize; i++) assert(items[i] == 0);
+        memset(items + size, 1, newSize - size);
+        size = newSize;
+    }
+    for (u64 i = 0; i < size; i++) assert(items[i] == 1);
 
-#ifdef MTB_TESTS
-#define MTB_DYNARR_TESTS
-#endif
+    // shrinking and clearing keep the committed pages
+    u64 committed = *arena.committed;
+    assert(mtb_arena_resize(&arena, items, size, 1));
+    mtb_arena_clear(&arena);
+    assert(*arena.committed == committed);
+    items = mtb_arena_bump(&arena, u8, size);
+    assert(items[size - 1] == 0);
+
+    // a copy shares the committed size, what it decommits is committed again by the original
+    MtbArena copy = arena;
+    mtb_arena_clear(&copy, .decommit = true);
+    assert(*arena.committed == 0);
+    mtb_arena_clear(&arena);
+    items = mtb_arena_bump(&arena, u8, size);
+    assert(*arena.committed == committed && items[size - 1] == 0);
+    items[size - 1] = 1;
 
+    mtb_arena_deinit(&arena);
 
-typedef struct mtb_dynarr MtbDynArr;
-struct mtb_dynarr
+    // default reservation
+    mtb_arena_init_reserved(&arena, 0);
+    assert(arena.size == MTB_ARENA_DEF_RESERVE_SIZE);
+    u64 *big = mtb_arena_bump(&arena, u64, mb(4));
+    big[mb(4) - 1] = U64_MAX;
+    assert(*arena.committed == mtb_align_pow2(mb(4) * sizeof(u64), MTB_ARENA_DEF_COMMIT_SIZE));
+    mtb_arena_deinit(&arena);
+}
+
+func void
+_test_mtb_arena_decommit(MtbArenaAllocator *allocator)
 {
-    MtbArena *arena;
-    u8 *items;
-    u64 itemSize;
+    u64 pageSize = (u64)sysconf(_SC_PAGE_SIZE);
+    MtbArena arena = {0};
+    MtbArenaStats stats = {0};
+    mtb_arena_init(&arena, 64 * pageSize, allocator);
+
+    // rewind keeps what's below the offset
+    u64 *kept = mtb_arena_bump(&arena, u64, 1);
+    *kept = U64_MAX;
+    u64 offset = arena.offset;
+    u8 *spike = mtb_arena_bump(&arena, u8, 32 * pageSize);
+    memset(spike, 1, 32 * pageSize);
+    mtb_arena_stats(&arena, &stats);
+    assert(stats.resident >= 32 * pageSize);
+
+    mtb_arena_rewind(&arena, offset, .decommit = true);
+    mtb_arena_stats(&arena, &stats);
+    assert(arena.offset == offset && *kept == U64_MAX);
+    assert(stats.resident <= 2 * pageSize);
+
+    // the pages come back zeroed
+    spike = mtb_arena_bump(&arena, u8, 32 * pageSize);
+    for (u64 i = 0; i < 32 * pageSize; i++) assert(spike[i] == 0);
+    memset(spike, 1, 32 * pageSize);
+
+    // clear keeps the high-water mark resident
+    mtb_arena_clear(&arena, .decommit = true, .keep = 8 * pageSize);
+    mtb_arena_stats(&arena, &stats);
+    assert(arena.offset == 0);
+    assert(stats.resident >= 8 * pageSize && stats.resident <= 10 * pageSize);
+
+    mtb_arena_clear(&arena, .decommit = true);
+    mtb_arena_stats(&arena, &stats);
+    assert(stats.resident <= pageSize);
+
+    mtb_arena_deinit(&arena);
+}
+
+func void
+_test_mtb_arena_decommit_virt(void)
+{
+    _test_mtb_arena_decommit(&MTB_ARENA_DEF_VIRT_ALLOCATOR);
+}
+
+func void
+_test_mtb_arena_decommit_reserved(void)
+{
+    u64 pageSize = (u64)sysconf(_SC_PAGE_SIZE);
+    MtbArenaAllocator allocator = MTB_ARENA_DEF_RESERVE_ALLOCATOR;
+    allocator.ctx = &pageSize;
+    _test_mtb_arena_decommit(&allocator);
+}
+
+func void *
+_test_mtb_counting_alloc(void *ctx, void *ptr, u64 size)
+{
+    *(i64 *)ctx += size > 0 ? 1 : -1; // live allocations
+    return mtb_arena_def_alloc(nil, ptr, size);
+}
+
+func void
+_test_mtb_arena_chained(void)
+{
+    i64 live = 0;
+    MtbArenaAllocator allocator = {
+        .ctx = &live,
+        .alloc = _test_mtb_counting_alloc,
+        .size = mtb_arena_def_size,
+    };
+
+    for (u32 cacheBlocks = 0; cacheBlocks < 2; cacheBlocks++) {
+        MtbArena arena = {0};
+        mtb_arena_init_chained(&arena, kb(1), &allocator, .maxBlockSize = kb(8), .cacheBlocks = cacheBlocks);
+        assert(live == 1);
+        MtbArenaBlock *first = arena.block;
+
+        // fills the first block, then chains doubling ones
+        u64 *items[100];
+        for (u64 i = 0; i < mtb_countof(items); i++) {
+            items[i] = mtb_arena_bump(&arena, u64, 16);
+            for (u64 j = 0; j < 16; j++) assert(items[i][j] == 0);
+            for (u64 j = 0; j < 16; j++) items[i][j] = i;
+        }
+        for (u64 i = 0; i < mtb_countof(items); i++) {
+            for (u64 j = 0; j < 16; j++) assert(items[i][j] == i);
+        }
+        assert(first->next->size == kb(2));
+        assert(arena.block->size == kb(8)); // capped
+        i64 blockCount = live;
+        assert(blockCount > 3);
+
+        // bigger than any block, and aligned
+        u8 *page = mtb_arena_bump(&arena, u8, kb(32), .align = kb(4));
+        assert((u64)page % kb(4) == 0 && arena.block->size >= kb(32));
+        assert(live == blockCount + 1);
+
+        u64 *last = mtb_arena_bump(&arena, u64, 1);
+        assert(!mtb_arena_resize(&arena, last, sizeof(u64), kb(64))); // doesn't fit its block
+
+        mtb_arena_clear(&arena);
+        assert(arena.block == first && arena.offset == 0 && first->next == nil);
+        assert(live == (cacheBlocks ? blockCount + 1 : 1));
+        MtbArenaStats stats = {0};
+        mtb_arena_stats(&arena, &stats);
+        assert(stats.blocks == (u64)live && stats.size >= kb(32) * cacheBlocks);
+
+        // cached blocks are reused
+        for (u64 i = 0; i < mtb_countof(items); i++) {
+            mtb_arena_bump(&arena, u64, 16);
+        }
+        assert(live == (cacheBlocks ? blockCount + 1 : blockCount));
+
+        mtb_arena_deinit(&arena);
+        assert(live == 0);
+    }
+
+    // w/ zeroed blocks, a copy shares the block's mark
+    MtbArena arena = {0};
+    mtb_arena_init_chained(&arena, kb(4), &MTB_ARENA_DEF_VIRT_ALLOCATOR);
+    MtbArena copy = arena;
+    u8 *scribbled = mtb_arena_bump(&copy, u8, kb(1));
+    memset(scribbled, 1, kb(1));
+    u8 *bumped = mtb_arena_bump(&arena, u8, kb(1));
+    assert(bumped == scribbled);
+    for (u64 i = 0; i < kb(1); i++) assert(bumped[i] == 0);
+    mtb_arena_deinit(&arena);
+}
+
+func void
+_test_mtb_arena_temp(void)
+{
+    MtbArena arena = {0};
+    mtb_arena_init(&arena, kb(4), &MTB_ARENA_DEF_ALLOCATOR);
+    mtb_arena_bump(&arena, u64, 1);
+    u64 offset = arena.offset;
+
+    // nested
+    MtbArenaTemp outer = mtb_arena_temp_begin(&arena);
+    mtb_arena_bump(&arena, u64, 10);
+    u64 innerOffset = arena.offset;
+    MtbArenaTemp inner = mtb_arena_temp_begin(&arena);
+    mtb_arena_bump(&arena, u64, 10);
+    mtb_arena_temp_end(&inner);
+    assert(arena.offset == innerOffset);
+    mtb_arena_temp_end(&outer);
+    assert(arena.offset == offset && arena.tempDepth == 0);
+
+    // scoped, released every iteration
+    for (u64 i = 0; i < 100; i++) {
+        mtb_arena_temp_scope(&arena);
+        u64 *scratch = mtb_arena_bump(&arena, u64, 64);
+        assert(scratch[63] == 0);
+        scratch[63] = i + 1;
+    }
+    assert(arena.offset == offset && arena.tempDepth == 0);
+    mtb_arena_deinit(&arena);
+
+    // across chained blocks
+    i64 live = 0;
+    MtbArenaAllocator allocator = {
+        .ctx = &live,
+        .alloc = _test_mtb_counting_alloc,
+        .size = mtb_arena_def_size,
+    };
+    for (u32 cacheBlocks = 0; cacheBlocks < 2; cacheBlocks++) {
+        mtb_arena_init_chained(&arena, kb(1), &allocator, .cacheBlocks = cacheBlocks);
+        mtb_arena_bump(&arena, u8, kb(1) - 8);
+        mtb_arena_bump(&arena, u8, 16); // into a second block
+        MtbArenaBlock *block = arena.block;
+        offset = arena.offset;
+
+        MtbArenaTemp temp = mtb_arena_temp_begin(&arena);
+        for (u64 i = 0; i < 64; i++) {
+            mtb_arena_bump(&arena, u8, kb(1));
+        }
+        i64 blockCount = live;
+        assert(arena.block != block && blockCount > 2);
+        mtb_arena_temp_end(&temp);
+        assert(arena.block == block && arena.offset == offset && block->next == nil);
+        assert(live == (cacheBlocks ? blockCount : 2));
+
+        mtb_arena_deinit(&arena);
+        assert(live == 0);
+    }
+}
+
+func void
+_test_mtb_arena(void)
+{
+    _test_mtb_def_virt_allocator();
+    _test_mtb_def_allocator();
+    _test_mtb_def_reserve_allocator();
+    _test_mtb_arena_reserved();
+    _test_mtb_arena_decommit_virt();
+    _test_mtb_arena_decommit_reserved();
+    _test_mtb_arena_chained();
+    _test_mtb_arena_temp();
+}
+
+#endif // MTB_ARENA_TESTS
+#ifndef MTB_DYNARR_H
+#define MTB_DYNARR_H
+
+#ifdef MTB_IMPLEMENTATION
+#define MTB_DYNARR_IMPLEMENTATION
+#endif
+
+#ifdef MTB_TESTS
+#define MTB_DYNARR_TESTS
+#endif
+
+
+typedef struct mtb_dynarr MtbDynArr;
+struct mtb_dynarr
+{
+    MtbArena *arena;
+    u8 *items;
+    u64 itemSize;
     u64 length;
     u64 capacity;
 };
@@ -1800,6 +2636,11 @@ mtb_dynarr_grow(MtbDynArr *array, u64 capacity)
 {
     mtb_assert_always(capacity > array->capacity);
 
+    // in place if the items are the last allocation, e.g. always in a reserved arena w/ a single array
+    if (array->items != nil && mtb_arena_resize(array->arena, array->items, array->capacity, capacity)) {
+        array->capacity = capacity;
+        return;
+    }
     u8 *oldItems = array->items;
     array->items = mtb_arena_bump(array->arena, u8, capacity);
     if (!mtb_dynarr_is_empty(array)) {
@@ -2044,9 +2885,11 @@ _test_mtb_dynarr_grow(MtbArena arena)
     assert(array.capacity == count * array.itemSize);
     assert(array.length == count);
 
+    u8 *items = array.items;
     mtb_dynarr_insert(&array, array.length);
     assert(array.capacity >= (count + 1) * array.itemSize);
     assert(array.length == count + 1);
+    assert(array.items == items); // the last allocation grows in place
 
     mtb_dynarr_clear(&array);
     assert(array.capacity >= (count + 1) * array.itemSize);
@@ -2507,10 +3350,37 @@ _test_mtb_segarr(void)
 #define MTB_HMAP_MIN_CAPACITY 16
 #endif
 
+#ifndef MTB_HMAP_DEF_MAX_LOAD
+#define MTB_HMAP_DEF_MAX_LOAD 0.75f
+#endif
+
+#ifndef MTB_HMAP_MIGRATE_STEP
+#define MTB_HMAP_MIGRATE_STEP 64 // old slots moved per operation during an incremental resize
+#endif
+
+#ifndef MTB_HMAP_BATCH_SIZE
+#define MTB_HMAP_BATCH_SIZE 32 // keys hashed and prefetched ahead of resolving them
+#endif
+
+#ifndef MTB_HMAP_SMALL_CAPACITY
+#define MTB_HMAP_SMALL_CAPACITY 8 // entries kept w/o hashing in small mode, must be power of 2
+#endif
+
+#define MTB_HMAP_GROUP_WIDTH 16
+
+#ifndef MTB_HMAP_STATS_PROBES
+#define MTB_HMAP_STATS_PROBES 16 // probe length histogram buckets
+#endif
+
+#define MTB_HMAP_FILE_MAGIC 0x5041484d4254424dull // "MBTBMHAP"
+#define MTB_HMAP_FILE_VERSION 2
+#define MTB_HMAP_FILE_ALIGN 4096 // the table starts page aligned in the file
+
 #define mtb_hmap_entry(hmap, index) ((hmap)->entries + (index) * (hmap)->entrySize)
 #define mtb_hmap_entry_header(hmap, entry) ((MtbHmapHeader *)(entry))
 #define mtb_hmap_entry_key(hmap, entry) ((entry) + (hmap)->headerSize)
 #define mtb_hmap_entry_value(hmap, entry) (mtb_hmap_entry_key(hmap, entry) + (hmap)->keySize)
+#define mtb_hmap_entry_hash(hmap, entry) ((u64 *)(mtb_hmap_entry_key(hmap, entry) - sizeof(u64))) // storeHash only
 
 
 typedef u8 MtbHmapEntryStatus;
@@ -2518,7 +3388,24 @@ enum
 {
     MTB_HMAP_ENTRY_FREE = 0,
     MTB_HMAP_ENTRY_OCCUPIED = 1,
-    MTB_HMAP_ENTRY_REMOVED = 2,
+};
+
+// Group probing keeps the entry status in a separate control array,
+// one byte per entry: either EMPTY, DELETED or 7 low bits of the hash.
+typedef u8 MtbHmapCtrl;
+enum
+{
+    MTB_HMAP_CTRL_EMPTY = 0x80,
+    MTB_HMAP_CTRL_DELETED = 0xFE,
+};
+
+typedef u8 MtbHmapProbing;
+enum
+{
+    MTB_HMAP_PROBING_LINEAR = 0, // entry by entry, status interleaved with key and value
+    MTB_HMAP_PROBING_GROUP = 1,  // MTB_HMAP_GROUP_WIDTH control bytes at a time (SSE2 if available)
+    MTB_HMAP_PROBING_ROBIN_HOOD = 2, // linear w/ displacement, status stores probe distance + 1,
+                                     // falls back to linear for good if a distance overflows it (many equal hashes)
 };
 
 typedef struct mtb_hmap_header MtbHmapHeader;
@@ -2534,13 +3421,32 @@ struct mtb_hmap
 
     u64 capacity; // must be power of 2!
     u64 count;
+    u64 deleted; // tombstones, group probing only
+    u64 threshold;
+    f32 maxLoad;
+
+    MtbHmapProbing probing;
+    MtbHmapCtrl *ctrl; // group probing only
+    bool storeHash;
+    bool small; // the first count entries are used and scanned w/o hashing, no ctrl
 
     u64 headerSize;
-    u64 keySize;
+    u64 keySize; // padded to the entry alignment
     u64 valueSize;
     u64 entrySize;
+    u64 keyBytes; // as given to init, what is copied from the caller's key
+    u64 valueBytes;
+    u64 align; // of the entry fields
     u8 *entries;
 
+    // incremental resize only, the previous table while it's being migrated
+    bool incremental;
+    u64 oldCapacity;
+    u8 *oldEntries; // nil when no resize is in progress
+    MtbHmapCtrl *oldCtrl;
+    u64 oldBeg;     // first old slot to migrate, no cluster wraps past it
+    u64 migrated;   // old slots migrated so far
+
     u64 (*key_hash)(void *k);
     bool (*key_equals)(void *k1, void *k2);
 };
@@ -2551,6 +3457,11 @@ struct mtb_hmap_init_options
     u64 capacity;
     u64 keyAlign;
     u64 valueAlign;
+    MtbHmapProbing probing;
+    bool storeHash; // keep the full hash in the entry header
+    f32 maxLoad;    // grow above this load factor, MTB_HMAP_DEF_MAX_LOAD if 0
+    bool incremental; // spread rehashing on grow over the following operations
+    bool small; // start in small mode until more than MTB_HMAP_SMALL_CAPACITY keys, w/ capacity 0 only
 };
 
 
@@ -2576,12 +3487,95 @@ func void mtb_hmap_init_opt(MtbHmap *hmap,
 func void mtb_hmap_clear(MtbHmap *hmap);
 func bool mtb_hmap_is_empty(MtbHmap *hmap);
 func void mtb_hmap_grow(MtbHmap *hmap, u64 capacity);
+func void mtb_hmap_clone(MtbHmap *hmap, MtbArena *arena, MtbHmap *src); // finishes a pending resize of src first
 func u64 mtb_hmap_calc_capacity(u64 n);
 
 func void *mtb_hmap_put(MtbHmap *hmap, void *key);
-func void *mtb_hmap_remove(MtbHmap *hmap, void *key);
+func void *mtb_hmap_upsert(MtbHmap *hmap, void *key, bool *inserted); // put, tells whether the key is new
+// With incremental resize every call may move entries, results are valid until the next call.
+func void *mtb_hmap_remove(MtbHmap *hmap, void *key); // result is valid until the next put/remove
 func void *mtb_hmap_get(MtbHmap *hmap, void *key);
 
+// Same as above w/ the hash already computed, it must be hmap->key_hash(key).
+func void *mtb_hmap_upsert_hashed(MtbHmap *hmap, void *key, u64 hash, bool *inserted);
+func void *mtb_hmap_remove_hashed(MtbHmap *hmap, void *key, u64 hash);
+func void *mtb_hmap_get_hashed(MtbHmap *hmap, void *key, u64 hash);
+
+// Same as put/get for count keys that are keyStride bytes apart, values[i] is the result for the i-th key.
+// Hashing and prefetching a batch ahead overlaps the cache misses of big tables.
+func void mtb_hmap_put_batch(MtbHmap *hmap, void *keys, u64 keyStride, u64 count, void **values);
+func void mtb_hmap_get_batch(MtbHmap *hmap, void *keys, u64 keyStride, u64 count, void **values);
+
+
+/* Diagnostics API */
+
+// Probe lengths and displacements are counted in slots, in groups w/ group probing.
+typedef struct mtb_hmap_stats MtbHmapStats;
+struct mtb_hmap_stats
+{
+    u64 count;
+    u64 capacity;
+    u64 tombstones;
+    u64 bytes; // of the table
+    f64 load;
+
+    u64 probes[MTB_HMAP_STATS_PROBES]; // entries found w/ i + 1 probes, the last bucket counts the longer ones
+    f64 avgDisplacement;
+    u64 maxDisplacement;
+
+    // runs of occupied slots (of groups w/o an empty slot w/ group probing) a miss may walk through
+    u64 clusterCount;
+    f64 avgCluster;
+    u64 maxCluster;
+};
+
+
+// Scans the whole table (finishing a pending incremental resize first).
+func void mtb_hmap_stats(MtbHmap *hmap, MtbHmapStats *stats);
+func void mtb_hmap_stats_print(MtbHmapStats *stats, const char *name); // through the mtb_perf report format
+
+
+/* Snapshot API */
+
+// The table block is written as is after a header w/ the layout parameters, so keys and values
+// must be plain data (no pointers). The file is only portable across the same architecture.
+typedef struct mtb_hmap_file_header MtbHmapFileHeader;
+struct mtb_hmap_file_header
+{
+    u64 magic;
+    u64 version;
+    u64 size; // of the file
+    u64 capacity;
+    u64 count;
+    u64 deleted;
+    u64 probing;
+    u64 storeHash;
+    u64 headerSize;
+    u64 keySize;
+    u64 valueSize;
+    u64 entrySize;
+    u64 keyBytes; // as given to init, checked against the mapping caller's
+    u64 valueBytes;
+    u64 align;
+    u64 ctrlOffset; // from the table, group probing only
+    f32 maxLoad;
+};
+
+
+// Returns false on I/O errors. The map itself changes, the contents don't: a pending incremental
+// resize is finished and a small map is grown out of small mode, so the table is a single block.
+func bool mtb_hmap_save(MtbHmap *hmap, char *path);
+// Maps the file read-only, the map can be queried right away (get, get_batch, iteration)
+// but not modified. keySize and valueSize must be the ones the map was built with, or it fails,
+// key_hash must be the function the map was built with.
+func bool mtb_hmap_map(MtbHmap *hmap,
+                       char *path,
+                       u64 keySize,
+                       u64 valueSize,
+                       u64 (*key_hash)(void *k),
+                       bool (*key_equals)(void *k1, void *k2));
+func void mtb_hmap_unmap(MtbHmap *hmap);
+
 
 /* Iterator API */
 
@@ -2591,6 +3585,8 @@ struct mtb_hmap_iter
     MtbHmap *hmap;
     u8 *prev;
     u8 *next;
+    u64 beg;   // first slot to visit, no cluster wraps past it
+    u64 index; // slots visited so far
 };
 
 
@@ -2602,315 +3598,1565 @@ func void *mtb_hmap_iter_next_key(MtbHmapIter *it);
 func void *mtb_hmap_iter_next_value(MtbHmapIter *it);
 func void *mtb_hmap_iter_remove(MtbHmapIter *it);
 
+
+/* Typed API */
+
+// Generates a linear probing hash map specialized for key type K and value type V,
+// so that key_hash(K *) and key_equals(K *, K *) can be inlined and the entry stride is
+// known at compile time. Expand it once per type pair, after the MTB implementation:
+//
+//     MTB_HMAP_DEFINE(U64Map, u64_map, u64, u64, hash_u64, equals_u64)
+//
+//     U64Map map = {0};
+//     u64_map_init(&map, &arena, 0);
+//     *u64_map_put(&map, &key) += 1;
+//
+#define MTB_HMAP_DEFINE(Name, name, K, V, key_hash, key_equals) \
+    typedef struct name##_entry Name##Entry; \
+    struct name##_entry \
+    { \
+        MtbHmapEntryStatus status; \
+        K key; \
+        V value; \
+    }; \
+    \
+    typedef struct name Name; \
+    struct name \
+    { \
+        MtbArena *arena; \
+        u64 capacity; /* must be power of 2! */ \
+        u64 count; \
+        u64 threshold; \
+        Name##Entry *entries; /* +1 spare entry past the end, holds the removed entry */ \
+    }; \
+    \
+    typedef struct name##_iter Name##Iter; \
+    struct name##_iter \
+    { \
+        Name *hmap; \
+        u64 index; \
+    }; \
+    \
+    func void \
+    name##_init(Name *hmap, MtbArena *arena, u64 capacity) \
+    { \
+        mtb_assert_always(mtb_is_pow2_or_zero(capacity)); \
+        hmap->arena = arena; \
+        hmap->capacity = capacity < MTB_HMAP_MIN_CAPACITY ? MTB_HMAP_MIN_CAPACITY : capacity; \
+        hmap->count = 0; \
+        hmap->threshold = (u64)((f32)hmap->capacity * MTB_HMAP_DEF_MAX_LOAD); \
+        hmap->entries = mtb_arena_bump(arena, Name##Entry, hmap->capacity + 1); \
+    } \
+    \
+    func void \
+    name##_clear(Name *hmap) \
+    { \
+        hmap->count = 0; \
+        memset(hmap->entries, 0, hmap->capacity * sizeof(Name##Entry)); \
+    } \
+    \
+    func Name##Entry * \
+    _##name##_probe(Name *hmap, K *key) /* the key's entry, or the free one ending its cluster */ \
+    { \
+        u64 mask = hmap->capacity - 1; \
+        u64 index = key_hash(key) & mask; \
+        Name##Entry *entry = hmap->entries + index; \
+        while (entry->status == MTB_HMAP_ENTRY_OCCUPIED && !key_equals(&entry->key, key)) { \
+            index = (index + 1) & mask; \
+            entry = hmap->entries + index; \
+        } \
+        return entry; \
+    } \
+    \
+    func void \
+    name##_grow(Name *hmap, u64 capacity) \
+    { \
+        mtb_assert_always(mtb_is_pow2(capacity)); \
+        mtb_assert_always(capacity > hmap->capacity); \
+        \
+        Name oldHmap = *hmap; \
+        u64 oldSize = (oldHmap.capacity + 1) * sizeof(Name##Entry); \
+        u64 size = mtb_mul_u64(capacity + 1, sizeof(Name##Entry)); \
+        \
+        /* same as mtb_hmap_grow, rehash behind the last arena allocation and move down */ \
+        bool inPlace = mtb_arena_resize(hmap->arena, oldHmap.entries, oldSize, mtb_add_u64(oldSize, size)); \
+        hmap->entries = inPlace ? oldHmap.entries + oldHmap.capacity + 1 : mtb_arena_bump(hmap->arena, Name##Entry, capacity + 1); \
+        hmap->capacity = capacity; \
+        hmap->threshold = (u64)((f32)capacity * MTB_HMAP_DEF_MAX_LOAD); \
+        \
+        for (u64 oldIndex = 0; oldIndex < oldHmap.capacity; oldIndex++) { \
+            Name##Entry *oldEntry = oldHmap.entries + oldIndex; \
+            if (oldEntry->status == MTB_HMAP_ENTRY_OCCUPIED) { \
+                *_##name##_probe(hmap, &oldEntry->key) = *oldEntry; \
+            } \
+        } \
+        \
+        if (inPlace) { \
+            memmove(oldHmap.entries, hmap->entries, size); \
+            mtb_arena_resize(hmap->arena, oldHmap.entries, oldSize + size, size); \
+            hmap->entries = oldHmap.entries; \
+        } \
+    } \
+    \
+    func V * \
+    name##_upsert(Name *hmap, K *key, bool *inserted) \
+    { \
+        if (hmap->count >= hmap->threshold) { \
+            name##_grow(hmap, hmap->capacity << 1); \
+        } \
+        Name##Entry *entry = _##name##_probe(hmap, key); \
+        *inserted = entry->status == MTB_HMAP_ENTRY_FREE; \
+        if (*inserted) { \
+            memset(entry, 0, sizeof(Name##Entry)); \
+            entry->status = MTB_HMAP_ENTRY_OCCUPIED; \
+            entry->key = *key; \
+            hmap->count++; \
+        } \
+        return &entry->value; \
+    } \
+    \
+    func V * \
+    name##_put(Name *hmap, K *key) \
+    { \
+        bool inserted; \
+        return name##_upsert(hmap, key, &inserted); \
+    } \
+    \
+    func V * \
+    name##_remove(Name *hmap, K *key) /* result is valid until the next put/remove */ \
+    { \
+        Name##Entry *entry = _##name##_probe(hmap, key); \
+        if (entry->status == MTB_HMAP_ENTRY_FREE) { \
+            return nil; \
+        } \
+        Name##Entry *removed = hmap->entries + hmap->capacity; \
+        *removed = *entry; \
+        \
+        /* backward shift, see _mtb_hmap_linear_erase */ \
+        u64 mask = hmap->capacity - 1; \
+        u64 hole = (u64)(entry - hmap->entries); \
+        for (u64 index = (hole + 1) & mask; hmap->entries[index].status == MTB_HMAP_ENTRY_OCCUPIED; index = (index + 1) & mask) { \
+            u64 home = key_hash(&hmap->entries[index].key) & mask; \
+            if (((index - home) & mask) >= ((index - hole) & mask)) { \
+                hmap->entries[hole] = hmap->entries[index]; \
+                hole = index; \
+            } \
+        } \
+        hmap->entries[hole].status = MTB_HMAP_ENTRY_FREE; \
+        hmap->count--; \
+        return &removed->value; \
+    } \
+    \
+    func V * \
+    name##_get(Name *hmap, K *key) \
+    { \
+        Name##Entry *entry = _##name##_probe(hmap, key); \
+        return entry->status == MTB_HMAP_ENTRY_FREE ? nil : &entry->value; \
+    } \
+    \
+    func void \
+    name##_iter_init(Name##Iter *it, Name *hmap) \
+    { \
+        it->hmap = hmap; \
+        it->index = 0; \
+    } \
+    \
+    func bool \
+    name##_iter_has_next(Name##Iter *it) \
+    { \
+        for (; it->index < it->hmap->capacity; it->index++) { \
+            if (it->hmap->entries[it->index].status == MTB_HMAP_ENTRY_OCCUPIED) { \
+                return true; \
+            } \
+        } \
+        return false; \
+    } \
+    \
+    func Name##Entry * \
+    name##_iter_next(Name##Iter *it) \
+    { \
+        mtb_assert_always(it->index < it->hmap->capacity); \
+        return it->hmap->entries + it->index++; \
+    }
+
 #endif //MTB_HMAP_H
 
 
 #ifdef MTB_HMAP_IMPLEMENTATION
 
-#define _mtb_hmap_threshold(capacity) ((capacity) - ((capacity) >> 2)) // 0.75 * capacity
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+#define _mtb_hmap_threshold(capacity, maxLoad) ((u64)((f32)(capacity) * (maxLoad)))
 #define _mtb_hmap_modulo_capacity(hmap, n) ((n) & ((hmap)->capacity - 1))
+#define _mtb_hmap_entry_index(hmap, entry) ((u64)((entry) - (hmap)->entries) / (hmap)->entrySize)
 
+#define _mtb_hmap_h1(hash) ((hash) >> 7)
+#define _mtb_hmap_h2(hash) ((MtbHmapCtrl)((hash) & 0x7F))
+#define _mtb_hmap_ctrl_is_full(c) ((c) < MTB_HMAP_CTRL_EMPTY)
+#define _mtb_hmap_group_mask(hmap) (((hmap)->capacity / MTB_HMAP_GROUP_WIDTH) - 1)
+#define _mtb_hmap_group_ctrl(hmap, group) ((hmap)->ctrl + (group) * MTB_HMAP_GROUP_WIDTH)
 
-func void
-mtb_hmap_init_opt(MtbHmap *hmap,
-                  MtbArena *arena,
-                  u64 keySize,
-                  u64 valueSize,
-                  u64 (*key_hash)(void *k),
-                  bool (*key_equals)(void *k1, void *k2),
-                  MtbHmapInitOptions opt)
-{
-    mtb_assert_always(mtb_is_pow2_or_zero(opt.capacity));
-    mtb_assert_always(mtb_is_pow2_or_zero(keySize));
-    mtb_assert_always(mtb_is_pow2_or_zero(opt.keyAlign));
-    mtb_assert_always(mtb_is_pow2_or_zero(valueSize));
-    mtb_assert_always(mtb_is_pow2_or_zero(opt.valueAlign));
+#define _MTB_HMAP_ROBIN_HOOD_MAX_STATUS 0xFF
 
-    hmap->arena = arena;
 
-    hmap->capacity = opt.capacity < MTB_HMAP_MIN_CAPACITY ? MTB_HMAP_MIN_CAPACITY : opt.capacity;
-    hmap->count = 0;
+func u32
+_mtb_hmap_group_match(MtbHmapCtrl *group, MtbHmapCtrl ctrl)
+{
+#ifdef __SSE2__
+    __m128i bytes = _mm_load_si128((__m128i *)group);
+    return (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8((char)ctrl)));
+#else
+    u32 mask = 0;
+    for (u32 i = 0; i < MTB_HMAP_GROUP_WIDTH; i++) {
+        mask |= (u32)(group[i] == ctrl) << i;
+    }
+    return mask;
+#endif
+}
 
-    u64 align = mtb_max_u64(mtb_alignof(MtbHmapHeader), mtb_max_u64(opt.keyAlign, opt.valueAlign));
-    hmap->headerSize = mtb_align_pow2(sizeof(MtbHmapHeader), align);
-    hmap->keySize = mtb_align_pow2(keySize, align);
-    hmap->valueSize = mtb_align_pow2(valueSize, align);
-    hmap->entrySize = hmap->headerSize + hmap->keySize + hmap->valueSize;
+func u32
+_mtb_hmap_group_match_empty_or_deleted(MtbHmapCtrl *group)
+{
+#ifdef __SSE2__
+    return (u32)_mm_movemask_epi8(_mm_load_si128((__m128i *)group));
+#else
+    u32 mask = 0;
+    for (u32 i = 0; i < MTB_HMAP_GROUP_WIDTH; i++) {
+        mask |= (u32)(group[i] >> 7) << i;
+    }
+    return mask;
+#endif
+}
 
-    hmap->entries = mtb_arena_bump(hmap->arena, u8, hmap->capacity * hmap->entrySize);
+// Entries and control bytes live in a single block: [entries] [spare entry] [ctrl (group probing only)]
+func u64
+_mtb_hmap_block_size(MtbHmap *hmap)
+{
+    // +1 spare entry past the end, holds removed or swapped entries
+    u64 entriesSize = mtb_mul_u64(hmap->capacity + 1, hmap->entrySize);
+    if (hmap->probing != MTB_HMAP_PROBING_GROUP || hmap->small) {
+        return entriesSize;
+    }
+    return mtb_add_u64(mtb_align_pow2(entriesSize, MTB_HMAP_GROUP_WIDTH), hmap->capacity);
+}
 
-    hmap->key_hash = key_hash;
-    hmap->key_equals = key_equals;
+func void
+_mtb_hmap_init_block(MtbHmap *hmap, u8 *block) // block must be zeroed
+{
+    hmap->entries = block;
+    hmap->threshold = hmap->small ? hmap->capacity : _mtb_hmap_threshold(hmap->capacity, hmap->maxLoad);
+    if (hmap->probing == MTB_HMAP_PROBING_GROUP && !hmap->small) {
+        hmap->ctrl = block + mtb_align_pow2((hmap->capacity + 1) * hmap->entrySize, MTB_HMAP_GROUP_WIDTH);
+        memset(hmap->ctrl, MTB_HMAP_CTRL_EMPTY, hmap->capacity);
+    }
 }
 
 func void
-mtb_hmap_clear(MtbHmap *hmap)
+_mtb_hmap_alloc(MtbHmap *hmap)
 {
-    hmap->count = 0;
-    memset(hmap->entries, 0, hmap->capacity * hmap->entrySize);
+    _mtb_hmap_init_block(hmap, mtb_arena_bump(hmap->arena, u8, _mtb_hmap_block_size(hmap), .align = MTB_HMAP_GROUP_WIDTH));
 }
 
 func bool
-mtb_hmap_is_empty(MtbHmap *hmap)
+_mtb_hmap_is_occupied(MtbHmap *hmap, u64 index)
 {
-    return hmap->count == 0;
+    if (hmap->small) {
+        return index < hmap->count;
+    }
+    if (hmap->probing == MTB_HMAP_PROBING_GROUP) {
+        return _mtb_hmap_ctrl_is_full(hmap->ctrl[index]);
+    }
+    return mtb_hmap_entry_header(hmap, mtb_hmap_entry(hmap, index))->status != MTB_HMAP_ENTRY_FREE;
 }
 
-func u64
-mtb_hmap_calc_capacity(u64 n)
+func bool
+_mtb_hmap_entry_matches(MtbHmap *hmap, u8 *entry, void *key, u64 hash)
 {
-    u64 capacity = n + (n / 3);
-    if (capacity < MTB_HMAP_MIN_CAPACITY) {
-        return MTB_HMAP_MIN_CAPACITY;
+    if (hmap->storeHash && *mtb_hmap_entry_hash(hmap, entry) != hash) {
+        return false;
     }
-    return mtb_roundup_pow2(capacity);
+    return hmap->key_equals(mtb_hmap_entry_key(hmap, entry), key);
 }
 
-func void
-mtb_hmap_grow(MtbHmap *hmap, u64 capacity)
+func u64
+_mtb_hmap_entry_rehash(MtbHmap *hmap, u8 *entry)
 {
-    mtb_perf_time_func();
-    mtb_assert_always(mtb_is_pow2(capacity));
-    mtb_assert_always(capacity > hmap->capacity);
-
-    MtbHmap oldHmap = *hmap;
-
-    hmap->count = 0;
-    hmap->capacity = capacity;
-    hmap->entries = mtb_arena_bump(hmap->arena, u8, hmap->capacity * hmap->entrySize);
+    // small mode doesn't fill in the stored hash
+    return hmap->storeHash && !hmap->small ? *mtb_hmap_entry_hash(hmap, entry) : hmap->key_hash(mtb_hmap_entry_key(hmap, entry));
+}
 
-    for (u64 oldIndex = 0; oldIndex < oldHmap.capacity; oldIndex++) {
-        u8 *oldEntry = mtb_hmap_entry(&oldHmap, oldIndex);
-        if (mtb_hmap_entry_header(&oldHmap, oldEntry)->status != MTB_HMAP_ENTRY_OCCUPIED) {
-            continue;
-        }
-        u64 hash = hmap->key_hash(mtb_hmap_entry_key(&oldHmap, oldEntry));
-        u64 index = _mtb_hmap_modulo_capacity(hmap, hash);
-        u8 *entry = mtb_hmap_entry(hmap, index);
-        while (mtb_hmap_entry_header(hmap, entry)->status == MTB_HMAP_ENTRY_OCCUPIED) {
-            index = _mtb_hmap_modulo_capacity(hmap, index + 1);
-            entry = mtb_hmap_entry(hmap, index);
+func u8 *
+_mtb_hmap_linear_find(MtbHmap *hmap, void *key, u64 hash)
+{
+    u64 index = _mtb_hmap_modulo_capacity(hmap, hash);
+    u8 *entry = mtb_hmap_entry(hmap, index);
+    while (mtb_hmap_entry_header(hmap, entry)->status == MTB_HMAP_ENTRY_OCCUPIED) {
+        if (_mtb_hmap_entry_matches(hmap, entry, key, hash)) {
+            return entry;
         }
-        memcpy(entry, oldEntry, hmap->entrySize);
-        hmap->count++;
+        index = _mtb_hmap_modulo_capacity(hmap, index + 1);
+        entry = mtb_hmap_entry(hmap, index);
     }
+    return nil;
 }
 
-func void *
-mtb_hmap_put(MtbHmap *hmap, void *key)
+func u8 *
+_mtb_hmap_linear_insert(MtbHmap *hmap, void *key, u64 hash, bool *inserted)
 {
-    mtb_perf_time_func();
-    if (hmap->count >= _mtb_hmap_threshold(hmap->capacity)) {
-        mtb_hmap_grow(hmap, hmap->capacity << 1);
-    }
-    u64 hash = hmap->key_hash(key);
     u64 index = _mtb_hmap_modulo_capacity(hmap, hash);
     u8 *entry = mtb_hmap_entry(hmap, index);
     while (mtb_hmap_entry_header(hmap, entry)->status == MTB_HMAP_ENTRY_OCCUPIED) {
-        if (hmap->key_equals(mtb_hmap_entry_key(hmap, entry), key)) {
-            return mtb_hmap_entry_value(hmap, entry);
+        if (key != nil && _mtb_hmap_entry_matches(hmap, entry, key, hash)) {
+            *inserted = false;
+            return entry;
         }
         index = _mtb_hmap_modulo_capacity(hmap, index + 1);
         entry = mtb_hmap_entry(hmap, index);
     }
     mtb_hmap_entry_header(hmap, entry)->status = MTB_HMAP_ENTRY_OCCUPIED;
-    memcpy(mtb_hmap_entry_key(hmap, entry), key, hmap->keySize);
-    hmap->count++;
-    return mtb_hmap_entry_value(hmap, entry);
+    *inserted = true;
+    return entry;
+}
+
+func u8 *
+_mtb_hmap_linear_erase(MtbHmap *hmap, u8 *entry)
+{
+    u8 *removed = mtb_hmap_entry(hmap, hmap->capacity);
+    memcpy(removed, entry, hmap->entrySize);
+
+    // Backward shift: pull every following entry of the cluster that
+    // may live in the hole closer to its home slot, so no tombstones.
+    u64 hole = _mtb_hmap_entry_index(hmap, entry);
+    u64 index = _mtb_hmap_modulo_capacity(hmap, hole + 1);
+    u8 *next = mtb_hmap_entry(hmap, index);
+    while (mtb_hmap_entry_header(hmap, next)->status == MTB_HMAP_ENTRY_OCCUPIED) {
+        u64 home = _mtb_hmap_modulo_capacity(hmap, _mtb_hmap_entry_rehash(hmap, next));
+        if (_mtb_hmap_modulo_capacity(hmap, index - home) >= _mtb_hmap_modulo_capacity(hmap, index - hole)) {
+            memcpy(mtb_hmap_entry(hmap, hole), next, hmap->entrySize);
+            hole = index;
+        }
+        index = _mtb_hmap_modulo_capacity(hmap, index + 1);
+        next = mtb_hmap_entry(hmap, index);
+    }
+    mtb_hmap_entry_header(hmap, mtb_hmap_entry(hmap, hole))->status = MTB_HMAP_ENTRY_FREE;
+
+    return removed;
 }
 
-func void *
-mtb_hmap_remove(MtbHmap *hmap, void *key)
+func u8 *
+_mtb_hmap_robin_hood_find(MtbHmap *hmap, void *key, u64 hash)
 {
-    u64 hash = hmap->key_hash(key);
     u64 index = _mtb_hmap_modulo_capacity(hmap, hash);
-    u8 *entry = mtb_hmap_entry(hmap, index);
-    while (mtb_hmap_entry_header(hmap, entry)->status != MTB_HMAP_ENTRY_FREE) {
-        if (mtb_hmap_entry_header(hmap, entry)->status != MTB_HMAP_ENTRY_REMOVED) {
-            if (hmap->key_equals(mtb_hmap_entry_key(hmap, entry), key)) {
-                mtb_hmap_entry_header(hmap, entry)->status = MTB_HMAP_ENTRY_REMOVED;
-                hmap->count--;
-                return mtb_hmap_entry_value(hmap, entry);
-            }
+    for (u64 status = MTB_HMAP_ENTRY_OCCUPIED; ; status++) {
+        u8 *entry = mtb_hmap_entry(hmap, index);
+        u64 entryStatus = mtb_hmap_entry_header(hmap, entry)->status;
+        if (entryStatus < status) {
+            return nil; // free, or closer to its home than the key would be
+        }
+        if (entryStatus == status && _mtb_hmap_entry_matches(hmap, entry, key, hash)) {
+            return entry;
         }
         index = _mtb_hmap_modulo_capacity(hmap, index + 1);
-        entry = mtb_hmap_entry(hmap, index);
     }
-    return nil;
 }
 
-func void *
-mtb_hmap_get(MtbHmap *hmap, void *key)
+// Returns nil if some probe distance would no longer fit the status.
+func u8 *
+_mtb_hmap_robin_hood_insert(MtbHmap *hmap, void *key, u64 hash, bool *inserted)
 {
-    mtb_perf_time_func();
-    u64 hash = hmap->key_hash(key);
     u64 index = _mtb_hmap_modulo_capacity(hmap, hash);
-    u8 *entry = mtb_hmap_entry(hmap, index);
-    while (mtb_hmap_entry_header(hmap, entry)->status != MTB_HMAP_ENTRY_FREE) {
-        if (mtb_hmap_entry_header(hmap, entry)->status != MTB_HMAP_ENTRY_REMOVED) {
-            if (hmap->key_equals(mtb_hmap_entry_key(hmap, entry), key)) {
-                return mtb_hmap_entry_value(hmap, entry);
-            }
+    u64 status = MTB_HMAP_ENTRY_OCCUPIED;
+    for (;; status++) {
+        u8 *entry = mtb_hmap_entry(hmap, index);
+        u64 entryStatus = mtb_hmap_entry_header(hmap, entry)->status;
+        if (entryStatus < status) {
+            break;
+        }
+        if (key != nil && entryStatus == status && _mtb_hmap_entry_matches(hmap, entry, key, hash)) {
+            *inserted = false;
+            return entry;
         }
         index = _mtb_hmap_modulo_capacity(hmap, index + 1);
-        entry = mtb_hmap_entry(hmap, index);
     }
-    return nil;
+    if (status > _MTB_HMAP_ROBIN_HOOD_MAX_STATUS) {
+        return nil;
+    }
+
+    // Take the slot from the richer entry by shifting the rest of the
+    // cluster one slot forward, each shifted entry gets one step further.
+    u64 last = index;
+    MtbHmapEntryStatus lastStatus;
+    while ((lastStatus = mtb_hmap_entry_header(hmap, mtb_hmap_entry(hmap, last))->status) != MTB_HMAP_ENTRY_FREE) {
+        if (lastStatus == _MTB_HMAP_ROBIN_HOOD_MAX_STATUS) {
+            return nil;
+        }
+        last = _mtb_hmap_modulo_capacity(hmap, last + 1);
+    }
+    while (last != index) {
+        u64 prev = _mtb_hmap_modulo_capacity(hmap, last - 1);
+        u8 *entry = mtb_hmap_entry(hmap, last);
+        memcpy(entry, mtb_hmap_entry(hmap, prev), hmap->entrySize);
+        mtb_hmap_entry_header(hmap, entry)->status++;
+        last = prev;
+    }
+
+    u8 *entry = mtb_hmap_entry(hmap, index);
+    mtb_hmap_entry_header(hmap, entry)->status = (MtbHmapEntryStatus)status;
+    *inserted = true;
+    return entry;
+}
+
+func u8 *
+_mtb_hmap_robin_hood_erase(MtbHmap *hmap, u8 *entry)
+{
+    u8 *removed = mtb_hmap_entry(hmap, hmap->capacity);
+    memcpy(removed, entry, hmap->entrySize);
+
+    // Backward shift until an entry already sits in its home slot.
+    u64 hole = _mtb_hmap_entry_index(hmap, entry);
+    u64 index = _mtb_hmap_modulo_capacity(hmap, hole + 1);
+    u8 *next = mtb_hmap_entry(hmap, index);
+    while (mtb_hmap_entry_header(hmap, next)->status > MTB_HMAP_ENTRY_OCCUPIED) {
+        u8 *holeEntry = mtb_hmap_entry(hmap, hole);
+        memcpy(holeEntry, next, hmap->entrySize);
+        mtb_hmap_entry_header(hmap, holeEntry)->status--;
+        hole = index;
+        index = _mtb_hmap_modulo_capacity(hmap, index + 1);
+        next = mtb_hmap_entry(hmap, index);
+    }
+    mtb_hmap_entry_header(hmap, mtb_hmap_entry(hmap, hole))->status = MTB_HMAP_ENTRY_FREE;
+
+    return removed;
 }
 
-func void
-mtb_hmap_iter_init(MtbHmapIter *it, MtbHmap *hmap)
+func u8 *
+_mtb_hmap_group_find(MtbHmap *hmap, void *key, u64 hash)
 {
-    it->hmap = hmap;
-    mtb_hmap_iter_reset(it);
+    u64 groupMask = _mtb_hmap_group_mask(hmap);
+    u64 group = _mtb_hmap_h1(hash) & groupMask;
+    MtbHmapCtrl h2 = _mtb_hmap_h2(hash);
+    for (u64 step = 0; step <= groupMask; step++) {
+        MtbHmapCtrl *ctrl = _mtb_hmap_group_ctrl(hmap, group);
+        for (u32 match = _mtb_hmap_group_match(ctrl, h2); match != 0; match &= match - 1) {
+            u8 *entry = mtb_hmap_entry(hmap, group * MTB_HMAP_GROUP_WIDTH + mtb_trailing_zeros_count(match));
+            if (_mtb_hmap_entry_matches(hmap, entry, key, hash)) {
+                return entry;
+            }
+        }
+        if (_mtb_hmap_group_match(ctrl, MTB_HMAP_CTRL_EMPTY) != 0) {
+            break;
+        }
+        group = (group + step + 1) & groupMask; // triangular, visits every group
+    }
+    return nil;
 }
 
-func void
-mtb_hmap_iter_reset(MtbHmapIter *it)
+func u64
+_mtb_hmap_group_find_available(MtbHmap *hmap, u64 hash)
+{
+    u64 groupMask = _mtb_hmap_group_mask(hmap);
+    u64 group = _mtb_hmap_h1(hash) & groupMask;
+    for (u64 step = 0; step <= groupMask; step++) {
+        u32 available = _mtb_hmap_group_match_empty_or_deleted(_mtb_hmap_group_ctrl(hmap, group));
+        if (available != 0) {
+            return group * MTB_HMAP_GROUP_WIDTH + mtb_trailing_zeros_count(available);
+        }
+        group = (group + step + 1) & groupMask;
+    }
+    mtb_invalid;
+    return U64_MAX;
+}
+
+func u8 *
+_mtb_hmap_group_insert(MtbHmap *hmap, void *key, u64 hash, bool *inserted)
 {
-    it->prev = nil;
-    it->next = nil;
+    if (key != nil) {
+        u8 *entry = _mtb_hmap_group_find(hmap, key, hash);
+        if (entry != nil) {
+            *inserted = false;
+            return entry;
+        }
+    }
+    // the second pass only reads control bytes, mostly of the same group
+    u64 slot = _mtb_hmap_group_find_available(hmap, hash);
+    if (hmap->ctrl[slot] == MTB_HMAP_CTRL_DELETED) {
+        hmap->deleted--;
+    }
+    hmap->ctrl[slot] = _mtb_hmap_h2(hash);
+    *inserted = true;
+    return mtb_hmap_entry(hmap, slot);
 }
 
-func bool
-mtb_hmap_iter_has_next(MtbHmapIter *it)
+func u8 *
+_mtb_hmap_group_erase(MtbHmap *hmap, u8 *entry)
 {
-    u8 *next = it->prev == nil ? it->hmap->entries : it->prev + it->hmap->entrySize;
-    u8 *end = it->hmap->entries + it->hmap->capacity * it->hmap->entrySize;
-    while (next < end) {
-        if (mtb_hmap_entry_header(it->hmap, next)->status == MTB_HMAP_ENTRY_OCCUPIED) {
-            it->next = next;
-            return true;
+    // If the group still has an EMPTY slot, no probe sequence has ever
+    // continued past it, so the slot can become EMPTY instead of DELETED.
+    u64 index = _mtb_hmap_entry_index(hmap, entry);
+    MtbHmapCtrl *group = _mtb_hmap_group_ctrl(hmap, index / MTB_HMAP_GROUP_WIDTH);
+    if (_mtb_hmap_group_match(group, MTB_HMAP_CTRL_EMPTY) != 0) {
+        hmap->ctrl[index] = MTB_HMAP_CTRL_EMPTY;
+    }
+    else {
+        hmap->ctrl[index] = MTB_HMAP_CTRL_DELETED;
+        hmap->deleted++;
+    }
+    return entry;
+}
+
+func void
+_mtb_hmap_group_drop_deleted(MtbHmap *hmap)
+{
+    // Rehash without growing: turn tombstones into EMPTY and mark every
+    // live entry as DELETED (pending), then move each pending entry to
+    // the first available slot of its probe sequence.
+    for (u64 index = 0; index < hmap->capacity; index++) {
+        bool isFull = _mtb_hmap_ctrl_is_full(hmap->ctrl[index]);
+        hmap->ctrl[index] = isFull ? MTB_HMAP_CTRL_DELETED : MTB_HMAP_CTRL_EMPTY;
+    }
+    u8 *spare = mtb_hmap_entry(hmap, hmap->capacity);
+    u64 index = 0;
+    while (index < hmap->capacity) {
+        if (hmap->ctrl[index] != MTB_HMAP_CTRL_DELETED) {
+            index++;
+            continue;
+        }
+        u8 *entry = mtb_hmap_entry(hmap, index);
+        u64 hash = _mtb_hmap_entry_rehash(hmap, entry);
+        u64 slot = _mtb_hmap_group_find_available(hmap, hash);
+        if (slot / MTB_HMAP_GROUP_WIDTH == index / MTB_HMAP_GROUP_WIDTH) {
+            hmap->ctrl[index] = _mtb_hmap_h2(hash);
+            index++;
+            continue;
+        }
+        u8 *target = mtb_hmap_entry(hmap, slot);
+        if (hmap->ctrl[slot] == MTB_HMAP_CTRL_EMPTY) {
+            memcpy(target, entry, hmap->entrySize);
+            hmap->ctrl[index] = MTB_HMAP_CTRL_EMPTY;
+            index++;
+        }
+        else {
+            // the target is pending too, swap and process it at this index
+            memcpy(spare, target, hmap->entrySize);
+            memcpy(target, entry, hmap->entrySize);
+            memcpy(entry, spare, hmap->entrySize);
         }
-        next += it->hmap->entrySize;
+        hmap->ctrl[slot] = _mtb_hmap_h2(hash);
     }
-    return false;
+    hmap->deleted = 0;
 }
 
-func void *
-mtb_hmap_iter_next(MtbHmapIter *it)
+func u8 *
+_mtb_hmap_small_find(MtbHmap *hmap, void *key)
 {
-    mtb_assert_always(it->next != nil);
-    it->prev = it->next;
-    it->next = nil;
-    return it->prev;
+    for (u64 index = 0; index < hmap->count; index++) {
+        u8 *entry = mtb_hmap_entry(hmap, index);
+        if (hmap->key_equals(mtb_hmap_entry_key(hmap, entry), key)) {
+            return entry;
+        }
+    }
+    return nil;
 }
 
-func void *
-mtb_hmap_iter_next_key(MtbHmapIter *it)
+// Returns nil if the key is missing and there is no room left,
+// the map has left small mode then.
+func u8 *
+_mtb_hmap_small_insert(MtbHmap *hmap, void *key, bool *inserted)
 {
-    return mtb_hmap_entry_key(it->hmap, mtb_hmap_iter_next(it));
+    u8 *entry = _mtb_hmap_small_find(hmap, key);
+    if (entry != nil) {
+        *inserted = false;
+        return entry;
+    }
+    if (hmap->count == hmap->capacity) {
+        mtb_hmap_grow(hmap, mtb_hmap_calc_capacity(hmap->capacity + 1));
+        return nil;
+    }
+    entry = mtb_hmap_entry(hmap, hmap->count);
+    memcpy(mtb_hmap_entry_key(hmap, entry), key, hmap->keyBytes);
+    memset(mtb_hmap_entry_value(hmap, entry), 0, hmap->valueSize);
+    hmap->count++;
+    *inserted = true;
+    return entry;
 }
 
-func void *
-mtb_hmap_iter_next_value(MtbHmapIter *it)
+func u8 *
+_mtb_hmap_small_erase(MtbHmap *hmap, u8 *entry)
 {
-    return mtb_hmap_entry_value(it->hmap, mtb_hmap_iter_next(it));
+    // swap with the last one to keep the entries dense
+    u8 *removed = mtb_hmap_entry(hmap, hmap->capacity);
+    memcpy(removed, entry, hmap->entrySize);
+    u8 *last = mtb_hmap_entry(hmap, hmap->count - 1);
+    if (entry != last) {
+        memcpy(entry, last, hmap->entrySize);
+    }
+    return removed;
 }
 
-func void *
-mtb_hmap_iter_remove(MtbHmapIter *it)
+func u8 *
+_mtb_hmap_find(MtbHmap *hmap, void *key, u64 hash)
 {
-    mtb_assert_always(it->prev != nil);
-    mtb_hmap_entry_header(it->hmap, it->prev)->status = MTB_HMAP_ENTRY_REMOVED;
-    it->hmap->count--;
-    return it->prev;
+    switch (hmap->probing) {
+        case MTB_HMAP_PROBING_LINEAR: return _mtb_hmap_linear_find(hmap, key, hash);
+        case MTB_HMAP_PROBING_GROUP: return _mtb_hmap_group_find(hmap, key, hash);
+        case MTB_HMAP_PROBING_ROBIN_HOOD: return _mtb_hmap_robin_hood_find(hmap, key, hash);
+        default: mtb_invalid;
+    }
+    return nil;
 }
 
-#endif // MTB_HMAP_IMPLEMENTATION
+// Returns the entry that holds the key, inserting it if missing.
+// If the key is nil the lookup is skipped and a free slot is claimed.
+// Returns nil if a probe distance would overflow the status (robin hood only).
+func u8 *
+_mtb_hmap_insert(MtbHmap *hmap, void *key, u64 hash, bool *inserted)
+{
+    u8 *entry = nil;
+    *inserted = false;
+    switch (hmap->probing) {
+        case MTB_HMAP_PROBING_LINEAR: entry = _mtb_hmap_linear_insert(hmap, key, hash, inserted); break;
+        case MTB_HMAP_PROBING_GROUP: entry = _mtb_hmap_group_insert(hmap, key, hash, inserted); break;
+        case MTB_HMAP_PROBING_ROBIN_HOOD: entry = _mtb_hmap_robin_hood_insert(hmap, key, hash, inserted); break;
+        default: mtb_invalid;
+    }
+    if (*inserted && hmap->storeHash) {
+        *mtb_hmap_entry_hash(hmap, entry) = hash;
+    }
+    return entry;
+}
+
+// Returns the entry that holds the removed key and value.
+func u8 *
+_mtb_hmap_erase(MtbHmap *hmap, u8 *entry)
+{
+    u8 *removed = nil;
+    if (hmap->small) {
+        removed = _mtb_hmap_small_erase(hmap, entry);
+    }
+    else {
+        switch (hmap->probing) {
+            case MTB_HMAP_PROBING_LINEAR: removed = _mtb_hmap_linear_erase(hmap, entry); break;
+            case MTB_HMAP_PROBING_GROUP: removed = _mtb_hmap_group_erase(hmap, entry); break;
+            case MTB_HMAP_PROBING_ROBIN_HOOD: removed = _mtb_hmap_robin_hood_erase(hmap, entry); break;
+            default: mtb_invalid;
+        }
+    }
+    hmap->count--;
+    return removed;
+}
 
+// A robin hood table is a valid linear one once every status is just occupied,
+// the old table of a pending incremental resize included.
+func void
+_mtb_hmap_robin_hood_to_linear(MtbHmap *hmap)
+{
+    mtb_assert(hmap->probing == MTB_HMAP_PROBING_ROBIN_HOOD && !hmap->small);
 
-#ifdef MTB_HMAP_TESTS
+    u8 *tables[] = { hmap->entries, hmap->oldEntries };
+    u64 capacities[] = { hmap->capacity, hmap->oldCapacity };
+    for (u64 t = 0; t < mtb_countof(tables); t++) {
+        for (u64 index = 0; tables[t] != nil && index < capacities[t]; index++) {
+            MtbHmapHeader *header = (MtbHmapHeader *)(tables[t] + index * hmap->entrySize);
+            if (header->status != MTB_HMAP_ENTRY_FREE) {
+                header->status = MTB_HMAP_ENTRY_OCCUPIED;
+            }
+        }
+    }
+    hmap->probing = MTB_HMAP_PROBING_LINEAR;
+}
 
-#include <assert.h>
+func MtbHmap
+_mtb_hmap_old(MtbHmap *hmap)
+{
+    MtbHmap oldHmap = *hmap;
+    oldHmap.capacity = hmap->oldCapacity;
+    oldHmap.entries = hmap->oldEntries;
+    oldHmap.ctrl = hmap->oldCtrl;
+    return oldHmap;
+}
 
+// Falls back to linear probing on a robin hood distance overflow, so a
+// copy of the old table taken before may carry a stale probing mode.
+func void
+_mtb_hmap_move(MtbHmap *hmap, MtbHmap *oldHmap, u8 *oldEntry)
+{
+    bool inserted;
+    u64 hash = _mtb_hmap_entry_rehash(oldHmap, oldEntry);
+    u8 *entry = _mtb_hmap_insert(hmap, nil, hash, &inserted);
+    if (entry == nil) {
+        _mtb_hmap_robin_hood_to_linear(hmap); // a bigger table wouldn't help equal hashes
+        entry = _mtb_hmap_insert(hmap, nil, hash, &inserted);
+    }
+    memcpy(mtb_hmap_entry_key(hmap, entry), mtb_hmap_entry_key(oldHmap, oldEntry), hmap->keySize + hmap->valueSize);
+}
 
-func u64
-_calc_hash_str(void *key)
+func void
+_mtb_hmap_migrate(MtbHmap *hmap, u64 slots)
 {
-    char *s = *(char **)key;
-    u64 hash = 0;
-    while (*s != '\0') hash = 17000069 * hash + *s++;
-    return hash;
+    if (hmap->oldEntries == nil) {
+        return;
+    }
+    MtbHmap oldHmap = _mtb_hmap_old(hmap);
+    u64 end = slots < oldHmap.capacity - hmap->migrated ? hmap->migrated + slots : oldHmap.capacity;
+    for (; hmap->migrated < oldHmap.capacity; hmap->migrated++) {
+        u64 oldIndex = _mtb_hmap_modulo_capacity(&oldHmap, hmap->oldBeg + hmap->migrated);
+        bool occupied = _mtb_hmap_is_occupied(&oldHmap, oldIndex);
+        if (!occupied && hmap->migrated >= end) {
+            break; // stop between clusters only, lookups in the old table still work
+        }
+        if (occupied) {
+            u8 *oldEntry = mtb_hmap_entry(&oldHmap, oldIndex);
+            _mtb_hmap_move(hmap, &oldHmap, oldEntry);
+            // no backward shift, the rest of the cluster goes in this call too
+            if (oldHmap.probing == MTB_HMAP_PROBING_GROUP) {
+                oldHmap.ctrl[oldIndex] = MTB_HMAP_CTRL_DELETED;
+            }
+            else {
+                mtb_hmap_entry_header(&oldHmap, oldEntry)->status = MTB_HMAP_ENTRY_FREE;
+            }
+        }
+    }
+    if (hmap->migrated == oldHmap.capacity) {
+        hmap->oldCapacity = 0;
+        hmap->oldEntries = nil;
+        hmap->oldCtrl = nil;
+    }
+}
+
+func void
+_mtb_hmap_grow_incremental(MtbHmap *hmap, u64 capacity)
+{
+    mtb_assert_always(hmap->oldEntries == nil);
+
+    hmap->oldCapacity = hmap->capacity;
+    hmap->oldEntries = hmap->entries;
+    hmap->oldCtrl = hmap->ctrl;
+    hmap->oldBeg = 0;
+    if (hmap->probing != MTB_HMAP_PROBING_GROUP) {
+        while (_mtb_hmap_is_occupied(hmap, hmap->oldBeg)) {
+            hmap->oldBeg++;
+        }
+    }
+    hmap->migrated = 0;
+
+    hmap->capacity = capacity;
+    hmap->deleted = 0;
+    _mtb_hmap_alloc(hmap);
+}
+
+// Entry layout from the probing mode and storeHash.
+func void
+_mtb_hmap_layout(MtbHmap *hmap, u64 keySize, u64 valueSize, u64 align)
+{
+    // header: [status (linear probing only)] [hash (storeHash only)]
+    align = mtb_max_u64(align, mtb_alignof(MtbHmapHeader));
+    u64 headerSize = hmap->probing == MTB_HMAP_PROBING_GROUP ? 0 : sizeof(MtbHmapHeader);
+    if (hmap->storeHash) {
+        align = mtb_max_u64(align, mtb_alignof(u64));
+        headerSize = mtb_align_pow2(headerSize, mtb_alignof(u64)) + sizeof(u64);
+    }
+    hmap->headerSize = mtb_align_pow2(headerSize, align);
+    hmap->keySize = mtb_align_pow2(keySize, align);
+    hmap->valueSize = mtb_align_pow2(valueSize, align);
+    hmap->entrySize = hmap->headerSize + hmap->keySize + hmap->valueSize;
+    hmap->keyBytes = keySize;
+    hmap->valueBytes = valueSize;
+    hmap->align = align;
+}
+
+func void
+mtb_hmap_init_opt(MtbHmap *hmap,
+                  MtbArena *arena,
+                  u64 keySize,
+                  u64 valueSize,
+                  u64 (*key_hash)(void *k),
+                  bool (*key_equals)(void *k1, void *k2),
+                  MtbHmapInitOptions opt)
+{
+    mtb_assert_always(mtb_is_pow2_or_zero(opt.capacity));
+    mtb_assert_always(mtb_is_pow2_or_zero(keySize));
+    mtb_assert_always(mtb_is_pow2_or_zero(opt.keyAlign));
+    mtb_assert_always(mtb_is_pow2_or_zero(valueSize));
+    mtb_assert_always(mtb_is_pow2_or_zero(opt.valueAlign));
+    mtb_assert_always(opt.probing <= MTB_HMAP_PROBING_ROBIN_HOOD);
+    mtb_assert_always(0.0f <= opt.maxLoad && opt.maxLoad < 1.0f);
+
+    hmap->arena = arena;
+
+    hmap->small = opt.small && opt.capacity == 0;
+    if (hmap->small) {
+        hmap->capacity = MTB_HMAP_SMALL_CAPACITY;
+    }
+    else {
+        hmap->capacity = opt.capacity < MTB_HMAP_MIN_CAPACITY ? MTB_HMAP_MIN_CAPACITY : opt.capacity;
+    }
+    hmap->count = 0;
+    hmap->deleted = 0;
+    hmap->maxLoad = opt.maxLoad == 0.0f ? MTB_HMAP_DEF_MAX_LOAD : opt.maxLoad;
+
+    hmap->probing = opt.probing;
+    hmap->ctrl = nil;
+    hmap->storeHash = opt.storeHash;
+
+    hmap->incremental = opt.incremental;
+    hmap->oldCapacity = 0;
+    hmap->oldEntries = nil;
+    hmap->oldCtrl = nil;
+    hmap->oldBeg = 0;
+    hmap->migrated = 0;
+
+    _mtb_hmap_layout(hmap, keySize, valueSize, mtb_max_u64(opt.keyAlign, opt.valueAlign));
+
+    _mtb_hmap_alloc(hmap);
+
+    hmap->key_hash = key_hash;
+    hmap->key_equals = key_equals;
+}
+
+func void
+mtb_hmap_clear(MtbHmap *hmap)
+{
+    hmap->count = 0;
+    hmap->deleted = 0;
+    hmap->oldCapacity = 0;
+    hmap->oldEntries = nil;
+    hmap->oldCtrl = nil;
+    memset(hmap->entries, 0, hmap->capacity * hmap->entrySize);
+    if (hmap->ctrl != nil) {
+        memset(hmap->ctrl, MTB_HMAP_CTRL_EMPTY, hmap->capacity);
+    }
 }
 
 func bool
-_is_equal_str(void *key1, void *key2)
+mtb_hmap_is_empty(MtbHmap *hmap)
 {
-    char *s1 = *(char **)key1;
-    char *s2 = *(char **)key2;
-    return strcmp(s1, s2) == 0;
+    return hmap->count == 0;
+}
+
+func u64
+mtb_hmap_calc_capacity(u64 n)
+{
+    u64 capacity = n + (n / 3);
+    if (capacity < MTB_HMAP_MIN_CAPACITY) {
+        return MTB_HMAP_MIN_CAPACITY;
+    }
+    return mtb_roundup_pow2(capacity);
 }
 
 func void
-_test_mtb_hmap_calc_capacity(void)
+mtb_hmap_grow(MtbHmap *hmap, u64 capacity)
 {
-    for (u64 i = 0; i <= _mtb_hmap_threshold(MTB_HMAP_MIN_CAPACITY); i++) {
-        assert(mtb_hmap_calc_capacity(i) == MTB_HMAP_MIN_CAPACITY);
+    mtb_assert_always(mtb_is_pow2(capacity));
+    mtb_assert_always(capacity > hmap->capacity);
+
+    _mtb_hmap_migrate(hmap, U64_MAX);
+
+    MtbHmap oldHmap = *hmap;
+    u64 oldSize = _mtb_hmap_block_size(&oldHmap);
+
+    hmap->capacity = capacity;
+    hmap->deleted = 0;
+    hmap->small = false; // for good
+    u64 size = _mtb_hmap_block_size(hmap);
+
+    // When the table is the last arena allocation, rehash right behind it,
+    // then move the new table down over the old one.
+    u64 tail = mtb_align_pow2(oldSize, MTB_HMAP_GROUP_WIDTH);
+    bool inPlace = mtb_arena_resize(hmap->arena, oldHmap.entries, oldSize, mtb_add_u64(tail, size));
+    if (inPlace) {
+        _mtb_hmap_init_block(hmap, oldHmap.entries + tail);
     }
-    assert(mtb_hmap_calc_capacity(_mtb_hmap_threshold(MTB_HMAP_MIN_CAPACITY) + 1) == 32);
-    assert(mtb_hmap_calc_capacity(MTB_HMAP_MIN_CAPACITY) == 32);
-    assert(mtb_hmap_calc_capacity(45) == 64);
-    assert(mtb_hmap_calc_capacity(100) == 256);
-    assert(mtb_hmap_calc_capacity(200) == 512);
-    assert(mtb_hmap_calc_capacity(400) == 1024);
+    else {
+        _mtb_hmap_alloc(hmap);
+    }
+
+    for (u64 oldIndex = 0; oldIndex < oldHmap.capacity; oldIndex++) {
+        if (!_mtb_hmap_is_occupied(&oldHmap, oldIndex)) {
+            continue;
+        }
+        _mtb_hmap_move(hmap, &oldHmap, mtb_hmap_entry(&oldHmap, oldIndex));
+    }
+
+    if (inPlace) {
+        memmove(oldHmap.entries, hmap->entries, size);
+        mtb_arena_resize(hmap->arena, oldHmap.entries, tail + size, size);
+        hmap->entries -= tail;
+        if (hmap->ctrl != nil) {
+            hmap->ctrl -= tail;
+        }
+    }
+}
+
+func u8 *
+_mtb_hmap_put_hashed(MtbHmap *hmap, void *key, u64 hash, bool *inserted)
+{
+    u8 *entry = _mtb_hmap_insert(hmap, key, hash, inserted);
+    if (entry == nil) {
+        _mtb_hmap_robin_hood_to_linear(hmap);
+        entry = _mtb_hmap_insert(hmap, key, hash, inserted);
+    }
+    if (*inserted) {
+        memcpy(mtb_hmap_entry_key(hmap, entry), key, hmap->keyBytes);
+        memset(mtb_hmap_entry_value(hmap, entry), 0, hmap->valueSize);
+        hmap->count++;
+    }
+    return entry;
+}
+
+func u8 *
+_mtb_hmap_lookup(MtbHmap *hmap, void *key, u64 hash)
+{
+    if (hmap->small) {
+        return _mtb_hmap_small_find(hmap, key);
+    }
+    u8 *entry = _mtb_hmap_find(hmap, key, hash);
+    if (entry == nil && hmap->oldEntries != nil) {
+        MtbHmap oldHmap = _mtb_hmap_old(hmap);
+        entry = _mtb_hmap_find(&oldHmap, key, hash);
+    }
+    return entry;
 }
 
 func void
-_test_mtb_hmap_put(MtbArena arena)
+_mtb_hmap_prefetch(MtbHmap *hmap, u64 hash)
 {
-    char *text = "Lorem ipsum dolor sit amet consectetuer adipiscing elit Pellentesque ipsum Fusce"
-                 " dui leo imperdiet in aliquam sit amet feugiat eu orci Etiam neque Fusce consect"
-                 "etuer risus a nunc Cum sociis natoque penatibus et magnis dis parturient montes "
-                 "nascetur ridiculus mus Donec quis nibh at felis congue commodo Nullam sit amet m"
-                 "agna in magna gravida vehicula Curabitur vitae diam non enim vestibulum interdum"
-                 " Donec iaculis gravida nulla Etiam sapien elit consequat eget tristique non vene"
-                 "natis quis ante Fusce tellus Morbi scelerisque luctus velit Maecenas ipsum velit"
-                 " consectetuer eu lobortis ut dictum at dui Fusce tellus Proin in tellus sit amet"
-                 " nibh dignissim sagittis Et harum quidem rerum facilis est et expedita distincti"
-                 "o Nullam at arcu a est sollicitudin euismod Vivamus luctus egestas leo Suspendis"
-                 "se sagittis ultrices augueFusce consectetuer risus a nunc Proin mattis lacinia j"
-                 "usto Mauris metus Inlaoreet magna id viverra tincidunt sem odio bibendum justo v"
-                 "el imperdiet sapien wisi sed libero Mauris dolor felis sagittis at luctus sed al"
-                 "iquam non tellus Nam libero tempore cum soluta nobis est eligendi optio cumque n"
-                 "ihil impedit quo minus id quod maxime placeat facere possimus omnis voluptas ass"
-                 "umenda est omnis dolor repellendus Cras elementum Nullam dapibus fermentum ipsum"
-                 " Aliquam erat volutpat Curabitur sagittis hendrerit ante Nunc dapibus tortor vel"
-                 " mi dapibus sollicitudin Nunc auctor Neque porro quisquam est quidolorem ipsum q"
-                 "uia dolor sit amet consectetur adipisci velit sed quia non numquam eius modi tem"
-                 "pora incidunt ut labore et dolore magnam aliquam quaerat voluptatem Maecenas fer"
-                 "mentum sem in pharetra pellentesque velit turpis volutpat ante in pharetra metus"
-                 " odio a lectus Nam sed tellus id magna elementum tincidunt Fusce consectetuer ri"
-                 "sus a nunc Nulla turpis magna cursus sit amet suscipit a interdum id felis Excep"
-                 "teur sint occaecat cupidatat non proident sunt in culpa qui officia deserunt mol"
-                 "lit anim id est laborum Mauris elementum mauris vitae tortor Aliquam erat volutp"
-                 "at In rutrum Temporibus autemquibusdam et aut officiis debitis aut rerum necessi"
-                 "tatibus saepe eveniet ut et voluptates repudiandae sint et molestiae non recusan"
-                 "dae Vivamus ac leo pretium faucibus Class aptent taciti sociosqu ad litora torqu"
-                 "ent per conubia nostra per inceptos hymenaeos Etiam commodo dui eget wisi Etiam "
-                 "dictum tincidunt diam Nullam eget nisl Itaque earum rerum hic tenetur a sapiente"
-                 " delectus ut aut reiciendis voluptatibus maiores alias consequatur aut perferend"
-                 "is doloribus asperiores repellat Phasellus rhoncus Duis viverra diam non justo S"
-                 "ed convallis magna eu sem Proin pede metus vulputate nec fermentum fringilla veh"
-                 "icula vitae justo Maecenas ipsum velit consectetuer eu lobortis ut dictum at dui"
-                 " Nullam lectus justo vulputate eget mollis sed tempor sed magna Nullam feugiat t"
-                 "urpis at pulvinar vulputate erat libero tristique tellus necbibendum odio risus "
-                 "sit amet ante Etiam sapien elit consequat eget tristique non venenatis quis ante"
-                 " Nulla est Nullam faucibus mi quis velit Duis condimentum augue id magna semper "
-                 "rutrum Aliquam erat volutpat Mauris metus Phasellus enim erat vestibulum vel ali"
-                 "quam a posuere eu velit Donec ipsummassa ullamcorper in auctor et scelerisque se"
-                 "d est Lorem ipsum dolor sitamet consectetuer adipiscing elit Curabitur bibendum "
-                 "justo non orci Sed elit dui pellentesque a faucibus vel interdum nec diam Fusce "
-                 "consectetuer risus a nunc Cras pede libero dapibus nec pretium sit amet tempor q"
-                 "uis Maecenas lorem Morbi imperdiet mauris ac auctor dictum nisl ligula egestas n"
-                 "ulla et sollicitudin sem purus in lacus Curabitur sagittis hendrerit ante Nullam"
-                 " faucibus mi quis velit Nullam justo enim consectetuer nec ullamcorper ac vestib"
-                 "ulum in elit Suspendisse sagittis ultrices augue Etiam dictum tincidunt diam Pro"
-                 "in mattis lacinia justo Quisque porta Maecenas ipsum velit consectetuer eu lobor"
-                 "tis ut dictum at dui";
-    // echo text | tr ' ' '\n' | sort | uniq -c | sort -nrk1
-    struct histogram {
-        char *word;
+    if (hmap->probing == MTB_HMAP_PROBING_GROUP) {
+        u64 group = _mtb_hmap_h1(hash) & _mtb_hmap_group_mask(hmap);
+        mtb_prefetch(_mtb_hmap_group_ctrl(hmap, group));
+        mtb_prefetch(mtb_hmap_entry(hmap, group * MTB_HMAP_GROUP_WIDTH));
+    }
+    else {
+        mtb_prefetch(mtb_hmap_entry(hmap, _mtb_hmap_modulo_capacity(hmap, hash)));
+    }
+}
+
+func void
+_mtb_hmap_reserve(MtbHmap *hmap, u64 n)
+{
+    _mtb_hmap_migrate(hmap, U64_MAX);
+    u64 count = mtb_add_u64(hmap->count, n);
+    if (count + hmap->deleted < hmap->threshold) {
+        return;
+    }
+    if (hmap->deleted > 0) {
+        _mtb_hmap_group_drop_deleted(hmap);
+    }
+    u64 capacity = hmap->capacity;
+    while (_mtb_hmap_threshold(capacity, hmap->maxLoad) <= count) {
+        capacity <<= 1;
+    }
+    if (capacity > hmap->capacity) {
+        mtb_hmap_grow(hmap, capacity);
+    }
+}
+
+func void
+mtb_hmap_clone(MtbHmap *hmap, MtbArena *arena, MtbHmap *src)
+{
+    _mtb_hmap_migrate(src, U64_MAX);
+
+    *hmap = *src;
+    hmap->arena = arena;
+    u64 size = _mtb_hmap_block_size(src);
+    hmap->entries = mtb_arena_bump(arena, u8, size, .align = MTB_HMAP_GROUP_WIDTH, .no_zero = true);
+    memcpy(hmap->entries, src->entries, size);
+    if (src->ctrl != nil) {
+        hmap->ctrl = hmap->entries + (src->ctrl - src->entries);
+    }
+}
+
+func void *
+mtb_hmap_put(MtbHmap *hmap, void *key)
+{
+    bool inserted;
+    return mtb_hmap_upsert(hmap, key, &inserted);
+}
+
+func void *
+mtb_hmap_upsert(MtbHmap *hmap, void *key, bool *inserted)
+{
+    if (hmap->small) {
+        u8 *entry = _mtb_hmap_small_insert(hmap, key, inserted);
+        if (entry != nil) {
+            return mtb_hmap_entry_value(hmap, entry);
+        }
+    }
+    return mtb_hmap_upsert_hashed(hmap, key, hmap->key_hash(key), inserted);
+}
+
+func void *
+mtb_hmap_upsert_hashed(MtbHmap *hmap, void *key, u64 hash, bool *inserted)
+{
+    mtb_assert(hmap->arena != nil); // not a mapped snapshot
+    if (hmap->small) {
+        u8 *entry = _mtb_hmap_small_insert(hmap, key, inserted);
+        if (entry != nil) {
+            return mtb_hmap_entry_value(hmap, entry);
+        }
+    }
+    _mtb_hmap_migrate(hmap, MTB_HMAP_MIGRATE_STEP);
+    if (hmap->count + hmap->deleted >= hmap->threshold) {
+        _mtb_hmap_migrate(hmap, U64_MAX);
+        if (hmap->count < hmap->threshold / 2) {
+            _mtb_hmap_group_drop_deleted(hmap); // mostly tombstones
+        }
+        else if (hmap->incremental) {
+            _mtb_hmap_grow_incremental(hmap, hmap->capacity << 1);
+        }
+        else {
+            mtb_hmap_grow(hmap, hmap->capacity << 1);
+        }
+    }
+    if (hmap->oldEntries != nil) {
+        // not migrated yet, move it over so that it's found below
+        MtbHmap oldHmap = _mtb_hmap_old(hmap);
+        u8 *oldEntry = _mtb_hmap_find(&oldHmap, key, hash);
+        if (oldEntry != nil) {
+            _mtb_hmap_move(hmap, &oldHmap, oldEntry);
+            oldHmap = _mtb_hmap_old(hmap); // may be linear now
+            _mtb_hmap_erase(&oldHmap, oldEntry);
+        }
+    }
+    return mtb_hmap_entry_value(hmap, _mtb_hmap_put_hashed(hmap, key, hash, inserted));
+}
+
+func void *
+mtb_hmap_remove(MtbHmap *hmap, void *key)
+{
+    return mtb_hmap_remove_hashed(hmap, key, hmap->small ? 0 : hmap->key_hash(key)); // not hashed in small mode
+}
+
+func void *
+mtb_hmap_remove_hashed(MtbHmap *hmap, void *key, u64 hash)
+{
+    mtb_assert(hmap->arena != nil);
+    _mtb_hmap_migrate(hmap, MTB_HMAP_MIGRATE_STEP);
+    u8 *entry = hmap->small ? _mtb_hmap_small_find(hmap, key) : _mtb_hmap_find(hmap, key, hash);
+    if (entry != nil) {
+        return mtb_hmap_entry_value(hmap, _mtb_hmap_erase(hmap, entry));
+    }
+    if (hmap->oldEntries != nil) {
+        MtbHmap oldHmap = _mtb_hmap_old(hmap);
+        entry = _mtb_hmap_find(&oldHmap, key, hash);
+        if (entry != nil) {
+            hmap->count--;
+            return mtb_hmap_entry_value(hmap, _mtb_hmap_erase(&oldHmap, entry));
+        }
+    }
+    return nil;
+}
+
+func void *
+mtb_hmap_get(MtbHmap *hmap, void *key)
+{
+    return mtb_hmap_get_hashed(hmap, key, hmap->small ? 0 : hmap->key_hash(key)); // not hashed in small mode
+}
+
+func void *
+mtb_hmap_get_hashed(MtbHmap *hmap, void *key, u64 hash)
+{
+    _mtb_hmap_migrate(hmap, MTB_HMAP_MIGRATE_STEP);
+    u8 *entry = _mtb_hmap_lookup(hmap, key, hash);
+    return entry == nil ? nil : mtb_hmap_entry_value(hmap, entry);
+}
+
+func void
+mtb_hmap_put_batch(MtbHmap *hmap, void *keys, u64 keyStride, u64 count, void **values)
+{
+    // room for all keys up front, so earlier results stay valid,
+    // unless robin hood inserts shift them, then they're all looked up again at the end
+    _mtb_hmap_reserve(hmap, count);
+    bool shifts = hmap->probing == MTB_HMAP_PROBING_ROBIN_HOOD;
+    if (hmap->small) {
+        for (u64 i = 0; i < count; i++) {
+            values[i] = mtb_hmap_put(hmap, (u8 *)keys + i * keyStride);
+        }
+        return;
+    }
+
+    u64 hashes[MTB_HMAP_BATCH_SIZE];
+    for (u64 beg = 0; beg < count; beg += MTB_HMAP_BATCH_SIZE) {
+        u64 end = mtb_min_u64(beg + MTB_HMAP_BATCH_SIZE, count);
+        for (u64 i = beg; i < end; i++) {
+            hashes[i - beg] = hmap->key_hash((u8 *)keys + i * keyStride);
+            _mtb_hmap_prefetch(hmap, hashes[i - beg]);
+        }
+        for (u64 i = beg; i < end; i++) {
+            bool inserted;
+            u8 *entry = _mtb_hmap_put_hashed(hmap, (u8 *)keys + i * keyStride, hashes[i - beg], &inserted);
+            values[i] = mtb_hmap_entry_value(hmap, entry);
+        }
+    }
+    if (shifts) {
+        mtb_hmap_get_batch(hmap, keys, keyStride, count, values);
+    }
+}
+
+func void
+mtb_hmap_get_batch(MtbHmap *hmap, void *keys, u64 keyStride, u64 count, void **values)
+{
+    _mtb_hmap_migrate(hmap, MTB_HMAP_MIGRATE_STEP);
+    if (hmap->small) {
+        for (u64 i = 0; i < count; i++) {
+            values[i] = mtb_hmap_get(hmap, (u8 *)keys + i * keyStride);
+        }
+        return;
+    }
+
+    u64 hashes[MTB_HMAP_BATCH_SIZE];
+    for (u64 beg = 0; beg < count; beg += MTB_HMAP_BATCH_SIZE) {
+        u64 end = mtb_min_u64(beg + MTB_HMAP_BATCH_SIZE, count);
+        for (u64 i = beg; i < end; i++) {
+            hashes[i - beg] = hmap->key_hash((u8 *)keys + i * keyStride);
+            _mtb_hmap_prefetch(hmap, hashes[i - beg]);
+        }
+        for (u64 i = beg; i < end; i++) {
+            u8 *entry = _mtb_hmap_lookup(hmap, (u8 *)keys + i * keyStride, hashes[i - beg]);
+            values[i] = entry == nil ? nil : mtb_hmap_entry_value(hmap, entry);
+        }
+    }
+}
+
+// Groups visited by the triangular probe sequence before reaching the entry's group.
+func u64
+_mtb_hmap_group_displacement(MtbHmap *hmap, u64 index, u64 hash)
+{
+    u64 groupMask = _mtb_hmap_group_mask(hmap);
+    u64 target = index / MTB_HMAP_GROUP_WIDTH;
+    u64 group = _mtb_hmap_h1(hash) & groupMask;
+    u64 step = 0;
+    for (; group != target; step++) {
+        group = (group + step + 1) & groupMask;
+    }
+    return step;
+}
+
+// A slot, or a group w/o an empty slot w/ group probing.
+func bool
+_mtb_hmap_stats_is_full(MtbHmap *hmap, u64 unit)
+{
+    if (hmap->probing == MTB_HMAP_PROBING_GROUP) {
+        return _mtb_hmap_group_match(_mtb_hmap_group_ctrl(hmap, unit), MTB_HMAP_CTRL_EMPTY) == 0;
+    }
+    return _mtb_hmap_is_occupied(hmap, unit);
+}
+
+func void
+mtb_hmap_stats(MtbHmap *hmap, MtbHmapStats *stats)
+{
+    _mtb_hmap_migrate(hmap, U64_MAX);
+
+    *stats = (MtbHmapStats){
+        .count = hmap->count,
+        .capacity = hmap->capacity,
+        .tombstones = hmap->deleted,
+        .bytes = _mtb_hmap_block_size(hmap),
+        .load = (f64)hmap->count / (f64)hmap->capacity,
+    };
+    if (hmap->small) {
+        return; // nothing is probed
+    }
+
+    u64 totalDisplacement = 0;
+    for (u64 index = 0; index < hmap->capacity; index++) {
+        if (!_mtb_hmap_is_occupied(hmap, index)) {
+            continue;
+        }
+        u64 hash = _mtb_hmap_entry_rehash(hmap, mtb_hmap_entry(hmap, index));
+        u64 displacement = hmap->probing == MTB_HMAP_PROBING_GROUP
+                               ? _mtb_hmap_group_displacement(hmap, index, hash)
+                               : _mtb_hmap_modulo_capacity(hmap, index - hash);
+        stats->probes[mtb_min_u64(displacement, MTB_HMAP_STATS_PROBES - 1)]++;
+        stats->maxDisplacement = mtb_max_u64(stats->maxDisplacement, displacement);
+        totalDisplacement += displacement;
+    }
+    if (hmap->count > 0) {
+        stats->avgDisplacement = (f64)totalDisplacement / (f64)hmap->count;
+    }
+
+    // clusters, starting right after a free unit so that none is split by the wrap around
+    u64 units = hmap->probing == MTB_HMAP_PROBING_GROUP ? hmap->capacity / MTB_HMAP_GROUP_WIDTH : hmap->capacity;
+    u64 start = 0;
+    while (start < units - 1 && _mtb_hmap_stats_is_full(hmap, start)) {
+        start++;
+    }
+    u64 run = 0;
+    u64 totalRun = 0;
+    for (u64 i = 1; i <= units; i++) {
+        bool full = _mtb_hmap_stats_is_full(hmap, (start + i) % units);
+        run += full;
+        if ((!full || i == units) && run > 0) {
+            stats->clusterCount++;
+            stats->maxCluster = mtb_max_u64(stats->maxCluster, run);
+            totalRun += run;
+            run = 0;
+        }
+    }
+    if (stats->clusterCount > 0) {
+        stats->avgCluster = (f64)totalRun / (f64)stats->clusterCount;
+    }
+}
+
+func void
+mtb_hmap_stats_print(MtbHmapStats *stats, const char *name)
+{
+    mtb_perf_print_block(name);
+    mtb_perf_print_u64("count", stats->count);
+    mtb_perf_print_u64("capacity", stats->capacity);
+    mtb_perf_print_f64("load", stats->load);
+    mtb_perf_print_u64("bytes", stats->bytes);
+    mtb_perf_print_u64("tombstones", stats->tombstones);
+    for (u64 i = 0; i < MTB_HMAP_STATS_PROBES; i++) {
+        if (stats->probes[i] > 0) {
+            char label[32];
+            snprintf(label, sizeof(label), "probes %lu%s", i + 1, i == MTB_HMAP_STATS_PROBES - 1 ? "+" : "");
+            mtb_perf_print_u64(label, stats->probes[i]);
+        }
+    }
+    mtb_perf_print_f64("avg displacement", stats->avgDisplacement);
+    mtb_perf_print_u64("max displacement", stats->maxDisplacement);
+    mtb_perf_print_u64("clusters", stats->clusterCount);
+    mtb_perf_print_f64("avg cluster", stats->avgCluster);
+    mtb_perf_print_u64("max cluster", stats->maxCluster);
+}
+
+func bool
+mtb_hmap_save(MtbHmap *hmap, char *path)
+{
+    _mtb_hmap_migrate(hmap, U64_MAX);
+    if (hmap->small) {
+        mtb_hmap_grow(hmap, mtb_hmap_calc_capacity(hmap->capacity + 1));
+    }
+
+    u64 blockSize = _mtb_hmap_block_size(hmap);
+    MtbHmapFileHeader header = {
+        .magic = MTB_HMAP_FILE_MAGIC,
+        .version = MTB_HMAP_FILE_VERSION,
+        .size = MTB_HMAP_FILE_ALIGN + blockSize,
+        .capacity = hmap->capacity,
+        .count = hmap->count,
+        .deleted = hmap->deleted,
+        .probing = hmap->probing,
+        .storeHash = hmap->storeHash,
+        .headerSize = hmap->headerSize,
+        .keySize = hmap->keySize,
+        .valueSize = hmap->valueSize,
+        .entrySize = hmap->entrySize,
+        .keyBytes = hmap->keyBytes,
+        .valueBytes = hmap->valueBytes,
+        .align = hmap->align,
+        .ctrlOffset = hmap->ctrl == nil ? 0 : (u64)(hmap->ctrl - hmap->entries),
+        .maxLoad = hmap->maxLoad,
+    };
+    u8 page[MTB_HMAP_FILE_ALIGN] = {0};
+    memcpy(page, &header, sizeof(header));
+
+    FILE *file = fopen(path, "wb");
+    if (file == nil) {
+        return false;
+    }
+    bool ok = fwrite(page, 1, sizeof(page), file) == sizeof(page) &&
+              fwrite(hmap->entries, 1, blockSize, file) == blockSize;
+    return fclose(file) == 0 && ok;
+}
+
+func bool
+mtb_hmap_map(MtbHmap *hmap,
+             char *path,
+             u64 keySize,
+             u64 valueSize,
+             u64 (*key_hash)(void *k),
+             bool (*key_equals)(void *k1, void *k2))
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (u64)st.st_size < MTB_HMAP_FILE_ALIGN) {
+        close(fd);
+        return false;
+    }
+    u64 size = (u64)st.st_size;
+    u8 *base = mmap(nil, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return false;
+    }
+
+    MtbHmapFileHeader *header = (MtbHmapFileHeader *)base;
+    MtbHmap mapped = {
+        .capacity = header->capacity,
+        .count = header->count,
+        .deleted = header->deleted,
+        .maxLoad = header->maxLoad,
+        .probing = (MtbHmapProbing)header->probing,
+        .storeHash = header->storeHash != 0,
+        .headerSize = header->headerSize,
+        .keySize = header->keySize,
+        .valueSize = header->valueSize,
+        .entrySize = header->entrySize,
+        .entries = base + MTB_HMAP_FILE_ALIGN,
+        .key_hash = key_hash,
+        .key_equals = key_equals,
+    };
+    mapped.threshold = _mtb_hmap_threshold(mapped.capacity, mapped.maxLoad);
+    if (mapped.probing == MTB_HMAP_PROBING_GROUP) {
+        mapped.ctrl = mapped.entries + header->ctrlOffset;
+    }
+
+    // the layout must be the one init gives the caller's key and value for the stored options
+    MtbHmap layout = { .probing = mapped.probing, .storeHash = mapped.storeHash };
+    bool valid = header->magic == MTB_HMAP_FILE_MAGIC &&
+                 header->version == MTB_HMAP_FILE_VERSION &&
+                 header->size == size &&
+                 header->probing <= MTB_HMAP_PROBING_ROBIN_HOOD &&
+                 header->keyBytes == keySize &&
+                 header->valueBytes == valueSize &&
+                 mtb_is_pow2(header->align) && header->align <= MTB_HMAP_FILE_ALIGN;
+    if (valid) {
+        _mtb_hmap_layout(&layout, keySize, valueSize, header->align);
+        valid = layout.align == header->align &&
+                layout.headerSize == mapped.headerSize &&
+                layout.keySize == mapped.keySize &&
+                layout.valueSize == mapped.valueSize &&
+                layout.entrySize == mapped.entrySize;
+        mapped.keyBytes = keySize;
+        mapped.valueBytes = valueSize;
+        mapped.align = layout.align;
+    }
+    // group loads read MTB_HMAP_GROUP_WIDTH aligned control bytes, up to the last group
+    u64 ctrlOffset = mtb_align_pow2((mapped.capacity + 1) * mapped.entrySize, MTB_HMAP_GROUP_WIDTH);
+    valid = valid &&
+            mapped.capacity >= MTB_HMAP_MIN_CAPACITY &&
+            mtb_is_pow2_or_zero(mapped.capacity) &&
+            mapped.entrySize > 0 &&
+            mapped.capacity < U64_MAX / 2 / mapped.entrySize &&
+            MTB_HMAP_FILE_ALIGN + _mtb_hmap_block_size(&mapped) == size &&
+            (mapped.ctrl == nil ||
+             (header->ctrlOffset == ctrlOffset &&
+              ctrlOffset + mtb_align_pow2(mapped.capacity, MTB_HMAP_GROUP_WIDTH) <= size - MTB_HMAP_FILE_ALIGN));
+    if (!valid) {
+        munmap(base, size);
+        return false;
+    }
+    *hmap = mapped;
+    return true;
+}
+
+func void
+mtb_hmap_unmap(MtbHmap *hmap)
+{
+    mtb_assert_always(hmap->arena == nil && hmap->entries != nil);
+    u8 *base = hmap->entries - MTB_HMAP_FILE_ALIGN;
+    munmap(base, ((MtbHmapFileHeader *)base)->size);
+    hmap->entries = nil;
+    hmap->ctrl = nil;
+}
+
+func void
+mtb_hmap_iter_init(MtbHmapIter *it, MtbHmap *hmap)
+{
+    it->hmap = hmap;
+    mtb_hmap_iter_reset(it);
+}
+
+func void
+mtb_hmap_iter_reset(MtbHmapIter *it)
+{
+    it->prev = nil;
+    it->next = nil;
+    it->beg = U64_MAX;
+    it->index = 0;
+}
+
+func bool
+mtb_hmap_iter_has_next(MtbHmapIter *it)
+{
+    MtbHmap *hmap = it->hmap;
+    if (it->beg == U64_MAX) {
+        _mtb_hmap_migrate(hmap, U64_MAX); // visit a single table
+        // Start at a free slot, so that backward shifts on removal only
+        // move not yet visited entries into the current slot.
+        it->beg = 0;
+        if (hmap->probing != MTB_HMAP_PROBING_GROUP && !hmap->small) {
+            while (_mtb_hmap_is_occupied(hmap, it->beg)) {
+                it->beg++;
+            }
+        }
+    }
+    for (; it->index < hmap->capacity; it->index++) {
+        u64 index = _mtb_hmap_modulo_capacity(hmap, it->beg + it->index);
+        if (_mtb_hmap_is_occupied(hmap, index)) {
+            it->next = mtb_hmap_entry(hmap, index);
+            return true;
+        }
+    }
+    return false;
+}
+
+func void *
+mtb_hmap_iter_next(MtbHmapIter *it)
+{
+    mtb_assert_always(it->next != nil);
+    it->prev = it->next;
+    it->next = nil;
+    it->index++;
+    return it->prev;
+}
+
+func void *
+mtb_hmap_iter_next_key(MtbHmapIter *it)
+{
+    return mtb_hmap_entry_key(it->hmap, mtb_hmap_iter_next(it));
+}
+
+func void *
+mtb_hmap_iter_next_value(MtbHmapIter *it)
+{
+    return mtb_hmap_entry_value(it->hmap, mtb_hmap_iter_next(it));
+}
+
+func void *
+mtb_hmap_iter_remove(MtbHmapIter *it)
+{
+    mtb_assert_always(it->prev != nil);
+    u8 *removed = _mtb_hmap_erase(it->hmap, it->prev);
+    it->prev = nil;
+    it->index--; // the slot may hold a shifted entry now, visit it again
+    return removed;
+}
+
+#endif // MTB_HMAP_IMPLEMENTATION
+
+
+
+
+#ifdef MTB_HMAP_TESTS
+
+#include <assert.h>
+
+
+func u64
+_calc_hash_str(void *key)
+{
+    char *s = *(char **)key;
+    u64 hash = 0;
+    while (*s != '\0') hash = 17000069 * hash + *s++;
+    return hash;
+}
+
+func bool
+_is_equal_str(void *key1, void *key2)
+{
+    char *s1 = *(char **)key1;
+    char *s2 = *(char **)key2;
+    return strcmp(s1, s2) == 0;
+}
+
+func void
+_test_mtb_hmap_calc_capacity(void)
+{
+    for (u64 i = 0; i <= _mtb_hmap_threshold(MTB_HMAP_MIN_CAPACITY, MTB_HMAP_DEF_MAX_LOAD); i++) {
+        assert(mtb_hmap_calc_capacity(i) == MTB_HMAP_MIN_CAPACITY);
+    }
+    assert(mtb_hmap_calc_capacity(_mtb_hmap_threshold(MTB_HMAP_MIN_CAPACITY, MTB_HMAP_DEF_MAX_LOAD) + 1) == 32);
+    assert(mtb_hmap_calc_capacity(MTB_HMAP_MIN_CAPACITY) == 32);
+    assert(mtb_hmap_calc_capacity(45) == 64);
+    assert(mtb_hmap_calc_capacity(100) == 256);
+    assert(mtb_hmap_calc_capacity(200) == 512);
+    assert(mtb_hmap_calc_capacity(400) == 1024);
+}
+
+func u64
+_calc_hash_u64(void *key)
+{
+    return *(u64 *)key * u64_lit(0x9E3779B97F4A7C15);
+}
+
+func bool
+_is_equal_u64(void *key1, void *key2)
+{
+    return *(u64 *)key1 == *(u64 *)key2;
+}
+
+func u64
+_calc_hash_u32(void *key)
+{
+    return *(u32 *)key * u64_lit(0x9E3779B97F4A7C15);
+}
+
+func bool
+_is_equal_u32(void *key1, void *key2)
+{
+    return *(u32 *)key1 == *(u32 *)key2;
+}
+
+func void
+_test_mtb_hmap_put(MtbArena *arena, MtbHmapInitOptions opt)
+{
+    mtb_arena_temp_scope(arena);
+    char *text = "Lorem ipsum dolor sit amet consectetuer adipiscing elit Pellentesque ipsum Fusce"
+                 " dui leo imperdiet in aliquam sit amet feugiat eu orci Etiam neque Fusce consect"
+                 "etuer risus a nunc Cum sociis natoque penatibus et magnis dis parturient montes "
+                 "nascetur ridiculus mus Donec quis nibh at felis congue commodo Nullam sit amet m"
+                 "agna in magna gravida vehicula Curabitur vitae diam non enim vestibulum interdum"
+                 " Donec iaculis gravida nulla Etiam sapien elit consequat eget tristique non vene"
+                 "natis quis ante Fusce tellus Morbi scelerisque luctus velit Maecenas ipsum velit"
+                 " consectetuer eu lobortis ut dictum at dui Fusce tellus Proin in tellus sit amet"
+                 " nibh dignissim sagittis Et harum quidem rerum facilis est et expedita distincti"
+                 "o Nullam at arcu a est sollicitudin euismod Vivamus luctus egestas leo Suspendis"
+                 "se sagittis ultrices augueFusce consectetuer risus a nunc Proin mattis lacinia j"
+                 "usto Mauris metus Inlaoreet magna id viverra tincidunt sem odio bibendum justo v"
+                 "el imperdiet sapien wisi sed libero Mauris dolor felis sagittis at luctus sed al"
+                 "iquam non tellus Nam libero tempore cum soluta nobis est eligendi optio cumque n"
+                 "ihil impedit quo minus id quod maxime placeat facere possimus omnis voluptas ass"
+                 "umenda est omnis dolor repellendus Cras elementum Nullam dapibus fermentum ipsum"
+                 " Aliquam erat volutpat Curabitur sagittis hendrerit ante Nunc dapibus tortor vel"
+                 " mi dapibus sollicitudin Nunc auctor Neque porro quisquam est quidolorem ipsum q"
+                 "uia dolor sit amet consectetur adipisci velit sed quia non numquam eius modi tem"
+                 "pora incidunt ut labore et dolore magnam aliquam quaerat voluptatem Maecenas fer"
+                 "mentum sem in pharetra pellentesque velit turpis volutpat ante in pharetra metus"
+                 " odio a lectus Nam sed tellus id magna elementum tincidunt Fusce consectetuer ri"
+                 "sus a nunc Nulla turpis magna cursus sit amet suscipit a interdum id felis Excep"
+                 "teur sint occaecat cupidatat non proident sunt in culpa qui officia deserunt mol"
+                 "lit anim id est laborum Mauris elementum mauris vitae tortor Aliquam erat volutp"
+                 "at In rutrum Temporibus autemquibusdam et aut officiis debitis aut rerum necessi"
+                 "tatibus saepe eveniet ut et voluptates repudiandae sint et molestiae non recusan"
+                 "dae Vivamus ac leo pretium faucibus Class aptent taciti sociosqu ad litora torqu"
+                 "ent per conubia nostra per inceptos hymenaeos Etiam commodo dui eget wisi Etiam "
+                 "dictum tincidunt diam Nullam eget nisl Itaque earum rerum hic tenetur a sapiente"
+                 " delectus ut aut reiciendis voluptatibus maiores alias consequatur aut perferend"
+                 "is doloribus asperiores repellat Phasellus rhoncus Duis viverra diam non justo S"
+                 "ed convallis magna eu sem Proin pede metus vulputate nec fermentum fringilla veh"
+                 "icula vitae justo Maecenas ipsum velit consectetuer eu lobortis ut dictum at dui"
+                 " Nullam lectus justo vulputate eget mollis sed tempor sed magna Nullam feugiat t"
+                 "urpis at pulvinar vulputate erat libero tristique tellus necbibendum odio risus "
+                 "sit amet ante Etiam sapien elit consequat eget tristique non venenatis quis ante"
+                 " Nulla est Nullam faucibus mi quis velit Duis condimentum augue id magna semper "
+                 "rutrum Aliquam erat volutpat Mauris metus Phasellus enim erat vestibulum vel ali"
+                 "quam a posuere eu velit Donec ipsummassa ullamcorper in auctor et scelerisque se"
+                 "d est Lorem ipsum dolor sitamet consectetuer adipiscing elit Curabitur bibendum "
+                 "justo non orci Sed elit dui pellentesque a faucibus vel interdum nec diam Fusce "
+                 "consectetuer risus a nunc Cras pede libero dapibus nec pretium sit amet tempor q"
+                 "uis Maecenas lorem Morbi imperdiet mauris ac auctor dictum nisl ligula egestas n"
+                 "ulla et sollicitudin sem purus in lacus Curabitur sagittis hendrerit ante Nullam"
+                 " faucibus mi quis velit Nullam justo enim consectetuer nec ullamcorper ac vestib"
+                 "ulum in elit Suspendisse sagittis ultrices augue Etiam dictum tincidunt diam Pro"
+                 "in mattis lacinia justo Quisque porta Maecenas ipsum velit consectetuer eu lobor"
+                 "tis ut dictum at dui";
+    // echo text | tr ' ' '\n' | sort | uniq -c | sort -nrk1
+    struct histogram {
+        char *word;
         u64 count;
     } hist[] = {
         { .word = "consectetuer", .count =10 },
@@ -3162,1184 +5408,6198 @@ _test_mtb_hmap_put(MtbArena arena)
         { .word = "ad", .count = 1 },
     };
 
-    MtbHmap hmap = {0};
-    mtb_hmap_init(&hmap, &arena, char *, u64, _calc_hash_str, _is_equal_str);
-    assert(mtb_hmap_is_empty(&hmap));
+    MtbHmap hmap = {0};
+    opt.keyAlign = mtb_alignof(char *);
+    opt.valueAlign = mtb_alignof(u64);
+    mtb_hmap_init_opt(&hmap, arena, sizeof(char *), sizeof(u64), _calc_hash_str, _is_equal_str, opt);
+    assert(mtb_hmap_is_empty(&hmap));
+
+    char *textCopy = strcpy(mtb_arena_bump(arena, char, strlen(text) + 1), text);
+    char *token = strtok(textCopy, " ");
+    while (token != nil) {
+        u64 *count = mtb_hmap_get(&hmap, &token);
+        if (count == nil) {
+            *(u64 *)mtb_hmap_put(&hmap, &token) = 1;
+        }
+        else {
+            *count += 1;
+        }
+        token = strtok(nil, " ");
+    }
+    assert(!mtb_hmap_is_empty(&hmap));
+    for (u64 i = 0; i < mtb_countof(hist); i++) {
+        struct histogram *wc = hist + i;
+        assert(*(u64 *)mtb_hmap_get(&hmap, &wc->word) == wc->count);
+    }
+
+    mtb_hmap_clear(&hmap);
+    assert(mtb_hmap_is_empty(&hmap));
+}
+
+func void
+_test_mtb_hmap_remove(MtbArena *arena, MtbHmapInitOptions opt)
+{
+    mtb_arena_temp_scope(arena);
+    MtbHmap hmap = {0};
+    opt.keyAlign = mtb_alignof(char *);
+    opt.valueAlign = mtb_alignof(u64);
+    mtb_hmap_init_opt(&hmap, arena, sizeof(char *), sizeof(u64), _calc_hash_str, _is_equal_str, opt);
+
+    char *k1 = "Pizza";
+    u64 v1 = 11;
+
+    assert(mtb_hmap_remove(&hmap, &k1) == nil);
+
+    for (int i = 0; i < 5; i++) {
+        *(u64 *)mtb_hmap_put(&hmap, &k1) = v1;
+        assert(*(u64 *)mtb_hmap_remove(&hmap, &k1) == v1);
+        assert(mtb_hmap_remove(&hmap, &k1) == nil);
+    }
+
+    assert(mtb_hmap_is_empty(&hmap));
+}
+
+func void
+_test_mtb_hmap_iter(MtbArena *arena, MtbHmapInitOptions opt)
+{
+    mtb_arena_temp_scope(arena);
+    MtbHmap hmap = {0};
+    opt.keyAlign = mtb_alignof(char *);
+    opt.valueAlign = mtb_alignof(u64);
+    mtb_hmap_init_opt(&hmap, arena, sizeof(char *), sizeof(u64), _calc_hash_str, _is_equal_str, opt);
+
+    MtbHmapIter it = {0};
+    mtb_hmap_iter_init(&it, &hmap);
+
+    assert(!mtb_hmap_iter_has_next(&it));
+
+    struct {
+        char *letter;
+        u64 order;
+    } alphabet[] = {
+        { .letter = "a", .order = 0 },
+        { .letter = "b", .order = 1 },
+        { .letter = "c", .order = 2 },
+        { .letter = "d", .order = 3 },
+        { .letter = "e", .order = 4 },
+        { .letter = "f", .order = 5 },
+        { .letter = "g", .order = 6 },
+        { .letter = "h", .order = 7 },
+        { .letter = "i", .order = 8 },
+        { .letter = "j", .order = 9 },
+        { .letter = "k", .order = 10 },
+        { .letter = "l", .order = 11 },
+        { .letter = "m", .order = 12 },
+        { .letter = "n", .order = 13 },
+        { .letter = "o", .order = 14 },
+        { .letter = "p", .order = 15 },
+        { .letter = "q", .order = 16 },
+        { .letter = "r", .order = 17 },
+        { .letter = "s", .order = 18 },
+        { .letter = "t", .order = 19 },
+        { .letter = "u", .order = 20 },
+        { .letter = "v", .order = 21 },
+        { .letter = "w", .order = 22 },
+        { .letter = "x", .order = 23 },
+        { .letter = "y", .order = 24 },
+        { .letter = "z", .order = 25 },
+    };
+
+    char *removed[] = { "k", "o", "t", "e", "n" };
+
+    for (u64 i = 0; i < mtb_countof(alphabet); i++) {
+        *(u64 *)mtb_hmap_put(&hmap, &alphabet[i].letter) = alphabet[i].order;
+    }
+
+    mtb_hmap_iter_reset(&it);
+    while (mtb_hmap_iter_has_next(&it)) {
+        char *key = *(char **)mtb_hmap_iter_next_key(&it);
+        for (u64 i = 0; i < mtb_countof(removed); i++) {
+            if (strcmp(key, removed[i]) == 0) {
+                mtb_hmap_iter_remove(&it);
+            }
+        }
+    }
+    for (u64 i = 0; i < mtb_countof(removed); i++) {
+        assert(mtb_hmap_get(&hmap, &removed[i]) == nil);
+    }
+
+    mtb_hmap_iter_reset(&it);
+    while (mtb_hmap_iter_has_next(&it)) {
+        mtb_hmap_iter_next(&it);
+        mtb_hmap_iter_remove(&it);
+    }
+    assert(mtb_hmap_is_empty(&hmap));
+
+    mtb_hmap_iter_reset(&it);
+    assert(!mtb_hmap_iter_has_next(&it));
+}
+
+func void
+_test_mtb_hmap_many(MtbArena *arena, MtbHmapInitOptions opt)
+{
+    mtb_arena_temp_scope(arena);
+    MtbHmap hmap = {0};
+    opt.keyAlign = mtb_alignof(u64);
+    opt.valueAlign = mtb_alignof(u64);
+    mtb_hmap_init_opt(&hmap, arena, sizeof(u64), sizeof(u64), _calc_hash_u64, _is_equal_u64, opt);
+
+    u64 n = 4096;
+    for (u64 k = 0; k < n; k++) {
+        *(u64 *)mtb_hmap_put(&hmap, &k) = k * k;
+    }
+    assert(hmap.count == n);
+    assert(hmap.capacity == mtb_hmap_calc_capacity(n));
+
+    for (u64 k = 0; k < n; k += 2) {
+        assert(*(u64 *)mtb_hmap_remove(&hmap, &k) == k * k);
+    }
+    assert(hmap.count == n / 2);
+
+    for (u64 k = 0; k < 2 * n; k++) {
+        u64 *v = mtb_hmap_get(&hmap, &k);
+        if (k < n && k % 2 == 1) {
+            assert(v != nil && *v == k * k);
+        }
+        else {
+            assert(v == nil);
+        }
+    }
+}
+
+func void
+_test_mtb_hmap_clone(MtbArena *arena, MtbHmapInitOptions opt)
+{
+    mtb_arena_temp_scope(arena);
+    MtbHmap hmap = {0};
+    opt.keyAlign = mtb_alignof(u64);
+    opt.valueAlign = mtb_alignof(u64);
+    mtb_hmap_init_opt(&hmap, arena, sizeof(u64), sizeof(u64), _calc_hash_u64, _is_equal_u64, opt);
+
+    u64 n = 100;
+    for (u64 k = 0; k < n; k++) {
+        *(u64 *)mtb_hmap_put(&hmap, &k) = k;
+    }
+    MtbHmap clone = {0};
+    mtb_hmap_clone(&clone, arena, &hmap);
+    for (u64 k = 0; k < n; k += 2) {
+        assert(*(u64 *)mtb_hmap_remove(&clone, &k) == k);
+    }
+    for (u64 k = n; k < 2 * n; k++) {
+        *(u64 *)mtb_hmap_put(&clone, &k) = k;
+    }
+    for (u64 k = 0; k < 2 * n; k++) {
+        u64 *v = mtb_hmap_get(&hmap, &k);
+        assert(k < n ? v != nil && *v == k : v == nil);
+        v = mtb_hmap_get(&clone, &k);
+        assert(k % 2 == 1 || k >= n ? v != nil && *v == k : v == nil);
+    }
+}
+
+func u64
+_calc_hash_u64_clustered(void *key)
+{
+    return (*(u64 *)key >> 6) * u64_lit(0x9E3779B97F4A7C15); // 64 keys per hash
+}
+
+func void
+_test_mtb_hmap_stats(MtbArena *arena, MtbHmapInitOptions opt)
+{
+    mtb_arena_temp_scope(arena);
+    opt.keyAlign = mtb_alignof(u64);
+    opt.valueAlign = mtb_alignof(u64);
+    MtbHmapStats stats[2] = {0};
+    u64 (*hashes[2])(void *) = { _calc_hash_u64, _calc_hash_u64_clustered };
+    u64 n = 1000;
+    for (u64 i = 0; i < mtb_countof(hashes); i++) {
+        mtb_arena_temp_scope(arena);
+        MtbHmap hmap = {0};
+        mtb_hmap_init_opt(&hmap, arena, sizeof(u64), sizeof(u64), hashes[i], _is_equal_u64, opt);
+        for (u64 k = 0; k < n + 100; k++) {
+            mtb_hmap_put(&hmap, &k);
+        }
+        for (u64 k = n; k < n + 100; k++) {
+            mtb_hmap_remove(&hmap, &k);
+        }
+        mtb_hmap_stats(&hmap, stats + i);
+
+        MtbHmapStats *s = stats + i;
+        assert(s->count == n && s->capacity == hmap.capacity);
+        assert(s->tombstones == hmap.deleted);
+        assert(s->bytes >= hmap.capacity * hmap.entrySize);
+        u64 probed = 0;
+        for (u64 j = 0; j < MTB_HMAP_STATS_PROBES; j++) {
+            probed += s->probes[j];
+        }
+        assert(probed == n);
+        assert(s->maxDisplacement >= s->avgDisplacement);
+        assert(s->clusterCount > 0 && s->maxCluster >= s->avgCluster);
+        if (opt.probing != MTB_HMAP_PROBING_GROUP) {
+            assert((u64)(s->avgCluster * (f64)s->clusterCount + 0.5) == n); // every entry is in a cluster
+        }
+    }
+    assert(stats[0].probes[0] > n / 2);
+    assert(stats[1].avgDisplacement > stats[0].avgDisplacement);
+    assert(stats[1].maxDisplacement > stats[0].maxDisplacement);
+}
+
+func void
+_test_mtb_hmap_snapshot(MtbArena *arena, MtbHmapInitOptions opt)
+{
+    mtb_arena_temp_scope(arena);
+    MtbHmap hmap = {0};
+    opt.keyAlign = mtb_alignof(u64);
+    opt.valueAlign = mtb_alignof(u64);
+    mtb_hmap_init_opt(&hmap, arena, sizeof(u64), sizeof(u64), _calc_hash_u64, _is_equal_u64, opt);
+
+    u64 n = 3000;
+    for (u64 k = 0; k < n; k++) {
+        *(u64 *)mtb_hmap_put(&hmap, &k) = k + 1;
+    }
+    for (u64 k = 0; k < n; k += 4) {
+        mtb_hmap_remove(&hmap, &k);
+    }
+
+    char path[] = "/tmp/_test_mtb_hmap.XXXXXX";
+    i32 fd = mkstemp(path);
+    assert(fd >= 0 && close(fd) == 0);
+    assert(mtb_hmap_save(&hmap, path));
+    MtbHmap mapped = {0};
+    assert(mtb_hmap_map(&mapped, path, sizeof(u64), sizeof(u64), _calc_hash_u64, _is_equal_u64));
+    assert(mapped.count == hmap.count);
+    for (u64 k = 0; k < 2 * n; k++) {
+        u64 *v = mtb_hmap_get(&mapped, &k);
+        assert(k < n && k % 4 != 0 ? v != nil && *v == k + 1 : v == nil);
+    }
+    u64 count = 0;
+    MtbHmapIter it = {0};
+    for (mtb_hmap_iter_init(&it, &mapped); mtb_hmap_iter_has_next(&it); count++) {
+        u64 *key = mtb_hmap_iter_next_key(&it);
+        assert(*(u64 *)mtb_hmap_get(&hmap, key) == *key + 1);
+    }
+    assert(count == hmap.count);
+    mtb_hmap_unmap(&mapped);
+
+    // other key or value types
+    assert(!mtb_hmap_map(&mapped, path, sizeof(u32), sizeof(u64), _calc_hash_u32, _is_equal_u32));
+    assert(!mtb_hmap_map(&mapped, path, sizeof(u64), sizeof(u32), _calc_hash_u64, _is_equal_u64));
+    MtbHmap small = {0};
+    mtb_hmap_init_opt(&small, arena, sizeof(u32), sizeof(u32), _calc_hash_u32, _is_equal_u32, opt);
+    for (u32 k = 0; k < 100; k++) {
+        *(u32 *)mtb_hmap_put(&small, &k) = k + 1;
+    }
+    assert(mtb_hmap_save(&small, path));
+    assert(!mtb_hmap_map(&mapped, path, sizeof(u64), sizeof(u64), _calc_hash_u64, _is_equal_u64));
+    assert(mtb_hmap_map(&mapped, path, sizeof(u32), sizeof(u32), _calc_hash_u32, _is_equal_u32));
+    for (u32 k = 0; k < 100; k++) {
+        assert(*(u32 *)mtb_hmap_get(&mapped, &k) == k + 1);
+    }
+    mtb_hmap_unmap(&mapped);
+
+    // broken header, truncated and missing files
+    assert(mtb_hmap_save(&hmap, path));
+    MtbHmapFileHeader header = {0};
+    FILE *file = fopen(path, "r+b");
+    assert(file != nil && fread(&header, sizeof(header), 1, file) == 1);
+    header.headerSize += header.align;
+    header.entrySize += header.align;
+    assert(fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1 && fclose(file) == 0);
+    assert(!mtb_hmap_map(&mapped, path, sizeof(u64), sizeof(u64), _calc_hash_u64, _is_equal_u64));
+    assert(mtb_hmap_save(&hmap, path));
+    assert(truncate(path, MTB_HMAP_FILE_ALIGN + hmap.entrySize) == 0);
+    assert(!mtb_hmap_map(&mapped, path, sizeof(u64), sizeof(u64), _calc_hash_u64, _is_equal_u64));
+    assert(unlink(path) == 0);
+    assert(!mtb_hmap_map(&mapped, path, sizeof(u64), sizeof(u64), _calc_hash_u64, _is_equal_u64));
+}
+
+func void
+_test_mtb_hmap_upsert(MtbArena *arena, MtbHmapInitOptions opt)
+{
+    mtb_arena_temp_scope(arena);
+    MtbHmap hmap = {0};
+    opt.keyAlign = mtb_alignof(u64);
+    opt.valueAlign = mtb_alignof(u64);
+    mtb_hmap_init_opt(&hmap, arena, sizeof(u64), sizeof(u64), _calc_hash_u64, _is_equal_u64, opt);
+
+    u64 n = 1000;
+    for (u64 i = 0; i < 3 * n; i++) {
+        u64 k = i % n;
+        bool inserted;
+        u64 *v = mtb_hmap_upsert(&hmap, &k, &inserted);
+        assert(inserted == (i < n));
+        assert(*v == i / n);
+        *v += 1;
+    }
+    assert(hmap.count == n);
+    for (u64 k = 0; k < n; k++) {
+        assert(*(u64 *)mtb_hmap_get(&hmap, &k) == 3);
+    }
+}
+
+func void
+_test_mtb_hmap_batch(MtbArena *arena, MtbHmapInitOptions opt)
+{
+    mtb_arena_temp_scope(arena);
+    MtbHmap hmap = {0};
+    opt.keyAlign = mtb_alignof(u64);
+    opt.valueAlign = mtb_alignof(u64);
+    mtb_hmap_init_opt(&hmap, arena, sizeof(u64), sizeof(u64), _calc_hash_u64, _is_equal_u64, opt);
+
+    u64 n = 1000;
+    u64 keys[1000];
+    void *values[1000];
+    for (u64 i = 0; i < n; i++) {
+        keys[i] = i % 700; // w/ duplicates
+    }
+    mtb_hmap_put_batch(&hmap, keys, sizeof(u64), n, values);
+    assert(hmap.count == 700);
+    for (u64 i = 0; i < n; i++) {
+        *(u64 *)values[i] += 1;
+    }
+    for (u64 k = 0; k < 700; k++) {
+        assert(*(u64 *)mtb_hmap_get(&hmap, &k) == (k < 300 ? 2 : 1));
+    }
+
+    for (u64 i = 0; i < n; i++) {
+        keys[i] = 2 * i; // every other one is missing
+    }
+    mtb_hmap_get_batch(&hmap, keys, sizeof(u64), n, values);
+    for (u64 i = 0; i < n; i++) {
+        assert(values[i] == mtb_hmap_get(&hmap, &keys[i]));
+        assert((values[i] != nil) == (keys[i] < 700));
+    }
+
+    // colliding keys, robin hood inserts shift the earlier ones of the same batch
+    MtbHmap clustered = {0};
+    mtb_hmap_init_opt(&clustered, arena, sizeof(u64), sizeof(u64), _calc_hash_u64_clustered, _is_equal_u64, opt);
+    MtbRng64 rng = {0};
+    mtb_rng64_init(&rng, 7);
+    for (u64 batch = 0; batch < 20; batch++) {
+        u64 count = 50;
+        for (u64 i = 0; i < count; i++) {
+            keys[i] = mtb_rng64_next_bounded(&rng, 2000);
+        }
+        mtb_hmap_put_batch(&clustered, keys, sizeof(u64), count, values);
+        for (u64 i = 0; i < count; i++) {
+            assert(values[i] == mtb_hmap_get(&clustered, &keys[i]));
+            assert(*(u64 *)values[i] == 0 || *(u64 *)values[i] == keys[i]); // new or seen before
+            *(u64 *)values[i] = keys[i];
+        }
+    }
+}
+
+func u64
+_calc_hash_const(void *key)
+{
+    return MTB_HMAP_MIN_CAPACITY - 1;
+}
+
+func void
+_test_mtb_hmap_churn(MtbArena *arena, MtbHmapInitOptions opt)
+{
+    mtb_arena_temp_scope(arena);
+    MtbHmap hmap = {0};
+    opt.keyAlign = mtb_alignof(u64);
+    opt.valueAlign = mtb_alignof(u64);
+    mtb_hmap_init_opt(&hmap, arena, sizeof(u64), sizeof(u64), _calc_hash_u64, _is_equal_u64, opt);
+
+    // keep a sliding window of live keys, the table must not keep growing
+    u64 window = 100;
+    for (u64 k = 0; k < 100 * window; k++) {
+        *(u64 *)mtb_hmap_put(&hmap, &k) = k;
+        if (k >= window) {
+            u64 old = k - window;
+            assert(*(u64 *)mtb_hmap_remove(&hmap, &old) == old);
+            assert(mtb_hmap_get(&hmap, &old) == nil);
+        }
+    }
+    assert(hmap.count == window);
+    assert(hmap.capacity <= mtb_hmap_calc_capacity(2 * window));
+    for (u64 k = 99 * window; k < 100 * window; k++) {
+        assert(*(u64 *)mtb_hmap_get(&hmap, &k) == k);
+    }
+}
+
+func void
+_test_mtb_hmap_iter_remove_wrap(MtbArena *arena, MtbHmapInitOptions opt)
+{
+    mtb_arena_temp_scope(arena);
+    MtbHmap hmap = {0};
+    opt.keyAlign = mtb_alignof(u64);
+    opt.valueAlign = mtb_alignof(u64);
+    mtb_hmap_init_opt(&hmap, arena, sizeof(u64), sizeof(u64), _calc_hash_const, _is_equal_u64, opt);
+
+    // all keys collide on the last slot, so the cluster wraps around
+    u64 n = 8;
+    for (u64 k = 0; k < n; k++) {
+        *(u64 *)mtb_hmap_put(&hmap, &k) = k;
+    }
+
+    u64 visited = 0;
+    MtbHmapIter it = {0};
+    mtb_hmap_iter_init(&it, &hmap);
+    while (mtb_hmap_iter_has_next(&it)) {
+        u64 key = *(u64 *)mtb_hmap_iter_next_key(&it);
+        assert((visited & (u64_lit(1) << key)) == 0);
+        visited |= u64_lit(1) << key;
+        if (key % 2 == 0) {
+            u8 *removed = mtb_hmap_iter_remove(&it);
+            assert(*(u64 *)mtb_hmap_entry_value(&hmap, removed) == key);
+        }
+    }
+    assert(visited == (u64_lit(1) << n) - 1);
+    assert(hmap.count == n / 2);
+    for (u64 k = 0; k < n; k++) {
+        assert((mtb_hmap_get(&hmap, &k) != nil) == (k % 2 == 1));
+    }
+}
+
+func void
+_test_mtb_hmap_small(MtbArena *arena, MtbHmapInitOptions opt)
+{
+    mtb_arena_temp_scope(arena);
+    MtbHmap hmap = {0};
+    opt.keyAlign = mtb_alignof(u64);
+    opt.valueAlign = mtb_alignof(u64);
+    opt.small = true;
+    mtb_hmap_init_opt(&hmap, arena, sizeof(u64), sizeof(u64), _calc_hash_u64, _is_equal_u64, opt);
+    assert(hmap.small && hmap.ctrl == nil);
+
+    u64 n = MTB_HMAP_SMALL_CAPACITY;
+    for (u64 k = 0; k < n; k++) {
+        *(u64 *)mtb_hmap_put(&hmap, &k) = k + 1;
+    }
+    assert(hmap.small && hmap.count == n);
+    u64 get = 3;
+    u64 *values[1];
+    mtb_hmap_get_batch(&hmap, &get, sizeof(u64), 1, (void **)values);
+    assert(*values[0] == 4 && mtb_hmap_get_hashed(&hmap, &get, _calc_hash_u64(&get)) == values[0]);
+
+    // removal swaps the last entry in, iteration visits it anyway
+    u64 k0 = 0;
+    assert(*(u64 *)mtb_hmap_remove(&hmap, &k0) == 1);
+    assert(mtb_hmap_get(&hmap, &k0) == nil);
+    u64 visited = 0;
+    MtbHmapIter it = {0};
+    for (mtb_hmap_iter_init(&it, &hmap); mtb_hmap_iter_has_next(&it);) {
+        u64 key = *(u64 *)mtb_hmap_iter_next_key(&it);
+        visited |= u64_lit(1) << key;
+        if (key % 2 == 1) {
+            assert(*(u64 *)mtb_hmap_entry_value(&hmap, mtb_hmap_iter_remove(&it)) == key + 1);
+        }
+    }
+    assert(visited == ((u64_lit(1) << n) - 1) - 1);
+    assert(hmap.count == n / 2 - 1);
+
+    // over the small capacity it becomes a regular hash table
+    for (u64 k = 0; k < 4 * n; k += 2) {
+        *(u64 *)mtb_hmap_put(&hmap, &k) = k + 1;
+    }
+    assert(!hmap.small && hmap.count == 2 * n);
+    assert((hmap.ctrl != nil) == (opt.probing == MTB_HMAP_PROBING_GROUP));
+    for (u64 k = 0; k < 4 * n; k++) {
+        u64 *v = mtb_hmap_get(&hmap, &k);
+        assert(k % 2 == 0 ? v != nil && *v == k + 1 : v == nil);
+    }
+    for (u64 k = 0; k < 4 * n; k += 4) {
+        assert(*(u64 *)mtb_hmap_remove(&hmap, &k) == k + 1);
+    }
+    assert(hmap.count == n);
+}
+
+func u64
+_calc_hash_parity(void *key)
+{
+    return (*(u64 *)key & 1) << 7; // even keys probe from group 0, odd keys from group 1
+}
+
+func void
+_test_mtb_hmap_drop_deleted(MtbArena *arena)
+{
+    mtb_arena_temp_scope(arena);
+    MtbHmap hmap = {0};
+    mtb_hmap_init(&hmap, arena, u64, u64, _calc_hash_parity, _is_equal_u64,
+                  .capacity = 2 * MTB_HMAP_GROUP_WIDTH,
+                  .probing = MTB_HMAP_PROBING_GROUP);
+
+    // fill group 0 with even keys, then remove them all: tombstones
+    for (u64 k = 0; k < 2 * (MTB_HMAP_GROUP_WIDTH + 2); k += 2) {
+        *(u64 *)mtb_hmap_put(&hmap, &k) = k;
+    }
+    for (u64 k = 0; k < 2 * MTB_HMAP_GROUP_WIDTH; k += 2) {
+        assert(*(u64 *)mtb_hmap_remove(&hmap, &k) == k);
+    }
+    assert(hmap.deleted == MTB_HMAP_GROUP_WIDTH);
+
+    // odd keys never reach group 0, so tombstones pile up until rehash
+    for (u64 k = 1; k < 2 * 8; k += 2) {
+        *(u64 *)mtb_hmap_put(&hmap, &k) = k;
+    }
+    assert(hmap.deleted == 0);
+    assert(hmap.capacity == 2 * MTB_HMAP_GROUP_WIDTH);
+    for (u64 k = 0; k < 2 * (MTB_HMAP_GROUP_WIDTH + 2); k++) {
+        u64 *v = mtb_hmap_get(&hmap, &k);
+        bool isLive = (k % 2 == 1 && k < 2 * 8) || (k % 2 == 0 && k >= 2 * MTB_HMAP_GROUP_WIDTH);
+        assert(isLive ? v != nil && *v == k : v == nil);
+    }
+}
+
+func void
+_test_mtb_hmap_check_robin_hood(MtbHmap *hmap)
+{
+    u64 count = 0;
+    for (u64 index = 0; index < hmap->capacity; index++) {
+        u8 *entry = mtb_hmap_entry(hmap, index);
+        MtbHmapEntryStatus status = mtb_hmap_entry_header(hmap, entry)->status;
+        if (status == MTB_HMAP_ENTRY_FREE) {
+            continue;
+        }
+        u64 home = _mtb_hmap_modulo_capacity(hmap, hmap->key_hash(mtb_hmap_entry_key(hmap, entry)));
+        assert(status - 1u == _mtb_hmap_modulo_capacity(hmap, index - home));
+
+        u8 *next = mtb_hmap_entry(hmap, _mtb_hmap_modulo_capacity(hmap, index + 1));
+        assert(mtb_hmap_entry_header(hmap, next)->status <= status + 1u);
+        count++;
+    }
+    assert(count == hmap->count);
+}
+
+func void
+_test_mtb_hmap_robin_hood(MtbArena *arena)
+{
+    mtb_arena_temp_scope(arena);
+    MtbHmap hmap = {0};
+    mtb_hmap_init(&hmap, arena, u64, u64, _calc_hash_u64, _is_equal_u64,
+                  .probing = MTB_HMAP_PROBING_ROBIN_HOOD,
+                  .maxLoad = 0.9f);
+
+    u64 n = 3000;
+    for (u64 k = 0; k < n; k++) {
+        *(u64 *)mtb_hmap_put(&hmap, &k) = k;
+    }
+    assert(hmap.capacity == 4096);
+    _test_mtb_hmap_check_robin_hood(&hmap);
+
+    for (u64 k = 0; k < n; k += 3) {
+        assert(*(u64 *)mtb_hmap_remove(&hmap, &k) == k);
+    }
+    _test_mtb_hmap_check_robin_hood(&hmap);
+    for (u64 k = 0; k < n; k++) {
+        assert((mtb_hmap_get(&hmap, &k) == nil) == (k % 3 == 0));
+    }
+}
+
+func u64
+_calc_hash_last_or_u64(void *key)
+{
+    return *(u64 *)key < U32_MAX ? U64_MAX : _calc_hash_u64(key); // small keys go to the last slot
+}
+
+func void
+_test_mtb_hmap_robin_hood_equal_hashes(MtbArena *arena)
+{
+    mtb_arena_temp_scope(arena);
+    for (u32 incremental = 0; incremental < 2; incremental++) {
+        MtbHmap hmap = {0};
+        mtb_hmap_init(&hmap, arena, u64, u64, _calc_hash_const, _is_equal_u64,
+                      .probing = MTB_HMAP_PROBING_ROBIN_HOOD,
+                      .incremental = incremental);
+
+        // distances past the status overflow, falls back to linear instead of growing,
+        // also while moving entries during an incremental resize
+        u64 n = 1000;
+        for (u64 k = 0; k < n; k++) {
+            *(u64 *)mtb_hmap_put(&hmap, &k) = k;
+        }
+        assert(hmap.probing == MTB_HMAP_PROBING_LINEAR);
+        assert(hmap.count == n && hmap.capacity == mtb_hmap_calc_capacity(n));
+        for (u64 k = 0; k < n; k += 2) {
+            assert(*(u64 *)mtb_hmap_remove(&hmap, &k) == k);
+        }
+        for (u64 k = 0; k < n; k++) {
+            u64 *v = mtb_hmap_get(&hmap, &k);
+            assert(k % 2 == 0 ? v == nil : *v == k);
+        }
+    }
+
+    // Overflows while moving an old entry: equal hashes in both tables, the old
+    // cluster wraps around the end, so it's migrated last.
+    MtbHmap hmap = {0};
+    mtb_hmap_init(&hmap, arena, u64, u64, _calc_hash_last_or_u64, _is_equal_u64,
+                  .probing = MTB_HMAP_PROBING_ROBIN_HOOD,
+                  .incremental = true);
+    u64 equal = 240;
+    u64 k = 0;
+    for (; k < equal; k++) {
+        *(u64 *)mtb_hmap_put(&hmap, &k) = k;
+    }
+    u64 other = U32_MAX;
+    while (hmap.oldCapacity < 4096) {
+        *(u64 *)mtb_hmap_put(&hmap, &other) = other;
+        other++;
+    }
+    while (hmap.oldEntries != nil) {
+        *(u64 *)mtb_hmap_put(&hmap, &k) = k;
+        k++;
+    }
+    assert(hmap.probing == MTB_HMAP_PROBING_LINEAR);
+    for (u64 j = 0; j < k; j++) {
+        assert(*(u64 *)mtb_hmap_get(&hmap, &j) == j);
+    }
+    for (u64 j = U32_MAX; j < other; j++) {
+        assert(*(u64 *)mtb_hmap_get(&hmap, &j) == j);
+    }
+}
+
+global u64 _test_mtb_hmap_hash_calls = 0;
+
+func u64
+_calc_hash_u64_counted(void *key)
+{
+    _test_mtb_hmap_hash_calls++;
+    return _calc_hash_u64(key);
+}
+
+func void
+_test_mtb_hmap_store_hash(MtbArena *arena)
+{
+    mtb_arena_temp_scope(arena);
+    MtbHmap hmap = {0};
+    mtb_hmap_init(&hmap, arena, u64, u64, _calc_hash_u64_counted, _is_equal_u64, .storeHash = true);
+    assert(hmap.headerSize == 2 * sizeof(u64));
+
+    _test_mtb_hmap_hash_calls = 0;
+    u64 n = 1000;
+    for (u64 k = 0; k < n; k++) {
+        *(u64 *)mtb_hmap_put(&hmap, &k) = k;
+    }
+    assert(hmap.capacity > MTB_HMAP_MIN_CAPACITY);
+    assert(_test_mtb_hmap_hash_calls == n); // growing doesn't rehash keys
+
+    for (u64 k = 0; k < n; k++) {
+        u8 *entry = (u8 *)mtb_hmap_get(&hmap, &k) - hmap.keySize - hmap.headerSize;
+        assert(*mtb_hmap_entry_hash(&hmap, entry) == _calc_hash_u64(&k));
+    }
+}
+
+// The stored hash pads a u32 key to 8 bytes, only 4 may be read from the caller's key.
+func void
+_test_mtb_hmap_store_hash_small_keys(MtbArena *arena)
+{
+    mtb_arena_temp_scope(arena);
+    MtbHmapInitOptions configs[] = {
+        { .probing = MTB_HMAP_PROBING_LINEAR, .storeHash = true },
+        { .probing = MTB_HMAP_PROBING_GROUP, .storeHash = true },
+        { .probing = MTB_HMAP_PROBING_ROBIN_HOOD, .storeHash = true },
+        { .probing = MTB_HMAP_PROBING_LINEAR, .storeHash = true, .small = true },
+    };
+    for (u64 i = 0; i < mtb_countof(configs); i++) {
+        MtbHmap hmap = {0};
+        mtb_hmap_init_opt(&hmap, arena, sizeof(u32), sizeof(u32), _calc_hash_u32, _is_equal_u32, configs[i]);
+        assert(hmap.keySize == sizeof(u64) && hmap.keyBytes == sizeof(u32));
+        for (u32 k = 0; k < 100; k++) {
+            *(u32 *)mtb_hmap_put(&hmap, &k) = k + 1;
+        }
+        for (u32 k = 0; k < 100; k++) {
+            bool inserted;
+            assert(*(u32 *)mtb_hmap_upsert(&hmap, &k, &inserted) == k + 1 && !inserted);
+        }
+    }
+}
+
+func void
+_test_mtb_hmap_incremental(MtbArena *arena, MtbHmapProbing probing)
+{
+    mtb_arena_temp_scope(arena);
+    MtbHmap hmap = {0};
+    mtb_hmap_init(&hmap, arena, u64, u64, _calc_hash_u64, _is_equal_u64, .probing = probing, .incremental = true);
+
+    u64 n = 4096;
+    bool migrating = false;
+    for (u64 k = 0; k < n; k++) {
+        *(u64 *)mtb_hmap_put(&hmap, &k) = k;
+        if (hmap.oldEntries == nil) {
+            continue;
+        }
+        migrating = true;
+        assert(hmap.migrated <= hmap.oldCapacity);
+        for (u64 j = 0; j <= k; j++) {
+            assert(*(u64 *)mtb_hmap_get(&hmap, &j) == j);
+        }
+    }
+    assert(migrating);
+    assert(hmap.count == n);
+    assert(hmap.capacity == mtb_hmap_calc_capacity(n));
+
+    // grow once more, then remove and update entries of both tables
+    while (hmap.oldEntries == nil) {
+        *(u64 *)mtb_hmap_put(&hmap, &n) = n;
+        n++;
+    }
+    u64 oldCount = 0;
+    MtbHmapIter it = {0};
+    mtb_hmap_iter_init(&it, &hmap);
+    for (u64 k = 0; k < n; k += 3) {
+        assert(*(u64 *)mtb_hmap_remove(&hmap, &k) == k);
+        assert(mtb_hmap_get(&hmap, &k) == nil);
+        u64 next = k + 1;
+        if (next < n) {
+            *(u64 *)mtb_hmap_put(&hmap, &next) += n;
+        }
+        oldCount += hmap.oldEntries != nil;
+    }
+    assert(oldCount > 0);
+    assert(hmap.oldEntries == nil);
+
+    u64 count = 0;
+    while (mtb_hmap_iter_has_next(&it)) {
+        u64 k = *(u64 *)mtb_hmap_iter_next_key(&it);
+        u64 v = k % 3 == 1 ? k + n : k;
+        assert(k % 3 != 0);
+        assert(*(u64 *)mtb_hmap_get(&hmap, &k) == v);
+        count++;
+    }
+    assert(count == hmap.count);
+    assert(count == n - (n + 2) / 3);
+}
+
+func void
+_test_mtb_hmap_grow_in_place(MtbArena *arena, MtbHmapProbing probing)
+{
+    mtb_arena_temp_scope(arena);
+    MtbArenaTemp temp = mtb_arena_temp_begin(arena);
+    MtbHmap hmap = {0};
+    mtb_hmap_init(&hmap, arena, u64, u64, _calc_hash_u64, _is_equal_u64, .probing = probing);
+
+    u64 n = 4096;
+    for (u64 k = 0; k < n; k++) {
+        *(u64 *)mtb_hmap_put(&hmap, &k) = k;
+    }
+    assert(hmap.capacity == mtb_hmap_calc_capacity(n));
+    // only the final table and the padding before it are left in the arena
+    assert(arena->offset - temp.offset <= _mtb_hmap_block_size(&hmap) + MTB_HMAP_GROUP_WIDTH);
+
+    // not the last allocation anymore, grows into a new block
+    u64 *last = mtb_arena_bump(arena, u64, 1);
+    mtb_hmap_grow(&hmap, hmap.capacity << 1);
+    assert(hmap.entries > (u8 *)last);
+    for (u64 k = 0; k < n; k++) {
+        assert(*(u64 *)mtb_hmap_get(&hmap, &k) == k);
+    }
+    mtb_arena_temp_end(&temp);
+}
+
+MTB_HMAP_DEFINE(MtbTestU64Map, _test_u64_map, u64, u64, _calc_hash_u64, _is_equal_u64)
+
+func void
+_test_mtb_hmap_typed(MtbArena *arena)
+{
+    mtb_arena_temp_scope(arena);
+    MtbTestU64Map hmap = {0};
+    _test_u64_map_init(&hmap, arena, 0);
+
+    // same operations on the generic map, results must match
+    MtbHmap ref = {0};
+    mtb_hmap_init(&ref, arena, u64, u64, _calc_hash_u64, _is_equal_u64);
+
+    MtbRng64 rng = {0};
+    mtb_rng64_init(&rng, 42);
+    for (u64 i = 0; i < 100000; i++) {
+        u64 k = mtb_rng64_next_bounded(&rng, 2048);
+        switch (mtb_rng64_next_bounded(&rng, 3)) {
+            case 0: {
+                bool inserted, refInserted;
+                *_test_u64_map_upsert(&hmap, &k, &inserted) += k;
+                *(u64 *)mtb_hmap_upsert(&ref, &k, &refInserted) += k;
+                assert(inserted == refInserted);
+            } break;
+            case 1: {
+                u64 *v = _test_u64_map_remove(&hmap, &k);
+                u64 *refV = mtb_hmap_remove(&ref, &k);
+                assert((v == nil) == (refV == nil));
+                assert(v == nil || *v == *refV);
+            } break;
+            default: {
+                u64 *v = _test_u64_map_get(&hmap, &k);
+                u64 *refV = mtb_hmap_get(&ref, &k);
+                assert((v == nil) == (refV == nil));
+                assert(v == nil || *v == *refV);
+            } break;
+        }
+        assert(hmap.count == ref.count);
+    }
+
+    u64 count = 0;
+    MtbTestU64MapIter it = {0};
+    _test_u64_map_iter_init(&it, &hmap);
+    while (_test_u64_map_iter_has_next(&it)) {
+        MtbTestU64MapEntry *entry = _test_u64_map_iter_next(&it);
+        assert(entry->value == *(u64 *)mtb_hmap_get(&ref, &entry->key));
+        count++;
+    }
+    assert(count == ref.count);
+
+    _test_u64_map_clear(&hmap);
+    assert(hmap.count == 0);
+    for (u64 k = 0; k < 2048; k++) {
+        assert(_test_u64_map_get(&hmap, &k) == nil);
+    }
+}
+
+func void
+_test_mtb_hmap(void)
+{
+    MtbArena arena = {0};
+    mtb_arena_init(&arena, mb(1), &MTB_ARENA_DEF_ALLOCATOR);
+
+    MtbHmapInitOptions configs[] = {
+        { .probing = MTB_HMAP_PROBING_LINEAR },
+        { .probing = MTB_HMAP_PROBING_GROUP },
+        { .probing = MTB_HMAP_PROBING_LINEAR, .storeHash = true },
+        { .probing = MTB_HMAP_PROBING_GROUP, .storeHash = true },
+        { .probing = MTB_HMAP_PROBING_ROBIN_HOOD },
+        { .probing = MTB_HMAP_PROBING_ROBIN_HOOD, .storeHash = true, .maxLoad = 0.9f },
+        { .probing = MTB_HMAP_PROBING_LINEAR, .incremental = true },
+        { .probing = MTB_HMAP_PROBING_GROUP, .incremental = true },
+        { .probing = MTB_HMAP_PROBING_ROBIN_HOOD, .incremental = true },
+        { .probing = MTB_HMAP_PROBING_LINEAR, .small = true },
+        { .probing = MTB_HMAP_PROBING_GROUP, .storeHash = true, .small = true },
+        { .probing = MTB_HMAP_PROBING_ROBIN_HOOD, .incremental = true, .small = true },
+    };
+    for (u64 i = 0; i < mtb_countof(configs); i++) {
+        _test_mtb_hmap_put(&arena, configs[i]);
+        _test_mtb_hmap_remove(&arena, configs[i]);
+        _test_mtb_hmap_iter(&arena, configs[i]);
+        _test_mtb_hmap_many(&arena, configs[i]);
+        _test_mtb_hmap_churn(&arena, configs[i]);
+        _test_mtb_hmap_iter_remove_wrap(&arena, configs[i]);
+        _test_mtb_hmap_upsert(&arena, configs[i]);
+        _test_mtb_hmap_clone(&arena, configs[i]);
+        _test_mtb_hmap_snapshot(&arena, configs[i]);
+        _test_mtb_hmap_stats(&arena, configs[i]);
+        _test_mtb_hmap_batch(&arena, configs[i]);
+        _test_mtb_hmap_small(&arena, configs[i]);
+    }
+    _test_mtb_hmap_store_hash(&arena);
+    _test_mtb_hmap_store_hash_small_keys(&arena);
+    _test_mtb_hmap_drop_deleted(&arena);
+    _test_mtb_hmap_robin_hood(&arena);
+    _test_mtb_hmap_robin_hood_equal_hashes(&arena);
+    _test_mtb_hmap_grow_in_place(&arena, MTB_HMAP_PROBING_LINEAR);
+    _test_mtb_hmap_grow_in_place(&arena, MTB_HMAP_PROBING_GROUP);
+    _test_mtb_hmap_grow_in_place(&arena, MTB_HMAP_PROBING_ROBIN_HOOD);
+    _test_mtb_hmap_incremental(&arena, MTB_HMAP_PROBING_LINEAR);
+    _test_mtb_hmap_incremental(&arena, MTB_HMAP_PROBING_GROUP);
+    _test_mtb_hmap_incremental(&arena, MTB_HMAP_PROBING_ROBIN_HOOD);
+    _test_mtb_hmap_typed(&arena);
+    _test_mtb_hmap_calc_capacity();
+
+    mtb_arena_deinit(&arena);
+}
+
+#endif // MTB_HMAP_TESTS
+
+
+#ifdef MTB_HMAP_BENCH
+
+#include <assert.h>
+
+
+func u64
+_calc_hash_str(void *key)
+{
+    char *s = *(char **)key;
+    u64 hash = 0;
+    while (*s != '\0') hash = 17000069 * hash + *s++;
+    return hash;
+}
+
+func bool
+_is_equal_str(void *key1, void *key2)
+{
+    char *s1 = *(char **)key1;
+    char *s2 = *(char **)key2;
+    return strcmp(s1, s2) == 0;
+}
+
+func u64
+_calc_hash_u64(void *key)
+{
+    return *(u64 *)key * 0x9E3779B97F4A7C15;
+}
+
+func bool
+_is_equal_u64(void *key1, void *key2)
+{
+    return *(u64 *)key1 == *(u64 *)key2;
+}
+
+func void
+_bench_mtb_hmap_put_latency(MtbArena *arena, MtbHmapInitOptions opt)
+{
+    mtb_arena_temp_scope(arena);
+    MtbHmap hmap = {0};
+    mtb_hmap_init_opt(&hmap, arena, sizeof(u64), sizeof(u64), _calc_hash_u64, _is_equal_u64, opt);
+
+    u64 n = 1 << 20;
+    u64 total = 0;
+    u64 worst = 0;
+    for (u64 k = 0; k < n; k++) {
+        u64 beg = mtb_perf_cpu_time();
+        *(u64 *)mtb_hmap_put(&hmap, &k) = k;
+        u64 elapsed = mtb_perf_cpu_time() - beg;
+        total += elapsed;
+        worst = mtb_max_u64(worst, elapsed);
+    }
+    assert(hmap.count == n);
+    printf("put: %lu total, %lu avg, %lu max (cpu time)\n", total, total / n, worst);
+}
+
+func void
+_bench_mtb_hmap_word_count(MtbArena *arena, MtbDynArr *tokens, MtbHmapInitOptions opt, i32 iterationCount)
+{
+    mtb_arena_temp_scope(arena);
+    mtb_perf_start();
+
+    for (i32 i = 0; i < iterationCount; i++) {
+        mtb_arena_temp_scope(arena);
+
+        MtbHmap hmap = {0};
+        mtb_hmap_init_opt(&hmap, arena, sizeof(char *), sizeof(u64), _calc_hash_str, _is_equal_str, opt);
+
+        MtbDynArrIter tokensIterator = {0};
+        mtb_dynarr_iter_init(&tokensIterator, tokens);
+
+        while (mtb_dynarr_iter_has_next(&tokensIterator)) {
+            char *token = *(char **)mtb_dynarr_iter_next(&tokensIterator);
+            mtb_perf_time_block("upsert");
+            bool inserted;
+            *(u64 *)mtb_hmap_upsert(&hmap, &token, &inserted) += 1;
+        }
+
+        // sanity check
+        struct histogram {
+            char *word;
+            u64 count;
+        } hist[] = {
+            { .word = "god", .count = 62 },
+            { .word = "dog", .count = 60 },
+            { .word = "duck", .count = 2 },
+            { .word = "poop", .count = 1 },
+            { .word = "love", .count = 1364 },
+        };
+        for (u64 i = 0; i < mtb_countof(hist); i++) {
+            struct histogram *wc = hist + i;
+            assert(*(u64 *)mtb_hmap_get(&hmap, &wc->word) == wc->count);
+        }
+        if (i == iterationCount - 1) {
+            MtbHmapStats stats = {0};
+            mtb_hmap_stats(&hmap, &stats);
+            mtb_hmap_stats_print(&stats, "table");
+        }
+    }
+    mtb_perf_print();
+}
+
+func void
+_bench_mtb_hmap_get_batch(MtbArena *arena, MtbHmapInitOptions opt)
+{
+    mtb_arena_temp_scope(arena);
+    MtbHmap hmap = {0};
+    mtb_hmap_init_opt(&hmap, arena, sizeof(u64), sizeof(u64), _calc_hash_u64, _is_equal_u64, opt);
+
+    u64 n = 1 << 21;
+    u64 *keys = mtb_arena_bump(arena, u64, n);
+    void **values = mtb_arena_bump(arena, void *, n);
+    for (u64 k = 0; k < n; k++) {
+        *(u64 *)mtb_hmap_put(&hmap, &k) = k;
+    }
+    MtbRng64 rng = {0};
+    mtb_rng64_init(&rng, 42);
+    for (u64 i = 0; i < n; i++) {
+        keys[i] = mtb_rng64_next_bounded(&rng, 2 * n);
+    }
+
+    u64 beg = mtb_perf_cpu_time();
+    for (u64 i = 0; i < n; i++) {
+        values[i] = mtb_hmap_get(&hmap, &keys[i]);
+    }
+    u64 single = mtb_perf_cpu_time() - beg;
+
+    beg = mtb_perf_cpu_time();
+    mtb_hmap_get_batch(&hmap, keys, sizeof(u64), n, values);
+    u64 batch = mtb_perf_cpu_time() - beg;
+
+    for (u64 i = 0; i < n; i++) {
+        assert((values[i] != nil) == (keys[i] < n));
+    }
+    printf("get: %lu, get_batch: %lu (cpu time)\n", single, batch);
+}
+
+// Startup cost: rebuilding the map vs mapping a saved snapshot, then the first lookups.
+func void
+_bench_mtb_hmap_snapshot(MtbArena *arena, MtbHmapInitOptions opt)
+{
+    mtb_arena_temp_scope(arena);
+    u64 n = 1 << 22;
+    u64 lookupCount = 1 << 20;
+    char path[] = "/tmp/_bench_mtb_hmap.XXXXXX";
+    i32 fd = mkstemp(path);
+    mtb_assert_always(fd >= 0 && close(fd) == 0);
+
+    u64 beg = mtb_perf_sys_time();
+    MtbHmap hmap = {0};
+    mtb_hmap_init_opt(&hmap, arena, sizeof(u64), sizeof(u64), _calc_hash_u64, _is_equal_u64, opt);
+    for (u64 k = 0; k < n; k++) {
+        *(u64 *)mtb_hmap_put(&hmap, &k) = k;
+    }
+    u64 build = mtb_perf_sys_time() - beg;
+
+    beg = mtb_perf_sys_time();
+    mtb_assert_always(mtb_hmap_save(&hmap, path));
+    u64 save = mtb_perf_sys_time() - beg;
+
+    beg = mtb_perf_sys_time();
+    MtbHmap mapped = {0};
+    mtb_assert_always(mtb_hmap_map(&mapped, path, sizeof(u64), sizeof(u64), _calc_hash_u64, _is_equal_u64));
+    u64 map = mtb_perf_sys_time() - beg;
+
+    MtbRng64 rng = {0};
+    mtb_rng64_init(&rng, 42);
+    u64 sum = 0;
+    beg = mtb_perf_sys_time();
+    for (u64 i = 0; i < lookupCount; i++) {
+        sum += *(u64 *)mtb_hmap_get(&mapped, &(u64){ mtb_rng64_next_bounded(&rng, n) });
+    }
+    u64 get = mtb_perf_sys_time() - beg;
+    assert(sum > 0);
+
+    f64 ms = 1000.0 / (f64)mtb_perf_sys_freq();
+    printf("%lu entries: build %.1f ms, save %.1f ms, map %.3f ms, %lu gets on the mapped map %.1f ms\n",
+           n,
+           (f64)build * ms,
+           (f64)save * ms,
+           (f64)map * ms,
+           lookupCount,
+           (f64)get * ms);
+
+    mtb_hmap_unmap(&mapped);
+    unlink(path);
+}
+
+func void
+_bench_mtb_hmap_small(MtbArena *arena, MtbHmapInitOptions opt)
+{
+    mtb_arena_temp_scope(arena);
+    // many tiny maps, e.g. per object attributes
+    u64 mapCount = 1 << 16;
+    u64 keyCount = 5;
+    u64 rounds = 32;
+    MtbHmap *maps = mtb_arena_bump(arena, MtbHmap, mapCount);
+
+    u64 offset = arena->offset;
+    u64 beg = mtb_perf_sys_time();
+    for (u64 i = 0; i < mapCount; i++) {
+        mtb_hmap_init_opt(maps + i, arena, sizeof(u64), sizeof(u64), _calc_hash_u64, _is_equal_u64, opt);
+        for (u64 k = 0; k < keyCount; k++) {
+            *(u64 *)mtb_hmap_put(maps + i, &(u64){ i + k }) = k;
+        }
+    }
+    u64 build = mtb_perf_sys_time() - beg;
+    u64 bytes = arena->offset - offset;
+
+    u64 sum = 0;
+    beg = mtb_perf_sys_time();
+    for (u64 r = 0; r < rounds; r++) {
+        for (u64 i = 0; i < mapCount; i++) {
+            u64 *v = mtb_hmap_get(maps + i, &(u64){ i + r % (keyCount + 1) }); // w/ misses
+            sum += v == nil ? 1 : *v;
+        }
+    }
+    u64 get = mtb_perf_sys_time() - beg;
+    assert(sum > 0);
+
+    f64 ms = 1000.0 / (f64)mtb_perf_sys_freq();
+    printf("%lu maps of %lu entries: build %.1f ms, %lu B/map, %lu gets %.1f ms\n",
+           mapCount,
+           keyCount,
+           (f64)build * ms,
+           bytes / mapCount,
+           rounds * mapCount,
+           (f64)get * ms);
+}
+
+MTB_HMAP_DEFINE(MtbBenchStrMap, _bench_str_map, char *, u64, _calc_hash_str, _is_equal_str)
+
+func void
+_bench_mtb_hmap_word_count_typed(MtbArena *arena, MtbDynArr *tokens, i32 iterationCount)
+{
+    mtb_arena_temp_scope(arena);
+    mtb_perf_start();
+
+    for (i32 i = 0; i < iterationCount; i++) {
+        mtb_arena_temp_scope(arena);
+
+        MtbBenchStrMap hmap = {0};
+        _bench_str_map_init(&hmap, arena, 0);
+
+        MtbDynArrIter tokensIterator = {0};
+        mtb_dynarr_iter_init(&tokensIterator, tokens);
+
+        while (mtb_dynarr_iter_has_next(&tokensIterator)) {
+            char **token = mtb_dynarr_iter_next(&tokensIterator);
+            mtb_perf_time_block("upsert");
+            bool inserted;
+            *_bench_str_map_upsert(&hmap, token, &inserted) += 1;
+        }
+
+        char *love = "love";
+        assert(*_bench_str_map_get(&hmap, &love) == 1364);
+    }
+    mtb_perf_print();
+}
+
+// The tokens are MtbStr (_bench_mtb_corpus_load), null-terminated, read as char * through their first field.
+func void
+_bench_mtb_hmap(MtbDynArr *tokens)
+{
+    MtbArena arena = {0};
+    mtb_arena_init(&arena, mb(64), &MTB_ARENA_DEF_ALLOCATOR);
+
+    // the default config keeps the full 1000 rounds, the others are compared on fewer
+    struct {
+        char *name;
+        MtbHmapInitOptions opt;
+        i32 iterationCount;
+    } configs[] = {
+        { .name = "linear probing", .opt = { .probing = MTB_HMAP_PROBING_LINEAR }, .iterationCount = 1000 },
+        { .name = "group probing", .opt = { .probing = MTB_HMAP_PROBING_GROUP }, .iterationCount = 50 },
+        { .name = "linear probing w/ stored hash", .opt = { .probing = MTB_HMAP_PROBING_LINEAR, .storeHash = true }, .iterationCount = 50 },
+        { .name = "group probing w/ stored hash", .opt = { .probing = MTB_HMAP_PROBING_GROUP, .storeHash = true }, .iterationCount = 50 },
+        { .name = "robin hood probing", .opt = { .probing = MTB_HMAP_PROBING_ROBIN_HOOD }, .iterationCount = 50 },
+        { .name = "robin hood probing at 0.9 load", .opt = { .probing = MTB_HMAP_PROBING_ROBIN_HOOD, .maxLoad = 0.9f }, .iterationCount = 50 },
+    };
+    for (u64 i = 0; i < mtb_countof(configs); i++) {
+        MtbHmapInitOptions opt = configs[i].opt;
+        opt.keyAlign = mtb_alignof(char *);
+        opt.valueAlign = mtb_alignof(u64);
+        printf("== %s ==\n", configs[i].name);
+        _bench_mtb_hmap_word_count(&arena, tokens, opt, configs[i].iterationCount);
+    }
+    printf("== typed linear probing ==\n");
+    _bench_mtb_hmap_word_count_typed(&arena, tokens, 50);
+
+    MtbArena latencyArena = {0};
+    mtb_arena_init(&latencyArena, mb(512), &MTB_ARENA_DEF_ALLOCATOR); // the snapshot map holds 96 + 192 MB while it grows
+    struct {
+        char *name;
+        MtbHmapInitOptions opt;
+    } latencyConfigs[] = {
+        { .name = "linear probing", .opt = { .probing = MTB_HMAP_PROBING_LINEAR } },
+        { .name = "linear probing w/ incremental resize", .opt = { .probing = MTB_HMAP_PROBING_LINEAR, .incremental = true } },
+        { .name = "group probing", .opt = { .probing = MTB_HMAP_PROBING_GROUP } },
+        { .name = "group probing w/ incremental resize", .opt = { .probing = MTB_HMAP_PROBING_GROUP, .incremental = true } },
+        { .name = "robin hood probing", .opt = { .probing = MTB_HMAP_PROBING_ROBIN_HOOD } },
+        { .name = "robin hood probing w/ incremental resize", .opt = { .probing = MTB_HMAP_PROBING_ROBIN_HOOD, .incremental = true } },
+    };
+    for (u64 i = 0; i < mtb_countof(latencyConfigs); i++) {
+        MtbHmapInitOptions opt = latencyConfigs[i].opt;
+        opt.keyAlign = mtb_alignof(u64);
+        opt.valueAlign = mtb_alignof(u64);
+        printf("== %s ==\n", latencyConfigs[i].name);
+        _bench_mtb_hmap_put_latency(&latencyArena, opt);
+    }
+    for (u64 i = 0; i < mtb_countof(latencyConfigs); i += 2) {
+        MtbHmapInitOptions opt = latencyConfigs[i].opt;
+        opt.keyAlign = mtb_alignof(u64);
+        opt.valueAlign = mtb_alignof(u64);
+        printf("== %s, batched get ==\n", latencyConfigs[i].name);
+        _bench_mtb_hmap_get_batch(&latencyArena, opt);
+    }
+    for (u64 i = 0; i < mtb_countof(latencyConfigs); i += 2) {
+        MtbHmapInitOptions opt = latencyConfigs[i].opt;
+        opt.keyAlign = mtb_alignof(u64);
+        opt.valueAlign = mtb_alignof(u64);
+        printf("== %s, snapshot ==\n", latencyConfigs[i].name);
+        _bench_mtb_hmap_snapshot(&latencyArena, opt);
+    }
+    for (u64 i = 0; i < mtb_countof(latencyConfigs); i += 2) {
+        MtbHmapInitOptions opt = latencyConfigs[i].opt;
+        opt.keyAlign = mtb_alignof(u64);
+        opt.valueAlign = mtb_alignof(u64);
+        printf("== %s, small maps ==\n", latencyConfigs[i].name);
+        _bench_mtb_hmap_small(&latencyArena, opt);
+        opt.small = true;
+        printf("== %s, small maps w/ small mode ==\n", latencyConfigs[i].name);
+        _bench_mtb_hmap_small(&latencyArena, opt);
+    }
+    mtb_arena_deinit(&latencyArena);
+
+    mtb_arena_deinit(&arena);
+}
+
+#endif // MTB_HMAP_BENCH
+#ifndef MTB_HSET_H
+#define MTB_HSET_H
+
+#ifdef MTB_IMPLEMENTATION
+#define MTB_HSET_IMPLEMENTATION
+#endif
+
+#ifdef MTB_TESTS
+#define MTB_HSET_TESTS
+#endif
+
+#ifdef MTB_BENCH
+#define MTB_HSET_BENCH
+#endif
+
+
+/* Hash Set */
+
+// A MtbHmap w/o value payload: entries are [header] [key] only, so w/ group probing
+// (no header) a set of u64 packs 8 keys per cache line instead of 4.
+typedef struct mtb_hset MtbHset;
+struct mtb_hset
+{
+    MtbHmap hmap;
+    MtbHmapInitOptions opt; // the result of a bulk operation is created w/ the same options
+};
+
+typedef struct mtb_hset_iter MtbHsetIter;
+struct mtb_hset_iter
+{
+    MtbHmapIter it;
+};
+
+
+// Same options as MtbHmap, valueAlign is ignored.
+func void mtb_hset_init_opt(MtbHset *hset,
+                            MtbArena *arena,
+                            u64 keySize,
+                            u64 (*key_hash)(void *k),
+                            bool (*key_equals)(void *k1, void *k2),
+                            MtbHmapInitOptions opt);
+#define mtb_hset_init(hset, arena, keyType, key_hash, key_equals, ...) \
+    mtb_hset_init_opt(hset, \
+                      arena, \
+                      sizeof(keyType), \
+                      key_hash, \
+                      key_equals, \
+                      (MtbHmapInitOptions){ \
+                          .keyAlign = mtb_alignof(keyType), \
+                          __VA_ARGS__ \
+                      })
+func void mtb_hset_clear(MtbHset *hset);
+func bool mtb_hset_is_empty(MtbHset *hset);
+func u64 mtb_hset_count(MtbHset *hset);
+
+func bool mtb_hset_insert(MtbHset *hset, void *key); // returns true if the key is new
+func bool mtb_hset_remove(MtbHset *hset, void *key);
+func bool mtb_hset_contains(MtbHset *hset, void *key);
+
+// The result is initialized in the arena, the operands must share key size and hash function.
+// Every operation iterates the smaller operand only (copying the larger one when needed).
+func void mtb_hset_union(MtbHset *result, MtbArena *arena, MtbHset *a, MtbHset *b);
+func void mtb_hset_intersect(MtbHset *result, MtbArena *arena, MtbHset *a, MtbHset *b);
+func void mtb_hset_difference(MtbHset *result, MtbArena *arena, MtbHset *a, MtbHset *b); // a - b
+
+func void mtb_hset_iter_init(MtbHsetIter *it, MtbHset *hset);
+func bool mtb_hset_iter_has_next(MtbHsetIter *it);
+func void *mtb_hset_iter_next(MtbHsetIter *it); // returns the key
+
+#endif //MTB_HSET_H
+
+
+#ifdef MTB_HSET_IMPLEMENTATION
+
+func void
+mtb_hset_init_opt(MtbHset *hset,
+                  MtbArena *arena,
+                  u64 keySize,
+                  u64 (*key_hash)(void *k),
+                  bool (*key_equals)(void *k1, void *k2),
+                  MtbHmapInitOptions opt)
+{
+    opt.valueAlign = 0;
+    hset->opt = opt;
+    mtb_hmap_init_opt(&hset->hmap, arena, keySize, 0, key_hash, key_equals, opt);
+}
+
+func void
+mtb_hset_clear(MtbHset *hset)
+{
+    mtb_hmap_clear(&hset->hmap);
+}
+
+func bool
+mtb_hset_is_empty(MtbHset *hset)
+{
+    return mtb_hmap_is_empty(&hset->hmap);
+}
+
+func u64
+mtb_hset_count(MtbHset *hset)
+{
+    return hset->hmap.count;
+}
+
+func bool
+mtb_hset_insert(MtbHset *hset, void *key)
+{
+    bool inserted;
+    mtb_hmap_upsert(&hset->hmap, key, &inserted);
+    return inserted;
+}
+
+func bool
+mtb_hset_remove(MtbHset *hset, void *key)
+{
+    return mtb_hmap_remove(&hset->hmap, key) != nil;
+}
+
+func bool
+mtb_hset_contains(MtbHset *hset, void *key)
+{
+    return mtb_hmap_get(&hset->hmap, key) != nil;
+}
+
+func void
+_mtb_hset_init_like(MtbHset *hset, MtbArena *arena, MtbHset *src, u64 count)
+{
+    MtbHmapInitOptions opt = src->opt;
+    opt.capacity = mtb_hmap_calc_capacity(count);
+    mtb_hset_init_opt(hset, arena, src->hmap.keySize, src->hmap.key_hash, src->hmap.key_equals, opt);
+}
+
+func void
+_mtb_hset_copy(MtbHset *hset, MtbArena *arena, MtbHset *src)
+{
+    hset->opt = src->opt;
+    mtb_hmap_clone(&hset->hmap, arena, &src->hmap);
+}
+
+func void
+mtb_hset_union(MtbHset *result, MtbArena *arena, MtbHset *a, MtbHset *b)
+{
+    mtb_assert_always(a->hmap.keySize == b->hmap.keySize && a->hmap.key_hash == b->hmap.key_hash);
+
+    MtbHset *small = a->hmap.count < b->hmap.count ? a : b;
+    MtbHset *large = small == a ? b : a;
+    _mtb_hset_copy(result, arena, large);
+    MtbHsetIter it = {0};
+    for (mtb_hset_iter_init(&it, small); mtb_hset_iter_has_next(&it);) {
+        mtb_hset_insert(result, mtb_hset_iter_next(&it));
+    }
+}
+
+func void
+mtb_hset_intersect(MtbHset *result, MtbArena *arena, MtbHset *a, MtbHset *b)
+{
+    mtb_assert_always(a->hmap.keySize == b->hmap.keySize && a->hmap.key_hash == b->hmap.key_hash);
+
+    MtbHset *small = a->hmap.count < b->hmap.count ? a : b;
+    MtbHset *large = small == a ? b : a;
+    _mtb_hset_init_like(result, arena, small, small->hmap.count);
+    MtbHsetIter it = {0};
+    for (mtb_hset_iter_init(&it, small); mtb_hset_iter_has_next(&it);) {
+        void *key = mtb_hset_iter_next(&it);
+        if (mtb_hset_contains(large, key)) {
+            mtb_hset_insert(result, key);
+        }
+    }
+}
+
+func void
+mtb_hset_difference(MtbHset *result, MtbArena *arena, MtbHset *a, MtbHset *b)
+{
+    mtb_assert_always(a->hmap.keySize == b->hmap.keySize && a->hmap.key_hash == b->hmap.key_hash);
+
+    MtbHsetIter it = {0};
+    if (a->hmap.count < b->hmap.count) {
+        _mtb_hset_init_like(result, arena, a, a->hmap.count);
+        for (mtb_hset_iter_init(&it, a); mtb_hset_iter_has_next(&it);) {
+            void *key = mtb_hset_iter_next(&it);
+            if (!mtb_hset_contains(b, key)) {
+                mtb_hset_insert(result, key);
+            }
+        }
+    }
+    else {
+        _mtb_hset_copy(result, arena, a);
+        for (mtb_hset_iter_init(&it, b); mtb_hset_iter_has_next(&it);) {
+            mtb_hset_remove(result, mtb_hset_iter_next(&it));
+        }
+    }
+}
+
+func void
+mtb_hset_iter_init(MtbHsetIter *it, MtbHset *hset)
+{
+    mtb_hmap_iter_init(&it->it, &hset->hmap);
+}
+
+func bool
+mtb_hset_iter_has_next(MtbHsetIter *it)
+{
+    return mtb_hmap_iter_has_next(&it->it);
+}
+
+func void *
+mtb_hset_iter_next(MtbHsetIter *it)
+{
+    return mtb_hmap_iter_next_key(&it->it);
+}
+
+#endif // MTB_HSET_IMPLEMENTATION
+
+
+#ifdef MTB_HSET_TESTS
+
+#include <assert.h>
+
+
+func u64
+_test_mtb_hset_hash_u64(void *key)
+{
+    return *(u64 *)key * 0x9E3779B97F4A7C15;
+}
+
+func bool
+_test_mtb_hset_is_equal_u64(void *key1, void *key2)
+{
+    return *(u64 *)key1 == *(u64 *)key2;
+}
+
+func void
+_test_mtb_hset_basic(MtbArena *arena, MtbHmapInitOptions opt)
+{
+    mtb_arena_temp_scope(arena);
+    MtbHset hset = {0};
+    opt.keyAlign = mtb_alignof(u64);
+    mtb_hset_init_opt(&hset, arena, sizeof(u64), _test_mtb_hset_hash_u64, _test_mtb_hset_is_equal_u64, opt);
+    assert(hset.hmap.valueSize == 0);
+    assert(hset.hmap.entrySize == hset.hmap.headerSize + sizeof(u64));
+    assert(mtb_hset_is_empty(&hset));
+
+    u64 n = 2000;
+    for (u64 k = 0; k < n; k++) {
+        assert(mtb_hset_insert(&hset, &k));
+        assert(!mtb_hset_insert(&hset, &k));
+    }
+    assert(mtb_hset_count(&hset) == n);
+    for (u64 k = 0; k < n; k += 3) {
+        assert(mtb_hset_remove(&hset, &k));
+        assert(!mtb_hset_remove(&hset, &k));
+    }
+    for (u64 k = 0; k < 2 * n; k++) {
+        assert(mtb_hset_contains(&hset, &k) == (k < n && k % 3 != 0));
+    }
+
+    u64 count = 0;
+    MtbHsetIter it = {0};
+    for (mtb_hset_iter_init(&it, &hset); mtb_hset_iter_has_next(&it); count++) {
+        u64 k = *(u64 *)mtb_hset_iter_next(&it);
+        assert(k < n && k % 3 != 0);
+    }
+    assert(count == mtb_hset_count(&hset));
+
+    mtb_hset_clear(&hset);
+    assert(mtb_hset_is_empty(&hset));
+    assert(!mtb_hset_contains(&hset, &(u64){ 1 }));
+}
+
+func void
+_test_mtb_hset_bulk(MtbArena *arena, MtbHmapInitOptions opt)
+{
+    mtb_arena_temp_scope(arena);
+    // a: multiples of 2 below 3000, b: multiples of 3 below 600
+    MtbHset a = {0};
+    MtbHset b = {0};
+    mtb_hset_init(&a, arena, u64, _test_mtb_hset_hash_u64, _test_mtb_hset_is_equal_u64, .probing = opt.probing,
+                  .storeHash = opt.storeHash, .incremental = opt.incremental);
+    mtb_hset_init(&b, arena, u64, _test_mtb_hset_hash_u64, _test_mtb_hset_is_equal_u64, .probing = opt.probing,
+                  .storeHash = opt.storeHash, .incremental = opt.incremental);
+    for (u64 k = 0; k < 3000; k += 2) {
+        mtb_hset_insert(&a, &k);
+    }
+    for (u64 k = 0; k < 600; k += 3) {
+        mtb_hset_insert(&b, &k);
+    }
+
+    // both operand orders, so both the small and the large side get iterated
+    MtbHset *operands[][2] = { { &a, &b }, { &b, &a } };
+    for (u64 i = 0; i < mtb_countof(operands); i++) {
+        MtbHset *x = operands[i][0];
+        MtbHset *y = operands[i][1];
+        MtbHset u = {0};
+        MtbHset n = {0};
+        MtbHset d = {0};
+        mtb_hset_union(&u, arena, x, y);
+        mtb_hset_intersect(&n, arena, x, y);
+        mtb_hset_difference(&d, arena, x, y);
+
+        u64 unionCount = 0;
+        u64 intersectCount = 0;
+        u64 differenceCount = 0;
+        for (u64 k = 0; k < 3100; k++) {
+            bool inX = mtb_hset_contains(x, &k);
+            bool inY = mtb_hset_contains(y, &k);
+            assert(mtb_hset_contains(&u, &k) == (inX || inY));
+            assert(mtb_hset_contains(&n, &k) == (inX && inY));
+            assert(mtb_hset_contains(&d, &k) == (inX && !inY));
+            unionCount += inX || inY;
+            intersectCount += inX && inY;
+            differenceCount += inX && !inY;
+        }
+        assert(mtb_hset_count(&u) == unionCount);
+        assert(mtb_hset_count(&n) == intersectCount);
+        assert(mtb_hset_count(&d) == differenceCount);
+    }
+    assert(mtb_hset_count(&a) == 1500);
+    assert(mtb_hset_count(&b) == 200);
+}
+
+func void
+_test_mtb_hset(void)
+{
+    MtbArena arena = {0};
+    mtb_arena_init(&arena, mb(1), &MTB_ARENA_DEF_ALLOCATOR);
+
+    MtbHmapInitOptions configs[] = {
+        { .probing = MTB_HMAP_PROBING_LINEAR },
+        { .probing = MTB_HMAP_PROBING_GROUP },
+        { .probing = MTB_HMAP_PROBING_GROUP, .storeHash = true },
+        { .probing = MTB_HMAP_PROBING_ROBIN_HOOD },
+        { .probing = MTB_HMAP_PROBING_LINEAR, .incremental = true },
+    };
+    for (u64 i = 0; i < mtb_countof(configs); i++) {
+        _test_mtb_hset_basic(&arena, configs[i]);
+        _test_mtb_hset_bulk(&arena, configs[i]);
+    }
+
+    mtb_arena_deinit(&arena);
+}
+
+#endif // MTB_HSET_TESTS
+
+
+#ifdef MTB_HSET_BENCH
+
+#include <assert.h>
+
+
+func u64
+_bench_mtb_hset_hash_u64(void *key)
+{
+    return *(u64 *)key * 0x9E3779B97F4A7C15;
+}
+
+func bool
+_bench_mtb_hset_is_equal_u64(void *key1, void *key2)
+{
+    return *(u64 *)key1 == *(u64 *)key2;
+}
+
+// Dedup of random ids, a set vs a map w/ a dummy u8 value (padded to the key alignment).
+func void
+_bench_mtb_hset_dedup(MtbArena *arena, u64 n, MtbHmapProbing probing)
+{
+    mtb_arena_temp_scope(arena);
+    u64 *ids = mtb_arena_bump(arena, u64, n);
+    MtbRng64 rng = {0};
+    mtb_rng64_init(&rng, 42);
+    for (u64 i = 0; i < n; i++) {
+        ids[i] = mtb_rng64_next_bounded(&rng, n);
+    }
+
+    MtbHmap hmap = {0};
+    mtb_hmap_init(&hmap, arena, u64, u8, _bench_mtb_hset_hash_u64, _bench_mtb_hset_is_equal_u64,
+                  .probing = probing);
+    u64 beg = mtb_perf_cpu_time();
+    u64 mapUnique = 0;
+    for (u64 i = 0; i < n; i++) {
+        bool inserted;
+        mtb_hmap_upsert(&hmap, ids + i, &inserted);
+        mapUnique += inserted;
+    }
+    u64 mapElapsed = mtb_perf_cpu_time() - beg;
+
+    MtbHset hset = {0};
+    mtb_hset_init(&hset, arena, u64, _bench_mtb_hset_hash_u64, _bench_mtb_hset_is_equal_u64, .probing = probing);
+    beg = mtb_perf_cpu_time();
+    u64 setUnique = 0;
+    for (u64 i = 0; i < n; i++) {
+        setUnique += mtb_hset_insert(&hset, ids + i);
+    }
+    u64 setElapsed = mtb_perf_cpu_time() - beg;
+
+    assert(mapUnique == setUnique);
+    printf("map: %lu (cpu time), %lu B/entry, set: %lu (cpu time), %lu B/entry\n",
+           mapElapsed,
+           hmap.entrySize,
+           setElapsed,
+           hset.hmap.entrySize);
+}
+
+func void
+_bench_mtb_hset(void)
+{
+    MtbArena arena = {0};
+    mtb_arena_init(&arena, mb(512), &MTB_ARENA_DEF_ALLOCATOR);
+
+    printf("== dedup, linear probing ==\n");
+    _bench_mtb_hset_dedup(&arena, 1 << 22, MTB_HMAP_PROBING_LINEAR);
+    printf("== dedup, group probing ==\n");
+    _bench_mtb_hset_dedup(&arena, 1 << 22, MTB_HMAP_PROBING_GROUP);
+
+    mtb_arena_deinit(&arena);
+}
+
+#endif // MTB_HSET_BENCH
+#ifndef MTB_OMAP_H
+#define MTB_OMAP_H
+
+#ifdef MTB_IMPLEMENTATION
+#define MTB_OMAP_IMPLEMENTATION
+#endif
+
+#ifdef MTB_TESTS
+#define MTB_OMAP_TESTS
+#endif
+
+#ifdef MTB_BENCH
+#define MTB_OMAP_BENCH
+#endif
+
+
+#ifndef MTB_OMAP_MIN_CAPACITY
+#define MTB_OMAP_MIN_CAPACITY 16
+#endif
+
+#define MTB_OMAP_DEAD_HASH U64_MAX // live entries never have the top hash bit set
+
+#define mtb_omap_entry_header(omap, entry) ((MtbOmapHeader *)(entry))
+#define mtb_omap_entry_key(omap, entry) ((entry) + (omap)->headerSize)
+#define mtb_omap_entry_value(omap, entry) (mtb_omap_entry_key(omap, entry) + (omap)->keySize)
+
+
+/* Insertion Ordered Hash Map */
+
+// Entries are stored densely in insertion order, the hash table is a sparse index of
+// u32 positions (+ 1, 0 is free) w/ linear probing and backward shift deletion.
+// Removed entries stay in place as dead ones until the next compaction (once they
+// outnumber the live ones), so iteration is a scan of the dense array.
+typedef struct mtb_omap_header MtbOmapHeader;
+struct mtb_omap_header
+{
+    u64 hash; // MTB_OMAP_DEAD_HASH if removed
+};
+
+typedef struct mtb_omap MtbOmap;
+struct mtb_omap
+{
+    MtbDynArr entries;
+    u32 *index;
+    u64 capacity; // of the index, must be power of 2!
+    u64 count;    // live entries
+    u64 threshold;
+
+    u64 headerSize;
+    u64 keySize; // padded to the entry alignment
+    u64 valueSize;
+    u64 entrySize;
+    u64 keyBytes; // as given to init, what is copied from the caller's key
+
+    u64 (*key_hash)(void *k);
+    bool (*key_equals)(void *k1, void *k2);
+};
+
+typedef struct mtb_omap_init_options MtbOmapInitOptions;
+struct mtb_omap_init_options
+{
+    u64 capacity;
+    u64 keyAlign;   // at most MTB_ARENA_DEF_ALIGN
+    u64 valueAlign; // at most MTB_ARENA_DEF_ALIGN
+};
+
+
+func void mtb_omap_init_opt(MtbOmap *omap,
+                            MtbArena *arena,
+                            u64 keySize,
+                            u64 valueSize,
+                            u64 (*key_hash)(void *k),
+                            bool (*key_equals)(void *k1, void *k2),
+                            MtbOmapInitOptions opt);
+#define mtb_omap_init(omap, arena, keyType, valueType, key_hash, key_equals, ...) \
+    mtb_omap_init_opt(omap, \
+                      arena, \
+                      sizeof(keyType), \
+                      sizeof(valueType), \
+                      key_hash, \
+                      key_equals, \
+                      (MtbOmapInitOptions){ \
+                          .keyAlign = mtb_alignof(keyType), \
+                          .valueAlign = mtb_alignof(valueType), \
+                          __VA_ARGS__ \
+                      })
+func void mtb_omap_clear(MtbOmap *omap);
+func bool mtb_omap_is_empty(MtbOmap *omap);
+func void mtb_omap_grow(MtbOmap *omap, u64 capacity);
+
+// A new key is appended, re-inserting a removed one moves it to the end.
+func void *mtb_omap_put(MtbOmap *omap, void *key);
+func void *mtb_omap_upsert(MtbOmap *omap, void *key, bool *inserted);
+func void *mtb_omap_remove(MtbOmap *omap, void *key); // the value stays valid until the next put or remove
+func void *mtb_omap_get(MtbOmap *omap, void *key);
+
+
+/* Iterator API */
+
+// In insertion order, entries can only be removed w/ mtb_omap_iter_remove while iterating.
+typedef struct mtb_omap_iter MtbOmapIter;
+struct mtb_omap_iter
+{
+    MtbOmap *omap;
+    u8 *prev;
+    u64 index;
+};
+
+
+func void mtb_omap_iter_init(MtbOmapIter *it, MtbOmap *omap);
+func void mtb_omap_iter_reset(MtbOmapIter *it);
+func bool mtb_omap_iter_has_next(MtbOmapIter *it);
+func void *mtb_omap_iter_next(MtbOmapIter *it);
+func void *mtb_omap_iter_next_key(MtbOmapIter *it);
+func void *mtb_omap_iter_next_value(MtbOmapIter *it);
+func void *mtb_omap_iter_remove(MtbOmapIter *it);
+
+#endif //MTB_OMAP_H
+
+
+#ifdef MTB_OMAP_IMPLEMENTATION
+
+#include <string.h>
+
+
+#define _mtb_omap_hash(omap, key) ((omap)->key_hash(key) & ~(u64_lit(1) << 63))
+#define _mtb_omap_entry(omap, position) ((omap)->entries.items + (position) * (omap)->entrySize)
+
+func u64
+_mtb_omap_threshold(u64 capacity)
+{
+    return capacity - (capacity >> 2);
+}
+
+// Index slot of the key, or of the free slot where it'd go.
+func u64
+_mtb_omap_find(MtbOmap *omap, void *key, u64 hash, bool *found)
+{
+    u64 mask = omap->capacity - 1;
+    for (u64 slot = hash & mask;; slot = (slot + 1) & mask) {
+        u32 position = omap->index[slot];
+        if (position == 0) {
+            *found = false;
+            return slot;
+        }
+        u8 *entry = _mtb_omap_entry(omap, position - 1);
+        if (mtb_omap_entry_header(omap, entry)->hash == hash && omap->key_equals(key, mtb_omap_entry_key(omap, entry))) {
+            *found = true;
+            return slot;
+        }
+    }
+}
+
+// Drops the dead entries, then rebuilds the index w/ the given capacity.
+func void
+_mtb_omap_rebuild(MtbOmap *omap, u64 capacity)
+{
+    u64 length = 0;
+    for (u64 i = 0; i < omap->entries.length; i++) {
+        u8 *entry = _mtb_omap_entry(omap, i);
+        if (mtb_omap_entry_header(omap, entry)->hash != MTB_OMAP_DEAD_HASH) {
+            if (length < i) {
+                memcpy(_mtb_omap_entry(omap, length), entry, omap->entrySize);
+            }
+            length++;
+        }
+    }
+    omap->entries.length = length;
+
+    if (capacity != omap->capacity) {
+        omap->index = mtb_arena_bump(omap->entries.arena, u32, capacity, .no_zero = true);
+        omap->capacity = capacity;
+        omap->threshold = _mtb_omap_threshold(capacity);
+    }
+    memset(omap->index, 0, capacity * sizeof(u32));
+    u64 mask = capacity - 1;
+    for (u64 i = 0; i < length; i++) {
+        u64 slot = mtb_omap_entry_header(omap, _mtb_omap_entry(omap, i))->hash & mask;
+        while (omap->index[slot] != 0) {
+            slot = (slot + 1) & mask;
+        }
+        omap->index[slot] = (u32)(i + 1);
+    }
+}
+
+func void
+mtb_omap_init_opt(MtbOmap *omap,
+                  MtbArena *arena,
+                  u64 keySize,
+                  u64 valueSize,
+                  u64 (*key_hash)(void *k),
+                  bool (*key_equals)(void *k1, void *k2),
+                  MtbOmapInitOptions opt)
+{
+    mtb_assert_always(mtb_is_pow2_or_zero(opt.capacity));
+    mtb_assert_always(mtb_is_pow2_or_zero(keySize));
+    mtb_assert_always(mtb_is_pow2_or_zero(opt.keyAlign) && opt.keyAlign <= MTB_ARENA_DEF_ALIGN);
+    mtb_assert_always(mtb_is_pow2_or_zero(valueSize));
+    mtb_assert_always(mtb_is_pow2_or_zero(opt.valueAlign) && opt.valueAlign <= MTB_ARENA_DEF_ALIGN);
+
+    // entry: [hash] [key] [value]
+    u64 align = mtb_max_u64(mtb_alignof(MtbOmapHeader), mtb_max_u64(opt.keyAlign, opt.valueAlign));
+    omap->headerSize = mtb_align_pow2(sizeof(MtbOmapHeader), align);
+    omap->keySize = mtb_align_pow2(keySize, align);
+    omap->valueSize = mtb_align_pow2(valueSize, align);
+    omap->entrySize = omap->headerSize + omap->keySize + omap->valueSize;
+    omap->keyBytes = keySize;
+    mtb_dynarr_init(&omap->entries, arena, omap->entrySize);
+
+    u64 capacity = opt.capacity < MTB_OMAP_MIN_CAPACITY ? MTB_OMAP_MIN_CAPACITY : opt.capacity;
+    omap->index = mtb_arena_bump(arena, u32, capacity);
+    omap->capacity = capacity;
+    omap->count = 0;
+    omap->threshold = _mtb_omap_threshold(capacity);
+
+    omap->key_hash = key_hash;
+    omap->key_equals = key_equals;
+}
+
+func void
+mtb_omap_clear(MtbOmap *omap)
+{
+    mtb_dynarr_clear(&omap->entries);
+    memset(omap->index, 0, omap->capacity * sizeof(u32));
+    omap->count = 0;
+}
+
+func bool
+mtb_omap_is_empty(MtbOmap *omap)
+{
+    return omap->count == 0;
+}
+
+func void
+mtb_omap_grow(MtbOmap *omap, u64 capacity)
+{
+    mtb_assert_always(mtb_is_pow2_or_zero(capacity));
+    mtb_assert_always(capacity > omap->capacity);
+    _mtb_omap_rebuild(omap, capacity);
+}
+
+func void *
+mtb_omap_put(MtbOmap *omap, void *key)
+{
+    bool inserted;
+    return mtb_omap_upsert(omap, key, &inserted);
+}
+
+func void *
+mtb_omap_upsert(MtbOmap *omap, void *key, bool *inserted)
+{
+    u64 hash = _mtb_omap_hash(omap, key);
+    bool found;
+    u64 slot = _mtb_omap_find(omap, key, hash, &found);
+    *inserted = !found;
+    if (found) {
+        return mtb_omap_entry_value(omap, _mtb_omap_entry(omap, omap->index[slot] - 1));
+    }
+
+    if (omap->count + 1 > omap->threshold) {
+        _mtb_omap_rebuild(omap, omap->capacity << 1);
+        slot = _mtb_omap_find(omap, key, hash, &found);
+    }
+    else if (omap->entries.length >= 2 * omap->count + MTB_OMAP_MIN_CAPACITY) {
+        _mtb_omap_rebuild(omap, omap->capacity); // mostly dead entries
+        slot = _mtb_omap_find(omap, key, hash, &found);
+    }
+    mtb_assert_always(omap->entries.length < U32_MAX);
+
+    u8 *entry = mtb_dynarr_push(&omap->entries);
+    mtb_omap_entry_header(omap, entry)->hash = hash;
+    memcpy(mtb_omap_entry_key(omap, entry), key, omap->keyBytes);
+    memset(mtb_omap_entry_value(omap, entry), 0, omap->valueSize);
+    omap->index[slot] = (u32)omap->entries.length;
+    omap->count++;
+    return mtb_omap_entry_value(omap, entry);
+}
+
+func u8 *
+_mtb_omap_erase(MtbOmap *omap, u64 slot)
+{
+    u8 *entry = _mtb_omap_entry(omap, omap->index[slot] - 1);
+    mtb_omap_entry_header(omap, entry)->hash = MTB_OMAP_DEAD_HASH;
+    omap->count--;
+
+    // backward shift, an entry moves if the free slot lies between its home and its slot
+    u64 mask = omap->capacity - 1;
+    u64 free = slot;
+    for (u64 next = (free + 1) & mask; omap->index[next] != 0; next = (next + 1) & mask) {
+        u64 home = mtb_omap_entry_header(omap, _mtb_omap_entry(omap, omap->index[next] - 1))->hash & mask;
+        if (((next - home) & mask) >= ((next - free) & mask)) {
+            omap->index[free] = omap->index[next];
+            free = next;
+        }
+    }
+    omap->index[free] = 0;
+    return entry;
+}
+
+func void *
+mtb_omap_remove(MtbOmap *omap, void *key)
+{
+    if (omap->entries.length >= 2 * omap->count + MTB_OMAP_MIN_CAPACITY) {
+        _mtb_omap_rebuild(omap, omap->capacity); // mostly dead entries
+    }
+    bool found;
+    u64 slot = _mtb_omap_find(omap, key, _mtb_omap_hash(omap, key), &found);
+    if (!found) {
+        return nil;
+    }
+    return mtb_omap_entry_value(omap, _mtb_omap_erase(omap, slot));
+}
+
+func void *
+mtb_omap_get(MtbOmap *omap, void *key)
+{
+    bool found;
+    u64 slot = _mtb_omap_find(omap, key, _mtb_omap_hash(omap, key), &found);
+    if (!found) {
+        return nil;
+    }
+    return mtb_omap_entry_value(omap, _mtb_omap_entry(omap, omap->index[slot] - 1));
+}
+
+func void
+mtb_omap_iter_init(MtbOmapIter *it, MtbOmap *omap)
+{
+    it->omap = omap;
+    mtb_omap_iter_reset(it);
+}
+
+func void
+mtb_omap_iter_reset(MtbOmapIter *it)
+{
+    it->prev = nil;
+    it->index = 0;
+}
+
+func bool
+mtb_omap_iter_has_next(MtbOmapIter *it)
+{
+    MtbOmap *omap = it->omap;
+    for (; it->index < omap->entries.length; it->index++) {
+        if (mtb_omap_entry_header(omap, _mtb_omap_entry(omap, it->index))->hash != MTB_OMAP_DEAD_HASH) {
+            return true;
+        }
+    }
+    return false;
+}
+
+func void *
+mtb_omap_iter_next(MtbOmapIter *it)
+{
+    mtb_assert_always(it->index < it->omap->entries.length);
+    it->prev = _mtb_omap_entry(it->omap, it->index);
+    it->index++;
+    return it->prev;
+}
+
+func void *
+mtb_omap_iter_next_key(MtbOmapIter *it)
+{
+    return mtb_omap_entry_key(it->omap, mtb_omap_iter_next(it));
+}
+
+func void *
+mtb_omap_iter_next_value(MtbOmapIter *it)
+{
+    return mtb_omap_entry_value(it->omap, mtb_omap_iter_next(it));
+}
+
+func void *
+mtb_omap_iter_remove(MtbOmapIter *it)
+{
+    mtb_assert_always(it->prev != nil);
+    MtbOmap *omap = it->omap;
+    bool found;
+    u64 slot = _mtb_omap_find(omap, mtb_omap_entry_key(omap, it->prev), mtb_omap_entry_header(omap, it->prev)->hash, &found);
+    mtb_assert_always(found);
+    u8 *removed = _mtb_omap_erase(omap, slot);
+    it->prev = nil;
+    return mtb_omap_entry_value(omap, removed);
+}
+
+#endif // MTB_OMAP_IMPLEMENTATION
+
+
+#ifdef MTB_OMAP_TESTS
+
+#include <assert.h>
+
+
+func u64
+_test_mtb_omap_hash_u64(void *key)
+{
+    return *(u64 *)key * 0x9E3779B97F4A7C15;
+}
+
+func bool
+_test_mtb_omap_is_equal_u64(void *key1, void *key2)
+{
+    return *(u64 *)key1 == *(u64 *)key2;
+}
+
+func u64
+_test_mtb_omap_hash_u32(void *key)
+{
+    return *(u32 *)key * 0x9E3779B97F4A7C15;
+}
+
+func bool
+_test_mtb_omap_is_equal_u32(void *key1, void *key2)
+{
+    return *(u32 *)key1 == *(u32 *)key2;
+}
+
+// Checks the map against a reference in insertion order: keys[i] is live if values[i] != 0.
+func void
+_test_mtb_omap_check(MtbOmap *omap, u64 *keys, u64 *values, u64 n)
+{
+    u64 i = 0;
+    MtbOmapIter it = {0};
+    for (mtb_omap_iter_init(&it, omap); mtb_omap_iter_has_next(&it);) {
+        u8 *entry = mtb_omap_iter_next(&it);
+        while (i < n && values[i] == 0) {
+            i++;
+        }
+        assert(i < n);
+        assert(*(u64 *)mtb_omap_entry_key(omap, entry) == keys[i]);
+        assert(*(u64 *)mtb_omap_entry_value(omap, entry) == values[i]);
+        i++;
+    }
+    while (i < n) {
+        assert(values[i++] == 0);
+    }
+}
+
+func void
+_test_mtb_omap_order(MtbArena *arena)
+{
+    mtb_arena_temp_scope(arena);
+    MtbOmap omap = {0};
+    mtb_omap_init(&omap, arena, u64, u64, _test_mtb_omap_hash_u64, _test_mtb_omap_is_equal_u64);
+
+    // every (re-)insertion appends a reference record
+    u64 n = 0;
+    u64 *keys = mtb_arena_bump(arena, u64, 8192);
+    u64 *values = mtb_arena_bump(arena, u64, 8192);
+    u64 *records = mtb_arena_bump(arena, u64, 1000); // latest record of a key
+    MtbRng64 rng = {0};
+    mtb_rng64_init(&rng, 11);
+    for (u64 step = 0; step < 6000; step++) {
+        u64 k = mtb_rng64_next_bounded(&rng, 1000);
+        u64 *v = mtb_omap_get(&omap, &k);
+        if (v == nil) {
+            bool inserted;
+            *(u64 *)mtb_omap_upsert(&omap, &k, &inserted) = step + 1;
+            assert(inserted);
+            keys[n] = k;
+            values[n] = step + 1;
+            records[k] = n++;
+        }
+        else if (step % 3 == 0) {
+            assert(*v == values[records[k]]);
+            assert(*(u64 *)mtb_omap_remove(&omap, &k) == values[records[k]]);
+            assert(mtb_omap_get(&omap, &k) == nil);
+            values[records[k]] = 0;
+        }
+        else {
+            *v = step + 1;
+            values[records[k]] = step + 1;
+        }
+    }
+    u64 count = 0;
+    for (u64 i = 0; i < n; i++) {
+        count += values[i] != 0;
+    }
+    assert(omap.count == count);
+    assert(omap.entries.length < 2 * omap.count + MTB_OMAP_MIN_CAPACITY);
+    _test_mtb_omap_check(&omap, keys, values, n);
+
+    // removal while iterating
+    MtbOmapIter it = {0};
+    for (mtb_omap_iter_init(&it, &omap); mtb_omap_iter_has_next(&it);) {
+        u64 k = *(u64 *)mtb_omap_iter_next_key(&it);
+        if (k % 2 == 0) {
+            assert(*(u64 *)mtb_omap_iter_remove(&it) == values[records[k]]);
+            values[records[k]] = 0;
+        }
+    }
+    _test_mtb_omap_check(&omap, keys, values, n);
+
+    mtb_omap_clear(&omap);
+    assert(mtb_omap_is_empty(&omap));
+    assert(!mtb_omap_iter_has_next((mtb_omap_iter_init(&it, &omap), &it)));
+    for (u64 k = 0; k < 1000; k++) {
+        assert(mtb_omap_get(&omap, &k) == nil);
+    }
+}
+
+func void
+_test_mtb_omap_grow_shrink(MtbArena *arena)
+{
+    mtb_arena_temp_scope(arena);
+    MtbOmap omap = {0};
+    mtb_omap_init(&omap, arena, u64, u32, _test_mtb_omap_hash_u64, _test_mtb_omap_is_equal_u64, .capacity = 32);
+    assert(omap.entrySize == 3 * sizeof(u64));
+
+    u64 n = 20000;
+    for (u64 k = 0; k < n; k++) {
+        *(u32 *)mtb_omap_put(&omap, &k) = (u32)k;
+    }
+    assert(omap.capacity == mtb_hmap_calc_capacity(n));
+    for (u64 k = 0; k < n - 10; k++) {
+        assert(mtb_omap_remove(&omap, &k) != nil);
+    }
+
+    // the dead head was compacted away while removing
+    assert(omap.entries.length < 2 * (omap.count + 1) + MTB_OMAP_MIN_CAPACITY);
+    u64 visited = 0;
+    MtbOmapIter it = {0};
+    for (mtb_omap_iter_init(&it, &omap); mtb_omap_iter_has_next(&it); visited++) {
+        assert(*(u32 *)mtb_omap_iter_next_value(&it) == n - 10 + visited);
+    }
+    assert(visited == 10);
+    mtb_omap_put(&omap, &n);
+    for (u64 k = n - 10; k <= n; k++) {
+        assert(mtb_omap_get(&omap, &k) != nil);
+    }
+
+    mtb_omap_grow(&omap, omap.capacity << 1);
+    for (u64 k = n - 10; k <= n; k++) {
+        assert(mtb_omap_get(&omap, &k) != nil);
+    }
+}
+
+// The hash header pads a u32 key to 8 bytes, only 4 may be read from the caller's key.
+func void
+_test_mtb_omap_small_keys(MtbArena *arena)
+{
+    mtb_arena_temp_scope(arena);
+    MtbOmap omap = {0};
+    mtb_omap_init(&omap, arena, u32, u32, _test_mtb_omap_hash_u32, _test_mtb_omap_is_equal_u32);
+    assert(omap.keySize == sizeof(u64) && omap.keyBytes == sizeof(u32));
+    for (u32 k = 0; k < 100; k++) {
+        *(u32 *)mtb_omap_put(&omap, &k) = k + 1;
+    }
+    for (u32 k = 0; k < 100; k++) {
+        bool inserted;
+        assert(*(u32 *)mtb_omap_upsert(&omap, &k, &inserted) == k + 1 && !inserted);
+    }
+    u32 k = 0;
+    MtbOmapIter it = {0};
+    for (mtb_omap_iter_init(&it, &omap); mtb_omap_iter_has_next(&it); k++) {
+        assert(*(u32 *)mtb_omap_entry_key(&omap, mtb_omap_iter_next(&it)) == k);
+    }
+    assert(k == 100);
+}
+
+func void
+_test_mtb_omap(void)
+{
+    MtbArena arena = {0};
+    mtb_arena_init(&arena, mb(4), &MTB_ARENA_DEF_ALLOCATOR);
+
+    _test_mtb_omap_order(&arena);
+    _test_mtb_omap_grow_shrink(&arena);
+    _test_mtb_omap_small_keys(&arena);
+
+    mtb_arena_deinit(&arena);
+}
+
+#endif // MTB_OMAP_TESTS
+
+
+#ifdef MTB_OMAP_BENCH
+
+#include <assert.h>
+
+
+func u64
+_bench_mtb_omap_hash_u64(void *key)
+{
+    return *(u64 *)key * 0x9E3779B97F4A7C15;
+}
+
+func bool
+_bench_mtb_omap_is_equal_u64(void *key1, void *key2)
+{
+    return *(u64 *)key1 == *(u64 *)key2;
+}
+
+// Iteration after the map has grown to n entries and shrunk to n / 1000, then lookups.
+func void
+_bench_mtb_omap_iter(MtbArena *arena, u64 n)
+{
+    mtb_arena_temp_scope(arena);
+    MtbHmap hmap = {0};
+    mtb_hmap_init(&hmap, arena, u64, u64, _bench_mtb_omap_hash_u64, _bench_mtb_omap_is_equal_u64);
+    MtbOmap omap = {0};
+    mtb_omap_init(&omap, arena, u64, u64, _bench_mtb_omap_hash_u64, _bench_mtb_omap_is_equal_u64);
+    for (u64 k = 0; k < n; k++) {
+        *(u64 *)mtb_hmap_put(&hmap, &k) = k;
+        *(u64 *)mtb_omap_put(&omap, &k) = k;
+    }
+    for (u64 k = 0; k < n; k++) {
+        if (k % 1000 != 0) {
+            mtb_hmap_remove(&hmap, &k);
+            mtb_omap_remove(&omap, &k);
+        }
+    }
+    u64 rounds = 100;
+    u64 hmapSum = 0;
+    u64 beg = mtb_perf_cpu_time();
+    for (u64 r = 0; r < rounds; r++) {
+        MtbHmapIter it = {0};
+        for (mtb_hmap_iter_init(&it, &hmap); mtb_hmap_iter_has_next(&it);) {
+            hmapSum += *(u64 *)mtb_hmap_iter_next_value(&it);
+        }
+    }
+    u64 hmapIter = mtb_perf_cpu_time() - beg;
+
+    u64 omapSum = 0;
+    beg = mtb_perf_cpu_time();
+    for (u64 r = 0; r < rounds; r++) {
+        MtbOmapIter it = {0};
+        for (mtb_omap_iter_init(&it, &omap); mtb_omap_iter_has_next(&it);) {
+            omapSum += *(u64 *)mtb_omap_iter_next_value(&it);
+        }
+    }
+    u64 omapIter = mtb_perf_cpu_time() - beg;
+    assert(hmapSum == omapSum);
+
+    beg = mtb_perf_cpu_time();
+    for (u64 i = 0; i < n; i++) {
+        hmapSum += mtb_hmap_get(&hmap, &i) != nil;
+    }
+    u64 hmapGet = mtb_perf_cpu_time() - beg;
+
+    beg = mtb_perf_cpu_time();
+    for (u64 i = 0; i < n; i++) {
+        omapSum += mtb_omap_get(&omap, &i) != nil;
+    }
+    u64 omapGet = mtb_perf_cpu_time() - beg;
+    assert(hmapSum == omapSum);
+
+    printf("%lu -> %lu entries: hmap iter %lu get %lu, omap iter %lu get %lu (cpu time)\n",
+           n,
+           omap.count,
+           hmapIter,
+           hmapGet,
+           omapIter,
+           omapGet);
+}
+
+func void
+_bench_mtb_omap(void)
+{
+    MtbArena arena = {0};
+    mtb_arena_init(&arena, mb(512), &MTB_ARENA_DEF_ALLOCATOR);
+
+    printf("== hmap vs insertion ordered map ==\n");
+    _bench_mtb_omap_iter(&arena, 1 << 16);
+    _bench_mtb_omap_iter(&arena, 1 << 20);
+
+    mtb_arena_deinit(&arena);
+}
+
+#endif // MTB_OMAP_BENCH
+#ifndef MTB_CACHE_H
+#define MTB_CACHE_H
+
+#ifdef MTB_IMPLEMENTATION
+#define MTB_CACHE_IMPLEMENTATION
+#endif
+
+#ifdef MTB_TESTS
+#define MTB_CACHE_TESTS
+#endif
+
+#ifdef MTB_BENCH
+#define MTB_CACHE_BENCH
+#endif
+
+
+#ifndef MTB_CACHE_DEF_SMALL_RATIO
+#define MTB_CACHE_DEF_SMALL_RATIO 0.1f // S3-FIFO small queue share of the capacity
+#endif
+
+#define MTB_CACHE_MAX_FREQ 3 // S3-FIFO access counter saturates here
+
+#define mtb_cache_entry_key(cache, entry) ((u8 *)(entry) + (cache)->headerSize)
+#define mtb_cache_entry_value(cache, entry) (mtb_cache_entry_key(cache, entry) + (cache)->keySize)
+
+
+typedef u8 MtbCachePolicy;
+enum
+{
+    MTB_CACHE_LRU = 0,    // moves hits to the front, evicts the back
+    MTB_CACHE_CLOCK = 1,  // marks hits, evicts the first unmarked entry from the back (second chance)
+    MTB_CACHE_S3FIFO = 2, // small probation queue + main CLOCK queue + ghost queue, scan resistant
+};
+
+typedef u8 MtbCacheQueue;
+enum
+{
+    MTB_CACHE_QUEUE_MAIN = 0,
+    MTB_CACHE_QUEUE_SMALL = 1, // S3-FIFO only
+};
+
+// Slab entries: [header] [key] [value]
+typedef struct mtb_cache_entry MtbCacheEntry;
+struct mtb_cache_entry
+{
+    MtbList node; // in its queue, or in the free list
+    u64 hash;
+    u8 freq;      // accesses since it was queued (saturating), a single mark w/ CLOCK
+    MtbCacheQueue queue;
+};
+
+typedef struct mtb_cache_stats MtbCacheStats;
+struct mtb_cache_stats
+{
+    u64 hits;
+    u64 misses;
+    u64 evictions;
+    u64 promotions; // S3-FIFO: moved from the small to the main queue
+    u64 ghostHits;  // S3-FIFO: missed keys inserted straight into the main queue
+};
+
+typedef struct mtb_cache MtbCache;
+struct mtb_cache
+{
+    u64 capacity;
+    MtbCachePolicy policy;
+    MtbHmap hmap; // key -> MtbCacheEntry *
+
+    u64 headerSize;
+    u64 keySize; // padded to the entry alignment
+    u64 valueSize;
+    u64 entrySize;
+    u64 keyBytes; // as given to init, what is copied from the caller's key
+    u8 *slab;
+    MtbList free;
+
+    MtbList queues[2];  // front is the newest, see MtbCacheQueue
+    u64 smallCount;
+    u64 smallCapacity;
+
+    // S3-FIFO: hashes of the keys recently evicted from the small queue
+    MtbHmap ghost;      // hash -> sequence number
+    u64 *ghostRing;     // the last ghostCapacity hashes added
+    u64 ghostCapacity;
+    u64 ghostSeq;
+
+    MtbCacheStats stats;
+
+    u64 (*key_hash)(void *k);
+    bool (*key_equals)(void *k1, void *k2);
+};
+
+typedef struct mtb_cache_init_options MtbCacheInitOptions;
+struct mtb_cache_init_options
+{
+    u64 keyAlign;
+    u64 valueAlign;
+    MtbCachePolicy policy;
+    f32 smallRatio; // S3-FIFO only, MTB_CACHE_DEF_SMALL_RATIO if 0
+};
+
+
+// Everything is allocated up front, no operation allocates afterwards.
+func void mtb_cache_init_opt(MtbCache *cache,
+                             MtbArena *arena,
+                             u64 capacity,
+                             u64 keySize,
+                             u64 valueSize,
+                             u64 (*key_hash)(void *k),
+                             bool (*key_equals)(void *k1, void *k2),
+                             MtbCacheInitOptions opt);
+#define mtb_cache_init(cache, arena, capacity, keyType, valueType, key_hash, key_equals, ...) \
+    mtb_cache_init_opt(cache, \
+                       arena, \
+                       capacity, \
+                       sizeof(keyType), \
+                       sizeof(valueType), \
+                       key_hash, \
+                       key_equals, \
+                       (MtbCacheInitOptions){ \
+                           .keyAlign = mtb_alignof(keyType), \
+                           .valueAlign = mtb_alignof(valueType), \
+                           __VA_ARGS__ \
+                       })
+func void mtb_cache_clear(MtbCache *cache); // keeps the stats
+func u64 mtb_cache_count(MtbCache *cache);
+
+// Counts a hit or a miss, the value is valid until the next put.
+func void *mtb_cache_get(MtbCache *cache, void *key);
+func bool mtb_cache_contains(MtbCache *cache, void *key); // no hit/miss, no access recorded
+// Evicts an entry when full, the value is zeroed if the key is new (not counted as a hit or miss).
+func void *mtb_cache_upsert(MtbCache *cache, void *key, bool *inserted);
+func void *mtb_cache_put(MtbCache *cache, void *key);
+func bool mtb_cache_remove(MtbCache *cache, void *key);
+
+func void mtb_cache_stats_print(MtbCache *cache, const char *name); // through the mtb_perf report format
+
+#endif //MTB_CACHE_H
+
+
+#ifdef MTB_CACHE_IMPLEMENTATION
+
+#include <string.h>
+
+
+#define _mtb_cache_entry_of(n) mtb_containerof(n, MtbCacheEntry, node)
+
+
+func u64
+_mtb_cache_ghost_hash(void *key)
+{
+    return *(u64 *)key; // already a hash
+}
+
+func bool
+_mtb_cache_ghost_equals(void *key1, void *key2)
+{
+    return *(u64 *)key1 == *(u64 *)key2;
+}
+
+func void
+mtb_cache_init_opt(MtbCache *cache,
+                   MtbArena *arena,
+                   u64 capacity,
+                   u64 keySize,
+                   u64 valueSize,
+                   u64 (*key_hash)(void *k),
+                   bool (*key_equals)(void *k1, void *k2),
+                   MtbCacheInitOptions opt)
+{
+    mtb_assert_always(capacity > 0);
+    mtb_assert_always(mtb_is_pow2_or_zero(opt.keyAlign));
+    mtb_assert_always(mtb_is_pow2_or_zero(opt.valueAlign));
+    mtb_assert_always(opt.policy <= MTB_CACHE_S3FIFO);
+    mtb_assert_always(0.0f <= opt.smallRatio && opt.smallRatio < 1.0f);
+
+    cache->capacity = capacity;
+    cache->policy = opt.policy;
+    cache->key_hash = key_hash;
+    cache->key_equals = key_equals;
+
+    // room for every entry below the max load, so the map never grows
+    MtbHmapInitOptions hmapOpt = {
+        .capacity = mtb_hmap_calc_capacity(capacity),
+        .keyAlign = opt.keyAlign,
+        .valueAlign = mtb_alignof(MtbCacheEntry *),
+    };
+    mtb_hmap_init_opt(&cache->hmap, arena, keySize, sizeof(MtbCacheEntry *), key_hash, key_equals, hmapOpt);
+
+    u64 align = mtb_max_u64(mtb_alignof(MtbCacheEntry), mtb_max_u64(opt.keyAlign, opt.valueAlign));
+    cache->headerSize = mtb_align_pow2(sizeof(MtbCacheEntry), align);
+    cache->keySize = mtb_align_pow2(keySize, align);
+    cache->valueSize = mtb_align_pow2(valueSize, align);
+    cache->entrySize = cache->headerSize + cache->keySize + cache->valueSize;
+    cache->keyBytes = keySize;
+    cache->slab = mtb_arena_bump(arena, u8, mtb_mul_u64(capacity, cache->entrySize), .align = align);
+
+    cache->smallCapacity = 0;
+    cache->ghostCapacity = 0;
+    if (cache->policy == MTB_CACHE_S3FIFO) {
+        f32 smallRatio = opt.smallRatio == 0.0f ? MTB_CACHE_DEF_SMALL_RATIO : opt.smallRatio;
+        cache->smallCapacity = mtb_max_u64((u64)((f32)capacity * smallRatio), 1);
+        cache->ghostCapacity = mtb_max_u64(capacity - cache->smallCapacity, 1);
+        mtb_hmap_init(&cache->ghost, arena, u64, u64, _mtb_cache_ghost_hash, _mtb_cache_ghost_equals,
+                      .capacity = mtb_hmap_calc_capacity(cache->ghostCapacity));
+        cache->ghostRing = mtb_arena_bump(arena, u64, cache->ghostCapacity);
+    }
+
+    cache->stats = (MtbCacheStats){0};
+    mtb_cache_clear(cache);
+}
+
+func void
+mtb_cache_clear(MtbCache *cache)
+{
+    mtb_hmap_clear(&cache->hmap);
+    mtb_list_init(&cache->free);
+    for (u64 i = 0; i < cache->capacity; i++) {
+        mtb_list_add_last(&cache->free, &((MtbCacheEntry *)(cache->slab + i * cache->entrySize))->node);
+    }
+    mtb_list_init(&cache->queues[MTB_CACHE_QUEUE_MAIN]);
+    mtb_list_init(&cache->queues[MTB_CACHE_QUEUE_SMALL]);
+    cache->smallCount = 0;
+    if (cache->policy == MTB_CACHE_S3FIFO) {
+        mtb_hmap_clear(&cache->ghost);
+        cache->ghostSeq = 0;
+    }
+}
+
+func u64
+mtb_cache_count(MtbCache *cache)
+{
+    return cache->hmap.count;
+}
+
+func void
+_mtb_cache_touch(MtbCache *cache, MtbCacheEntry *entry)
+{
+    switch (cache->policy) {
+        case MTB_CACHE_LRU: mtb_list_add_first(&cache->queues[entry->queue], mtb_list_remove(&entry->node)); break;
+        case MTB_CACHE_CLOCK: entry->freq = 1; break;
+        case MTB_CACHE_S3FIFO: entry->freq = (u8)mtb_min_u64(entry->freq + 1, MTB_CACHE_MAX_FREQ); break;
+        default: mtb_invalid;
+    }
+}
+
+func void
+_mtb_cache_ghost_add(MtbCache *cache, u64 hash)
+{
+    u64 slot = cache->ghostSeq % cache->ghostCapacity;
+    if (cache->ghostSeq >= cache->ghostCapacity) {
+        // drop the oldest one, unless it was added again since
+        u64 oldest = cache->ghostRing[slot];
+        u64 *seq = mtb_hmap_get(&cache->ghost, &oldest);
+        if (seq != nil && *seq == cache->ghostSeq - cache->ghostCapacity) {
+            mtb_hmap_remove(&cache->ghost, &oldest);
+        }
+    }
+    cache->ghostRing[slot] = hash;
+    *(u64 *)mtb_hmap_put(&cache->ghost, &hash) = cache->ghostSeq++;
+}
+
+func void
+_mtb_cache_release(MtbCache *cache, MtbCacheEntry *entry)
+{
+    mtb_hmap_remove_hashed(&cache->hmap, mtb_cache_entry_key(cache, entry), entry->hash);
+    mtb_list_remove(&entry->node);
+    if (entry->queue == MTB_CACHE_QUEUE_SMALL) {
+        cache->smallCount--;
+    }
+    mtb_list_add_first(&cache->free, &entry->node);
+}
+
+func MtbCacheEntry *
+_mtb_cache_victim(MtbCache *cache)
+{
+    MtbList *main = &cache->queues[MTB_CACHE_QUEUE_MAIN];
+    MtbList *small = &cache->queues[MTB_CACHE_QUEUE_SMALL];
+    for (;;) {
+        if (cache->smallCount > 0 && (cache->smallCount >= cache->smallCapacity || mtb_list_is_empty(main))) {
+            MtbCacheEntry *entry = _mtb_cache_entry_of(mtb_list_get_last(small));
+            if (entry->freq == 0) {
+                _mtb_cache_ghost_add(cache, entry->hash);
+                return entry;
+            }
+            // accessed while on probation
+            mtb_list_add_first(main, mtb_list_remove(&entry->node));
+            entry->queue = MTB_CACHE_QUEUE_MAIN;
+            entry->freq = 0;
+            cache->smallCount--;
+            cache->stats.promotions++;
+            continue;
+        }
+        MtbCacheEntry *entry = _mtb_cache_entry_of(mtb_list_get_last(main));
+        if (entry->freq == 0 || cache->policy == MTB_CACHE_LRU) {
+            return entry;
+        }
+        entry->freq--; // second chance
+        mtb_list_add_first(main, mtb_list_remove(&entry->node));
+    }
+}
+
+func void *
+mtb_cache_get(MtbCache *cache, void *key)
+{
+    MtbCacheEntry **entry = mtb_hmap_get(&cache->hmap, key);
+    if (entry == nil) {
+        cache->stats.misses++;
+        return nil;
+    }
+    cache->stats.hits++;
+    _mtb_cache_touch(cache, *entry);
+    return mtb_cache_entry_value(cache, *entry);
+}
+
+func bool
+mtb_cache_contains(MtbCache *cache, void *key)
+{
+    return mtb_hmap_get(&cache->hmap, key) != nil;
+}
+
+func void *
+mtb_cache_upsert(MtbCache *cache, void *key, bool *inserted)
+{
+    u64 hash = cache->key_hash(key);
+    MtbCacheEntry **slot = mtb_hmap_get_hashed(&cache->hmap, key, hash);
+    if (slot != nil) {
+        *inserted = false;
+        _mtb_cache_touch(cache, *slot);
+        return mtb_cache_entry_value(cache, *slot);
+    }
+
+    if (mtb_list_is_empty(&cache->free)) {
+        _mtb_cache_release(cache, _mtb_cache_victim(cache));
+        cache->stats.evictions++;
+    }
+    MtbCacheEntry *entry = _mtb_cache_entry_of(mtb_list_remove_first(&cache->free));
+    entry->hash = hash;
+    entry->freq = 0;
+    entry->queue = MTB_CACHE_QUEUE_MAIN;
+    if (cache->policy == MTB_CACHE_S3FIFO) {
+        if (mtb_hmap_remove(&cache->ghost, &hash) != nil) {
+            cache->stats.ghostHits++; // evicted too early, skip the probation
+        }
+        else {
+            entry->queue = MTB_CACHE_QUEUE_SMALL;
+            cache->smallCount++;
+        }
+    }
+    mtb_list_add_first(&cache->queues[entry->queue], &entry->node);
+    memcpy(mtb_cache_entry_key(cache, entry), key, cache->keyBytes);
+    memset(mtb_cache_entry_value(cache, entry), 0, cache->valueSize);
+
+    bool isNew;
+    *(MtbCacheEntry **)mtb_hmap_upsert_hashed(&cache->hmap, key, hash, &isNew) = entry;
+    *inserted = true;
+    return mtb_cache_entry_value(cache, entry);
+}
+
+func void *
+mtb_cache_put(MtbCache *cache, void *key)
+{
+    bool inserted;
+    return mtb_cache_upsert(cache, key, &inserted);
+}
+
+func bool
+mtb_cache_remove(MtbCache *cache, void *key)
+{
+    MtbCacheEntry **entry = mtb_hmap_get(&cache->hmap, key);
+    if (entry == nil) {
+        return false;
+    }
+    _mtb_cache_release(cache, *entry);
+    return true;
+}
+
+func void
+mtb_cache_stats_print(MtbCache *cache, const char *name)
+{
+    MtbCacheStats *stats = &cache->stats;
+    u64 lookups = stats->hits + stats->misses;
+    mtb_perf_print_block(name);
+    mtb_perf_print_u64("count", mtb_cache_count(cache));
+    mtb_perf_print_u64("capacity", cache->capacity);
+    mtb_perf_print_u64("hits", stats->hits);
+    mtb_perf_print_u64("misses", stats->misses);
+    mtb_perf_print_f64("hit ratio", lookups == 0 ? 0.0 : (f64)stats->hits / (f64)lookups);
+    mtb_perf_print_u64("evictions", stats->evictions);
+    if (cache->policy == MTB_CACHE_S3FIFO) {
+        mtb_perf_print_u64("promotions", stats->promotions);
+        mtb_perf_print_u64("ghost hits", stats->ghostHits);
+    }
+}
+
+#endif // MTB_CACHE_IMPLEMENTATION
+
+
+
+
+#ifdef MTB_CACHE_TESTS
+
+#include <assert.h>
+
+
+func u64
+_test_mtb_cache_hash_u64(void *key)
+{
+    return *(u64 *)key * 0x9E3779B97F4A7C15;
+}
+
+func bool
+_test_mtb_cache_is_equal_u64(void *key1, void *key2)
+{
+    return *(u64 *)key1 == *(u64 *)key2;
+}
+
+func u64
+_test_mtb_cache_hash_u32(void *key)
+{
+    return *(u32 *)key * 0x9E3779B97F4A7C15;
+}
+
+func bool
+_test_mtb_cache_is_equal_u32(void *key1, void *key2)
+{
+    return *(u32 *)key1 == *(u32 *)key2;
+}
+
+// The entry header pads a u32 key to 8 bytes, only 4 may be read from the caller's key.
+func void
+_test_mtb_cache_small_keys(MtbArena *arena, MtbCachePolicy policy)
+{
+    mtb_arena_temp_scope(arena);
+    MtbCache cache = {0};
+    mtb_cache_init(&cache, arena, 16, u32, u32, _test_mtb_cache_hash_u32, _test_mtb_cache_is_equal_u32,
+                   .policy = policy);
+    assert(cache.keySize == sizeof(u64) && cache.keyBytes == sizeof(u32));
+    for (u32 k = 0; k < 100; k++) {
+        *(u32 *)mtb_cache_put(&cache, &k) = k + 1;
+        u32 *v = mtb_cache_get(&cache, &k);
+        assert(v != nil && *v == k + 1);
+    }
+    assert(cache.stats.evictions == 100 - 16);
+}
+
+func void
+_test_mtb_cache_basic(MtbArena *arena, MtbCachePolicy policy)
+{
+    mtb_arena_temp_scope(arena);
+    MtbCache cache = {0};
+    u64 capacity = 64;
+    mtb_cache_init(&cache, arena, capacity, u64, u64, _test_mtb_cache_hash_u64, _test_mtb_cache_is_equal_u64,
+                   .policy = policy);
+
+    // no allocation past init
+    u64 offset = arena->offset;
+    for (u64 k = 0; k < 10 * capacity; k++) {
+        bool inserted;
+        u64 *v = mtb_cache_upsert(&cache, &k, &inserted);
+        assert(inserted && *v == 0);
+        *v = k + 1;
+        assert(mtb_cache_count(&cache) == mtb_min_u64(k + 1, capacity));
+
+        u64 *got = mtb_cache_get(&cache, &k);
+        assert(got == v && *got == k + 1);
+        assert(mtb_cache_upsert(&cache, &k, &inserted) == v && !inserted);
+    }
+    assert(arena->offset == offset);
+    assert(cache.stats.hits == 10 * capacity);
+    assert(cache.stats.evictions == 9 * capacity);
+
+    u64 present = 0;
+    for (u64 k = 0; k < 10 * capacity; k++) {
+        if (mtb_cache_contains(&cache, &k)) {
+            assert(*(u64 *)mtb_cache_get(&cache, &k) == k + 1);
+            present++;
+        }
+    }
+    assert(present == capacity);
+
+    u64 missing = 10 * capacity;
+    assert(mtb_cache_get(&cache, &missing) == nil);
+    assert(cache.stats.misses == 1);
+
+    u64 last = 10 * capacity - 1;
+    assert(mtb_cache_remove(&cache, &last));
+    assert(!mtb_cache_remove(&cache, &last));
+    assert(!mtb_cache_contains(&cache, &last));
+    assert(mtb_cache_count(&cache) == capacity - 1);
+
+    mtb_cache_clear(&cache);
+    assert(mtb_cache_count(&cache) == 0);
+    for (u64 k = 0; k < capacity; k++) {
+        mtb_cache_put(&cache, &k);
+    }
+    assert(mtb_cache_count(&cache) == capacity);
+}
+
+func void
+_test_mtb_cache_lru(MtbArena *arena)
+{
+    mtb_arena_temp_scope(arena);
+    MtbCache cache = {0};
+    mtb_cache_init(&cache, arena, 4, u64, u64, _test_mtb_cache_hash_u64, _test_mtb_cache_is_equal_u64,
+                   .policy = MTB_CACHE_LRU);
+    for (u64 k = 0; k < 4; k++) {
+        mtb_cache_put(&cache, &k);
+    }
+    u64 k0 = 0;
+    mtb_cache_get(&cache, &k0); // 1 is the least recently used now
+    u64 k4 = 4;
+    mtb_cache_put(&cache, &k4);
+    for (u64 k = 0; k < 5; k++) {
+        assert(mtb_cache_contains(&cache, &k) == (k != 1));
+    }
+}
+
+func void
+_test_mtb_cache_clock(MtbArena *arena)
+{
+    mtb_arena_temp_scope(arena);
+    MtbCache cache = {0};
+    mtb_cache_init(&cache, arena, 4, u64, u64, _test_mtb_cache_hash_u64, _test_mtb_cache_is_equal_u64,
+                   .policy = MTB_CACHE_CLOCK);
+    for (u64 k = 0; k < 4; k++) {
+        mtb_cache_put(&cache, &k);
+    }
+    u64 k0 = 0;
+    u64 k1 = 1;
+    mtb_cache_get(&cache, &k0);
+    mtb_cache_get(&cache, &k1);
+    u64 k4 = 4;
+    mtb_cache_put(&cache, &k4); // 0 and 1 get a second chance
+    for (u64 k = 0; k < 5; k++) {
+        assert(mtb_cache_contains(&cache, &k) == (k != 2));
+    }
+}
+
+func void
+_test_mtb_cache_s3fifo(MtbArena *arena)
+{
+    mtb_arena_temp_scope(arena);
+    MtbCache cache = {0};
+    u64 capacity = 100;
+    mtb_cache_init(&cache, arena, capacity, u64, u64, _test_mtb_cache_hash_u64, _test_mtb_cache_is_equal_u64,
+                   .policy = MTB_CACHE_S3FIFO);
+    assert(cache.smallCapacity == 10);
+
+    // a hot set accessed twice, then a long scan of one-hit wonders
+    u64 hot = 50;
+    for (u64 round = 0; round < 2; round++) {
+        for (u64 k = 0; k < hot; k++) {
+            if (mtb_cache_get(&cache, &k) == nil) {
+                *(u64 *)mtb_cache_put(&cache, &k) = k;
+            }
+        }
+    }
+    for (u64 k = 1000; k < 1000 + 10 * capacity; k++) {
+        if (mtb_cache_get(&cache, &k) == nil) {
+            mtb_cache_put(&cache, &k);
+        }
+    }
+    // the scan only went through the small queue
+    for (u64 k = 0; k < hot; k++) {
+        assert(mtb_cache_contains(&cache, &k));
+    }
+    assert(cache.stats.promotions >= hot - cache.smallCapacity);
+
+    // recently evicted keys come back into the main queue
+    u64 ghostHits = cache.stats.ghostHits;
+    u64 recent = 1000 + 10 * capacity - hot - 1; // the small queue kept the latest ones
+    assert(!mtb_cache_contains(&cache, &recent));
+    mtb_cache_put(&cache, &recent);
+    assert(cache.stats.ghostHits == ghostHits + 1);
+}
+
+func void
+_test_mtb_cache(void)
+{
+    MtbArena arena = {0};
+    mtb_arena_init(&arena, mb(1), &MTB_ARENA_DEF_ALLOCATOR);
+
+    _test_mtb_cache_basic(&arena, MTB_CACHE_LRU);
+    _test_mtb_cache_basic(&arena, MTB_CACHE_CLOCK);
+    _test_mtb_cache_basic(&arena, MTB_CACHE_S3FIFO);
+    _test_mtb_cache_lru(&arena);
+    _test_mtb_cache_clock(&arena);
+    _test_mtb_cache_s3fifo(&arena);
+    _test_mtb_cache_small_keys(&arena, MTB_CACHE_LRU);
+    _test_mtb_cache_small_keys(&arena, MTB_CACHE_S3FIFO);
+
+    mtb_arena_deinit(&arena);
+}
+
+#endif // MTB_CACHE_TESTS
+
+
+#ifdef MTB_CACHE_BENCH
+
+#include <assert.h>
+#include <stdio.h>
+
+
+func u64
+_bench_mtb_cache_hash_u64(void *key)
+{
+    return *(u64 *)key * 0x9E3779B97F4A7C15;
+}
+
+func bool
+_bench_mtb_cache_is_equal_u64(void *key1, void *key2)
+{
+    return *(u64 *)key1 == *(u64 *)key2;
+}
+
+// Skewed accesses to a working set twice the capacity, interrupted by scans of never seen keys.
+func void
+_bench_mtb_cache_workload(MtbArena *arena, MtbCachePolicy policy, char *name)
+{
+    mtb_arena_temp_scope(arena);
+    u64 capacity = 1 << 16;
+    u64 accessCount = 1 << 23;
+    u64 scanLength = 2 * capacity;
+
+    MtbCache cache = {0};
+    mtb_cache_init(&cache, arena, capacity, u64, u64, _bench_mtb_cache_hash_u64, _bench_mtb_cache_is_equal_u64,
+                   .policy = policy);
+
+    MtbRng64 rng = {0};
+    mtb_rng64_init(&rng, 42);
+    u64 scanKey = U64_MAX / 2;
+    u64 beg = mtb_perf_sys_time();
+    for (u64 i = 0; i < accessCount; i++) {
+        u64 key;
+        if (i % (accessCount / 8) < scanLength) {
+            key = scanKey++;
+        }
+        else {
+            // 80% of the accesses to the hottest 20% of the keys
+            u64 range = 2 * capacity;
+            key = mtb_rng64_next_unit(&rng) < 0.8 ? mtb_rng64_next_bounded(&rng, range / 5) : mtb_rng64_next_bounded(&rng, range);
+        }
+        u64 *value = mtb_cache_get(&cache, &key);
+        if (value == nil) {
+            *(u64 *)mtb_cache_put(&cache, &key) = key;
+        }
+        else {
+            assert(*value == key);
+        }
+    }
+    u64 elapsed = mtb_perf_sys_time() - beg;
+
+    f64 seconds = (f64)elapsed / (f64)mtb_perf_sys_freq();
+    printf("%s: %.2f M accesses/s\n", name, (f64)accessCount / seconds / 1e6);
+    mtb_cache_stats_print(&cache, name);
+}
+
+func void
+_bench_mtb_cache(void)
+{
+    MtbArena arena = {0};
+    mtb_arena_init(&arena, mb(64), &MTB_ARENA_DEF_ALLOCATOR);
+
+    printf("== skewed accesses w/ scans ==\n");
+    _bench_mtb_cache_workload(&arena, MTB_CACHE_LRU, "lru");
+    _bench_mtb_cache_workload(&arena, MTB_CACHE_CLOCK, "clock");
+    _bench_mtb_cache_workload(&arena, MTB_CACHE_S3FIFO, "s3-fifo");
+
+    mtb_arena_deinit(&arena);
+}
+
+#endif // MTB_CACHE_BENCH
+#ifndef MTB_STRING_H
+#define MTB_STRING_H
+
+#ifdef MTB_IMPLEMENTATION
+#define MTB_STRING_IMPLEMENTATION
+#endif
+
+#ifdef MTB_TESTS
+#define MTB_STRING_TESTS
+#endif
+
+#ifdef MTB_BENCH
+#define MTB_STRING_BENCH
+#endif
+
+
+#include <stdarg.h>
+#include <string.h>
+
+
+/* String */
+
+#define MTB_STR_NOT_FOUND U64_MAX
+
+typedef struct mtb_str MtbStr;
+struct mtb_str
+{
+    union {
+        u8 *bytes;
+        char *chars; // not null-terminated!
+    };
+    u64 length; // in bytes
+};
+
+typedef struct mtb_str_cmp_options MtbStrCmpOptions;
+struct mtb_str_cmp_options
+{
+    bool ignoreCase;
+};
+
+typedef struct mtb_str_find_options MtbStrFindOptions;
+struct mtb_str_find_options
+{
+    bool ignoreCase;
+};
+
+typedef struct mtb_str_split_options MtbStrSplitOptions;
+struct mtb_str_split_options
+{
+    bool skipEmpty;
+};
+
+typedef struct mtb_str_join_options MtbStrJoinOptions;
+struct mtb_str_join_options
+{
+    bool skipEmpty;
+};
+
+#define mtb_str_varg(s) (i32)((s).length), ((s).chars)
+
+#define mtb_str(b, l) ((MtbStr){ .bytes = (b), .length = (l) })
+#define mtb_str_char(c) mtb_str((u8[]){ (c) }, 1)
+#define mtb_str_lit(c) mtb_str((u8 *)(c), sizeof(c) - 1)
+#define mtb_str_empty() mtb_str_lit("")
+
+func MtbStr mtb_str_from_cstr(char *cstr);
+func char *mtb_str_to_cstr(MtbArena *arena, MtbStr str);
+
+func MtbStr mtb_str_vsprintf(MtbArena *arena, char *fmt, va_list args);
+func MtbStr mtb_str_sprintf(MtbArena *arena, char *fmt, ...);
+
+func i32 mtb_str_cmp_opt(MtbStr a, MtbStr b, MtbStrCmpOptions opt);
+#define mtb_str_cmp(a, b, ...) mtb_str_cmp_opt(a, b, (MtbStrCmpOptions){ __VA_ARGS__ })
+#define mtb_str_cmp_lit(a, b, ...) mtb_str_cmp(a, mtb_str_lit(b), __VA_ARGS__)
+#define mtb_str_cmp_cstr(a, b, ...) mtb_str_cmp(a, mtb_str_from_cstr(b), __VA_ARGS__)
+#define mtb_str_is_equal(a, b, ...) (mtb_str_cmp(a, b, __VA_ARGS__) == 0)
+#define mtb_str_is_equal_lit(a, b, ...) mtb_str_is_equal(a, mtb_str_lit(b), __VA_ARGS__)
+#define mtb_str_is_equal_cstr(a, b, ...) mtb_str_is_equal(a, mtb_str_from_cstr(b), __VA_ARGS__)
+
+func u64 mtb_str_find_opt(MtbStr str, MtbStr pattern, MtbStrFindOptions opt);
+#define mtb_str_find(str, pattern, ...) mtb_str_find_opt(str, pattern, (MtbStrFindOptions){ __VA_ARGS__ })
+#define mtb_str_find_lit(str, pattern, ...) mtb_str_find(str, mtb_str_lit(pattern), __VA_ARGS__)
+#define mtb_str_find_char(str, pattern, ...) mtb_str_find(str, mtb_str_char(pattern), __VA_ARGS__)
+#define mtb_str_find_cstr(str, pattern, ...) mtb_str_find(str, mtb_str_from_cstr(pattern), __VA_ARGS__)
+#define mtb_str_contains(str, pattern, ...) ((bool)(mtb_str_find(str, pattern, __VA_ARGS__) != MTB_STR_NOT_FOUND))
+#define mtb_str_contains_lit(str, pattern, ...) mtb_str_contains(str, mtb_str_lit(pattern), __VA_ARGS__)
+#define mtb_str_contains_char(str, pattern, ...) mtb_str_contains(str, mtb_str_char(pattern), __VA_ARGS__)
+#define mtb_str_contains_cstr(str, pattern, ...) mtb_str_contains(str, mtb_str_from_cstr(pattern), __VA_ARGS__)
+
+func bool mtb_str_has_prefix_opt(MtbStr str, MtbStr pfx, MtbStrFindOptions opt);
+#define mtb_str_has_prefix(str, pfx, ...) mtb_str_has_prefix_opt(str, pfx, (MtbStrFindOptions){ __VA_ARGS__ })
+#define mtb_str_has_prefix_lit(str, pfx, ...) mtb_str_has_prefix(str, mtb_str_lit(pfx), __VA_ARGS__)
+#define mtb_str_has_prefix_cstr(str, pfx, ...) mtb_str_has_prefix(str, mtb_str_from_cstr(pfx), __VA_ARGS__)
+
+func bool mtb_str_has_suffix_opt(MtbStr str, MtbStr sfx, MtbStrFindOptions opt);
+#define mtb_str_has_suffix(str, sfx, ...) mtb_str_has_suffix_opt(str, sfx, (MtbStrFindOptions){ __VA_ARGS__ })
+#define mtb_str_has_suffix_lit(str, sfx, ...) mtb_str_has_suffix(str, mtb_str_lit(sfx), __VA_ARGS__)
+#define mtb_str_has_suffix_cstr(str, sfx, ...) mtb_str_has_suffix(str, mtb_str_from_cstr(sfx), __VA_ARGS__)
+
+func MtbStr mtb_str_trim(MtbStr str);
+func MtbStr mtb_str_trim_beg(MtbStr str);
+func MtbStr mtb_str_trim_end(MtbStr str);
+func MtbStr mtb_str_skip(MtbStr str, u64 length);
+func MtbStr mtb_str_chop(MtbStr str, u64 length);
+func MtbStr mtb_str_to_lower(MtbArena *arena, MtbStr str);
+func MtbStr mtb_str_to_upper(MtbArena *arena, MtbStr str);
+func MtbStr mtb_str_dup(MtbArena *arena, MtbStr str);
+func MtbStr mtb_str_cat(MtbArena *arena, MtbStr a, MtbStr b);
+func MtbStr mtb_str_substr(MtbStr str, u64 beg, u64 end);
+func MtbStr mtb_str_prefix(MtbStr str, u64 length);
+func MtbStr mtb_str_suffix(MtbStr str, u64 length);
+func bool mtb_str_is_empty(MtbStr str);
+
+
+/* String List */
+
+typedef struct mtb_str_list MtbStrList;
+struct mtb_str_list
+{
+    MtbList node;
+    union {
+        MtbArena *arena;
+        MtbStr *str;
+    };
+};
+
+func void mtb_str_list_init(MtbArena *arena, MtbStrList *list);
+func void mtb_str_list_clear(MtbStrList *list);
+func bool mtb_str_list_is_empty(MtbStrList *list);
+
+func MtbStrList *mtb_str_list_append(MtbStrList *list, MtbStr *str);
+#define mtb_str_list_append_lit(list, str) mtb_str_list_append(list, &mtb_str_lit(str))
+func MtbStrList *mtb_str_list_appendf(MtbStrList *list, char *fmt, ...);
+
+func MtbStrList *mtb_str_list_prepend(MtbStrList *list, MtbStr *str);
+#define mtb_str_list_prepend_lit(list, str) mtb_str_list_prepend(list, &mtb_str_lit(str))
+func MtbStrList *mtb_str_list_prependf(MtbStrList *list, char *fmt, ...);
+
+func MtbStr mtb_str_join_opt(MtbStrList *list, MtbStr delim, MtbStrJoinOptions opt);
+#define mtb_str_join(list, delim, ...) mtb_str_join_opt(list, delim, (MtbStrJoinOptions){ __VA_ARGS__ })
+#define mtb_str_join_lit(list, delim, ...) mtb_str_join(list, mtb_str_lit(delim), __VA_ARGS__)
+#define mtb_str_join_char(list, delim, ...) mtb_str_join(list, mtb_str_char(delim), __VA_ARGS__)
+
+func void mtb_str_split_opt(MtbStrList *list, MtbStr str, MtbStr delim, MtbStrSplitOptions opt);
+#define mtb_str_split(list, str, delim, ...) mtb_str_split_opt(list, str, delim, (MtbStrSplitOptions){ __VA_ARGS__ })
+#define mtb_str_split_lit(list, str, delim, ...) mtb_str_split(list, str, mtb_str_lit(delim), __VA_ARGS__)
+#define mtb_str_split_char(list, str, delim, ...) mtb_str_split(list, str, mtb_str_char(delim), __VA_ARGS__)
+
+
+/* Hash map utils */
+
+// Based on wyhash: word at a time w/ unaligned loads, 64x64->128 bit multiply-fold mixing.
+#define _mtb_str_hash_secret0 0x2d358dccaa6c78a5ull
+#define _mtb_str_hash_secret1 0x8bb84b93962eacc9ull
+#define _mtb_str_hash_secret2 0x4b33a62ed433d4a3ull
+#define _mtb_str_hash_secret3 0x4d5a2da51de1aa47ull
+
+func u64
+_mtb_str_hash_mix(u64 a, u64 b)
+{
+    __uint128_t r = (__uint128_t)a * b;
+    return (u64)r ^ (u64)(r >> 64);
+}
+
+func u64
+_mtb_str_hash_read64(u8 *p)
+{
+    u64 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+func u64
+_mtb_str_hash_read32(u8 *p)
+{
+    u32 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+func u64
+mtb_str_hash_bytes(u8 *bytes, u64 length, u64 seed)
+{
+    u8 *p = bytes;
+    u64 a = 0;
+    u64 b = 0;
+    seed ^= _mtb_str_hash_mix(seed ^ _mtb_str_hash_secret0, _mtb_str_hash_secret1);
+    if (length <= 16) {
+        if (length >= 4) {
+            u64 offset = (length >> 3) << 2; // 0 or 4, the two 8 byte halves overlap for short keys
+            a = (_mtb_str_hash_read32(p) << 32) | _mtb_str_hash_read32(p + offset);
+            b = (_mtb_str_hash_read32(p + length - 4) << 32) | _mtb_str_hash_read32(p + length - 4 - offset);
+        }
+        else if (length > 0) {
+            a = ((u64)p[0] << 16) | ((u64)p[length >> 1] << 8) | p[length - 1];
+        }
+    }
+    else {
+        u64 i = length;
+        if (i > 48) {
+            u64 seed1 = seed;
+            u64 seed2 = seed;
+            do {
+                seed = _mtb_str_hash_mix(_mtb_str_hash_read64(p) ^ _mtb_str_hash_secret1, _mtb_str_hash_read64(p + 8) ^ seed);
+                seed1 = _mtb_str_hash_mix(_mtb_str_hash_read64(p + 16) ^ _mtb_str_hash_secret2, _mtb_str_hash_read64(p + 24) ^ seed1);
+                seed2 = _mtb_str_hash_mix(_mtb_str_hash_read64(p + 32) ^ _mtb_str_hash_secret3, _mtb_str_hash_read64(p + 40) ^ seed2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= seed1 ^ seed2;
+        }
+        while (i > 16) {
+            seed = _mtb_str_hash_mix(_mtb_str_hash_read64(p) ^ _mtb_str_hash_secret1, _mtb_str_hash_read64(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+        a = _mtb_str_hash_read64(p + i - 16);
+        b = _mtb_str_hash_read64(p + i - 8);
+    }
+    __uint128_t r = (__uint128_t)(a ^ _mtb_str_hash_secret1) * (b ^ seed);
+    return _mtb_str_hash_mix((u64)r ^ _mtb_str_hash_secret0 ^ length, (u64)(r >> 64) ^ _mtb_str_hash_secret1);
+}
+
+func u64
+mtb_str_hash(MtbStr str)
+{
+    return mtb_str_hash_bytes(str.bytes, str.length, 0);
+}
+
+func u64
+mtb_str_key_hash(void *key)
+{
+    return mtb_str_hash(*(MtbStr *)key);
+}
+
+func bool
+mtb_str_key_equals(void *key1, void *key2)
+{
+    MtbStr *s1 = (MtbStr *)key1;
+    MtbStr *s2 = (MtbStr *)key2;
+    return mtb_str_is_equal(*s1, *s2);
+}
+
+#endif // MTB_STRING_H
+
+
+#ifdef MTB_STRING_IMPLEMENTATION
+
+#include <stdio.h>
+#include <string.h>
+
+
+func MtbStr
+mtb_str_from_cstr(char *cstr)
+{
+    return mtb_str((u8 *)cstr, strlen(cstr));
+}
+
+func char *
+mtb_str_to_cstr(MtbArena *arena, MtbStr str)
+{
+    char *cstr = mtb_arena_bump(arena, char, str.length + 1);
+    memcpy(cstr, str.chars, str.length);
+    return cstr;
+}
+
+func MtbStr
+mtb_str_vsprintf(MtbArena *arena, char *fmt, va_list args)
+{
+    va_list argsTmp;
+    va_copy(argsTmp, args);
+    u64 length = vsnprintf(nil, 0, fmt, argsTmp);
+    va_end(argsTmp);
+
+    if (length == 0) {
+        return mtb_str_empty();
+    }
+
+    char *chars = mtb_arena_bump(arena, char, length);
+    vsprintf(chars, fmt, args);
+
+    return mtb_str((u8 *)chars, length);
+}
+
+func MtbStr
+mtb_str_sprintf(MtbArena *arena, char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+
+    MtbStr result = mtb_str_vsprintf(arena, fmt, args);
+
+    va_end(args);
+    return result;
+}
+
+func i32
+mtb_str_cmp_opt(MtbStr a, MtbStr b, MtbStrCmpOptions opt)
+{
+    // TODO intrinsify
+    u64 minLength = mtb_min_u64(a.length, b.length);
+    if (opt.ignoreCase) {
+        for (u64 i = 0; i < minLength; i++) {
+            char ca = mtb_char_to_lower(a.chars[i]);
+            char cb = mtb_char_to_lower(b.chars[i]);
+            if (ca != cb) {
+                return ca > cb ? 1 : -1;
+            }
+        }
+    }
+    else {
+        i32 result = strncmp(a.chars, b.chars, minLength);
+        if (result != 0) {
+            return result;
+        }
+    }
+    return a.length == b.length ? 0 : a.length > b.length ? 1 : -1;
+}
+
+func u64
+mtb_str_find_opt(MtbStr str, MtbStr pattern, MtbStrFindOptions opt)
+{
+    if (str.length >= pattern.length) {
+        u64 i, iEnd = str.length - pattern.length + 1;
+        u64 j, jEnd = pattern.length;
+        if (opt.ignoreCase) {
+            for (i = 0; i < iEnd; i++) {
+                for (j = 0; j < jEnd; j++) {
+                    if (mtb_char_to_lower(str.chars[i + j]) != mtb_char_to_lower(pattern.chars[j])) {
+                        break;
+                    }
+                }
+                if (j == jEnd) {
+                    return i;
+                }
+            }
+        }
+        else {
+            for (i = 0; i < iEnd; i++) {
+                for (j = 0; j < jEnd; j++) {
+                    if (str.chars[i + j] != pattern.chars[j]) {
+                        break;
+                    }
+                }
+                if (j == jEnd) {
+                    return i;
+                }
+            }
+        }
+    }
+    return MTB_STR_NOT_FOUND;
+}
+
+func bool
+mtb_str_has_prefix_opt(MtbStr str, MtbStr pfx, MtbStrFindOptions opt)
+{
+    if (str.length < pfx.length) {
+        return false;
+    }
+    MtbStr substr = mtb_str_substr(str, 0, pfx.length);
+    return mtb_str_is_equal(pfx, substr, .ignoreCase = opt.ignoreCase);
+}
+
+func bool
+mtb_str_has_suffix_opt(MtbStr str, MtbStr sfx, MtbStrFindOptions opt)
+{
+    if (str.length < sfx.length) {
+        return false;
+    }
+    MtbStr substr = mtb_str_substr(str, str.length - sfx.length, str.length);
+    return mtb_str_is_equal(sfx, substr, .ignoreCase = opt.ignoreCase);
+}
+
+func MtbStr
+mtb_str_trim(MtbStr str)
+{
+    u64 beg = 0;
+    while (beg < str.length && mtb_char_is_space(str.chars[beg])) {
+        beg++;
+    }
+    u64 end = str.length;
+    while (beg < end && mtb_char_is_space(str.chars[end - 1])) {
+        end--;
+    }
+    str.chars += beg;
+    str.length = end - beg;
+    return str;
+}
+
+func MtbStr
+mtb_str_trim_beg(MtbStr str)
+{
+    u64 beg = 0;
+    while (beg < str.length && mtb_char_is_space(str.chars[beg])) {
+        beg++;
+    }
+    str.chars += beg;
+    str.length -= beg;
+    return str;
+}
+
+func MtbStr
+mtb_str_trim_end(MtbStr str)
+{
+    u64 end = str.length;
+    while (end > 0 && mtb_char_is_space(str.chars[end - 1])) {
+        end--;
+    }
+    str.length = end;
+    return str;
+}
+
+func MtbStr
+mtb_str_skip(MtbStr str, u64 length)
+{
+    mtb_assert_always(str.length >= length);
+    str.chars += length;
+    str.length -= length;
+    return str;
+}
+
+func MtbStr
+mtb_str_chop(MtbStr str, u64 length)
+{
+    mtb_assert_always(str.length >= length);
+    str.length -= length;
+    return str;
+}
+
+func MtbStr
+mtb_str_to_lower(MtbArena *arena, MtbStr str)
+{
+    if (mtb_str_is_empty(str)) {
+        return str;
+    }
+    char *chars = mtb_arena_bump(arena, char, str.length);
+    for (u64 i = 0; i < str.length; i++) {
+        chars[i] = mtb_char_to_lower(str.chars[i]);
+    }
+    str.chars = chars;
+    return str;
+}
+
+func MtbStr
+mtb_str_to_upper(MtbArena *arena, MtbStr str)
+{
+    if (mtb_str_is_empty(str)) {
+        return str;
+    }
+    char *chars = mtb_arena_bump(arena, char, str.length);
+    for (u64 i = 0; i < str.length; i++) {
+        chars[i] = mtb_char_to_upper(str.chars[i]);
+    }
+    str.chars = chars;
+    return str;
+}
+
+func MtbStr
+mtb_str_dup(MtbArena *arena, MtbStr str)
+{
+    if (mtb_str_is_empty(str)) {
+        return str;
+    }
+    u8 *bytes = mtb_arena_bump(arena, u8, str.length);
+    memcpy(bytes, str.bytes, str.length);
+    str.bytes = bytes;
+    return str;
+}
+
+func MtbStr
+mtb_str_cat(MtbArena *arena, MtbStr a, MtbStr b)
+{
+    u64 length = mtb_add_u64(a.length, b.length);
+    if (length == 0) {
+        return mtb_str_empty();
+    }
+    u8 *bytes = mtb_arena_bump(arena, u8, length);
+    memcpy(bytes, a.bytes, a.length);
+    memcpy(bytes + a.length, b.bytes, b.length);
+    return mtb_str(bytes, length);
+}
+
+func MtbStr
+mtb_str_substr(MtbStr str, u64 beg, u64 end)
+{
+    mtb_assert_always(beg <= end && end <= str.length);
+    str.chars += beg;
+    str.length = end - beg;
+    return str;
+}
+
+func MtbStr
+mtb_str_prefix(MtbStr str, u64 length)
+{
+    mtb_assert_always(str.length >= length);
+    str.length = length;
+    return str;
+}
+
+func MtbStr mtb_str_suffix(MtbStr str, u64 length)
+{
+    mtb_assert_always(str.length >= length);
+    str.chars += str.length - length;
+    str.length = length;
+    return str;
+}
+
+func bool
+mtb_str_is_empty(MtbStr str)
+{
+    return str.length == 0;
+}
+
+func void
+mtb_str_list_init(MtbArena *arena, MtbStrList *list)
+{
+    list->arena = arena;
+    mtb_list_init(&list->node);
+}
+
+func void
+mtb_str_list_clear(MtbStrList *list)
+{
+    mtb_list_reset(&list->node);
+}
+
+func bool
+mtb_str_list_is_empty(MtbStrList *list)
+{
+    return mtb_list_is_empty(&list->node);
+}
+
+func MtbStrList *
+mtb_str_list_append(MtbStrList *list, MtbStr *str)
+{
+    MtbStrList *node = mtb_arena_bump(list->arena, MtbStrList, 1);
+    node->str = str;
+    mtb_list_add_last(&list->node, &node->node);
+    return node;
+}
+
+func MtbStrList *
+mtb_str_list_appendf(MtbStrList *list, char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    MtbStr *str = mtb_arena_bump(list->arena, MtbStr, 1);
+    *str = mtb_str_vsprintf(list->arena, fmt, args);
+    va_end(args);
+    return mtb_str_list_append(list, str);
+}
+
+func MtbStrList *
+mtb_str_list_prepend(MtbStrList *list, MtbStr *str)
+{
+    MtbStrList *node = mtb_arena_bump(list->arena, MtbStrList, 1);
+    node->str = str;
+    mtb_list_add_first(&list->node, &node->node);
+    return node;
+}
+
+func MtbStrList *
+mtb_str_list_prependf(MtbStrList *list, char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    MtbStr *str = mtb_arena_bump(list->arena, MtbStr, 1);
+    *str = mtb_str_vsprintf(list->arena, fmt, args);
+    va_end(args);
+    return mtb_str_list_prepend(list, str);
+}
+
+func MtbStr
+mtb_str_join_opt(MtbStrList *list, MtbStr delim, MtbStrJoinOptions opt)
+{
+    u64 length = 0;
+    mtb_list_foreach(&list->node, n) {
+        MtbStrList *node = mtb_containerof(n, MtbStrList, node);
+        MtbStr *str = node->str;
+        if (!mtb_str_is_empty(*str) || !opt.skipEmpty) {
+            length += str->length + delim.length;
+        }
+    }
+    if (length == 0) {
+        return mtb_str_empty();
+    }
+    length -= delim.length;
+
+    u8 *bytes = mtb_arena_bump(list->arena, u8, length);
+    u64 bytesOffset = 0;
+    mtb_list_foreach(&list->node, n) {
+        MtbStrList *node = mtb_containerof(n, MtbStrList, node);
+        MtbStr *str = node->str;
+        if (!mtb_str_is_empty(*str) || !opt.skipEmpty) {
+            memcpy(bytes + bytesOffset, str->bytes, str->length);
+            bytesOffset += str->length;
+            if (bytesOffset < length) {
+                memcpy(bytes + bytesOffset, delim.bytes, delim.length);
+                bytesOffset += delim.length;
+            }
+        }
+    }
+    return mtb_str(bytes, length);
+}
+
+func void
+mtb_str_split_opt(MtbStrList *list, MtbStr str, MtbStr delim, MtbStrSplitOptions opt)
+{
+    MtbArena *arena = list->arena;
+
+    if (mtb_str_is_empty(delim)) {
+        MtbStr *tok = mtb_arena_bump(arena, MtbStr, 1);
+        *tok = mtb_str_prefix(str, str.length);
+        mtb_str_list_append(list, tok);
+    }
+    else {
+        while (!mtb_str_is_empty(str)) {
+            u64 i = mtb_str_find(str, delim);
+            MtbStr tok = mtb_str_prefix(str, mtb_min_u64(i, str.length));
+            if (!mtb_str_is_empty(tok) || !opt.skipEmpty) {
+                MtbStrList *node = mtb_str_list_append(list, mtb_arena_bump(arena, MtbStr, 1));
+                *node->str = tok;
+
+                str.length -= tok.length;
+                str.bytes += tok.length;
+            }
+            if (i != MTB_STR_NOT_FOUND) {
+                str.length -= delim.length;
+                str.bytes += delim.length;
+            }
+        }
+    }
+}
+
+#endif // MTB_STRING_IMPLEMENTATION
+
+
+#ifdef MTB_STRING_TESTS
+
+#include <assert.h>
+
+
+func void
+_test_mtb_str_cstr(MtbArena arena)
+{
+    char *c1 = "My C String!";
+    MtbStr s1 = mtb_str_from_cstr(c1);
+    assert(strlen(c1) == s1.length);
+    assert(strncmp(c1, s1.chars, s1.length) == 0);
+
+    MtbStr s2 = mtb_str_lit("My non-C string!");
+    char *c2 = mtb_str_to_cstr(&arena, s2);
+    assert(strlen(c1) == s1.length);
+    assert(strncmp(c2, s2.chars, s2.length) == 0);
+}
+
+func void
+_test_mtb_str_sprintf(MtbArena arena)
+{
+    MtbStr e1 = mtb_str_empty();
+    MtbStr a1 = mtb_str_sprintf(&arena, "");
+    assert(e1.length == a1.length);
+    assert(mtb_str_is_equal(e1, a1));
+
+    MtbStr e2 = mtb_str_from_cstr("123\n0.4567\nAbCdEfGh");
+    MtbStr a2 = mtb_str_sprintf(&arena, "%d\n%.4f\n%s", 123, 0.4567, "AbCdEfGh");
+    assert(e2.length == a2.length);
+    assert(mtb_str_is_equal(e2, a2));
+}
+
+func void
+_test_mtb_str_cmp(void)
+{
+    assert(mtb_str_is_equal(mtb_str_empty(), mtb_str_empty()));
+    assert(mtb_str_cmp(mtb_str_lit("abcd"), mtb_str_empty()) > 0);
+    assert(mtb_str_cmp(mtb_str_empty(), mtb_str_lit("abcd")) < 0);
+    assert(mtb_str_is_equal(mtb_str_lit("abcd"), mtb_str_lit("abcd")));
+    assert(mtb_str_cmp(mtb_str_lit("abcd"), mtb_str_lit("abcD")) > 0);
+    assert(mtb_str_cmp(mtb_str_lit("abcD"), mtb_str_lit("abcd")) < 0);
+    assert(mtb_str_cmp(mtb_str_lit("abcde"), mtb_str_lit("abcd")) > 0);
+    assert(mtb_str_cmp(mtb_str_lit("abcd"), mtb_str_lit("abcde")) < 0);
+
+    assert(mtb_str_is_equal(mtb_str_empty(), mtb_str_empty(), .ignoreCase = true));
+    assert(mtb_str_cmp(mtb_str_lit("AbCd"), mtb_str_empty(), .ignoreCase = true) > 0);
+    assert(mtb_str_cmp(mtb_str_empty(), mtb_str_lit("aBcD"), .ignoreCase = true) < 0);
+    assert(mtb_str_is_equal(mtb_str_lit("AbCd"), mtb_str_lit("aBcD"), .ignoreCase = true));
+    assert(mtb_str_cmp(mtb_str_lit("AbCe"), mtb_str_lit("aBcD"), .ignoreCase = true) > 0);
+    assert(mtb_str_cmp(mtb_str_lit("AbCd"), mtb_str_lit("aBcE"), .ignoreCase = true) < 0);
+    assert(mtb_str_cmp(mtb_str_lit("AbCdE"), mtb_str_lit("aBcD"), .ignoreCase = true) > 0);
+    assert(mtb_str_cmp(mtb_str_lit("AbCd"), mtb_str_lit("aBcDe"), .ignoreCase = true) < 0);
+}
+
+func void
+_test_mtb_str_find(void)
+{
+    assert(mtb_str_find(mtb_str_lit("ABCDEFGHIJKLMNOPQRSTUVWXYZ"), mtb_str_empty()) == 0);
+    assert(mtb_str_find(mtb_str_empty(), mtb_str_lit("ABCDEFGHIJKLMNOPQRSTUVWXYZ")) == MTB_STR_NOT_FOUND);
+    assert(mtb_str_find(mtb_str_lit("ABCDEFGHIJKLMNOPQRSTUVWXYZ"), mtb_str_lit("ABCDEFGHIJKLMNOPQRSTUVWXYZ")) == 0);
+    assert(mtb_str_find(mtb_str_lit("ABCDEFGHIJKLMNOPQRSTUVWXYZ"), mtb_str_lit("A")) == 0);
+    assert(mtb_str_find(mtb_str_lit("ABCDEFGHIJKLMNOPQRSTUVWXYZ"), mtb_str_lit("MNOPQRS")) == 12);
+    assert(mtb_str_find(mtb_str_lit("ABCDEFGHIJKLMNOPQRSTUVWXYZ"), mtb_str_lit("Z")) == 25);
+    assert(mtb_str_find(mtb_str_lit("ABCDEFGHIJKLMNOPQRSTUVWXYZ"), mtb_str_lit("z")) == MTB_STR_NOT_FOUND);
+    assert(mtb_str_contains(mtb_str_lit("It's a Me, Mario!"), mtb_str_lit("Mario")));
+    assert(!mtb_str_contains(mtb_str_lit("It's a Me, Mario!"), mtb_str_lit("Wario")));
+
+    assert(mtb_str_find(mtb_str_lit("AbCdEfGhIjKlMnOpQrStUvWxYz"), mtb_str_empty(), .ignoreCase = true) == 0);
+    assert(mtb_str_find(mtb_str_empty(), mtb_str_lit("AbCdEfGhIjKlMnOpQrStUvWxYz"), .ignoreCase = true) == MTB_STR_NOT_FOUND);
+    assert(mtb_str_find(mtb_str_lit("AbCdEfGhIjKlMnOpQrStUvWxYz"), mtb_str_lit("aBcDeFgHiJkLmNoPqRsTuVwXyZ"), .ignoreCase = true) == 0);
+    assert(mtb_str_find(mtb_str_lit("AbCdEfGhIjKlMnOpQrStUvWxYz"), mtb_str_lit("a"), .ignoreCase = true) == 0);
+    assert(mtb_str_find(mtb_str_lit("AbCdEfGhIjKlMnOpQrStUvWxYz"), mtb_str_lit("mNoPqRs"), .ignoreCase = true) == 12);
+    assert(mtb_str_find(mtb_str_lit("AbCdEfGhIjKlMnOpQrStUvWxYz"), mtb_str_lit("Z"), .ignoreCase = true) == 25);
+    assert(mtb_str_find(mtb_str_lit("AbCdEfGhIjKlMnOpQrStUvWxYz"), mtb_str_lit("1"), .ignoreCase = true) == MTB_STR_NOT_FOUND);
+    assert(mtb_str_contains(mtb_str_lit("It's a Me, Mario!"), mtb_str_lit("mario"), .ignoreCase = true));
+    assert(!mtb_str_contains(mtb_str_lit("It's a Me, Mario!"), mtb_str_lit("wario"), .ignoreCase = true));
+}
+
+func void
+_test_mtb_str_has_prefix(void)
+{
+    assert(mtb_str_has_prefix(mtb_str_lit("Hello, World!"), mtb_str_empty()));
+    assert(!mtb_str_has_prefix(mtb_str_empty(), mtb_str_lit("Hello, World!")));
+    assert(mtb_str_has_prefix(mtb_str_lit("Hello, World!"), mtb_str_lit("Hello")));
+    assert(!mtb_str_has_prefix(mtb_str_lit("Hello, World!"), mtb_str_lit("World!")));
+    assert(mtb_str_has_prefix(mtb_str_lit("Hello, World!"), mtb_str_lit("Hello, World!")));
+
+    assert(mtb_str_has_prefix(mtb_str_lit("Hello, World!"), mtb_str_empty(), .ignoreCase = true));
+    assert(!mtb_str_has_prefix(mtb_str_empty(), mtb_str_lit("Hello, World!"), .ignoreCase = true));
+    assert(mtb_str_has_prefix(mtb_str_lit("Hello, World!"), mtb_str_lit("hello"), .ignoreCase = true));
+    assert(!mtb_str_has_prefix(mtb_str_lit("Hello, World!"), mtb_str_lit("world!"), .ignoreCase = true));
+    assert(mtb_str_has_prefix(mtb_str_lit("Hello, World!"), mtb_str_lit("hello, world!"), .ignoreCase = true));
+}
+
+func void
+_test_mtb_str_has_suffix(void)
+{
+    assert(mtb_str_has_suffix(mtb_str_lit("Hello, World!"), mtb_str_empty()));
+    assert(!mtb_str_has_suffix(mtb_str_empty(), mtb_str_lit("Hello, World!")));
+    assert(mtb_str_has_suffix(mtb_str_lit("Hello, World!"), mtb_str_lit("World!")));
+    assert(!mtb_str_has_suffix(mtb_str_lit("Hello, World!"), mtb_str_lit("Hello")));
+    assert(mtb_str_has_suffix(mtb_str_lit("Hello, World!"), mtb_str_lit("Hello, World!")));
+
+    assert(mtb_str_has_suffix(mtb_str_lit("Hello, World!"), mtb_str_empty(), .ignoreCase = true));
+    assert(!mtb_str_has_suffix(mtb_str_empty(), mtb_str_lit("Hello, World!"), .ignoreCase = true));
+    assert(mtb_str_has_suffix(mtb_str_lit("Hello, World!"), mtb_str_lit("world!"), .ignoreCase = true));
+    assert(!mtb_str_has_suffix(mtb_str_lit("Hello, World!"), mtb_str_lit("hello"), .ignoreCase = true));
+    assert(mtb_str_has_suffix(mtb_str_lit("Hello, World!"), mtb_str_lit("hello, world!"), .ignoreCase = true));
+}
+
+func void
+_test_mtb_str_trim(void)
+{
+    assert(mtb_str_is_equal(mtb_str_trim(mtb_str_empty()), mtb_str_empty()));
+    assert(mtb_str_is_equal(mtb_str_trim(mtb_str_lit(" \t\r\n\v\f")), mtb_str_empty()));
+    assert(mtb_str_is_equal(mtb_str_trim(mtb_str_lit("Hello! \t\r\n\v\f")), mtb_str_lit("Hello!")));
+    assert(mtb_str_is_equal(mtb_str_trim(mtb_str_lit(" \t\r\n\v\fHello!")), mtb_str_lit("Hello!")));
+    assert(mtb_str_is_equal(mtb_str_trim(mtb_str_lit(" \t\r\n\v\fHello! \t\r\n\v\f")), mtb_str_lit("Hello!")));
+}
+
+func void
+_test_mtb_str_trim_beg(void)
+{
+    assert(mtb_str_is_equal(mtb_str_trim_beg(mtb_str_empty()), mtb_str_empty()));
+    assert(mtb_str_is_equal(mtb_str_trim_beg(mtb_str_lit(" \t\r\n\v\f")), mtb_str_empty()));
+    assert(mtb_str_is_equal(mtb_str_trim_beg(mtb_str_lit("Hello! \t\r\n\v\f")), mtb_str_lit("Hello! \t\r\n\v\f")));
+    assert(mtb_str_is_equal(mtb_str_trim_beg(mtb_str_lit(" \t\r\n\v\fHello!")), mtb_str_lit("Hello!")));
+    assert(mtb_str_is_equal(mtb_str_trim_beg(mtb_str_lit(" \t\r\n\v\fHello! \t\r\n\v\f")), mtb_str_lit("Hello! \t\r\n\v\f")));
+}
+
+func void
+_test_mtb_str_trim_end(void)
+{
+    assert(mtb_str_is_equal(mtb_str_trim_end(mtb_str_empty()), mtb_str_empty()));
+    assert(mtb_str_is_equal(mtb_str_trim_end(mtb_str_lit(" \t\r\n\v\f")), mtb_str_empty()));
+    assert(mtb_str_is_equal(mtb_str_trim_end(mtb_str_lit("Hello! \t\r\n\v\f")), mtb_str_lit("Hello!")));
+    assert(mtb_str_is_equal(mtb_str_trim_end(mtb_str_lit(" \t\r\n\v\fHello!")), mtb_str_lit(" \t\r\n\v\fHello!")));
+    assert(mtb_str_is_equal(mtb_str_trim_end(mtb_str_lit(" \t\r\n\v\fHello! \t\r\n\v\f")), mtb_str_lit(" \t\r\n\v\fHello!")));
+}
+
+func void
+_test_mtb_str_skip()
+{
+    assert(mtb_str_is_equal(mtb_str_skip(mtb_str_empty(), 0), mtb_str_empty()));
+    assert(mtb_str_is_equal(mtb_str_skip(mtb_str_lit("Hello, World!"), 0), mtb_str_lit("Hello, World!")));
+    assert(mtb_str_is_equal(mtb_str_skip(mtb_str_lit("Hello, World!"), 7), mtb_str_lit("World!")));
+    assert(mtb_str_is_equal(mtb_str_skip(mtb_str_lit("Hello, World!"), 13), mtb_str_empty()));
+}
+
+func void
+_test_mtb_str_chop()
+{
+    assert(mtb_str_is_equal(mtb_str_chop(mtb_str_empty(), 0), mtb_str_empty()));
+    assert(mtb_str_is_equal(mtb_str_chop(mtb_str_lit("Hello, World!"), 0), mtb_str_lit("Hello, World!")));
+    assert(mtb_str_is_equal(mtb_str_chop(mtb_str_lit("Hello, World!"), 8), mtb_str_lit("Hello")));
+    assert(mtb_str_is_equal(mtb_str_chop(mtb_str_lit("Hello, World!"), 13), mtb_str_empty()));
+}
+
+func void
+_test_mtb_str_to_lower(MtbArena arena)
+{
+    assert(mtb_str_is_equal(mtb_str_to_lower(&arena, mtb_str_empty()), mtb_str_empty()));
+    assert(mtb_str_is_equal(mtb_str_to_lower(&arena, mtb_str_lit("Hello, World!")), mtb_str_lit("hello, world!")));
+}
+
+func void
+_test_mtb_str_to_upper(MtbArena arena)
+{
+    assert(mtb_str_is_equal(mtb_str_to_upper(&arena, mtb_str_empty()), mtb_str_empty()));
+    assert(mtb_str_is_equal(mtb_str_to_upper(&arena, mtb_str_lit("Hello, World!")), mtb_str_lit("HELLO, WORLD!")));
+}
+
+func void
+_test_mtb_str_dup(MtbArena arena)
+{
+    MtbStr o1 = mtb_str_empty();
+    MtbStr a1 = mtb_str_dup(&arena, o1);
+    assert(mtb_str_is_empty(a1));
+    assert(mtb_str_is_equal(o1, a1));
 
-    char *textCopy = strcpy(mtb_arena_bump(&arena, char, strlen(text) + 1), text);
-    char *token = strtok(textCopy, " ");
-    while (token != nil) {
-        u64 *count = mtb_hmap_get(&hmap, &token);
-        if (count == nil) {
-            *(u64 *)mtb_hmap_put(&hmap, &token) = 1;
+    MtbStr o2 = mtb_str_lit("Duplicate Me!");
+    MtbStr a2 = mtb_str_dup(&arena, o2);
+    assert(o2.bytes != a2.bytes);
+    assert(mtb_str_is_equal(o2, a2));
+}
+
+func void
+_test_mtb_str_cat(MtbArena arena)
+{
+    MtbStr e1 = mtb_str_empty();
+    MtbStr a1 = mtb_str_cat(&arena, mtb_str_empty(), mtb_str_empty());
+    assert(mtb_str_is_equal(e1, a1));
+
+    MtbStr e2 = mtb_str_lit("abcd");
+    MtbStr a2 = mtb_str_cat(&arena, mtb_str_lit("abcd"), mtb_str_empty());
+    assert(mtb_str_is_equal(e2, a2));
+
+    MtbStr e3 = mtb_str_lit("abcd");
+    MtbStr a3 = mtb_str_cat(&arena, mtb_str_empty(), mtb_str_lit("abcd"));
+    assert(mtb_str_is_equal(e3, a3));
+
+    MtbStr e4 = mtb_str_lit("abcd1234");
+    MtbStr a4 = mtb_str_cat(&arena, mtb_str_lit("abcd"), mtb_str_lit("1234"));
+    assert(mtb_str_is_equal(e4, a4));
+}
+
+func void
+_test_mtb_str_substr(void)
+{
+    MtbStr s = mtb_str_lit("Hello, World!");
+    assert(mtb_str_is_equal(mtb_str_substr(s, 0, s.length), mtb_str_lit("Hello, World!")));
+    assert(mtb_str_is_equal(mtb_str_substr(s, 0, 5), mtb_str_lit("Hello")));
+    assert(mtb_str_is_equal(mtb_str_substr(s, 7, s.length), mtb_str_lit("World!")));
+    assert(mtb_str_is_equal(mtb_str_substr(s, 0, 0), mtb_str_empty()));
+    assert(mtb_str_is_equal(mtb_str_substr(s, s.length, s.length), mtb_str_empty()));
+}
+
+func void
+_test_mtb_str_prefix()
+{
+    assert(mtb_str_is_equal(mtb_str_prefix(mtb_str_empty(), 0), mtb_str_empty()));
+    assert(mtb_str_is_equal(mtb_str_prefix(mtb_str_lit("Hello, World!"), 0), mtb_str_empty()));
+    assert(mtb_str_is_equal(mtb_str_prefix(mtb_str_lit("Hello, World!"), 5), mtb_str_lit("Hello")));
+    assert(mtb_str_is_equal(mtb_str_prefix(mtb_str_lit("Hello, World!"), 13), mtb_str_lit("Hello, World!")));
+}
+
+func void
+_test_mtb_str_suffix()
+{
+    assert(mtb_str_is_equal(mtb_str_suffix(mtb_str_empty(), 0), mtb_str_empty()));
+    assert(mtb_str_is_equal(mtb_str_suffix(mtb_str_lit("Hello, World!"), 0), mtb_str_empty()));
+    assert(mtb_str_is_equal(mtb_str_suffix(mtb_str_lit("Hello, World!"), 6), mtb_str_lit("World!")));
+    assert(mtb_str_is_equal(mtb_str_suffix(mtb_str_lit("Hello, World!"), 13), mtb_str_lit("Hello, World!")));
+}
+
+func void
+_test_mtb_str_join(MtbArena arena)
+{
+    MtbStrList list = {0};
+    mtb_str_list_init(&arena, &list);
+
+    char *e1 = "";
+    MtbStr a1 = mtb_str_join_char(&list, ' ');
+    assert(a1.length == strlen(e1));
+    assert(strncmp(a1.chars, e1, a1.length) == 0);
+    mtb_str_list_clear(&list);
+
+    char *e2 = "HI";
+    mtb_str_list_prepend_lit(&list, "HI");
+    MtbStr a2 = mtb_str_join_char(&list, ' ');
+    assert(a2.length == strlen(e2));
+    assert(strncmp(a2.chars, e2, a2.length) == 0);
+    mtb_str_list_clear(&list);
+
+    char *e3 = "HELLO MY DEAR WORLD !";
+    mtb_str_list_prepend_lit(&list, "DEAR");
+    mtb_str_list_prepend_lit(&list, "MY");
+    mtb_str_list_prepend_lit(&list, "HELLO");
+    mtb_str_list_append_lit(&list, "WORLD");
+    mtb_str_list_append_lit(&list, "!");
+    MtbStr a3 = mtb_str_join_char(&list, ' ');
+    assert(a3.length == strlen(e3));
+    assert(strncmp(a3.chars, e3, a3.length) == 0);
+    mtb_str_list_clear(&list);
+
+    char *e4 = "HELLO!";
+    mtb_str_list_append_lit(&list, "!");
+    mtb_str_list_prepend_lit(&list, "HELLO");
+    MtbStr a4 = mtb_str_join_lit(&list, "");
+    assert(a4.length == strlen(e4));
+    assert(strncmp(a4.chars, e4, a4.length) == 0);
+    mtb_str_list_clear(&list);
+
+    char *e5 = "100! 0.12345?";
+    mtb_str_list_appendf(&list, "%.5f?", 0.123451f);
+    mtb_str_list_prependf(&list, "%d!", 100);
+    MtbStr a5 = mtb_str_join_char(&list, ' ');
+    assert(a5.length == strlen(e5));
+    assert(strncmp(a5.chars, e5, a5.length) == 0);
+    mtb_str_list_clear(&list);
+
+    char *e6 = ",,";
+    mtb_str_list_append_lit(&list, "");
+    mtb_str_list_append_lit(&list, "");
+    mtb_str_list_append_lit(&list, "");
+    MtbStr a6 = mtb_str_join_char(&list, ',');
+    assert(a6.length == strlen(e6));
+    assert(strncmp(a6.chars, e6, a6.length) == 0);
+    mtb_str_list_clear(&list);
+
+    char *e7 = "";
+    mtb_str_list_append_lit(&list, "");
+    mtb_str_list_append_lit(&list, "");
+    mtb_str_list_append_lit(&list, "");
+    MtbStr a7 = mtb_str_join_char(&list, ',', .skipEmpty = true);
+    assert(a7.length == strlen(e7));
+    assert(strncmp(a7.chars, e7, a7.length) == 0);
+    mtb_str_list_clear(&list);
+
+    assert(mtb_str_list_is_empty(&list));
+}
+
+func void
+_test_mtb_str_split(MtbArena arena)
+{
+    MtbStrList list = {0};
+    mtb_str_list_init(&arena, &list);
+
+    MtbStr s1 = mtb_str_empty();
+    mtb_str_split_char(&list, s1, ',');
+    assert(mtb_str_list_is_empty(&list));
+    mtb_str_list_clear(&list);
+
+    MtbStr s2 = mtb_str_lit("A,B,C,D,E");
+    MtbStr e2[] = { mtb_str_lit("A"), mtb_str_lit("B"), mtb_str_lit("C"), mtb_str_lit("D"), mtb_str_lit("E") };
+    mtb_str_split_char(&list, s2, ',');
+    i32 i2 = 0;
+    mtb_list_foreach(&list.node, n) {
+        MtbStrList *node = mtb_containerof(n, MtbStrList, node);
+        assert(mtb_str_is_equal(*node->str, e2[i2++]));
+    }
+    mtb_str_list_clear(&list);
+
+    MtbStr s3 = mtb_str_lit("A,B,C,D,E");
+    MtbStr e3[] = { mtb_str_lit("A,B,C,D,E") };
+    mtb_str_split_lit(&list, s3, " ");
+    i32 i3 = 0;
+    mtb_list_foreach(&list.node, n) {
+        MtbStrList *node = mtb_containerof(n, MtbStrList, node);
+        assert(mtb_str_is_equal(*node->str, e3[i3++]));
+    }
+    mtb_str_list_clear(&list);
+
+    MtbStr s4 = mtb_str_lit("A,B,C,D,E");
+    MtbStr e4[] = { mtb_str_lit("A,B,C,D,E") };
+    mtb_str_split(&list, s4, mtb_str_empty());
+    i32 i4 = 0;
+    mtb_list_foreach(&list.node, n) {
+        MtbStrList *node = mtb_containerof(n, MtbStrList, node);
+        assert(mtb_str_is_equal(*node->str, e4[i4++]));
+    }
+    mtb_str_list_clear(&list);
+
+    MtbStr s5 = mtb_str_lit(",,");
+    MtbStr e5[] = { mtb_str_empty(), mtb_str_empty(), mtb_str_empty() };
+    mtb_str_split_char(&list, s5, ',');
+    i32 i5 = 0;
+    mtb_list_foreach(&list.node, n) {
+        MtbStrList *node = mtb_containerof(n, MtbStrList, node);
+        assert(mtb_str_is_equal(*node->str, e5[i5++]));
+    }
+    mtb_str_list_clear(&list);
+
+    MtbStr s6 = mtb_str_lit(",,");
+    mtb_str_split_char(&list, s6, ',', .skipEmpty = true);
+    assert(mtb_str_list_is_empty(&list));
+    mtb_str_list_clear(&list);
+
+    assert(mtb_str_list_is_empty(&list));
+}
+
+func void
+_test_mtb_str_hash(void)
+{
+    u8 bytes[128 + 8];
+    for (u64 i = 0; i < sizeof(bytes); i++) {
+        bytes[i] = (u8)(i * 7 + 1);
+    }
+    u64 hashes[129];
+    for (u64 length = 0; length <= 128; length++) {
+        hashes[length] = mtb_str_hash(mtb_str(bytes, length));
+        // doesn't depend on alignment
+        u8 copy[128 + 8];
+        for (u64 offset = 1; offset < 8; offset++) {
+            memcpy(copy + offset, bytes, length);
+            assert(mtb_str_hash(mtb_str(copy + offset, length)) == hashes[length]);
         }
-        else {
-            *count += 1;
+        // every prefix is different
+        for (u64 prev = 0; prev < length; prev++) {
+            assert(hashes[prev] != hashes[length]);
         }
-        token = strtok(nil, " ");
+        // every byte counts
+        if (length > 0) {
+            bytes[length / 2] ^= 1;
+            assert(mtb_str_hash(mtb_str(bytes, length)) != hashes[length]);
+            bytes[length / 2] ^= 1;
+        }
+    }
+    assert(mtb_str_hash_bytes(bytes, 16, 1) != mtb_str_hash_bytes(bytes, 16, 2));
+    assert(mtb_str_key_hash(&mtb_str_lit("abc")) == mtb_str_hash(mtb_str_lit("abc")));
+
+    // low bits are well spread, hmap only uses those
+    u8 buckets[256] = {0};
+    for (u32 i = 0; i < 256; i++) {
+        char key[4] = { 'k', 'e', 'y', (char)i };
+        buckets[mtb_str_hash(mtb_str((u8 *)key, sizeof(key))) & 255] = 1;
+    }
+    u32 used = 0;
+    for (u32 i = 0; i < 256; i++) {
+        used += buckets[i];
+    }
+    assert(used > 140); // ~162 expected for random hashes
+}
+
+func void
+_test_mtb_string(void)
+{
+    MtbArena arena = {0};
+    mtb_arena_init(&arena, kb(1), &MTB_ARENA_DEF_ALLOCATOR);
+
+    _test_mtb_str_cstr(arena);
+    _test_mtb_str_sprintf(arena);
+    _test_mtb_str_cmp();
+    _test_mtb_str_find();
+    _test_mtb_str_has_prefix();
+    _test_mtb_str_has_suffix();
+    _test_mtb_str_trim();
+    _test_mtb_str_skip();
+    _test_mtb_str_chop();
+    _test_mtb_str_to_lower(arena);
+    _test_mtb_str_to_upper(arena);
+    _test_mtb_str_dup(arena);
+    _test_mtb_str_cat(arena);
+    _test_mtb_str_substr();
+    _test_mtb_str_prefix();
+    _test_mtb_str_suffix();
+    _test_mtb_str_join(arena);
+    _test_mtb_str_split(arena);
+    _test_mtb_str_hash();
+
+    mtb_arena_deinit(&arena);
+}
+
+#endif // MTB_STRING_TESTS
+
+
+#ifdef MTB_STRING_BENCH
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+// The corpus shared by the benches, loaded once by bench.c: data/shakespeare.txt split on whitespace.
+// Separators are overwritten w/ '\0', so the chars of every token are also a C string.
+func MtbStr
+_bench_mtb_corpus_load(MtbArena *arena, MtbDynArr *tokens)
+{
+    FILE *inputFile = fopen("data/shakespeare.txt", "r");
+    if (inputFile == nil) {
+        fprintf(stderr, "fopen() failed\n");
+        exit(1);
+    }
+    fseek(inputFile, 0L, SEEK_END);
+    u64 inputFileSize = ftell(inputFile);
+    fseek(inputFile, 0L, SEEK_SET);
+
+    mtb_arena_init(arena, inputFileSize * 8, &MTB_ARENA_DEF_ALLOCATOR);
+
+    u8 *inputData = mtb_arena_bump(arena, u8, inputFileSize + 1);
+    if (fread(inputData, sizeof(u8), inputFileSize, inputFile) != inputFileSize) {
+        fprintf(stderr, "fread() failed\n");
+        exit(1);
     }
-    assert(!mtb_hmap_is_empty(&hmap));
-    for (u64 i = 0; i < mtb_countof(hist); i++) {
-        struct histogram *wc = hist + i;
-        assert(*(u64 *)mtb_hmap_get(&hmap, &wc->word) == wc->count);
+    fclose(inputFile);
+    MtbStr corpus = mtb_str(inputData, inputFileSize);
+
+    mtb_dynarr_init(tokens, arena, sizeof(MtbStr));
+    u64 beg = 0;
+    for (u64 i = 0; i <= corpus.length; i++) {
+        if (i == corpus.length || mtb_char_is_space(corpus.chars[i])) {
+            if (i > beg) {
+                *(MtbStr *)mtb_dynarr_push(tokens) = mtb_str_substr(corpus, beg, i);
+            }
+            corpus.chars[i] = '\0';
+            beg = i + 1;
+        }
     }
+    return corpus;
+}
 
-    mtb_hmap_clear(&hmap);
-    assert(mtb_hmap_is_empty(&hmap));
+
+func u64
+_bench_mtb_str_key_hash_mul(void *key)
+{
+    MtbStr *s = (MtbStr *)key;
+    u64 hash = 0;
+    for (u64 i = 0; i < s->length; i++) {
+        hash = 17000069 * hash + s->chars[i];
+    }
+    return hash;
 }
 
 func void
-_test_mtb_hmap_remove(MtbArena arena)
+_bench_mtb_str_hash(MtbArena *arena, MtbDynArr *tokens, MtbStr corpus, u64 (*key_hash)(void *key))
 {
-    MtbHmap hmap = {0};
-    mtb_hmap_init(&hmap, &arena, sizeof(char *), sizeof(u64), _calc_hash_str, _is_equal_str);
+    mtb_arena_temp_scope(arena);
+    u64 iterationCount = 100;
+    u64 sum = 0;
 
-    char *k1 = "Pizza";
-    u64 v1 = 11;
+    u64 beg = mtb_perf_cpu_time();
+    for (u64 i = 0; i < iterationCount; i++) {
+        for (u64 t = 0; t < tokens->length; t++) {
+            sum += key_hash(mtb_dynarr_get(tokens, t));
+        }
+    }
+    u64 tokensTime = mtb_perf_cpu_time() - beg;
 
-    assert(mtb_hmap_remove(&hmap, &k1) == nil);
+    beg = mtb_perf_cpu_time();
+    for (u64 i = 0; i < iterationCount; i++) {
+        sum += key_hash(&corpus);
+    }
+    u64 corpusTime = mtb_perf_cpu_time() - beg;
 
-    for (int i = 0; i < 5; i++) {
-        *(u64 *)mtb_hmap_put(&hmap, &k1) = v1;
-        assert(*(u64 *)mtb_hmap_remove(&hmap, &k1) == v1);
-        assert(mtb_hmap_remove(&hmap, &k1) == nil);
+    beg = mtb_perf_cpu_time();
+    MtbHmap hmap = {0};
+    mtb_hmap_init(&hmap, arena, MtbStr, u64, key_hash, mtb_str_key_equals);
+    for (u64 i = 0; i < iterationCount / 10; i++) {
+        mtb_hmap_clear(&hmap);
+        for (u64 t = 0; t < tokens->length; t++) {
+            bool inserted;
+            *(u64 *)mtb_hmap_upsert(&hmap, mtb_dynarr_get(tokens, t), &inserted) += 1;
+        }
     }
+    u64 wordCountTime = mtb_perf_cpu_time() - beg;
 
-    assert(mtb_hmap_is_empty(&hmap));
+    printf("tokens: %lu, corpus: %lu, word count: %lu (cpu time, checksum %lu)\n",
+           tokensTime, corpusTime, wordCountTime, sum);
 }
 
 func void
-_test_mtb_hmap_iter(MtbArena arena)
+_bench_mtb_string(MtbStr corpus, MtbDynArr *tokens)
 {
-    MtbHmap hmap = {0};
-    mtb_hmap_init(&hmap, &arena, sizeof(char *), sizeof(u64), _calc_hash_str, _is_equal_str);
+    MtbArena arena = {0};
+    mtb_arena_init(&arena, mb(64), &MTB_ARENA_DEF_ALLOCATOR);
 
-    MtbHmapIter it = {0};
-    mtb_hmap_iter_init(&it, &hmap);
+    printf("== multiplicative string hash ==\n");
+    _bench_mtb_str_hash(&arena, tokens, corpus, _bench_mtb_str_key_hash_mul);
+    printf("== mtb_str_hash ==\n");
+    _bench_mtb_str_hash(&arena, tokens, corpus, mtb_str_key_hash);
 
-    assert(!mtb_hmap_iter_has_next(&it));
+    mtb_arena_deinit(&arena);
+}
 
-    struct {
-        char *letter;
-        u64 order;
-    } alphabet[] = {
-        { .letter = "a", .order = 0 },
-        { .letter = "b", .order = 1 },
-        { .letter = "c", .order = 2 },
-        { .letter = "d", .order = 3 },
-        { .letter = "e", .order = 4 },
-        { .letter = "f", .order = 5 },
-        { .letter = "g", .order = 6 },
-        { .letter = "h", .order = 7 },
-        { .letter = "i", .order = 8 },
-        { .letter = "j", .order = 9 },
-        { .letter = "k", .order = 10 },
-        { .letter = "l", .order = 11 },
-        { .letter = "m", .order = 12 },
-        { .letter = "n", .order = 13 },
-        { .letter = "o", .order = 14 },
-        { .letter = "p", .order = 15 },
-        { .letter = "q", .order = 16 },
-        { .letter = "r", .order = 17 },
-        { .letter = "s", .order = 18 },
-        { .letter = "t", .order = 19 },
-        { .letter = "u", .order = 20 },
-        { .letter = "v", .order = 21 },
-        { .letter = "w", .order = 22 },
-        { .letter = "x", .order = 23 },
-        { .letter = "y", .order = 24 },
-        { .letter = "z", .order = 25 },
-    };
+#endif // MTB_STRING_BENCH
+#ifndef MTB_PHASH_H
+#define MTB_PHASH_H
 
-    char *removed[] = { "k", "o", "t", "e", "n" };
+#ifdef MTB_IMPLEMENTATION
+#define MTB_PHASH_IMPLEMENTATION
+#endif
 
-    for (u64 i = 0; i < mtb_countof(alphabet); i++) {
-        *(u64 *)mtb_hmap_put(&hmap, &alphabet[i].letter) = alphabet[i].order;
-    }
+#ifdef MTB_TESTS
+#define MTB_PHASH_TESTS
+#endif
 
-    mtb_hmap_iter_reset(&it);
-    while (mtb_hmap_iter_has_next(&it)) {
-        char *key = *(char **)mtb_hmap_iter_next_key(&it);
-        for (u64 i = 0; i < mtb_countof(removed); i++) {
-            if (strcmp(key, removed[i]) == 0) {
-                mtb_hmap_iter_remove(&it);
-            }
-        }
+#ifdef MTB_BENCH
+#define MTB_PHASH_BENCH
+#endif
+
+
+#ifndef MTB_PHASH_DEF_BUCKET_LOAD
+#define MTB_PHASH_DEF_BUCKET_LOAD 4.0f
+#endif
+
+#ifndef MTB_PHASH_MAX_PILOT
+#define MTB_PHASH_MAX_PILOT (1u << 24) // tries per bucket before the build restarts w/ the next seed
+#endif
+
+#define MTB_PHASH_MAGIC 0x3148534148504d4dull // "MMPHASH1"
+
+
+/* Static Minimal Perfect Hash Table */
+
+// CHD style: keys are hashed into buckets of ~MTB_PHASH_DEF_BUCKET_LOAD keys, the biggest
+// buckets are placed first, every bucket gets the first pilot that maps all of its keys to
+// free slots. A lookup is one hash, one pilot load and one key compare.
+//
+// The table is a single blob (this header + data) w/ offsets instead of pointers,
+// phash->size bytes from phash can be written out and loaded back (or mmap-ed) as is.
+typedef struct mtb_phash MtbPhash;
+struct mtb_phash
+{
+    u64 magic;
+    u64 size; // of the whole blob
+    u64 count;
+    u64 bucketCount;
+    u64 seed;
+    u64 keySize; // 0 for MtbStr keys
+
+    // from the start of the blob
+    u64 pilotsOffset;     // u32[bucketCount]
+    u64 indicesOffset;    // u32[count], index of the key in the build input, by slot
+    u64 keyOffsetsOffset; // u32[count + 1], MtbStr keys only
+    u64 keysOffset;       // key bytes, by slot
+};
+
+typedef struct mtb_phash_build_options MtbPhashBuildOptions;
+struct mtb_phash_build_options
+{
+    u64 seed;
+    f32 bucketLoad; // avg keys per bucket, MTB_PHASH_DEF_BUCKET_LOAD if 0, more is smaller but slower to build
+};
+
+
+// The keys must be unique, the blob is bumped from the arena (temporaries go above it).
+func MtbPhash *mtb_phash_build_str_opt(MtbArena *arena, MtbStr *keys, u64 count, MtbPhashBuildOptions opt);
+#define mtb_phash_build_str(arena, keys, count, ...) \
+    mtb_phash_build_str_opt(arena, keys, count, (MtbPhashBuildOptions){ __VA_ARGS__ })
+func MtbPhash *mtb_phash_build_u64_opt(MtbArena *arena, u64 *keys, u64 count, MtbPhashBuildOptions opt);
+#define mtb_phash_build_u64(arena, keys, count, ...) \
+    mtb_phash_build_u64_opt(arena, keys, count, (MtbPhashBuildOptions){ __VA_ARGS__ })
+
+// Returns the index of the key in the build input, U64_MAX if it's not in the table.
+func u64 mtb_phash_get_str(MtbPhash *phash, MtbStr key);
+func u64 mtb_phash_get_u64(MtbPhash *phash, u64 key);
+
+// Validates a serialized table (8 byte aligned), returns nil if it's not one.
+func MtbPhash *mtb_phash_load(void *blob, u64 size);
+
+#endif //MTB_PHASH_H
+
+
+#ifdef MTB_PHASH_IMPLEMENTATION
+
+#include <string.h>
+
+
+#define _mtb_phash_bucket(hash, bucketCount) ((((hash) >> 32) * (bucketCount)) >> 32)
+#define _mtb_phash_data(phash, type, offset) ((type *)((u8 *)(phash) + (phash)->offset))
+
+func u64
+_mtb_phash_slot(u64 hash, u32 pilot, u64 count)
+{
+    u64 h = hash ^ (pilot * u64_lit(0x9E3779B97F4A7C15));
+    h ^= h >> 33;
+    h *= u64_lit(0xff51afd7ed558ccd);
+    h ^= h >> 33;
+    return (u64)(((__uint128_t)h * count) >> 64);
+}
+
+// Either strKeys or u64Keys is given.
+func MtbStr
+_mtb_phash_input_key(MtbStr *strKeys, u64 *u64Keys, u64 index)
+{
+    return strKeys != nil ? strKeys[index] : mtb_str((u8 *)(u64Keys + index), sizeof(u64));
+}
+
+func bool
+_mtb_phash_place(MtbPhash *phash, MtbStr *strKeys, u64 *u64Keys, u64 *hashes, u32 *slotKeys, MtbArena *scratch)
+{
+    u64 count = phash->count;
+    u64 bucketCount = phash->bucketCount;
+    u32 *pilots = _mtb_phash_data(phash, u32, pilotsOffset);
+    mtb_arena_temp_scope(scratch); // released for the next seed
+
+    // keys grouped by bucket (counting sort)
+    u32 *bucketBeg = mtb_arena_bump(scratch, u32, bucketCount + 1);
+    u32 *bucketKeys = mtb_arena_bump(scratch, u32, count, .no_zero = true);
+    for (u64 i = 0; i < count; i++) {
+        MtbStr key = _mtb_phash_input_key(strKeys, u64Keys, i);
+        hashes[i] = mtb_str_hash_bytes(key.bytes, key.length, phash->seed);
+        bucketBeg[_mtb_phash_bucket(hashes[i], bucketCount) + 1]++;
     }
-    for (u64 i = 0; i < mtb_countof(removed); i++) {
-        assert(mtb_hmap_get(&hmap, &removed[i]) == nil);
+    u32 maxBucketSize = 0;
+    for (u64 b = 0; b < bucketCount; b++) {
+        maxBucketSize = bucketBeg[b + 1] > maxBucketSize ? bucketBeg[b + 1] : maxBucketSize;
+        bucketBeg[b + 1] += bucketBeg[b];
+    }
+    u32 *cursor = mtb_arena_bump(scratch, u32, bucketCount, .no_zero = true);
+    memcpy(cursor, bucketBeg, bucketCount * sizeof(u32));
+    for (u64 i = 0; i < count; i++) {
+        bucketKeys[cursor[_mtb_phash_bucket(hashes[i], bucketCount)]++] = (u32)i;
     }
 
-    mtb_hmap_iter_reset(&it);
-    while (mtb_hmap_iter_has_next(&it)) {
-        mtb_hmap_iter_next(&it);
-        mtb_hmap_iter_remove(&it);
+    // buckets by size, biggest first (counting sort)
+    u32 *sizeBeg = mtb_arena_bump(scratch, u32, maxBucketSize + 2);
+    u32 *order = mtb_arena_bump(scratch, u32, bucketCount, .no_zero = true);
+    for (u64 b = 0; b < bucketCount; b++) {
+        sizeBeg[maxBucketSize - (bucketBeg[b + 1] - bucketBeg[b]) + 1]++;
+    }
+    for (u64 s = 0; s <= maxBucketSize; s++) {
+        sizeBeg[s + 1] += sizeBeg[s];
+    }
+    for (u64 b = 0; b < bucketCount; b++) {
+        order[sizeBeg[maxBucketSize - (bucketBeg[b + 1] - bucketBeg[b])]++] = (u32)b;
     }
-    assert(mtb_hmap_is_empty(&hmap));
 
-    mtb_hmap_iter_reset(&it);
-    assert(!mtb_hmap_iter_has_next(&it));
+    memset(slotKeys, 0xFF, count * sizeof(u32));
+    u64 *slots = mtb_arena_bump(scratch, u64, maxBucketSize, .no_zero = true);
+    for (u64 i = 0; i < bucketCount; i++) {
+        u32 b = order[i];
+        u32 *bucket = bucketKeys + bucketBeg[b];
+        u32 size = bucketBeg[b + 1] - bucketBeg[b];
+        if (size == 0) {
+            break;
+        }
+
+        // equal hashes never separate, either a duplicate key or a bad seed
+        for (u32 j = 0; j < size; j++) {
+            for (u32 k = j + 1; k < size; k++) {
+                if (hashes[bucket[j]] == hashes[bucket[k]]) {
+                    MtbStr key1 = _mtb_phash_input_key(strKeys, u64Keys, bucket[j]);
+                    MtbStr key2 = _mtb_phash_input_key(strKeys, u64Keys, bucket[k]);
+                    mtb_assert_always(key1.length != key2.length || memcmp(key1.bytes, key2.bytes, key1.length) != 0);
+                    return false;
+                }
+            }
+        }
+
+        u32 pilot = 0;
+        for (;; pilot++) {
+            if (pilot == MTB_PHASH_MAX_PILOT) {
+                return false;
+            }
+            u32 placed = 0;
+            for (; placed < size; placed++) {
+                u64 slot = _mtb_phash_slot(hashes[bucket[placed]], pilot, count);
+                if (slotKeys[slot] != U32_MAX) {
+                    break;
+                }
+                slotKeys[slot] = bucket[placed];
+                slots[placed] = slot;
+            }
+            if (placed == size) {
+                break;
+            }
+            for (u32 j = 0; j < placed; j++) {
+                slotKeys[slots[j]] = U32_MAX;
+            }
+        }
+        pilots[b] = pilot;
+    }
+    return true;
 }
 
-func void
-_test_mtb_hmap(void)
+func MtbPhash *
+_mtb_phash_build(MtbArena *arena, MtbStr *strKeys, u64 *u64Keys, u64 keySize, u64 count, MtbPhashBuildOptions opt)
 {
-    MtbArena arena = {0};
-    mtb_arena_init(&arena, mb(1), &MTB_ARENA_DEF_ALLOCATOR);
+    mtb_assert_always(count < U32_MAX);
+    mtb_assert_always(0.0f <= opt.bucketLoad);
 
-    _test_mtb_hmap_put(arena);
-    _test_mtb_hmap_remove(arena);
-    _test_mtb_hmap_calc_capacity();
-    _test_mtb_hmap_iter(arena);
+    f32 bucketLoad = opt.bucketLoad == 0.0f ? MTB_PHASH_DEF_BUCKET_LOAD : opt.bucketLoad;
+    u64 bucketCount = (u64)((f32)count / bucketLoad) + 1;
+    mtb_assert_always(bucketCount < U32_MAX);
+    u64 keyBytes = count * keySize;
+    for (u64 i = 0; keySize == 0 && i < count; i++) {
+        keyBytes += strKeys[i].length;
+    }
+    mtb_assert_always(keyBytes < U32_MAX);
+
+    u64 size = sizeof(MtbPhash);
+    u64 pilotsOffset = size;
+    size += bucketCount * sizeof(u32);
+    u64 indicesOffset = size;
+    size += count * sizeof(u32);
+    u64 keyOffsetsOffset = 0;
+    if (keySize == 0) {
+        keyOffsetsOffset = size;
+        size += (count + 1) * sizeof(u32);
+    }
+    size = mtb_align_pow2(size, mtb_alignof(u64));
+    u64 keysOffset = size;
+    size += keyBytes;
+
+    MtbPhash *phash = mtb_arena_bump_raw(arena, size, .align = mtb_alignof(MtbPhash));
+    *phash = (MtbPhash){
+        .magic = MTB_PHASH_MAGIC,
+        .size = size,
+        .count = count,
+        .bucketCount = bucketCount,
+        .seed = opt.seed,
+        .keySize = keySize,
+        .pilotsOffset = pilotsOffset,
+        .indicesOffset = indicesOffset,
+        .keyOffsetsOffset = keyOffsetsOffset,
+        .keysOffset = keysOffset,
+    };
 
-    mtb_arena_deinit(&arena);
-}
+    MtbArenaTemp scratch = mtb_arena_temp_begin(arena);
+    u32 *slotKeys = nil;
+    if (count > 0) { // an empty table has zero pilots and misses every lookup
+        u64 *hashes = mtb_arena_bump(arena, u64, count, .no_zero = true);
+        slotKeys = mtb_arena_bump(arena, u32, count, .no_zero = true);
+        while (!_mtb_phash_place(phash, strKeys, u64Keys, hashes, slotKeys, arena)) {
+            phash->seed++;
+        }
+    }
 
-#endif // MTB_HMAP_TESTS
+    u32 *indices = _mtb_phash_data(phash, u32, indicesOffset);
+    u32 *keyOffsets = _mtb_phash_data(phash, u32, keyOffsetsOffset);
+    u8 *keyData = _mtb_phash_data(phash, u8, keysOffset);
+    u64 keyOffset = 0;
+    for (u64 slot = 0; slot < count; slot++) {
+        MtbStr key = _mtb_phash_input_key(strKeys, u64Keys, slotKeys[slot]);
+        indices[slot] = slotKeys[slot];
+        if (keySize == 0) {
+            keyOffsets[slot] = (u32)keyOffset;
+        }
+        memcpy(keyData + keyOffset, key.bytes, key.length);
+        keyOffset += key.length;
+    }
+    if (keySize == 0) {
+        keyOffsets[count] = (u32)keyOffset;
+    }
+    mtb_arena_temp_end(&scratch);
+    return phash;
+}
 
+func MtbPhash *
+mtb_phash_build_str_opt(MtbArena *arena, MtbStr *keys, u64 count, MtbPhashBuildOptions opt)
+{
+    return _mtb_phash_build(arena, keys, nil, 0, count, opt);
+}
 
-#ifdef MTB_HMAP_BENCH
+func MtbPhash *
+mtb_phash_build_u64_opt(MtbArena *arena, u64 *keys, u64 count, MtbPhashBuildOptions opt)
+{
+    return _mtb_phash_build(arena, nil, keys, sizeof(u64), count, opt);
+}
 
-#include <assert.h>
+func u64
+_mtb_phash_get(MtbPhash *phash, u8 *key, u64 length)
+{
+    if (phash->count == 0) {
+        return U64_MAX;
+    }
+    u64 hash = mtb_str_hash_bytes(key, length, phash->seed);
+    u32 pilot = _mtb_phash_data(phash, u32, pilotsOffset)[_mtb_phash_bucket(hash, phash->bucketCount)];
+    u64 slot = _mtb_phash_slot(hash, pilot, phash->count);
+
+    u8 *slotKey = _mtb_phash_data(phash, u8, keysOffset);
+    u64 slotLength = phash->keySize;
+    if (phash->keySize == 0) {
+        u32 *keyOffsets = _mtb_phash_data(phash, u32, keyOffsetsOffset);
+        slotKey += keyOffsets[slot];
+        slotLength = keyOffsets[slot + 1] - keyOffsets[slot];
+    }
+    else {
+        slotKey += slot * phash->keySize;
+    }
+    if (slotLength != length || memcmp(slotKey, key, length) != 0) {
+        return U64_MAX;
+    }
+    return _mtb_phash_data(phash, u32, indicesOffset)[slot];
+}
 
+func u64
+mtb_phash_get_str(MtbPhash *phash, MtbStr key)
+{
+    mtb_assert(phash->keySize == 0);
+    return _mtb_phash_get(phash, key.bytes, key.length);
+}
 
 func u64
-_calc_hash_str(void *key)
+mtb_phash_get_u64(MtbPhash *phash, u64 key)
 {
-    char *s = *(char **)key;
-    u64 hash = 0;
-    while (*s != '\0') hash = 17000069 * hash + *s++;
-    return hash;
+    mtb_assert(phash->keySize == sizeof(u64));
+    return _mtb_phash_get(phash, (u8 *)&key, sizeof(u64));
 }
 
+// n u32s at offset fit in the blob and are aligned, w/o overflowing.
 func bool
-_is_equal_str(void *key1, void *key2)
+_mtb_phash_fits_u32(MtbPhash *phash, u64 offset, u64 n)
 {
-    char *s1 = *(char **)key1;
-    char *s2 = *(char **)key2;
-    return strcmp(s1, s2) == 0;
+    return offset <= phash->size && n <= (phash->size - offset) / sizeof(u32) && offset % mtb_alignof(u32) == 0;
 }
 
-func void
-_bench_mtb_hmap(void)
+func MtbPhash *
+mtb_phash_load(void *blob, u64 size)
 {
-    mtb_perf_start();
+    MtbPhash *phash = blob;
+    if (size < sizeof(MtbPhash) || (u64)blob % mtb_alignof(MtbPhash) != 0) {
+        return nil;
+    }
+    if (phash->magic != MTB_PHASH_MAGIC || phash->size > size || phash->bucketCount == 0) {
+        return nil;
+    }
+    if (phash->keySize != 0 && phash->keySize != sizeof(u64)) {
+        return nil;
+    }
+    if (phash->count >= U32_MAX || phash->bucketCount >= U32_MAX) {
+        return nil;
+    }
 
-    FILE *inputFile = fopen("data/shakespeare.txt", "r");
-    fseek(inputFile, 0L, SEEK_END);
-    u64 inputFileSize = ftell(inputFile);
-    fseek(inputFile, 0L, SEEK_SET);
+    // every array must fit, the key offsets are checked against the key bytes
+    u64 keyBytes = phash->size - mtb_min_u64(phash->keysOffset, phash->size);
+    bool valid = _mtb_phash_fits_u32(phash, phash->pilotsOffset, phash->bucketCount) &&
+                 _mtb_phash_fits_u32(phash, phash->indicesOffset, phash->count) &&
+                 phash->keysOffset <= phash->size;
+    if (valid && phash->keySize == 0) {
+        valid = _mtb_phash_fits_u32(phash, phash->keyOffsetsOffset, phash->count + 1);
+        u32 *keyOffsets = _mtb_phash_data(phash, u32, keyOffsetsOffset);
+        for (u64 i = 0; valid && i < phash->count; i++) {
+            valid = keyOffsets[i] <= keyOffsets[i + 1] && keyOffsets[i + 1] <= keyBytes;
+        }
+    }
+    else if (valid) {
+        valid = phash->count * phash->keySize <= keyBytes;
+    }
+    u32 *indices = _mtb_phash_data(phash, u32, indicesOffset);
+    for (u64 i = 0; valid && i < phash->count; i++) {
+        valid = indices[i] < phash->count;
+    }
+    return valid ? phash : nil;
+}
 
-    MtbArena arena = {0};
-    mtb_arena_init(&arena, inputFileSize * 10, &MTB_ARENA_DEF_ALLOCATOR);
+#endif // MTB_PHASH_IMPLEMENTATION
 
-    char *inputData = mtb_arena_bump(&arena, char, inputFileSize + 1);
-    if (fread(inputData, sizeof(char), inputFileSize, inputFile) != inputFileSize) {
-        fprintf(stderr, "fread() failed\n");
-        exit(1);
-    }
-    fclose(inputFile);
 
-    MtbDynArr tokens = {0};
-    mtb_dynarr_init(&tokens, &arena, sizeof(char *));
-    char *token = strtok(inputData, " \t\r\n");
-    while (token != nil) {
-        *(char **)mtb_dynarr_push(&tokens) = token;
-        token = strtok(nil, " \n");
-    }
+#ifdef MTB_PHASH_TESTS
 
-    i32 iterationCount = 100;
-    for (i32 i = 0; i < iterationCount; i++) {
-        MtbArena arenaTmp = arena;
+#include <assert.h>
 
-        MtbHmap hmap = {0};
-        mtb_hmap_init(&hmap, &arenaTmp, char *, u64, _calc_hash_str, _is_equal_str);
 
-        MtbDynArrIter tokensIterator = {0};
-        mtb_dynarr_iter_init(&tokensIterator, &tokens);
+func void
+_test_mtb_phash_str(MtbArena *arena)
+{
+    mtb_arena_temp_scope(arena);
+    char *words[] = {
+        "auto", "break", "case", "char", "const", "continue", "default", "do", "double", "else", "enum",
+        "extern", "float", "for", "goto", "if", "inline", "int", "long", "register", "restrict", "return",
+        "short", "signed", "sizeof", "static", "struct", "switch", "typedef", "union", "unsigned", "void",
+        "volatile", "while", "", "_Bool", "_Complex", "_Imaginary", "an_identifier_longer_than_48_bytes_to_hash",
+    };
+    u64 count = mtb_countof(words);
+    MtbStr *keys = mtb_arena_bump(arena, MtbStr, count);
+    for (u64 i = 0; i < count; i++) {
+        keys[i] = mtb_str((u8 *)words[i], strlen(words[i]));
+    }
 
-        while (mtb_dynarr_iter_has_next(&tokensIterator)) {
-            char *token = *(char **)mtb_dynarr_iter_next(&tokensIterator);
-            u64 *count = mtb_hmap_get(&hmap, &token);
-            if (count == nil) {
-                *(u64 *)mtb_hmap_put(&hmap, &token) = 1;
-            }
-            else {
-                *count += 1;
-            }
-        }
+    MtbPhash *phash = mtb_phash_build_str(arena, keys, count);
+    assert(phash->count == count);
+    assert((u8 *)phash + phash->size == arena->base + arena->offset); // temporaries were dropped
+    for (u64 i = 0; i < count; i++) {
+        assert(mtb_phash_get_str(phash, keys[i]) == i);
+    }
+    assert(mtb_phash_get_str(phash, mtb_str_lit("main")) == U64_MAX);
+    assert(mtb_phash_get_str(phash, mtb_str_lit("whil")) == U64_MAX);
+    assert(mtb_phash_get_str(phash, mtb_str_lit("while ")) == U64_MAX);
+
+    // serialized copy, then a few broken ones
+    u64 *blob = mtb_arena_bump(arena, u64, phash->size / sizeof(u64) + 1);
+    memcpy(blob, phash, phash->size);
+    MtbPhash *loaded = mtb_phash_load(blob, phash->size);
+    assert(loaded != nil);
+    for (u64 i = 0; i < count; i++) {
+        assert(mtb_phash_get_str(loaded, keys[i]) == i);
+    }
+    assert(mtb_phash_load(blob, phash->size - 1) == nil);
+    assert(mtb_phash_load((u8 *)blob + 1, phash->size) == nil);
+    loaded->keyOffsetsOffset = loaded->size;
+    assert(mtb_phash_load(blob, phash->size) == nil);
+    loaded->keyOffsetsOffset = phash->keyOffsetsOffset;
+    loaded->pilotsOffset = U64_MAX - 3; // wraps around w/ the bucket count
+    assert(mtb_phash_load(blob, phash->size) == nil);
+    loaded->pilotsOffset = phash->pilotsOffset + 1; // misaligned
+    assert(mtb_phash_load(blob, phash->size) == nil);
+    loaded->pilotsOffset = phash->pilotsOffset;
+    loaded->indicesOffset = U64_MAX - sizeof(u32) * phash->count + 1;
+    assert(mtb_phash_load(blob, phash->size) == nil);
+    loaded->indicesOffset = phash->indicesOffset + 2;
+    assert(mtb_phash_load(blob, phash->size) == nil);
+    loaded->indicesOffset = phash->indicesOffset;
+    loaded->keyOffsetsOffset = phash->keyOffsetsOffset + 1;
+    assert(mtb_phash_load(blob, phash->size) == nil);
+    loaded->keyOffsetsOffset = phash->keyOffsetsOffset;
+    assert(mtb_phash_load(blob, phash->size) == loaded);
+    loaded->magic = 0;
+    assert(mtb_phash_load(blob, phash->size) == nil);
+}
 
-        // sanity check
-        struct histogram {
-            char *word;
-            u64 count;
-        } hist[] = {
-            { .word = "god", .count = 62 },
-            { .word = "dog", .count = 60 },
-            { .word = "duck", .count = 2 },
-            { .word = "poop", .count = 1 },
-            { .word = "love", .count = 1364 },
-        };
-        for (u64 i = 0; i < mtb_countof(hist); i++) {
-            struct histogram *wc = hist + i;
-            assert(*(u64 *)mtb_hmap_get(&hmap, &wc->word) == wc->count);
-        }
+func void
+_test_mtb_phash_empty(MtbArena *arena)
+{
+    mtb_arena_temp_scope(arena);
+    MtbPhash *phash = mtb_phash_build_str(arena, nil, 0);
+    assert(phash->count == 0);
+    assert(mtb_phash_get_str(phash, mtb_str_lit("")) == U64_MAX);
+    assert(mtb_phash_get_str(phash, mtb_str_lit("main")) == U64_MAX);
+    assert(mtb_phash_load(phash, phash->size) == phash);
+
+    phash = mtb_phash_build_u64(arena, nil, 0);
+    assert(mtb_phash_get_u64(phash, 0) == U64_MAX);
+    assert(mtb_phash_load(phash, phash->size) == phash);
+}
+
+func void
+_test_mtb_phash_u64(MtbArena *arena, u64 count, f32 bucketLoad)
+{
+    mtb_arena_temp_scope(arena);
+    MtbRng64 rng = {0};
+    mtb_rng64_init(&rng, 7);
+    u64 *keys = mtb_arena_bump(arena, u64, count);
+    for (u64 i = 0; i < count; i++) {
+        keys[i] = mtb_rng64_next(&rng);
     }
-    mtb_perf_print();
 
-    mtb_arena_deinit(&arena);
+    MtbPhash *phash = mtb_phash_build_u64(arena, keys, count, .seed = 3, .bucketLoad = bucketLoad);
+    assert(phash->size <= sizeof(MtbPhash) + count * (sizeof(u32) + sizeof(u64)) + (phash->bucketCount + 1) * sizeof(u32));
+    for (u64 i = 0; i < count; i++) {
+        assert(mtb_phash_get_u64(phash, keys[i]) == i);
+    }
+    u64 misses = 0;
+    for (u64 i = 0; i < count; i++) {
+        misses += mtb_phash_get_u64(phash, keys[i] + 1) == U64_MAX;
+    }
+    assert(misses == count);
+    assert(mtb_phash_load(phash, phash->size) == phash);
 }
 
-#endif // MTB_HMAP_BENCH
-#ifndef MTB_STRING_H
-#define MTB_STRING_H
+func void
+_test_mtb_phash(void)
+{
+    MtbArena arena = {0};
+    mtb_arena_init(&arena, mb(1), &MTB_ARENA_DEF_ALLOCATOR);
 
-#ifdef MTB_IMPLEMENTATION
-#define MTB_STRING_IMPLEMENTATION
-#endif
+    _test_mtb_phash_str(&arena);
+    _test_mtb_phash_empty(&arena);
+    _test_mtb_phash_u64(&arena, 1, 0.0f);
+    _test_mtb_phash_u64(&arena, 2, 0.0f);
+    _test_mtb_phash_u64(&arena, 1000, 0.0f);
+    _test_mtb_phash_u64(&arena, 10000, 6.0f);
 
-#ifdef MTB_TESTS
-#define MTB_STRING_TESTS
-#endif
+    mtb_arena_deinit(&arena);
+}
 
+#endif // MTB_PHASH_TESTS
 
-#include <stdarg.h>
 
+#ifdef MTB_PHASH_BENCH
 
-/* String */
+#include <assert.h>
 
-#define MTB_STR_NOT_FOUND U64_MAX
 
-typedef struct mtb_str MtbStr;
-struct mtb_str
+func u64
+_bench_mtb_phash_hash_u64(void *key)
 {
-    union {
-        u8 *bytes;
-        char *chars; // not null-terminated!
-    };
-    u64 length; // in bytes
-};
+    return mtb_str_hash_bytes(key, sizeof(u64), 0);
+}
 
-typedef struct mtb_str_cmp_options MtbStrCmpOptions;
-struct mtb_str_cmp_options
+func bool
+_bench_mtb_phash_is_equal_u64(void *key1, void *key2)
 {
-    bool ignoreCase;
-};
+    return *(u64 *)key1 == *(u64 *)key2;
+}
 
-typedef struct mtb_str_find_options MtbStrFindOptions;
-struct mtb_str_find_options
+// Lookups of present keys in random order, phash vs a MtbHmap w/ the same hash function.
+func void
+_bench_mtb_phash_get(MtbArena *arena, u64 count)
 {
-    bool ignoreCase;
-};
+    mtb_arena_temp_scope(arena);
+    MtbRng64 rng = {0};
+    mtb_rng64_init(&rng, 42);
+    u64 *keys = mtb_arena_bump(arena, u64, count);
+    for (u64 i = 0; i < count; i++) {
+        keys[i] = mtb_rng64_next(&rng);
+    }
+    u64 lookupCount = 1 << 22;
+    u64 *lookups = mtb_arena_bump(arena, u64, lookupCount);
+    for (u64 i = 0; i < lookupCount; i++) {
+        lookups[i] = keys[mtb_rng64_next_bounded(&rng, count)];
+    }
 
-typedef struct mtb_str_split_options MtbStrSplitOptions;
-struct mtb_str_split_options
-{
-    bool skipEmpty;
-};
+    u64 beg = mtb_perf_cpu_time();
+    MtbPhash *phash = mtb_phash_build_u64(arena, keys, count);
+    u64 build = mtb_perf_cpu_time() - beg;
 
-typedef struct mtb_str_join_options MtbStrJoinOptions;
-struct mtb_str_join_options
-{
-    bool skipEmpty;
-};
+    MtbHmap hmap = {0};
+    mtb_hmap_init(&hmap, arena, u64, u64, _bench_mtb_phash_hash_u64, _bench_mtb_phash_is_equal_u64,
+                  .probing = MTB_HMAP_PROBING_GROUP, .capacity = mtb_hmap_calc_capacity(count));
+    for (u64 i = 0; i < count; i++) {
+        *(u64 *)mtb_hmap_put(&hmap, keys + i) = i;
+    }
 
-#define mtb_str_varg(s) (i32)((s).length), ((s).chars)
+    u64 sum = 0;
+    beg = mtb_perf_cpu_time();
+    for (u64 i = 0; i < lookupCount; i++) {
+        sum += *(u64 *)mtb_hmap_get(&hmap, lookups + i);
+    }
+    u64 hmapElapsed = mtb_perf_cpu_time() - beg;
 
-#define mtb_str(b, l) ((MtbStr){ .bytes = (b), .length = (l) })
-#define mtb_str_char(c) mtb_str((u8[]){ (c) }, 1)
-#define mtb_str_lit(c) mtb_str((u8 *)(c), sizeof(c) - 1)
-#define mtb_str_empty() mtb_str_lit("")
+    u64 phashSum = 0;
+    beg = mtb_perf_cpu_time();
+    for (u64 i = 0; i < lookupCount; i++) {
+        phashSum += mtb_phash_get_u64(phash, lookups[i]);
+    }
+    u64 phashElapsed = mtb_perf_cpu_time() - beg;
 
-func MtbStr mtb_str_from_cstr(char *cstr);
-func char *mtb_str_to_cstr(MtbArena *arena, MtbStr str);
+    assert(sum == phashSum);
+    printf("%lu keys: build %lu, hmap get %lu, phash get %lu (cpu time), %.2f B/key vs %.2f B/key\n",
+           count,
+           build,
+           hmapElapsed,
+           phashElapsed,
+           (f64)phash->size / (f64)count,
+           (f64)(hmap.capacity * (hmap.entrySize + 1)) / (f64)count);
+}
 
-func MtbStr mtb_str_vsprintf(MtbArena *arena, char *fmt, va_list args);
-func MtbStr mtb_str_sprintf(MtbArena *arena, char *fmt, ...);
+func void
+_bench_mtb_phash(void)
+{
+    MtbArena arena = {0};
+    mtb_arena_init(&arena, mb(256), &MTB_ARENA_DEF_ALLOCATOR);
 
-func i32 mtb_str_cmp_opt(MtbStr a, MtbStr b, MtbStrCmpOptions opt);
-#define mtb_str_cmp(a, b, ...) mtb_str_cmp_opt(a, b, (MtbStrCmpOptions){ __VA_ARGS__ })
-#define mtb_str_cmp_lit(a, b, ...) mtb_str_cmp(a, mtb_str_lit(b), __VA_ARGS__)
-#define mtb_str_cmp_cstr(a, b, ...) mtb_str_cmp(a, mtb_str_from_cstr(b), __VA_ARGS__)
-#define mtb_str_is_equal(a, b, ...) (mtb_str_cmp(a, b, __VA_ARGS__) == 0)
-#define mtb_str_is_equal_lit(a, b, ...) mtb_str_is_equal(a, mtb_str_lit(b), __VA_ARGS__)
-#define mtb_str_is_equal_cstr(a, b, ...) mtb_str_is_equal(a, mtb_str_from_cstr(b), __VA_ARGS__)
+    printf("== perfect hash vs group probing ==\n");
+    _bench_mtb_phash_get(&arena, 1 << 10);
+    _bench_mtb_phash_get(&arena, 1 << 16);
+    _bench_mtb_phash_get(&arena, 1 << 20);
 
-func u64 mtb_str_find_opt(MtbStr str, MtbStr pattern, MtbStrFindOptions opt);
-#define mtb_str_find(str, pattern, ...) mtb_str_find_opt(str, pattern, (MtbStrFindOptions){ __VA_ARGS__ })
-#define mtb_str_find_lit(str, pattern, ...) mtb_str_find(str, mtb_str_lit(pattern), __VA_ARGS__)
-#define mtb_str_find_char(str, pattern, ...) mtb_str_find(str, mtb_str_char(pattern), __VA_ARGS__)
-#define mtb_str_find_cstr(str, pattern, ...) mtb_str_find(str, mtb_str_from_cstr(pattern), __VA_ARGS__)
-#define mtb_str_contains(str, pattern, ...) ((bool)(mtb_str_find(str, pattern, __VA_ARGS__) != MTB_STR_NOT_FOUND))
-#define mtb_str_contains_lit(str, pattern, ...) mtb_str_contains(str, mtb_str_lit(pattern), __VA_ARGS__)
-#define mtb_str_contains_char(str, pattern, ...) mtb_str_contains(str, mtb_str_char(pattern), __VA_ARGS__)
-#define mtb_str_contains_cstr(str, pattern, ...) mtb_str_contains(str, mtb_str_from_cstr(pattern), __VA_ARGS__)
+    mtb_arena_deinit(&arena);
+}
 
-func bool mtb_str_has_prefix_opt(MtbStr str, MtbStr pfx, MtbStrFindOptions opt);
-#define mtb_str_has_prefix(str, pfx, ...) mtb_str_has_prefix_opt(str, pfx, (MtbStrFindOptions){ __VA_ARGS__ })
-#define mtb_str_has_prefix_lit(str, pfx, ...) mtb_str_has_prefix(str, mtb_str_lit(pfx), __VA_ARGS__)
-#define mtb_str_has_prefix_cstr(str, pfx, ...) mtb_str_has_prefix(str, mtb_str_from_cstr(pfx), __VA_ARGS__)
+#endif // MTB_PHASH_BENCH
+#ifndef MTB_CMAP_H
+#define MTB_CMAP_H
 
-func bool mtb_str_has_suffix_opt(MtbStr str, MtbStr sfx, MtbStrFindOptions opt);
-#define mtb_str_has_suffix(str, sfx, ...) mtb_str_has_suffix_opt(str, sfx, (MtbStrFindOptions){ __VA_ARGS__ })
-#define mtb_str_has_suffix_lit(str, sfx, ...) mtb_str_has_suffix(str, mtb_str_lit(sfx), __VA_ARGS__)
-#define mtb_str_has_suffix_cstr(str, sfx, ...) mtb_str_has_suffix(str, mtb_str_from_cstr(sfx), __VA_ARGS__)
+#ifdef MTB_IMPLEMENTATION
+#define MTB_CMAP_IMPLEMENTATION
+#endif
 
-func MtbStr mtb_str_trim(MtbStr str);
-func MtbStr mtb_str_trim_beg(MtbStr str);
-func MtbStr mtb_str_trim_end(MtbStr str);
-func MtbStr mtb_str_skip(MtbStr str, u64 length);
-func MtbStr mtb_str_chop(MtbStr str, u64 length);
-func MtbStr mtb_str_to_lower(MtbArena *arena, MtbStr str);
-func MtbStr mtb_str_to_upper(MtbArena *arena, MtbStr str);
-func MtbStr mtb_str_dup(MtbArena *arena, MtbStr str);
-func MtbStr mtb_str_cat(MtbArena *arena, MtbStr a, MtbStr b);
-func MtbStr mtb_str_substr(MtbStr str, u64 beg, u64 end);
-func MtbStr mtb_str_prefix(MtbStr str, u64 length);
-func MtbStr mtb_str_suffix(MtbStr str, u64 length);
-func bool mtb_str_is_empty(MtbStr str);
+#ifdef MTB_TESTS
+#define MTB_CMAP_TESTS
+#endif
 
+#ifdef MTB_BENCH
+#define MTB_CMAP_BENCH
+#endif
 
-/* String List */
 
-typedef struct mtb_str_list MtbStrList;
-struct mtb_str_list
-{
-    MtbList node;
-    union {
-        MtbArena *arena;
-        MtbStr *str;
-    };
-};
+#include <threads.h>
 
-func void mtb_str_list_init(MtbArena *arena, MtbStrList *list);
-func void mtb_str_list_clear(MtbStrList *list);
-func bool mtb_str_list_is_empty(MtbStrList *list);
 
-func MtbStrList *mtb_str_list_append(MtbStrList *list, MtbStr *str);
-#define mtb_str_list_append_lit(list, str) mtb_str_list_append(list, &mtb_str_lit(str))
-func MtbStrList *mtb_str_list_appendf(MtbStrList *list, char *fmt, ...);
+#ifndef MTB_CMAP_DEF_SHARD_COUNT
+#define MTB_CMAP_DEF_SHARD_COUNT 64
+#endif
 
-func MtbStrList *mtb_str_list_prepend(MtbStrList *list, MtbStr *str);
-#define mtb_str_list_prepend_lit(list, str) mtb_str_list_prepend(list, &mtb_str_lit(str))
-func MtbStrList *mtb_str_list_prependf(MtbStrList *list, char *fmt, ...);
+#ifndef MTB_CMAP_DEF_SHARD_ARENA_SIZE
+#define MTB_CMAP_DEF_SHARD_ARENA_SIZE mb(64)
+#endif
 
-func MtbStr mtb_str_join_opt(MtbStrList *list, MtbStr delim, MtbStrJoinOptions opt);
-#define mtb_str_join(list, delim, ...) mtb_str_join_opt(list, delim, (MtbStrJoinOptions){ __VA_ARGS__ })
-#define mtb_str_join_lit(list, delim, ...) mtb_str_join(list, mtb_str_lit(delim), __VA_ARGS__)
-#define mtb_str_join_char(list, delim, ...) mtb_str_join(list, mtb_str_char(delim), __VA_ARGS__)
+#ifndef MTB_CMAP_RCU_DEF_MAX_READERS
+#define MTB_CMAP_RCU_DEF_MAX_READERS 64
+#endif
 
-func void mtb_str_split_opt(MtbStrList *list, MtbStr str, MtbStr delim, MtbStrSplitOptions opt);
-#define mtb_str_split(list, str, delim, ...) mtb_str_split_opt(list, str, delim, (MtbStrSplitOptions){ __VA_ARGS__ })
-#define mtb_str_split_lit(list, str, delim, ...) mtb_str_split(list, str, mtb_str_lit(delim), __VA_ARGS__)
-#define mtb_str_split_char(list, str, delim, ...) mtb_str_split(list, str, mtb_str_char(delim), __VA_ARGS__)
+#ifndef MTB_CMAP_RCU_DEF_VERSION_ARENA_SIZE
+#define MTB_CMAP_RCU_DEF_VERSION_ARENA_SIZE mb(64)
+#endif
 
+#define MTB_CMAP_CACHE_LINE 64
 
-/* Hash map utils */
 
-func u64
-mtb_str_key_hash(void *key)
+/* Concurrent (sharded) Hash Map */
+
+// Every shard is a MtbHmap w/ its own lock and arena, picked by the high hash bits
+// (the map itself uses the low ones). Values are copied in and out under the lock.
+typedef struct mtb_cmap_shard MtbCmapShard;
+struct mtb_cmap_shard
 {
-    MtbStr *s = (MtbStr *)key;
-    u64 hash = 0;
-    for (u64 i = 0; i < s->length; i++) {
-        hash = 17000069 * hash + s->chars[i];
-    }
-    return hash;
-}
+    mtx_t lock;
+    MtbArena arena;
+    MtbHmap hmap;
+} __attribute__((aligned(MTB_CMAP_CACHE_LINE)));
 
-func bool
-mtb_str_key_equals(void *key1, void *key2)
+typedef struct mtb_cmap MtbCmap;
+struct mtb_cmap
 {
-    MtbStr *s1 = (MtbStr *)key1;
-    MtbStr *s2 = (MtbStr *)key2;
-    return mtb_str_is_equal(*s1, *s2);
-}
+    u64 shardCount; // must be power of 2!
+    u32 shardShift;
+    MtbCmapShard *shards;
+    u64 valueSize;
 
-#endif // MTB_STRING_H
+    u64 (*key_hash)(void *k);
+};
 
+typedef struct mtb_cmap_init_options MtbCmapInitOptions;
+struct mtb_cmap_init_options
+{
+    u64 shardCount;               // MTB_CMAP_DEF_SHARD_COUNT if 0
+    u64 shardArenaSize;           // MTB_CMAP_DEF_SHARD_ARENA_SIZE if 0
+    MtbArenaAllocator *allocator; // of the shard arenas, MTB_ARENA_DEF_ALLOCATOR if nil
+    MtbHmapInitOptions hmap;
+};
 
-#ifdef MTB_STRING_IMPLEMENTATION
 
-#include <stdio.h>
-#include <string.h>
+// The shard array is bumped from the arena, shards allocate from their own ones.
+func void mtb_cmap_init_opt(MtbCmap *cmap,
+                            MtbArena *arena,
+                            u64 keySize,
+                            u64 valueSize,
+                            u64 (*key_hash)(void *k),
+                            bool (*key_equals)(void *k1, void *k2),
+                            MtbCmapInitOptions opt);
+#define mtb_cmap_init(cmap, arena, keyType, valueType, key_hash, key_equals, ...) \
+    mtb_cmap_init_opt(cmap, \
+                      arena, \
+                      sizeof(keyType), \
+                      sizeof(valueType), \
+                      key_hash, \
+                      key_equals, \
+                      (MtbCmapInitOptions){ \
+                          .hmap = { .keyAlign = mtb_alignof(keyType), .valueAlign = mtb_alignof(valueType) }, \
+                          __VA_ARGS__ \
+                      })
+func void mtb_cmap_deinit(MtbCmap *cmap);
+func u64 mtb_cmap_count(MtbCmap *cmap);
 
+// Thread safe, the value (if not nil) is copied in or out.
+func bool mtb_cmap_put(MtbCmap *cmap, void *key, void *value); // returns true if the key is new
+func bool mtb_cmap_remove(MtbCmap *cmap, void *key, void *value);
+func bool mtb_cmap_get(MtbCmap *cmap, void *key, void *value);
 
-func MtbStr
-mtb_str_from_cstr(char *cstr)
+// Thread safe, calls update on the value (zeroed if the key is new) under the shard lock.
+func bool mtb_cmap_update(MtbCmap *cmap, void *key, void (*update)(void *value, void *ctx), void *ctx);
+
+// Not thread safe, the shard maps can be iterated once all writers are done.
+func MtbHmap *mtb_cmap_shard(MtbCmap *cmap, u64 index);
+
+
+
+/* Read-mostly (RCU) Hash Map */
+
+// Readers never lock, they look up an immutable snapshot. A writer edits a private copy and
+// publishes it atomically, the previous one is freed once every reader left its epoch.
+typedef struct mtb_cmap_rcu_version MtbCmapRcuVersion;
+struct mtb_cmap_rcu_version
 {
-    return mtb_str((u8 *)cstr, strlen(cstr));
-}
+    MtbArena arena; // the version itself is its first allocation
+    MtbHmap hmap;
+};
 
-func char *
-mtb_str_to_cstr(MtbArena *arena, MtbStr str)
+typedef struct mtb_cmap_rcu_reader MtbCmapRcuReader;
+struct mtb_cmap_rcu_reader
 {
-    char *cstr = mtb_arena_bump(arena, char, str.length + 1);
-    memcpy(cstr, str.chars, str.length);
-    return cstr;
-}
+    u64 epoch; // 0 outside of read_begin/read_end
+    u64 used;  // claimed by register, released by unregister
+} __attribute__((aligned(MTB_CMAP_CACHE_LINE)));
 
-func MtbStr
-mtb_str_vsprintf(MtbArena *arena, char *fmt, va_list args)
+typedef struct mtb_cmap_rcu MtbCmapRcu;
+struct mtb_cmap_rcu
 {
-    va_list argsTmp;
-    va_copy(argsTmp, args);
-    u64 length = vsnprintf(nil, 0, fmt, argsTmp);
-    va_end(argsTmp);
+    MtbCmapRcuVersion *current;
+    u64 epoch;
+    u64 maxReaders;
+    MtbCmapRcuReader *readers;
+    u64 valueSize;
 
-    if (length == 0) {
-        return mtb_str_empty();
-    }
+    mtx_t writeLock;
+    MtbCmapRcuVersion *pending;
+    u64 versionArenaSize;
+    MtbArenaAllocator *allocator;
+} __attribute__((aligned(MTB_CMAP_CACHE_LINE)));
 
-    char *chars = mtb_arena_bump(arena, char, length);
-    vsprintf(chars, fmt, args);
+typedef struct mtb_cmap_rcu_init_options MtbCmapRcuInitOptions;
+struct mtb_cmap_rcu_init_options
+{
+    u64 maxReaders;               // MTB_CMAP_RCU_DEF_MAX_READERS if 0
+    u64 versionArenaSize;         // MTB_CMAP_RCU_DEF_VERSION_ARENA_SIZE if 0
+    MtbArenaAllocator *allocator; // of the version arenas, MTB_ARENA_DEF_ALLOCATOR if nil
+    MtbHmapInitOptions hmap;      // incremental resize is not allowed, lookups must not write
+};
 
-    return mtb_str((u8 *)chars, length);
-}
 
-func MtbStr
-mtb_str_sprintf(MtbArena *arena, char *fmt, ...)
-{
-    va_list args;
-    va_start(args, fmt);
+// The reader slots are bumped from the arena, every version allocates from its own one.
+func void mtb_cmap_rcu_init_opt(MtbCmapRcu *rcu,
+                                MtbArena *arena,
+                                u64 keySize,
+                                u64 valueSize,
+                                u64 (*key_hash)(void *k),
+                                bool (*key_equals)(void *k1, void *k2),
+                                MtbCmapRcuInitOptions opt);
+#define mtb_cmap_rcu_init(rcu, arena, keyType, valueType, key_hash, key_equals, ...) \
+    mtb_cmap_rcu_init_opt(rcu, \
+                          arena, \
+                          sizeof(keyType), \
+                          sizeof(valueType), \
+                          key_hash, \
+                          key_equals, \
+                          (MtbCmapRcuInitOptions){ \
+                              .hmap = { .keyAlign = mtb_alignof(keyType), .valueAlign = mtb_alignof(valueType) }, \
+                              __VA_ARGS__ \
+                          })
+func void mtb_cmap_rcu_deinit(MtbCmapRcu *rcu); // no readers or writer may be active
+
+// Thread safe, every reader thread registers once and passes its slot to the read calls.
+// A thread that stops reading unregisters, so its slot can be taken by another one.
+func u64 mtb_cmap_rcu_register(MtbCmapRcu *rcu);
+func void mtb_cmap_rcu_unregister(MtbCmapRcu *rcu, u64 reader); // not between read_begin/read_end
+
+// The snapshot stays valid (and unchanged) until read_end, must not be modified. Not reentrant.
+func MtbHmap *mtb_cmap_rcu_read_begin(MtbCmapRcu *rcu, u64 reader);
+func void mtb_cmap_rcu_read_end(MtbCmapRcu *rcu, u64 reader);
+func bool mtb_cmap_rcu_get(MtbCmapRcu *rcu, u64 reader, void *key, void *value); // value copied out if not nil
+
+// Writers are serialized, write_begin returns a private copy of the current map and write_end
+// publishes it, then blocks until the replaced one can be freed (a reader thread must not write).
+func MtbHmap *mtb_cmap_rcu_write_begin(MtbCmapRcu *rcu);
+func void mtb_cmap_rcu_write_end(MtbCmapRcu *rcu);
+
+#endif //MTB_CMAP_H
+
+
+#ifdef MTB_CMAP_IMPLEMENTATION
 
-    MtbStr result = mtb_str_vsprintf(arena, fmt, args);
+#include <string.h>
 
-    va_end(args);
-    return result;
-}
 
-func i32
-mtb_str_cmp_opt(MtbStr a, MtbStr b, MtbStrCmpOptions opt)
-{
-    // TODO intrinsify
-    u64 minLength = mtb_min_u64(a.length, b.length);
-    if (opt.ignoreCase) {
-        for (u64 i = 0; i < minLength; i++) {
-            char ca = mtb_char_to_lower(a.chars[i]);
-            char cb = mtb_char_to_lower(b.chars[i]);
-            if (ca != cb) {
-                return ca > cb ? 1 : -1;
-            }
-        }
-    }
-    else {
-        i32 result = strncmp(a.chars, b.chars, minLength);
-        if (result != 0) {
-            return result;
-        }
+#define _mtb_cmap_shard_of(cmap, hash) ((cmap)->shards + ((cmap)->shardShift == 64 ? 0 : (hash) >> (cmap)->shardShift))
+
+
+func void
+mtb_cmap_init_opt(MtbCmap *cmap,
+                  MtbArena *arena,
+                  u64 keySize,
+                  u64 valueSize,
+                  u64 (*key_hash)(void *k),
+                  bool (*key_equals)(void *k1, void *k2),
+                  MtbCmapInitOptions opt)
+{
+    mtb_assert_always(mtb_is_pow2_or_zero(opt.shardCount));
+
+    cmap->shardCount = opt.shardCount == 0 ? MTB_CMAP_DEF_SHARD_COUNT : opt.shardCount;
+    cmap->shardShift = (u32)(64 - mtb_trailing_zeros_count(cmap->shardCount));
+    cmap->shards = mtb_arena_bump(arena, MtbCmapShard, cmap->shardCount);
+    cmap->valueSize = valueSize;
+    cmap->key_hash = key_hash;
+
+    u64 shardArenaSize = opt.shardArenaSize == 0 ? MTB_CMAP_DEF_SHARD_ARENA_SIZE : opt.shardArenaSize;
+    MtbArenaAllocator *allocator = opt.allocator == nil ? &MTB_ARENA_DEF_ALLOCATOR : opt.allocator;
+    for (u64 i = 0; i < cmap->shardCount; i++) {
+        MtbCmapShard *shard = cmap->shards + i;
+        mtb_assert_always(mtx_init(&shard->lock, mtx_plain) == thrd_success);
+        mtb_arena_init(&shard->arena, shardArenaSize, allocator);
+        mtb_hmap_init_opt(&shard->hmap, &shard->arena, keySize, valueSize, key_hash, key_equals, opt.hmap);
     }
-    return a.length == b.length ? 0 : a.length > b.length ? 1 : -1;
 }
 
-func u64
-mtb_str_find_opt(MtbStr str, MtbStr pattern, MtbStrFindOptions opt)
+func void
+mtb_cmap_deinit(MtbCmap *cmap)
 {
-    if (str.length >= pattern.length) {
-        u64 i, iEnd = str.length - pattern.length + 1;
-        u64 j, jEnd = pattern.length;
-        if (opt.ignoreCase) {
-            for (i = 0; i < iEnd; i++) {
-                for (j = 0; j < jEnd; j++) {
-                    if (mtb_char_to_lower(str.chars[i + j]) != mtb_char_to_lower(pattern.chars[j])) {
-                        break;
-                    }
-                }
-                if (j == jEnd) {
-                    return i;
-                }
-            }
-        }
-        else {
-            for (i = 0; i < iEnd; i++) {
-                for (j = 0; j < jEnd; j++) {
-                    if (str.chars[i + j] != pattern.chars[j]) {
-                        break;
-                    }
-                }
-                if (j == jEnd) {
-                    return i;
-                }
-            }
-        }
+    for (u64 i = 0; i < cmap->shardCount; i++) {
+        MtbCmapShard *shard = cmap->shards + i;
+        mtx_destroy(&shard->lock);
+        mtb_arena_deinit(&shard->arena);
     }
-    return MTB_STR_NOT_FOUND;
+    cmap->shardCount = 0;
+    cmap->shards = nil;
 }
 
-func bool
-mtb_str_has_prefix_opt(MtbStr str, MtbStr pfx, MtbStrFindOptions opt)
-{
-    if (str.length < pfx.length) {
-        return false;
+func u64
+mtb_cmap_count(MtbCmap *cmap)
+{
+    u64 count = 0;
+    for (u64 i = 0; i < cmap->shardCount; i++) {
+        MtbCmapShard *shard = cmap->shards + i;
+        mtx_lock(&shard->lock);
+        count += shard->hmap.count;
+        mtx_unlock(&shard->lock);
     }
-    MtbStr substr = mtb_str_substr(str, 0, pfx.length);
-    return mtb_str_is_equal(pfx, substr, .ignoreCase = opt.ignoreCase);
+    return count;
 }
 
 func bool
-mtb_str_has_suffix_opt(MtbStr str, MtbStr sfx, MtbStrFindOptions opt)
-{
-    if (str.length < sfx.length) {
-        return false;
+mtb_cmap_put(MtbCmap *cmap, void *key, void *value)
+{
+    u64 hash = cmap->key_hash(key);
+    MtbCmapShard *shard = _mtb_cmap_shard_of(cmap, hash);
+    mtx_lock(&shard->lock);
+    bool inserted;
+    void *shardValue = mtb_hmap_upsert_hashed(&shard->hmap, key, hash, &inserted);
+    if (value != nil) {
+        memcpy(shardValue, value, cmap->valueSize);
     }
-    MtbStr substr = mtb_str_substr(str, str.length - sfx.length, str.length);
-    return mtb_str_is_equal(sfx, substr, .ignoreCase = opt.ignoreCase);
+    mtx_unlock(&shard->lock);
+    return inserted;
 }
 
-func MtbStr
-mtb_str_trim(MtbStr str)
-{
-    u64 beg = 0;
-    while (beg < str.length && mtb_char_is_space(str.chars[beg])) {
-        beg++;
-    }
-    u64 end = str.length;
-    while (beg < end && mtb_char_is_space(str.chars[end - 1])) {
-        end--;
+func bool
+mtb_cmap_remove(MtbCmap *cmap, void *key, void *value)
+{
+    u64 hash = cmap->key_hash(key);
+    MtbCmapShard *shard = _mtb_cmap_shard_of(cmap, hash);
+    mtx_lock(&shard->lock);
+    void *shardValue = mtb_hmap_remove_hashed(&shard->hmap, key, hash);
+    if (shardValue != nil && value != nil) {
+        memcpy(value, shardValue, cmap->valueSize);
     }
-    str.chars += beg;
-    str.length = end - beg;
-    return str;
+    mtx_unlock(&shard->lock);
+    return shardValue != nil;
 }
 
-func MtbStr
-mtb_str_trim_beg(MtbStr str)
-{
-    u64 beg = 0;
-    while (beg < str.length && mtb_char_is_space(str.chars[beg])) {
-        beg++;
+func bool
+mtb_cmap_get(MtbCmap *cmap, void *key, void *value)
+{
+    u64 hash = cmap->key_hash(key);
+    MtbCmapShard *shard = _mtb_cmap_shard_of(cmap, hash);
+    mtx_lock(&shard->lock);
+    void *shardValue = mtb_hmap_get_hashed(&shard->hmap, key, hash);
+    if (shardValue != nil && value != nil) {
+        memcpy(value, shardValue, cmap->valueSize);
     }
-    str.chars += beg;
-    str.length -= beg;
-    return str;
+    mtx_unlock(&shard->lock);
+    return shardValue != nil;
 }
 
-func MtbStr
-mtb_str_trim_end(MtbStr str)
+func bool
+mtb_cmap_update(MtbCmap *cmap, void *key, void (*update)(void *value, void *ctx), void *ctx)
 {
-    u64 end = str.length;
-    while (end > 0 && mtb_char_is_space(str.chars[end - 1])) {
-        end--;
-    }
-    str.length = end;
-    return str;
+    u64 hash = cmap->key_hash(key);
+    MtbCmapShard *shard = _mtb_cmap_shard_of(cmap, hash);
+    mtx_lock(&shard->lock);
+    bool inserted;
+    update(mtb_hmap_upsert_hashed(&shard->hmap, key, hash, &inserted), ctx);
+    mtx_unlock(&shard->lock);
+    return inserted;
 }
 
-func MtbStr
-mtb_str_skip(MtbStr str, u64 length)
+func MtbHmap *
+mtb_cmap_shard(MtbCmap *cmap, u64 index)
 {
-    mtb_assert_always(str.length >= length);
-    str.chars += length;
-    str.length -= length;
-    return str;
+    mtb_assert_always(index < cmap->shardCount);
+    return &cmap->shards[index].hmap;
 }
 
-func MtbStr
-mtb_str_chop(MtbStr str, u64 length)
+
+func MtbCmapRcuVersion *
+_mtb_cmap_rcu_version_new(MtbCmapRcu *rcu)
 {
-    mtb_assert_always(str.length >= length);
-    str.length -= length;
-    return str;
+    MtbArena arena = {0};
+    mtb_arena_init(&arena, rcu->versionArenaSize, rcu->allocator);
+    MtbCmapRcuVersion *version = mtb_arena_bump(&arena, MtbCmapRcuVersion, 1);
+    version->arena = arena;
+    return version;
 }
 
-func MtbStr
-mtb_str_to_lower(MtbArena *arena, MtbStr str)
+func void
+_mtb_cmap_rcu_version_free(MtbCmapRcuVersion *version)
 {
-    if (mtb_str_is_empty(str)) {
-        return str;
-    }
-    char *chars = mtb_arena_bump(arena, char, str.length);
-    for (u64 i = 0; i < str.length; i++) {
-        chars[i] = mtb_char_to_lower(str.chars[i]);
-    }
-    str.chars = chars;
-    return str;
+    MtbArena arena = version->arena;
+    mtb_arena_deinit(&arena);
 }
 
-func MtbStr
-mtb_str_to_upper(MtbArena *arena, MtbStr str)
-{
-    if (mtb_str_is_empty(str)) {
-        return str;
-    }
-    char *chars = mtb_arena_bump(arena, char, str.length);
-    for (u64 i = 0; i < str.length; i++) {
-        chars[i] = mtb_char_to_upper(str.chars[i]);
-    }
-    str.chars = chars;
-    return str;
+func void
+mtb_cmap_rcu_init_opt(MtbCmapRcu *rcu,
+                      MtbArena *arena,
+                      u64 keySize,
+                      u64 valueSize,
+                      u64 (*key_hash)(void *k),
+                      bool (*key_equals)(void *k1, void *k2),
+                      MtbCmapRcuInitOptions opt)
+{
+    mtb_assert_always(!opt.hmap.incremental);
+
+    rcu->epoch = 1;
+    rcu->maxReaders = opt.maxReaders == 0 ? MTB_CMAP_RCU_DEF_MAX_READERS : opt.maxReaders;
+    rcu->readers = mtb_arena_bump(arena, MtbCmapRcuReader, rcu->maxReaders);
+    rcu->valueSize = valueSize;
+    mtb_assert_always(mtx_init(&rcu->writeLock, mtx_plain) == thrd_success);
+    rcu->pending = nil;
+    rcu->versionArenaSize = opt.versionArenaSize == 0 ? MTB_CMAP_RCU_DEF_VERSION_ARENA_SIZE : opt.versionArenaSize;
+    rcu->allocator = opt.allocator == nil ? &MTB_ARENA_DEF_ALLOCATOR : opt.allocator;
+
+    MtbCmapRcuVersion *version = _mtb_cmap_rcu_version_new(rcu);
+    mtb_hmap_init_opt(&version->hmap, &version->arena, keySize, valueSize, key_hash, key_equals, opt.hmap);
+    rcu->current = version;
 }
 
-func MtbStr
-mtb_str_dup(MtbArena *arena, MtbStr str)
+func void
+mtb_cmap_rcu_deinit(MtbCmapRcu *rcu)
 {
-    if (mtb_str_is_empty(str)) {
-        return str;
-    }
-    u8 *bytes = mtb_arena_bump(arena, u8, str.length);
-    memcpy(bytes, str.bytes, str.length);
-    str.bytes = bytes;
-    return str;
+    mtb_assert_always(rcu->pending == nil);
+    _mtb_cmap_rcu_version_free(rcu->current);
+    mtx_destroy(&rcu->writeLock);
+    rcu->current = nil;
+    rcu->readers = nil;
 }
 
-func MtbStr
-mtb_str_cat(MtbArena *arena, MtbStr a, MtbStr b)
+func u64
+mtb_cmap_rcu_register(MtbCmapRcu *rcu)
 {
-    u64 length = mtb_add_u64(a.length, b.length);
-    if (length == 0) {
-        return mtb_str_empty();
+    for (u64 reader = 0; reader < rcu->maxReaders; reader++) {
+        u64 unused = 0;
+        if (__atomic_load_n(&rcu->readers[reader].used, __ATOMIC_RELAXED) == 0 &&
+            __atomic_compare_exchange_n(&rcu->readers[reader].used, &unused, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return reader;
+        }
     }
-    u8 *bytes = mtb_arena_bump(arena, u8, length);
-    memcpy(bytes, a.bytes, a.length);
-    memcpy(bytes + a.length, b.bytes, b.length);
-    return mtb_str(bytes, length);
+    mtb_assert_always(!"more than maxReaders registered readers");
+    return U64_MAX;
 }
 
-func MtbStr
-mtb_str_substr(MtbStr str, u64 beg, u64 end)
+func void
+mtb_cmap_rcu_unregister(MtbCmapRcu *rcu, u64 reader)
 {
-    mtb_assert_always(beg <= end && end <= str.length);
-    str.chars += beg;
-    str.length = end - beg;
-    return str;
+    mtb_assert(reader < rcu->maxReaders);
+    mtb_assert(__atomic_load_n(&rcu->readers[reader].epoch, __ATOMIC_RELAXED) == 0);
+    __atomic_store_n(&rcu->readers[reader].used, 0, __ATOMIC_RELEASE);
 }
 
-func MtbStr
-mtb_str_prefix(MtbStr str, u64 length)
+func MtbHmap *
+mtb_cmap_rcu_read_begin(MtbCmapRcu *rcu, u64 reader)
 {
-    mtb_assert_always(str.length >= length);
-    str.length = length;
-    return str;
+    mtb_assert(reader < rcu->maxReaders);
+    // Either the writer sees our epoch or we see its new version (both sides are seq_cst).
+    u64 epoch = __atomic_load_n(&rcu->epoch, __ATOMIC_ACQUIRE);
+    __atomic_store_n(&rcu->readers[reader].epoch, epoch, __ATOMIC_SEQ_CST);
+    MtbCmapRcuVersion *version = __atomic_load_n(&rcu->current, __ATOMIC_SEQ_CST);
+    return &version->hmap;
 }
 
-func MtbStr mtb_str_suffix(MtbStr str, u64 length)
+func void
+mtb_cmap_rcu_read_end(MtbCmapRcu *rcu, u64 reader)
 {
-    mtb_assert_always(str.length >= length);
-    str.chars += str.length - length;
-    str.length = length;
-    return str;
+    __atomic_store_n(&rcu->readers[reader].epoch, 0, __ATOMIC_RELEASE);
 }
 
 func bool
-mtb_str_is_empty(MtbStr str)
+mtb_cmap_rcu_get(MtbCmapRcu *rcu, u64 reader, void *key, void *value)
 {
-    return str.length == 0;
+    MtbHmap *hmap = mtb_cmap_rcu_read_begin(rcu, reader);
+    void *mapValue = mtb_hmap_get(hmap, key);
+    if (mapValue != nil && value != nil) {
+        memcpy(value, mapValue, rcu->valueSize);
+    }
+    mtb_cmap_rcu_read_end(rcu, reader);
+    return mapValue != nil;
 }
 
-func void
-mtb_str_list_init(MtbArena *arena, MtbStrList *list)
+func MtbHmap *
+mtb_cmap_rcu_write_begin(MtbCmapRcu *rcu)
 {
-    list->arena = arena;
-    mtb_list_init(&list->node);
+    mtx_lock(&rcu->writeLock);
+    MtbCmapRcuVersion *version = _mtb_cmap_rcu_version_new(rcu);
+    mtb_hmap_clone(&version->hmap, &version->arena, &rcu->current->hmap);
+    rcu->pending = version;
+    return &version->hmap;
 }
 
 func void
-mtb_str_list_clear(MtbStrList *list)
+mtb_cmap_rcu_write_end(MtbCmapRcu *rcu)
+{
+    mtb_assert_always(rcu->pending != nil);
+
+    MtbCmapRcuVersion *old = rcu->current;
+    __atomic_store_n(&rcu->current, rcu->pending, __ATOMIC_SEQ_CST);
+    rcu->pending = nil;
+    u64 epoch = __atomic_add_fetch(&rcu->epoch, 1, __ATOMIC_SEQ_CST);
+
+    // Readers that entered at an older epoch may still hold the old version. Every slot is scanned,
+    // unused ones stay at epoch 0.
+    for (u64 i = 0; i < rcu->maxReaders; i++) {
+        for (;;) {
+            u64 readerEpoch = __atomic_load_n(&rcu->readers[i].epoch, __ATOMIC_SEQ_CST);
+            if (readerEpoch == 0 || readerEpoch >= epoch) {
+                break;
+            }
+            thrd_yield();
+        }
+    }
+    _mtb_cmap_rcu_version_free(old);
+    mtx_unlock(&rcu->writeLock);
+}
+
+#endif // MTB_CMAP_IMPLEMENTATION
+
+
+#ifdef MTB_CMAP_TESTS
+
+#include <assert.h>
+
+
+func u64
+_test_mtb_cmap_hash_u64(void *key)
 {
-    mtb_list_reset(&list->node);
+    return *(u64 *)key * 0x9E3779B97F4A7C15;
 }
 
 func bool
-mtb_str_list_is_empty(MtbStrList *list)
+_test_mtb_cmap_is_equal_u64(void *key1, void *key2)
 {
-    return mtb_list_is_empty(&list->node);
+    return *(u64 *)key1 == *(u64 *)key2;
 }
 
-func MtbStrList *
-mtb_str_list_append(MtbStrList *list, MtbStr *str)
+func void
+_test_mtb_cmap_increment(void *value, void *ctx)
 {
-    MtbStrList *node = mtb_arena_bump(list->arena, MtbStrList, 1);
-    node->str = str;
-    mtb_list_add_last(&list->node, &node->node);
-    return node;
+    *(u64 *)value += *(u64 *)ctx;
 }
 
-func MtbStrList *
-mtb_str_list_appendf(MtbStrList *list, char *fmt, ...)
-{
-    va_list args;
-    va_start(args, fmt);
-    MtbStr *str = mtb_arena_bump(list->arena, MtbStr, 1);
-    *str = mtb_str_vsprintf(list->arena, fmt, args);
-    va_end(args);
-    return mtb_str_list_append(list, str);
+func void
+_test_mtb_cmap_basic(MtbArena *arena)
+{
+    mtb_arena_temp_scope(arena);
+    MtbCmap cmap = {0};
+    mtb_cmap_init(&cmap, arena, u64, u64, _test_mtb_cmap_hash_u64, _test_mtb_cmap_is_equal_u64,
+                  .shardCount = 4, .shardArenaSize = kb(64));
+    assert(cmap.shardCount == 4);
+    assert(cmap.shardShift == 62);
+
+    u64 n = 1000;
+    for (u64 k = 0; k < n; k++) {
+        u64 v = k * k;
+        assert(mtb_cmap_put(&cmap, &k, &v));
+    }
+    assert(mtb_cmap_count(&cmap) == n);
+
+    u64 used = 0;
+    for (u64 i = 0; i < cmap.shardCount; i++) {
+        used += mtb_cmap_shard(&cmap, i)->count > 0;
+    }
+    assert(used == cmap.shardCount);
+
+    for (u64 k = 0; k < n; k += 2) {
+        u64 v = 0;
+        assert(mtb_cmap_remove(&cmap, &k, &v));
+        assert(v == k * k);
+        assert(!mtb_cmap_remove(&cmap, &k, nil));
+    }
+    for (u64 k = 0; k < n; k++) {
+        u64 one = 1;
+        assert(mtb_cmap_update(&cmap, &k, _test_mtb_cmap_increment, &one) == (k % 2 == 0));
+        u64 v = 0;
+        assert(mtb_cmap_get(&cmap, &k, &v));
+        assert(v == (k % 2 == 0 ? 1 : k * k + 1));
+    }
+    assert(mtb_cmap_count(&cmap) == n);
+
+    mtb_cmap_deinit(&cmap);
 }
 
-func MtbStrList *
-mtb_str_list_prepend(MtbStrList *list, MtbStr *str)
+typedef struct _test_mtb_cmap_worker _TestMtbCmapWorker;
+struct _test_mtb_cmap_worker
 {
-    MtbStrList *node = mtb_arena_bump(list->arena, MtbStrList, 1);
-    node->str = str;
-    mtb_list_add_first(&list->node, &node->node);
-    return node;
-}
+    MtbCmap *cmap;
+    u64 beg;
+    u64 end;
+};
 
-func MtbStrList *
-mtb_str_list_prependf(MtbStrList *list, char *fmt, ...)
+func int
+_test_mtb_cmap_worker_run(void *arg)
 {
-    va_list args;
-    va_start(args, fmt);
-    MtbStr *str = mtb_arena_bump(list->arena, MtbStr, 1);
-    *str = mtb_str_vsprintf(list->arena, fmt, args);
-    va_end(args);
-    return mtb_str_list_prepend(list, str);
+    _TestMtbCmapWorker *worker = arg;
+    for (u64 i = worker->beg; i < worker->end; i++) {
+        u64 k = i % 1000; // overlapping keys between threads
+        u64 one = 1;
+        mtb_cmap_update(worker->cmap, &k, _test_mtb_cmap_increment, &one);
+    }
+    return 0;
 }
 
-func MtbStr
-mtb_str_join_opt(MtbStrList *list, MtbStr delim, MtbStrJoinOptions opt)
+func void
+_test_mtb_cmap_threads(MtbArena *arena)
+{
+    mtb_arena_temp_scope(arena);
+    MtbCmap cmap = {0};
+    mtb_cmap_init(&cmap, arena, u64, u64, _test_mtb_cmap_hash_u64, _test_mtb_cmap_is_equal_u64,
+                  .shardCount = 8, .shardArenaSize = kb(64));
+
+    u64 n = 40000;
+    thrd_t threads[4];
+    _TestMtbCmapWorker workers[4];
+    for (u64 i = 0; i < mtb_countof(threads); i++) {
+        workers[i] = (_TestMtbCmapWorker){ .cmap = &cmap, .beg = i * n / 4, .end = (i + 1) * n / 4 };
+        assert(thrd_create(&threads[i], _test_mtb_cmap_worker_run, &workers[i]) == thrd_success);
+    }
+    for (u64 i = 0; i < mtb_countof(threads); i++) {
+        assert(thrd_join(threads[i], nil) == thrd_success);
+    }
+
+    assert(mtb_cmap_count(&cmap) == 1000);
+    for (u64 k = 0; k < 1000; k++) {
+        u64 v = 0;
+        assert(mtb_cmap_get(&cmap, &k, &v));
+        assert(v == n / 1000);
+    }
+
+    mtb_cmap_deinit(&cmap);
+}
+
+func void
+_test_mtb_cmap_rcu_basic(MtbArena *arena)
+{
+    mtb_arena_temp_scope(arena);
+    MtbCmapRcu rcu = {0};
+    mtb_cmap_rcu_init(&rcu, arena, u64, u64, _test_mtb_cmap_hash_u64, _test_mtb_cmap_is_equal_u64,
+                      .maxReaders = 2, .versionArenaSize = kb(256));
+    u64 reader = mtb_cmap_rcu_register(&rcu);
+    assert(reader == 0);
+
+    u64 n = 1000;
+    MtbHmap *hmap = mtb_cmap_rcu_write_begin(&rcu);
+    for (u64 k = 0; k < n; k++) {
+        *(u64 *)mtb_hmap_put(hmap, &k) = k * k;
+    }
+    assert(!mtb_cmap_rcu_get(&rcu, reader, &(u64){ 1 }, nil)); // not published yet
+    mtb_cmap_rcu_write_end(&rcu);
+
+    MtbHmap *snapshot = mtb_cmap_rcu_read_begin(&rcu, reader);
+    assert(snapshot->count == n);
+    mtb_cmap_rcu_read_end(&rcu, reader);
+
+    hmap = mtb_cmap_rcu_write_begin(&rcu);
+    for (u64 k = 0; k < n; k += 2) {
+        assert(mtb_hmap_remove(hmap, &k) != nil);
+    }
+    mtb_cmap_rcu_write_end(&rcu);
+
+    for (u64 k = 0; k < n; k++) {
+        u64 v = 0;
+        assert(mtb_cmap_rcu_get(&rcu, reader, &k, &v) == (k % 2 == 1));
+        assert(k % 2 == 0 || v == k * k);
+    }
+
+    mtb_cmap_rcu_deinit(&rcu);
+}
+
+typedef struct _test_mtb_cmap_rcu_worker _TestMtbCmapRcuWorker;
+struct _test_mtb_cmap_rcu_worker
 {
-    u64 length = 0;
-    mtb_list_foreach(&list->node, n) {
-        MtbStrList *node = mtb_containerof(n, MtbStrList, node);
-        MtbStr *str = node->str;
-        if (!mtb_str_is_empty(*str) || !opt.skipEmpty) {
-            length += str->length + delim.length;
+    MtbCmapRcu *rcu;
+    u64 keyCount;
+    u64 lastVersion;
+};
+
+func int
+_test_mtb_cmap_rcu_reader_run(void *arg)
+{
+    _TestMtbCmapRcuWorker *worker = arg;
+    u64 reader = mtb_cmap_rcu_register(worker->rcu);
+    u64 prevVersion = 0;
+    while (prevVersion < worker->lastVersion) {
+        // every published snapshot maps all keys to the same version
+        MtbHmap *hmap = mtb_cmap_rcu_read_begin(worker->rcu, reader);
+        u64 version = *(u64 *)mtb_hmap_get(hmap, &(u64){ 0 });
+        for (u64 k = 1; k < worker->keyCount; k++) {
+            assert(*(u64 *)mtb_hmap_get(hmap, &k) == version);
         }
+        mtb_cmap_rcu_read_end(worker->rcu, reader);
+        assert(version >= prevVersion);
+        prevVersion = version;
     }
-    if (length == 0) {
-        return mtb_str_empty();
+    mtb_cmap_rcu_unregister(worker->rcu, reader);
+    return 0;
+}
+
+func void
+_test_mtb_cmap_rcu_threads(MtbArena *arena)
+{
+    mtb_arena_temp_scope(arena);
+    MtbCmapRcu rcu = {0};
+    mtb_cmap_rcu_init(&rcu, arena, u64, u64, _test_mtb_cmap_hash_u64, _test_mtb_cmap_is_equal_u64,
+                      .maxReaders = 4, .versionArenaSize = kb(64));
+
+    u64 keyCount = 64;
+    MtbHmap *hmap = mtb_cmap_rcu_write_begin(&rcu);
+    for (u64 k = 0; k < keyCount; k++) {
+        *(u64 *)mtb_hmap_put(hmap, &k) = 0;
     }
-    length -= delim.length;
+    mtb_cmap_rcu_write_end(&rcu);
 
-    u8 *bytes = mtb_arena_bump(list->arena, u8, length);
-    u64 bytesOffset = 0;
-    mtb_list_foreach(&list->node, n) {
-        MtbStrList *node = mtb_containerof(n, MtbStrList, node);
-        MtbStr *str = node->str;
-        if (!mtb_str_is_empty(*str) || !opt.skipEmpty) {
-            memcpy(bytes + bytesOffset, str->bytes, str->length);
-            bytesOffset += str->length;
-            if (bytesOffset < length) {
-                memcpy(bytes + bytesOffset, delim.bytes, delim.length);
-                bytesOffset += delim.length;
-            }
+    _TestMtbCmapRcuWorker worker = { .rcu = &rcu, .keyCount = keyCount, .lastVersion = 200 };
+    thrd_t threads[4];
+    for (u64 i = 0; i < mtb_countof(threads); i++) {
+        assert(thrd_create(&threads[i], _test_mtb_cmap_rcu_reader_run, &worker) == thrd_success);
+    }
+    for (u64 version = 1; version <= worker.lastVersion; version++) {
+        hmap = mtb_cmap_rcu_write_begin(&rcu);
+        for (u64 k = 0; k < keyCount; k++) {
+            *(u64 *)mtb_hmap_put(hmap, &k) = version;
         }
+        mtb_cmap_rcu_write_end(&rcu);
     }
-    return mtb_str(bytes, length);
+    for (u64 i = 0; i < mtb_countof(threads); i++) {
+        assert(thrd_join(threads[i], nil) == thrd_success);
+    }
+    for (u64 i = 0; i < rcu.maxReaders; i++) {
+        assert(rcu.readers[i].used == 0);
+    }
+
+    mtb_cmap_rcu_deinit(&rcu);
+}
+
+func int
+_test_mtb_cmap_rcu_short_reader_run(void *arg)
+{
+    _TestMtbCmapRcuWorker *worker = arg;
+    u64 reader = mtb_cmap_rcu_register(worker->rcu);
+    for (u64 k = 0; k < worker->keyCount; k++) {
+        assert(mtb_cmap_rcu_get(worker->rcu, reader, &k, nil));
+    }
+    mtb_cmap_rcu_unregister(worker->rcu, reader);
+    return 0;
 }
 
 func void
-mtb_str_split_opt(MtbStrList *list, MtbStr str, MtbStr delim, MtbStrSplitOptions opt)
+_test_mtb_cmap_rcu_churn(MtbArena *arena)
 {
-    MtbArena *arena = list->arena;
+    mtb_arena_temp_scope(arena);
+    MtbCmapRcu rcu = {0};
+    mtb_cmap_rcu_init(&rcu, arena, u64, u64, _test_mtb_cmap_hash_u64, _test_mtb_cmap_is_equal_u64,
+                      .maxReaders = 2, .versionArenaSize = kb(64));
 
-    if (mtb_str_is_empty(delim)) {
-        MtbStr *tok = mtb_arena_bump(arena, MtbStr, 1);
-        *tok = mtb_str_prefix(str, str.length);
-        mtb_str_list_append(list, tok);
+    u64 keyCount = 64;
+    MtbHmap *hmap = mtb_cmap_rcu_write_begin(&rcu);
+    for (u64 k = 0; k < keyCount; k++) {
+        *(u64 *)mtb_hmap_put(hmap, &k) = 0;
     }
-    else {
-        while (!mtb_str_is_empty(str)) {
-            u64 i = mtb_str_find(str, delim);
-            MtbStr tok = mtb_str_prefix(str, mtb_min_u64(i, str.length));
-            if (!mtb_str_is_empty(tok) || !opt.skipEmpty) {
-                MtbStrList *node = mtb_str_list_append(list, mtb_arena_bump(arena, MtbStr, 1));
-                *node->str = tok;
-
-                str.length -= tok.length;
-                str.bytes += tok.length;
-            }
-            if (i != MTB_STR_NOT_FOUND) {
-                str.length -= delim.length;
-                str.bytes += delim.length;
-            }
+    mtb_cmap_rcu_write_end(&rcu);
+
+    // many more short-lived reader threads than slots
+    _TestMtbCmapRcuWorker worker = { .rcu = &rcu, .keyCount = keyCount };
+    for (u64 round = 1; round <= 32; round++) {
+        thrd_t threads[2];
+        for (u64 i = 0; i < mtb_countof(threads); i++) {
+            assert(thrd_create(&threads[i], _test_mtb_cmap_rcu_short_reader_run, &worker) == thrd_success);
+        }
+        hmap = mtb_cmap_rcu_write_begin(&rcu);
+        *(u64 *)mtb_hmap_put(hmap, &(u64){ 0 }) = round;
+        mtb_cmap_rcu_write_end(&rcu);
+        for (u64 i = 0; i < mtb_countof(threads); i++) {
+            assert(thrd_join(threads[i], nil) == thrd_success);
         }
     }
+
+    u64 reader = mtb_cmap_rcu_register(&rcu);
+    assert(reader == 0);
+    assert(mtb_cmap_rcu_register(&rcu) == 1);
+    mtb_cmap_rcu_unregister(&rcu, reader);
+    assert(mtb_cmap_rcu_register(&rcu) == reader);
+
+    mtb_cmap_rcu_deinit(&rcu);
 }
 
-#endif // MTB_STRING_IMPLEMENTATION
+func void
+_test_mtb_cmap(void)
+{
+    MtbArena arena = {0};
+    mtb_arena_init(&arena, kb(16), &MTB_ARENA_DEF_ALLOCATOR);
 
+    _test_mtb_cmap_basic(&arena);
+    _test_mtb_cmap_threads(&arena);
+    _test_mtb_cmap_rcu_basic(&arena);
+    _test_mtb_cmap_rcu_threads(&arena);
+    _test_mtb_cmap_rcu_churn(&arena);
 
-#ifdef MTB_STRING_TESTS
+    mtb_arena_deinit(&arena);
+}
+
+#endif // MTB_CMAP_TESTS
+
+
+#ifdef MTB_CMAP_BENCH
 
 #include <assert.h>
 
 
+typedef struct _bench_mtb_cmap_worker _BenchMtbCmapWorker;
+struct _bench_mtb_cmap_worker
+{
+    MtbCmap *cmap;
+    MtbStr *tokens;
+    u64 count;
+};
+
 func void
-_test_mtb_str_cstr(MtbArena arena)
+_bench_mtb_cmap_increment(void *value, void *ctx)
 {
-    char *c1 = "My C String!";
-    MtbStr s1 = mtb_str_from_cstr(c1);
-    assert(strlen(c1) == s1.length);
-    assert(strncmp(c1, s1.chars, s1.length) == 0);
+    *(u64 *)value += 1;
+}
 
-    MtbStr s2 = mtb_str_lit("My non-C string!");
-    char *c2 = mtb_str_to_cstr(&arena, s2);
-    assert(strlen(c1) == s1.length);
-    assert(strncmp(c2, s2.chars, s2.length) == 0);
+func int
+_bench_mtb_cmap_worker_run(void *arg)
+{
+    _BenchMtbCmapWorker *worker = arg;
+    for (u64 i = 0; i < worker->count; i++) {
+        mtb_cmap_update(worker->cmap, worker->tokens + i, _bench_mtb_cmap_increment, nil);
+    }
+    return 0;
 }
 
 func void
-_test_mtb_str_sprintf(MtbArena arena)
-{
-    MtbStr e1 = mtb_str_empty();
-    MtbStr a1 = mtb_str_sprintf(&arena, "");
-    assert(e1.length == a1.length);
-    assert(mtb_str_is_equal(e1, a1));
+_bench_mtb_cmap_word_count(MtbArena *arena, MtbDynArr *tokens, u64 threadCount)
+{
+    mtb_arena_temp_scope(arena);
+    MtbCmap cmap = {0};
+    mtb_cmap_init(&cmap, arena, MtbStr, u64, mtb_str_key_hash, mtb_str_key_equals, .shardArenaSize = mb(4));
+
+    thrd_t *threads = mtb_arena_bump(arena, thrd_t, threadCount);
+    _BenchMtbCmapWorker *workers = mtb_arena_bump(arena, _BenchMtbCmapWorker, threadCount);
+
+    u64 beg = mtb_perf_sys_time();
+    for (u64 i = 0; i < threadCount; i++) {
+        u64 tokensBeg = i * tokens->length / threadCount;
+        u64 tokensEnd = (i + 1) * tokens->length / threadCount;
+        workers[i] = (_BenchMtbCmapWorker){
+            .cmap = &cmap,
+            .tokens = mtb_dynarr_get(tokens, tokensBeg),
+            .count = tokensEnd - tokensBeg,
+        };
+        mtb_assert_always(thrd_create(&threads[i], _bench_mtb_cmap_worker_run, &workers[i]) == thrd_success);
+    }
+    for (u64 i = 0; i < threadCount; i++) {
+        mtb_assert_always(thrd_join(threads[i], nil) == thrd_success);
+    }
+    u64 elapsed = mtb_perf_sys_time() - beg;
 
-    MtbStr e2 = mtb_str_from_cstr("123\n0.4567\nAbCdEfGh");
-    MtbStr a2 = mtb_str_sprintf(&arena, "%d\n%.4f\n%s", 123, 0.4567, "AbCdEfGh");
-    assert(e2.length == a2.length);
-    assert(mtb_str_is_equal(e2, a2));
+    MtbStr love = mtb_str_lit("love");
+    u64 loveCount = 0;
+    assert(mtb_cmap_get(&cmap, &love, &loveCount) && loveCount > 0);
+
+    f64 seconds = (f64)elapsed / (f64)mtb_perf_sys_freq();
+    printf("%lu threads: %.3f s, %.2f M tokens/s\n", threadCount, seconds, (f64)tokens->length / seconds / 1e6);
+
+    mtb_cmap_deinit(&cmap);
 }
 
-func void
-_test_mtb_str_cmp(void)
+typedef struct _bench_mtb_cmap_rcu_worker _BenchMtbCmapRcuWorker;
+struct _bench_mtb_cmap_rcu_worker
 {
-    assert(mtb_str_is_equal(mtb_str_empty(), mtb_str_empty()));
-    assert(mtb_str_cmp(mtb_str_lit("abcd"), mtb_str_empty()) > 0);
-    assert(mtb_str_cmp(mtb_str_empty(), mtb_str_lit("abcd")) < 0);
-    assert(mtb_str_is_equal(mtb_str_lit("abcd"), mtb_str_lit("abcd")));
-    assert(mtb_str_cmp(mtb_str_lit("abcd"), mtb_str_lit("abcD")) > 0);
-    assert(mtb_str_cmp(mtb_str_lit("abcD"), mtb_str_lit("abcd")) < 0);
-    assert(mtb_str_cmp(mtb_str_lit("abcde"), mtb_str_lit("abcd")) > 0);
-    assert(mtb_str_cmp(mtb_str_lit("abcd"), mtb_str_lit("abcde")) < 0);
+    MtbCmapRcu *rcu; // the mutex guarded cmap if nil
+    MtbCmap *cmap;
+    MtbStr *tokens;
+    u64 count;
+    u64 found;
+};
 
-    assert(mtb_str_is_equal(mtb_str_empty(), mtb_str_empty(), .ignoreCase = true));
-    assert(mtb_str_cmp(mtb_str_lit("AbCd"), mtb_str_empty(), .ignoreCase = true) > 0);
-    assert(mtb_str_cmp(mtb_str_empty(), mtb_str_lit("aBcD"), .ignoreCase = true) < 0);
-    assert(mtb_str_is_equal(mtb_str_lit("AbCd"), mtb_str_lit("aBcD"), .ignoreCase = true));
-    assert(mtb_str_cmp(mtb_str_lit("AbCe"), mtb_str_lit("aBcD"), .ignoreCase = true) > 0);
-    assert(mtb_str_cmp(mtb_str_lit("AbCd"), mtb_str_lit("aBcE"), .ignoreCase = true) < 0);
-    assert(mtb_str_cmp(mtb_str_lit("AbCdE"), mtb_str_lit("aBcD"), .ignoreCase = true) > 0);
-    assert(mtb_str_cmp(mtb_str_lit("AbCd"), mtb_str_lit("aBcDe"), .ignoreCase = true) < 0);
+func int
+_bench_mtb_cmap_rcu_worker_run(void *arg)
+{
+    _BenchMtbCmapRcuWorker *worker = arg;
+    u64 found = 0;
+    if (worker->rcu != nil) {
+        u64 reader = mtb_cmap_rcu_register(worker->rcu);
+        for (u64 i = 0; i < worker->count; i++) {
+            found += mtb_cmap_rcu_get(worker->rcu, reader, worker->tokens + i, nil);
+        }
+        mtb_cmap_rcu_unregister(worker->rcu, reader);
+    }
+    else {
+        for (u64 i = 0; i < worker->count; i++) {
+            found += mtb_cmap_get(worker->cmap, worker->tokens + i, nil);
+        }
+    }
+    worker->found = found;
+    return 0;
 }
 
 func void
-_test_mtb_str_find(void)
-{
-    assert(mtb_str_find(mtb_str_lit("ABCDEFGHIJKLMNOPQRSTUVWXYZ"), mtb_str_empty()) == 0);
-    assert(mtb_str_find(mtb_str_empty(), mtb_str_lit("ABCDEFGHIJKLMNOPQRSTUVWXYZ")) == MTB_STR_NOT_FOUND);
-    assert(mtb_str_find(mtb_str_lit("ABCDEFGHIJKLMNOPQRSTUVWXYZ"), mtb_str_lit("ABCDEFGHIJKLMNOPQRSTUVWXYZ")) == 0);
-    assert(mtb_str_find(mtb_str_lit("ABCDEFGHIJKLMNOPQRSTUVWXYZ"), mtb_str_lit("A")) == 0);
-    assert(mtb_str_find(mtb_str_lit("ABCDEFGHIJKLMNOPQRSTUVWXYZ"), mtb_str_lit("MNOPQRS")) == 12);
-    assert(mtb_str_find(mtb_str_lit("ABCDEFGHIJKLMNOPQRSTUVWXYZ"), mtb_str_lit("Z")) == 25);
-    assert(mtb_str_find(mtb_str_lit("ABCDEFGHIJKLMNOPQRSTUVWXYZ"), mtb_str_lit("z")) == MTB_STR_NOT_FOUND);
-    assert(mtb_str_contains(mtb_str_lit("It's a Me, Mario!"), mtb_str_lit("Mario")));
-    assert(!mtb_str_contains(mtb_str_lit("It's a Me, Mario!"), mtb_str_lit("Wario")));
+_bench_mtb_cmap_rcu_lookup(MtbArena *arena, MtbDynArr *tokens, u64 threadCount, bool rcuMode)
+{
+    mtb_arena_temp_scope(arena);
+    // a single shard is a mutex around mtb_hmap_get
+    MtbCmap cmap = {0};
+    MtbCmapRcu rcu = {0};
+    if (rcuMode) {
+        mtb_cmap_rcu_init(&rcu, arena, MtbStr, u64, mtb_str_key_hash, mtb_str_key_equals,
+                          .versionArenaSize = mb(8));
+        MtbHmap *hmap = mtb_cmap_rcu_write_begin(&rcu);
+        for (u64 i = 0; i < tokens->length; i++) {
+            *(u64 *)mtb_hmap_put(hmap, mtb_dynarr_get(tokens, i)) += 1;
+        }
+        mtb_cmap_rcu_write_end(&rcu);
+    }
+    else {
+        mtb_cmap_init(&cmap, arena, MtbStr, u64, mtb_str_key_hash, mtb_str_key_equals,
+                      .shardCount = 1, .shardArenaSize = mb(8));
+        for (u64 i = 0; i < tokens->length; i++) {
+            mtb_cmap_update(&cmap, mtb_dynarr_get(tokens, i), _bench_mtb_cmap_increment, nil);
+        }
+    }
 
-    assert(mtb_str_find(mtb_str_lit("AbCdEfGhIjKlMnOpQrStUvWxYz"), mtb_str_empty(), .ignoreCase = true) == 0);
-    assert(mtb_str_find(mtb_str_empty(), mtb_str_lit("AbCdEfGhIjKlMnOpQrStUvWxYz"), .ignoreCase = true) == MTB_STR_NOT_FOUND);
-    assert(mtb_str_find(mtb_str_lit("AbCdEfGhIjKlMnOpQrStUvWxYz"), mtb_str_lit("aBcDeFgHiJkLmNoPqRsTuVwXyZ"), .ignoreCase = true) == 0);
-    assert(mtb_str_find(mtb_str_lit("AbCdEfGhIjKlMnOpQrStUvWxYz"), mtb_str_lit("a"), .ignoreCase = true) == 0);
-    assert(mtb_str_find(mtb_str_lit("AbCdEfGhIjKlMnOpQrStUvWxYz"), mtb_str_lit("mNoPqRs"), .ignoreCase = true) == 12);
-    assert(mtb_str_find(mtb_str_lit("AbCdEfGhIjKlMnOpQrStUvWxYz"), mtb_str_lit("Z"), .ignoreCase = true) == 25);
-    assert(mtb_str_find(mtb_str_lit("AbCdEfGhIjKlMnOpQrStUvWxYz"), mtb_str_lit("1"), .ignoreCase = true) == MTB_STR_NOT_FOUND);
-    assert(mtb_str_contains(mtb_str_lit("It's a Me, Mario!"), mtb_str_lit("mario"), .ignoreCase = true));
-    assert(!mtb_str_contains(mtb_str_lit("It's a Me, Mario!"), mtb_str_lit("wario"), .ignoreCase = true));
+    thrd_t *threads = mtb_arena_bump(arena, thrd_t, threadCount);
+    _BenchMtbCmapRcuWorker *workers = mtb_arena_bump(arena, _BenchMtbCmapRcuWorker, threadCount);
+
+    // every thread looks up the whole corpus
+    u64 beg = mtb_perf_sys_time();
+    for (u64 i = 0; i < threadCount; i++) {
+        workers[i] = (_BenchMtbCmapRcuWorker){
+            .rcu = rcuMode ? &rcu : nil,
+            .cmap = &cmap,
+            .tokens = mtb_dynarr_get(tokens, 0),
+            .count = tokens->length,
+        };
+        mtb_assert_always(thrd_create(&threads[i], _bench_mtb_cmap_rcu_worker_run, &workers[i]) == thrd_success);
+    }
+    for (u64 i = 0; i < threadCount; i++) {
+        mtb_assert_always(thrd_join(threads[i], nil) == thrd_success);
+        assert(workers[i].found == tokens->length);
+    }
+    u64 elapsed = mtb_perf_sys_time() - beg;
+
+    f64 seconds = (f64)elapsed / (f64)mtb_perf_sys_freq();
+    printf("%s, %lu threads: %.3f s, %.2f M lookups/s\n",
+           rcuMode ? "rcu" : "mutex",
+           threadCount,
+           seconds,
+           (f64)(tokens->length * threadCount) / seconds / 1e6);
+
+    if (rcuMode) {
+        mtb_cmap_rcu_deinit(&rcu);
+    }
+    else {
+        mtb_cmap_deinit(&cmap);
+    }
 }
 
 func void
-_test_mtb_str_has_prefix(void)
+_bench_mtb_cmap(MtbDynArr *tokens)
 {
-    assert(mtb_str_has_prefix(mtb_str_lit("Hello, World!"), mtb_str_empty()));
-    assert(!mtb_str_has_prefix(mtb_str_empty(), mtb_str_lit("Hello, World!")));
-    assert(mtb_str_has_prefix(mtb_str_lit("Hello, World!"), mtb_str_lit("Hello")));
-    assert(!mtb_str_has_prefix(mtb_str_lit("Hello, World!"), mtb_str_lit("World!")));
-    assert(mtb_str_has_prefix(mtb_str_lit("Hello, World!"), mtb_str_lit("Hello, World!")));
+    MtbArena arena = {0};
+    mtb_arena_init(&arena, mb(128), &MTB_ARENA_DEF_ALLOCATOR);
+
+    u64 cpuCount = (u64)sysconf(_SC_NPROCESSORS_ONLN);
+    printf("== word count, sharded concurrent map ==\n");
+    for (u64 threadCount = 1; threadCount <= cpuCount; threadCount <<= 1) {
+        _bench_mtb_cmap_word_count(&arena, tokens, threadCount);
+        if (threadCount < cpuCount && threadCount << 1 > cpuCount) {
+            _bench_mtb_cmap_word_count(&arena, tokens, cpuCount);
+        }
+    }
 
-    assert(mtb_str_has_prefix(mtb_str_lit("Hello, World!"), mtb_str_empty(), .ignoreCase = true));
-    assert(!mtb_str_has_prefix(mtb_str_empty(), mtb_str_lit("Hello, World!"), .ignoreCase = true));
-    assert(mtb_str_has_prefix(mtb_str_lit("Hello, World!"), mtb_str_lit("hello"), .ignoreCase = true));
-    assert(!mtb_str_has_prefix(mtb_str_lit("Hello, World!"), mtb_str_lit("world!"), .ignoreCase = true));
-    assert(mtb_str_has_prefix(mtb_str_lit("Hello, World!"), mtb_str_lit("hello, world!"), .ignoreCase = true));
+    printf("== lookups, mutex vs read-mostly (rcu) map ==\n");
+    for (u64 threadCount = 1; threadCount <= cpuCount; threadCount <<= 1) {
+        _bench_mtb_cmap_rcu_lookup(&arena, tokens, threadCount, false);
+        _bench_mtb_cmap_rcu_lookup(&arena, tokens, threadCount, true);
+    }
+
+    mtb_arena_deinit(&arena);
 }
 
-func void
-_test_mtb_str_has_suffix(void)
+#endif // MTB_CMAP_BENCH
+#ifndef MTB_INTERN_H
+#define MTB_INTERN_H
+
+#ifdef MTB_IMPLEMENTATION
+#define MTB_INTERN_IMPLEMENTATION
+#endif
+
+#ifdef MTB_TESTS
+#define MTB_INTERN_TESTS
+#endif
+
+#ifdef MTB_BENCH
+#define MTB_INTERN_BENCH
+#endif
+
+
+#include <threads.h>
+
+
+#ifndef MTB_CINTERN_DEF_SHARD_COUNT
+#define MTB_CINTERN_DEF_SHARD_COUNT 16
+#endif
+
+#ifndef MTB_CINTERN_DEF_SHARD_ARENA_SIZE
+#define MTB_CINTERN_DEF_SHARD_ARENA_SIZE mb(64)
+#endif
+
+#define MTB_INTERN_CACHE_LINE 64
+
+#define MTB_SYM_NONE U32_MAX
+
+
+/* String Interner */
+
+// Every distinct string is copied once into the arena and gets a dense 32 bit symbol,
+// so equal strings compare as equal symbols (or equal canonical bytes pointers).
+typedef u32 MtbSym;
+
+typedef struct mtb_intern MtbIntern;
+struct mtb_intern
 {
-    assert(mtb_str_has_suffix(mtb_str_lit("Hello, World!"), mtb_str_empty()));
-    assert(!mtb_str_has_suffix(mtb_str_empty(), mtb_str_lit("Hello, World!")));
-    assert(mtb_str_has_suffix(mtb_str_lit("Hello, World!"), mtb_str_lit("World!")));
-    assert(!mtb_str_has_suffix(mtb_str_lit("Hello, World!"), mtb_str_lit("Hello")));
-    assert(mtb_str_has_suffix(mtb_str_lit("Hello, World!"), mtb_str_lit("Hello, World!")));
+    MtbArena *arena;
+    MtbHmap hmap;   // canonical MtbStr -> MtbSym, w/ stored hashes so they are computed once
+    MtbSegArr strs; // MtbSym -> canonical MtbStr, segments never move
+};
+
+
+func void mtb_intern_init(MtbIntern *intern, MtbArena *arena);
+func u64 mtb_intern_count(MtbIntern *intern);
+
+func MtbSym mtb_intern(MtbIntern *intern, MtbStr str);
+func MtbSym mtb_intern_hashed(MtbIntern *intern, MtbStr str, u64 hash); // hash must be mtb_str_hash(str)
+#define mtb_intern_lit(intern, s) mtb_intern(intern, mtb_str_lit(s))
+func MtbSym mtb_intern_find(MtbIntern *intern, MtbStr str); // MTB_SYM_NONE if never interned
+
+// The canonical copy, null-terminated past its length. Stays valid as long as the arena.
+func MtbStr mtb_intern_str(MtbIntern *intern, MtbSym sym);
+
+
+/* Concurrent (sharded) String Interner */
+
+// Every shard is a MtbIntern w/ its own lock and arena, picked by the high hash bits.
+// Symbols keep the shard in their low bits, so they are unique but not dense.
+typedef struct mtb_cintern_shard MtbCinternShard;
+struct mtb_cintern_shard
+{
+    mtx_t lock;
+    MtbArena arena;
+    MtbIntern intern;
+} __attribute__((aligned(MTB_INTERN_CACHE_LINE)));
+
+typedef struct mtb_cintern MtbCintern;
+struct mtb_cintern
+{
+    u64 shardCount; // must be power of 2!
+    u32 shardShift;
+    u32 shardBits;
+    MtbCinternShard *shards;
+};
+
+typedef struct mtb_cintern_init_options MtbCinternInitOptions;
+struct mtb_cintern_init_options
+{
+    u64 shardCount;               // MTB_CINTERN_DEF_SHARD_COUNT if 0
+    u64 shardArenaSize;           // MTB_CINTERN_DEF_SHARD_ARENA_SIZE if 0
+    MtbArenaAllocator *allocator; // of the shard arenas, MTB_ARENA_DEF_ALLOCATOR if nil
+};
+
+
+// The shard array is bumped from the arena, shards allocate from their own ones.
+func void mtb_cintern_init_opt(MtbCintern *cintern, MtbArena *arena, MtbCinternInitOptions opt);
+#define mtb_cintern_init(cintern, arena, ...) mtb_cintern_init_opt(cintern, arena, (MtbCinternInitOptions){ __VA_ARGS__ })
+func void mtb_cintern_deinit(MtbCintern *cintern);
+func u64 mtb_cintern_count(MtbCintern *cintern);
+
+// Thread safe, same as the MtbIntern ones.
+func MtbSym mtb_cintern(MtbCintern *cintern, MtbStr str);
+func MtbSym mtb_cintern_find(MtbCintern *cintern, MtbStr str);
+func MtbStr mtb_cintern_str(MtbCintern *cintern, MtbSym sym);
+
+#endif //MTB_INTERN_H
+
+
+#ifdef MTB_INTERN_IMPLEMENTATION
+
+#include <string.h>
+
+
+#define _mtb_cintern_shard_of(cintern, hash) ((cintern)->shards + ((cintern)->shardShift == 64 ? 0 : (hash) >> (cintern)->shardShift))
 
-    assert(mtb_str_has_suffix(mtb_str_lit("Hello, World!"), mtb_str_empty(), .ignoreCase = true));
-    assert(!mtb_str_has_suffix(mtb_str_empty(), mtb_str_lit("Hello, World!"), .ignoreCase = true));
-    assert(mtb_str_has_suffix(mtb_str_lit("Hello, World!"), mtb_str_lit("world!"), .ignoreCase = true));
-    assert(!mtb_str_has_suffix(mtb_str_lit("Hello, World!"), mtb_str_lit("hello"), .ignoreCase = true));
-    assert(mtb_str_has_suffix(mtb_str_lit("Hello, World!"), mtb_str_lit("hello, world!"), .ignoreCase = true));
-}
 
 func void
-_test_mtb_str_trim(void)
+mtb_intern_init(MtbIntern *intern, MtbArena *arena)
 {
-    assert(mtb_str_is_equal(mtb_str_trim(mtb_str_empty()), mtb_str_empty()));
-    assert(mtb_str_is_equal(mtb_str_trim(mtb_str_lit(" \t\r\n\v\f")), mtb_str_empty()));
-    assert(mtb_str_is_equal(mtb_str_trim(mtb_str_lit("Hello! \t\r\n\v\f")), mtb_str_lit("Hello!")));
-    assert(mtb_str_is_equal(mtb_str_trim(mtb_str_lit(" \t\r\n\v\fHello!")), mtb_str_lit("Hello!")));
-    assert(mtb_str_is_equal(mtb_str_trim(mtb_str_lit(" \t\r\n\v\fHello! \t\r\n\v\f")), mtb_str_lit("Hello!")));
+    intern->arena = arena;
+    mtb_hmap_init(&intern->hmap, arena, MtbStr, MtbSym, mtb_str_key_hash, mtb_str_key_equals,
+                  .probing = MTB_HMAP_PROBING_GROUP, .storeHash = true);
+    mtb_segarr_init(&intern->strs, arena, sizeof(MtbStr));
 }
 
-func void
-_test_mtb_str_trim_beg(void)
+func u64
+mtb_intern_count(MtbIntern *intern)
 {
-    assert(mtb_str_is_equal(mtb_str_trim_beg(mtb_str_empty()), mtb_str_empty()));
-    assert(mtb_str_is_equal(mtb_str_trim_beg(mtb_str_lit(" \t\r\n\v\f")), mtb_str_empty()));
-    assert(mtb_str_is_equal(mtb_str_trim_beg(mtb_str_lit("Hello! \t\r\n\v\f")), mtb_str_lit("Hello! \t\r\n\v\f")));
-    assert(mtb_str_is_equal(mtb_str_trim_beg(mtb_str_lit(" \t\r\n\v\fHello!")), mtb_str_lit("Hello!")));
-    assert(mtb_str_is_equal(mtb_str_trim_beg(mtb_str_lit(" \t\r\n\v\fHello! \t\r\n\v\f")), mtb_str_lit("Hello! \t\r\n\v\f")));
+    return intern->strs.count;
 }
 
-func void
-_test_mtb_str_trim_end(void)
+func MtbSym
+mtb_intern(MtbIntern *intern, MtbStr str)
 {
-    assert(mtb_str_is_equal(mtb_str_trim_end(mtb_str_empty()), mtb_str_empty()));
-    assert(mtb_str_is_equal(mtb_str_trim_end(mtb_str_lit(" \t\r\n\v\f")), mtb_str_empty()));
-    assert(mtb_str_is_equal(mtb_str_trim_end(mtb_str_lit("Hello! \t\r\n\v\f")), mtb_str_lit("Hello!")));
-    assert(mtb_str_is_equal(mtb_str_trim_end(mtb_str_lit(" \t\r\n\v\fHello!")), mtb_str_lit(" \t\r\n\v\fHello!")));
-    assert(mtb_str_is_equal(mtb_str_trim_end(mtb_str_lit(" \t\r\n\v\fHello! \t\r\n\v\f")), mtb_str_lit(" \t\r\n\v\fHello!")));
+    return mtb_intern_hashed(intern, str, mtb_str_hash(str));
+}
+
+func MtbSym
+mtb_intern_hashed(MtbIntern *intern, MtbStr str, u64 hash)
+{
+    MtbSym *sym = mtb_hmap_get_hashed(&intern->hmap, &str, hash);
+    if (sym != nil) {
+        return *sym;
+    }
+
+    // the key must point to the canonical bytes, so they are copied before the insert
+    mtb_assert_always(intern->strs.count < MTB_SYM_NONE);
+    MtbStr canonical = mtb_str(mtb_arena_bump(intern->arena, u8, str.length + 1), str.length); // zeroed, so null-terminated
+    if (!mtb_str_is_empty(str)) {
+        memcpy(canonical.bytes, str.bytes, str.length);
+    }
+    bool inserted;
+    sym = mtb_hmap_upsert_hashed(&intern->hmap, &canonical, hash, &inserted);
+    mtb_assert(inserted);
+    *sym = (MtbSym)intern->strs.count;
+    *(MtbStr *)mtb_segarr_add_last(&intern->strs) = canonical;
+    return *sym;
 }
 
-func void
-_test_mtb_str_skip()
+func MtbSym
+mtb_intern_find(MtbIntern *intern, MtbStr str)
 {
-    assert(mtb_str_is_equal(mtb_str_skip(mtb_str_empty(), 0), mtb_str_empty()));
-    assert(mtb_str_is_equal(mtb_str_skip(mtb_str_lit("Hello, World!"), 0), mtb_str_lit("Hello, World!")));
-    assert(mtb_str_is_equal(mtb_str_skip(mtb_str_lit("Hello, World!"), 7), mtb_str_lit("World!")));
-    assert(mtb_str_is_equal(mtb_str_skip(mtb_str_lit("Hello, World!"), 13), mtb_str_empty()));
+    MtbSym *sym = mtb_hmap_get(&intern->hmap, &str);
+    return sym == nil ? MTB_SYM_NONE : *sym;
 }
 
-func void
-_test_mtb_str_chop()
+func MtbStr
+mtb_intern_str(MtbIntern *intern, MtbSym sym)
 {
-    assert(mtb_str_is_equal(mtb_str_chop(mtb_str_empty(), 0), mtb_str_empty()));
-    assert(mtb_str_is_equal(mtb_str_chop(mtb_str_lit("Hello, World!"), 0), mtb_str_lit("Hello, World!")));
-    assert(mtb_str_is_equal(mtb_str_chop(mtb_str_lit("Hello, World!"), 8), mtb_str_lit("Hello")));
-    assert(mtb_str_is_equal(mtb_str_chop(mtb_str_lit("Hello, World!"), 13), mtb_str_empty()));
+    return *(MtbStr *)mtb_segarr_get(&intern->strs, sym);
 }
 
 func void
-_test_mtb_str_to_lower(MtbArena arena)
-{
-    assert(mtb_str_is_equal(mtb_str_to_lower(&arena, mtb_str_empty()), mtb_str_empty()));
-    assert(mtb_str_is_equal(mtb_str_to_lower(&arena, mtb_str_lit("Hello, World!")), mtb_str_lit("hello, world!")));
+mtb_cintern_init_opt(MtbCintern *cintern, MtbArena *arena, MtbCinternInitOptions opt)
+{
+    mtb_assert_always(mtb_is_pow2_or_zero(opt.shardCount));
+
+    cintern->shardCount = opt.shardCount == 0 ? MTB_CINTERN_DEF_SHARD_COUNT : opt.shardCount;
+    cintern->shardBits = (u32)mtb_trailing_zeros_count(cintern->shardCount);
+    cintern->shardShift = 64 - cintern->shardBits;
+    cintern->shards = mtb_arena_bump(arena, MtbCinternShard, cintern->shardCount);
+
+    u64 shardArenaSize = opt.shardArenaSize == 0 ? MTB_CINTERN_DEF_SHARD_ARENA_SIZE : opt.shardArenaSize;
+    MtbArenaAllocator *allocator = opt.allocator == nil ? &MTB_ARENA_DEF_ALLOCATOR : opt.allocator;
+    for (u64 i = 0; i < cintern->shardCount; i++) {
+        MtbCinternShard *shard = cintern->shards + i;
+        mtb_assert_always(mtx_init(&shard->lock, mtx_plain) == thrd_success);
+        mtb_arena_init(&shard->arena, shardArenaSize, allocator);
+        mtb_intern_init(&shard->intern, &shard->arena);
+    }
 }
 
 func void
-_test_mtb_str_to_upper(MtbArena arena)
+mtb_cintern_deinit(MtbCintern *cintern)
 {
-    assert(mtb_str_is_equal(mtb_str_to_upper(&arena, mtb_str_empty()), mtb_str_empty()));
-    assert(mtb_str_is_equal(mtb_str_to_upper(&arena, mtb_str_lit("Hello, World!")), mtb_str_lit("HELLO, WORLD!")));
+    for (u64 i = 0; i < cintern->shardCount; i++) {
+        MtbCinternShard *shard = cintern->shards + i;
+        mtx_destroy(&shard->lock);
+        mtb_arena_deinit(&shard->arena);
+    }
+    cintern->shardCount = 0;
+    cintern->shards = nil;
 }
 
-func void
-_test_mtb_str_dup(MtbArena arena)
+func u64
+mtb_cintern_count(MtbCintern *cintern)
+{
+    u64 count = 0;
+    for (u64 i = 0; i < cintern->shardCount; i++) {
+        MtbCinternShard *shard = cintern->shards + i;
+        mtx_lock(&shard->lock);
+        count += mtb_intern_count(&shard->intern);
+        mtx_unlock(&shard->lock);
+    }
+    return count;
+}
+
+func MtbSym
+mtb_cintern(MtbCintern *cintern, MtbStr str)
 {
-    MtbStr o1 = mtb_str_empty();
-    MtbStr a1 = mtb_str_dup(&arena, o1);
-    assert(mtb_str_is_empty(a1));
-    assert(mtb_str_is_equal(o1, a1));
+    u64 hash = mtb_str_hash(str);
+    MtbCinternShard *shard = _mtb_cintern_shard_of(cintern, hash);
+    mtx_lock(&shard->lock);
+    MtbSym sym = mtb_intern_hashed(&shard->intern, str, hash);
+    mtx_unlock(&shard->lock);
+    mtb_assert_always(sym < MTB_SYM_NONE >> cintern->shardBits);
+    return (sym << cintern->shardBits) | (MtbSym)(shard - cintern->shards);
+}
 
-    MtbStr o2 = mtb_str_lit("Duplicate Me!");
-    MtbStr a2 = mtb_str_dup(&arena, o2);
-    assert(o2.bytes != a2.bytes);
-    assert(mtb_str_is_equal(o2, a2));
+func MtbSym
+mtb_cintern_find(MtbCintern *cintern, MtbStr str)
+{
+    u64 hash = mtb_str_hash(str);
+    MtbCinternShard *shard = _mtb_cintern_shard_of(cintern, hash);
+    mtx_lock(&shard->lock);
+    MtbSym *sym = mtb_hmap_get_hashed(&shard->intern.hmap, &str, hash);
+    MtbSym result = sym == nil ? MTB_SYM_NONE : (*sym << cintern->shardBits) | (MtbSym)(shard - cintern->shards);
+    mtx_unlock(&shard->lock);
+    return result;
 }
 
-func void
-_test_mtb_str_cat(MtbArena arena)
+func MtbStr
+mtb_cintern_str(MtbCintern *cintern, MtbSym sym)
 {
-    MtbStr e1 = mtb_str_empty();
-    MtbStr a1 = mtb_str_cat(&arena, mtb_str_empty(), mtb_str_empty());
-    assert(mtb_str_is_equal(e1, a1));
+    MtbCinternShard *shard = cintern->shards + (sym & (cintern->shardCount - 1));
+    mtx_lock(&shard->lock);
+    MtbStr str = mtb_intern_str(&shard->intern, sym >> cintern->shardBits);
+    mtx_unlock(&shard->lock);
+    return str;
+}
 
-    MtbStr e2 = mtb_str_lit("abcd");
-    MtbStr a2 = mtb_str_cat(&arena, mtb_str_lit("abcd"), mtb_str_empty());
-    assert(mtb_str_is_equal(e2, a2));
+#endif // MTB_INTERN_IMPLEMENTATION
 
-    MtbStr e3 = mtb_str_lit("abcd");
-    MtbStr a3 = mtb_str_cat(&arena, mtb_str_empty(), mtb_str_lit("abcd"));
-    assert(mtb_str_is_equal(e3, a3));
 
-    MtbStr e4 = mtb_str_lit("abcd1234");
-    MtbStr a4 = mtb_str_cat(&arena, mtb_str_lit("abcd"), mtb_str_lit("1234"));
-    assert(mtb_str_is_equal(e4, a4));
-}
+
+
+#ifdef MTB_INTERN_TESTS
+
+#include <assert.h>
+
 
 func void
-_test_mtb_str_substr(void)
-{
-    MtbStr s = mtb_str_lit("Hello, World!");
-    assert(mtb_str_is_equal(mtb_str_substr(s, 0, s.length), mtb_str_lit("Hello, World!")));
-    assert(mtb_str_is_equal(mtb_str_substr(s, 0, 5), mtb_str_lit("Hello")));
-    assert(mtb_str_is_equal(mtb_str_substr(s, 7, s.length), mtb_str_lit("World!")));
-    assert(mtb_str_is_equal(mtb_str_substr(s, 0, 0), mtb_str_empty()));
-    assert(mtb_str_is_equal(mtb_str_substr(s, s.length, s.length), mtb_str_empty()));
+_test_mtb_intern_basic(MtbArena *arena)
+{
+    mtb_arena_temp_scope(arena);
+    MtbIntern intern = {0};
+    mtb_intern_init(&intern, arena);
+
+    char buffer[] = "hello";
+    MtbSym hello = mtb_intern(&intern, mtb_str((u8 *)buffer, 5));
+    MtbSym world = mtb_intern_lit(&intern, "world");
+    MtbSym empty = mtb_intern_lit(&intern, "");
+    assert(hello == 0 && world == 1 && empty == 2);
+    assert(mtb_intern_count(&intern) == 3);
+
+    // the interner keeps its own copy
+    buffer[0] = 'j';
+    assert(mtb_intern_lit(&intern, "hello") == hello);
+    assert(mtb_intern_find(&intern, mtb_str_lit("jello")) == MTB_SYM_NONE);
+    assert(mtb_intern_lit(&intern, "jello") == 3);
+    assert(mtb_intern_find(&intern, mtb_str_lit("jello")) == 3);
+
+    MtbStr str = mtb_intern_str(&intern, hello);
+    assert(mtb_str_is_equal_lit(str, "hello"));
+    assert(strcmp(str.chars, "hello") == 0);
+    assert(str.bytes != (u8 *)buffer);
+    assert(mtb_intern_str(&intern, mtb_intern(&intern, mtb_str_from_cstr("hello"))).bytes == str.bytes);
+    assert(mtb_str_is_empty(mtb_intern_str(&intern, empty)));
+    assert(strcmp(mtb_intern_str(&intern, empty).chars, "") == 0);
+    assert(mtb_intern_count(&intern) == 4);
 }
 
 func void
-_test_mtb_str_prefix()
+_test_mtb_intern_many(MtbArena *arena)
+{
+    mtb_arena_temp_scope(arena);
+    MtbIntern intern = {0};
+    mtb_intern_init(&intern, arena);
+
+    u64 n = 10000;
+    for (u64 round = 0; round < 2; round++) {
+        for (u64 i = 0; i < n; i++) {
+            char buffer[32];
+            i32 length = snprintf(buffer, sizeof(buffer), "sym%lu", i);
+            assert(mtb_intern(&intern, mtb_str((u8 *)buffer, (u64)length)) == i);
+        }
+    }
+    assert(mtb_intern_count(&intern) == n);
+    for (u64 i = 0; i < n; i++) {
+        char expected[32];
+        snprintf(expected, sizeof(expected), "sym%lu", i);
+        assert(strcmp(mtb_intern_str(&intern, (MtbSym)i).chars, expected) == 0);
+    }
+}
+
+typedef struct _test_mtb_cintern_worker _TestMtbCinternWorker;
+struct _test_mtb_cintern_worker
 {
-    assert(mtb_str_is_equal(mtb_str_prefix(mtb_str_empty(), 0), mtb_str_empty()));
-    assert(mtb_str_is_equal(mtb_str_prefix(mtb_str_lit("Hello, World!"), 0), mtb_str_empty()));
-    assert(mtb_str_is_equal(mtb_str_prefix(mtb_str_lit("Hello, World!"), 5), mtb_str_lit("Hello")));
-    assert(mtb_str_is_equal(mtb_str_prefix(mtb_str_lit("Hello, World!"), 13), mtb_str_lit("Hello, World!")));
+    MtbCintern *cintern;
+    u64 offset;
+    MtbSym syms[1000];
+};
+
+func int
+_test_mtb_cintern_worker_run(void *arg)
+{
+    _TestMtbCinternWorker *worker = arg;
+    for (u64 i = 0; i < mtb_countof(worker->syms); i++) {
+        u64 k = (i + worker->offset) % mtb_countof(worker->syms); // same strings, different order
+        char buffer[32];
+        i32 length = snprintf(buffer, sizeof(buffer), "sym%lu", k);
+        worker->syms[k] = mtb_cintern(worker->cintern, mtb_str((u8 *)buffer, (u64)length));
+    }
+    return 0;
 }
 
 func void
-_test_mtb_str_suffix()
+_test_mtb_cintern_threads(MtbArena *arena)
 {
-    assert(mtb_str_is_equal(mtb_str_suffix(mtb_str_empty(), 0), mtb_str_empty()));
-    assert(mtb_str_is_equal(mtb_str_suffix(mtb_str_lit("Hello, World!"), 0), mtb_str_empty()));
-    assert(mtb_str_is_equal(mtb_str_suffix(mtb_str_lit("Hello, World!"), 6), mtb_str_lit("World!")));
-    assert(mtb_str_is_equal(mtb_str_suffix(mtb_str_lit("Hello, World!"), 13), mtb_str_lit("Hello, World!")));
+    mtb_arena_temp_scope(arena);
+    MtbCintern cintern = {0};
+    mtb_cintern_init(&cintern, arena, .shardCount = 4, .shardArenaSize = kb(256));
+
+    thrd_t threads[4];
+    _TestMtbCinternWorker *workers = mtb_arena_bump(arena, _TestMtbCinternWorker, mtb_countof(threads));
+    for (u64 i = 0; i < mtb_countof(threads); i++) {
+        workers[i] = (_TestMtbCinternWorker){ .cintern = &cintern, .offset = i * 250 };
+        assert(thrd_create(&threads[i], _test_mtb_cintern_worker_run, &workers[i]) == thrd_success);
+    }
+    for (u64 i = 0; i < mtb_countof(threads); i++) {
+        assert(thrd_join(threads[i], nil) == thrd_success);
+    }
+
+    assert(mtb_cintern_count(&cintern) == 1000);
+    for (u64 k = 0; k < 1000; k++) {
+        MtbSym sym = workers[0].syms[k];
+        for (u64 i = 1; i < mtb_countof(threads); i++) {
+            assert(workers[i].syms[k] == sym);
+        }
+        char expected[32];
+        snprintf(expected, sizeof(expected), "sym%lu", k);
+        assert(strcmp(mtb_cintern_str(&cintern, sym).chars, expected) == 0);
+        assert(mtb_cintern_find(&cintern, mtb_str_from_cstr(expected)) == sym);
+    }
+    assert(mtb_cintern_find(&cintern, mtb_str_lit("sym1000")) == MTB_SYM_NONE);
+
+    mtb_cintern_deinit(&cintern);
 }
 
 func void
-_test_mtb_str_join(MtbArena arena)
+_test_mtb_intern(void)
 {
-    MtbStrList list = {0};
-    mtb_str_list_init(&arena, &list);
-
-    char *e1 = "";
-    MtbStr a1 = mtb_str_join_char(&list, ' ');
-    assert(a1.length == strlen(e1));
-    assert(strncmp(a1.chars, e1, a1.length) == 0);
-    mtb_str_list_clear(&list);
+    MtbArena arena = {0};
+    mtb_arena_init(&arena, mb(4), &MTB_ARENA_DEF_ALLOCATOR);
 
-    char *e2 = "HI";
-    mtb_str_list_prepend_lit(&list, "HI");
-    MtbStr a2 = mtb_str_join_char(&list, ' ');
-    assert(a2.length == strlen(e2));
-    assert(strncmp(a2.chars, e2, a2.length) == 0);
-    mtb_str_list_clear(&list);
+    _test_mtb_intern_basic(&arena);
+    _test_mtb_intern_many(&arena);
+    _test_mtb_cintern_threads(&arena);
 
-    char *e3 = "HELLO MY DEAR WORLD !";
-    mtb_str_list_prepend_lit(&list, "DEAR");
-    mtb_str_list_prepend_lit(&list, "MY");
-    mtb_str_list_prepend_lit(&list, "HELLO");
-    mtb_str_list_append_lit(&list, "WORLD");
-    mtb_str_list_append_lit(&list, "!");
-    MtbStr a3 = mtb_str_join_char(&list, ' ');
-    assert(a3.length == strlen(e3));
-    assert(strncmp(a3.chars, e3, a3.length) == 0);
-    mtb_str_list_clear(&list);
+    mtb_arena_deinit(&arena);
+}
 
-    char *e4 = "HELLO!";
-    mtb_str_list_append_lit(&list, "!");
-    mtb_str_list_prepend_lit(&list, "HELLO");
-    MtbStr a4 = mtb_str_join_lit(&list, "");
-    assert(a4.length == strlen(e4));
-    assert(strncmp(a4.chars, e4, a4.length) == 0);
-    mtb_str_list_clear(&list);
+#endif // MTB_INTERN_TESTS
 
-    char *e5 = "100! 0.12345?";
-    mtb_str_list_appendf(&list, "%.5f?", 0.123451f);
-    mtb_str_list_prependf(&list, "%d!", 100);
-    MtbStr a5 = mtb_str_join_char(&list, ' ');
-    assert(a5.length == strlen(e5));
-    assert(strncmp(a5.chars, e5, a5.length) == 0);
-    mtb_str_list_clear(&list);
 
-    char *e6 = ",,";
-    mtb_str_list_append_lit(&list, "");
-    mtb_str_list_append_lit(&list, "");
-    mtb_str_list_append_lit(&list, "");
-    MtbStr a6 = mtb_str_join_char(&list, ',');
-    assert(a6.length == strlen(e6));
-    assert(strncmp(a6.chars, e6, a6.length) == 0);
-    mtb_str_list_clear(&list);
+#ifdef MTB_INTERN_BENCH
 
-    char *e7 = "";
-    mtb_str_list_append_lit(&list, "");
-    mtb_str_list_append_lit(&list, "");
-    mtb_str_list_append_lit(&list, "");
-    MtbStr a7 = mtb_str_join_char(&list, ',', .skipEmpty = true);
-    assert(a7.length == strlen(e7));
-    assert(strncmp(a7.chars, e7, a7.length) == 0);
-    mtb_str_list_clear(&list);
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
 
-    assert(mtb_str_list_is_empty(&list));
-}
 
 func void
-_test_mtb_str_split(MtbArena arena)
+_bench_mtb_intern_keywords(MtbArena *arena, MtbDynArr *tokens)
 {
-    MtbStrList list = {0};
-    mtb_str_list_init(&arena, &list);
+    mtb_arena_temp_scope(arena);
+    u64 rounds = 8;
 
-    MtbStr s1 = mtb_str_empty();
-    mtb_str_split_char(&list, s1, ',');
-    assert(mtb_str_list_is_empty(&list));
-    mtb_str_list_clear(&list);
+    MtbIntern intern = {0};
+    mtb_intern_init(&intern, arena);
 
-    MtbStr s2 = mtb_str_lit("A,B,C,D,E");
-    MtbStr e2[] = { mtb_str_lit("A"), mtb_str_lit("B"), mtb_str_lit("C"), mtb_str_lit("D"), mtb_str_lit("E") };
-    mtb_str_split_char(&list, s2, ',');
-    i32 i2 = 0;
-    mtb_list_foreach(&list.node, n) {
-        MtbStrList *node = mtb_containerof(n, MtbStrList, node);
-        assert(mtb_str_is_equal(*node->str, e2[i2++]));
+    u64 beg = mtb_perf_sys_time();
+    MtbSym *syms = mtb_arena_bump(arena, MtbSym, tokens->length);
+    for (u64 i = 0; i < tokens->length; i++) {
+        syms[i] = mtb_intern(&intern, *(MtbStr *)mtb_dynarr_get(tokens, i));
     }
-    mtb_str_list_clear(&list);
+    u64 internTime = mtb_perf_sys_time() - beg;
 
-    MtbStr s3 = mtb_str_lit("A,B,C,D,E");
-    MtbStr e3[] = { mtb_str_lit("A,B,C,D,E") };
-    mtb_str_split_lit(&list, s3, " ");
-    i32 i3 = 0;
-    mtb_list_foreach(&list.node, n) {
-        MtbStrList *node = mtb_containerof(n, MtbStrList, node);
-        assert(mtb_str_is_equal(*node->str, e3[i3++]));
+    // a parser checking every token against its keywords, the most frequent words of the corpus stand in for them
+    u64 *freqs = mtb_arena_bump(arena, u64, mtb_intern_count(&intern) + 1);
+    for (u64 i = 0; i < tokens->length; i++) {
+        freqs[syms[i]]++;
+    }
+    char *keywords[16];
+    MtbSym keywordSyms[mtb_countof(keywords)];
+    u64 keywordCount = mtb_min_u64(mtb_countof(keywords), mtb_intern_count(&intern));
+    for (u64 k = 0; k < keywordCount; k++) {
+        MtbSym top = 0;
+        for (MtbSym s = 1; s < mtb_intern_count(&intern); s++) {
+            if (freqs[s] > freqs[top]) {
+                top = s;
+            }
+        }
+        freqs[top] = 0;
+        keywordSyms[k] = top;
+        keywords[k] = mtb_intern_str(&intern, top).chars;
     }
-    mtb_str_list_clear(&list);
 
-    MtbStr s4 = mtb_str_lit("A,B,C,D,E");
-    MtbStr e4[] = { mtb_str_lit("A,B,C,D,E") };
-    mtb_str_split(&list, s4, mtb_str_empty());
-    i32 i4 = 0;
-    mtb_list_foreach(&list.node, n) {
-        MtbStrList *node = mtb_containerof(n, MtbStrList, node);
-        assert(mtb_str_is_equal(*node->str, e4[i4++]));
+    u64 strCount = 0;
+    beg = mtb_perf_sys_time();
+    for (u64 r = 0; r < rounds; r++) {
+        for (u64 i = 0; i < tokens->length; i++) {
+            MtbStr token = *(MtbStr *)mtb_dynarr_get(tokens, i);
+            for (u64 k = 0; k < keywordCount; k++) {
+                if (mtb_str_is_equal_cstr(token, keywords[k])) {
+                    strCount++;
+                    break;
+                }
+            }
+        }
     }
-    mtb_str_list_clear(&list);
+    u64 strTime = mtb_perf_sys_time() - beg;
+
+    u64 symCount = 0;
+    beg = mtb_perf_sys_time();
+    for (u64 r = 0; r < rounds; r++) {
+        for (u64 i = 0; i < tokens->length; i++) {
+            for (u64 k = 0; k < keywordCount; k++) {
+                if (syms[i] == keywordSyms[k]) {
+                    symCount++;
+                    break;
+                }
+            }
+        }
+    }
+    u64 symTime = mtb_perf_sys_time() - beg;
+    assert(strCount == symCount);
 
-    MtbStr s5 = mtb_str_lit(",,");
-    MtbStr e5[] = { mtb_str_empty(), mtb_str_empty(), mtb_str_empty() };
-    mtb_str_split_char(&list, s5, ',');
-    i32 i5 = 0;
-    mtb_list_foreach(&list.node, n) {
-        MtbStrList *node = mtb_containerof(n, MtbStrList, node);
-        assert(mtb_str_is_equal(*node->str, e5[i5++]));
+    f64 ms = 1000.0 / (f64)mtb_perf_sys_freq();
+    printf("%lu tokens, %lu distinct: intern %.1f ms, keyword matching x%lu w/ mtb_str_is_equal_cstr %.1f ms, w/ symbols %.1f ms\n",
+           tokens->length,
+           mtb_intern_count(&intern),
+           (f64)internTime * ms,
+           rounds,
+           (f64)strTime * ms,
+           (f64)symTime * ms);
+}
+
+typedef struct _bench_mtb_cintern_worker _BenchMtbCinternWorker;
+struct _bench_mtb_cintern_worker
+{
+    MtbCintern *cintern;
+    MtbStr *tokens;
+    u64 count;
+};
+
+func int
+_bench_mtb_cintern_worker_run(void *arg)
+{
+    _BenchMtbCinternWorker *worker = arg;
+    for (u64 i = 0; i < worker->count; i++) {
+        mtb_cintern(worker->cintern, worker->tokens[i]);
     }
-    mtb_str_list_clear(&list);
+    return 0;
+}
 
-    MtbStr s6 = mtb_str_lit(",,");
-    mtb_str_split_char(&list, s6, ',', .skipEmpty = true);
-    assert(mtb_str_list_is_empty(&list));
-    mtb_str_list_clear(&list);
+func void
+_bench_mtb_cintern(MtbArena *arena, MtbDynArr *tokens, u64 threadCount)
+{
+    mtb_arena_temp_scope(arena);
+    MtbCintern cintern = {0};
+    mtb_cintern_init(&cintern, arena, .shardArenaSize = mb(8));
+
+    thrd_t *threads = mtb_arena_bump(arena, thrd_t, threadCount);
+    _BenchMtbCinternWorker *workers = mtb_arena_bump(arena, _BenchMtbCinternWorker, threadCount);
+
+    u64 beg = mtb_perf_sys_time();
+    for (u64 i = 0; i < threadCount; i++) {
+        u64 tokensBeg = i * tokens->length / threadCount;
+        u64 tokensEnd = (i + 1) * tokens->length / threadCount;
+        workers[i] = (_BenchMtbCinternWorker){
+            .cintern = &cintern,
+            .tokens = mtb_dynarr_get(tokens, tokensBeg),
+            .count = tokensEnd - tokensBeg,
+        };
+        mtb_assert_always(thrd_create(&threads[i], _bench_mtb_cintern_worker_run, &workers[i]) == thrd_success);
+    }
+    for (u64 i = 0; i < threadCount; i++) {
+        mtb_assert_always(thrd_join(threads[i], nil) == thrd_success);
+    }
+    u64 elapsed = mtb_perf_sys_time() - beg;
 
-    assert(mtb_str_list_is_empty(&list));
+    f64 seconds = (f64)elapsed / (f64)mtb_perf_sys_freq();
+    printf("%lu threads: %.3f s, %.2f M tokens/s\n", threadCount, seconds, (f64)tokens->length / seconds / 1e6);
+
+    mtb_cintern_deinit(&cintern);
 }
 
 func void
-_test_mtb_string(void)
+_bench_mtb_intern(MtbDynArr *tokens)
 {
     MtbArena arena = {0};
-    mtb_arena_init(&arena, kb(1), &MTB_ARENA_DEF_ALLOCATOR);
+    mtb_arena_init(&arena, mb(128), &MTB_ARENA_DEF_ALLOCATOR);
 
-    _test_mtb_str_cstr(arena);
-    _test_mtb_str_sprintf(arena);
-    _test_mtb_str_cmp();
-    _test_mtb_str_find();
-    _test_mtb_str_has_prefix();
-    _test_mtb_str_has_suffix();
-    _test_mtb_str_trim();
-    _test_mtb_str_skip();
-    _test_mtb_str_chop();
-    _test_mtb_str_to_lower(arena);
-    _test_mtb_str_to_upper(arena);
-    _test_mtb_str_dup(arena);
-    _test_mtb_str_cat(arena);
-    _test_mtb_str_substr();
-    _test_mtb_str_prefix();
-    _test_mtb_str_suffix();
-    _test_mtb_str_join(arena);
-    _test_mtb_str_split(arena);
+    printf("== interning ==\n");
+    _bench_mtb_intern_keywords(&arena, tokens);
+
+    u64 cpuCount = (u64)sysconf(_SC_NPROCESSORS_ONLN);
+    printf("== interning, sharded concurrent interner ==\n");
+    for (u64 threadCount = 1; threadCount <= cpuCount; threadCount <<= 1) {
+        _bench_mtb_cintern(&arena, tokens, threadCount);
+    }
 
     mtb_arena_deinit(&arena);
 }
 
-#endif // MTB_STRING_TESTS
+#endif // MTB_INTERN_BENCH
 
 #endif //MTB_H
@@ -18,6 +18,18 @@ struct mtb_arena_allocator
     void *ctx;                                      /* custom context */
     void *(*alloc)(void *ctx, void *ptr, u64 size); /* allocate if size > 0, free otherwise */
     u64 (*size)(void *ctx, void *ptr);              /* return allocation size */
+    /* optional, makes [ptr, ptr + size) usable past the committed bytes and returns the new committed size */
+    u64 (*commit)(void *ctx, void *ptr, u64 committed, u64 size);
+    /* optional, returns the pages past ptr + size to the OS and returns where they start from ptr,
+       past it memory is uncommitted w/ a commit hook, zero filled otherwise */
+    u64 (*decommit)(void *ctx, void *ptr, u64 committed, u64 size);
+    bool zeroed; /* fresh allocations read as zeros, e.g. mmap */
+    /* optional w/ zeroed, a u64 kept next to the allocation where the arena and its copies share
+       the high-water mark of the bytes handed out, single block arenas zero every bump without it */
+    u64 *(*mark)(void *ctx, void *ptr);
+    /* required w/ commit, a u64 kept next to the allocation where the arena and its copies share
+       the committed size */
+    u64 *(*commitMark)(void *ctx, void *ptr);
 };
 
 func u64 mtb_arena_def_size(void *ctx, void *ptr);
@@ -25,6 +37,17 @@ func void *mtb_arena_def_alloc(void *ctx, void *ptr, u64 size);
 
 func u64 mtb_arena_def_virt_size(void *ctx, void *ptr);
 func void *mtb_arena_def_virt_alloc(void *ctx, void *ptr, u64 size);
+func u64 mtb_arena_def_virt_decommit(void *ctx, void *ptr, u64 committed, u64 size);
+func u64 *mtb_arena_def_virt_mark(void *ctx, void *ptr);
+
+// Reserves the address space only, pages are committed in power of 2 chunks of *(u64 *)ctx bytes,
+// or MTB_ARENA_DEF_COMMIT_SIZE if ctx is nil, as the arena bumps past them.
+func u64 mtb_arena_def_reserve_size(void *ctx, void *ptr);
+func void *mtb_arena_def_reserve_alloc(void *ctx, void *ptr, u64 size);
+func u64 mtb_arena_def_reserve_commit(void *ctx, void *ptr, u64 committed, u64 size);
+func u64 mtb_arena_def_reserve_decommit(void *ctx, void *ptr, u64 committed, u64 size);
+func u64 *mtb_arena_def_reserve_mark(void *ctx, void *ptr);
+func u64 *mtb_arena_def_reserve_commit_mark(void *ctx, void *ptr);
 
 
 /* Arena */
@@ -33,13 +56,79 @@ func void *mtb_arena_def_virt_alloc(void *ctx, void *ptr, u64 size);
 #define MTB_ARENA_DEF_ALIGN sizeof(void *)
 #endif
 
+#ifndef MTB_ARENA_DEF_COMMIT_SIZE
+#define MTB_ARENA_DEF_COMMIT_SIZE mb(1) // a power of 2, at least the page size
+#endif
+
+#ifndef MTB_ARENA_DEF_RESERVE_SIZE
+#define MTB_ARENA_DEF_RESERVE_SIZE gb(64) // address space only, nothing is committed up front
+#endif
+
+#ifndef MTB_ARENA_DEF_MAX_BLOCK_SIZE
+#define MTB_ARENA_DEF_MAX_BLOCK_SIZE mb(64) // chained arenas stop doubling the block size here
+#endif
+
+typedef struct mtb_arena_block MtbArenaBlock;
+struct mtb_arena_block
+{
+    MtbArenaBlock *prev;
+    MtbArenaBlock *next;
+    u64 size;    // usable, past the header
+    u64 touched; // high-water mark, shared by the copies of the arena
+};
+
 typedef struct mtb_arena MtbArena;
 struct mtb_arena
 {
     u8 *base;
     u64 offset;
     u64 size;
+    u64 *committed; // usable bytes from base, shared by the copies of the arena, nil unless the allocator commits on demand
+    u64 *touched;  // high-water mark of the bytes handed out, past it memory is still zero, nil if every bump zeroes
     MtbArenaAllocator *allocator;
+
+    // chained arenas only, nil otherwise
+    MtbArenaBlock *first; // kept by clear
+    MtbArenaBlock *block; // the one base points into
+    MtbArenaBlock *cache; // released blocks kept for reuse (cacheBlocks)
+    u64 maxBlockSize;
+    bool cacheBlocks;
+
+    u64 tempDepth; // open temp scopes
+};
+
+// Saved position, see mtb_arena_temp_begin.
+typedef struct mtb_arena_temp MtbArenaTemp;
+struct mtb_arena_temp
+{
+    MtbArena *arena;
+    MtbArenaBlock *block; // nil w/ single block arenas
+    u64 offset;
+    u64 depth;
+};
+
+typedef struct mtb_arena_chain_options MtbArenaChainOptions;
+struct mtb_arena_chain_options
+{
+    u64 maxBlockSize; // every new block doubles the previous one up to this, MTB_ARENA_DEF_MAX_BLOCK_SIZE if 0
+    bool cacheBlocks; // clear keeps the chained blocks for reuse, instead of freeing them
+};
+
+typedef struct mtb_arena_clear_options MtbArenaClearOptions;
+struct mtb_arena_clear_options
+{
+    bool decommit; // return the pages past the new offset and keep to the OS, if the allocator can
+    u64 keep;      // high-water mark (from base) that stays resident
+};
+
+typedef struct mtb_arena_stats MtbArenaStats;
+struct mtb_arena_stats
+{
+    u64 offset;
+    u64 size;      // of every block w/ chained arenas, cached ones included
+    u64 committed; // of every block w/ chained arenas, cached ones included
+    u64 resident;  // of the committed bytes, rounded to pages (mincore)
+    u64 blocks;
 };
 
 typedef struct mtb_arena_bump_options MtbArenaBumpOptions;
@@ -50,6 +139,14 @@ struct mtb_arena_bump_options
 };
 
 func void mtb_arena_init(MtbArena *arena, u64 size, MtbArenaAllocator *allocator);
+// Reserves size bytes of address space and commits it as the arena grows, so the last allocation
+// can grow in place (mtb_arena_resize) and pointers stay stable, e.g. MtbDynArr and MtbHmap never relocate.
+func void mtb_arena_init_reserved(MtbArena *arena, u64 size);
+// Starts w/ a block of the given size and chains new blocks from the allocator when it's full,
+// instead of trapping. Blocks chained by a copy of the arena are not freed by the original.
+func void mtb_arena_init_chained_opt(MtbArena *arena, u64 size, MtbArenaAllocator *allocator, MtbArenaChainOptions opt);
+#define mtb_arena_init_chained(arena, size, allocator, ...) \
+    mtb_arena_init_chained_opt(arena, size, allocator, (MtbArenaChainOptions){ __VA_ARGS__ })
 func void mtb_arena_deinit(MtbArena *arena);
 
 func void *mtb_arena_bump_opt(MtbArena *arena, u64 size, MtbArenaBumpOptions opt);
@@ -58,7 +155,28 @@ func void *mtb_arena_bump_opt(MtbArena *arena, u64 size, MtbArenaBumpOptions opt
 #define mtb_arena_bump(arena, type, count, ...) \
     (type *)mtb_arena_bump_opt(arena, mtb_mul_u64(sizeof(type), (count)), (MtbArenaBumpOptions){ .align = mtb_alignof(type), __VA_ARGS__ })
 
-func void mtb_arena_clear(MtbArena *arena);
+func bool mtb_arena_resize(MtbArena *arena, void *ptr, u64 oldSize, u64 newSize); /* last allocation only, within its block */
+// Back to an earlier offset of the current block, e.g. a saved arena->offset.
+func void mtb_arena_rewind_opt(MtbArena *arena, u64 offset, MtbArenaClearOptions opt);
+#define mtb_arena_rewind(arena, offset, ...) \
+    mtb_arena_rewind_opt(arena, offset, (MtbArenaClearOptions){ __VA_ARGS__ })
+// Back to the first block, O(1) unless chained blocks are freed or pages are decommitted.
+// No temp scope may be open, MTB_DEBUG traps otherwise.
+func void mtb_arena_clear_opt(MtbArena *arena, MtbArenaClearOptions opt);
+#define mtb_arena_clear(arena, ...) \
+    mtb_arena_clear_opt(arena, (MtbArenaClearOptions){ __VA_ARGS__ })
+
+// Everything bumped between begin and end is released in O(1) at end, chained blocks included
+// (freed or cached like clear does). Scopes nest and must end in reverse order, MTB_DEBUG traps otherwise.
+func MtbArenaTemp mtb_arena_temp_begin(MtbArena *arena);
+func void mtb_arena_temp_end(MtbArenaTemp *temp);
+// Ends the scope when the enclosing block exits.
+#define _mtb_arena_temp_scope(arena, _t) \
+    MtbArenaTemp _t __attribute__((__cleanup__(mtb_arena_temp_end))) = mtb_arena_temp_begin(arena)
+#define mtb_arena_temp_scope(arena) _mtb_arena_temp_scope(arena, mtb_id(_t))
+
+func void mtb_arena_stats(MtbArena *arena, MtbArenaStats *stats);
+func void mtb_arena_stats_print(MtbArenaStats *stats, const char *name); // through the mtb_perf report format
 
 #endif //MTB_ARENA_H
 
@@ -72,6 +190,7 @@ func void mtb_arena_clear(MtbArena *arena);
 
 
 #define MTB_ARENA_DEF_ALLOCATOR_HEADER_SIZE sizeof(u64)
+#define MTB_ARENA_DEF_VIRT_HEADER_SIZE (2 * sizeof(u64)) // mark, size
 
 
 global MtbArenaAllocator MTB_ARENA_DEF_ALLOCATOR = {
@@ -84,6 +203,20 @@ global MtbArenaAllocator MTB_ARENA_DEF_VIRT_ALLOCATOR = {
     .ctx = nil,
     .alloc = mtb_arena_def_virt_alloc,
     .size = mtb_arena_def_virt_size,
+    .decommit = mtb_arena_def_virt_decommit,
+    .zeroed = true,
+    .mark = mtb_arena_def_virt_mark,
+};
+
+global MtbArenaAllocator MTB_ARENA_DEF_RESERVE_ALLOCATOR = {
+    .ctx = nil,
+    .alloc = mtb_arena_def_reserve_alloc,
+    .size = mtb_arena_def_reserve_size,
+    .commit = mtb_arena_def_reserve_commit,
+    .decommit = mtb_arena_def_reserve_decommit,
+    .zeroed = true,
+    .mark = mtb_arena_def_reserve_mark,
+    .commitMark = mtb_arena_def_reserve_commit_mark,
 };
 
 
@@ -144,44 +277,267 @@ mtb_arena_def_virt_alloc(void *ctx, void *ptr, u64 size)
     if (size == 0) {
         mtb_assert_always(base != nil);
         u64 allocSize = mtb_arena_def_virt_size(ctx, base);
-        mtb_assert(munmap(base - headerSize - pageSize, allocSize) == 0);
+        mtb_assert(munmap(base - MTB_ARENA_DEF_VIRT_HEADER_SIZE - pageSize, allocSize) == 0);
         return nil;
     }
 
     mtb_assert_always(base == nil);
 
     // Allocate enough memory to fit: arena, header, 2 guard pages.
-    u64 sizeWithHeader = mtb_add_u64(size, headerSize);
+    u64 sizeWithHeader = mtb_add_u64(size, MTB_ARENA_DEF_VIRT_HEADER_SIZE);
     u64 sizeWithHeaderAligned = mtb_align_pow2(sizeWithHeader, pageSize);
     u64 allocSize = mtb_add_u64(sizeWithHeaderAligned, 2 * pageSize);
     u8 *mmapAddr = (u8 *)mmap(nil, allocSize, PROT_NONE, MAP_ANON | MAP_PRIVATE, -1, 0);
     mtb_assert(mmapAddr != MAP_FAILED);
 
-    u64 *header = (u64 *)(mmapAddr + pageSize);
-    mtb_assert(mprotect(header, sizeWithHeaderAligned, PROT_READ | PROT_WRITE) == 0);
+    u8 *headerAddr = mmapAddr + pageSize;
+    mtb_assert(mprotect(headerAddr, sizeWithHeaderAligned, PROT_READ | PROT_WRITE) == 0);
+    u64 *header = (u64 *)(headerAddr + MTB_ARENA_DEF_VIRT_HEADER_SIZE - headerSize);
     *header = allocSize;
 
     return header + 1;
 }
 
+// Stays committed, the pages are zero filled on the next touch.
+func u64
+mtb_arena_def_virt_decommit(void *ctx, void *ptr, u64 committed, u64 size)
+{
+    u8 *base = (u8 *)ptr;
+    u64 pageSize = (u64)sysconf(_SC_PAGE_SIZE);
+
+    u8 *mmapAddr = base - MTB_ARENA_DEF_VIRT_HEADER_SIZE - pageSize;
+    u8 *end = mmapAddr + mtb_arena_def_virt_size(ctx, base) - pageSize; // before the guard page
+    u8 *beg = (u8 *)mtb_align_pow2((u64)(base + size), pageSize);
+    if (beg >= end) {
+        return (u64)(end - base);
+    }
+    // MADV_FREE would only drop the pages under memory pressure, so the RSS wouldn't go down
+    mtb_assert(madvise(beg, (u64)(end - beg), MADV_DONTNEED) == 0);
+    return (u64)(beg - base);
+}
+
+func u64 *
+mtb_arena_def_virt_mark(void *ctx, void *ptr)
+{
+    return (u64 *)((u8 *)ptr - MTB_ARENA_DEF_VIRT_HEADER_SIZE);
+}
+
+func u64
+mtb_arena_def_reserve_size(void *ctx, void *ptr)
+{
+    return mtb_arena_def_virt_size(ctx, ptr);
+}
+
+func void *
+mtb_arena_def_reserve_alloc(void *ctx, void *ptr, u64 size)
+{
+    u8 *base = (u8 *)ptr;
+    u64 headerSize = MTB_ARENA_DEF_ALLOCATOR_HEADER_SIZE;
+    u64 pageSize = (u64)sysconf(_SC_PAGE_SIZE);
+    mtb_assert(mtb_is_pow2(pageSize));
+
+    if (size == 0) {
+        mtb_assert_always(base != nil);
+        u64 allocSize = mtb_arena_def_reserve_size(ctx, base);
+        mtb_assert(munmap(base - pageSize, allocSize) == 0);
+        return nil;
+    }
+
+    mtb_assert_always(base == nil);
+
+    // Reserve: header page, arena, guard page. Only the header page is committed.
+    u64 sizeAligned = mtb_align_pow2(size, pageSize);
+    u64 allocSize = mtb_add_u64(sizeAligned, 2 * pageSize);
+    u8 *mmapAddr = (u8 *)mmap(nil, allocSize, PROT_NONE, MAP_ANON | MAP_PRIVATE | MAP_NORESERVE, -1, 0);
+    mtb_assert(mmapAddr != MAP_FAILED);
+    mtb_assert(mprotect(mmapAddr, pageSize, PROT_READ | PROT_WRITE) == 0);
+
+    u8 *result = mmapAddr + pageSize;
+    u64 *header = (u64 *)(result - headerSize);
+    *header = allocSize;
+
+    return result;
+}
+
+func u64
+mtb_arena_def_reserve_commit(void *ctx, void *ptr, u64 committed, u64 size)
+{
+    u8 *base = (u8 *)ptr;
+    u64 pageSize = (u64)sysconf(_SC_PAGE_SIZE);
+    u64 chunkSize = ctx != nil ? *(u64 *)ctx : MTB_ARENA_DEF_COMMIT_SIZE;
+    mtb_assert_always(mtb_is_pow2(chunkSize) && chunkSize >= pageSize);
+
+    u64 reserved = mtb_arena_def_reserve_size(ctx, base) - 2 * pageSize;
+    u64 newCommitted = mtb_min_u64(mtb_align_pow2(size, chunkSize), reserved);
+    if (newCommitted > committed) {
+        mtb_assert(mprotect(base + committed, newCommitted - committed, PROT_READ | PROT_WRITE) == 0);
+    }
+    return newCommitted;
+}
+
+func u64
+mtb_arena_def_reserve_decommit(void *ctx, void *ptr, u64 committed, u64 size)
+{
+    u8 *base = (u8 *)ptr;
+    u64 chunkSize = ctx != nil ? *(u64 *)ctx : MTB_ARENA_DEF_COMMIT_SIZE;
+
+    u64 newCommitted = mtb_align_pow2(size, chunkSize);
+    if (newCommitted < committed) {
+        mtb_assert(madvise(base + newCommitted, committed - newCommitted, MADV_DONTNEED) == 0);
+        mtb_assert(mprotect(base + newCommitted, committed - newCommitted, PROT_NONE) == 0);
+        return newCommitted;
+    }
+    return committed;
+}
+
+// In the header page, like the size.
+func u64 *
+mtb_arena_def_reserve_mark(void *ctx, void *ptr)
+{
+    return mtb_arena_def_virt_mark(ctx, ptr);
+}
+
+// In the header page, before the mark.
+func u64 *
+mtb_arena_def_reserve_commit_mark(void *ctx, void *ptr)
+{
+    return mtb_arena_def_reserve_mark(ctx, ptr) - 1;
+}
+
 func void
 mtb_arena_init(MtbArena *arena, u64 size, MtbArenaAllocator *allocator)
 {
+    *arena = (MtbArena){0};
     arena->allocator = allocator;
     arena->base = allocator->alloc(allocator->ctx, nil, size);
     arena->offset = 0;
     arena->size = size;
+    if (allocator->commit != nil) {
+        arena->committed = allocator->commitMark(allocator->ctx, arena->base);
+        *arena->committed = 0;
+    }
+    if (allocator->zeroed && allocator->mark != nil) {
+        arena->touched = allocator->mark(allocator->ctx, arena->base);
+        *arena->touched = 0;
+    }
+}
+
+func void
+mtb_arena_init_reserved(MtbArena *arena, u64 size)
+{
+    mtb_arena_init(arena, size == 0 ? MTB_ARENA_DEF_RESERVE_SIZE : size, &MTB_ARENA_DEF_RESERVE_ALLOCATOR);
+}
+
+func void
+_mtb_arena_commit(MtbArena *arena, u64 offset)
+{
+    if (arena->committed != nil && offset > *arena->committed) {
+        MtbArenaAllocator *allocator = arena->allocator;
+        *arena->committed = allocator->commit(allocator->ctx, arena->base, *arena->committed, offset);
+        mtb_assert_always(*arena->committed >= offset);
+    }
+}
+
+func void
+_mtb_arena_use_block(MtbArena *arena, MtbArenaBlock *block)
+{
+    arena->block = block;
+    arena->base = (u8 *)(block + 1);
+    arena->offset = 0;
+    arena->size = block->size;
+    arena->committed = nil;
+    arena->touched = &block->touched;
+}
+
+func u64
+_mtb_arena_committed(MtbArena *arena)
+{
+    return arena->committed != nil ? *arena->committed : arena->size;
+}
+
+// Bytes past it are still zero.
+func u64
+_mtb_arena_touched(MtbArena *arena)
+{
+    return arena->touched != nil ? *arena->touched : arena->size;
+}
+
+func void
+_mtb_arena_touch(MtbArena *arena, u64 offset)
+{
+    if (arena->touched != nil && offset > *arena->touched) {
+        *arena->touched = offset;
+    }
+}
+
+func MtbArenaBlock *
+_mtb_arena_alloc_block(MtbArena *arena, u64 size)
+{
+    MtbArenaAllocator *allocator = arena->allocator;
+    MtbArenaBlock *block = allocator->alloc(allocator->ctx, nil, mtb_add_u64(sizeof(MtbArenaBlock), size));
+    block->prev = nil;
+    block->next = nil;
+    block->size = size;
+    block->touched = allocator->zeroed ? 0 : size;
+    return block;
+}
+
+func void
+_mtb_arena_free_blocks(MtbArena *arena, MtbArenaBlock *block) // and every one before it
+{
+    MtbArenaAllocator *allocator = arena->allocator;
+    while (block != nil) {
+        MtbArenaBlock *prev = block->prev;
+        allocator->alloc(allocator->ctx, block, 0);
+        block = prev;
+    }
+}
+
+// Makes room for size more bytes in a new block, from the cache if the most recent one fits.
+func void
+_mtb_arena_chain(MtbArena *arena, u64 size)
+{
+    MtbArenaBlock *block = arena->cache;
+    bool fresh = block == nil || block->size < size;
+    if (!fresh) {
+        arena->cache = block->prev; // keeps its mark, only what was handed out is zeroed again
+    }
+    else {
+        u64 blockSize = mtb_max_u64(mtb_min_u64(mtb_mul_u64(arena->block->size, 2), arena->maxBlockSize), size);
+        block = _mtb_arena_alloc_block(arena, blockSize);
+    }
+    block->prev = arena->block;
+    block->next = nil;
+    arena->block->next = block;
+    _mtb_arena_use_block(arena, block);
+}
+
+func void
+mtb_arena_init_chained_opt(MtbArena *arena, u64 size, MtbArenaAllocator *allocator, MtbArenaChainOptions opt)
+{
+    mtb_assert_always(size > 0);
+    mtb_assert_always(allocator->commit == nil); // blocks are committed whole
+
+    *arena = (MtbArena){0};
+    arena->allocator = allocator;
+    arena->maxBlockSize = opt.maxBlockSize == 0 ? MTB_ARENA_DEF_MAX_BLOCK_SIZE : opt.maxBlockSize;
+    arena->cacheBlocks = opt.cacheBlocks;
+    arena->first = _mtb_arena_alloc_block(arena, size);
+    _mtb_arena_use_block(arena, arena->first);
 }
 
 func void
 mtb_arena_deinit(MtbArena *arena)
 {
     MtbArenaAllocator *allocator = arena->allocator;
-    allocator->alloc(allocator->ctx, arena->base, 0);
-    arena->base = nil;
-    arena->offset = 0;
-    arena->size = 0;
-    arena->allocator = nil;
+    if (arena->first != nil) {
+        _mtb_arena_free_blocks(arena, arena->block);
+        _mtb_arena_free_blocks(arena, arena->cache);
+    }
+    else {
+        allocator->alloc(allocator->ctx, arena->base, 0);
+    }
+    *arena = (MtbArena){0};
 }
 
 func void *
@@ -195,18 +551,186 @@ mtb_arena_bump_opt(MtbArena *arena, u64 size, MtbArenaBumpOptions opt)
     u64 padding = mtb_align_padding_pow2((u64)(arena->base + oldOffset), align);
     u64 oldOffsetAligned = mtb_add_u64(oldOffset, padding);
     u64 newOffset = mtb_add_u64(oldOffsetAligned, size);
-    mtb_assert_always(newOffset <= arena->size);
+    if (newOffset > arena->size) {
+        mtb_assert_always(arena->first != nil); // a single block arena is full
+        _mtb_arena_chain(arena, mtb_add_u64(size, align));
+        return mtb_arena_bump_opt(arena, size, opt);
+    }
+    _mtb_arena_commit(arena, newOffset);
     arena->offset = newOffset;
 
     u8 *result = arena->base + oldOffsetAligned;
+    u64 touched = _mtb_arena_touched(arena);
+    if (!opt.no_zero && oldOffsetAligned < touched) {
+        memset(result, 0, mtb_min_u64(newOffset, touched) - oldOffsetAligned); // the rest was never touched
+    }
+    _mtb_arena_touch(arena, newOffset);
+
+    return result;
+}
+
+func bool
+mtb_arena_resize(MtbArena *arena, void *ptr, u64 oldSize, u64 newSize)
+{
+    mtb_assert_always(newSize > 0);
+
+    u8 *oldEnd = (u8 *)ptr + oldSize;
+    if (oldEnd != arena->base + arena->offset) {
+        return false;
+    }
+    u64 newOffset = mtb_add_u64((u64)((u8 *)ptr - arena->base), newSize);
+    if (newOffset > arena->size) {
+        return false;
+    }
+    _mtb_arena_commit(arena, newOffset);
+    u64 touched = _mtb_arena_touched(arena);
+    if (arena->offset < touched && newOffset > arena->offset) {
+        memset(oldEnd, 0, mtb_min_u64(newOffset, touched) - arena->offset);
+    }
+    _mtb_arena_touch(arena, newOffset);
+    arena->offset = newOffset;
+    return true;
+}
+
+// Frees, or caches, every block after the given one and goes back to it.
+func void
+_mtb_arena_unchain(MtbArena *arena, MtbArenaBlock *keep)
+{
+    // the chain is keep <-> next <-> ... <-> block
+    MtbArenaBlock *next = keep->next;
+    keep->next = nil;
+    next->prev = nil;
+    if (arena->cacheBlocks) {
+        next->prev = arena->cache;
+        arena->cache = arena->block;
+    }
+    else {
+        _mtb_arena_free_blocks(arena, arena->block);
+    }
+    _mtb_arena_use_block(arena, keep);
+}
+
+func void
+_mtb_arena_decommit(MtbArena *arena, u64 keep)
+{
+    MtbArenaAllocator *allocator = arena->allocator;
+    if (allocator->decommit == nil) {
+        return;
+    }
+    // chained blocks were allocated w/ their header
+    u8 *ptr = arena->first != nil ? (u8 *)arena->block : arena->base;
+    u64 headerSize = (u64)(arena->base - ptr);
+    u64 size = mtb_add_u64(mtb_max_u64(arena->offset, keep), headerSize);
+    u64 returned = allocator->decommit(allocator->ctx, ptr, _mtb_arena_committed(arena) + headerSize, size) - headerSize;
+    if (arena->touched != nil && returned < *arena->touched) {
+        *arena->touched = returned;
+    }
+    if (arena->committed != nil) {
+        *arena->committed = returned;
+    }
+}
 
-    return opt.no_zero ? result : memset(result, 0, size);
+func void
+mtb_arena_rewind_opt(MtbArena *arena, u64 offset, MtbArenaClearOptions opt)
+{
+    mtb_assert_always(offset <= arena->offset);
+
+    arena->offset = offset;
+    if (opt.decommit) {
+        _mtb_arena_decommit(arena, opt.keep);
+    }
 }
 
 func void
-mtb_arena_clear(MtbArena *arena)
+mtb_arena_clear_opt(MtbArena *arena, MtbArenaClearOptions opt)
 {
+    mtb_assert(arena->tempDepth == 0); // a temp scope is still open, its end would restore a freed block
     arena->offset = 0;
+    if (arena->first != nil && arena->block != arena->first) {
+        _mtb_arena_unchain(arena, arena->first);
+    }
+    if (opt.decommit) {
+        _mtb_arena_decommit(arena, opt.keep);
+    }
+}
+
+func MtbArenaTemp
+mtb_arena_temp_begin(MtbArena *arena)
+{
+    return (MtbArenaTemp){
+        .arena = arena,
+        .block = arena->block,
+        .offset = arena->offset,
+        .depth = ++arena->tempDepth,
+    };
+}
+
+func void
+mtb_arena_temp_end(MtbArenaTemp *temp)
+{
+    MtbArena *arena = temp->arena;
+    mtb_assert(temp->depth == arena->tempDepth); // an inner scope is still open, or this one has ended
+
+    if (arena->block != temp->block) {
+        _mtb_arena_unchain(arena, temp->block);
+    }
+    else {
+        mtb_assert_always(temp->offset <= arena->offset);
+    }
+    arena->offset = temp->offset;
+    arena->tempDepth = temp->depth - 1;
+}
+
+func u64
+_mtb_arena_resident(u8 *ptr, u64 size)
+{
+    u64 pageSize = (u64)sysconf(_SC_PAGE_SIZE);
+    u8 *beg = (u8 *)((u64)ptr & ~(pageSize - 1));
+    u8 *end = (u8 *)mtb_align_pow2((u64)(ptr + size), pageSize);
+
+    u64 resident = 0;
+    unsigned char pages[256];
+    for (u8 *cur = beg; cur < end; cur += sizeof(pages) * pageSize) {
+        u64 count = mtb_min_u64((u64)(end - cur) / pageSize, sizeof(pages));
+        mtb_assert(mincore(cur, count * pageSize, pages) == 0);
+        for (u64 i = 0; i < count; i++) {
+            resident += pages[i] & 1;
+        }
+    }
+    return resident * pageSize;
+}
+
+func void
+mtb_arena_stats(MtbArena *arena, MtbArenaStats *stats)
+{
+    *stats = (MtbArenaStats){ .offset = arena->offset };
+    if (arena->first == nil) {
+        stats->size = arena->size;
+        stats->committed = _mtb_arena_committed(arena);
+        stats->resident = stats->committed > 0 ? _mtb_arena_resident(arena->base, stats->committed) : 0;
+        stats->blocks = 1;
+        return;
+    }
+    MtbArenaBlock *chains[] = { arena->block, arena->cache };
+    for (u64 i = 0; i < mtb_countof(chains); i++) {
+        for (MtbArenaBlock *block = chains[i]; block != nil; block = block->prev) {
+            stats->size += block->size;
+            stats->committed += block->size;
+            stats->resident += _mtb_arena_resident((u8 *)(block + 1), block->size);
+            stats->blocks++;
+        }
+    }
+}
+
+func void
+mtb_arena_stats_print(MtbArenaStats *stats, const char *name)
+{
+    mtb_perf_print_block(name);
+    mtb_perf_print_u64("offset", stats->offset);
+    mtb_perf_print_u64("size", stats->size);
+    mtb_perf_print_u64("committed", stats->committed);
+    mtb_perf_print_u64("resident", stats->resident);
+    mtb_perf_print_u64("blocks", stats->blocks);
 }
 
 #endif // MTB_ARENA_IMPLEMENTATION
@@ -222,12 +746,13 @@ _test_mtb_allocator(MtbArenaAllocator *allocator)
 {
     MtbArena arena = {0};
     u64 pageSize = (u64)sysconf(_SC_PAGE_SIZE);
-    u64 arenaSize = 2 * pageSize;
+    u64 arenaSize = 3 * pageSize;
 
     // init
     mtb_arena_init(&arena, arenaSize, allocator);
     assert(arena.size == arenaSize);
     assert(arena.allocator->size(arena.allocator->ctx, arena.base) >= arenaSize);
+    assert(_mtb_arena_touched(&arena) == (allocator->mark != nil ? 0 : arenaSize));
 
     // alloc
     u64 *tiny = mtb_arena_bump(&arena, u64, 1);
@@ -244,13 +769,42 @@ _test_mtb_allocator(MtbArenaAllocator *allocator)
     for (u32 i = 0; i < pageSize; i++) page[i] = U8_MAX;          // is writable
     for (u32 i = 0; i < pageSize; i++) assert(page[i] == U8_MAX); // is readable
 
+    // resize
+    u64 *last = mtb_arena_bump(&arena, u64, 2);
+    last[1] = U64_MAX;
+    u64 lastOffset = arena.offset;
+    assert(mtb_arena_resize(&arena, last, 2 * sizeof(u64), 4 * sizeof(u64)));
+    assert(arena.offset == lastOffset + 2 * sizeof(u64));
+    assert(last[1] == U64_MAX && last[2] == 0 && last[3] == 0); // keeps content, zeroes the rest
+    assert(mtb_arena_resize(&arena, last, 4 * sizeof(u64), sizeof(u64)));
+    assert(arena.offset == lastOffset - sizeof(u64));
+    assert(mtb_arena_resize(&arena, last, sizeof(u64), 2 * sizeof(u64)));
+    assert(last[1] == 0); // touched before, zeroed again
+    assert(mtb_arena_resize(&arena, last, 2 * sizeof(u64), sizeof(u64)));
+    assert(!mtb_arena_resize(&arena, page, pageSize, 2 * pageSize)); // not the last one
+    assert(!mtb_arena_resize(&arena, last, sizeof(u64), arenaSize)); // doesn't fit
+    assert(arena.offset == lastOffset - sizeof(u64));
+
     // clear
     assert(arena.offset != 0);
     mtb_arena_clear(&arena);
     assert(arena.offset == 0);
 
+    // reuse is zeroed
+    u64 *reused = mtb_arena_bump(&arena, u64, 1);
+    assert(reused == tiny && *reused == 0);
+
+    // a copy shares the high-water mark, what it handed out is zeroed for the original too
+    mtb_arena_clear(&arena);
+    mtb_arena_bump(&arena, u64, 1);
+    MtbArena copy = arena;
+    u8 *scribbled = mtb_arena_bump(&copy, u8, pageSize);
+    memset(scribbled, 1, pageSize);
+    u8 *bumped = mtb_arena_bump(&arena, u8, pageSize);
+    assert(bumped == scribbled);
+    for (u32 i = 0; i < pageSize; i++) assert(bumped[i] == 0);
+
     // deinit
-    assert(mtb_arena_bump(&arena, u32, 1) != nil);
     assert(arena.base != nil);
     assert(arena.offset != 0);
     assert(arena.size != 0);
@@ -274,11 +828,267 @@ _test_mtb_def_allocator(void)
     _test_mtb_allocator(&MTB_ARENA_DEF_ALLOCATOR);
 }
 
+func void
+_test_mtb_def_reserve_allocator(void)
+{
+    _test_mtb_allocator(&MTB_ARENA_DEF_RESERVE_ALLOCATOR);
+}
+
+func void
+_test_mtb_arena_reserved(void)
+{
+    u64 pageSize = (u64)sysconf(_SC_PAGE_SIZE);
+    u64 chunkSize = 4 * pageSize;
+    MtbArenaAllocator allocator = MTB_ARENA_DEF_RESERVE_ALLOCATOR;
+    allocator.ctx = &chunkSize;
+
+    MtbArena arena = {0};
+    mtb_arena_init(&arena, gb(64), &allocator);
+    assert(arena.size == gb(64) && *arena.committed == 0);
+
+    // commits a chunk at a time
+    u8 *items = mtb_arena_bump(&arena, u8, 1);
+    assert(*arena.committed == chunkSize);
+    items[0] = 1;
+
+    // grows in place across chunks, content and pointer are kept
+    u64 size = 1;
+    for (u64 newSize = 2; newSize <= 64 * pageSize; newSize *= 2) {
+        assert(mtb_arena_resize(&arena, items, size, newSize));
+        assert(*arena.committed == mtb_align_pow2(newSize, chunkSize));
+        for (u64 i = size; i < newSize; i++) assert(items[i] == 0);
+        memset(items + size, 1, newSize - size);
+        size = newSize;
+    }
+    for (u64 i = 0; i < size; i++) assert(items[i] == 1);
+
+    // shrinking and clearing keep the committed pages
+    u64 committed = *arena.committed;
+    assert(mtb_arena_resize(&arena, items, size, 1));
+    mtb_arena_clear(&arena);
+    assert(*arena.committed == committed);
+    items = mtb_arena_bump(&arena, u8, size);
+    assert(items[size - 1] == 0);
+
+    // a copy shares the committed size, what it decommits is committed again by the original
+    MtbArena copy = arena;
+    mtb_arena_clear(&copy, .decommit = true);
+    assert(*arena.committed == 0);
+    mtb_arena_clear(&arena);
+    items = mtb_arena_bump(&arena, u8, size);
+    assert(*arena.committed == committed && items[size - 1] == 0);
+    items[size - 1] = 1;
+
+    mtb_arena_deinit(&arena);
+
+    // default reservation
+    mtb_arena_init_reserved(&arena, 0);
+    assert(arena.size == MTB_ARENA_DEF_RESERVE_SIZE);
+    u64 *big = mtb_arena_bump(&arena, u64, mb(4));
+    big[mb(4) - 1] = U64_MAX;
+    assert(*arena.committed == mtb_align_pow2(mb(4) * sizeof(u64), MTB_ARENA_DEF_COMMIT_SIZE));
+    mtb_arena_deinit(&arena);
+}
+
+func void
+_test_mtb_arena_decommit(MtbArenaAllocator *allocator)
+{
+    u64 pageSize = (u64)sysconf(_SC_PAGE_SIZE);
+    MtbArena arena = {0};
+    MtbArenaStats stats = {0};
+    mtb_arena_init(&arena, 64 * pageSize, allocator);
+
+    // rewind keeps what's below the offset
+    u64 *kept = mtb_arena_bump(&arena, u64, 1);
+    *kept = U64_MAX;
+    u64 offset = arena.offset;
+    u8 *spike = mtb_arena_bump(&arena, u8, 32 * pageSize);
+    memset(spike, 1, 32 * pageSize);
+    mtb_arena_stats(&arena, &stats);
+    assert(stats.resident >= 32 * pageSize);
+
+    mtb_arena_rewind(&arena, offset, .decommit = true);
+    mtb_arena_stats(&arena, &stats);
+    assert(arena.offset == offset && *kept == U64_MAX);
+    assert(stats.resident <= 2 * pageSize);
+
+    // the pages come back zeroed
+    spike = mtb_arena_bump(&arena, u8, 32 * pageSize);
+    for (u64 i = 0; i < 32 * pageSize; i++) assert(spike[i] == 0);
+    memset(spike, 1, 32 * pageSize);
+
+    // clear keeps the high-water mark resident
+    mtb_arena_clear(&arena, .decommit = true, .keep = 8 * pageSize);
+    mtb_arena_stats(&arena, &stats);
+    assert(arena.offset == 0);
+    assert(stats.resident >= 8 * pageSize && stats.resident <= 10 * pageSize);
+
+    mtb_arena_clear(&arena, .decommit = true);
+    mtb_arena_stats(&arena, &stats);
+    assert(stats.resident <= pageSize);
+
+    mtb_arena_deinit(&arena);
+}
+
+func void
+_test_mtb_arena_decommit_virt(void)
+{
+    _test_mtb_arena_decommit(&MTB_ARENA_DEF_VIRT_ALLOCATOR);
+}
+
+func void
+_test_mtb_arena_decommit_reserved(void)
+{
+    u64 pageSize = (u64)sysconf(_SC_PAGE_SIZE);
+    MtbArenaAllocator allocator = MTB_ARENA_DEF_RESERVE_ALLOCATOR;
+    allocator.ctx = &pageSize;
+    _test_mtb_arena_decommit(&allocator);
+}
+
+func void *
+_test_mtb_counting_alloc(void *ctx, void *ptr, u64 size)
+{
+    *(i64 *)ctx += size > 0 ? 1 : -1; // live allocations
+    return mtb_arena_def_alloc(nil, ptr, size);
+}
+
+func void
+_test_mtb_arena_chained(void)
+{
+    i64 live = 0;
+    MtbArenaAllocator allocator = {
+        .ctx = &live,
+        .alloc = _test_mtb_counting_alloc,
+        .size = mtb_arena_def_size,
+    };
+
+    for (u32 cacheBlocks = 0; cacheBlocks < 2; cacheBlocks++) {
+        MtbArena arena = {0};
+        mtb_arena_init_chained(&arena, kb(1), &allocator, .maxBlockSize = kb(8), .cacheBlocks = cacheBlocks);
+        assert(live == 1);
+        MtbArenaBlock *first = arena.block;
+
+        // fills the first block, then chains doubling ones
+        u64 *items[100];
+        for (u64 i = 0; i < mtb_countof(items); i++) {
+            items[i] = mtb_arena_bump(&arena, u64, 16);
+            for (u64 j = 0; j < 16; j++) assert(items[i][j] == 0);
+            for (u64 j = 0; j < 16; j++) items[i][j] = i;
+        }
+        for (u64 i = 0; i < mtb_countof(items); i++) {
+            for (u64 j = 0; j < 16; j++) assert(items[i][j] == i);
+        }
+        assert(first->next->size == kb(2));
+        assert(arena.block->size == kb(8)); // capped
+        i64 blockCount = live;
+        assert(blockCount > 3);
+
+        // bigger than any block, and aligned
+        u8 *page = mtb_arena_bump(&arena, u8, kb(32), .align = kb(4));
+        assert((u64)page % kb(4) == 0 && arena.block->size >= kb(32));
+        assert(live == blockCount + 1);
+
+        u64 *last = mtb_arena_bump(&arena, u64, 1);
+        assert(!mtb_arena_resize(&arena, last, sizeof(u64), kb(64))); // doesn't fit its block
+
+        mtb_arena_clear(&arena);
+        assert(arena.block == first && arena.offset == 0 && first->next == nil);
+        assert(live == (cacheBlocks ? blockCount + 1 : 1));
+        MtbArenaStats stats = {0};
+        mtb_arena_stats(&arena, &stats);
+        assert(stats.blocks == (u64)live && stats.size >= kb(32) * cacheBlocks);
+
+        // cached blocks are reused
+        for (u64 i = 0; i < mtb_countof(items); i++) {
+            mtb_arena_bump(&arena, u64, 16);
+        }
+        assert(live == (cacheBlocks ? blockCount + 1 : blockCount));
+
+        mtb_arena_deinit(&arena);
+        assert(live == 0);
+    }
+
+    // w/ zeroed blocks, a copy shares the block's mark
+    MtbArena arena = {0};
+    mtb_arena_init_chained(&arena, kb(4), &MTB_ARENA_DEF_VIRT_ALLOCATOR);
+    MtbArena copy = arena;
+    u8 *scribbled = mtb_arena_bump(&copy, u8, kb(1));
+    memset(scribbled, 1, kb(1));
+    u8 *bumped = mtb_arena_bump(&arena, u8, kb(1));
+    assert(bumped == scribbled);
+    for (u64 i = 0; i < kb(1); i++) assert(bumped[i] == 0);
+    mtb_arena_deinit(&arena);
+}
+
+func void
+_test_mtb_arena_temp(void)
+{
+    MtbArena arena = {0};
+    mtb_arena_init(&arena, kb(4), &MTB_ARENA_DEF_ALLOCATOR);
+    mtb_arena_bump(&arena, u64, 1);
+    u64 offset = arena.offset;
+
+    // nested
+    MtbArenaTemp outer = mtb_arena_temp_begin(&arena);
+    mtb_arena_bump(&arena, u64, 10);
+    u64 innerOffset = arena.offset;
+    MtbArenaTemp inner = mtb_arena_temp_begin(&arena);
+    mtb_arena_bump(&arena, u64, 10);
+    mtb_arena_temp_end(&inner);
+    assert(arena.offset == innerOffset);
+    mtb_arena_temp_end(&outer);
+    assert(arena.offset == offset && arena.tempDepth == 0);
+
+    // scoped, released every iteration
+    for (u64 i = 0; i < 100; i++) {
+        mtb_arena_temp_scope(&arena);
+        u64 *scratch = mtb_arena_bump(&arena, u64, 64);
+        assert(scratch[63] == 0);
+        scratch[63] = i + 1;
+    }
+    assert(arena.offset == offset && arena.tempDepth == 0);
+    mtb_arena_deinit(&arena);
+
+    // across chained blocks
+    i64 live = 0;
+    MtbArenaAllocator allocator = {
+        .ctx = &live,
+        .alloc = _test_mtb_counting_alloc,
+        .size = mtb_arena_def_size,
+    };
+    for (u32 cacheBlocks = 0; cacheBlocks < 2; cacheBlocks++) {
+        mtb_arena_init_chained(&arena, kb(1), &allocator, .cacheBlocks = cacheBlocks);
+        mtb_arena_bump(&arena, u8, kb(1) - 8);
+        mtb_arena_bump(&arena, u8, 16); // into a second block
+        MtbArenaBlock *block = arena.block;
+        offset = arena.offset;
+
+        MtbArenaTemp temp = mtb_arena_temp_begin(&arena);
+        for (u64 i = 0; i < 64; i++) {
+            mtb_arena_bump(&arena, u8, kb(1));
+        }
+        i64 blockCount = live;
+        assert(arena.block != block && blockCount > 2);
+        mtb_arena_temp_end(&temp);
+        assert(arena.block == block && arena.offset == offset && block->next == nil);
+        assert(live == (cacheBlocks ? blockCount : 2));
+
+        mtb_arena_deinit(&arena);
+        assert(live == 0);
+    }
+}
+
 func void
 _test_mtb_arena(void)
 {
     _test_mtb_def_virt_allocator();
     _test_mtb_def_allocator();
+    _test_mtb_def_reserve_allocator();
+    _test_mtb_arena_reserved();
+    _test_mtb_arena_decommit_virt();
+    _test_mtb_arena_decommit_reserved();
+    _test_mtb_arena_chained();
+    _test_mtb_arena_temp();
 }
 
 #endif // MTB_ARENA_TESTS
@@ -0,0 +1,673 @@
+#ifndef MTB_CACHE_H
+#define MTB_CACHE_H
+
+#ifdef MTB_IMPLEMENTATION
+#define MTB_CACHE_IMPLEMENTATION
+#endif
+
+#ifdef MTB_TESTS
+#define MTB_CACHE_TESTS
+#endif
+
+#ifdef MTB_BENCH
+#define MTB_CACHE_BENCH
+#endif
+
+
+#ifndef MTB_CACHE_DEF_SMALL_RATIO
+#define MTB_CACHE_DEF_SMALL_RATIO 0.1f // S3-FIFO small queue share of the capacity
+#endif
+
+#define MTB_CACHE_MAX_FREQ 3 // S3-FIFO access counter saturates here
+
+#define mtb_cache_entry_key(cache, entry) ((u8 *)(entry) + (cache)->headerSize)
+#define mtb_cache_entry_value(cache, entry) (mtb_cache_entry_key(cache, entry) + (cache)->keySize)
+
+
+typedef u8 MtbCachePolicy;
+enum
+{
+    MTB_CACHE_LRU = 0,    // moves hits to the front, evicts the back
+    MTB_CACHE_CLOCK = 1,  // marks hits, evicts the first unmarked entry from the back (second chance)
+    MTB_CACHE_S3FIFO = 2, // small probation queue + main CLOCK queue + ghost queue, scan resistant
+};
+
+typedef u8 MtbCacheQueue;
+enum
+{
+    MTB_CACHE_QUEUE_MAIN = 0,
+    MTB_CACHE_QUEUE_SMALL = 1, // S3-FIFO only
+};
+
+// Slab entries: [header] [key] [value]
+typedef struct mtb_cache_entry MtbCacheEntry;
+struct mtb_cache_entry
+{
+    MtbList node; // in its queue, or in the free list
+    u64 hash;
+    u8 freq;      // accesses since it was queued (saturating), a single mark w/ CLOCK
+    MtbCacheQueue queue;
+};
+
+typedef struct mtb_cache_stats MtbCacheStats;
+struct mtb_cache_stats
+{
+    u64 hits;
+    u64 misses;
+    u64 evictions;
+    u64 promotions; // S3-FIFO: moved from the small to the main queue
+    u64 ghostHits;  // S3-FIFO: missed keys inserted straight into the main queue
+};
+
+typedef struct mtb_cache MtbCache;
+struct mtb_cache
+{
+    u64 capacity;
+    MtbCachePolicy policy;
+    MtbHmap hmap; // key -> MtbCacheEntry *
+
+    u64 headerSize;
+    u64 keySize; // padded to the entry alignment
+    u64 valueSize;
+    u64 entrySize;
+    u64 keyBytes; // as given to init, what is copied from the caller's key
+    u8 *slab;
+    MtbList free;
+
+    MtbList queues[2];  // front is the newest, see MtbCacheQueue
+    u64 smallCount;
+    u64 smallCapacity;
+
+    // S3-FIFO: hashes of the keys recently evicted from the small queue
+    MtbHmap ghost;      // hash -> sequence number
+    u64 *ghostRing;     // the last ghostCapacity hashes added
+    u64 ghostCapacity;
+    u64 ghostSeq;
+
+    MtbCacheStats stats;
+
+    u64 (*key_hash)(void *k);
+    bool (*key_equals)(void *k1, void *k2);
+};
+
+typedef struct mtb_cache_init_options MtbCacheInitOptions;
+struct mtb_cache_init_options
+{
+    u64 keyAlign;
+    u64 valueAlign;
+    MtbCachePolicy policy;
+    f32 smallRatio; // S3-FIFO only, MTB_CACHE_DEF_SMALL_RATIO if 0
+};
+
+
+// Everything is allocated up front, no operation allocates afterwards.
+func void mtb_cache_init_opt(MtbCache *cache,
+                             MtbArena *arena,
+                             u64 capacity,
+                             u64 keySize,
+                             u64 valueSize,
+                             u64 (*key_hash)(void *k),
+                             bool (*key_equals)(void *k1, void *k2),
+                             MtbCacheInitOptions opt);
+#define mtb_cache_init(cache, arena, capacity, keyType, valueType, key_hash, key_equals, ...) \
+    mtb_cache_init_opt(cache, \
+                       arena, \
+                       capacity, \
+                       sizeof(keyType), \
+                       sizeof(valueType), \
+                       key_hash, \
+                       key_equals, \
+                       (MtbCacheInitOptions){ \
+                           .keyAlign = mtb_alignof(keyType), \
+                           .valueAlign = mtb_alignof(valueType), \
+                           __VA_ARGS__ \
+                       })
+func void mtb_cache_clear(MtbCache *cache); // keeps the stats
+func u64 mtb_cache_count(MtbCache *cache);
+
+// Counts a hit or a miss, the value is valid until the next put.
+func void *mtb_cache_get(MtbCache *cache, void *key);
+func bool mtb_cache_contains(MtbCache *cache, void *key); // no hit/miss, no access recorded
+// Evicts an entry when full, the value is zeroed if the key is new (not counted as a hit or miss).
+func void *mtb_cache_upsert(MtbCache *cache, void *key, bool *inserted);
+func void *mtb_cache_put(MtbCache *cache, void *key);
+func bool mtb_cache_remove(MtbCache *cache, void *key);
+
+func void mtb_cache_stats_print(MtbCache *cache, const char *name); // through the mtb_perf report format
+
+#endif //MTB_CACHE_H
+
+
+#ifdef MTB_CACHE_IMPLEMENTATION
+
+#include <string.h>
+
+
+#define _mtb_cache_entry_of(n) mtb_containerof(n, MtbCacheEntry, node)
+
+
+func u64
+_mtb_cache_ghost_hash(void *key)
+{
+    return *(u64 *)key; // already a hash
+}
+
+func bool
+_mtb_cache_ghost_equals(void *key1, void *key2)
+{
+    return *(u64 *)key1 == *(u64 *)key2;
+}
+
+func void
+mtb_cache_init_opt(MtbCache *cache,
+                   MtbArena *arena,
+                   u64 capacity,
+                   u64 keySize,
+                   u64 valueSize,
+                   u64 (*key_hash)(void *k),
+                   bool (*key_equals)(void *k1, void *k2),
+                   MtbCacheInitOptions opt)
+{
+    mtb_assert_always(capacity > 0);
+    mtb_assert_always(mtb_is_pow2_or_zero(opt.keyAlign));
+    mtb_assert_always(mtb_is_pow2_or_zero(opt.valueAlign));
+    mtb_assert_always(opt.policy <= MTB_CACHE_S3FIFO);
+    mtb_assert_always(0.0f <= opt.smallRatio && opt.smallRatio < 1.0f);
+
+    cache->capacity = capacity;
+    cache->policy = opt.policy;
+    cache->key_hash = key_hash;
+    cache->key_equals = key_equals;
+
+    // room for every entry below the max load, so the map never grows
+    MtbHmapInitOptions hmapOpt = {
+        .capacity = mtb_hmap_calc_capacity(capacity),
+        .keyAlign = opt.keyAlign,
+        .valueAlign = mtb_alignof(MtbCacheEntry *),
+    };
+    mtb_hmap_init_opt(&cache->hmap, arena, keySize, sizeof(MtbCacheEntry *), key_hash, key_equals, hmapOpt);
+
+    u64 align = mtb_max_u64(mtb_alignof(MtbCacheEntry), mtb_max_u64(opt.keyAlign, opt.valueAlign));
+    cache->headerSize = mtb_align_pow2(sizeof(MtbCacheEntry), align);
+    cache->keySize = mtb_align_pow2(keySize, align);
+    cache->valueSize = mtb_align_pow2(valueSize, align);
+    cache->entrySize = cache->headerSize + cache->keySize + cache->valueSize;
+    cache->keyBytes = keySize;
+    cache->slab = mtb_arena_bump(arena, u8, mtb_mul_u64(capacity, cache->entrySize), .align = align);
+
+    cache->smallCapacity = 0;
+    cache->ghostCapacity = 0;
+    if (cache->policy == MTB_CACHE_S3FIFO) {
+        f32 smallRatio = opt.smallRatio == 0.0f ? MTB_CACHE_DEF_SMALL_RATIO : opt.smallRatio;
+        cache->smallCapacity = mtb_max_u64((u64)((f32)capacity * smallRatio), 1);
+        cache->ghostCapacity = mtb_max_u64(capacity - cache->smallCapacity, 1);
+        mtb_hmap_init(&cache->ghost, arena, u64, u64, _mtb_cache_ghost_hash, _mtb_cache_ghost_equals,
+                      .capacity = mtb_hmap_calc_capacity(cache->ghostCapacity));
+        cache->ghostRing = mtb_arena_bump(arena, u64, cache->ghostCapacity);
+    }
+
+    cache->stats = (MtbCacheStats){0};
+    mtb_cache_clear(cache);
+}
+
+func void
+mtb_cache_clear(MtbCache *cache)
+{
+    mtb_hmap_clear(&cache->hmap);
+    mtb_list_init(&cache->free);
+    for (u64 i = 0; i < cache->capacity; i++) {
+        mtb_list_add_last(&cache->free, &((MtbCacheEntry *)(cache->slab + i * cache->entrySize))->node);
+    }
+    mtb_list_init(&cache->queues[MTB_CACHE_QUEUE_MAIN]);
+    mtb_list_init(&cache->queues[MTB_CACHE_QUEUE_SMALL]);
+    cache->smallCount = 0;
+    if (cache->policy == MTB_CACHE_S3FIFO) {
+        mtb_hmap_clear(&cache->ghost);
+        cache->ghostSeq = 0;
+    }
+}
+
+func u64
+mtb_cache_count(MtbCache *cache)
+{
+    return cache->hmap.count;
+}
+
+func void
+_mtb_cache_touch(MtbCache *cache, MtbCacheEntry *entry)
+{
+    switch (cache->policy) {
+        case MTB_CACHE_LRU: mtb_list_add_first(&cache->queues[entry->queue], mtb_list_remove(&entry->node)); break;
+        case MTB_CACHE_CLOCK: entry->freq = 1; break;
+        case MTB_CACHE_S3FIFO: entry->freq = (u8)mtb_min_u64(entry->freq + 1, MTB_CACHE_MAX_FREQ); break;
+        default: mtb_invalid;
+    }
+}
+
+func void
+_mtb_cache_ghost_add(MtbCache *cache, u64 hash)
+{
+    u64 slot = cache->ghostSeq % cache->ghostCapacity;
+    if (cache->ghostSeq >= cache->ghostCapacity) {
+        // drop the oldest one, unless it was added again since
+        u64 oldest = cache->ghostRing[slot];
+        u64 *seq = mtb_hmap_get(&cache->ghost, &oldest);
+        if (seq != nil && *seq == cache->ghostSeq - cache->ghostCapacity) {
+            mtb_hmap_remove(&cache->ghost, &oldest);
+        }
+    }
+    cache->ghostRing[slot] = hash;
+    *(u64 *)mtb_hmap_put(&cache->ghost, &hash) = cache->ghostSeq++;
+}
+
+func void
+_mtb_cache_release(MtbCache *cache, MtbCacheEntry *entry)
+{
+    mtb_hmap_remove_hashed(&cache->hmap, mtb_cache_entry_key(cache, entry), entry->hash);
+    mtb_list_remove(&entry->node);
+    if (entry->queue == MTB_CACHE_QUEUE_SMALL) {
+        cache->smallCount--;
+    }
+    mtb_list_add_first(&cache->free, &entry->node);
+}
+
+func MtbCacheEntry *
+_mtb_cache_victim(MtbCache *cache)
+{
+    MtbList *main = &cache->queues[MTB_CACHE_QUEUE_MAIN];
+    MtbList *small = &cache->queues[MTB_CACHE_QUEUE_SMALL];
+    for (;;) {
+        if (cache->smallCount > 0 && (cache->smallCount >= cache->smallCapacity || mtb_list_is_empty(main))) {
+            MtbCacheEntry *entry = _mtb_cache_entry_of(mtb_list_get_last(small));
+            if (entry->freq == 0) {
+                _mtb_cache_ghost_add(cache, entry->hash);
+                return entry;
+            }
+            // accessed while on probation
+            mtb_list_add_first(main, mtb_list_remove(&entry->node));
+            entry->queue = MTB_CACHE_QUEUE_MAIN;
+            entry->freq = 0;
+            cache->smallCount--;
+            cache->stats.promotions++;
+            continue;
+        }
+        MtbCacheEntry *entry = _mtb_cache_entry_of(mtb_list_get_last(main));
+        if (entry->freq == 0 || cache->policy == MTB_CACHE_LRU) {
+            return entry;
+        }
+        entry->freq--; // second chance
+        mtb_list_add_first(main, mtb_list_remove(&entry->node));
+    }
+}
+
+func void *
+mtb_cache_get(MtbCache *cache, void *key)
+{
+    MtbCacheEntry **entry = mtb_hmap_get(&cache->hmap, key);
+    if (entry == nil) {
+        cache->stats.misses++;
+        return nil;
+    }
+    cache->stats.hits++;
+    _mtb_cache_touch(cache, *entry);
+    return mtb_cache_entry_value(cache, *entry);
+}
+
+func bool
+mtb_cache_contains(MtbCache *cache, void *key)
+{
+    return mtb_hmap_get(&cache->hmap, key) != nil;
+}
+
+func void *
+mtb_cache_upsert(MtbCache *cache, void *key, bool *inserted)
+{
+    u64 hash = cache->key_hash(key);
+    MtbCacheEntry **slot = mtb_hmap_get_hashed(&cache->hmap, key, hash);
+    if (slot != nil) {
+        *inserted = false;
+        _mtb_cache_touch(cache, *slot);
+        return mtb_cache_entry_value(cache, *slot);
+    }
+
+    if (mtb_list_is_empty(&cache->free)) {
+        _mtb_cache_release(cache, _mtb_cache_victim(cache));
+        cache->stats.evictions++;
+    }
+    MtbCacheEntry *entry = _mtb_cache_entry_of(mtb_list_remove_first(&cache->free));
+    entry->hash = hash;
+    entry->freq = 0;
+    entry->queue = MTB_CACHE_QUEUE_MAIN;
+    if (cache->policy == MTB_CACHE_S3FIFO) {
+        if (mtb_hmap_remove(&cache->ghost, &hash) != nil) {
+            cache->stats.ghostHits++; // evicted too early, skip the probation
+        }
+        else {
+            entry->queue = MTB_CACHE_QUEUE_SMALL;
+            cache->smallCount++;
+        }
+    }
+    mtb_list_add_first(&cache->queues[entry->queue], &entry->node);
+    memcpy(mtb_cache_entry_key(cache, entry), key, cache->keyBytes);
+    memset(mtb_cache_entry_value(cache, entry), 0, cache->valueSize);
+
+    bool isNew;
+    *(MtbCacheEntry **)mtb_hmap_upsert_hashed(&cache->hmap, key, hash, &isNew) = entry;
+    *inserted = true;
+    return mtb_cache_entry_value(cache, entry);
+}
+
+func void *
+mtb_cache_put(MtbCache *cache, void *key)
+{
+    bool inserted;
+    return mtb_cache_upsert(cache, key, &inserted);
+}
+
+func bool
+mtb_cache_remove(MtbCache *cache, void *key)
+{
+    MtbCacheEntry **entry = mtb_hmap_get(&cache->hmap, key);
+    if (entry == nil) {
+        return false;
+    }
+    _mtb_cache_release(cache, *entry);
+    return true;
+}
+
+func void
+mtb_cache_stats_print(MtbCache *cache, const char *name)
+{
+    MtbCacheStats *stats = &cache->stats;
+    u64 lookups = stats->hits + stats->misses;
+    mtb_perf_print_block(name);
+    mtb_perf_print_u64("count", mtb_cache_count(cache));
+    mtb_perf_print_u64("capacity", cache->capacity);
+    mtb_perf_print_u64("hits", stats->hits);
+    mtb_perf_print_u64("misses", stats->misses);
+    mtb_perf_print_f64("hit ratio", lookups == 0 ? 0.0 : (f64)stats->hits / (f64)lookups);
+    mtb_perf_print_u64("evictions", stats->evictions);
+    if (cache->policy == MTB_CACHE_S3FIFO) {
+        mtb_perf_print_u64("promotions", stats->promotions);
+        mtb_perf_print_u64("ghost hits", stats->ghostHits);
+    }
+}
+
+#endif // MTB_CACHE_IMPLEMENTATION
+
+
+
+
+#ifdef MTB_CACHE_TESTS
+
+#include <assert.h>
+
+
+func u64
+_test_mtb_cache_hash_u64(void *key)
+{
+    return *(u64 *)key * 0x9E3779B97F4A7C15;
+}
+
+func bool
+_test_mtb_cache_is_equal_u64(void *key1, void *key2)
+{
+    return *(u64 *)key1 == *(u64 *)key2;
+}
+
+func u64
+_test_mtb_cache_hash_u32(void *key)
+{
+    return *(u32 *)key * 0x9E3779B97F4A7C15;
+}
+
+func bool
+_test_mtb_cache_is_equal_u32(void *key1, void *key2)
+{
+    return *(u32 *)key1 == *(u32 *)key2;
+}
+
+// The entry header pads a u32 key to 8 bytes, only 4 may be read from the caller's key.
+func void
+_test_mtb_cache_small_keys(MtbArena *arena, MtbCachePolicy policy)
+{
+    mtb_arena_temp_scope(arena);
+    MtbCache cache = {0};
+    mtb_cache_init(&cache, arena, 16, u32, u32, _test_mtb_cache_hash_u32, _test_mtb_cache_is_equal_u32,
+                   .policy = policy);
+    assert(cache.keySize == sizeof(u64) && cache.keyBytes == sizeof(u32));
+    for (u32 k = 0; k < 100; k++) {
+        *(u32 *)mtb_cache_put(&cache, &k) = k + 1;
+        u32 *v = mtb_cache_get(&cache, &k);
+        assert(v != nil && *v == k + 1);
+    }
+    assert(cache.stats.evictions == 100 - 16);
+}
+
+func void
+_test_mtb_cache_basic(MtbArena *arena, MtbCachePolicy policy)
+{
+    mtb_arena_temp_scope(arena);
+    MtbCache cache = {0};
+    u64 capacity = 64;
+    mtb_cache_init(&cache, arena, capacity, u64, u64, _test_mtb_cache_hash_u64, _test_mtb_cache_is_equal_u64,
+                   .policy = policy);
+
+    // no allocation past init
+    u64 offset = arena->offset;
+    for (u64 k = 0; k < 10 * capacity; k++) {
+        bool inserted;
+        u64 *v = mtb_cache_upsert(&cache, &k, &inserted);
+        assert(inserted && *v == 0);
+        *v = k + 1;
+        assert(mtb_cache_count(&cache) == mtb_min_u64(k + 1, capacity));
+
+        u64 *got = mtb_cache_get(&cache, &k);
+        assert(got == v && *got == k + 1);
+        assert(mtb_cache_upsert(&cache, &k, &inserted) == v && !inserted);
+    }
+    assert(arena->offset == offset);
+    assert(cache.stats.hits == 10 * capacity);
+    assert(cache.stats.evictions == 9 * capacity);
+
+    u64 present = 0;
+    for (u64 k = 0; k < 10 * capacity; k++) {
+        if (mtb_cache_contains(&cache, &k)) {
+            assert(*(u64 *)mtb_cache_get(&cache, &k) == k + 1);
+            present++;
+        }
+    }
+    assert(present == capacity);
+
+    u64 missing = 10 * capacity;
+    assert(mtb_cache_get(&cache, &missing) == nil);
+    assert(cache.stats.misses == 1);
+
+    u64 last = 10 * capacity - 1;
+    assert(mtb_cache_remove(&cache, &last));
+    assert(!mtb_cache_remove(&cache, &last));
+    assert(!mtb_cache_contains(&cache, &last));
+    assert(mtb_cache_count(&cache) == capacity - 1);
+
+    mtb_cache_clear(&cache);
+    assert(mtb_cache_count(&cache) == 0);
+    for (u64 k = 0; k < capacity; k++) {
+        mtb_cache_put(&cache, &k);
+    }
+    assert(mtb_cache_count(&cache) == capacity);
+}
+
+func void
+_test_mtb_cache_lru(MtbArena *arena)
+{
+    mtb_arena_temp_scope(arena);
+    MtbCache cache = {0};
+    mtb_cache_init(&cache, arena, 4, u64, u64, _test_mtb_cache_hash_u64, _test_mtb_cache_is_equal_u64,
+                   .policy = MTB_CACHE_LRU);
+    for (u64 k = 0; k < 4; k++) {
+        mtb_cache_put(&cache, &k);
+    }
+    u64 k0 = 0;
+    mtb_cache_get(&cache, &k0); // 1 is the least recently used now
+    u64 k4 = 4;
+    mtb_cache_put(&cache, &k4);
+    for (u64 k = 0; k < 5; k++) {
+        assert(mtb_cache_contains(&cache, &k) == (k != 1));
+    }
+}
+
+func void
+_test_mtb_cache_clock(MtbArena *arena)
+{
+    mtb_arena_temp_scope(arena);
+    MtbCache cache = {0};
+    mtb_cache_init(&cache, arena, 4, u64, u64, _test_mtb_cache_hash_u64, _test_mtb_cache_is_equal_u64,
+                   .policy = MTB_CACHE_CLOCK);
+    for (u64 k = 0; k < 4; k++) {
+        mtb_cache_put(&cache, &k);
+    }
+    u64 k0 = 0;
+    u64 k1 = 1;
+    mtb_cache_get(&cache, &k0);
+    mtb_cache_get(&cache, &k1);
+    u64 k4 = 4;
+    mtb_cache_put(&cache, &k4); // 0 and 1 get a second chance
+    for (u64 k = 0; k < 5; k++) {
+        assert(mtb_cache_contains(&cache, &k) == (k != 2));
+    }
+}
+
+func void
+_test_mtb_cache_s3fifo(MtbArena *arena)
+{
+    mtb_arena_temp_scope(arena);
+    MtbCache cache = {0};
+    u64 capacity = 100;
+    mtb_cache_init(&cache, arena, capacity, u64, u64, _test_mtb_cache_hash_u64, _test_mtb_cache_is_equal_u64,
+                   .policy = MTB_CACHE_S3FIFO);
+    assert(cache.smallCapacity == 10);
+
+    // a hot set accessed twice, then a long scan of one-hit wonders
+    u64 hot = 50;
+    for (u64 round = 0; round < 2; round++) {
+        for (u64 k = 0; k < hot; k++) {
+            if (mtb_cache_get(&cache, &k) == nil) {
+                *(u64 *)mtb_cache_put(&cache, &k) = k;
+            }
+        }
+    }
+    for (u64 k = 1000; k < 1000 + 10 * capacity; k++) {
+        if (mtb_cache_get(&cache, &k) == nil) {
+            mtb_cache_put(&cache, &k);
+        }
+    }
+    // the scan only went through the small queue
+    for (u64 k = 0; k < hot; k++) {
+        assert(mtb_cache_contains(&cache, &k));
+    }
+    assert(cache.stats.promotions >= hot - cache.smallCapacity);
+
+    // recently evicted keys come back into the main queue
+    u64 ghostHits = cache.stats.ghostHits;
+    u64 recent = 1000 + 10 * capacity - hot - 1; // the small queue kept the latest ones
+    assert(!mtb_cache_contains(&cache, &recent));
+    mtb_cache_put(&cache, &recent);
+    assert(cache.stats.ghostHits == ghostHits + 1);
+}
+
+func void
+_test_mtb_cache(void)
+{
+    MtbArena arena = {0};
+    mtb_arena_init(&arena, mb(1), &MTB_ARENA_DEF_ALLOCATOR);
+
+    _test_mtb_cache_basic(&arena, MTB_CACHE_LRU);
+    _test_mtb_cache_basic(&arena, MTB_CACHE_CLOCK);
+    _test_mtb_cache_basic(&arena, MTB_CACHE_S3FIFO);
+    _test_mtb_cache_lru(&arena);
+    _test_mtb_cache_clock(&arena);
+    _test_mtb_cache_s3fifo(&arena);
+    _test_mtb_cache_small_keys(&arena, MTB_CACHE_LRU);
+    _test_mtb_cache_small_keys(&arena, MTB_CACHE_S3FIFO);
+
+    mtb_arena_deinit(&arena);
+}
+
+#endif // MTB_CACHE_TESTS
+
+
+#ifdef MTB_CACHE_BENCH
+
+#include <assert.h>
+#include <stdio.h>
+
+
+func u64
+_bench_mtb_cache_hash_u64(void *key)
+{
+    return *(u64 *)key * 0x9E3779B97F4A7C15;
+}
+
+func bool
+_bench_mtb_cache_is_equal_u64(void *key1, void *key2)
+{
+    return *(u64 *)key1 == *(u64 *)key2;
+}
+
+// Skewed accesses to a working set twice the capacity, interrupted by scans of never seen keys.
+func void
+_bench_mtb_cache_workload(MtbArena *arena, MtbCachePolicy policy, char *name)
+{
+    mtb_arena_temp_scope(arena);
+    u64 capacity = 1 << 16;
+    u64 accessCount = 1 << 23;
+    u64 scanLength = 2 * capacity;
+
+    MtbCache cache = {0};
+    mtb_cache_init(&cache, arena, capacity, u64, u64, _bench_mtb_cache_hash_u64, _bench_mtb_cache_is_equal_u64,
+                   .policy = policy);
+
+    MtbRng64 rng = {0};
+    mtb_rng64_init(&rng, 42);
+    u64 scanKey = U64_MAX / 2;
+    u64 beg = mtb_perf_sys_time();
+    for (u64 i = 0; i < accessCount; i++) {
+        u64 key;
+        if (i % (accessCount / 8) < scanLength) {
+            key = scanKey++;
+        }
+        else {
+            // 80% of the accesses to the hottest 20% of the keys
+            u64 range = 2 * capacity;
+            key = mtb_rng64_next_unit(&rng) < 0.8 ? mtb_rng64_next_bounded(&rng, range / 5) : mtb_rng64_next_bounded(&rng, range);
+        }
+        u64 *value = mtb_cache_get(&cache, &key);
+        if (value == nil) {
+            *(u64 *)mtb_cache_put(&cache, &key) = key;
+        }
+        else {
+            assert(*value == key);
+        }
+    }
+    u64 elapsed = mtb_perf_sys_time() - beg;
+
+    f64 seconds = (f64)elapsed / (f64)mtb_perf_sys_freq();
+    printf("%s: %.2f M accesses/s\n", name, (f64)accessCount / seconds / 1e6);
+    mtb_cache_stats_print(&cache, name);
+}
+
+func void
+_bench_mtb_cache(void)
+{
+    MtbArena arena = {0};
+    mtb_arena_init(&arena, mb(64), &MTB_ARENA_DEF_ALLOCATOR);
+
+    printf("== skewed accesses w/ scans ==\n");
+    _bench_mtb_cache_workload(&arena, MTB_CACHE_LRU, "lru");
+    _bench_mtb_cache_workload(&arena, MTB_CACHE_CLOCK, "clock");
+    _bench_mtb_cache_workload(&arena, MTB_CACHE_S3FIFO, "s3-fifo");
+
+    mtb_arena_deinit(&arena);
+}
+
+#endif // MTB_CACHE_BENCH
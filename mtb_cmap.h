@@ -0,0 +1,917 @@
+#ifndef MTB_CMAP_H
+#define MTB_CMAP_H
+
+#ifdef MTB_IMPLEMENTATION
+#define MTB_CMAP_IMPLEMENTATION
+#endif
+
+#ifdef MTB_TESTS
+#define MTB_CMAP_TESTS
+#endif
+
+#ifdef MTB_BENCH
+#define MTB_CMAP_BENCH
+#endif
+
+
+#include <threads.h>
+
+
+#ifndef MTB_CMAP_DEF_SHARD_COUNT
+#define MTB_CMAP_DEF_SHARD_COUNT 64
+#endif
+
+#ifndef MTB_CMAP_DEF_SHARD_ARENA_SIZE
+#define MTB_CMAP_DEF_SHARD_ARENA_SIZE mb(64)
+#endif
+
+#ifndef MTB_CMAP_RCU_DEF_MAX_READERS
+#define MTB_CMAP_RCU_DEF_MAX_READERS 64
+#endif
+
+#ifndef MTB_CMAP_RCU_DEF_VERSION_ARENA_SIZE
+#define MTB_CMAP_RCU_DEF_VERSION_ARENA_SIZE mb(64)
+#endif
+
+#define MTB_CMAP_CACHE_LINE 64
+
+
+/* Concurrent (sharded) Hash Map */
+
+// Every shard is a MtbHmap w/ its own lock and arena, picked by the high hash bits
+// (the map itself uses the low ones). Values are copied in and out under the lock.
+typedef struct mtb_cmap_shard MtbCmapShard;
+struct mtb_cmap_shard
+{
+    mtx_t lock;
+    MtbArena arena;
+    MtbHmap hmap;
+} __attribute__((aligned(MTB_CMAP_CACHE_LINE)));
+
+typedef struct mtb_cmap MtbCmap;
+struct mtb_cmap
+{
+    u64 shardCount; // must be power of 2!
+    u32 shardShift;
+    MtbCmapShard *shards;
+    u64 valueSize;
+
+    u64 (*key_hash)(void *k);
+};
+
+typedef struct mtb_cmap_init_options MtbCmapInitOptions;
+struct mtb_cmap_init_options
+{
+    u64 shardCount;               // MTB_CMAP_DEF_SHARD_COUNT if 0
+    u64 shardArenaSize;           // MTB_CMAP_DEF_SHARD_ARENA_SIZE if 0
+    MtbArenaAllocator *allocator; // of the shard arenas, MTB_ARENA_DEF_ALLOCATOR if nil
+    MtbHmapInitOptions hmap;
+};
+
+
+// The shard array is bumped from the arena, shards allocate from their own ones.
+func void mtb_cmap_init_opt(MtbCmap *cmap,
+                            MtbArena *arena,
+                            u64 keySize,
+                            u64 valueSize,
+                            u64 (*key_hash)(void *k),
+                            bool (*key_equals)(void *k1, void *k2),
+                            MtbCmapInitOptions opt);
+#define mtb_cmap_init(cmap, arena, keyType, valueType, key_hash, key_equals, ...) \
+    mtb_cmap_init_opt(cmap, \
+                      arena, \
+                      sizeof(keyType), \
+                      sizeof(valueType), \
+                      key_hash, \
+                      key_equals, \
+                      (MtbCmapInitOptions){ \
+                          .hmap = { .keyAlign = mtb_alignof(keyType), .valueAlign = mtb_alignof(valueType) }, \
+                          __VA_ARGS__ \
+                      })
+func void mtb_cmap_deinit(MtbCmap *cmap);
+func u64 mtb_cmap_count(MtbCmap *cmap);
+
+// Thread safe, the value (if not nil) is copied in or out.
+func bool mtb_cmap_put(MtbCmap *cmap, void *key, void *value); // returns true if the key is new
+func bool mtb_cmap_remove(MtbCmap *cmap, void *key, void *value);
+func bool mtb_cmap_get(MtbCmap *cmap, void *key, void *value);
+
+// Thread safe, calls update on the value (zeroed if the key is new) under the shard lock.
+func bool mtb_cmap_update(MtbCmap *cmap, void *key, void (*update)(void *value, void *ctx), void *ctx);
+
+// Not thread safe, the shard maps can be iterated once all writers are done.
+func MtbHmap *mtb_cmap_shard(MtbCmap *cmap, u64 index);
+
+
+
+/* Read-mostly (RCU) Hash Map */
+
+// Readers never lock, they look up an immutable snapshot. A writer edits a private copy and
+// publishes it atomically, the previous one is freed once every reader left its epoch.
+typedef struct mtb_cmap_rcu_version MtbCmapRcuVersion;
+struct mtb_cmap_rcu_version
+{
+    MtbArena arena; // the version itself is its first allocation
+    MtbHmap hmap;
+};
+
+typedef struct mtb_cmap_rcu_reader MtbCmapRcuReader;
+struct mtb_cmap_rcu_reader
+{
+    u64 epoch; // 0 outside of read_begin/read_end
+    u64 used;  // claimed by register, released by unregister
+} __attribute__((aligned(MTB_CMAP_CACHE_LINE)));
+
+typedef struct mtb_cmap_rcu MtbCmapRcu;
+struct mtb_cmap_rcu
+{
+    MtbCmapRcuVersion *current;
+    u64 epoch;
+    u64 maxReaders;
+    MtbCmapRcuReader *readers;
+    u64 valueSize;
+
+    mtx_t writeLock;
+    MtbCmapRcuVersion *pending;
+    u64 versionArenaSize;
+    MtbArenaAllocator *allocator;
+} __attribute__((aligned(MTB_CMAP_CACHE_LINE)));
+
+typedef struct mtb_cmap_rcu_init_options MtbCmapRcuInitOptions;
+struct mtb_cmap_rcu_init_options
+{
+    u64 maxReaders;               // MTB_CMAP_RCU_DEF_MAX_READERS if 0
+    u64 versionArenaSize;         // MTB_CMAP_RCU_DEF_VERSION_ARENA_SIZE if 0
+    MtbArenaAllocator *allocator; // of the version arenas, MTB_ARENA_DEF_ALLOCATOR if nil
+    MtbHmapInitOptions hmap;      // incremental resize is not allowed, lookups must not write
+};
+
+
+// The reader slots are bumped from the arena, every version allocates from its own one.
+func void mtb_cmap_rcu_init_opt(MtbCmapRcu *rcu,
+                                MtbArena *arena,
+                                u64 keySize,
+                                u64 valueSize,
+                                u64 (*key_hash)(void *k),
+                                bool (*key_equals)(void *k1, void *k2),
+                                MtbCmapRcuInitOptions opt);
+#define mtb_cmap_rcu_init(rcu, arena, keyType, valueType, key_hash, key_equals, ...) \
+    mtb_cmap_rcu_init_opt(rcu, \
+                          arena, \
+                          sizeof(keyType), \
+                          sizeof(valueType), \
+                          key_hash, \
+                          key_equals, \
+                          (MtbCmapRcuInitOptions){ \
+                              .hmap = { .keyAlign = mtb_alignof(keyType), .valueAlign = mtb_alignof(valueType) }, \
+                              __VA_ARGS__ \
+                          })
+func void mtb_cmap_rcu_deinit(MtbCmapRcu *rcu); // no readers or writer may be active
+
+// Thread safe, every reader thread registers once and passes its slot to the read calls.
+// A thread that stops reading unregisters, so its slot can be taken by another one.
+func u64 mtb_cmap_rcu_register(MtbCmapRcu *rcu);
+func void mtb_cmap_rcu_unregister(MtbCmapRcu *rcu, u64 reader); // not between read_begin/read_end
+
+// The snapshot stays valid (and unchanged) until read_end, must not be modified. Not reentrant.
+func MtbHmap *mtb_cmap_rcu_read_begin(MtbCmapRcu *rcu, u64 reader);
+func void mtb_cmap_rcu_read_end(MtbCmapRcu *rcu, u64 reader);
+func bool mtb_cmap_rcu_get(MtbCmapRcu *rcu, u64 reader, void *key, void *value); // value copied out if not nil
+
+// Writers are serialized, write_begin returns a private copy of the current map and write_end
+// publishes it, then blocks until the replaced one can be freed (a reader thread must not write).
+func MtbHmap *mtb_cmap_rcu_write_begin(MtbCmapRcu *rcu);
+func void mtb_cmap_rcu_write_end(MtbCmapRcu *rcu);
+
+#endif //MTB_CMAP_H
+
+
+#ifdef MTB_CMAP_IMPLEMENTATION
+
+#include <string.h>
+
+
+#define _mtb_cmap_shard_of(cmap, hash) ((cmap)->shards + ((cmap)->shardShift == 64 ? 0 : (hash) >> (cmap)->shardShift))
+
+
+func void
+mtb_cmap_init_opt(MtbCmap *cmap,
+                  MtbArena *arena,
+                  u64 keySize,
+                  u64 valueSize,
+                  u64 (*key_hash)(void *k),
+                  bool (*key_equals)(void *k1, void *k2),
+                  MtbCmapInitOptions opt)
+{
+    mtb_assert_always(mtb_is_pow2_or_zero(opt.shardCount));
+
+    cmap->shardCount = opt.shardCount == 0 ? MTB_CMAP_DEF_SHARD_COUNT : opt.shardCount;
+    cmap->shardShift = (u32)(64 - mtb_trailing_zeros_count(cmap->shardCount));
+    cmap->shards = mtb_arena_bump(arena, MtbCmapShard, cmap->shardCount);
+    cmap->valueSize = valueSize;
+    cmap->key_hash = key_hash;
+
+    u64 shardArenaSize = opt.shardArenaSize == 0 ? MTB_CMAP_DEF_SHARD_ARENA_SIZE : opt.shardArenaSize;
+    MtbArenaAllocator *allocator = opt.allocator == nil ? &MTB_ARENA_DEF_ALLOCATOR : opt.allocator;
+    for (u64 i = 0; i < cmap->shardCount; i++) {
+        MtbCmapShard *shard = cmap->shards + i;
+        mtb_assert_always(mtx_init(&shard->lock, mtx_plain) == thrd_success);
+        mtb_arena_init(&shard->arena, shardArenaSize, allocator);
+        mtb_hmap_init_opt(&shard->hmap, &shard->arena, keySize, valueSize, key_hash, key_equals, opt.hmap);
+    }
+}
+
+func void
+mtb_cmap_deinit(MtbCmap *cmap)
+{
+    for (u64 i = 0; i < cmap->shardCount; i++) {
+        MtbCmapShard *shard = cmap->shards + i;
+        mtx_destroy(&shard->lock);
+        mtb_arena_deinit(&shard->arena);
+    }
+    cmap->shardCount = 0;
+    cmap->shards = nil;
+}
+
+func u64
+mtb_cmap_count(MtbCmap *cmap)
+{
+    u64 count = 0;
+    for (u64 i = 0; i < cmap->shardCount; i++) {
+        MtbCmapShard *shard = cmap->shards + i;
+        mtx_lock(&shard->lock);
+        count += shard->hmap.count;
+        mtx_unlock(&shard->lock);
+    }
+    return count;
+}
+
+func bool
+mtb_cmap_put(MtbCmap *cmap, void *key, void *value)
+{
+    u64 hash = cmap->key_hash(key);
+    MtbCmapShard *shard = _mtb_cmap_shard_of(cmap, hash);
+    mtx_lock(&shard->lock);
+    bool inserted;
+    void *shardValue = mtb_hmap_upsert_hashed(&shard->hmap, key, hash, &inserted);
+    if (value != nil) {
+        memcpy(shardValue, value, cmap->valueSize);
+    }
+    mtx_unlock(&shard->lock);
+    return inserted;
+}
+
+func bool
+mtb_cmap_remove(MtbCmap *cmap, void *key, void *value)
+{
+    u64 hash = cmap->key_hash(key);
+    MtbCmapShard *shard = _mtb_cmap_shard_of(cmap, hash);
+    mtx_lock(&shard->lock);
+    void *shardValue = mtb_hmap_remove_hashed(&shard->hmap, key, hash);
+    if (shardValue != nil && value != nil) {
+        memcpy(value, shardValue, cmap->valueSize);
+    }
+    mtx_unlock(&shard->lock);
+    return shardValue != nil;
+}
+
+func bool
+mtb_cmap_get(MtbCmap *cmap, void *key, void *value)
+{
+    u64 hash = cmap->key_hash(key);
+    MtbCmapShard *shard = _mtb_cmap_shard_of(cmap, hash);
+    mtx_lock(&shard->lock);
+    void *shardValue = mtb_hmap_get_hashed(&shard->hmap, key, hash);
+    if (shardValue != nil && value != nil) {
+        memcpy(value, shardValue, cmap->valueSize);
+    }
+    mtx_unlock(&shard->lock);
+    return shardValue != nil;
+}
+
+func bool
+mtb_cmap_update(MtbCmap *cmap, void *key, void (*update)(void *value, void *ctx), void *ctx)
+{
+    u64 hash = cmap->key_hash(key);
+    MtbCmapShard *shard = _mtb_cmap_shard_of(cmap, hash);
+    mtx_lock(&shard->lock);
+    bool inserted;
+    update(mtb_hmap_upsert_hashed(&shard->hmap, key, hash, &inserted), ctx);
+    mtx_unlock(&shard->lock);
+    return inserted;
+}
+
+func MtbHmap *
+mtb_cmap_shard(MtbCmap *cmap, u64 index)
+{
+    mtb_assert_always(index < cmap->shardCount);
+    return &cmap->shards[index].hmap;
+}
+
+
+func MtbCmapRcuVersion *
+_mtb_cmap_rcu_version_new(MtbCmapRcu *rcu)
+{
+    MtbArena arena = {0};
+    mtb_arena_init(&arena, rcu->versionArenaSize, rcu->allocator);
+    MtbCmapRcuVersion *version = mtb_arena_bump(&arena, MtbCmapRcuVersion, 1);
+    version->arena = arena;
+    return version;
+}
+
+func void
+_mtb_cmap_rcu_version_free(MtbCmapRcuVersion *version)
+{
+    MtbArena arena = version->arena;
+    mtb_arena_deinit(&arena);
+}
+
+func void
+mtb_cmap_rcu_init_opt(MtbCmapRcu *rcu,
+                      MtbArena *arena,
+                      u64 keySize,
+                      u64 valueSize,
+                      u64 (*key_hash)(void *k),
+                      bool (*key_equals)(void *k1, void *k2),
+                      MtbCmapRcuInitOptions opt)
+{
+    mtb_assert_always(!opt.hmap.incremental);
+
+    rcu->epoch = 1;
+    rcu->maxReaders = opt.maxReaders == 0 ? MTB_CMAP_RCU_DEF_MAX_READERS : opt.maxReaders;
+    rcu->readers = mtb_arena_bump(arena, MtbCmapRcuReader, rcu->maxReaders);
+    rcu->valueSize = valueSize;
+    mtb_assert_always(mtx_init(&rcu->writeLock, mtx_plain) == thrd_success);
+    rcu->pending = nil;
+    rcu->versionArenaSize = opt.versionArenaSize == 0 ? MTB_CMAP_RCU_DEF_VERSION_ARENA_SIZE : opt.versionArenaSize;
+    rcu->allocator = opt.allocator == nil ? &MTB_ARENA_DEF_ALLOCATOR : opt.allocator;
+
+    MtbCmapRcuVersion *version = _mtb_cmap_rcu_version_new(rcu);
+    mtb_hmap_init_opt(&version->hmap, &version->arena, keySize, valueSize, key_hash, key_equals, opt.hmap);
+    rcu->current = version;
+}
+
+func void
+mtb_cmap_rcu_deinit(MtbCmapRcu *rcu)
+{
+    mtb_assert_always(rcu->pending == nil);
+    _mtb_cmap_rcu_version_free(rcu->current);
+    mtx_destroy(&rcu->writeLock);
+    rcu->current = nil;
+    rcu->readers = nil;
+}
+
+func u64
+mtb_cmap_rcu_register(MtbCmapRcu *rcu)
+{
+    for (u64 reader = 0; reader < rcu->maxReaders; reader++) {
+        u64 unused = 0;
+        if (__atomic_load_n(&rcu->readers[reader].used, __ATOMIC_RELAXED) == 0 &&
+            __atomic_compare_exchange_n(&rcu->readers[reader].used, &unused, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return reader;
+        }
+    }
+    mtb_assert_always(!"more than maxReaders registered readers");
+    return U64_MAX;
+}
+
+func void
+mtb_cmap_rcu_unregister(MtbCmapRcu *rcu, u64 reader)
+{
+    mtb_assert(reader < rcu->maxReaders);
+    mtb_assert(__atomic_load_n(&rcu->readers[reader].epoch, __ATOMIC_RELAXED) == 0);
+    __atomic_store_n(&rcu->readers[reader].used, 0, __ATOMIC_RELEASE);
+}
+
+func MtbHmap *
+mtb_cmap_rcu_read_begin(MtbCmapRcu *rcu, u64 reader)
+{
+    mtb_assert(reader < rcu->maxReaders);
+    // Either the writer sees our epoch or we see its new version (both sides are seq_cst).
+    u64 epoch = __atomic_load_n(&rcu->epoch, __ATOMIC_ACQUIRE);
+    __atomic_store_n(&rcu->readers[reader].epoch, epoch, __ATOMIC_SEQ_CST);
+    MtbCmapRcuVersion *version = __atomic_load_n(&rcu->current, __ATOMIC_SEQ_CST);
+    return &version->hmap;
+}
+
+func void
+mtb_cmap_rcu_read_end(MtbCmapRcu *rcu, u64 reader)
+{
+    __atomic_store_n(&rcu->readers[reader].epoch, 0, __ATOMIC_RELEASE);
+}
+
+func bool
+mtb_cmap_rcu_get(MtbCmapRcu *rcu, u64 reader, void *key, void *value)
+{
+    MtbHmap *hmap = mtb_cmap_rcu_read_begin(rcu, reader);
+    void *mapValue = mtb_hmap_get(hmap, key);
+    if (mapValue != nil && value != nil) {
+        memcpy(value, mapValue, rcu->valueSize);
+    }
+    mtb_cmap_rcu_read_end(rcu, reader);
+    return mapValue != nil;
+}
+
+func MtbHmap *
+mtb_cmap_rcu_write_begin(MtbCmapRcu *rcu)
+{
+    mtx_lock(&rcu->writeLock);
+    MtbCmapRcuVersion *version = _mtb_cmap_rcu_version_new(rcu);
+    mtb_hmap_clone(&version->hmap, &version->arena, &rcu->current->hmap);
+    rcu->pending = version;
+    return &version->hmap;
+}
+
+func void
+mtb_cmap_rcu_write_end(MtbCmapRcu *rcu)
+{
+    mtb_assert_always(rcu->pending != nil);
+
+    MtbCmapRcuVersion *old = rcu->current;
+    __atomic_store_n(&rcu->current, rcu->pending, __ATOMIC_SEQ_CST);
+    rcu->pending = nil;
+    u64 epoch = __atomic_add_fetch(&rcu->epoch, 1, __ATOMIC_SEQ_CST);
+
+    // Readers that entered at an older epoch may still hold the old version. Every slot is scanned,
+    // unused ones stay at epoch 0.
+    for (u64 i = 0; i < rcu->maxReaders; i++) {
+        for (;;) {
+            u64 readerEpoch = __atomic_load_n(&rcu->readers[i].epoch, __ATOMIC_SEQ_CST);
+            if (readerEpoch == 0 || readerEpoch >= epoch) {
+                break;
+            }
+            thrd_yield();
+        }
+    }
+    _mtb_cmap_rcu_version_free(old);
+    mtx_unlock(&rcu->writeLock);
+}
+
+#endif // MTB_CMAP_IMPLEMENTATION
+
+
+#ifdef MTB_CMAP_TESTS
+
+#include <assert.h>
+
+
+func u64
+_test_mtb_cmap_hash_u64(void *key)
+{
+    return *(u64 *)key * 0x9E3779B97F4A7C15;
+}
+
+func bool
+_test_mtb_cmap_is_equal_u64(void *key1, void *key2)
+{
+    return *(u64 *)key1 == *(u64 *)key2;
+}
+
+func void
+_test_mtb_cmap_increment(void *value, void *ctx)
+{
+    *(u64 *)value += *(u64 *)ctx;
+}
+
+func void
+_test_mtb_cmap_basic(MtbArena *arena)
+{
+    mtb_arena_temp_scope(arena);
+    MtbCmap cmap = {0};
+    mtb_cmap_init(&cmap, arena, u64, u64, _test_mtb_cmap_hash_u64, _test_mtb_cmap_is_equal_u64,
+                  .shardCount = 4, .shardArenaSize = kb(64));
+    assert(cmap.shardCount == 4);
+    assert(cmap.shardShift == 62);
+
+    u64 n = 1000;
+    for (u64 k = 0; k < n; k++) {
+        u64 v = k * k;
+        assert(mtb_cmap_put(&cmap, &k, &v));
+    }
+    assert(mtb_cmap_count(&cmap) == n);
+
+    u64 used = 0;
+    for (u64 i = 0; i < cmap.shardCount; i++) {
+        used += mtb_cmap_shard(&cmap, i)->count > 0;
+    }
+    assert(used == cmap.shardCount);
+
+    for (u64 k = 0; k < n; k += 2) {
+        u64 v = 0;
+        assert(mtb_cmap_remove(&cmap, &k, &v));
+        assert(v == k * k);
+        assert(!mtb_cmap_remove(&cmap, &k, nil));
+    }
+    for (u64 k = 0; k < n; k++) {
+        u64 one = 1;
+        assert(mtb_cmap_update(&cmap, &k, _test_mtb_cmap_increment, &one) == (k % 2 == 0));
+        u64 v = 0;
+        assert(mtb_cmap_get(&cmap, &k, &v));
+        assert(v == (k % 2 == 0 ? 1 : k * k + 1));
+    }
+    assert(mtb_cmap_count(&cmap) == n);
+
+    mtb_cmap_deinit(&cmap);
+}
+
+typedef struct _test_mtb_cmap_worker _TestMtbCmapWorker;
+struct _test_mtb_cmap_worker
+{
+    MtbCmap *cmap;
+    u64 beg;
+    u64 end;
+};
+
+func int
+_test_mtb_cmap_worker_run(void *arg)
+{
+    _TestMtbCmapWorker *worker = arg;
+    for (u64 i = worker->beg; i < worker->end; i++) {
+        u64 k = i % 1000; // overlapping keys between threads
+        u64 one = 1;
+        mtb_cmap_update(worker->cmap, &k, _test_mtb_cmap_increment, &one);
+    }
+    return 0;
+}
+
+func void
+_test_mtb_cmap_threads(MtbArena *arena)
+{
+    mtb_arena_temp_scope(arena);
+    MtbCmap cmap = {0};
+    mtb_cmap_init(&cmap, arena, u64, u64, _test_mtb_cmap_hash_u64, _test_mtb_cmap_is_equal_u64,
+                  .shardCount = 8, .shardArenaSize = kb(64));
+
+    u64 n = 40000;
+    thrd_t threads[4];
+    _TestMtbCmapWorker workers[4];
+    for (u64 i = 0; i < mtb_countof(threads); i++) {
+        workers[i] = (_TestMtbCmapWorker){ .cmap = &cmap, .beg = i * n / 4, .end = (i + 1) * n / 4 };
+        assert(thrd_create(&threads[i], _test_mtb_cmap_worker_run, &workers[i]) == thrd_success);
+    }
+    for (u64 i = 0; i < mtb_countof(threads); i++) {
+        assert(thrd_join(threads[i], nil) == thrd_success);
+    }
+
+    assert(mtb_cmap_count(&cmap) == 1000);
+    for (u64 k = 0; k < 1000; k++) {
+        u64 v = 0;
+        assert(mtb_cmap_get(&cmap, &k, &v));
+        assert(v == n / 1000);
+    }
+
+    mtb_cmap_deinit(&cmap);
+}
+
+func void
+_test_mtb_cmap_rcu_basic(MtbArena *arena)
+{
+    mtb_arena_temp_scope(arena);
+    MtbCmapRcu rcu = {0};
+    mtb_cmap_rcu_init(&rcu, arena, u64, u64, _test_mtb_cmap_hash_u64, _test_mtb_cmap_is_equal_u64,
+                      .maxReaders = 2, .versionArenaSize = kb(256));
+    u64 reader = mtb_cmap_rcu_register(&rcu);
+    assert(reader == 0);
+
+    u64 n = 1000;
+    MtbHmap *hmap = mtb_cmap_rcu_write_begin(&rcu);
+    for (u64 k = 0; k < n; k++) {
+        *(u64 *)mtb_hmap_put(hmap, &k) = k * k;
+    }
+    assert(!mtb_cmap_rcu_get(&rcu, reader, &(u64){ 1 }, nil)); // not published yet
+    mtb_cmap_rcu_write_end(&rcu);
+
+    MtbHmap *snapshot = mtb_cmap_rcu_read_begin(&rcu, reader);
+    assert(snapshot->count == n);
+    mtb_cmap_rcu_read_end(&rcu, reader);
+
+    hmap = mtb_cmap_rcu_write_begin(&rcu);
+    for (u64 k = 0; k < n; k += 2) {
+        assert(mtb_hmap_remove(hmap, &k) != nil);
+    }
+    mtb_cmap_rcu_write_end(&rcu);
+
+    for (u64 k = 0; k < n; k++) {
+        u64 v = 0;
+        assert(mtb_cmap_rcu_get(&rcu, reader, &k, &v) == (k % 2 == 1));
+        assert(k % 2 == 0 || v == k * k);
+    }
+
+    mtb_cmap_rcu_deinit(&rcu);
+}
+
+typedef struct _test_mtb_cmap_rcu_worker _TestMtbCmapRcuWorker;
+struct _test_mtb_cmap_rcu_worker
+{
+    MtbCmapRcu *rcu;
+    u64 keyCount;
+    u64 lastVersion;
+};
+
+func int
+_test_mtb_cmap_rcu_reader_run(void *arg)
+{
+    _TestMtbCmapRcuWorker *worker = arg;
+    u64 reader = mtb_cmap_rcu_register(worker->rcu);
+    u64 prevVersion = 0;
+    while (prevVersion < worker->lastVersion) {
+        // every published snapshot maps all keys to the same version
+        MtbHmap *hmap = mtb_cmap_rcu_read_begin(worker->rcu, reader);
+        u64 version = *(u64 *)mtb_hmap_get(hmap, &(u64){ 0 });
+        for (u64 k = 1; k < worker->keyCount; k++) {
+            assert(*(u64 *)mtb_hmap_get(hmap, &k) == version);
+        }
+        mtb_cmap_rcu_read_end(worker->rcu, reader);
+        assert(version >= prevVersion);
+        prevVersion = version;
+    }
+    mtb_cmap_rcu_unregister(worker->rcu, reader);
+    return 0;
+}
+
+func void
+_test_mtb_cmap_rcu_threads(MtbArena *arena)
+{
+    mtb_arena_temp_scope(arena);
+    MtbCmapRcu rcu = {0};
+    mtb_cmap_rcu_init(&rcu, arena, u64, u64, _test_mtb_cmap_hash_u64, _test_mtb_cmap_is_equal_u64,
+                      .maxReaders = 4, .versionArenaSize = kb(64));
+
+    u64 keyCount = 64;
+    MtbHmap *hmap = mtb_cmap_rcu_write_begin(&rcu);
+    for (u64 k = 0; k < keyCount; k++) {
+        *(u64 *)mtb_hmap_put(hmap, &k) = 0;
+    }
+    mtb_cmap_rcu_write_end(&rcu);
+
+    _TestMtbCmapRcuWorker worker = { .rcu = &rcu, .keyCount = keyCount, .lastVersion = 200 };
+    thrd_t threads[4];
+    for (u64 i = 0; i < mtb_countof(threads); i++) {
+        assert(thrd_create(&threads[i], _test_mtb_cmap_rcu_reader_run, &worker) == thrd_success);
+    }
+    for (u64 version = 1; version <= worker.lastVersion; version++) {
+        hmap = mtb_cmap_rcu_write_begin(&rcu);
+        for (u64 k = 0; k < keyCount; k++) {
+            *(u64 *)mtb_hmap_put(hmap, &k) = version;
+        }
+        mtb_cmap_rcu_write_end(&rcu);
+    }
+    for (u64 i = 0; i < mtb_countof(threads); i++) {
+        assert(thrd_join(threads[i], nil) == thrd_success);
+    }
+    for (u64 i = 0; i < rcu.maxReaders; i++) {
+        assert(rcu.readers[i].used == 0);
+    }
+
+    mtb_cmap_rcu_deinit(&rcu);
+}
+
+func int
+_test_mtb_cmap_rcu_short_reader_run(void *arg)
+{
+    _TestMtbCmapRcuWorker *worker = arg;
+    u64 reader = mtb_cmap_rcu_register(worker->rcu);
+    for (u64 k = 0; k < worker->keyCount; k++) {
+        assert(mtb_cmap_rcu_get(worker->rcu, reader, &k, nil));
+    }
+    mtb_cmap_rcu_unregister(worker->rcu, reader);
+    return 0;
+}
+
+func void
+_test_mtb_cmap_rcu_churn(MtbArena *arena)
+{
+    mtb_arena_temp_scope(arena);
+    MtbCmapRcu rcu = {0};
+    mtb_cmap_rcu_init(&rcu, arena, u64, u64, _test_mtb_cmap_hash_u64, _test_mtb_cmap_is_equal_u64,
+                      .maxReaders = 2, .versionArenaSize = kb(64));
+
+    u64 keyCount = 64;
+    MtbHmap *hmap = mtb_cmap_rcu_write_begin(&rcu);
+    for (u64 k = 0; k < keyCount; k++) {
+        *(u64 *)mtb_hmap_put(hmap, &k) = 0;
+    }
+    mtb_cmap_rcu_write_end(&rcu);
+
+    // many more short-lived reader threads than slots
+    _TestMtbCmapRcuWorker worker = { .rcu = &rcu, .keyCount = keyCount };
+    for (u64 round = 1; round <= 32; round++) {
+        thrd_t threads[2];
+        for (u64 i = 0; i < mtb_countof(threads); i++) {
+            assert(thrd_create(&threads[i], _test_mtb_cmap_rcu_short_reader_run, &worker) == thrd_success);
+        }
+        hmap = mtb_cmap_rcu_write_begin(&rcu);
+        *(u64 *)mtb_hmap_put(hmap, &(u64){ 0 }) = round;
+        mtb_cmap_rcu_write_end(&rcu);
+        for (u64 i = 0; i < mtb_countof(threads); i++) {
+            assert(thrd_join(threads[i], nil) == thrd_success);
+        }
+    }
+
+    u64 reader = mtb_cmap_rcu_register(&rcu);
+    assert(reader == 0);
+    assert(mtb_cmap_rcu_register(&rcu) == 1);
+    mtb_cmap_rcu_unregister(&rcu, reader);
+    assert(mtb_cmap_rcu_register(&rcu) == reader);
+
+    mtb_cmap_rcu_deinit(&rcu);
+}
+
+func void
+_test_mtb_cmap(void)
+{
+    MtbArena arena = {0};
+    mtb_arena_init(&arena, kb(16), &MTB_ARENA_DEF_ALLOCATOR);
+
+    _test_mtb_cmap_basic(&arena);
+    _test_mtb_cmap_threads(&arena);
+    _test_mtb_cmap_rcu_basic(&arena);
+    _test_mtb_cmap_rcu_threads(&arena);
+    _test_mtb_cmap_rcu_churn(&arena);
+
+    mtb_arena_deinit(&arena);
+}
+
+#endif // MTB_CMAP_TESTS
+
+
+#ifdef MTB_CMAP_BENCH
+
+#include <assert.h>
+
+
+typedef struct _bench_mtb_cmap_worker _BenchMtbCmapWorker;
+struct _bench_mtb_cmap_worker
+{
+    MtbCmap *cmap;
+    MtbStr *tokens;
+    u64 count;
+};
+
+func void
+_bench_mtb_cmap_increment(void *value, void *ctx)
+{
+    *(u64 *)value += 1;
+}
+
+func int
+_bench_mtb_cmap_worker_run(void *arg)
+{
+    _BenchMtbCmapWorker *worker = arg;
+    for (u64 i = 0; i < worker->count; i++) {
+        mtb_cmap_update(worker->cmap, worker->tokens + i, _bench_mtb_cmap_increment, nil);
+    }
+    return 0;
+}
+
+func void
+_bench_mtb_cmap_word_count(MtbArena *arena, MtbDynArr *tokens, u64 threadCount)
+{
+    mtb_arena_temp_scope(arena);
+    MtbCmap cmap = {0};
+    mtb_cmap_init(&cmap, arena, MtbStr, u64, mtb_str_key_hash, mtb_str_key_equals, .shardArenaSize = mb(4));
+
+    thrd_t *threads = mtb_arena_bump(arena, thrd_t, threadCount);
+    _BenchMtbCmapWorker *workers = mtb_arena_bump(arena, _BenchMtbCmapWorker, threadCount);
+
+    u64 beg = mtb_perf_sys_time();
+    for (u64 i = 0; i < threadCount; i++) {
+        u64 tokensBeg = i * tokens->length / threadCount;
+        u64 tokensEnd = (i + 1) * tokens->length / threadCount;
+        workers[i] = (_BenchMtbCmapWorker){
+            .cmap = &cmap,
+            .tokens = mtb_dynarr_get(tokens, tokensBeg),
+            .count = tokensEnd - tokensBeg,
+        };
+        mtb_assert_always(thrd_create(&threads[i], _bench_mtb_cmap_worker_run, &workers[i]) == thrd_success);
+    }
+    for (u64 i = 0; i < threadCount; i++) {
+        mtb_assert_always(thrd_join(threads[i], nil) == thrd_success);
+    }
+    u64 elapsed = mtb_perf_sys_time() - beg;
+
+    MtbStr love = mtb_str_lit("love");
+    u64 loveCount = 0;
+    assert(mtb_cmap_get(&cmap, &love, &loveCount) && loveCount > 0);
+
+    f64 seconds = (f64)elapsed / (f64)mtb_perf_sys_freq();
+    printf("%lu threads: %.3f s, %.2f M tokens/s\n", threadCount, seconds, (f64)tokens->length / seconds / 1e6);
+
+    mtb_cmap_deinit(&cmap);
+}
+
+typedef struct _bench_mtb_cmap_rcu_worker _BenchMtbCmapRcuWorker;
+struct _bench_mtb_cmap_rcu_worker
+{
+    MtbCmapRcu *rcu; // the mutex guarded cmap if nil
+    MtbCmap *cmap;
+    MtbStr *tokens;
+    u64 count;
+    u64 found;
+};
+
+func int
+_bench_mtb_cmap_rcu_worker_run(void *arg)
+{
+    _BenchMtbCmapRcuWorker *worker = arg;
+    u64 found = 0;
+    if (worker->rcu != nil) {
+        u64 reader = mtb_cmap_rcu_register(worker->rcu);
+        for (u64 i = 0; i < worker->count; i++) {
+            found += mtb_cmap_rcu_get(worker->rcu, reader, worker->tokens + i, nil);
+        }
+        mtb_cmap_rcu_unregister(worker->rcu, reader);
+    }
+    else {
+        for (u64 i = 0; i < worker->count; i++) {
+            found += mtb_cmap_get(worker->cmap, worker->tokens + i, nil);
+        }
+    }
+    worker->found = found;
+    return 0;
+}
+
+func void
+_bench_mtb_cmap_rcu_lookup(MtbArena *arena, MtbDynArr *tokens, u64 threadCount, bool rcuMode)
+{
+    mtb_arena_temp_scope(arena);
+    // a single shard is a mutex around mtb_hmap_get
+    MtbCmap cmap = {0};
+    MtbCmapRcu rcu = {0};
+    if (rcuMode) {
+        mtb_cmap_rcu_init(&rcu, arena, MtbStr, u64, mtb_str_key_hash, mtb_str_key_equals,
+                          .versionArenaSize = mb(8));
+        MtbHmap *hmap = mtb_cmap_rcu_write_begin(&rcu);
+        for (u64 i = 0; i < tokens->length; i++) {
+            *(u64 *)mtb_hmap_put(hmap, mtb_dynarr_get(tokens, i)) += 1;
+        }
+        mtb_cmap_rcu_write_end(&rcu);
+    }
+    else {
+        mtb_cmap_init(&cmap, arena, MtbStr, u64, mtb_str_key_hash, mtb_str_key_equals,
+                      .shardCount = 1, .shardArenaSize = mb(8));
+        for (u64 i = 0; i < tokens->length; i++) {
+            mtb_cmap_update(&cmap, mtb_dynarr_get(tokens, i), _bench_mtb_cmap_increment, nil);
+        }
+    }
+
+    thrd_t *threads = mtb_arena_bump(arena, thrd_t, threadCount);
+    _BenchMtbCmapRcuWorker *workers = mtb_arena_bump(arena, _BenchMtbCmapRcuWorker, threadCount);
+
+    // every thread looks up the whole corpus
+    u64 beg = mtb_perf_sys_time();
+    for (u64 i = 0; i < threadCount; i++) {
+        workers[i] = (_BenchMtbCmapRcuWorker){
+            .rcu = rcuMode ? &rcu : nil,
+            .cmap = &cmap,
+            .tokens = mtb_dynarr_get(tokens, 0),
+            .count = tokens->length,
+        };
+        mtb_assert_always(thrd_create(&threads[i], _bench_mtb_cmap_rcu_worker_run, &workers[i]) == thrd_success);
+    }
+    for (u64 i = 0; i < threadCount; i++) {
+        mtb_assert_always(thrd_join(threads[i], nil) == thrd_success);
+        assert(workers[i].found == tokens->length);
+    }
+    u64 elapsed = mtb_perf_sys_time() - beg;
+
+    f64 seconds = (f64)elapsed / (f64)mtb_perf_sys_freq();
+    printf("%s, %lu threads: %.3f s, %.2f M lookups/s\n",
+           rcuMode ? "rcu" : "mutex",
+           threadCount,
+           seconds,
+           (f64)(tokens->length * threadCount) / seconds / 1e6);
+
+    if (rcuMode) {
+        mtb_cmap_rcu_deinit(&rcu);
+    }
+    else {
+        mtb_cmap_deinit(&cmap);
+    }
+}
+
+func void
+_bench_mtb_cmap(MtbDynArr *tokens)
+{
+    MtbArena arena = {0};
+    mtb_arena_init(&arena, mb(128), &MTB_ARENA_DEF_ALLOCATOR);
+
+    u64 cpuCount = (u64)sysconf(_SC_NPROCESSORS_ONLN);
+    printf("== word count, sharded concurrent map ==\n");
+    for (u64 threadCount = 1; threadCount <= cpuCount; threadCount <<= 1) {
+        _bench_mtb_cmap_word_count(&arena, tokens, threadCount);
+        if (threadCount < cpuCount && threadCount << 1 > cpuCount) {
+            _bench_mtb_cmap_word_count(&arena, tokens, cpuCount);
+        }
+    }
+
+    printf("== lookups, mutex vs read-mostly (rcu) map ==\n");
+    for (u64 threadCount = 1; threadCount <= cpuCount; threadCount <<= 1) {
+        _bench_mtb_cmap_rcu_lookup(&arena, tokens, threadCount, false);
+        _bench_mtb_cmap_rcu_lookup(&arena, tokens, threadCount, true);
+    }
+
+    mtb_arena_deinit(&arena);
+}
+
+#endif // MTB_CMAP_BENCH
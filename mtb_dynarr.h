@@ -97,6 +97,11 @@ mtb_dynarr_grow(MtbDynArr *array, u64 capacity)
 {
     mtb_assert_always(capacity > array->capacity);
 
+    // in place if the items are the last allocation, e.g. always in a reserved arena w/ a single array
+    if (array->items != nil && mtb_arena_resize(array->arena, array->items, array->capacity, capacity)) {
+        array->capacity = capacity;
+        return;
+    }
     u8 *oldItems = array->items;
     array->items = mtb_arena_bump(array->arena, u8, capacity);
     if (!mtb_dynarr_is_empty(array)) {
@@ -341,9 +346,11 @@ _test_mtb_dynarr_grow(MtbArena arena)
     assert(array.capacity == count * array.itemSize);
     assert(array.length == count);
 
+    u8 *items = array.items;
     mtb_dynarr_insert(&array, array.length);
     assert(array.capacity >= (count + 1) * array.itemSize);
     assert(array.length == count + 1);
+    assert(array.items == items); // the last allocation grows in place
 
     mtb_dynarr_clear(&array);
     assert(array.capacity >= (count + 1) * array.itemSize);
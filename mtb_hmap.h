@@ -18,10 +18,37 @@
 #define MTB_HMAP_MIN_CAPACITY 16
 #endif
 
+#ifndef MTB_HMAP_DEF_MAX_LOAD
+#define MTB_HMAP_DEF_MAX_LOAD 0.75f
+#endif
+
+#ifndef MTB_HMAP_MIGRATE_STEP
+#define MTB_HMAP_MIGRATE_STEP 64 // old slots moved per operation during an incremental resize
+#endif
+
+#ifndef MTB_HMAP_BATCH_SIZE
+#define MTB_HMAP_BATCH_SIZE 32 // keys hashed and prefetched ahead of resolving them
+#endif
+
+#ifndef MTB_HMAP_SMALL_CAPACITY
+#define MTB_HMAP_SMALL_CAPACITY 8 // entries kept w/o hashing in small mode, must be power of 2
+#endif
+
+#define MTB_HMAP_GROUP_WIDTH 16
+
+#ifndef MTB_HMAP_STATS_PROBES
+#define MTB_HMAP_STATS_PROBES 16 // probe length histogram buckets
+#endif
+
+#define MTB_HMAP_FILE_MAGIC 0x5041484d4254424dull // "MBTBMHAP"
+#define MTB_HMAP_FILE_VERSION 2
+#define MTB_HMAP_FILE_ALIGN 4096 // the table starts page aligned in the file
+
 #define mtb_hmap_entry(hmap, index) ((hmap)->entries + (index) * (hmap)->entrySize)
 #define mtb_hmap_entry_header(hmap, entry) ((MtbHmapHeader *)(entry))
 #define mtb_hmap_entry_key(hmap, entry) ((entry) + (hmap)->headerSize)
 #define mtb_hmap_entry_value(hmap, entry) (mtb_hmap_entry_key(hmap, entry) + (hmap)->keySize)
+#define mtb_hmap_entry_hash(hmap, entry) ((u64 *)(mtb_hmap_entry_key(hmap, entry) - sizeof(u64))) // storeHash only
 
 
 typedef u8 MtbHmapEntryStatus;
@@ -29,7 +56,24 @@ enum
 {
     MTB_HMAP_ENTRY_FREE = 0,
     MTB_HMAP_ENTRY_OCCUPIED = 1,
-    MTB_HMAP_ENTRY_REMOVED = 2,
+};
+
+// Group probing keeps the entry status in a separate control array,
+// one byte per entry: either EMPTY, DELETED or 7 low bits of the hash.
+typedef u8 MtbHmapCtrl;
+enum
+{
+    MTB_HMAP_CTRL_EMPTY = 0x80,
+    MTB_HMAP_CTRL_DELETED = 0xFE,
+};
+
+typedef u8 MtbHmapProbing;
+enum
+{
+    MTB_HMAP_PROBING_LINEAR = 0, // entry by entry, status interleaved with key and value
+    MTB_HMAP_PROBING_GROUP = 1,  // MTB_HMAP_GROUP_WIDTH control bytes at a time (SSE2 if available)
+    MTB_HMAP_PROBING_ROBIN_HOOD = 2, // linear w/ displacement, status stores probe distance + 1,
+                                     // falls back to linear for good if a distance overflows it (many equal hashes)
 };
 
 typedef struct mtb_hmap_header MtbHmapHeader;
@@ -45,13 +89,32 @@ struct mtb_hmap
 
     u64 capacity; // must be power of 2!
     u64 count;
+    u64 deleted; // tombstones, group probing only
+    u64 threshold;
+    f32 maxLoad;
+
+    MtbHmapProbing probing;
+    MtbHmapCtrl *ctrl; // group probing only
+    bool storeHash;
+    bool small; // the first count entries are used and scanned w/o hashing, no ctrl
 
     u64 headerSize;
-    u64 keySize;
+    u64 keySize; // padded to the entry alignment
     u64 valueSize;
     u64 entrySize;
+    u64 keyBytes; // as given to init, what is copied from the caller's key
+    u64 valueBytes;
+    u64 align; // of the entry fields
     u8 *entries;
 
+    // incremental resize only, the previous table while it's being migrated
+    bool incremental;
+    u64 oldCapacity;
+    u8 *oldEntries; // nil when no resize is in progress
+    MtbHmapCtrl *oldCtrl;
+    u64 oldBeg;     // first old slot to migrate, no cluster wraps past it
+    u64 migrated;   // old slots migrated so far
+
     u64 (*key_hash)(void *k);
     bool (*key_equals)(void *k1, void *k2);
 };
@@ -62,6 +125,11 @@ struct mtb_hmap_init_options
     u64 capacity;
     u64 keyAlign;
     u64 valueAlign;
+    MtbHmapProbing probing;
+    bool storeHash; // keep the full hash in the entry header
+    f32 maxLoad;    // grow above this load factor, MTB_HMAP_DEF_MAX_LOAD if 0
+    bool incremental; // spread rehashing on grow over the following operations
+    bool small; // start in small mode until more than MTB_HMAP_SMALL_CAPACITY keys, w/ capacity 0 only
 };
 
 
@@ -87,12 +155,95 @@ func void mtb_hmap_init_opt(MtbHmap *hmap,
 func void mtb_hmap_clear(MtbHmap *hmap);
 func bool mtb_hmap_is_empty(MtbHmap *hmap);
 func void mtb_hmap_grow(MtbHmap *hmap, u64 capacity);
+func void mtb_hmap_clone(MtbHmap *hmap, MtbArena *arena, MtbHmap *src); // finishes a pending resize of src first
 func u64 mtb_hmap_calc_capacity(u64 n);
 
 func void *mtb_hmap_put(MtbHmap *hmap, void *key);
-func void *mtb_hmap_remove(MtbHmap *hmap, void *key);
+func void *mtb_hmap_upsert(MtbHmap *hmap, void *key, bool *inserted); // put, tells whether the key is new
+// With incremental resize every call may move entries, results are valid until the next call.
+func void *mtb_hmap_remove(MtbHmap *hmap, void *key); // result is valid until the next put/remove
 func void *mtb_hmap_get(MtbHmap *hmap, void *key);
 
+// Same as above w/ the hash already computed, it must be hmap->key_hash(key).
+func void *mtb_hmap_upsert_hashed(MtbHmap *hmap, void *key, u64 hash, bool *inserted);
+func void *mtb_hmap_remove_hashed(MtbHmap *hmap, void *key, u64 hash);
+func void *mtb_hmap_get_hashed(MtbHmap *hmap, void *key, u64 hash);
+
+// Same as put/get for count keys that are keyStride bytes apart, values[i] is the result for the i-th key.
+// Hashing and prefetching a batch ahead overlaps the cache misses of big tables.
+func void mtb_hmap_put_batch(MtbHmap *hmap, void *keys, u64 keyStride, u64 count, void **values);
+func void mtb_hmap_get_batch(MtbHmap *hmap, void *keys, u64 keyStride, u64 count, void **values);
+
+
+/* Diagnostics API */
+
+// Probe lengths and displacements are counted in slots, in groups w/ group probing.
+typedef struct mtb_hmap_stats MtbHmapStats;
+struct mtb_hmap_stats
+{
+    u64 count;
+    u64 capacity;
+    u64 tombstones;
+    u64 bytes; // of the table
+    f64 load;
+
+    u64 probes[MTB_HMAP_STATS_PROBES]; // entries found w/ i + 1 probes, the last bucket counts the longer ones
+    f64 avgDisplacement;
+    u64 maxDisplacement;
+
+    // runs of occupied slots (of groups w/o an empty slot w/ group probing) a miss may walk through
+    u64 clusterCount;
+    f64 avgCluster;
+    u64 maxCluster;
+};
+
+
+// Scans the whole table (finishing a pending incremental resize first).
+func void mtb_hmap_stats(MtbHmap *hmap, MtbHmapStats *stats);
+func void mtb_hmap_stats_print(MtbHmapStats *stats, const char *name); // through the mtb_perf report format
+
+
+/* Snapshot API */
+
+// The table block is written as is after a header w/ the layout parameters, so keys and values
+// must be plain data (no pointers). The file is only portable across the same architecture.
+typedef struct mtb_hmap_file_header MtbHmapFileHeader;
+struct mtb_hmap_file_header
+{
+    u64 magic;
+    u64 version;
+    u64 size; // of the file
+    u64 capacity;
+    u64 count;
+    u64 deleted;
+    u64 probing;
+    u64 storeHash;
+    u64 headerSize;
+    u64 keySize;
+    u64 valueSize;
+    u64 entrySize;
+    u64 keyBytes; // as given to init, checked against the mapping caller's
+    u64 valueBytes;
+    u64 align;
+    u64 ctrlOffset; // from the table, group probing only
+    f32 maxLoad;
+};
+
+
+// Returns false on I/O errors. The map itself changes, the contents don't: a pending incremental
+// resize is finished and a small map is grown out of small mode, so the table is a single block.
+func bool mtb_hmap_save(MtbHmap *hmap, char *path);
+// Maps the file read-only, the map can be queried right away (get, get_batch, iteration)
+// but not modified. keySize and valueSize must be the ones the map was built with, or it fails,
+// key_hash must be the function the map was built with.
+func bool mtb_hmap_map(MtbHmap *hmap,
+                       char *path,
+                       u64 keySize,
+                       u64 valueSize,
+                       u64 (*key_hash)(void *k),
+                       bool (*key_equals)(void *k1, void *k2));
+func void mtb_hmap_unmap(MtbHmap *hmap);
+
 
 /* Iterator API */
 
@@ -102,6 +253,8 @@ struct mtb_hmap_iter
     MtbHmap *hmap;
     u8 *prev;
     u8 *next;
+    u64 beg;   // first slot to visit, no cluster wraps past it
+    u64 index; // slots visited so far
 };
 
 
@@ -113,260 +266,1513 @@ func void *mtb_hmap_iter_next_key(MtbHmapIter *it);
 func void *mtb_hmap_iter_next_value(MtbHmapIter *it);
 func void *mtb_hmap_iter_remove(MtbHmapIter *it);
 
+
+/* Typed API */
+
+// Generates a linear probing hash map specialized for key type K and value type V,
+// so that key_hash(K *) and key_equals(K *, K *) can be inlined and the entry stride is
+// known at compile time. Expand it once per type pair, after the MTB implementation:
+//
+//     MTB_HMAP_DEFINE(U64Map, u64_map, u64, u64, hash_u64, equals_u64)
+//
+//     U64Map map = {0};
+//     u64_map_init(&map, &arena, 0);
+//     *u64_map_put(&map, &key) += 1;
+//
+#define MTB_HMAP_DEFINE(Name, name, K, V, key_hash, key_equals) \
+    typedef struct name##_entry Name##Entry; \
+    struct name##_entry \
+    { \
+        MtbHmapEntryStatus status; \
+        K key; \
+        V value; \
+    }; \
+    \
+    typedef struct name Name; \
+    struct name \
+    { \
+        MtbArena *arena; \
+        u64 capacity; /* must be power of 2! */ \
+        u64 count; \
+        u64 threshold; \
+        Name##Entry *entries; /* +1 spare entry past the end, holds the removed entry */ \
+    }; \
+    \
+    typedef struct name##_iter Name##Iter; \
+    struct name##_iter \
+    { \
+        Name *hmap; \
+        u64 index; \
+    }; \
+    \
+    func void \
+    name##_init(Name *hmap, MtbArena *arena, u64 capacity) \
+    { \
+        mtb_assert_always(mtb_is_pow2_or_zero(capacity)); \
+        hmap->arena = arena; \
+        hmap->capacity = capacity < MTB_HMAP_MIN_CAPACITY ? MTB_HMAP_MIN_CAPACITY : capacity; \
+        hmap->count = 0; \
+        hmap->threshold = (u64)((f32)hmap->capacity * MTB_HMAP_DEF_MAX_LOAD); \
+        hmap->entries = mtb_arena_bump(arena, Name##Entry, hmap->capacity + 1); \
+    } \
+    \
+    func void \
+    name##_clear(Name *hmap) \
+    { \
+        hmap->count = 0; \
+        memset(hmap->entries, 0, hmap->capacity * sizeof(Name##Entry)); \
+    } \
+    \
+    func Name##Entry * \
+    _##name##_probe(Name *hmap, K *key) /* the key's entry, or the free one ending its cluster */ \
+    { \
+        u64 mask = hmap->capacity - 1; \
+        u64 index = key_hash(key) & mask; \
+        Name##Entry *entry = hmap->entries + index; \
+        while (entry->status == MTB_HMAP_ENTRY_OCCUPIED && !key_equals(&entry->key, key)) { \
+            index = (index + 1) & mask; \
+            entry = hmap->entries + index; \
+        } \
+        return entry; \
+    } \
+    \
+    func void \
+    name##_grow(Name *hmap, u64 capacity) \
+    { \
+        mtb_assert_always(mtb_is_pow2(capacity)); \
+        mtb_assert_always(capacity > hmap->capacity); \
+        \
+        Name oldHmap = *hmap; \
+        u64 oldSize = (oldHmap.capacity + 1) * sizeof(Name##Entry); \
+        u64 size = mtb_mul_u64(capacity + 1, sizeof(Name##Entry)); \
+        \
+        /* same as mtb_hmap_grow, rehash behind the last arena allocation and move down */ \
+        bool inPlace = mtb_arena_resize(hmap->arena, oldHmap.entries, oldSize, mtb_add_u64(oldSize, size)); \
+        hmap->entries = inPlace ? oldHmap.entries + oldHmap.capacity + 1 : mtb_arena_bump(hmap->arena, Name##Entry, capacity + 1); \
+        hmap->capacity = capacity; \
+        hmap->threshold = (u64)((f32)capacity * MTB_HMAP_DEF_MAX_LOAD); \
+        \
+        for (u64 oldIndex = 0; oldIndex < oldHmap.capacity; oldIndex++) { \
+            Name##Entry *oldEntry = oldHmap.entries + oldIndex; \
+            if (oldEntry->status == MTB_HMAP_ENTRY_OCCUPIED) { \
+                *_##name##_probe(hmap, &oldEntry->key) = *oldEntry; \
+            } \
+        } \
+        \
+        if (inPlace) { \
+            memmove(oldHmap.entries, hmap->entries, size); \
+            mtb_arena_resize(hmap->arena, oldHmap.entries, oldSize + size, size); \
+            hmap->entries = oldHmap.entries; \
+        } \
+    } \
+    \
+    func V * \
+    name##_upsert(Name *hmap, K *key, bool *inserted) \
+    { \
+        if (hmap->count >= hmap->threshold) { \
+            name##_grow(hmap, hmap->capacity << 1); \
+        } \
+        Name##Entry *entry = _##name##_probe(hmap, key); \
+        *inserted = entry->status == MTB_HMAP_ENTRY_FREE; \
+        if (*inserted) { \
+            memset(entry, 0, sizeof(Name##Entry)); \
+            entry->status = MTB_HMAP_ENTRY_OCCUPIED; \
+            entry->key = *key; \
+            hmap->count++; \
+        } \
+        return &entry->value; \
+    } \
+    \
+    func V * \
+    name##_put(Name *hmap, K *key) \
+    { \
+        bool inserted; \
+        return name##_upsert(hmap, key, &inserted); \
+    } \
+    \
+    func V * \
+    name##_remove(Name *hmap, K *key) /* result is valid until the next put/remove */ \
+    { \
+        Name##Entry *entry = _##name##_probe(hmap, key); \
+        if (entry->status == MTB_HMAP_ENTRY_FREE) { \
+            return nil; \
+        } \
+        Name##Entry *removed = hmap->entries + hmap->capacity; \
+        *removed = *entry; \
+        \
+        /* backward shift, see _mtb_hmap_linear_erase */ \
+        u64 mask = hmap->capacity - 1; \
+        u64 hole = (u64)(entry - hmap->entries); \
+        for (u64 index = (hole + 1) & mask; hmap->entries[index].status == MTB_HMAP_ENTRY_OCCUPIED; index = (index + 1) & mask) { \
+            u64 home = key_hash(&hmap->entries[index].key) & mask; \
+            if (((index - home) & mask) >= ((index - hole) & mask)) { \
+                hmap->entries[hole] = hmap->entries[index]; \
+                hole = index; \
+            } \
+        } \
+        hmap->entries[hole].status = MTB_HMAP_ENTRY_FREE; \
+        hmap->count--; \
+        return &removed->value; \
+    } \
+    \
+    func V * \
+    name##_get(Name *hmap, K *key) \
+    { \
+        Name##Entry *entry = _##name##_probe(hmap, key); \
+        return entry->status == MTB_HMAP_ENTRY_FREE ? nil : &entry->value; \
+    } \
+    \
+    func void \
+    name##_iter_init(Name##Iter *it, Name *hmap) \
+    { \
+        it->hmap = hmap; \
+        it->index = 0; \
+    } \
+    \
+    func bool \
+    name##_iter_has_next(Name##Iter *it) \
+    { \
+        for (; it->index < it->hmap->capacity; it->index++) { \
+            if (it->hmap->entries[it->index].status == MTB_HMAP_ENTRY_OCCUPIED) { \
+                return true; \
+            } \
+        } \
+        return false; \
+    } \
+    \
+    func Name##Entry * \
+    name##_iter_next(Name##Iter *it) \
+    { \
+        mtb_assert_always(it->index < it->hmap->capacity); \
+        return it->hmap->entries + it->index++; \
+    }
+
 #endif //MTB_HMAP_H
 
 
 #ifdef MTB_HMAP_IMPLEMENTATION
 
-#define _mtb_hmap_threshold(capacity) ((capacity) - ((capacity) >> 2)) // 0.75 * capacity
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+#define _mtb_hmap_threshold(capacity, maxLoad) ((u64)((f32)(capacity) * (maxLoad)))
 #define _mtb_hmap_modulo_capacity(hmap, n) ((n) & ((hmap)->capacity - 1))
+#define _mtb_hmap_entry_index(hmap, entry) ((u64)((entry) - (hmap)->entries) / (hmap)->entrySize)
 
+#define _mtb_hmap_h1(hash) ((hash) >> 7)
+#define _mtb_hmap_h2(hash) ((MtbHmapCtrl)((hash) & 0x7F))
+#define _mtb_hmap_ctrl_is_full(c) ((c) < MTB_HMAP_CTRL_EMPTY)
+#define _mtb_hmap_group_mask(hmap) (((hmap)->capacity / MTB_HMAP_GROUP_WIDTH) - 1)
+#define _mtb_hmap_group_ctrl(hmap, group) ((hmap)->ctrl + (group) * MTB_HMAP_GROUP_WIDTH)
 
-func void
-mtb_hmap_init_opt(MtbHmap *hmap,
-                  MtbArena *arena,
-                  u64 keySize,
-                  u64 valueSize,
-                  u64 (*key_hash)(void *k),
-                  bool (*key_equals)(void *k1, void *k2),
-                  MtbHmapInitOptions opt)
-{
-    mtb_assert_always(mtb_is_pow2_or_zero(opt.capacity));
-    mtb_assert_always(mtb_is_pow2_or_zero(keySize));
-    mtb_assert_always(mtb_is_pow2_or_zero(opt.keyAlign));
-    mtb_assert_always(mtb_is_pow2_or_zero(valueSize));
-    mtb_assert_always(mtb_is_pow2_or_zero(opt.valueAlign));
+#define _MTB_HMAP_ROBIN_HOOD_MAX_STATUS 0xFF
 
-    hmap->arena = arena;
 
-    hmap->capacity = opt.capacity < MTB_HMAP_MIN_CAPACITY ? MTB_HMAP_MIN_CAPACITY : opt.capacity;
-    hmap->count = 0;
+func u32
+_mtb_hmap_group_match(MtbHmapCtrl *group, MtbHmapCtrl ctrl)
+{
+#ifdef __SSE2__
+    __m128i bytes = _mm_load_si128((__m128i *)group);
+    return (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8((char)ctrl)));
+#else
+    u32 mask = 0;
+    for (u32 i = 0; i < MTB_HMAP_GROUP_WIDTH; i++) {
+        mask |= (u32)(group[i] == ctrl) << i;
+    }
+    return mask;
+#endif
+}
 
-    u64 align = mtb_max_u64(mtb_alignof(MtbHmapHeader), mtb_max_u64(opt.keyAlign, opt.valueAlign));
-    hmap->headerSize = mtb_align_pow2(sizeof(MtbHmapHeader), align);
-    hmap->keySize = mtb_align_pow2(keySize, align);
-    hmap->valueSize = mtb_align_pow2(valueSize, align);
-    hmap->entrySize = hmap->headerSize + hmap->keySize + hmap->valueSize;
+func u32
+_mtb_hmap_group_match_empty_or_deleted(MtbHmapCtrl *group)
+{
+#ifdef __SSE2__
+    return (u32)_mm_movemask_epi8(_mm_load_si128((__m128i *)group));
+#else
+    u32 mask = 0;
+    for (u32 i = 0; i < MTB_HMAP_GROUP_WIDTH; i++) {
+        mask |= (u32)(group[i] >> 7) << i;
+    }
+    return mask;
+#endif
+}
 
-    hmap->entries = mtb_arena_bump(hmap->arena, u8, hmap->capacity * hmap->entrySize);
+// Entries and control bytes live in a single block: [entries] [spare entry] [ctrl (group probing only)]
+func u64
+_mtb_hmap_block_size(MtbHmap *hmap)
+{
+    // +1 spare entry past the end, holds removed or swapped entries
+    u64 entriesSize = mtb_mul_u64(hmap->capacity + 1, hmap->entrySize);
+    if (hmap->probing != MTB_HMAP_PROBING_GROUP || hmap->small) {
+        return entriesSize;
+    }
+    return mtb_add_u64(mtb_align_pow2(entriesSize, MTB_HMAP_GROUP_WIDTH), hmap->capacity);
+}
 
-    hmap->key_hash = key_hash;
-    hmap->key_equals = key_equals;
+func void
+_mtb_hmap_init_block(MtbHmap *hmap, u8 *block) // block must be zeroed
+{
+    hmap->entries = block;
+    hmap->threshold = hmap->small ? hmap->capacity : _mtb_hmap_threshold(hmap->capacity, hmap->maxLoad);
+    if (hmap->probing == MTB_HMAP_PROBING_GROUP && !hmap->small) {
+        hmap->ctrl = block + mtb_align_pow2((hmap->capacity + 1) * hmap->entrySize, MTB_HMAP_GROUP_WIDTH);
+        memset(hmap->ctrl, MTB_HMAP_CTRL_EMPTY, hmap->capacity);
+    }
 }
 
 func void
-mtb_hmap_clear(MtbHmap *hmap)
+_mtb_hmap_alloc(MtbHmap *hmap)
 {
-    hmap->count = 0;
-    memset(hmap->entries, 0, hmap->capacity * hmap->entrySize);
+    _mtb_hmap_init_block(hmap, mtb_arena_bump(hmap->arena, u8, _mtb_hmap_block_size(hmap), .align = MTB_HMAP_GROUP_WIDTH));
 }
 
 func bool
-mtb_hmap_is_empty(MtbHmap *hmap)
+_mtb_hmap_is_occupied(MtbHmap *hmap, u64 index)
 {
-    return hmap->count == 0;
+    if (hmap->small) {
+        return index < hmap->count;
+    }
+    if (hmap->probing == MTB_HMAP_PROBING_GROUP) {
+        return _mtb_hmap_ctrl_is_full(hmap->ctrl[index]);
+    }
+    return mtb_hmap_entry_header(hmap, mtb_hmap_entry(hmap, index))->status != MTB_HMAP_ENTRY_FREE;
 }
 
-func u64
-mtb_hmap_calc_capacity(u64 n)
+func bool
+_mtb_hmap_entry_matches(MtbHmap *hmap, u8 *entry, void *key, u64 hash)
 {
-    u64 capacity = n + (n / 3);
-    if (capacity < MTB_HMAP_MIN_CAPACITY) {
-        return MTB_HMAP_MIN_CAPACITY;
+    if (hmap->storeHash && *mtb_hmap_entry_hash(hmap, entry) != hash) {
+        return false;
     }
-    return mtb_roundup_pow2(capacity);
+    return hmap->key_equals(mtb_hmap_entry_key(hmap, entry), key);
 }
 
-func void
-mtb_hmap_grow(MtbHmap *hmap, u64 capacity)
+func u64
+_mtb_hmap_entry_rehash(MtbHmap *hmap, u8 *entry)
 {
-    mtb_assert_always(mtb_is_pow2(capacity));
-    mtb_assert_always(capacity > hmap->capacity);
-
-    MtbHmap oldHmap = *hmap;
-
-    hmap->count = 0;
-    hmap->capacity = capacity;
-    hmap->entries = mtb_arena_bump(hmap->arena, u8, hmap->capacity * hmap->entrySize);
+    // small mode doesn't fill in the stored hash
+    return hmap->storeHash && !hmap->small ? *mtb_hmap_entry_hash(hmap, entry) : hmap->key_hash(mtb_hmap_entry_key(hmap, entry));
+}
 
-    for (u64 oldIndex = 0; oldIndex < oldHmap.capacity; oldIndex++) {
-        u8 *oldEntry = mtb_hmap_entry(&oldHmap, oldIndex);
-        if (mtb_hmap_entry_header(&oldHmap, oldEntry)->status != MTB_HMAP_ENTRY_OCCUPIED) {
-            continue;
-        }
-        u64 hash = hmap->key_hash(mtb_hmap_entry_key(&oldHmap, oldEntry));
-        u64 index = _mtb_hmap_modulo_capacity(hmap, hash);
-        u8 *entry = mtb_hmap_entry(hmap, index);
-        while (mtb_hmap_entry_header(hmap, entry)->status == MTB_HMAP_ENTRY_OCCUPIED) {
-            index = _mtb_hmap_modulo_capacity(hmap, index + 1);
-            entry = mtb_hmap_entry(hmap, index);
+func u8 *
+_mtb_hmap_linear_find(MtbHmap *hmap, void *key, u64 hash)
+{
+    u64 index = _mtb_hmap_modulo_capacity(hmap, hash);
+    u8 *entry = mtb_hmap_entry(hmap, index);
+    while (mtb_hmap_entry_header(hmap, entry)->status == MTB_HMAP_ENTRY_OCCUPIED) {
+        if (_mtb_hmap_entry_matches(hmap, entry, key, hash)) {
+            return entry;
         }
-        memcpy(entry, oldEntry, hmap->entrySize);
-        hmap->count++;
+        index = _mtb_hmap_modulo_capacity(hmap, index + 1);
+        entry = mtb_hmap_entry(hmap, index);
     }
+    return nil;
 }
 
-func void *
-mtb_hmap_put(MtbHmap *hmap, void *key)
+func u8 *
+_mtb_hmap_linear_insert(MtbHmap *hmap, void *key, u64 hash, bool *inserted)
 {
-    if (hmap->count >= _mtb_hmap_threshold(hmap->capacity)) {
-        mtb_hmap_grow(hmap, hmap->capacity << 1);
-    }
-    u64 hash = hmap->key_hash(key);
     u64 index = _mtb_hmap_modulo_capacity(hmap, hash);
     u8 *entry = mtb_hmap_entry(hmap, index);
     while (mtb_hmap_entry_header(hmap, entry)->status == MTB_HMAP_ENTRY_OCCUPIED) {
-        if (hmap->key_equals(mtb_hmap_entry_key(hmap, entry), key)) {
-            return mtb_hmap_entry_value(hmap, entry);
+        if (key != nil && _mtb_hmap_entry_matches(hmap, entry, key, hash)) {
+            *inserted = false;
+            return entry;
         }
         index = _mtb_hmap_modulo_capacity(hmap, index + 1);
         entry = mtb_hmap_entry(hmap, index);
     }
     mtb_hmap_entry_header(hmap, entry)->status = MTB_HMAP_ENTRY_OCCUPIED;
-    memcpy(mtb_hmap_entry_key(hmap, entry), key, hmap->keySize);
-    hmap->count++;
-    return mtb_hmap_entry_value(hmap, entry);
+    *inserted = true;
+    return entry;
 }
 
-func void *
-mtb_hmap_remove(MtbHmap *hmap, void *key)
+func u8 *
+_mtb_hmap_linear_erase(MtbHmap *hmap, u8 *entry)
 {
-    u64 hash = hmap->key_hash(key);
-    u64 index = _mtb_hmap_modulo_capacity(hmap, hash);
-    u8 *entry = mtb_hmap_entry(hmap, index);
-    while (mtb_hmap_entry_header(hmap, entry)->status != MTB_HMAP_ENTRY_FREE) {
-        if (mtb_hmap_entry_header(hmap, entry)->status != MTB_HMAP_ENTRY_REMOVED) {
-            if (hmap->key_equals(mtb_hmap_entry_key(hmap, entry), key)) {
-                mtb_hmap_entry_header(hmap, entry)->status = MTB_HMAP_ENTRY_REMOVED;
-                hmap->count--;
-                return mtb_hmap_entry_value(hmap, entry);
-            }
+    u8 *removed = mtb_hmap_entry(hmap, hmap->capacity);
+    memcpy(removed, entry, hmap->entrySize);
+
+    // Backward shift: pull every following entry of the cluster that
+    // may live in the hole closer to its home slot, so no tombstones.
+    u64 hole = _mtb_hmap_entry_index(hmap, entry);
+    u64 index = _mtb_hmap_modulo_capacity(hmap, hole + 1);
+    u8 *next = mtb_hmap_entry(hmap, index);
+    while (mtb_hmap_entry_header(hmap, next)->status == MTB_HMAP_ENTRY_OCCUPIED) {
+        u64 home = _mtb_hmap_modulo_capacity(hmap, _mtb_hmap_entry_rehash(hmap, next));
+        if (_mtb_hmap_modulo_capacity(hmap, index - home) >= _mtb_hmap_modulo_capacity(hmap, index - hole)) {
+            memcpy(mtb_hmap_entry(hmap, hole), next, hmap->entrySize);
+            hole = index;
         }
         index = _mtb_hmap_modulo_capacity(hmap, index + 1);
-        entry = mtb_hmap_entry(hmap, index);
+        next = mtb_hmap_entry(hmap, index);
     }
-    return nil;
+    mtb_hmap_entry_header(hmap, mtb_hmap_entry(hmap, hole))->status = MTB_HMAP_ENTRY_FREE;
+
+    return removed;
 }
 
-func void *
-mtb_hmap_get(MtbHmap *hmap, void *key)
+func u8 *
+_mtb_hmap_robin_hood_find(MtbHmap *hmap, void *key, u64 hash)
 {
-    u64 hash = hmap->key_hash(key);
     u64 index = _mtb_hmap_modulo_capacity(hmap, hash);
-    u8 *entry = mtb_hmap_entry(hmap, index);
-    while (mtb_hmap_entry_header(hmap, entry)->status != MTB_HMAP_ENTRY_FREE) {
-        if (mtb_hmap_entry_header(hmap, entry)->status != MTB_HMAP_ENTRY_REMOVED) {
-            if (hmap->key_equals(mtb_hmap_entry_key(hmap, entry), key)) {
-                return mtb_hmap_entry_value(hmap, entry);
-            }
+    for (u64 status = MTB_HMAP_ENTRY_OCCUPIED; ; status++) {
+        u8 *entry = mtb_hmap_entry(hmap, index);
+        u64 entryStatus = mtb_hmap_entry_header(hmap, entry)->status;
+        if (entryStatus < status) {
+            return nil; // free, or closer to its home than the key would be
+        }
+        if (entryStatus == status && _mtb_hmap_entry_matches(hmap, entry, key, hash)) {
+            return entry;
         }
         index = _mtb_hmap_modulo_capacity(hmap, index + 1);
-        entry = mtb_hmap_entry(hmap, index);
     }
-    return nil;
 }
 
-func void
-mtb_hmap_iter_init(MtbHmapIter *it, MtbHmap *hmap)
+// Returns nil if some probe distance would no longer fit the status.
+func u8 *
+_mtb_hmap_robin_hood_insert(MtbHmap *hmap, void *key, u64 hash, bool *inserted)
 {
-    it->hmap = hmap;
-    mtb_hmap_iter_reset(it);
+    u64 index = _mtb_hmap_modulo_capacity(hmap, hash);
+    u64 status = MTB_HMAP_ENTRY_OCCUPIED;
+    for (;; status++) {
+        u8 *entry = mtb_hmap_entry(hmap, index);
+        u64 entryStatus = mtb_hmap_entry_header(hmap, entry)->status;
+        if (entryStatus < status) {
+            break;
+        }
+        if (key != nil && entryStatus == status && _mtb_hmap_entry_matches(hmap, entry, key, hash)) {
+            *inserted = false;
+            return entry;
+        }
+        index = _mtb_hmap_modulo_capacity(hmap, index + 1);
+    }
+    if (status > _MTB_HMAP_ROBIN_HOOD_MAX_STATUS) {
+        return nil;
+    }
+
+    // Take the slot from the richer entry by shifting the rest of the
+    // cluster one slot forward, each shifted entry gets one step further.
+    u64 last = index;
+    MtbHmapEntryStatus lastStatus;
+    while ((lastStatus = mtb_hmap_entry_header(hmap, mtb_hmap_entry(hmap, last))->status) != MTB_HMAP_ENTRY_FREE) {
+        if (lastStatus == _MTB_HMAP_ROBIN_HOOD_MAX_STATUS) {
+            return nil;
+        }
+        last = _mtb_hmap_modulo_capacity(hmap, last + 1);
+    }
+    while (last != index) {
+        u64 prev = _mtb_hmap_modulo_capacity(hmap, last - 1);
+        u8 *entry = mtb_hmap_entry(hmap, last);
+        memcpy(entry, mtb_hmap_entry(hmap, prev), hmap->entrySize);
+        mtb_hmap_entry_header(hmap, entry)->status++;
+        last = prev;
+    }
+
+    u8 *entry = mtb_hmap_entry(hmap, index);
+    mtb_hmap_entry_header(hmap, entry)->status = (MtbHmapEntryStatus)status;
+    *inserted = true;
+    return entry;
 }
 
-func void
-mtb_hmap_iter_reset(MtbHmapIter *it)
+func u8 *
+_mtb_hmap_robin_hood_erase(MtbHmap *hmap, u8 *entry)
 {
-    it->prev = nil;
-    it->next = nil;
+    u8 *removed = mtb_hmap_entry(hmap, hmap->capacity);
+    memcpy(removed, entry, hmap->entrySize);
+
+    // Backward shift until an entry already sits in its home slot.
+    u64 hole = _mtb_hmap_entry_index(hmap, entry);
+    u64 index = _mtb_hmap_modulo_capacity(hmap, hole + 1);
+    u8 *next = mtb_hmap_entry(hmap, index);
+    while (mtb_hmap_entry_header(hmap, next)->status > MTB_HMAP_ENTRY_OCCUPIED) {
+        u8 *holeEntry = mtb_hmap_entry(hmap, hole);
+        memcpy(holeEntry, next, hmap->entrySize);
+        mtb_hmap_entry_header(hmap, holeEntry)->status--;
+        hole = index;
+        index = _mtb_hmap_modulo_capacity(hmap, index + 1);
+        next = mtb_hmap_entry(hmap, index);
+    }
+    mtb_hmap_entry_header(hmap, mtb_hmap_entry(hmap, hole))->status = MTB_HMAP_ENTRY_FREE;
+
+    return removed;
 }
 
-func bool
-mtb_hmap_iter_has_next(MtbHmapIter *it)
+func u8 *
+_mtb_hmap_group_find(MtbHmap *hmap, void *key, u64 hash)
 {
-    u8 *next = it->prev == nil ? it->hmap->entries : it->prev + it->hmap->entrySize;
-    u8 *end = it->hmap->entries + it->hmap->capacity * it->hmap->entrySize;
-    while (next < end) {
-        if (mtb_hmap_entry_header(it->hmap, next)->status == MTB_HMAP_ENTRY_OCCUPIED) {
-            it->next = next;
-            return true;
+    u64 groupMask = _mtb_hmap_group_mask(hmap);
+    u64 group = _mtb_hmap_h1(hash) & groupMask;
+    MtbHmapCtrl h2 = _mtb_hmap_h2(hash);
+    for (u64 step = 0; step <= groupMask; step++) {
+        MtbHmapCtrl *ctrl = _mtb_hmap_group_ctrl(hmap, group);
+        for (u32 match = _mtb_hmap_group_match(ctrl, h2); match != 0; match &= match - 1) {
+            u8 *entry = mtb_hmap_entry(hmap, group * MTB_HMAP_GROUP_WIDTH + mtb_trailing_zeros_count(match));
+            if (_mtb_hmap_entry_matches(hmap, entry, key, hash)) {
+                return entry;
+            }
         }
-        next += it->hmap->entrySize;
+        if (_mtb_hmap_group_match(ctrl, MTB_HMAP_CTRL_EMPTY) != 0) {
+            break;
+        }
+        group = (group + step + 1) & groupMask; // triangular, visits every group
     }
-    return false;
+    return nil;
 }
 
-func void *
-mtb_hmap_iter_next(MtbHmapIter *it)
+func u64
+_mtb_hmap_group_find_available(MtbHmap *hmap, u64 hash)
 {
-    mtb_assert_always(it->next != nil);
-    it->prev = it->next;
-    it->next = nil;
-    return it->prev;
+    u64 groupMask = _mtb_hmap_group_mask(hmap);
+    u64 group = _mtb_hmap_h1(hash) & groupMask;
+    for (u64 step = 0; step <= groupMask; step++) {
+        u32 available = _mtb_hmap_group_match_empty_or_deleted(_mtb_hmap_group_ctrl(hmap, group));
+        if (available != 0) {
+            return group * MTB_HMAP_GROUP_WIDTH + mtb_trailing_zeros_count(available);
+        }
+        group = (group + step + 1) & groupMask;
+    }
+    mtb_invalid;
+    return U64_MAX;
 }
 
-func void *
-mtb_hmap_iter_next_key(MtbHmapIter *it)
+func u8 *
+_mtb_hmap_group_insert(MtbHmap *hmap, void *key, u64 hash, bool *inserted)
 {
-    return mtb_hmap_entry_key(it->hmap, mtb_hmap_iter_next(it));
+    if (key != nil) {
+        u8 *entry = _mtb_hmap_group_find(hmap, key, hash);
+        if (entry != nil) {
+            *inserted = false;
+            return entry;
+        }
+    }
+    // the second pass only reads control bytes, mostly of the same group
+    u64 slot = _mtb_hmap_group_find_available(hmap, hash);
+    if (hmap->ctrl[slot] == MTB_HMAP_CTRL_DELETED) {
+        hmap->deleted--;
+    }
+    hmap->ctrl[slot] = _mtb_hmap_h2(hash);
+    *inserted = true;
+    return mtb_hmap_entry(hmap, slot);
 }
 
-func void *
-mtb_hmap_iter_next_value(MtbHmapIter *it)
+func u8 *
+_mtb_hmap_group_erase(MtbHmap *hmap, u8 *entry)
 {
-    return mtb_hmap_entry_value(it->hmap, mtb_hmap_iter_next(it));
+    // If the group still has an EMPTY slot, no probe sequence has ever
+    // continued past it, so the slot can become EMPTY instead of DELETED.
+    u64 index = _mtb_hmap_entry_index(hmap, entry);
+    MtbHmapCtrl *group = _mtb_hmap_group_ctrl(hmap, index / MTB_HMAP_GROUP_WIDTH);
+    if (_mtb_hmap_group_match(group, MTB_HMAP_CTRL_EMPTY) != 0) {
+        hmap->ctrl[index] = MTB_HMAP_CTRL_EMPTY;
+    }
+    else {
+        hmap->ctrl[index] = MTB_HMAP_CTRL_DELETED;
+        hmap->deleted++;
+    }
+    return entry;
 }
 
-func void *
-mtb_hmap_iter_remove(MtbHmapIter *it)
+func void
+_mtb_hmap_group_drop_deleted(MtbHmap *hmap)
 {
-    mtb_assert_always(it->prev != nil);
-    mtb_hmap_entry_header(it->hmap, it->prev)->status = MTB_HMAP_ENTRY_REMOVED;
-    it->hmap->count--;
-    return it->prev;
+    // Rehash without growing: turn tombstones into EMPTY and mark every
+    // live entry as DELETED (pending), then move each pending entry to
+    // the first available slot of its probe sequence.
+    for (u64 index = 0; index < hmap->capacity; index++) {
+        bool isFull = _mtb_hmap_ctrl_is_full(hmap->ctrl[index]);
+        hmap->ctrl[index] = isFull ? MTB_HMAP_CTRL_DELETED : MTB_HMAP_CTRL_EMPTY;
+    }
+    u8 *spare = mtb_hmap_entry(hmap, hmap->capacity);
+    u64 index = 0;
+    while (index < hmap->capacity) {
+        if (hmap->ctrl[index] != MTB_HMAP_CTRL_DELETED) {
+            index++;
+            continue;
+        }
+        u8 *entry = mtb_hmap_entry(hmap, index);
+        u64 hash = _mtb_hmap_entry_rehash(hmap, entry);
+        u64 slot = _mtb_hmap_group_find_available(hmap, hash);
+        if (slot / MTB_HMAP_GROUP_WIDTH == index / MTB_HMAP_GROUP_WIDTH) {
+            hmap->ctrl[index] = _mtb_hmap_h2(hash);
+            index++;
+            continue;
+        }
+        u8 *target = mtb_hmap_entry(hmap, slot);
+        if (hmap->ctrl[slot] == MTB_HMAP_CTRL_EMPTY) {
+            memcpy(target, entry, hmap->entrySize);
+            hmap->ctrl[index] = MTB_HMAP_CTRL_EMPTY;
+            index++;
+        }
+        else {
+            // the target is pending too, swap and process it at this index
+            memcpy(spare, target, hmap->entrySize);
+            memcpy(target, entry, hmap->entrySize);
+            memcpy(entry, spare, hmap->entrySize);
+        }
+        hmap->ctrl[slot] = _mtb_hmap_h2(hash);
+    }
+    hmap->deleted = 0;
 }
 
-#endif // MTB_HMAP_IMPLEMENTATION
-
-
-#ifdef MTB_HMAP_TESTS
-
-#include <assert.h>
+func u8 *
+_mtb_hmap_small_find(MtbHmap *hmap, void *key)
+{
+    for (u64 index = 0; index < hmap->count; index++) {
+        u8 *entry = mtb_hmap_entry(hmap, index);
+        if (hmap->key_equals(mtb_hmap_entry_key(hmap, entry), key)) {
+            return entry;
+        }
+    }
+    return nil;
+}
 
+// Returns nil if the key is missing and there is no room left,
+// the map has left small mode then.
+func u8 *
+_mtb_hmap_small_insert(MtbHmap *hmap, void *key, bool *inserted)
+{
+    u8 *entry = _mtb_hmap_small_find(hmap, key);
+    if (entry != nil) {
+        *inserted = false;
+        return entry;
+    }
+    if (hmap->count == hmap->capacity) {
+        mtb_hmap_grow(hmap, mtb_hmap_calc_capacity(hmap->capacity + 1));
+        return nil;
+    }
+    entry = mtb_hmap_entry(hmap, hmap->count);
+    memcpy(mtb_hmap_entry_key(hmap, entry), key, hmap->keyBytes);
+    memset(mtb_hmap_entry_value(hmap, entry), 0, hmap->valueSize);
+    hmap->count++;
+    *inserted = true;
+    return entry;
+}
 
-func u64
-_calc_hash_str(void *key)
+func u8 *
+_mtb_hmap_small_erase(MtbHmap *hmap, u8 *entry)
 {
-    char *s = *(char **)key;
-    u64 hash = 0;
-    while (*s != '\0') hash = 17000069 * hash + *s++;
-    return hash;
+    // swap with the last one to keep the entries dense
+    u8 *removed = mtb_hmap_entry(hmap, hmap->capacity);
+    memcpy(removed, entry, hmap->entrySize);
+    u8 *last = mtb_hmap_entry(hmap, hmap->count - 1);
+    if (entry != last) {
+        memcpy(entry, last, hmap->entrySize);
+    }
+    return removed;
 }
 
-func bool
-_is_equal_str(void *key1, void *key2)
+func u8 *
+_mtb_hmap_find(MtbHmap *hmap, void *key, u64 hash)
 {
-    char *s1 = *(char **)key1;
-    char *s2 = *(char **)key2;
-    return strcmp(s1, s2) == 0;
+    switch (hmap->probing) {
+        case MTB_HMAP_PROBING_LINEAR: return _mtb_hmap_linear_find(hmap, key, hash);
+        case MTB_HMAP_PROBING_GROUP: return _mtb_hmap_group_find(hmap, key, hash);
+        case MTB_HMAP_PROBING_ROBIN_HOOD: return _mtb_hmap_robin_hood_find(hmap, key, hash);
+        default: mtb_invalid;
+    }
+    return nil;
 }
 
-func void
-_test_mtb_hmap_calc_capacity(void)
+// Returns the entry that holds the key, inserting it if missing.
+// If the key is nil the lookup is skipped and a free slot is claimed.
+// Returns nil if a probe distance would overflow the status (robin hood only).
+func u8 *
+_mtb_hmap_insert(MtbHmap *hmap, void *key, u64 hash, bool *inserted)
 {
-    for (u64 i = 0; i <= _mtb_hmap_threshold(MTB_HMAP_MIN_CAPACITY); i++) {
-        assert(mtb_hmap_calc_capacity(i) == MTB_HMAP_MIN_CAPACITY);
+    u8 *entry = nil;
+    *inserted = false;
+    switch (hmap->probing) {
+        case MTB_HMAP_PROBING_LINEAR: entry = _mtb_hmap_linear_insert(hmap, key, hash, inserted); break;
+        case MTB_HMAP_PROBING_GROUP: entry = _mtb_hmap_group_insert(hmap, key, hash, inserted); break;
+        case MTB_HMAP_PROBING_ROBIN_HOOD: entry = _mtb_hmap_robin_hood_insert(hmap, key, hash, inserted); break;
+        default: mtb_invalid;
     }
-    assert(mtb_hmap_calc_capacity(_mtb_hmap_threshold(MTB_HMAP_MIN_CAPACITY) + 1) == 32);
-    assert(mtb_hmap_calc_capacity(MTB_HMAP_MIN_CAPACITY) == 32);
-    assert(mtb_hmap_calc_capacity(45) == 64);
-    assert(mtb_hmap_calc_capacity(100) == 256);
-    assert(mtb_hmap_calc_capacity(200) == 512);
-    assert(mtb_hmap_calc_capacity(400) == 1024);
+    if (*inserted && hmap->storeHash) {
+        *mtb_hmap_entry_hash(hmap, entry) = hash;
+    }
+    return entry;
 }
 
-func void
-_test_mtb_hmap_put(MtbArena arena)
+// Returns the entry that holds the removed key and value.
+func u8 *
+_mtb_hmap_erase(MtbHmap *hmap, u8 *entry)
 {
+    u8 *removed = nil;
+    if (hmap->small) {
+        removed = _mtb_hmap_small_erase(hmap, entry);
+    }
+    else {
+        switch (hmap->probing) {
+            case MTB_HMAP_PROBING_LINEAR: removed = _mtb_hmap_linear_erase(hmap, entry); break;
+            case MTB_HMAP_PROBING_GROUP: removed = _mtb_hmap_group_erase(hmap, entry); break;
+            case MTB_HMAP_PROBING_ROBIN_HOOD: removed = _mtb_hmap_robin_hood_erase(hmap, entry); break;
+            default: mtb_invalid;
+        }
+    }
+    hmap->count--;
+    return removed;
+}
+
+// A robin hood table is a valid linear one once every status is just occupied,
+// the old table of a pending incremental resize included.
+func void
+_mtb_hmap_robin_hood_to_linear(MtbHmap *hmap)
+{
+    mtb_assert(hmap->probing == MTB_HMAP_PROBING_ROBIN_HOOD && !hmap->small);
+
+    u8 *tables[] = { hmap->entries, hmap->oldEntries };
+    u64 capacities[] = { hmap->capacity, hmap->oldCapacity };
+    for (u64 t = 0; t < mtb_countof(tables); t++) {
+        for (u64 index = 0; tables[t] != nil && index < capacities[t]; index++) {
+            MtbHmapHeader *header = (MtbHmapHeader *)(tables[t] + index * hmap->entrySize);
+            if (header->status != MTB_HMAP_ENTRY_FREE) {
+                header->status = MTB_HMAP_ENTRY_OCCUPIED;
+            }
+        }
+    }
+    hmap->probing = MTB_HMAP_PROBING_LINEAR;
+}
+
+func MtbHmap
+_mtb_hmap_old(MtbHmap *hmap)
+{
+    MtbHmap oldHmap = *hmap;
+    oldHmap.capacity = hmap->oldCapacity;
+    oldHmap.entries = hmap->oldEntries;
+    oldHmap.ctrl = hmap->oldCtrl;
+    return oldHmap;
+}
+
+// Falls back to linear probing on a robin hood distance overflow, so a
+// copy of the old table taken before may carry a stale probing mode.
+func void
+_mtb_hmap_move(MtbHmap *hmap, MtbHmap *oldHmap, u8 *oldEntry)
+{
+    bool inserted;
+    u64 hash = _mtb_hmap_entry_rehash(oldHmap, oldEntry);
+    u8 *entry = _mtb_hmap_insert(hmap, nil, hash, &inserted);
+    if (entry == nil) {
+        _mtb_hmap_robin_hood_to_linear(hmap); // a bigger table wouldn't help equal hashes
+        entry = _mtb_hmap_insert(hmap, nil, hash, &inserted);
+    }
+    memcpy(mtb_hmap_entry_key(hmap, entry), mtb_hmap_entry_key(oldHmap, oldEntry), hmap->keySize + hmap->valueSize);
+}
+
+func void
+_mtb_hmap_migrate(MtbHmap *hmap, u64 slots)
+{
+    if (hmap->oldEntries == nil) {
+        return;
+    }
+    MtbHmap oldHmap = _mtb_hmap_old(hmap);
+    u64 end = slots < oldHmap.capacity - hmap->migrated ? hmap->migrated + slots : oldHmap.capacity;
+    for (; hmap->migrated < oldHmap.capacity; hmap->migrated++) {
+        u64 oldIndex = _mtb_hmap_modulo_capacity(&oldHmap, hmap->oldBeg + hmap->migrated);
+        bool occupied = _mtb_hmap_is_occupied(&oldHmap, oldIndex);
+        if (!occupied && hmap->migrated >= end) {
+            break; // stop between clusters only, lookups in the old table still work
+        }
+        if (occupied) {
+            u8 *oldEntry = mtb_hmap_entry(&oldHmap, oldIndex);
+            _mtb_hmap_move(hmap, &oldHmap, oldEntry);
+            // no backward shift, the rest of the cluster goes in this call too
+            if (oldHmap.probing == MTB_HMAP_PROBING_GROUP) {
+                oldHmap.ctrl[oldIndex] = MTB_HMAP_CTRL_DELETED;
+            }
+            else {
+                mtb_hmap_entry_header(&oldHmap, oldEntry)->status = MTB_HMAP_ENTRY_FREE;
+            }
+        }
+    }
+    if (hmap->migrated == oldHmap.capacity) {
+        hmap->oldCapacity = 0;
+        hmap->oldEntries = nil;
+        hmap->oldCtrl = nil;
+    }
+}
+
+func void
+_mtb_hmap_grow_incremental(MtbHmap *hmap, u64 capacity)
+{
+    mtb_assert_always(hmap->oldEntries == nil);
+
+    hmap->oldCapacity = hmap->capacity;
+    hmap->oldEntries = hmap->entries;
+    hmap->oldCtrl = hmap->ctrl;
+    hmap->oldBeg = 0;
+    if (hmap->probing != MTB_HMAP_PROBING_GROUP) {
+        while (_mtb_hmap_is_occupied(hmap, hmap->oldBeg)) {
+            hmap->oldBeg++;
+        }
+    }
+    hmap->migrated = 0;
+
+    hmap->capacity = capacity;
+    hmap->deleted = 0;
+    _mtb_hmap_alloc(hmap);
+}
+
+// Entry layout from the probing mode and storeHash.
+func void
+_mtb_hmap_layout(MtbHmap *hmap, u64 keySize, u64 valueSize, u64 align)
+{
+    // header: [status (linear probing only)] [hash (storeHash only)]
+    align = mtb_max_u64(align, mtb_alignof(MtbHmapHeader));
+    u64 headerSize = hmap->probing == MTB_HMAP_PROBING_GROUP ? 0 : sizeof(MtbHmapHeader);
+    if (hmap->storeHash) {
+        align = mtb_max_u64(align, mtb_alignof(u64));
+        headerSize = mtb_align_pow2(headerSize, mtb_alignof(u64)) + sizeof(u64);
+    }
+    hmap->headerSize = mtb_align_pow2(headerSize, align);
+    hmap->keySize = mtb_align_pow2(keySize, align);
+    hmap->valueSize = mtb_align_pow2(valueSize, align);
+    hmap->entrySize = hmap->headerSize + hmap->keySize + hmap->valueSize;
+    hmap->keyBytes = keySize;
+    hmap->valueBytes = valueSize;
+    hmap->align = align;
+}
+
+func void
+mtb_hmap_init_opt(MtbHmap *hmap,
+                  MtbArena *arena,
+                  u64 keySize,
+                  u64 valueSize,
+                  u64 (*key_hash)(void *k),
+                  bool (*key_equals)(void *k1, void *k2),
+                  MtbHmapInitOptions opt)
+{
+    mtb_assert_always(mtb_is_pow2_or_zero(opt.capacity));
+    mtb_assert_always(mtb_is_pow2_or_zero(keySize));
+    mtb_assert_always(mtb_is_pow2_or_zero(opt.keyAlign));
+    mtb_assert_always(mtb_is_pow2_or_zero(valueSize));
+    mtb_assert_always(mtb_is_pow2_or_zero(opt.valueAlign));
+    mtb_assert_always(opt.probing <= MTB_HMAP_PROBING_ROBIN_HOOD);
+    mtb_assert_always(0.0f <= opt.maxLoad && opt.maxLoad < 1.0f);
+
+    hmap->arena = arena;
+
+    hmap->small = opt.small && opt.capacity == 0;
+    if (hmap->small) {
+        hmap->capacity = MTB_HMAP_SMALL_CAPACITY;
+    }
+    else {
+        hmap->capacity = opt.capacity < MTB_HMAP_MIN_CAPACITY ? MTB_HMAP_MIN_CAPACITY : opt.capacity;
+    }
+    hmap->count = 0;
+    hmap->deleted = 0;
+    hmap->maxLoad = opt.maxLoad == 0.0f ? MTB_HMAP_DEF_MAX_LOAD : opt.maxLoad;
+
+    hmap->probing = opt.probing;
+    hmap->ctrl = nil;
+    hmap->storeHash = opt.storeHash;
+
+    hmap->incremental = opt.incremental;
+    hmap->oldCapacity = 0;
+    hmap->oldEntries = nil;
+    hmap->oldCtrl = nil;
+    hmap->oldBeg = 0;
+    hmap->migrated = 0;
+
+    _mtb_hmap_layout(hmap, keySize, valueSize, mtb_max_u64(opt.keyAlign, opt.valueAlign));
+
+    _mtb_hmap_alloc(hmap);
+
+    hmap->key_hash = key_hash;
+    hmap->key_equals = key_equals;
+}
+
+func void
+mtb_hmap_clear(MtbHmap *hmap)
+{
+    hmap->count = 0;
+    hmap->deleted = 0;
+    hmap->oldCapacity = 0;
+    hmap->oldEntries = nil;
+    hmap->oldCtrl = nil;
+    memset(hmap->entries, 0, hmap->capacity * hmap->entrySize);
+    if (hmap->ctrl != nil) {
+        memset(hmap->ctrl, MTB_HMAP_CTRL_EMPTY, hmap->capacity);
+    }
+}
+
+func bool
+mtb_hmap_is_empty(MtbHmap *hmap)
+{
+    return hmap->count == 0;
+}
+
+func u64
+mtb_hmap_calc_capacity(u64 n)
+{
+    u64 capacity = n + (n / 3);
+    if (capacity < MTB_HMAP_MIN_CAPACITY) {
+        return MTB_HMAP_MIN_CAPACITY;
+    }
+    return mtb_roundup_pow2(capacity);
+}
+
+func void
+mtb_hmap_grow(MtbHmap *hmap, u64 capacity)
+{
+    mtb_assert_always(mtb_is_pow2(capacity));
+    mtb_assert_always(capacity > hmap->capacity);
+
+    _mtb_hmap_migrate(hmap, U64_MAX);
+
+    MtbHmap oldHmap = *hmap;
+    u64 oldSize = _mtb_hmap_block_size(&oldHmap);
+
+    hmap->capacity = capacity;
+    hmap->deleted = 0;
+    hmap->small = false; // for good
+    u64 size = _mtb_hmap_block_size(hmap);
+
+    // When the table is the last arena allocation, rehash right behind it,
+    // then move the new table down over the old one.
+    u64 tail = mtb_align_pow2(oldSize, MTB_HMAP_GROUP_WIDTH);
+    bool inPlace = mtb_arena_resize(hmap->arena, oldHmap.entries, oldSize, mtb_add_u64(tail, size));
+    if (inPlace) {
+        _mtb_hmap_init_block(hmap, oldHmap.entries + tail);
+    }
+    else {
+        _mtb_hmap_alloc(hmap);
+    }
+
+    for (u64 oldIndex = 0; oldIndex < oldHmap.capacity; oldIndex++) {
+        if (!_mtb_hmap_is_occupied(&oldHmap, oldIndex)) {
+            continue;
+        }
+        _mtb_hmap_move(hmap, &oldHmap, mtb_hmap_entry(&oldHmap, oldIndex));
+    }
+
+    if (inPlace) {
+        memmove(oldHmap.entries, hmap->entries, size);
+        mtb_arena_resize(hmap->arena, oldHmap.entries, tail + size, size);
+        hmap->entries -= tail;
+        if (hmap->ctrl != nil) {
+            hmap->ctrl -= tail;
+        }
+    }
+}
+
+func u8 *
+_mtb_hmap_put_hashed(MtbHmap *hmap, void *key, u64 hash, bool *inserted)
+{
+    u8 *entry = _mtb_hmap_insert(hmap, key, hash, inserted);
+    if (entry == nil) {
+        _mtb_hmap_robin_hood_to_linear(hmap);
+        entry = _mtb_hmap_insert(hmap, key, hash, inserted);
+    }
+    if (*inserted) {
+        memcpy(mtb_hmap_entry_key(hmap, entry), key, hmap->keyBytes);
+        memset(mtb_hmap_entry_value(hmap, entry), 0, hmap->valueSize);
+        hmap->count++;
+    }
+    return entry;
+}
+
+func u8 *
+_mtb_hmap_lookup(MtbHmap *hmap, void *key, u64 hash)
+{
+    if (hmap->small) {
+        return _mtb_hmap_small_find(hmap, key);
+    }
+    u8 *entry = _mtb_hmap_find(hmap, key, hash);
+    if (entry == nil && hmap->oldEntries != nil) {
+        MtbHmap oldHmap = _mtb_hmap_old(hmap);
+        entry = _mtb_hmap_find(&oldHmap, key, hash);
+    }
+    return entry;
+}
+
+func void
+_mtb_hmap_prefetch(MtbHmap *hmap, u64 hash)
+{
+    if (hmap->probing == MTB_HMAP_PROBING_GROUP) {
+        u64 group = _mtb_hmap_h1(hash) & _mtb_hmap_group_mask(hmap);
+        mtb_prefetch(_mtb_hmap_group_ctrl(hmap, group));
+        mtb_prefetch(mtb_hmap_entry(hmap, group * MTB_HMAP_GROUP_WIDTH));
+    }
+    else {
+        mtb_prefetch(mtb_hmap_entry(hmap, _mtb_hmap_modulo_capacity(hmap, hash)));
+    }
+}
+
+func void
+_mtb_hmap_reserve(MtbHmap *hmap, u64 n)
+{
+    _mtb_hmap_migrate(hmap, U64_MAX);
+    u64 count = mtb_add_u64(hmap->count, n);
+    if (count + hmap->deleted < hmap->threshold) {
+        return;
+    }
+    if (hmap->deleted > 0) {
+        _mtb_hmap_group_drop_deleted(hmap);
+    }
+    u64 capacity = hmap->capacity;
+    while (_mtb_hmap_threshold(capacity, hmap->maxLoad) <= count) {
+        capacity <<= 1;
+    }
+    if (capacity > hmap->capacity) {
+        mtb_hmap_grow(hmap, capacity);
+    }
+}
+
+func void
+mtb_hmap_clone(MtbHmap *hmap, MtbArena *arena, MtbHmap *src)
+{
+    _mtb_hmap_migrate(src, U64_MAX);
+
+    *hmap = *src;
+    hmap->arena = arena;
+    u64 size = _mtb_hmap_block_size(src);
+    hmap->entries = mtb_arena_bump(arena, u8, size, .align = MTB_HMAP_GROUP_WIDTH, .no_zero = true);
+    memcpy(hmap->entries, src->entries, size);
+    if (src->ctrl != nil) {
+        hmap->ctrl = hmap->entries + (src->ctrl - src->entries);
+    }
+}
+
+func void *
+mtb_hmap_put(MtbHmap *hmap, void *key)
+{
+    bool inserted;
+    return mtb_hmap_upsert(hmap, key, &inserted);
+}
+
+func void *
+mtb_hmap_upsert(MtbHmap *hmap, void *key, bool *inserted)
+{
+    if (hmap->small) {
+        u8 *entry = _mtb_hmap_small_insert(hmap, key, inserted);
+        if (entry != nil) {
+            return mtb_hmap_entry_value(hmap, entry);
+        }
+    }
+    return mtb_hmap_upsert_hashed(hmap, key, hmap->key_hash(key), inserted);
+}
+
+func void *
+mtb_hmap_upsert_hashed(MtbHmap *hmap, void *key, u64 hash, bool *inserted)
+{
+    mtb_assert(hmap->arena != nil); // not a mapped snapshot
+    if (hmap->small) {
+        u8 *entry = _mtb_hmap_small_insert(hmap, key, inserted);
+        if (entry != nil) {
+            return mtb_hmap_entry_value(hmap, entry);
+        }
+    }
+    _mtb_hmap_migrate(hmap, MTB_HMAP_MIGRATE_STEP);
+    if (hmap->count + hmap->deleted >= hmap->threshold) {
+        _mtb_hmap_migrate(hmap, U64_MAX);
+        if (hmap->count < hmap->threshold / 2) {
+            _mtb_hmap_group_drop_deleted(hmap); // mostly tombstones
+        }
+        else if (hmap->incremental) {
+            _mtb_hmap_grow_incremental(hmap, hmap->capacity << 1);
+        }
+        else {
+            mtb_hmap_grow(hmap, hmap->capacity << 1);
+        }
+    }
+    if (hmap->oldEntries != nil) {
+        // not migrated yet, move it over so that it's found below
+        MtbHmap oldHmap = _mtb_hmap_old(hmap);
+        u8 *oldEntry = _mtb_hmap_find(&oldHmap, key, hash);
+        if (oldEntry != nil) {
+            _mtb_hmap_move(hmap, &oldHmap, oldEntry);
+            oldHmap = _mtb_hmap_old(hmap); // may be linear now
+            _mtb_hmap_erase(&oldHmap, oldEntry);
+        }
+    }
+    return mtb_hmap_entry_value(hmap, _mtb_hmap_put_hashed(hmap, key, hash, inserted));
+}
+
+func void *
+mtb_hmap_remove(MtbHmap *hmap, void *key)
+{
+    return mtb_hmap_remove_hashed(hmap, key, hmap->small ? 0 : hmap->key_hash(key)); // not hashed in small mode
+}
+
+func void *
+mtb_hmap_remove_hashed(MtbHmap *hmap, void *key, u64 hash)
+{
+    mtb_assert(hmap->arena != nil);
+    _mtb_hmap_migrate(hmap, MTB_HMAP_MIGRATE_STEP);
+    u8 *entry = hmap->small ? _mtb_hmap_small_find(hmap, key) : _mtb_hmap_find(hmap, key, hash);
+    if (entry != nil) {
+        return mtb_hmap_entry_value(hmap, _mtb_hmap_erase(hmap, entry));
+    }
+    if (hmap->oldEntries != nil) {
+        MtbHmap oldHmap = _mtb_hmap_old(hmap);
+        entry = _mtb_hmap_find(&oldHmap, key, hash);
+        if (entry != nil) {
+            hmap->count--;
+            return mtb_hmap_entry_value(hmap, _mtb_hmap_erase(&oldHmap, entry));
+        }
+    }
+    return nil;
+}
+
+func void *
+mtb_hmap_get(MtbHmap *hmap, void *key)
+{
+    return mtb_hmap_get_hashed(hmap, key, hmap->small ? 0 : hmap->key_hash(key)); // not hashed in small mode
+}
+
+func void *
+mtb_hmap_get_hashed(MtbHmap *hmap, void *key, u64 hash)
+{
+    _mtb_hmap_migrate(hmap, MTB_HMAP_MIGRATE_STEP);
+    u8 *entry = _mtb_hmap_lookup(hmap, key, hash);
+    return entry == nil ? nil : mtb_hmap_entry_value(hmap, entry);
+}
+
+func void
+mtb_hmap_put_batch(MtbHmap *hmap, void *keys, u64 keyStride, u64 count, void **values)
+{
+    // room for all keys up front, so earlier results stay valid,
+    // unless robin hood inserts shift them, then they're all looked up again at the end
+    _mtb_hmap_reserve(hmap, count);
+    bool shifts = hmap->probing == MTB_HMAP_PROBING_ROBIN_HOOD;
+    if (hmap->small) {
+        for (u64 i = 0; i < count; i++) {
+            values[i] = mtb_hmap_put(hmap, (u8 *)keys + i * keyStride);
+        }
+        return;
+    }
+
+    u64 hashes[MTB_HMAP_BATCH_SIZE];
+    for (u64 beg = 0; beg < count; beg += MTB_HMAP_BATCH_SIZE) {
+        u64 end = mtb_min_u64(beg + MTB_HMAP_BATCH_SIZE, count);
+        for (u64 i = beg; i < end; i++) {
+            hashes[i - beg] = hmap->key_hash((u8 *)keys + i * keyStride);
+            _mtb_hmap_prefetch(hmap, hashes[i - beg]);
+        }
+        for (u64 i = beg; i < end; i++) {
+            bool inserted;
+            u8 *entry = _mtb_hmap_put_hashed(hmap, (u8 *)keys + i * keyStride, hashes[i - beg], &inserted);
+            values[i] = mtb_hmap_entry_value(hmap, entry);
+        }
+    }
+    if (shifts) {
+        mtb_hmap_get_batch(hmap, keys, keyStride, count, values);
+    }
+}
+
+func void
+mtb_hmap_get_batch(MtbHmap *hmap, void *keys, u64 keyStride, u64 count, void **values)
+{
+    _mtb_hmap_migrate(hmap, MTB_HMAP_MIGRATE_STEP);
+    if (hmap->small) {
+        for (u64 i = 0; i < count; i++) {
+            values[i] = mtb_hmap_get(hmap, (u8 *)keys + i * keyStride);
+        }
+        return;
+    }
+
+    u64 hashes[MTB_HMAP_BATCH_SIZE];
+    for (u64 beg = 0; beg < count; beg += MTB_HMAP_BATCH_SIZE) {
+        u64 end = mtb_min_u64(beg + MTB_HMAP_BATCH_SIZE, count);
+        for (u64 i = beg; i < end; i++) {
+            hashes[i - beg] = hmap->key_hash((u8 *)keys + i * keyStride);
+            _mtb_hmap_prefetch(hmap, hashes[i - beg]);
+        }
+        for (u64 i = beg; i < end; i++) {
+            u8 *entry = _mtb_hmap_lookup(hmap, (u8 *)keys + i * keyStride, hashes[i - beg]);
+            values[i] = entry == nil ? nil : mtb_hmap_entry_value(hmap, entry);
+        }
+    }
+}
+
+// Groups visited by the triangular probe sequence before reaching the entry's group.
+func u64
+_mtb_hmap_group_displacement(MtbHmap *hmap, u64 index, u64 hash)
+{
+    u64 groupMask = _mtb_hmap_group_mask(hmap);
+    u64 target = index / MTB_HMAP_GROUP_WIDTH;
+    u64 group = _mtb_hmap_h1(hash) & groupMask;
+    u64 step = 0;
+    for (; group != target; step++) {
+        group = (group + step + 1) & groupMask;
+    }
+    return step;
+}
+
+// A slot, or a group w/o an empty slot w/ group probing.
+func bool
+_mtb_hmap_stats_is_full(MtbHmap *hmap, u64 unit)
+{
+    if (hmap->probing == MTB_HMAP_PROBING_GROUP) {
+        return _mtb_hmap_group_match(_mtb_hmap_group_ctrl(hmap, unit), MTB_HMAP_CTRL_EMPTY) == 0;
+    }
+    return _mtb_hmap_is_occupied(hmap, unit);
+}
+
+func void
+mtb_hmap_stats(MtbHmap *hmap, MtbHmapStats *stats)
+{
+    _mtb_hmap_migrate(hmap, U64_MAX);
+
+    *stats = (MtbHmapStats){
+        .count = hmap->count,
+        .capacity = hmap->capacity,
+        .tombstones = hmap->deleted,
+        .bytes = _mtb_hmap_block_size(hmap),
+        .load = (f64)hmap->count / (f64)hmap->capacity,
+    };
+    if (hmap->small) {
+        return; // nothing is probed
+    }
+
+    u64 totalDisplacement = 0;
+    for (u64 index = 0; index < hmap->capacity; index++) {
+        if (!_mtb_hmap_is_occupied(hmap, index)) {
+            continue;
+        }
+        u64 hash = _mtb_hmap_entry_rehash(hmap, mtb_hmap_entry(hmap, index));
+        u64 displacement = hmap->probing == MTB_HMAP_PROBING_GROUP
+                               ? _mtb_hmap_group_displacement(hmap, index, hash)
+                               : _mtb_hmap_modulo_capacity(hmap, index - hash);
+        stats->probes[mtb_min_u64(displacement, MTB_HMAP_STATS_PROBES - 1)]++;
+        stats->maxDisplacement = mtb_max_u64(stats->maxDisplacement, displacement);
+        totalDisplacement += displacement;
+    }
+    if (hmap->count > 0) {
+        stats->avgDisplacement = (f64)totalDisplacement / (f64)hmap->count;
+    }
+
+    // clusters, starting right after a free unit so that none is split by the wrap around
+    u64 units = hmap->probing == MTB_HMAP_PROBING_GROUP ? hmap->capacity / MTB_HMAP_GROUP_WIDTH : hmap->capacity;
+    u64 start = 0;
+    while (start < units - 1 && _mtb_hmap_stats_is_full(hmap, start)) {
+        start++;
+    }
+    u64 run = 0;
+    u64 totalRun = 0;
+    for (u64 i = 1; i <= units; i++) {
+        bool full = _mtb_hmap_stats_is_full(hmap, (start + i) % units);
+        run += full;
+        if ((!full || i == units) && run > 0) {
+            stats->clusterCount++;
+            stats->maxCluster = mtb_max_u64(stats->maxCluster, run);
+            totalRun += run;
+            run = 0;
+        }
+    }
+    if (stats->clusterCount > 0) {
+        stats->avgCluster = (f64)totalRun / (f64)stats->clusterCount;
+    }
+}
+
+func void
+mtb_hmap_stats_print(MtbHmapStats *stats, const char *name)
+{
+    mtb_perf_print_block(name);
+    mtb_perf_print_u64("count", stats->count);
+    mtb_perf_print_u64("capacity", stats->capacity);
+    mtb_perf_print_f64("load", stats->load);
+    mtb_perf_print_u64("bytes", stats->bytes);
+    mtb_perf_print_u64("tombstones", stats->tombstones);
+    for (u64 i = 0; i < MTB_HMAP_STATS_PROBES; i++) {
+        if (stats->probes[i] > 0) {
+            char label[32];
+            snprintf(label, sizeof(label), "probes %lu%s", i + 1, i == MTB_HMAP_STATS_PROBES - 1 ? "+" : "");
+            mtb_perf_print_u64(label, stats->probes[i]);
+        }
+    }
+    mtb_perf_print_f64("avg displacement", stats->avgDisplacement);
+    mtb_perf_print_u64("max displacement", stats->maxDisplacement);
+    mtb_perf_print_u64("clusters", stats->clusterCount);
+    mtb_perf_print_f64("avg cluster", stats->avgCluster);
+    mtb_perf_print_u64("max cluster", stats->maxCluster);
+}
+
+func bool
+mtb_hmap_save(MtbHmap *hmap, char *path)
+{
+    _mtb_hmap_migrate(hmap, U64_MAX);
+    if (hmap->small) {
+        mtb_hmap_grow(hmap, mtb_hmap_calc_capacity(hmap->capacity + 1));
+    }
+
+    u64 blockSize = _mtb_hmap_block_size(hmap);
+    MtbHmapFileHeader header = {
+        .magic = MTB_HMAP_FILE_MAGIC,
+        .version = MTB_HMAP_FILE_VERSION,
+        .size = MTB_HMAP_FILE_ALIGN + blockSize,
+        .capacity = hmap->capacity,
+        .count = hmap->count,
+        .deleted = hmap->deleted,
+        .probing = hmap->probing,
+        .storeHash = hmap->storeHash,
+        .headerSize = hmap->headerSize,
+        .keySize = hmap->keySize,
+        .valueSize = hmap->valueSize,
+        .entrySize = hmap->entrySize,
+        .keyBytes = hmap->keyBytes,
+        .valueBytes = hmap->valueBytes,
+        .align = hmap->align,
+        .ctrlOffset = hmap->ctrl == nil ? 0 : (u64)(hmap->ctrl - hmap->entries),
+        .maxLoad = hmap->maxLoad,
+    };
+    u8 page[MTB_HMAP_FILE_ALIGN] = {0};
+    memcpy(page, &header, sizeof(header));
+
+    FILE *file = fopen(path, "wb");
+    if (file == nil) {
+        return false;
+    }
+    bool ok = fwrite(page, 1, sizeof(page), file) == sizeof(page) &&
+              fwrite(hmap->entries, 1, blockSize, file) == blockSize;
+    return fclose(file) == 0 && ok;
+}
+
+func bool
+mtb_hmap_map(MtbHmap *hmap,
+             char *path,
+             u64 keySize,
+             u64 valueSize,
+             u64 (*key_hash)(void *k),
+             bool (*key_equals)(void *k1, void *k2))
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (u64)st.st_size < MTB_HMAP_FILE_ALIGN) {
+        close(fd);
+        return false;
+    }
+    u64 size = (u64)st.st_size;
+    u8 *base = mmap(nil, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return false;
+    }
+
+    MtbHmapFileHeader *header = (MtbHmapFileHeader *)base;
+    MtbHmap mapped = {
+        .capacity = header->capacity,
+        .count = header->count,
+        .deleted = header->deleted,
+        .maxLoad = header->maxLoad,
+        .probing = (MtbHmapProbing)header->probing,
+        .storeHash = header->storeHash != 0,
+        .headerSize = header->headerSize,
+        .keySize = header->keySize,
+        .valueSize = header->valueSize,
+        .entrySize = header->entrySize,
+        .entries = base + MTB_HMAP_FILE_ALIGN,
+        .key_hash = key_hash,
+        .key_equals = key_equals,
+    };
+    mapped.threshold = _mtb_hmap_threshold(mapped.capacity, mapped.maxLoad);
+    if (mapped.probing == MTB_HMAP_PROBING_GROUP) {
+        mapped.ctrl = mapped.entries + header->ctrlOffset;
+    }
+
+    // the layout must be the one init gives the caller's key and value for the stored options
+    MtbHmap layout = { .probing = mapped.probing, .storeHash = mapped.storeHash };
+    bool valid = header->magic == MTB_HMAP_FILE_MAGIC &&
+                 header->version == MTB_HMAP_FILE_VERSION &&
+                 header->size == size &&
+                 header->probing <= MTB_HMAP_PROBING_ROBIN_HOOD &&
+                 header->keyBytes == keySize &&
+                 header->valueBytes == valueSize &&
+                 mtb_is_pow2(header->align) && header->align <= MTB_HMAP_FILE_ALIGN;
+    if (valid) {
+        _mtb_hmap_layout(&layout, keySize, valueSize, header->align);
+        valid = layout.align == header->align &&
+                layout.headerSize == mapped.headerSize &&
+                layout.keySize == mapped.keySize &&
+                layout.valueSize == mapped.valueSize &&
+                layout.entrySize == mapped.entrySize;
+        mapped.keyBytes = keySize;
+        mapped.valueBytes = valueSize;
+        mapped.align = layout.align;
+    }
+    // group loads read MTB_HMAP_GROUP_WIDTH aligned control bytes, up to the last group
+    u64 ctrlOffset = mtb_align_pow2((mapped.capacity + 1) * mapped.entrySize, MTB_HMAP_GROUP_WIDTH);
+    valid = valid &&
+            mapped.capacity >= MTB_HMAP_MIN_CAPACITY &&
+            mtb_is_pow2_or_zero(mapped.capacity) &&
+            mapped.entrySize > 0 &&
+            mapped.capacity < U64_MAX / 2 / mapped.entrySize &&
+            MTB_HMAP_FILE_ALIGN + _mtb_hmap_block_size(&mapped) == size &&
+            (mapped.ctrl == nil ||
+             (header->ctrlOffset == ctrlOffset &&
+              ctrlOffset + mtb_align_pow2(mapped.capacity, MTB_HMAP_GROUP_WIDTH) <= size - MTB_HMAP_FILE_ALIGN));
+    if (!valid) {
+        munmap(base, size);
+        return false;
+    }
+    *hmap = mapped;
+    return true;
+}
+
+func void
+mtb_hmap_unmap(MtbHmap *hmap)
+{
+    mtb_assert_always(hmap->arena == nil && hmap->entries != nil);
+    u8 *base = hmap->entries - MTB_HMAP_FILE_ALIGN;
+    munmap(base, ((MtbHmapFileHeader *)base)->size);
+    hmap->entries = nil;
+    hmap->ctrl = nil;
+}
+
+func void
+mtb_hmap_iter_init(MtbHmapIter *it, MtbHmap *hmap)
+{
+    it->hmap = hmap;
+    mtb_hmap_iter_reset(it);
+}
+
+func void
+mtb_hmap_iter_reset(MtbHmapIter *it)
+{
+    it->prev = nil;
+    it->next = nil;
+    it->beg = U64_MAX;
+    it->index = 0;
+}
+
+func bool
+mtb_hmap_iter_has_next(MtbHmapIter *it)
+{
+    MtbHmap *hmap = it->hmap;
+    if (it->beg == U64_MAX) {
+        _mtb_hmap_migrate(hmap, U64_MAX); // visit a single table
+        // Start at a free slot, so that backward shifts on removal only
+        // move not yet visited entries into the current slot.
+        it->beg = 0;
+        if (hmap->probing != MTB_HMAP_PROBING_GROUP && !hmap->small) {
+            while (_mtb_hmap_is_occupied(hmap, it->beg)) {
+                it->beg++;
+            }
+        }
+    }
+    for (; it->index < hmap->capacity; it->index++) {
+        u64 index = _mtb_hmap_modulo_capacity(hmap, it->beg + it->index);
+        if (_mtb_hmap_is_occupied(hmap, index)) {
+            it->next = mtb_hmap_entry(hmap, index);
+            return true;
+        }
+    }
+    return false;
+}
+
+func void *
+mtb_hmap_iter_next(MtbHmapIter *it)
+{
+    mtb_assert_always(it->next != nil);
+    it->prev = it->next;
+    it->next = nil;
+    it->index++;
+    return it->prev;
+}
+
+func void *
+mtb_hmap_iter_next_key(MtbHmapIter *it)
+{
+    return mtb_hmap_entry_key(it->hmap, mtb_hmap_iter_next(it));
+}
+
+func void *
+mtb_hmap_iter_next_value(MtbHmapIter *it)
+{
+    return mtb_hmap_entry_value(it->hmap, mtb_hmap_iter_next(it));
+}
+
+func void *
+mtb_hmap_iter_remove(MtbHmapIter *it)
+{
+    mtb_assert_always(it->prev != nil);
+    u8 *removed = _mtb_hmap_erase(it->hmap, it->prev);
+    it->prev = nil;
+    it->index--; // the slot may hold a shifted entry now, visit it again
+    return removed;
+}
+
+#endif // MTB_HMAP_IMPLEMENTATION
+
+
+
+
+#ifdef MTB_HMAP_TESTS
+
+#include <assert.h>
+
+
+func u64
+_calc_hash_str(void *key)
+{
+    char *s = *(char **)key;
+    u64 hash = 0;
+    while (*s != '\0') hash = 17000069 * hash + *s++;
+    return hash;
+}
+
+func bool
+_is_equal_str(void *key1, void *key2)
+{
+    char *s1 = *(char **)key1;
+    char *s2 = *(char **)key2;
+    return strcmp(s1, s2) == 0;
+}
+
+func void
+_test_mtb_hmap_calc_capacity(void)
+{
+    for (u64 i = 0; i <= _mtb_hmap_threshold(MTB_HMAP_MIN_CAPACITY, MTB_HMAP_DEF_MAX_LOAD); i++) {
+        assert(mtb_hmap_calc_capacity(i) == MTB_HMAP_MIN_CAPACITY);
+    }
+    assert(mtb_hmap_calc_capacity(_mtb_hmap_threshold(MTB_HMAP_MIN_CAPACITY, MTB_HMAP_DEF_MAX_LOAD) + 1) == 32);
+    assert(mtb_hmap_calc_capacity(MTB_HMAP_MIN_CAPACITY) == 32);
+    assert(mtb_hmap_calc_capacity(45) == 64);
+    assert(mtb_hmap_calc_capacity(100) == 256);
+    assert(mtb_hmap_calc_capacity(200) == 512);
+    assert(mtb_hmap_calc_capacity(400) == 1024);
+}
+
+func u64
+_calc_hash_u64(void *key)
+{
+    return *(u64 *)key * u64_lit(0x9E3779B97F4A7C15);
+}
+
+func bool
+_is_equal_u64(void *key1, void *key2)
+{
+    return *(u64 *)key1 == *(u64 *)key2;
+}
+
+func u64
+_calc_hash_u32(void *key)
+{
+    return *(u32 *)key * u64_lit(0x9E3779B97F4A7C15);
+}
+
+func bool
+_is_equal_u32(void *key1, void *key2)
+{
+    return *(u32 *)key1 == *(u32 *)key2;
+}
+
+func void
+_test_mtb_hmap_put(MtbArena *arena, MtbHmapInitOptions opt)
+{
+    mtb_arena_temp_scope(arena);
     char *text = "Lorem ipsum dolor sit amet consectetuer adipiscing elit Pellentesque ipsum Fusce"
                  " dui leo imperdiet in aliquam sit amet feugiat eu orci Etiam neque Fusce consect"
                  "etuer risus a nunc Cum sociis natoque penatibus et magnis dis parturient montes "
@@ -671,122 +2077,841 @@ _test_mtb_hmap_put(MtbArena arena)
     };
 
     MtbHmap hmap = {0};
-    mtb_hmap_init(&hmap, &arena, char *, u64, _calc_hash_str, _is_equal_str);
-    assert(mtb_hmap_is_empty(&hmap));
-
-    char *textCopy = strcpy(mtb_arena_bump(&arena, char, strlen(text) + 1), text);
-    char *token = strtok(textCopy, " ");
-    while (token != nil) {
-        u64 *count = mtb_hmap_get(&hmap, &token);
-        if (count == nil) {
-            *(u64 *)mtb_hmap_put(&hmap, &token) = 1;
-        }
-        else {
-            *count += 1;
+    opt.keyAlign = mtb_alignof(char *);
+    opt.valueAlign = mtb_alignof(u64);
+    mtb_hmap_init_opt(&hmap, arena, sizeof(char *), sizeof(u64), _calc_hash_str, _is_equal_str, opt);
+    assert(mtb_hmap_is_empty(&hmap));
+
+    char *textCopy = strcpy(mtb_arena_bump(arena, char, strlen(text) + 1), text);
+    char *token = strtok(textCopy, " ");
+    while (token != nil) {
+        u64 *count = mtb_hmap_get(&hmap, &token);
+        if (count == nil) {
+            *(u64 *)mtb_hmap_put(&hmap, &token) = 1;
+        }
+        else {
+            *count += 1;
+        }
+        token = strtok(nil, " ");
+    }
+    assert(!mtb_hmap_is_empty(&hmap));
+    for (u64 i = 0; i < mtb_countof(hist); i++) {
+        struct histogram *wc = hist + i;
+        assert(*(u64 *)mtb_hmap_get(&hmap, &wc->word) == wc->count);
+    }
+
+    mtb_hmap_clear(&hmap);
+    assert(mtb_hmap_is_empty(&hmap));
+}
+
+func void
+_test_mtb_hmap_remove(MtbArena *arena, MtbHmapInitOptions opt)
+{
+    mtb_arena_temp_scope(arena);
+    MtbHmap hmap = {0};
+    opt.keyAlign = mtb_alignof(char *);
+    opt.valueAlign = mtb_alignof(u64);
+    mtb_hmap_init_opt(&hmap, arena, sizeof(char *), sizeof(u64), _calc_hash_str, _is_equal_str, opt);
+
+    char *k1 = "Pizza";
+    u64 v1 = 11;
+
+    assert(mtb_hmap_remove(&hmap, &k1) == nil);
+
+    for (int i = 0; i < 5; i++) {
+        *(u64 *)mtb_hmap_put(&hmap, &k1) = v1;
+        assert(*(u64 *)mtb_hmap_remove(&hmap, &k1) == v1);
+        assert(mtb_hmap_remove(&hmap, &k1) == nil);
+    }
+
+    assert(mtb_hmap_is_empty(&hmap));
+}
+
+func void
+_test_mtb_hmap_iter(MtbArena *arena, MtbHmapInitOptions opt)
+{
+    mtb_arena_temp_scope(arena);
+    MtbHmap hmap = {0};
+    opt.keyAlign = mtb_alignof(char *);
+    opt.valueAlign = mtb_alignof(u64);
+    mtb_hmap_init_opt(&hmap, arena, sizeof(char *), sizeof(u64), _calc_hash_str, _is_equal_str, opt);
+
+    MtbHmapIter it = {0};
+    mtb_hmap_iter_init(&it, &hmap);
+
+    assert(!mtb_hmap_iter_has_next(&it));
+
+    struct {
+        char *letter;
+        u64 order;
+    } alphabet[] = {
+        { .letter = "a", .order = 0 },
+        { .letter = "b", .order = 1 },
+        { .letter = "c", .order = 2 },
+        { .letter = "d", .order = 3 },
+        { .letter = "e", .order = 4 },
+        { .letter = "f", .order = 5 },
+        { .letter = "g", .order = 6 },
+        { .letter = "h", .order = 7 },
+        { .letter = "i", .order = 8 },
+        { .letter = "j", .order = 9 },
+        { .letter = "k", .order = 10 },
+        { .letter = "l", .order = 11 },
+        { .letter = "m", .order = 12 },
+        { .letter = "n", .order = 13 },
+        { .letter = "o", .order = 14 },
+        { .letter = "p", .order = 15 },
+        { .letter = "q", .order = 16 },
+        { .letter = "r", .order = 17 },
+        { .letter = "s", .order = 18 },
+        { .letter = "t", .order = 19 },
+        { .letter = "u", .order = 20 },
+        { .letter = "v", .order = 21 },
+        { .letter = "w", .order = 22 },
+        { .letter = "x", .order = 23 },
+        { .letter = "y", .order = 24 },
+        { .letter = "z", .order = 25 },
+    };
+
+    char *removed[] = { "k", "o", "t", "e", "n" };
+
+    for (u64 i = 0; i < mtb_countof(alphabet); i++) {
+        *(u64 *)mtb_hmap_put(&hmap, &alphabet[i].letter) = alphabet[i].order;
+    }
+
+    mtb_hmap_iter_reset(&it);
+    while (mtb_hmap_iter_has_next(&it)) {
+        char *key = *(char **)mtb_hmap_iter_next_key(&it);
+        for (u64 i = 0; i < mtb_countof(removed); i++) {
+            if (strcmp(key, removed[i]) == 0) {
+                mtb_hmap_iter_remove(&it);
+            }
+        }
+    }
+    for (u64 i = 0; i < mtb_countof(removed); i++) {
+        assert(mtb_hmap_get(&hmap, &removed[i]) == nil);
+    }
+
+    mtb_hmap_iter_reset(&it);
+    while (mtb_hmap_iter_has_next(&it)) {
+        mtb_hmap_iter_next(&it);
+        mtb_hmap_iter_remove(&it);
+    }
+    assert(mtb_hmap_is_empty(&hmap));
+
+    mtb_hmap_iter_reset(&it);
+    assert(!mtb_hmap_iter_has_next(&it));
+}
+
+func void
+_test_mtb_hmap_many(MtbArena *arena, MtbHmapInitOptions opt)
+{
+    mtb_arena_temp_scope(arena);
+    MtbHmap hmap = {0};
+    opt.keyAlign = mtb_alignof(u64);
+    opt.valueAlign = mtb_alignof(u64);
+    mtb_hmap_init_opt(&hmap, arena, sizeof(u64), sizeof(u64), _calc_hash_u64, _is_equal_u64, opt);
+
+    u64 n = 4096;
+    for (u64 k = 0; k < n; k++) {
+        *(u64 *)mtb_hmap_put(&hmap, &k) = k * k;
+    }
+    assert(hmap.count == n);
+    assert(hmap.capacity == mtb_hmap_calc_capacity(n));
+
+    for (u64 k = 0; k < n; k += 2) {
+        assert(*(u64 *)mtb_hmap_remove(&hmap, &k) == k * k);
+    }
+    assert(hmap.count == n / 2);
+
+    for (u64 k = 0; k < 2 * n; k++) {
+        u64 *v = mtb_hmap_get(&hmap, &k);
+        if (k < n && k % 2 == 1) {
+            assert(v != nil && *v == k * k);
+        }
+        else {
+            assert(v == nil);
+        }
+    }
+}
+
+func void
+_test_mtb_hmap_clone(MtbArena *arena, MtbHmapInitOptions opt)
+{
+    mtb_arena_temp_scope(arena);
+    MtbHmap hmap = {0};
+    opt.keyAlign = mtb_alignof(u64);
+    opt.valueAlign = mtb_alignof(u64);
+    mtb_hmap_init_opt(&hmap, arena, sizeof(u64), sizeof(u64), _calc_hash_u64, _is_equal_u64, opt);
+
+    u64 n = 100;
+    for (u64 k = 0; k < n; k++) {
+        *(u64 *)mtb_hmap_put(&hmap, &k) = k;
+    }
+    MtbHmap clone = {0};
+    mtb_hmap_clone(&clone, arena, &hmap);
+    for (u64 k = 0; k < n; k += 2) {
+        assert(*(u64 *)mtb_hmap_remove(&clone, &k) == k);
+    }
+    for (u64 k = n; k < 2 * n; k++) {
+        *(u64 *)mtb_hmap_put(&clone, &k) = k;
+    }
+    for (u64 k = 0; k < 2 * n; k++) {
+        u64 *v = mtb_hmap_get(&hmap, &k);
+        assert(k < n ? v != nil && *v == k : v == nil);
+        v = mtb_hmap_get(&clone, &k);
+        assert(k % 2 == 1 || k >= n ? v != nil && *v == k : v == nil);
+    }
+}
+
+func u64
+_calc_hash_u64_clustered(void *key)
+{
+    return (*(u64 *)key >> 6) * u64_lit(0x9E3779B97F4A7C15); // 64 keys per hash
+}
+
+func void
+_test_mtb_hmap_stats(MtbArena *arena, MtbHmapInitOptions opt)
+{
+    mtb_arena_temp_scope(arena);
+    opt.keyAlign = mtb_alignof(u64);
+    opt.valueAlign = mtb_alignof(u64);
+    MtbHmapStats stats[2] = {0};
+    u64 (*hashes[2])(void *) = { _calc_hash_u64, _calc_hash_u64_clustered };
+    u64 n = 1000;
+    for (u64 i = 0; i < mtb_countof(hashes); i++) {
+        mtb_arena_temp_scope(arena);
+        MtbHmap hmap = {0};
+        mtb_hmap_init_opt(&hmap, arena, sizeof(u64), sizeof(u64), hashes[i], _is_equal_u64, opt);
+        for (u64 k = 0; k < n + 100; k++) {
+            mtb_hmap_put(&hmap, &k);
+        }
+        for (u64 k = n; k < n + 100; k++) {
+            mtb_hmap_remove(&hmap, &k);
+        }
+        mtb_hmap_stats(&hmap, stats + i);
+
+        MtbHmapStats *s = stats + i;
+        assert(s->count == n && s->capacity == hmap.capacity);
+        assert(s->tombstones == hmap.deleted);
+        assert(s->bytes >= hmap.capacity * hmap.entrySize);
+        u64 probed = 0;
+        for (u64 j = 0; j < MTB_HMAP_STATS_PROBES; j++) {
+            probed += s->probes[j];
+        }
+        assert(probed == n);
+        assert(s->maxDisplacement >= s->avgDisplacement);
+        assert(s->clusterCount > 0 && s->maxCluster >= s->avgCluster);
+        if (opt.probing != MTB_HMAP_PROBING_GROUP) {
+            assert((u64)(s->avgCluster * (f64)s->clusterCount + 0.5) == n); // every entry is in a cluster
+        }
+    }
+    assert(stats[0].probes[0] > n / 2);
+    assert(stats[1].avgDisplacement > stats[0].avgDisplacement);
+    assert(stats[1].maxDisplacement > stats[0].maxDisplacement);
+}
+
+func void
+_test_mtb_hmap_snapshot(MtbArena *arena, MtbHmapInitOptions opt)
+{
+    mtb_arena_temp_scope(arena);
+    MtbHmap hmap = {0};
+    opt.keyAlign = mtb_alignof(u64);
+    opt.valueAlign = mtb_alignof(u64);
+    mtb_hmap_init_opt(&hmap, arena, sizeof(u64), sizeof(u64), _calc_hash_u64, _is_equal_u64, opt);
+
+    u64 n = 3000;
+    for (u64 k = 0; k < n; k++) {
+        *(u64 *)mtb_hmap_put(&hmap, &k) = k + 1;
+    }
+    for (u64 k = 0; k < n; k += 4) {
+        mtb_hmap_remove(&hmap, &k);
+    }
+
+    char path[] = "/tmp/_test_mtb_hmap.XXXXXX";
+    i32 fd = mkstemp(path);
+    assert(fd >= 0 && close(fd) == 0);
+    assert(mtb_hmap_save(&hmap, path));
+    MtbHmap mapped = {0};
+    assert(mtb_hmap_map(&mapped, path, sizeof(u64), sizeof(u64), _calc_hash_u64, _is_equal_u64));
+    assert(mapped.count == hmap.count);
+    for (u64 k = 0; k < 2 * n; k++) {
+        u64 *v = mtb_hmap_get(&mapped, &k);
+        assert(k < n && k % 4 != 0 ? v != nil && *v == k + 1 : v == nil);
+    }
+    u64 count = 0;
+    MtbHmapIter it = {0};
+    for (mtb_hmap_iter_init(&it, &mapped); mtb_hmap_iter_has_next(&it); count++) {
+        u64 *key = mtb_hmap_iter_next_key(&it);
+        assert(*(u64 *)mtb_hmap_get(&hmap, key) == *key + 1);
+    }
+    assert(count == hmap.count);
+    mtb_hmap_unmap(&mapped);
+
+    // other key or value types
+    assert(!mtb_hmap_map(&mapped, path, sizeof(u32), sizeof(u64), _calc_hash_u32, _is_equal_u32));
+    assert(!mtb_hmap_map(&mapped, path, sizeof(u64), sizeof(u32), _calc_hash_u64, _is_equal_u64));
+    MtbHmap small = {0};
+    mtb_hmap_init_opt(&small, arena, sizeof(u32), sizeof(u32), _calc_hash_u32, _is_equal_u32, opt);
+    for (u32 k = 0; k < 100; k++) {
+        *(u32 *)mtb_hmap_put(&small, &k) = k + 1;
+    }
+    assert(mtb_hmap_save(&small, path));
+    assert(!mtb_hmap_map(&mapped, path, sizeof(u64), sizeof(u64), _calc_hash_u64, _is_equal_u64));
+    assert(mtb_hmap_map(&mapped, path, sizeof(u32), sizeof(u32), _calc_hash_u32, _is_equal_u32));
+    for (u32 k = 0; k < 100; k++) {
+        assert(*(u32 *)mtb_hmap_get(&mapped, &k) == k + 1);
+    }
+    mtb_hmap_unmap(&mapped);
+
+    // broken header, truncated and missing files
+    assert(mtb_hmap_save(&hmap, path));
+    MtbHmapFileHeader header = {0};
+    FILE *file = fopen(path, "r+b");
+    assert(file != nil && fread(&header, sizeof(header), 1, file) == 1);
+    header.headerSize += header.align;
+    header.entrySize += header.align;
+    assert(fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1 && fclose(file) == 0);
+    assert(!mtb_hmap_map(&mapped, path, sizeof(u64), sizeof(u64), _calc_hash_u64, _is_equal_u64));
+    assert(mtb_hmap_save(&hmap, path));
+    assert(truncate(path, MTB_HMAP_FILE_ALIGN + hmap.entrySize) == 0);
+    assert(!mtb_hmap_map(&mapped, path, sizeof(u64), sizeof(u64), _calc_hash_u64, _is_equal_u64));
+    assert(unlink(path) == 0);
+    assert(!mtb_hmap_map(&mapped, path, sizeof(u64), sizeof(u64), _calc_hash_u64, _is_equal_u64));
+}
+
+func void
+_test_mtb_hmap_upsert(MtbArena *arena, MtbHmapInitOptions opt)
+{
+    mtb_arena_temp_scope(arena);
+    MtbHmap hmap = {0};
+    opt.keyAlign = mtb_alignof(u64);
+    opt.valueAlign = mtb_alignof(u64);
+    mtb_hmap_init_opt(&hmap, arena, sizeof(u64), sizeof(u64), _calc_hash_u64, _is_equal_u64, opt);
+
+    u64 n = 1000;
+    for (u64 i = 0; i < 3 * n; i++) {
+        u64 k = i % n;
+        bool inserted;
+        u64 *v = mtb_hmap_upsert(&hmap, &k, &inserted);
+        assert(inserted == (i < n));
+        assert(*v == i / n);
+        *v += 1;
+    }
+    assert(hmap.count == n);
+    for (u64 k = 0; k < n; k++) {
+        assert(*(u64 *)mtb_hmap_get(&hmap, &k) == 3);
+    }
+}
+
+func void
+_test_mtb_hmap_batch(MtbArena *arena, MtbHmapInitOptions opt)
+{
+    mtb_arena_temp_scope(arena);
+    MtbHmap hmap = {0};
+    opt.keyAlign = mtb_alignof(u64);
+    opt.valueAlign = mtb_alignof(u64);
+    mtb_hmap_init_opt(&hmap, arena, sizeof(u64), sizeof(u64), _calc_hash_u64, _is_equal_u64, opt);
+
+    u64 n = 1000;
+    u64 keys[1000];
+    void *values[1000];
+    for (u64 i = 0; i < n; i++) {
+        keys[i] = i % 700; // w/ duplicates
+    }
+    mtb_hmap_put_batch(&hmap, keys, sizeof(u64), n, values);
+    assert(hmap.count == 700);
+    for (u64 i = 0; i < n; i++) {
+        *(u64 *)values[i] += 1;
+    }
+    for (u64 k = 0; k < 700; k++) {
+        assert(*(u64 *)mtb_hmap_get(&hmap, &k) == (k < 300 ? 2 : 1));
+    }
+
+    for (u64 i = 0; i < n; i++) {
+        keys[i] = 2 * i; // every other one is missing
+    }
+    mtb_hmap_get_batch(&hmap, keys, sizeof(u64), n, values);
+    for (u64 i = 0; i < n; i++) {
+        assert(values[i] == mtb_hmap_get(&hmap, &keys[i]));
+        assert((values[i] != nil) == (keys[i] < 700));
+    }
+
+    // colliding keys, robin hood inserts shift the earlier ones of the same batch
+    MtbHmap clustered = {0};
+    mtb_hmap_init_opt(&clustered, arena, sizeof(u64), sizeof(u64), _calc_hash_u64_clustered, _is_equal_u64, opt);
+    MtbRng64 rng = {0};
+    mtb_rng64_init(&rng, 7);
+    for (u64 batch = 0; batch < 20; batch++) {
+        u64 count = 50;
+        for (u64 i = 0; i < count; i++) {
+            keys[i] = mtb_rng64_next_bounded(&rng, 2000);
+        }
+        mtb_hmap_put_batch(&clustered, keys, sizeof(u64), count, values);
+        for (u64 i = 0; i < count; i++) {
+            assert(values[i] == mtb_hmap_get(&clustered, &keys[i]));
+            assert(*(u64 *)values[i] == 0 || *(u64 *)values[i] == keys[i]); // new or seen before
+            *(u64 *)values[i] = keys[i];
+        }
+    }
+}
+
+func u64
+_calc_hash_const(void *key)
+{
+    return MTB_HMAP_MIN_CAPACITY - 1;
+}
+
+func void
+_test_mtb_hmap_churn(MtbArena *arena, MtbHmapInitOptions opt)
+{
+    mtb_arena_temp_scope(arena);
+    MtbHmap hmap = {0};
+    opt.keyAlign = mtb_alignof(u64);
+    opt.valueAlign = mtb_alignof(u64);
+    mtb_hmap_init_opt(&hmap, arena, sizeof(u64), sizeof(u64), _calc_hash_u64, _is_equal_u64, opt);
+
+    // keep a sliding window of live keys, the table must not keep growing
+    u64 window = 100;
+    for (u64 k = 0; k < 100 * window; k++) {
+        *(u64 *)mtb_hmap_put(&hmap, &k) = k;
+        if (k >= window) {
+            u64 old = k - window;
+            assert(*(u64 *)mtb_hmap_remove(&hmap, &old) == old);
+            assert(mtb_hmap_get(&hmap, &old) == nil);
+        }
+    }
+    assert(hmap.count == window);
+    assert(hmap.capacity <= mtb_hmap_calc_capacity(2 * window));
+    for (u64 k = 99 * window; k < 100 * window; k++) {
+        assert(*(u64 *)mtb_hmap_get(&hmap, &k) == k);
+    }
+}
+
+func void
+_test_mtb_hmap_iter_remove_wrap(MtbArena *arena, MtbHmapInitOptions opt)
+{
+    mtb_arena_temp_scope(arena);
+    MtbHmap hmap = {0};
+    opt.keyAlign = mtb_alignof(u64);
+    opt.valueAlign = mtb_alignof(u64);
+    mtb_hmap_init_opt(&hmap, arena, sizeof(u64), sizeof(u64), _calc_hash_const, _is_equal_u64, opt);
+
+    // all keys collide on the last slot, so the cluster wraps around
+    u64 n = 8;
+    for (u64 k = 0; k < n; k++) {
+        *(u64 *)mtb_hmap_put(&hmap, &k) = k;
+    }
+
+    u64 visited = 0;
+    MtbHmapIter it = {0};
+    mtb_hmap_iter_init(&it, &hmap);
+    while (mtb_hmap_iter_has_next(&it)) {
+        u64 key = *(u64 *)mtb_hmap_iter_next_key(&it);
+        assert((visited & (u64_lit(1) << key)) == 0);
+        visited |= u64_lit(1) << key;
+        if (key % 2 == 0) {
+            u8 *removed = mtb_hmap_iter_remove(&it);
+            assert(*(u64 *)mtb_hmap_entry_value(&hmap, removed) == key);
+        }
+    }
+    assert(visited == (u64_lit(1) << n) - 1);
+    assert(hmap.count == n / 2);
+    for (u64 k = 0; k < n; k++) {
+        assert((mtb_hmap_get(&hmap, &k) != nil) == (k % 2 == 1));
+    }
+}
+
+func void
+_test_mtb_hmap_small(MtbArena *arena, MtbHmapInitOptions opt)
+{
+    mtb_arena_temp_scope(arena);
+    MtbHmap hmap = {0};
+    opt.keyAlign = mtb_alignof(u64);
+    opt.valueAlign = mtb_alignof(u64);
+    opt.small = true;
+    mtb_hmap_init_opt(&hmap, arena, sizeof(u64), sizeof(u64), _calc_hash_u64, _is_equal_u64, opt);
+    assert(hmap.small && hmap.ctrl == nil);
+
+    u64 n = MTB_HMAP_SMALL_CAPACITY;
+    for (u64 k = 0; k < n; k++) {
+        *(u64 *)mtb_hmap_put(&hmap, &k) = k + 1;
+    }
+    assert(hmap.small && hmap.count == n);
+    u64 get = 3;
+    u64 *values[1];
+    mtb_hmap_get_batch(&hmap, &get, sizeof(u64), 1, (void **)values);
+    assert(*values[0] == 4 && mtb_hmap_get_hashed(&hmap, &get, _calc_hash_u64(&get)) == values[0]);
+
+    // removal swaps the last entry in, iteration visits it anyway
+    u64 k0 = 0;
+    assert(*(u64 *)mtb_hmap_remove(&hmap, &k0) == 1);
+    assert(mtb_hmap_get(&hmap, &k0) == nil);
+    u64 visited = 0;
+    MtbHmapIter it = {0};
+    for (mtb_hmap_iter_init(&it, &hmap); mtb_hmap_iter_has_next(&it);) {
+        u64 key = *(u64 *)mtb_hmap_iter_next_key(&it);
+        visited |= u64_lit(1) << key;
+        if (key % 2 == 1) {
+            assert(*(u64 *)mtb_hmap_entry_value(&hmap, mtb_hmap_iter_remove(&it)) == key + 1);
         }
-        token = strtok(nil, " ");
     }
-    assert(!mtb_hmap_is_empty(&hmap));
-    for (u64 i = 0; i < mtb_countof(hist); i++) {
-        struct histogram *wc = hist + i;
-        assert(*(u64 *)mtb_hmap_get(&hmap, &wc->word) == wc->count);
+    assert(visited == ((u64_lit(1) << n) - 1) - 1);
+    assert(hmap.count == n / 2 - 1);
+
+    // over the small capacity it becomes a regular hash table
+    for (u64 k = 0; k < 4 * n; k += 2) {
+        *(u64 *)mtb_hmap_put(&hmap, &k) = k + 1;
+    }
+    assert(!hmap.small && hmap.count == 2 * n);
+    assert((hmap.ctrl != nil) == (opt.probing == MTB_HMAP_PROBING_GROUP));
+    for (u64 k = 0; k < 4 * n; k++) {
+        u64 *v = mtb_hmap_get(&hmap, &k);
+        assert(k % 2 == 0 ? v != nil && *v == k + 1 : v == nil);
     }
+    for (u64 k = 0; k < 4 * n; k += 4) {
+        assert(*(u64 *)mtb_hmap_remove(&hmap, &k) == k + 1);
+    }
+    assert(hmap.count == n);
+}
 
-    mtb_hmap_clear(&hmap);
-    assert(mtb_hmap_is_empty(&hmap));
+func u64
+_calc_hash_parity(void *key)
+{
+    return (*(u64 *)key & 1) << 7; // even keys probe from group 0, odd keys from group 1
 }
 
 func void
-_test_mtb_hmap_remove(MtbArena arena)
+_test_mtb_hmap_drop_deleted(MtbArena *arena)
 {
+    mtb_arena_temp_scope(arena);
     MtbHmap hmap = {0};
-    mtb_hmap_init(&hmap, &arena, sizeof(char *), sizeof(u64), _calc_hash_str, _is_equal_str);
+    mtb_hmap_init(&hmap, arena, u64, u64, _calc_hash_parity, _is_equal_u64,
+                  .capacity = 2 * MTB_HMAP_GROUP_WIDTH,
+                  .probing = MTB_HMAP_PROBING_GROUP);
 
-    char *k1 = "Pizza";
-    u64 v1 = 11;
+    // fill group 0 with even keys, then remove them all: tombstones
+    for (u64 k = 0; k < 2 * (MTB_HMAP_GROUP_WIDTH + 2); k += 2) {
+        *(u64 *)mtb_hmap_put(&hmap, &k) = k;
+    }
+    for (u64 k = 0; k < 2 * MTB_HMAP_GROUP_WIDTH; k += 2) {
+        assert(*(u64 *)mtb_hmap_remove(&hmap, &k) == k);
+    }
+    assert(hmap.deleted == MTB_HMAP_GROUP_WIDTH);
 
-    assert(mtb_hmap_remove(&hmap, &k1) == nil);
+    // odd keys never reach group 0, so tombstones pile up until rehash
+    for (u64 k = 1; k < 2 * 8; k += 2) {
+        *(u64 *)mtb_hmap_put(&hmap, &k) = k;
+    }
+    assert(hmap.deleted == 0);
+    assert(hmap.capacity == 2 * MTB_HMAP_GROUP_WIDTH);
+    for (u64 k = 0; k < 2 * (MTB_HMAP_GROUP_WIDTH + 2); k++) {
+        u64 *v = mtb_hmap_get(&hmap, &k);
+        bool isLive = (k % 2 == 1 && k < 2 * 8) || (k % 2 == 0 && k >= 2 * MTB_HMAP_GROUP_WIDTH);
+        assert(isLive ? v != nil && *v == k : v == nil);
+    }
+}
 
-    for (int i = 0; i < 5; i++) {
-        *(u64 *)mtb_hmap_put(&hmap, &k1) = v1;
-        assert(*(u64 *)mtb_hmap_remove(&hmap, &k1) == v1);
-        assert(mtb_hmap_remove(&hmap, &k1) == nil);
+func void
+_test_mtb_hmap_check_robin_hood(MtbHmap *hmap)
+{
+    u64 count = 0;
+    for (u64 index = 0; index < hmap->capacity; index++) {
+        u8 *entry = mtb_hmap_entry(hmap, index);
+        MtbHmapEntryStatus status = mtb_hmap_entry_header(hmap, entry)->status;
+        if (status == MTB_HMAP_ENTRY_FREE) {
+            continue;
+        }
+        u64 home = _mtb_hmap_modulo_capacity(hmap, hmap->key_hash(mtb_hmap_entry_key(hmap, entry)));
+        assert(status - 1u == _mtb_hmap_modulo_capacity(hmap, index - home));
+
+        u8 *next = mtb_hmap_entry(hmap, _mtb_hmap_modulo_capacity(hmap, index + 1));
+        assert(mtb_hmap_entry_header(hmap, next)->status <= status + 1u);
+        count++;
     }
+    assert(count == hmap->count);
+}
 
-    assert(mtb_hmap_is_empty(&hmap));
+func void
+_test_mtb_hmap_robin_hood(MtbArena *arena)
+{
+    mtb_arena_temp_scope(arena);
+    MtbHmap hmap = {0};
+    mtb_hmap_init(&hmap, arena, u64, u64, _calc_hash_u64, _is_equal_u64,
+                  .probing = MTB_HMAP_PROBING_ROBIN_HOOD,
+                  .maxLoad = 0.9f);
+
+    u64 n = 3000;
+    for (u64 k = 0; k < n; k++) {
+        *(u64 *)mtb_hmap_put(&hmap, &k) = k;
+    }
+    assert(hmap.capacity == 4096);
+    _test_mtb_hmap_check_robin_hood(&hmap);
+
+    for (u64 k = 0; k < n; k += 3) {
+        assert(*(u64 *)mtb_hmap_remove(&hmap, &k) == k);
+    }
+    _test_mtb_hmap_check_robin_hood(&hmap);
+    for (u64 k = 0; k < n; k++) {
+        assert((mtb_hmap_get(&hmap, &k) == nil) == (k % 3 == 0));
+    }
+}
+
+func u64
+_calc_hash_last_or_u64(void *key)
+{
+    return *(u64 *)key < U32_MAX ? U64_MAX : _calc_hash_u64(key); // small keys go to the last slot
 }
 
 func void
-_test_mtb_hmap_iter(MtbArena arena)
+_test_mtb_hmap_robin_hood_equal_hashes(MtbArena *arena)
 {
+    mtb_arena_temp_scope(arena);
+    for (u32 incremental = 0; incremental < 2; incremental++) {
+        MtbHmap hmap = {0};
+        mtb_hmap_init(&hmap, arena, u64, u64, _calc_hash_const, _is_equal_u64,
+                      .probing = MTB_HMAP_PROBING_ROBIN_HOOD,
+                      .incremental = incremental);
+
+        // distances past the status overflow, falls back to linear instead of growing,
+        // also while moving entries during an incremental resize
+        u64 n = 1000;
+        for (u64 k = 0; k < n; k++) {
+            *(u64 *)mtb_hmap_put(&hmap, &k) = k;
+        }
+        assert(hmap.probing == MTB_HMAP_PROBING_LINEAR);
+        assert(hmap.count == n && hmap.capacity == mtb_hmap_calc_capacity(n));
+        for (u64 k = 0; k < n; k += 2) {
+            assert(*(u64 *)mtb_hmap_remove(&hmap, &k) == k);
+        }
+        for (u64 k = 0; k < n; k++) {
+            u64 *v = mtb_hmap_get(&hmap, &k);
+            assert(k % 2 == 0 ? v == nil : *v == k);
+        }
+    }
+
+    // Overflows while moving an old entry: equal hashes in both tables, the old
+    // cluster wraps around the end, so it's migrated last.
     MtbHmap hmap = {0};
-    mtb_hmap_init(&hmap, &arena, sizeof(char *), sizeof(u64), _calc_hash_str, _is_equal_str);
+    mtb_hmap_init(&hmap, arena, u64, u64, _calc_hash_last_or_u64, _is_equal_u64,
+                  .probing = MTB_HMAP_PROBING_ROBIN_HOOD,
+                  .incremental = true);
+    u64 equal = 240;
+    u64 k = 0;
+    for (; k < equal; k++) {
+        *(u64 *)mtb_hmap_put(&hmap, &k) = k;
+    }
+    u64 other = U32_MAX;
+    while (hmap.oldCapacity < 4096) {
+        *(u64 *)mtb_hmap_put(&hmap, &other) = other;
+        other++;
+    }
+    while (hmap.oldEntries != nil) {
+        *(u64 *)mtb_hmap_put(&hmap, &k) = k;
+        k++;
+    }
+    assert(hmap.probing == MTB_HMAP_PROBING_LINEAR);
+    for (u64 j = 0; j < k; j++) {
+        assert(*(u64 *)mtb_hmap_get(&hmap, &j) == j);
+    }
+    for (u64 j = U32_MAX; j < other; j++) {
+        assert(*(u64 *)mtb_hmap_get(&hmap, &j) == j);
+    }
+}
 
-    MtbHmapIter it = {0};
-    mtb_hmap_iter_init(&it, &hmap);
+global u64 _test_mtb_hmap_hash_calls = 0;
 
-    assert(!mtb_hmap_iter_has_next(&it));
+func u64
+_calc_hash_u64_counted(void *key)
+{
+    _test_mtb_hmap_hash_calls++;
+    return _calc_hash_u64(key);
+}
 
-    struct {
-        char *letter;
-        u64 order;
-    } alphabet[] = {
-        { .letter = "a", .order = 0 },
-        { .letter = "b", .order = 1 },
-        { .letter = "c", .order = 2 },
-        { .letter = "d", .order = 3 },
-        { .letter = "e", .order = 4 },
-        { .letter = "f", .order = 5 },
-        { .letter = "g", .order = 6 },
-        { .letter = "h", .order = 7 },
-        { .letter = "i", .order = 8 },
-        { .letter = "j", .order = 9 },
-        { .letter = "k", .order = 10 },
-        { .letter = "l", .order = 11 },
-        { .letter = "m", .order = 12 },
-        { .letter = "n", .order = 13 },
-        { .letter = "o", .order = 14 },
-        { .letter = "p", .order = 15 },
-        { .letter = "q", .order = 16 },
-        { .letter = "r", .order = 17 },
-        { .letter = "s", .order = 18 },
-        { .letter = "t", .order = 19 },
-        { .letter = "u", .order = 20 },
-        { .letter = "v", .order = 21 },
-        { .letter = "w", .order = 22 },
-        { .letter = "x", .order = 23 },
-        { .letter = "y", .order = 24 },
-        { .letter = "z", .order = 25 },
-    };
+func void
+_test_mtb_hmap_store_hash(MtbArena *arena)
+{
+    mtb_arena_temp_scope(arena);
+    MtbHmap hmap = {0};
+    mtb_hmap_init(&hmap, arena, u64, u64, _calc_hash_u64_counted, _is_equal_u64, .storeHash = true);
+    assert(hmap.headerSize == 2 * sizeof(u64));
 
-    char *removed[] = { "k", "o", "t", "e", "n" };
+    _test_mtb_hmap_hash_calls = 0;
+    u64 n = 1000;
+    for (u64 k = 0; k < n; k++) {
+        *(u64 *)mtb_hmap_put(&hmap, &k) = k;
+    }
+    assert(hmap.capacity > MTB_HMAP_MIN_CAPACITY);
+    assert(_test_mtb_hmap_hash_calls == n); // growing doesn't rehash keys
 
-    for (u64 i = 0; i < mtb_countof(alphabet); i++) {
-        *(u64 *)mtb_hmap_put(&hmap, &alphabet[i].letter) = alphabet[i].order;
+    for (u64 k = 0; k < n; k++) {
+        u8 *entry = (u8 *)mtb_hmap_get(&hmap, &k) - hmap.keySize - hmap.headerSize;
+        assert(*mtb_hmap_entry_hash(&hmap, entry) == _calc_hash_u64(&k));
     }
+}
 
-    mtb_hmap_iter_reset(&it);
-    while (mtb_hmap_iter_has_next(&it)) {
-        char *key = *(char **)mtb_hmap_iter_next_key(&it);
-        for (u64 i = 0; i < mtb_countof(removed); i++) {
-            if (strcmp(key, removed[i]) == 0) {
-                mtb_hmap_iter_remove(&it);
-            }
+// The stored hash pads a u32 key to 8 bytes, only 4 may be read from the caller's key.
+func void
+_test_mtb_hmap_store_hash_small_keys(MtbArena *arena)
+{
+    mtb_arena_temp_scope(arena);
+    MtbHmapInitOptions configs[] = {
+        { .probing = MTB_HMAP_PROBING_LINEAR, .storeHash = true },
+        { .probing = MTB_HMAP_PROBING_GROUP, .storeHash = true },
+        { .probing = MTB_HMAP_PROBING_ROBIN_HOOD, .storeHash = true },
+        { .probing = MTB_HMAP_PROBING_LINEAR, .storeHash = true, .small = true },
+    };
+    for (u64 i = 0; i < mtb_countof(configs); i++) {
+        MtbHmap hmap = {0};
+        mtb_hmap_init_opt(&hmap, arena, sizeof(u32), sizeof(u32), _calc_hash_u32, _is_equal_u32, configs[i]);
+        assert(hmap.keySize == sizeof(u64) && hmap.keyBytes == sizeof(u32));
+        for (u32 k = 0; k < 100; k++) {
+            *(u32 *)mtb_hmap_put(&hmap, &k) = k + 1;
+        }
+        for (u32 k = 0; k < 100; k++) {
+            bool inserted;
+            assert(*(u32 *)mtb_hmap_upsert(&hmap, &k, &inserted) == k + 1 && !inserted);
         }
     }
-    for (u64 i = 0; i < mtb_countof(removed); i++) {
-        assert(mtb_hmap_get(&hmap, &removed[i]) == nil);
+}
+
+func void
+_test_mtb_hmap_incremental(MtbArena *arena, MtbHmapProbing probing)
+{
+    mtb_arena_temp_scope(arena);
+    MtbHmap hmap = {0};
+    mtb_hmap_init(&hmap, arena, u64, u64, _calc_hash_u64, _is_equal_u64, .probing = probing, .incremental = true);
+
+    u64 n = 4096;
+    bool migrating = false;
+    for (u64 k = 0; k < n; k++) {
+        *(u64 *)mtb_hmap_put(&hmap, &k) = k;
+        if (hmap.oldEntries == nil) {
+            continue;
+        }
+        migrating = true;
+        assert(hmap.migrated <= hmap.oldCapacity);
+        for (u64 j = 0; j <= k; j++) {
+            assert(*(u64 *)mtb_hmap_get(&hmap, &j) == j);
+        }
+    }
+    assert(migrating);
+    assert(hmap.count == n);
+    assert(hmap.capacity == mtb_hmap_calc_capacity(n));
+
+    // grow once more, then remove and update entries of both tables
+    while (hmap.oldEntries == nil) {
+        *(u64 *)mtb_hmap_put(&hmap, &n) = n;
+        n++;
+    }
+    u64 oldCount = 0;
+    MtbHmapIter it = {0};
+    mtb_hmap_iter_init(&it, &hmap);
+    for (u64 k = 0; k < n; k += 3) {
+        assert(*(u64 *)mtb_hmap_remove(&hmap, &k) == k);
+        assert(mtb_hmap_get(&hmap, &k) == nil);
+        u64 next = k + 1;
+        if (next < n) {
+            *(u64 *)mtb_hmap_put(&hmap, &next) += n;
+        }
+        oldCount += hmap.oldEntries != nil;
     }
+    assert(oldCount > 0);
+    assert(hmap.oldEntries == nil);
 
-    mtb_hmap_iter_reset(&it);
+    u64 count = 0;
     while (mtb_hmap_iter_has_next(&it)) {
-        mtb_hmap_iter_next(&it);
-        mtb_hmap_iter_remove(&it);
+        u64 k = *(u64 *)mtb_hmap_iter_next_key(&it);
+        u64 v = k % 3 == 1 ? k + n : k;
+        assert(k % 3 != 0);
+        assert(*(u64 *)mtb_hmap_get(&hmap, &k) == v);
+        count++;
     }
-    assert(mtb_hmap_is_empty(&hmap));
+    assert(count == hmap.count);
+    assert(count == n - (n + 2) / 3);
+}
 
-    mtb_hmap_iter_reset(&it);
-    assert(!mtb_hmap_iter_has_next(&it));
+func void
+_test_mtb_hmap_grow_in_place(MtbArena *arena, MtbHmapProbing probing)
+{
+    mtb_arena_temp_scope(arena);
+    MtbArenaTemp temp = mtb_arena_temp_begin(arena);
+    MtbHmap hmap = {0};
+    mtb_hmap_init(&hmap, arena, u64, u64, _calc_hash_u64, _is_equal_u64, .probing = probing);
+
+    u64 n = 4096;
+    for (u64 k = 0; k < n; k++) {
+        *(u64 *)mtb_hmap_put(&hmap, &k) = k;
+    }
+    assert(hmap.capacity == mtb_hmap_calc_capacity(n));
+    // only the final table and the padding before it are left in the arena
+    assert(arena->offset - temp.offset <= _mtb_hmap_block_size(&hmap) + MTB_HMAP_GROUP_WIDTH);
+
+    // not the last allocation anymore, grows into a new block
+    u64 *last = mtb_arena_bump(arena, u64, 1);
+    mtb_hmap_grow(&hmap, hmap.capacity << 1);
+    assert(hmap.entries > (u8 *)last);
+    for (u64 k = 0; k < n; k++) {
+        assert(*(u64 *)mtb_hmap_get(&hmap, &k) == k);
+    }
+    mtb_arena_temp_end(&temp);
+}
+
+MTB_HMAP_DEFINE(MtbTestU64Map, _test_u64_map, u64, u64, _calc_hash_u64, _is_equal_u64)
+
+func void
+_test_mtb_hmap_typed(MtbArena *arena)
+{
+    mtb_arena_temp_scope(arena);
+    MtbTestU64Map hmap = {0};
+    _test_u64_map_init(&hmap, arena, 0);
+
+    // same operations on the generic map, results must match
+    MtbHmap ref = {0};
+    mtb_hmap_init(&ref, arena, u64, u64, _calc_hash_u64, _is_equal_u64);
+
+    MtbRng64 rng = {0};
+    mtb_rng64_init(&rng, 42);
+    for (u64 i = 0; i < 100000; i++) {
+        u64 k = mtb_rng64_next_bounded(&rng, 2048);
+        switch (mtb_rng64_next_bounded(&rng, 3)) {
+            case 0: {
+                bool inserted, refInserted;
+                *_test_u64_map_upsert(&hmap, &k, &inserted) += k;
+                *(u64 *)mtb_hmap_upsert(&ref, &k, &refInserted) += k;
+                assert(inserted == refInserted);
+            } break;
+            case 1: {
+                u64 *v = _test_u64_map_remove(&hmap, &k);
+                u64 *refV = mtb_hmap_remove(&ref, &k);
+                assert((v == nil) == (refV == nil));
+                assert(v == nil || *v == *refV);
+            } break;
+            default: {
+                u64 *v = _test_u64_map_get(&hmap, &k);
+                u64 *refV = mtb_hmap_get(&ref, &k);
+                assert((v == nil) == (refV == nil));
+                assert(v == nil || *v == *refV);
+            } break;
+        }
+        assert(hmap.count == ref.count);
+    }
+
+    u64 count = 0;
+    MtbTestU64MapIter it = {0};
+    _test_u64_map_iter_init(&it, &hmap);
+    while (_test_u64_map_iter_has_next(&it)) {
+        MtbTestU64MapEntry *entry = _test_u64_map_iter_next(&it);
+        assert(entry->value == *(u64 *)mtb_hmap_get(&ref, &entry->key));
+        count++;
+    }
+    assert(count == ref.count);
+
+    _test_u64_map_clear(&hmap);
+    assert(hmap.count == 0);
+    for (u64 k = 0; k < 2048; k++) {
+        assert(_test_u64_map_get(&hmap, &k) == nil);
+    }
 }
 
 func void
@@ -795,10 +2920,47 @@ _test_mtb_hmap(void)
     MtbArena arena = {0};
     mtb_arena_init(&arena, mb(1), &MTB_ARENA_DEF_ALLOCATOR);
 
-    _test_mtb_hmap_put(arena);
-    _test_mtb_hmap_remove(arena);
+    MtbHmapInitOptions configs[] = {
+        { .probing = MTB_HMAP_PROBING_LINEAR },
+        { .probing = MTB_HMAP_PROBING_GROUP },
+        { .probing = MTB_HMAP_PROBING_LINEAR, .storeHash = true },
+        { .probing = MTB_HMAP_PROBING_GROUP, .storeHash = true },
+        { .probing = MTB_HMAP_PROBING_ROBIN_HOOD },
+        { .probing = MTB_HMAP_PROBING_ROBIN_HOOD, .storeHash = true, .maxLoad = 0.9f },
+        { .probing = MTB_HMAP_PROBING_LINEAR, .incremental = true },
+        { .probing = MTB_HMAP_PROBING_GROUP, .incremental = true },
+        { .probing = MTB_HMAP_PROBING_ROBIN_HOOD, .incremental = true },
+        { .probing = MTB_HMAP_PROBING_LINEAR, .small = true },
+        { .probing = MTB_HMAP_PROBING_GROUP, .storeHash = true, .small = true },
+        { .probing = MTB_HMAP_PROBING_ROBIN_HOOD, .incremental = true, .small = true },
+    };
+    for (u64 i = 0; i < mtb_countof(configs); i++) {
+        _test_mtb_hmap_put(&arena, configs[i]);
+        _test_mtb_hmap_remove(&arena, configs[i]);
+        _test_mtb_hmap_iter(&arena, configs[i]);
+        _test_mtb_hmap_many(&arena, configs[i]);
+        _test_mtb_hmap_churn(&arena, configs[i]);
+        _test_mtb_hmap_iter_remove_wrap(&arena, configs[i]);
+        _test_mtb_hmap_upsert(&arena, configs[i]);
+        _test_mtb_hmap_clone(&arena, configs[i]);
+        _test_mtb_hmap_snapshot(&arena, configs[i]);
+        _test_mtb_hmap_stats(&arena, configs[i]);
+        _test_mtb_hmap_batch(&arena, configs[i]);
+        _test_mtb_hmap_small(&arena, configs[i]);
+    }
+    _test_mtb_hmap_store_hash(&arena);
+    _test_mtb_hmap_store_hash_small_keys(&arena);
+    _test_mtb_hmap_drop_deleted(&arena);
+    _test_mtb_hmap_robin_hood(&arena);
+    _test_mtb_hmap_robin_hood_equal_hashes(&arena);
+    _test_mtb_hmap_grow_in_place(&arena, MTB_HMAP_PROBING_LINEAR);
+    _test_mtb_hmap_grow_in_place(&arena, MTB_HMAP_PROBING_GROUP);
+    _test_mtb_hmap_grow_in_place(&arena, MTB_HMAP_PROBING_ROBIN_HOOD);
+    _test_mtb_hmap_incremental(&arena, MTB_HMAP_PROBING_LINEAR);
+    _test_mtb_hmap_incremental(&arena, MTB_HMAP_PROBING_GROUP);
+    _test_mtb_hmap_incremental(&arena, MTB_HMAP_PROBING_ROBIN_HOOD);
+    _test_mtb_hmap_typed(&arena);
     _test_mtb_hmap_calc_capacity();
-    _test_mtb_hmap_iter(arena);
 
     mtb_arena_deinit(&arena);
 }
@@ -828,55 +2990,59 @@ _is_equal_str(void *key1, void *key2)
     return strcmp(s1, s2) == 0;
 }
 
-func void
-_bench_mtb_hmap(void)
+func u64
+_calc_hash_u64(void *key)
 {
-    mtb_perf_start();
-
-    FILE *inputFile = fopen("data/shakespeare.txt", "r");
-    fseek(inputFile, 0L, SEEK_END);
-    u64 inputFileSize = ftell(inputFile);
-    fseek(inputFile, 0L, SEEK_SET);
+    return *(u64 *)key * 0x9E3779B97F4A7C15;
+}
 
-    MtbArena arena = {0};
-    mtb_arena_init(&arena, inputFileSize * 10, &MTB_ARENA_DEF_ALLOCATOR);
+func bool
+_is_equal_u64(void *key1, void *key2)
+{
+    return *(u64 *)key1 == *(u64 *)key2;
+}
 
-    char *inputData = mtb_arena_bump(&arena, char, inputFileSize + 1);
-    if (fread(inputData, sizeof(char), inputFileSize, inputFile) != inputFileSize) {
-        fprintf(stderr, "fread() failed\n");
-        exit(1);
+func void
+_bench_mtb_hmap_put_latency(MtbArena *arena, MtbHmapInitOptions opt)
+{
+    mtb_arena_temp_scope(arena);
+    MtbHmap hmap = {0};
+    mtb_hmap_init_opt(&hmap, arena, sizeof(u64), sizeof(u64), _calc_hash_u64, _is_equal_u64, opt);
+
+    u64 n = 1 << 20;
+    u64 total = 0;
+    u64 worst = 0;
+    for (u64 k = 0; k < n; k++) {
+        u64 beg = mtb_perf_cpu_time();
+        *(u64 *)mtb_hmap_put(&hmap, &k) = k;
+        u64 elapsed = mtb_perf_cpu_time() - beg;
+        total += elapsed;
+        worst = mtb_max_u64(worst, elapsed);
     }
-    fclose(inputFile);
+    assert(hmap.count == n);
+    printf("put: %lu total, %lu avg, %lu max (cpu time)\n", total, total / n, worst);
+}
 
-    MtbDynArr tokens = {0};
-    mtb_dynarr_init(&tokens, &arena, sizeof(char *));
-    char *token = strtok(inputData, " \t\r\n");
-    while (token != nil) {
-        *(char **)mtb_dynarr_push(&tokens) = token;
-        token = strtok(nil, " \n");
-    }
+func void
+_bench_mtb_hmap_word_count(MtbArena *arena, MtbDynArr *tokens, MtbHmapInitOptions opt, i32 iterationCount)
+{
+    mtb_arena_temp_scope(arena);
+    mtb_perf_start();
 
-    i32 iterationCount = 1000;
     for (i32 i = 0; i < iterationCount; i++) {
-        MtbArena arenaTmp = arena;
+        mtb_arena_temp_scope(arena);
 
         MtbHmap hmap = {0};
-        mtb_hmap_init(&hmap, &arenaTmp, char *, u64, _calc_hash_str, _is_equal_str);
+        mtb_hmap_init_opt(&hmap, arena, sizeof(char *), sizeof(u64), _calc_hash_str, _is_equal_str, opt);
 
         MtbDynArrIter tokensIterator = {0};
-        mtb_dynarr_iter_init(&tokensIterator, &tokens);
+        mtb_dynarr_iter_init(&tokensIterator, tokens);
 
         while (mtb_dynarr_iter_has_next(&tokensIterator)) {
             char *token = *(char **)mtb_dynarr_iter_next(&tokensIterator);
-            mtb_perf_time_block("get");
-            u64 *count = mtb_hmap_get(&hmap, &token);
-            if (count == nil) {
-                mtb_perf_time_block("put");
-                *(u64 *)mtb_hmap_put(&hmap, &token) = 1;
-            }
-            else {
-                *count += 1;
-            }
+            mtb_perf_time_block("upsert");
+            bool inserted;
+            *(u64 *)mtb_hmap_upsert(&hmap, &token, &inserted) += 1;
         }
 
         // sanity check
@@ -894,8 +3060,248 @@ _bench_mtb_hmap(void)
             struct histogram *wc = hist + i;
             assert(*(u64 *)mtb_hmap_get(&hmap, &wc->word) == wc->count);
         }
+        if (i == iterationCount - 1) {
+            MtbHmapStats stats = {0};
+            mtb_hmap_stats(&hmap, &stats);
+            mtb_hmap_stats_print(&stats, "table");
+        }
+    }
+    mtb_perf_print();
+}
+
+func void
+_bench_mtb_hmap_get_batch(MtbArena *arena, MtbHmapInitOptions opt)
+{
+    mtb_arena_temp_scope(arena);
+    MtbHmap hmap = {0};
+    mtb_hmap_init_opt(&hmap, arena, sizeof(u64), sizeof(u64), _calc_hash_u64, _is_equal_u64, opt);
+
+    u64 n = 1 << 21;
+    u64 *keys = mtb_arena_bump(arena, u64, n);
+    void **values = mtb_arena_bump(arena, void *, n);
+    for (u64 k = 0; k < n; k++) {
+        *(u64 *)mtb_hmap_put(&hmap, &k) = k;
+    }
+    MtbRng64 rng = {0};
+    mtb_rng64_init(&rng, 42);
+    for (u64 i = 0; i < n; i++) {
+        keys[i] = mtb_rng64_next_bounded(&rng, 2 * n);
+    }
+
+    u64 beg = mtb_perf_cpu_time();
+    for (u64 i = 0; i < n; i++) {
+        values[i] = mtb_hmap_get(&hmap, &keys[i]);
+    }
+    u64 single = mtb_perf_cpu_time() - beg;
+
+    beg = mtb_perf_cpu_time();
+    mtb_hmap_get_batch(&hmap, keys, sizeof(u64), n, values);
+    u64 batch = mtb_perf_cpu_time() - beg;
+
+    for (u64 i = 0; i < n; i++) {
+        assert((values[i] != nil) == (keys[i] < n));
+    }
+    printf("get: %lu, get_batch: %lu (cpu time)\n", single, batch);
+}
+
+// Startup cost: rebuilding the map vs mapping a saved snapshot, then the first lookups.
+func void
+_bench_mtb_hmap_snapshot(MtbArena *arena, MtbHmapInitOptions opt)
+{
+    mtb_arena_temp_scope(arena);
+    u64 n = 1 << 22;
+    u64 lookupCount = 1 << 20;
+    char path[] = "/tmp/_bench_mtb_hmap.XXXXXX";
+    i32 fd = mkstemp(path);
+    mtb_assert_always(fd >= 0 && close(fd) == 0);
+
+    u64 beg = mtb_perf_sys_time();
+    MtbHmap hmap = {0};
+    mtb_hmap_init_opt(&hmap, arena, sizeof(u64), sizeof(u64), _calc_hash_u64, _is_equal_u64, opt);
+    for (u64 k = 0; k < n; k++) {
+        *(u64 *)mtb_hmap_put(&hmap, &k) = k;
+    }
+    u64 build = mtb_perf_sys_time() - beg;
+
+    beg = mtb_perf_sys_time();
+    mtb_assert_always(mtb_hmap_save(&hmap, path));
+    u64 save = mtb_perf_sys_time() - beg;
+
+    beg = mtb_perf_sys_time();
+    MtbHmap mapped = {0};
+    mtb_assert_always(mtb_hmap_map(&mapped, path, sizeof(u64), sizeof(u64), _calc_hash_u64, _is_equal_u64));
+    u64 map = mtb_perf_sys_time() - beg;
+
+    MtbRng64 rng = {0};
+    mtb_rng64_init(&rng, 42);
+    u64 sum = 0;
+    beg = mtb_perf_sys_time();
+    for (u64 i = 0; i < lookupCount; i++) {
+        sum += *(u64 *)mtb_hmap_get(&mapped, &(u64){ mtb_rng64_next_bounded(&rng, n) });
+    }
+    u64 get = mtb_perf_sys_time() - beg;
+    assert(sum > 0);
+
+    f64 ms = 1000.0 / (f64)mtb_perf_sys_freq();
+    printf("%lu entries: build %.1f ms, save %.1f ms, map %.3f ms, %lu gets on the mapped map %.1f ms\n",
+           n,
+           (f64)build * ms,
+           (f64)save * ms,
+           (f64)map * ms,
+           lookupCount,
+           (f64)get * ms);
+
+    mtb_hmap_unmap(&mapped);
+    unlink(path);
+}
+
+func void
+_bench_mtb_hmap_small(MtbArena *arena, MtbHmapInitOptions opt)
+{
+    mtb_arena_temp_scope(arena);
+    // many tiny maps, e.g. per object attributes
+    u64 mapCount = 1 << 16;
+    u64 keyCount = 5;
+    u64 rounds = 32;
+    MtbHmap *maps = mtb_arena_bump(arena, MtbHmap, mapCount);
+
+    u64 offset = arena->offset;
+    u64 beg = mtb_perf_sys_time();
+    for (u64 i = 0; i < mapCount; i++) {
+        mtb_hmap_init_opt(maps + i, arena, sizeof(u64), sizeof(u64), _calc_hash_u64, _is_equal_u64, opt);
+        for (u64 k = 0; k < keyCount; k++) {
+            *(u64 *)mtb_hmap_put(maps + i, &(u64){ i + k }) = k;
+        }
+    }
+    u64 build = mtb_perf_sys_time() - beg;
+    u64 bytes = arena->offset - offset;
+
+    u64 sum = 0;
+    beg = mtb_perf_sys_time();
+    for (u64 r = 0; r < rounds; r++) {
+        for (u64 i = 0; i < mapCount; i++) {
+            u64 *v = mtb_hmap_get(maps + i, &(u64){ i + r % (keyCount + 1) }); // w/ misses
+            sum += v == nil ? 1 : *v;
+        }
+    }
+    u64 get = mtb_perf_sys_time() - beg;
+    assert(sum > 0);
+
+    f64 ms = 1000.0 / (f64)mtb_perf_sys_freq();
+    printf("%lu maps of %lu entries: build %.1f ms, %lu B/map, %lu gets %.1f ms\n",
+           mapCount,
+           keyCount,
+           (f64)build * ms,
+           bytes / mapCount,
+           rounds * mapCount,
+           (f64)get * ms);
+}
+
+MTB_HMAP_DEFINE(MtbBenchStrMap, _bench_str_map, char *, u64, _calc_hash_str, _is_equal_str)
+
+func void
+_bench_mtb_hmap_word_count_typed(MtbArena *arena, MtbDynArr *tokens, i32 iterationCount)
+{
+    mtb_arena_temp_scope(arena);
+    mtb_perf_start();
+
+    for (i32 i = 0; i < iterationCount; i++) {
+        mtb_arena_temp_scope(arena);
+
+        MtbBenchStrMap hmap = {0};
+        _bench_str_map_init(&hmap, arena, 0);
+
+        MtbDynArrIter tokensIterator = {0};
+        mtb_dynarr_iter_init(&tokensIterator, tokens);
+
+        while (mtb_dynarr_iter_has_next(&tokensIterator)) {
+            char **token = mtb_dynarr_iter_next(&tokensIterator);
+            mtb_perf_time_block("upsert");
+            bool inserted;
+            *_bench_str_map_upsert(&hmap, token, &inserted) += 1;
+        }
+
+        char *love = "love";
+        assert(*_bench_str_map_get(&hmap, &love) == 1364);
     }
     mtb_perf_print();
+}
+
+// The tokens are MtbStr (_bench_mtb_corpus_load), null-terminated, read as char * through their first field.
+func void
+_bench_mtb_hmap(MtbDynArr *tokens)
+{
+    MtbArena arena = {0};
+    mtb_arena_init(&arena, mb(64), &MTB_ARENA_DEF_ALLOCATOR);
+
+    // the default config keeps the full 1000 rounds, the others are compared on fewer
+    struct {
+        char *name;
+        MtbHmapInitOptions opt;
+        i32 iterationCount;
+    } configs[] = {
+        { .name = "linear probing", .opt = { .probing = MTB_HMAP_PROBING_LINEAR }, .iterationCount = 1000 },
+        { .name = "group probing", .opt = { .probing = MTB_HMAP_PROBING_GROUP }, .iterationCount = 50 },
+        { .name = "linear probing w/ stored hash", .opt = { .probing = MTB_HMAP_PROBING_LINEAR, .storeHash = true }, .iterationCount = 50 },
+        { .name = "group probing w/ stored hash", .opt = { .probing = MTB_HMAP_PROBING_GROUP, .storeHash = true }, .iterationCount = 50 },
+        { .name = "robin hood probing", .opt = { .probing = MTB_HMAP_PROBING_ROBIN_HOOD }, .iterationCount = 50 },
+        { .name = "robin hood probing at 0.9 load", .opt = { .probing = MTB_HMAP_PROBING_ROBIN_HOOD, .maxLoad = 0.9f }, .iterationCount = 50 },
+    };
+    for (u64 i = 0; i < mtb_countof(configs); i++) {
+        MtbHmapInitOptions opt = configs[i].opt;
+        opt.keyAlign = mtb_alignof(char *);
+        opt.valueAlign = mtb_alignof(u64);
+        printf("== %s ==\n", configs[i].name);
+        _bench_mtb_hmap_word_count(&arena, tokens, opt, configs[i].iterationCount);
+    }
+    printf("== typed linear probing ==\n");
+    _bench_mtb_hmap_word_count_typed(&arena, tokens, 50);
+
+    MtbArena latencyArena = {0};
+    mtb_arena_init(&latencyArena, mb(512), &MTB_ARENA_DEF_ALLOCATOR); // the snapshot map holds 96 + 192 MB while it grows
+    struct {
+        char *name;
+        MtbHmapInitOptions opt;
+    } latencyConfigs[] = {
+        { .name = "linear probing", .opt = { .probing = MTB_HMAP_PROBING_LINEAR } },
+        { .name = "linear probing w/ incremental resize", .opt = { .probing = MTB_HMAP_PROBING_LINEAR, .incremental = true } },
+        { .name = "group probing", .opt = { .probing = MTB_HMAP_PROBING_GROUP } },
+        { .name = "group probing w/ incremental resize", .opt = { .probing = MTB_HMAP_PROBING_GROUP, .incremental = true } },
+        { .name = "robin hood probing", .opt = { .probing = MTB_HMAP_PROBING_ROBIN_HOOD } },
+        { .name = "robin hood probing w/ incremental resize", .opt = { .probing = MTB_HMAP_PROBING_ROBIN_HOOD, .incremental = true } },
+    };
+    for (u64 i = 0; i < mtb_countof(latencyConfigs); i++) {
+        MtbHmapInitOptions opt = latencyConfigs[i].opt;
+        opt.keyAlign = mtb_alignof(u64);
+        opt.valueAlign = mtb_alignof(u64);
+        printf("== %s ==\n", latencyConfigs[i].name);
+        _bench_mtb_hmap_put_latency(&latencyArena, opt);
+    }
+    for (u64 i = 0; i < mtb_countof(latencyConfigs); i += 2) {
+        MtbHmapInitOptions opt = latencyConfigs[i].opt;
+        opt.keyAlign = mtb_alignof(u64);
+        opt.valueAlign = mtb_alignof(u64);
+        printf("== %s, batched get ==\n", latencyConfigs[i].name);
+        _bench_mtb_hmap_get_batch(&latencyArena, opt);
+    }
+    for (u64 i = 0; i < mtb_countof(latencyConfigs); i += 2) {
+        MtbHmapInitOptions opt = latencyConfigs[i].opt;
+        opt.keyAlign = mtb_alignof(u64);
+        opt.valueAlign = mtb_alignof(u64);
+        printf("== %s, snapshot ==\n", latencyConfigs[i].name);
+        _bench_mtb_hmap_snapshot(&latencyArena, opt);
+    }
+    for (u64 i = 0; i < mtb_countof(latencyConfigs); i += 2) {
+        MtbHmapInitOptions opt = latencyConfigs[i].opt;
+        opt.keyAlign = mtb_alignof(u64);
+        opt.valueAlign = mtb_alignof(u64);
+        printf("== %s, small maps ==\n", latencyConfigs[i].name);
+        _bench_mtb_hmap_small(&latencyArena, opt);
+        opt.small = true;
+        printf("== %s, small maps w/ small mode ==\n", latencyConfigs[i].name);
+        _bench_mtb_hmap_small(&latencyArena, opt);
+    }
+    mtb_arena_deinit(&latencyArena);
 
     mtb_arena_deinit(&arena);
 }
@@ -0,0 +1,418 @@
+#ifndef MTB_HSET_H
+#define MTB_HSET_H
+
+#ifdef MTB_IMPLEMENTATION
+#define MTB_HSET_IMPLEMENTATION
+#endif
+
+#ifdef MTB_TESTS
+#define MTB_HSET_TESTS
+#endif
+
+#ifdef MTB_BENCH
+#define MTB_HSET_BENCH
+#endif
+
+
+/* Hash Set */
+
+// A MtbHmap w/o value payload: entries are [header] [key] only, so w/ group probing
+// (no header) a set of u64 packs 8 keys per cache line instead of 4.
+typedef struct mtb_hset MtbHset;
+struct mtb_hset
+{
+    MtbHmap hmap;
+    MtbHmapInitOptions opt; // the result of a bulk operation is created w/ the same options
+};
+
+typedef struct mtb_hset_iter MtbHsetIter;
+struct mtb_hset_iter
+{
+    MtbHmapIter it;
+};
+
+
+// Same options as MtbHmap, valueAlign is ignored.
+func void mtb_hset_init_opt(MtbHset *hset,
+                            MtbArena *arena,
+                            u64 keySize,
+                            u64 (*key_hash)(void *k),
+                            bool (*key_equals)(void *k1, void *k2),
+                            MtbHmapInitOptions opt);
+#define mtb_hset_init(hset, arena, keyType, key_hash, key_equals, ...) \
+    mtb_hset_init_opt(hset, \
+                      arena, \
+                      sizeof(keyType), \
+                      key_hash, \
+                      key_equals, \
+                      (MtbHmapInitOptions){ \
+                          .keyAlign = mtb_alignof(keyType), \
+                          __VA_ARGS__ \
+                      })
+func void mtb_hset_clear(MtbHset *hset);
+func bool mtb_hset_is_empty(MtbHset *hset);
+func u64 mtb_hset_count(MtbHset *hset);
+
+func bool mtb_hset_insert(MtbHset *hset, void *key); // returns true if the key is new
+func bool mtb_hset_remove(MtbHset *hset, void *key);
+func bool mtb_hset_contains(MtbHset *hset, void *key);
+
+// The result is initialized in the arena, the operands must share key size and hash function.
+// Every operation iterates the smaller operand only (copying the larger one when needed).
+func void mtb_hset_union(MtbHset *result, MtbArena *arena, MtbHset *a, MtbHset *b);
+func void mtb_hset_intersect(MtbHset *result, MtbArena *arena, MtbHset *a, MtbHset *b);
+func void mtb_hset_difference(MtbHset *result, MtbArena *arena, MtbHset *a, MtbHset *b); // a - b
+
+func void mtb_hset_iter_init(MtbHsetIter *it, MtbHset *hset);
+func bool mtb_hset_iter_has_next(MtbHsetIter *it);
+func void *mtb_hset_iter_next(MtbHsetIter *it); // returns the key
+
+#endif //MTB_HSET_H
+
+
+#ifdef MTB_HSET_IMPLEMENTATION
+
+func void
+mtb_hset_init_opt(MtbHset *hset,
+                  MtbArena *arena,
+                  u64 keySize,
+                  u64 (*key_hash)(void *k),
+                  bool (*key_equals)(void *k1, void *k2),
+                  MtbHmapInitOptions opt)
+{
+    opt.valueAlign = 0;
+    hset->opt = opt;
+    mtb_hmap_init_opt(&hset->hmap, arena, keySize, 0, key_hash, key_equals, opt);
+}
+
+func void
+mtb_hset_clear(MtbHset *hset)
+{
+    mtb_hmap_clear(&hset->hmap);
+}
+
+func bool
+mtb_hset_is_empty(MtbHset *hset)
+{
+    return mtb_hmap_is_empty(&hset->hmap);
+}
+
+func u64
+mtb_hset_count(MtbHset *hset)
+{
+    return hset->hmap.count;
+}
+
+func bool
+mtb_hset_insert(MtbHset *hset, void *key)
+{
+    bool inserted;
+    mtb_hmap_upsert(&hset->hmap, key, &inserted);
+    return inserted;
+}
+
+func bool
+mtb_hset_remove(MtbHset *hset, void *key)
+{
+    return mtb_hmap_remove(&hset->hmap, key) != nil;
+}
+
+func bool
+mtb_hset_contains(MtbHset *hset, void *key)
+{
+    return mtb_hmap_get(&hset->hmap, key) != nil;
+}
+
+func void
+_mtb_hset_init_like(MtbHset *hset, MtbArena *arena, MtbHset *src, u64 count)
+{
+    MtbHmapInitOptions opt = src->opt;
+    opt.capacity = mtb_hmap_calc_capacity(count);
+    mtb_hset_init_opt(hset, arena, src->hmap.keySize, src->hmap.key_hash, src->hmap.key_equals, opt);
+}
+
+func void
+_mtb_hset_copy(MtbHset *hset, MtbArena *arena, MtbHset *src)
+{
+    hset->opt = src->opt;
+    mtb_hmap_clone(&hset->hmap, arena, &src->hmap);
+}
+
+func void
+mtb_hset_union(MtbHset *result, MtbArena *arena, MtbHset *a, MtbHset *b)
+{
+    mtb_assert_always(a->hmap.keySize == b->hmap.keySize && a->hmap.key_hash == b->hmap.key_hash);
+
+    MtbHset *small = a->hmap.count < b->hmap.count ? a : b;
+    MtbHset *large = small == a ? b : a;
+    _mtb_hset_copy(result, arena, large);
+    MtbHsetIter it = {0};
+    for (mtb_hset_iter_init(&it, small); mtb_hset_iter_has_next(&it);) {
+        mtb_hset_insert(result, mtb_hset_iter_next(&it));
+    }
+}
+
+func void
+mtb_hset_intersect(MtbHset *result, MtbArena *arena, MtbHset *a, MtbHset *b)
+{
+    mtb_assert_always(a->hmap.keySize == b->hmap.keySize && a->hmap.key_hash == b->hmap.key_hash);
+
+    MtbHset *small = a->hmap.count < b->hmap.count ? a : b;
+    MtbHset *large = small == a ? b : a;
+    _mtb_hset_init_like(result, arena, small, small->hmap.count);
+    MtbHsetIter it = {0};
+    for (mtb_hset_iter_init(&it, small); mtb_hset_iter_has_next(&it);) {
+        void *key = mtb_hset_iter_next(&it);
+        if (mtb_hset_contains(large, key)) {
+            mtb_hset_insert(result, key);
+        }
+    }
+}
+
+func void
+mtb_hset_difference(MtbHset *result, MtbArena *arena, MtbHset *a, MtbHset *b)
+{
+    mtb_assert_always(a->hmap.keySize == b->hmap.keySize && a->hmap.key_hash == b->hmap.key_hash);
+
+    MtbHsetIter it = {0};
+    if (a->hmap.count < b->hmap.count) {
+        _mtb_hset_init_like(result, arena, a, a->hmap.count);
+        for (mtb_hset_iter_init(&it, a); mtb_hset_iter_has_next(&it);) {
+            void *key = mtb_hset_iter_next(&it);
+            if (!mtb_hset_contains(b, key)) {
+                mtb_hset_insert(result, key);
+            }
+        }
+    }
+    else {
+        _mtb_hset_copy(result, arena, a);
+        for (mtb_hset_iter_init(&it, b); mtb_hset_iter_has_next(&it);) {
+            mtb_hset_remove(result, mtb_hset_iter_next(&it));
+        }
+    }
+}
+
+func void
+mtb_hset_iter_init(MtbHsetIter *it, MtbHset *hset)
+{
+    mtb_hmap_iter_init(&it->it, &hset->hmap);
+}
+
+func bool
+mtb_hset_iter_has_next(MtbHsetIter *it)
+{
+    return mtb_hmap_iter_has_next(&it->it);
+}
+
+func void *
+mtb_hset_iter_next(MtbHsetIter *it)
+{
+    return mtb_hmap_iter_next_key(&it->it);
+}
+
+#endif // MTB_HSET_IMPLEMENTATION
+
+
+#ifdef MTB_HSET_TESTS
+
+#include <assert.h>
+
+
+func u64
+_test_mtb_hset_hash_u64(void *key)
+{
+    return *(u64 *)key * 0x9E3779B97F4A7C15;
+}
+
+func bool
+_test_mtb_hset_is_equal_u64(void *key1, void *key2)
+{
+    return *(u64 *)key1 == *(u64 *)key2;
+}
+
+func void
+_test_mtb_hset_basic(MtbArena *arena, MtbHmapInitOptions opt)
+{
+    mtb_arena_temp_scope(arena);
+    MtbHset hset = {0};
+    opt.keyAlign = mtb_alignof(u64);
+    mtb_hset_init_opt(&hset, arena, sizeof(u64), _test_mtb_hset_hash_u64, _test_mtb_hset_is_equal_u64, opt);
+    assert(hset.hmap.valueSize == 0);
+    assert(hset.hmap.entrySize == hset.hmap.headerSize + sizeof(u64));
+    assert(mtb_hset_is_empty(&hset));
+
+    u64 n = 2000;
+    for (u64 k = 0; k < n; k++) {
+        assert(mtb_hset_insert(&hset, &k));
+        assert(!mtb_hset_insert(&hset, &k));
+    }
+    assert(mtb_hset_count(&hset) == n);
+    for (u64 k = 0; k < n; k += 3) {
+        assert(mtb_hset_remove(&hset, &k));
+        assert(!mtb_hset_remove(&hset, &k));
+    }
+    for (u64 k = 0; k < 2 * n; k++) {
+        assert(mtb_hset_contains(&hset, &k) == (k < n && k % 3 != 0));
+    }
+
+    u64 count = 0;
+    MtbHsetIter it = {0};
+    for (mtb_hset_iter_init(&it, &hset); mtb_hset_iter_has_next(&it); count++) {
+        u64 k = *(u64 *)mtb_hset_iter_next(&it);
+        assert(k < n && k % 3 != 0);
+    }
+    assert(count == mtb_hset_count(&hset));
+
+    mtb_hset_clear(&hset);
+    assert(mtb_hset_is_empty(&hset));
+    assert(!mtb_hset_contains(&hset, &(u64){ 1 }));
+}
+
+func void
+_test_mtb_hset_bulk(MtbArena *arena, MtbHmapInitOptions opt)
+{
+    mtb_arena_temp_scope(arena);
+    // a: multiples of 2 below 3000, b: multiples of 3 below 600
+    MtbHset a = {0};
+    MtbHset b = {0};
+    mtb_hset_init(&a, arena, u64, _test_mtb_hset_hash_u64, _test_mtb_hset_is_equal_u64, .probing = opt.probing,
+                  .storeHash = opt.storeHash, .incremental = opt.incremental);
+    mtb_hset_init(&b, arena, u64, _test_mtb_hset_hash_u64, _test_mtb_hset_is_equal_u64, .probing = opt.probing,
+                  .storeHash = opt.storeHash, .incremental = opt.incremental);
+    for (u64 k = 0; k < 3000; k += 2) {
+        mtb_hset_insert(&a, &k);
+    }
+    for (u64 k = 0; k < 600; k += 3) {
+        mtb_hset_insert(&b, &k);
+    }
+
+    // both operand orders, so both the small and the large side get iterated
+    MtbHset *operands[][2] = { { &a, &b }, { &b, &a } };
+    for (u64 i = 0; i < mtb_countof(operands); i++) {
+        MtbHset *x = operands[i][0];
+        MtbHset *y = operands[i][1];
+        MtbHset u = {0};
+        MtbHset n = {0};
+        MtbHset d = {0};
+        mtb_hset_union(&u, arena, x, y);
+        mtb_hset_intersect(&n, arena, x, y);
+        mtb_hset_difference(&d, arena, x, y);
+
+        u64 unionCount = 0;
+        u64 intersectCount = 0;
+        u64 differenceCount = 0;
+        for (u64 k = 0; k < 3100; k++) {
+            bool inX = mtb_hset_contains(x, &k);
+            bool inY = mtb_hset_contains(y, &k);
+            assert(mtb_hset_contains(&u, &k) == (inX || inY));
+            assert(mtb_hset_contains(&n, &k) == (inX && inY));
+            assert(mtb_hset_contains(&d, &k) == (inX && !inY));
+            unionCount += inX || inY;
+            intersectCount += inX && inY;
+            differenceCount += inX && !inY;
+        }
+        assert(mtb_hset_count(&u) == unionCount);
+        assert(mtb_hset_count(&n) == intersectCount);
+        assert(mtb_hset_count(&d) == differenceCount);
+    }
+    assert(mtb_hset_count(&a) == 1500);
+    assert(mtb_hset_count(&b) == 200);
+}
+
+func void
+_test_mtb_hset(void)
+{
+    MtbArena arena = {0};
+    mtb_arena_init(&arena, mb(1), &MTB_ARENA_DEF_ALLOCATOR);
+
+    MtbHmapInitOptions configs[] = {
+        { .probing = MTB_HMAP_PROBING_LINEAR },
+        { .probing = MTB_HMAP_PROBING_GROUP },
+        { .probing = MTB_HMAP_PROBING_GROUP, .storeHash = true },
+        { .probing = MTB_HMAP_PROBING_ROBIN_HOOD },
+        { .probing = MTB_HMAP_PROBING_LINEAR, .incremental = true },
+    };
+    for (u64 i = 0; i < mtb_countof(configs); i++) {
+        _test_mtb_hset_basic(&arena, configs[i]);
+        _test_mtb_hset_bulk(&arena, configs[i]);
+    }
+
+    mtb_arena_deinit(&arena);
+}
+
+#endif // MTB_HSET_TESTS
+
+
+#ifdef MTB_HSET_BENCH
+
+#include <assert.h>
+
+
+func u64
+_bench_mtb_hset_hash_u64(void *key)
+{
+    return *(u64 *)key * 0x9E3779B97F4A7C15;
+}
+
+func bool
+_bench_mtb_hset_is_equal_u64(void *key1, void *key2)
+{
+    return *(u64 *)key1 == *(u64 *)key2;
+}
+
+// Dedup of random ids, a set vs a map w/ a dummy u8 value (padded to the key alignment).
+func void
+_bench_mtb_hset_dedup(MtbArena *arena, u64 n, MtbHmapProbing probing)
+{
+    mtb_arena_temp_scope(arena);
+    u64 *ids = mtb_arena_bump(arena, u64, n);
+    MtbRng64 rng = {0};
+    mtb_rng64_init(&rng, 42);
+    for (u64 i = 0; i < n; i++) {
+        ids[i] = mtb_rng64_next_bounded(&rng, n);
+    }
+
+    MtbHmap hmap = {0};
+    mtb_hmap_init(&hmap, arena, u64, u8, _bench_mtb_hset_hash_u64, _bench_mtb_hset_is_equal_u64,
+                  .probing = probing);
+    u64 beg = mtb_perf_cpu_time();
+    u64 mapUnique = 0;
+    for (u64 i = 0; i < n; i++) {
+        bool inserted;
+        mtb_hmap_upsert(&hmap, ids + i, &inserted);
+        mapUnique += inserted;
+    }
+    u64 mapElapsed = mtb_perf_cpu_time() - beg;
+
+    MtbHset hset = {0};
+    mtb_hset_init(&hset, arena, u64, _bench_mtb_hset_hash_u64, _bench_mtb_hset_is_equal_u64, .probing = probing);
+    beg = mtb_perf_cpu_time();
+    u64 setUnique = 0;
+    for (u64 i = 0; i < n; i++) {
+        setUnique += mtb_hset_insert(&hset, ids + i);
+    }
+    u64 setElapsed = mtb_perf_cpu_time() - beg;
+
+    assert(mapUnique == setUnique);
+    printf("map: %lu (cpu time), %lu B/entry, set: %lu (cpu time), %lu B/entry\n",
+           mapElapsed,
+           hmap.entrySize,
+           setElapsed,
+           hset.hmap.entrySize);
+}
+
+func void
+_bench_mtb_hset(void)
+{
+    MtbArena arena = {0};
+    mtb_arena_init(&arena, mb(512), &MTB_ARENA_DEF_ALLOCATOR);
+
+    printf("== dedup, linear probing ==\n");
+    _bench_mtb_hset_dedup(&arena, 1 << 22, MTB_HMAP_PROBING_LINEAR);
+    printf("== dedup, group probing ==\n");
+    _bench_mtb_hset_dedup(&arena, 1 << 22, MTB_HMAP_PROBING_GROUP);
+
+    mtb_arena_deinit(&arena);
+}
+
+#endif // MTB_HSET_BENCH
@@ -0,0 +1,533 @@
+#ifndef MTB_INTERN_H
+#define MTB_INTERN_H
+
+#ifdef MTB_IMPLEMENTATION
+#define MTB_INTERN_IMPLEMENTATION
+#endif
+
+#ifdef MTB_TESTS
+#define MTB_INTERN_TESTS
+#endif
+
+#ifdef MTB_BENCH
+#define MTB_INTERN_BENCH
+#endif
+
+
+#include <threads.h>
+
+
+#ifndef MTB_CINTERN_DEF_SHARD_COUNT
+#define MTB_CINTERN_DEF_SHARD_COUNT 16
+#endif
+
+#ifndef MTB_CINTERN_DEF_SHARD_ARENA_SIZE
+#define MTB_CINTERN_DEF_SHARD_ARENA_SIZE mb(64)
+#endif
+
+#define MTB_INTERN_CACHE_LINE 64
+
+#define MTB_SYM_NONE U32_MAX
+
+
+/* String Interner */
+
+// Every distinct string is copied once into the arena and gets a dense 32 bit symbol,
+// so equal strings compare as equal symbols (or equal canonical bytes pointers).
+typedef u32 MtbSym;
+
+typedef struct mtb_intern MtbIntern;
+struct mtb_intern
+{
+    MtbArena *arena;
+    MtbHmap hmap;   // canonical MtbStr -> MtbSym, w/ stored hashes so they are computed once
+    MtbSegArr strs; // MtbSym -> canonical MtbStr, segments never move
+};
+
+
+func void mtb_intern_init(MtbIntern *intern, MtbArena *arena);
+func u64 mtb_intern_count(MtbIntern *intern);
+
+func MtbSym mtb_intern(MtbIntern *intern, MtbStr str);
+func MtbSym mtb_intern_hashed(MtbIntern *intern, MtbStr str, u64 hash); // hash must be mtb_str_hash(str)
+#define mtb_intern_lit(intern, s) mtb_intern(intern, mtb_str_lit(s))
+func MtbSym mtb_intern_find(MtbIntern *intern, MtbStr str); // MTB_SYM_NONE if never interned
+
+// The canonical copy, null-terminated past its length. Stays valid as long as the arena.
+func MtbStr mtb_intern_str(MtbIntern *intern, MtbSym sym);
+
+
+/* Concurrent (sharded) String Interner */
+
+// Every shard is a MtbIntern w/ its own lock and arena, picked by the high hash bits.
+// Symbols keep the shard in their low bits, so they are unique but not dense.
+typedef struct mtb_cintern_shard MtbCinternShard;
+struct mtb_cintern_shard
+{
+    mtx_t lock;
+    MtbArena arena;
+    MtbIntern intern;
+} __attribute__((aligned(MTB_INTERN_CACHE_LINE)));
+
+typedef struct mtb_cintern MtbCintern;
+struct mtb_cintern
+{
+    u64 shardCount; // must be power of 2!
+    u32 shardShift;
+    u32 shardBits;
+    MtbCinternShard *shards;
+};
+
+typedef struct mtb_cintern_init_options MtbCinternInitOptions;
+struct mtb_cintern_init_options
+{
+    u64 shardCount;               // MTB_CINTERN_DEF_SHARD_COUNT if 0
+    u64 shardArenaSize;           // MTB_CINTERN_DEF_SHARD_ARENA_SIZE if 0
+    MtbArenaAllocator *allocator; // of the shard arenas, MTB_ARENA_DEF_ALLOCATOR if nil
+};
+
+
+// The shard array is bumped from the arena, shards allocate from their own ones.
+func void mtb_cintern_init_opt(MtbCintern *cintern, MtbArena *arena, MtbCinternInitOptions opt);
+#define mtb_cintern_init(cintern, arena, ...) mtb_cintern_init_opt(cintern, arena, (MtbCinternInitOptions){ __VA_ARGS__ })
+func void mtb_cintern_deinit(MtbCintern *cintern);
+func u64 mtb_cintern_count(MtbCintern *cintern);
+
+// Thread safe, same as the MtbIntern ones.
+func MtbSym mtb_cintern(MtbCintern *cintern, MtbStr str);
+func MtbSym mtb_cintern_find(MtbCintern *cintern, MtbStr str);
+func MtbStr mtb_cintern_str(MtbCintern *cintern, MtbSym sym);
+
+#endif //MTB_INTERN_H
+
+
+#ifdef MTB_INTERN_IMPLEMENTATION
+
+#include <string.h>
+
+
+#define _mtb_cintern_shard_of(cintern, hash) ((cintern)->shards + ((cintern)->shardShift == 64 ? 0 : (hash) >> (cintern)->shardShift))
+
+
+func void
+mtb_intern_init(MtbIntern *intern, MtbArena *arena)
+{
+    intern->arena = arena;
+    mtb_hmap_init(&intern->hmap, arena, MtbStr, MtbSym, mtb_str_key_hash, mtb_str_key_equals,
+                  .probing = MTB_HMAP_PROBING_GROUP, .storeHash = true);
+    mtb_segarr_init(&intern->strs, arena, sizeof(MtbStr));
+}
+
+func u64
+mtb_intern_count(MtbIntern *intern)
+{
+    return intern->strs.count;
+}
+
+func MtbSym
+mtb_intern(MtbIntern *intern, MtbStr str)
+{
+    return mtb_intern_hashed(intern, str, mtb_str_hash(str));
+}
+
+func MtbSym
+mtb_intern_hashed(MtbIntern *intern, MtbStr str, u64 hash)
+{
+    MtbSym *sym = mtb_hmap_get_hashed(&intern->hmap, &str, hash);
+    if (sym != nil) {
+        return *sym;
+    }
+
+    // the key must point to the canonical bytes, so they are copied before the insert
+    mtb_assert_always(intern->strs.count < MTB_SYM_NONE);
+    MtbStr canonical = mtb_str(mtb_arena_bump(intern->arena, u8, str.length + 1), str.length); // zeroed, so null-terminated
+    if (!mtb_str_is_empty(str)) {
+        memcpy(canonical.bytes, str.bytes, str.length);
+    }
+    bool inserted;
+    sym = mtb_hmap_upsert_hashed(&intern->hmap, &canonical, hash, &inserted);
+    mtb_assert(inserted);
+    *sym = (MtbSym)intern->strs.count;
+    *(MtbStr *)mtb_segarr_add_last(&intern->strs) = canonical;
+    return *sym;
+}
+
+func MtbSym
+mtb_intern_find(MtbIntern *intern, MtbStr str)
+{
+    MtbSym *sym = mtb_hmap_get(&intern->hmap, &str);
+    return sym == nil ? MTB_SYM_NONE : *sym;
+}
+
+func MtbStr
+mtb_intern_str(MtbIntern *intern, MtbSym sym)
+{
+    return *(MtbStr *)mtb_segarr_get(&intern->strs, sym);
+}
+
+func void
+mtb_cintern_init_opt(MtbCintern *cintern, MtbArena *arena, MtbCinternInitOptions opt)
+{
+    mtb_assert_always(mtb_is_pow2_or_zero(opt.shardCount));
+
+    cintern->shardCount = opt.shardCount == 0 ? MTB_CINTERN_DEF_SHARD_COUNT : opt.shardCount;
+    cintern->shardBits = (u32)mtb_trailing_zeros_count(cintern->shardCount);
+    cintern->shardShift = 64 - cintern->shardBits;
+    cintern->shards = mtb_arena_bump(arena, MtbCinternShard, cintern->shardCount);
+
+    u64 shardArenaSize = opt.shardArenaSize == 0 ? MTB_CINTERN_DEF_SHARD_ARENA_SIZE : opt.shardArenaSize;
+    MtbArenaAllocator *allocator = opt.allocator == nil ? &MTB_ARENA_DEF_ALLOCATOR : opt.allocator;
+    for (u64 i = 0; i < cintern->shardCount; i++) {
+        MtbCinternShard *shard = cintern->shards + i;
+        mtb_assert_always(mtx_init(&shard->lock, mtx_plain) == thrd_success);
+        mtb_arena_init(&shard->arena, shardArenaSize, allocator);
+        mtb_intern_init(&shard->intern, &shard->arena);
+    }
+}
+
+func void
+mtb_cintern_deinit(MtbCintern *cintern)
+{
+    for (u64 i = 0; i < cintern->shardCount; i++) {
+        MtbCinternShard *shard = cintern->shards + i;
+        mtx_destroy(&shard->lock);
+        mtb_arena_deinit(&shard->arena);
+    }
+    cintern->shardCount = 0;
+    cintern->shards = nil;
+}
+
+func u64
+mtb_cintern_count(MtbCintern *cintern)
+{
+    u64 count = 0;
+    for (u64 i = 0; i < cintern->shardCount; i++) {
+        MtbCinternShard *shard = cintern->shards + i;
+        mtx_lock(&shard->lock);
+        count += mtb_intern_count(&shard->intern);
+        mtx_unlock(&shard->lock);
+    }
+    return count;
+}
+
+func MtbSym
+mtb_cintern(MtbCintern *cintern, MtbStr str)
+{
+    u64 hash = mtb_str_hash(str);
+    MtbCinternShard *shard = _mtb_cintern_shard_of(cintern, hash);
+    mtx_lock(&shard->lock);
+    MtbSym sym = mtb_intern_hashed(&shard->intern, str, hash);
+    mtx_unlock(&shard->lock);
+    mtb_assert_always(sym < MTB_SYM_NONE >> cintern->shardBits);
+    return (sym << cintern->shardBits) | (MtbSym)(shard - cintern->shards);
+}
+
+func MtbSym
+mtb_cintern_find(MtbCintern *cintern, MtbStr str)
+{
+    u64 hash = mtb_str_hash(str);
+    MtbCinternShard *shard = _mtb_cintern_shard_of(cintern, hash);
+    mtx_lock(&shard->lock);
+    MtbSym *sym = mtb_hmap_get_hashed(&shard->intern.hmap, &str, hash);
+    MtbSym result = sym == nil ? MTB_SYM_NONE : (*sym << cintern->shardBits) | (MtbSym)(shard - cintern->shards);
+    mtx_unlock(&shard->lock);
+    return result;
+}
+
+func MtbStr
+mtb_cintern_str(MtbCintern *cintern, MtbSym sym)
+{
+    MtbCinternShard *shard = cintern->shards + (sym & (cintern->shardCount - 1));
+    mtx_lock(&shard->lock);
+    MtbStr str = mtb_intern_str(&shard->intern, sym >> cintern->shardBits);
+    mtx_unlock(&shard->lock);
+    return str;
+}
+
+#endif // MTB_INTERN_IMPLEMENTATION
+
+
+
+
+#ifdef MTB_INTERN_TESTS
+
+#include <assert.h>
+
+
+func void
+_test_mtb_intern_basic(MtbArena *arena)
+{
+    mtb_arena_temp_scope(arena);
+    MtbIntern intern = {0};
+    mtb_intern_init(&intern, arena);
+
+    char buffer[] = "hello";
+    MtbSym hello = mtb_intern(&intern, mtb_str((u8 *)buffer, 5));
+    MtbSym world = mtb_intern_lit(&intern, "world");
+    MtbSym empty = mtb_intern_lit(&intern, "");
+    assert(hello == 0 && world == 1 && empty == 2);
+    assert(mtb_intern_count(&intern) == 3);
+
+    // the interner keeps its own copy
+    buffer[0] = 'j';
+    assert(mtb_intern_lit(&intern, "hello") == hello);
+    assert(mtb_intern_find(&intern, mtb_str_lit("jello")) == MTB_SYM_NONE);
+    assert(mtb_intern_lit(&intern, "jello") == 3);
+    assert(mtb_intern_find(&intern, mtb_str_lit("jello")) == 3);
+
+    MtbStr str = mtb_intern_str(&intern, hello);
+    assert(mtb_str_is_equal_lit(str, "hello"));
+    assert(strcmp(str.chars, "hello") == 0);
+    assert(str.bytes != (u8 *)buffer);
+    assert(mtb_intern_str(&intern, mtb_intern(&intern, mtb_str_from_cstr("hello"))).bytes == str.bytes);
+    assert(mtb_str_is_empty(mtb_intern_str(&intern, empty)));
+    assert(strcmp(mtb_intern_str(&intern, empty).chars, "") == 0);
+    assert(mtb_intern_count(&intern) == 4);
+}
+
+func void
+_test_mtb_intern_many(MtbArena *arena)
+{
+    mtb_arena_temp_scope(arena);
+    MtbIntern intern = {0};
+    mtb_intern_init(&intern, arena);
+
+    u64 n = 10000;
+    for (u64 round = 0; round < 2; round++) {
+        for (u64 i = 0; i < n; i++) {
+            char buffer[32];
+            i32 length = snprintf(buffer, sizeof(buffer), "sym%lu", i);
+            assert(mtb_intern(&intern, mtb_str((u8 *)buffer, (u64)length)) == i);
+        }
+    }
+    assert(mtb_intern_count(&intern) == n);
+    for (u64 i = 0; i < n; i++) {
+        char expected[32];
+        snprintf(expected, sizeof(expected), "sym%lu", i);
+        assert(strcmp(mtb_intern_str(&intern, (MtbSym)i).chars, expected) == 0);
+    }
+}
+
+typedef struct _test_mtb_cintern_worker _TestMtbCinternWorker;
+struct _test_mtb_cintern_worker
+{
+    MtbCintern *cintern;
+    u64 offset;
+    MtbSym syms[1000];
+};
+
+func int
+_test_mtb_cintern_worker_run(void *arg)
+{
+    _TestMtbCinternWorker *worker = arg;
+    for (u64 i = 0; i < mtb_countof(worker->syms); i++) {
+        u64 k = (i + worker->offset) % mtb_countof(worker->syms); // same strings, different order
+        char buffer[32];
+        i32 length = snprintf(buffer, sizeof(buffer), "sym%lu", k);
+        worker->syms[k] = mtb_cintern(worker->cintern, mtb_str((u8 *)buffer, (u64)length));
+    }
+    return 0;
+}
+
+func void
+_test_mtb_cintern_threads(MtbArena *arena)
+{
+    mtb_arena_temp_scope(arena);
+    MtbCintern cintern = {0};
+    mtb_cintern_init(&cintern, arena, .shardCount = 4, .shardArenaSize = kb(256));
+
+    thrd_t threads[4];
+    _TestMtbCinternWorker *workers = mtb_arena_bump(arena, _TestMtbCinternWorker, mtb_countof(threads));
+    for (u64 i = 0; i < mtb_countof(threads); i++) {
+        workers[i] = (_TestMtbCinternWorker){ .cintern = &cintern, .offset = i * 250 };
+        assert(thrd_create(&threads[i], _test_mtb_cintern_worker_run, &workers[i]) == thrd_success);
+    }
+    for (u64 i = 0; i < mtb_countof(threads); i++) {
+        assert(thrd_join(threads[i], nil) == thrd_success);
+    }
+
+    assert(mtb_cintern_count(&cintern) == 1000);
+    for (u64 k = 0; k < 1000; k++) {
+        MtbSym sym = workers[0].syms[k];
+        for (u64 i = 1; i < mtb_countof(threads); i++) {
+            assert(workers[i].syms[k] == sym);
+        }
+        char expected[32];
+        snprintf(expected, sizeof(expected), "sym%lu", k);
+        assert(strcmp(mtb_cintern_str(&cintern, sym).chars, expected) == 0);
+        assert(mtb_cintern_find(&cintern, mtb_str_from_cstr(expected)) == sym);
+    }
+    assert(mtb_cintern_find(&cintern, mtb_str_lit("sym1000")) == MTB_SYM_NONE);
+
+    mtb_cintern_deinit(&cintern);
+}
+
+func void
+_test_mtb_intern(void)
+{
+    MtbArena arena = {0};
+    mtb_arena_init(&arena, mb(4), &MTB_ARENA_DEF_ALLOCATOR);
+
+    _test_mtb_intern_basic(&arena);
+    _test_mtb_intern_many(&arena);
+    _test_mtb_cintern_threads(&arena);
+
+    mtb_arena_deinit(&arena);
+}
+
+#endif // MTB_INTERN_TESTS
+
+
+#ifdef MTB_INTERN_BENCH
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+
+func void
+_bench_mtb_intern_keywords(MtbArena *arena, MtbDynArr *tokens)
+{
+    mtb_arena_temp_scope(arena);
+    u64 rounds = 8;
+
+    MtbIntern intern = {0};
+    mtb_intern_init(&intern, arena);
+
+    u64 beg = mtb_perf_sys_time();
+    MtbSym *syms = mtb_arena_bump(arena, MtbSym, tokens->length);
+    for (u64 i = 0; i < tokens->length; i++) {
+        syms[i] = mtb_intern(&intern, *(MtbStr *)mtb_dynarr_get(tokens, i));
+    }
+    u64 internTime = mtb_perf_sys_time() - beg;
+
+    // a parser checking every token against its keywords, the most frequent words of the corpus stand in for them
+    u64 *freqs = mtb_arena_bump(arena, u64, mtb_intern_count(&intern) + 1);
+    for (u64 i = 0; i < tokens->length; i++) {
+        freqs[syms[i]]++;
+    }
+    char *keywords[16];
+    MtbSym keywordSyms[mtb_countof(keywords)];
+    u64 keywordCount = mtb_min_u64(mtb_countof(keywords), mtb_intern_count(&intern));
+    for (u64 k = 0; k < keywordCount; k++) {
+        MtbSym top = 0;
+        for (MtbSym s = 1; s < mtb_intern_count(&intern); s++) {
+            if (freqs[s] > freqs[top]) {
+                top = s;
+            }
+        }
+        freqs[top] = 0;
+        keywordSyms[k] = top;
+        keywords[k] = mtb_intern_str(&intern, top).chars;
+    }
+
+    u64 strCount = 0;
+    beg = mtb_perf_sys_time();
+    for (u64 r = 0; r < rounds; r++) {
+        for (u64 i = 0; i < tokens->length; i++) {
+            MtbStr token = *(MtbStr *)mtb_dynarr_get(tokens, i);
+            for (u64 k = 0; k < keywordCount; k++) {
+                if (mtb_str_is_equal_cstr(token, keywords[k])) {
+                    strCount++;
+                    break;
+                }
+            }
+        }
+    }
+    u64 strTime = mtb_perf_sys_time() - beg;
+
+    u64 symCount = 0;
+    beg = mtb_perf_sys_time();
+    for (u64 r = 0; r < rounds; r++) {
+        for (u64 i = 0; i < tokens->length; i++) {
+            for (u64 k = 0; k < keywordCount; k++) {
+                if (syms[i] == keywordSyms[k]) {
+                    symCount++;
+                    break;
+                }
+            }
+        }
+    }
+    u64 symTime = mtb_perf_sys_time() - beg;
+    assert(strCount == symCount);
+
+    f64 ms = 1000.0 / (f64)mtb_perf_sys_freq();
+    printf("%lu tokens, %lu distinct: intern %.1f ms, keyword matching x%lu w/ mtb_str_is_equal_cstr %.1f ms, w/ symbols %.1f ms\n",
+           tokens->length,
+           mtb_intern_count(&intern),
+           (f64)internTime * ms,
+           rounds,
+           (f64)strTime * ms,
+           (f64)symTime * ms);
+}
+
+typedef struct _bench_mtb_cintern_worker _BenchMtbCinternWorker;
+struct _bench_mtb_cintern_worker
+{
+    MtbCintern *cintern;
+    MtbStr *tokens;
+    u64 count;
+};
+
+func int
+_bench_mtb_cintern_worker_run(void *arg)
+{
+    _BenchMtbCinternWorker *worker = arg;
+    for (u64 i = 0; i < worker->count; i++) {
+        mtb_cintern(worker->cintern, worker->tokens[i]);
+    }
+    return 0;
+}
+
+func void
+_bench_mtb_cintern(MtbArena *arena, MtbDynArr *tokens, u64 threadCount)
+{
+    mtb_arena_temp_scope(arena);
+    MtbCintern cintern = {0};
+    mtb_cintern_init(&cintern, arena, .shardArenaSize = mb(8));
+
+    thrd_t *threads = mtb_arena_bump(arena, thrd_t, threadCount);
+    _BenchMtbCinternWorker *workers = mtb_arena_bump(arena, _BenchMtbCinternWorker, threadCount);
+
+    u64 beg = mtb_perf_sys_time();
+    for (u64 i = 0; i < threadCount; i++) {
+        u64 tokensBeg = i * tokens->length / threadCount;
+        u64 tokensEnd = (i + 1) * tokens->length / threadCount;
+        workers[i] = (_BenchMtbCinternWorker){
+            .cintern = &cintern,
+            .tokens = mtb_dynarr_get(tokens, tokensBeg),
+            .count = tokensEnd - tokensBeg,
+        };
+        mtb_assert_always(thrd_create(&threads[i], _bench_mtb_cintern_worker_run, &workers[i]) == thrd_success);
+    }
+    for (u64 i = 0; i < threadCount; i++) {
+        mtb_assert_always(thrd_join(threads[i], nil) == thrd_success);
+    }
+    u64 elapsed = mtb_perf_sys_time() - beg;
+
+    f64 seconds = (f64)elapsed / (f64)mtb_perf_sys_freq();
+    printf("%lu threads: %.3f s, %.2f M tokens/s\n", threadCount, seconds, (f64)tokens->length / seconds / 1e6);
+
+    mtb_cintern_deinit(&cintern);
+}
+
+func void
+_bench_mtb_intern(MtbDynArr *tokens)
+{
+    MtbArena arena = {0};
+    mtb_arena_init(&arena, mb(128), &MTB_ARENA_DEF_ALLOCATOR);
+
+    printf("== interning ==\n");
+    _bench_mtb_intern_keywords(&arena, tokens);
+
+    u64 cpuCount = (u64)sysconf(_SC_NPROCESSORS_ONLN);
+    printf("== interning, sharded concurrent interner ==\n");
+    for (u64 threadCount = 1; threadCount <= cpuCount; threadCount <<= 1) {
+        _bench_mtb_cintern(&arena, tokens, threadCount);
+    }
+
+    mtb_arena_deinit(&arena);
+}
+
+#endif // MTB_INTERN_BENCH
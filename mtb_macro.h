@@ -46,14 +46,15 @@
 #define mtb_is_pow2(s) ((bool)((s) != 0 && mtb_is_pow2_or_zero((s))))
 
 #define mtb_leading_zeros_count(n) __builtin_clzg(n)
+#define mtb_trailing_zeros_count(n) __builtin_ctzg(n)
 #define mtb_roundup_pow2(n) (u64_lit(1) << (sizeof(u64) * CHAR_BIT - mtb_leading_zeros_count(n - 1)))
 
 
 /* Memory Utils */
 
-#define kibi(n) ((u64)((n) * (1 << 10)))
-#define mebi(n) ((u64)((n) * (1 << 20)))
-#define gibi(n) ((u64)((n) * (1 << 30)))
+#define kibi(n) ((u64)(n) * ((u64)1 << 10))
+#define mebi(n) ((u64)(n) * ((u64)1 << 20))
+#define gibi(n) ((u64)(n) * ((u64)1 << 30))
 
 #define kb(n) kibi(n)
 #define mb(n) mebi(n)
@@ -62,6 +63,8 @@
 #define mtb_align_pow2(s, a) ((u64)(((s) + (a) - 1) & (~((a) - 1))))
 #define mtb_align_padding_pow2(s, a) ((u64)((-(s)) & ((a) - 1)))
 
+#define mtb_prefetch(p) __builtin_prefetch(p)
+
 #if defined(_MTB_COMPILER_GCC)
 # define mtb_alignof(T) __alignof__(T)
 #elif defined(_MTB_COMPILER_CLANG)
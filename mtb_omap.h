@@ -0,0 +1,669 @@
+#ifndef MTB_OMAP_H
+#define MTB_OMAP_H
+
+#ifdef MTB_IMPLEMENTATION
+#define MTB_OMAP_IMPLEMENTATION
+#endif
+
+#ifdef MTB_TESTS
+#define MTB_OMAP_TESTS
+#endif
+
+#ifdef MTB_BENCH
+#define MTB_OMAP_BENCH
+#endif
+
+
+#ifndef MTB_OMAP_MIN_CAPACITY
+#define MTB_OMAP_MIN_CAPACITY 16
+#endif
+
+#define MTB_OMAP_DEAD_HASH U64_MAX // live entries never have the top hash bit set
+
+#define mtb_omap_entry_header(omap, entry) ((MtbOmapHeader *)(entry))
+#define mtb_omap_entry_key(omap, entry) ((entry) + (omap)->headerSize)
+#define mtb_omap_entry_value(omap, entry) (mtb_omap_entry_key(omap, entry) + (omap)->keySize)
+
+
+/* Insertion Ordered Hash Map */
+
+// Entries are stored densely in insertion order, the hash table is a sparse index of
+// u32 positions (+ 1, 0 is free) w/ linear probing and backward shift deletion.
+// Removed entries stay in place as dead ones until the next compaction (once they
+// outnumber the live ones), so iteration is a scan of the dense array.
+typedef struct mtb_omap_header MtbOmapHeader;
+struct mtb_omap_header
+{
+    u64 hash; // MTB_OMAP_DEAD_HASH if removed
+};
+
+typedef struct mtb_omap MtbOmap;
+struct mtb_omap
+{
+    MtbDynArr entries;
+    u32 *index;
+    u64 capacity; // of the index, must be power of 2!
+    u64 count;    // live entries
+    u64 threshold;
+
+    u64 headerSize;
+    u64 keySize; // padded to the entry alignment
+    u64 valueSize;
+    u64 entrySize;
+    u64 keyBytes; // as given to init, what is copied from the caller's key
+
+    u64 (*key_hash)(void *k);
+    bool (*key_equals)(void *k1, void *k2);
+};
+
+typedef struct mtb_omap_init_options MtbOmapInitOptions;
+struct mtb_omap_init_options
+{
+    u64 capacity;
+    u64 keyAlign;   // at most MTB_ARENA_DEF_ALIGN
+    u64 valueAlign; // at most MTB_ARENA_DEF_ALIGN
+};
+
+
+func void mtb_omap_init_opt(MtbOmap *omap,
+                            MtbArena *arena,
+                            u64 keySize,
+                            u64 valueSize,
+                            u64 (*key_hash)(void *k),
+                            bool (*key_equals)(void *k1, void *k2),
+                            MtbOmapInitOptions opt);
+#define mtb_omap_init(omap, arena, keyType, valueType, key_hash, key_equals, ...) \
+    mtb_omap_init_opt(omap, \
+                      arena, \
+                      sizeof(keyType), \
+                      sizeof(valueType), \
+                      key_hash, \
+                      key_equals, \
+                      (MtbOmapInitOptions){ \
+                          .keyAlign = mtb_alignof(keyType), \
+                          .valueAlign = mtb_alignof(valueType), \
+                          __VA_ARGS__ \
+                      })
+func void mtb_omap_clear(MtbOmap *omap);
+func bool mtb_omap_is_empty(MtbOmap *omap);
+func void mtb_omap_grow(MtbOmap *omap, u64 capacity);
+
+// A new key is appended, re-inserting a removed one moves it to the end.
+func void *mtb_omap_put(MtbOmap *omap, void *key);
+func void *mtb_omap_upsert(MtbOmap *omap, void *key, bool *inserted);
+func void *mtb_omap_remove(MtbOmap *omap, void *key); // the value stays valid until the next put or remove
+func void *mtb_omap_get(MtbOmap *omap, void *key);
+
+
+/* Iterator API */
+
+// In insertion order, entries can only be removed w/ mtb_omap_iter_remove while iterating.
+typedef struct mtb_omap_iter MtbOmapIter;
+struct mtb_omap_iter
+{
+    MtbOmap *omap;
+    u8 *prev;
+    u64 index;
+};
+
+
+func void mtb_omap_iter_init(MtbOmapIter *it, MtbOmap *omap);
+func void mtb_omap_iter_reset(MtbOmapIter *it);
+func bool mtb_omap_iter_has_next(MtbOmapIter *it);
+func void *mtb_omap_iter_next(MtbOmapIter *it);
+func void *mtb_omap_iter_next_key(MtbOmapIter *it);
+func void *mtb_omap_iter_next_value(MtbOmapIter *it);
+func void *mtb_omap_iter_remove(MtbOmapIter *it);
+
+#endif //MTB_OMAP_H
+
+
+#ifdef MTB_OMAP_IMPLEMENTATION
+
+#include <string.h>
+
+
+#define _mtb_omap_hash(omap, key) ((omap)->key_hash(key) & ~(u64_lit(1) << 63))
+#define _mtb_omap_entry(omap, position) ((omap)->entries.items + (position) * (omap)->entrySize)
+
+func u64
+_mtb_omap_threshold(u64 capacity)
+{
+    return capacity - (capacity >> 2);
+}
+
+// Index slot of the key, or of the free slot where it'd go.
+func u64
+_mtb_omap_find(MtbOmap *omap, void *key, u64 hash, bool *found)
+{
+    u64 mask = omap->capacity - 1;
+    for (u64 slot = hash & mask;; slot = (slot + 1) & mask) {
+        u32 position = omap->index[slot];
+        if (position == 0) {
+            *found = false;
+            return slot;
+        }
+        u8 *entry = _mtb_omap_entry(omap, position - 1);
+        if (mtb_omap_entry_header(omap, entry)->hash == hash && omap->key_equals(key, mtb_omap_entry_key(omap, entry))) {
+            *found = true;
+            return slot;
+        }
+    }
+}
+
+// Drops the dead entries, then rebuilds the index w/ the given capacity.
+func void
+_mtb_omap_rebuild(MtbOmap *omap, u64 capacity)
+{
+    u64 length = 0;
+    for (u64 i = 0; i < omap->entries.length; i++) {
+        u8 *entry = _mtb_omap_entry(omap, i);
+        if (mtb_omap_entry_header(omap, entry)->hash != MTB_OMAP_DEAD_HASH) {
+            if (length < i) {
+                memcpy(_mtb_omap_entry(omap, length), entry, omap->entrySize);
+            }
+            length++;
+        }
+    }
+    omap->entries.length = length;
+
+    if (capacity != omap->capacity) {
+        omap->index = mtb_arena_bump(omap->entries.arena, u32, capacity, .no_zero = true);
+        omap->capacity = capacity;
+        omap->threshold = _mtb_omap_threshold(capacity);
+    }
+    memset(omap->index, 0, capacity * sizeof(u32));
+    u64 mask = capacity - 1;
+    for (u64 i = 0; i < length; i++) {
+        u64 slot = mtb_omap_entry_header(omap, _mtb_omap_entry(omap, i))->hash & mask;
+        while (omap->index[slot] != 0) {
+            slot = (slot + 1) & mask;
+        }
+        omap->index[slot] = (u32)(i + 1);
+    }
+}
+
+func void
+mtb_omap_init_opt(MtbOmap *omap,
+                  MtbArena *arena,
+                  u64 keySize,
+                  u64 valueSize,
+                  u64 (*key_hash)(void *k),
+                  bool (*key_equals)(void *k1, void *k2),
+                  MtbOmapInitOptions opt)
+{
+    mtb_assert_always(mtb_is_pow2_or_zero(opt.capacity));
+    mtb_assert_always(mtb_is_pow2_or_zero(keySize));
+    mtb_assert_always(mtb_is_pow2_or_zero(opt.keyAlign) && opt.keyAlign <= MTB_ARENA_DEF_ALIGN);
+    mtb_assert_always(mtb_is_pow2_or_zero(valueSize));
+    mtb_assert_always(mtb_is_pow2_or_zero(opt.valueAlign) && opt.valueAlign <= MTB_ARENA_DEF_ALIGN);
+
+    // entry: [hash] [key] [value]
+    u64 align = mtb_max_u64(mtb_alignof(MtbOmapHeader), mtb_max_u64(opt.keyAlign, opt.valueAlign));
+    omap->headerSize = mtb_align_pow2(sizeof(MtbOmapHeader), align);
+    omap->keySize = mtb_align_pow2(keySize, align);
+    omap->valueSize = mtb_align_pow2(valueSize, align);
+    omap->entrySize = omap->headerSize + omap->keySize + omap->valueSize;
+    omap->keyBytes = keySize;
+    mtb_dynarr_init(&omap->entries, arena, omap->entrySize);
+
+    u64 capacity = opt.capacity < MTB_OMAP_MIN_CAPACITY ? MTB_OMAP_MIN_CAPACITY : opt.capacity;
+    omap->index = mtb_arena_bump(arena, u32, capacity);
+    omap->capacity = capacity;
+    omap->count = 0;
+    omap->threshold = _mtb_omap_threshold(capacity);
+
+    omap->key_hash = key_hash;
+    omap->key_equals = key_equals;
+}
+
+func void
+mtb_omap_clear(MtbOmap *omap)
+{
+    mtb_dynarr_clear(&omap->entries);
+    memset(omap->index, 0, omap->capacity * sizeof(u32));
+    omap->count = 0;
+}
+
+func bool
+mtb_omap_is_empty(MtbOmap *omap)
+{
+    return omap->count == 0;
+}
+
+func void
+mtb_omap_grow(MtbOmap *omap, u64 capacity)
+{
+    mtb_assert_always(mtb_is_pow2_or_zero(capacity));
+    mtb_assert_always(capacity > omap->capacity);
+    _mtb_omap_rebuild(omap, capacity);
+}
+
+func void *
+mtb_omap_put(MtbOmap *omap, void *key)
+{
+    bool inserted;
+    return mtb_omap_upsert(omap, key, &inserted);
+}
+
+func void *
+mtb_omap_upsert(MtbOmap *omap, void *key, bool *inserted)
+{
+    u64 hash = _mtb_omap_hash(omap, key);
+    bool found;
+    u64 slot = _mtb_omap_find(omap, key, hash, &found);
+    *inserted = !found;
+    if (found) {
+        return mtb_omap_entry_value(omap, _mtb_omap_entry(omap, omap->index[slot] - 1));
+    }
+
+    if (omap->count + 1 > omap->threshold) {
+        _mtb_omap_rebuild(omap, omap->capacity << 1);
+        slot = _mtb_omap_find(omap, key, hash, &found);
+    }
+    else if (omap->entries.length >= 2 * omap->count + MTB_OMAP_MIN_CAPACITY) {
+        _mtb_omap_rebuild(omap, omap->capacity); // mostly dead entries
+        slot = _mtb_omap_find(omap, key, hash, &found);
+    }
+    mtb_assert_always(omap->entries.length < U32_MAX);
+
+    u8 *entry = mtb_dynarr_push(&omap->entries);
+    mtb_omap_entry_header(omap, entry)->hash = hash;
+    memcpy(mtb_omap_entry_key(omap, entry), key, omap->keyBytes);
+    memset(mtb_omap_entry_value(omap, entry), 0, omap->valueSize);
+    omap->index[slot] = (u32)omap->entries.length;
+    omap->count++;
+    return mtb_omap_entry_value(omap, entry);
+}
+
+func u8 *
+_mtb_omap_erase(MtbOmap *omap, u64 slot)
+{
+    u8 *entry = _mtb_omap_entry(omap, omap->index[slot] - 1);
+    mtb_omap_entry_header(omap, entry)->hash = MTB_OMAP_DEAD_HASH;
+    omap->count--;
+
+    // backward shift, an entry moves if the free slot lies between its home and its slot
+    u64 mask = omap->capacity - 1;
+    u64 free = slot;
+    for (u64 next = (free + 1) & mask; omap->index[next] != 0; next = (next + 1) & mask) {
+        u64 home = mtb_omap_entry_header(omap, _mtb_omap_entry(omap, omap->index[next] - 1))->hash & mask;
+        if (((next - home) & mask) >= ((next - free) & mask)) {
+            omap->index[free] = omap->index[next];
+            free = next;
+        }
+    }
+    omap->index[free] = 0;
+    return entry;
+}
+
+func void *
+mtb_omap_remove(MtbOmap *omap, void *key)
+{
+    if (omap->entries.length >= 2 * omap->count + MTB_OMAP_MIN_CAPACITY) {
+        _mtb_omap_rebuild(omap, omap->capacity); // mostly dead entries
+    }
+    bool found;
+    u64 slot = _mtb_omap_find(omap, key, _mtb_omap_hash(omap, key), &found);
+    if (!found) {
+        return nil;
+    }
+    return mtb_omap_entry_value(omap, _mtb_omap_erase(omap, slot));
+}
+
+func void *
+mtb_omap_get(MtbOmap *omap, void *key)
+{
+    bool found;
+    u64 slot = _mtb_omap_find(omap, key, _mtb_omap_hash(omap, key), &found);
+    if (!found) {
+        return nil;
+    }
+    return mtb_omap_entry_value(omap, _mtb_omap_entry(omap, omap->index[slot] - 1));
+}
+
+func void
+mtb_omap_iter_init(MtbOmapIter *it, MtbOmap *omap)
+{
+    it->omap = omap;
+    mtb_omap_iter_reset(it);
+}
+
+func void
+mtb_omap_iter_reset(MtbOmapIter *it)
+{
+    it->prev = nil;
+    it->index = 0;
+}
+
+func bool
+mtb_omap_iter_has_next(MtbOmapIter *it)
+{
+    MtbOmap *omap = it->omap;
+    for (; it->index < omap->entries.length; it->index++) {
+        if (mtb_omap_entry_header(omap, _mtb_omap_entry(omap, it->index))->hash != MTB_OMAP_DEAD_HASH) {
+            return true;
+        }
+    }
+    return false;
+}
+
+func void *
+mtb_omap_iter_next(MtbOmapIter *it)
+{
+    mtb_assert_always(it->index < it->omap->entries.length);
+    it->prev = _mtb_omap_entry(it->omap, it->index);
+    it->index++;
+    return it->prev;
+}
+
+func void *
+mtb_omap_iter_next_key(MtbOmapIter *it)
+{
+    return mtb_omap_entry_key(it->omap, mtb_omap_iter_next(it));
+}
+
+func void *
+mtb_omap_iter_next_value(MtbOmapIter *it)
+{
+    return mtb_omap_entry_value(it->omap, mtb_omap_iter_next(it));
+}
+
+func void *
+mtb_omap_iter_remove(MtbOmapIter *it)
+{
+    mtb_assert_always(it->prev != nil);
+    MtbOmap *omap = it->omap;
+    bool found;
+    u64 slot = _mtb_omap_find(omap, mtb_omap_entry_key(omap, it->prev), mtb_omap_entry_header(omap, it->prev)->hash, &found);
+    mtb_assert_always(found);
+    u8 *removed = _mtb_omap_erase(omap, slot);
+    it->prev = nil;
+    return mtb_omap_entry_value(omap, removed);
+}
+
+#endif // MTB_OMAP_IMPLEMENTATION
+
+
+#ifdef MTB_OMAP_TESTS
+
+#include <assert.h>
+
+
+func u64
+_test_mtb_omap_hash_u64(void *key)
+{
+    return *(u64 *)key * 0x9E3779B97F4A7C15;
+}
+
+func bool
+_test_mtb_omap_is_equal_u64(void *key1, void *key2)
+{
+    return *(u64 *)key1 == *(u64 *)key2;
+}
+
+func u64
+_test_mtb_omap_hash_u32(void *key)
+{
+    return *(u32 *)key * 0x9E3779B97F4A7C15;
+}
+
+func bool
+_test_mtb_omap_is_equal_u32(void *key1, void *key2)
+{
+    return *(u32 *)key1 == *(u32 *)key2;
+}
+
+// Checks the map against a reference in insertion order: keys[i] is live if values[i] != 0.
+func void
+_test_mtb_omap_check(MtbOmap *omap, u64 *keys, u64 *values, u64 n)
+{
+    u64 i = 0;
+    MtbOmapIter it = {0};
+    for (mtb_omap_iter_init(&it, omap); mtb_omap_iter_has_next(&it);) {
+        u8 *entry = mtb_omap_iter_next(&it);
+        while (i < n && values[i] == 0) {
+            i++;
+        }
+        assert(i < n);
+        assert(*(u64 *)mtb_omap_entry_key(omap, entry) == keys[i]);
+        assert(*(u64 *)mtb_omap_entry_value(omap, entry) == values[i]);
+        i++;
+    }
+    while (i < n) {
+        assert(values[i++] == 0);
+    }
+}
+
+func void
+_test_mtb_omap_order(MtbArena *arena)
+{
+    mtb_arena_temp_scope(arena);
+    MtbOmap omap = {0};
+    mtb_omap_init(&omap, arena, u64, u64, _test_mtb_omap_hash_u64, _test_mtb_omap_is_equal_u64);
+
+    // every (re-)insertion appends a reference record
+    u64 n = 0;
+    u64 *keys = mtb_arena_bump(arena, u64, 8192);
+    u64 *values = mtb_arena_bump(arena, u64, 8192);
+    u64 *records = mtb_arena_bump(arena, u64, 1000); // latest record of a key
+    MtbRng64 rng = {0};
+    mtb_rng64_init(&rng, 11);
+    for (u64 step = 0; step < 6000; step++) {
+        u64 k = mtb_rng64_next_bounded(&rng, 1000);
+        u64 *v = mtb_omap_get(&omap, &k);
+        if (v == nil) {
+            bool inserted;
+            *(u64 *)mtb_omap_upsert(&omap, &k, &inserted) = step + 1;
+            assert(inserted);
+            keys[n] = k;
+            values[n] = step + 1;
+            records[k] = n++;
+        }
+        else if (step % 3 == 0) {
+            assert(*v == values[records[k]]);
+            assert(*(u64 *)mtb_omap_remove(&omap, &k) == values[records[k]]);
+            assert(mtb_omap_get(&omap, &k) == nil);
+            values[records[k]] = 0;
+        }
+        else {
+            *v = step + 1;
+            values[records[k]] = step + 1;
+        }
+    }
+    u64 count = 0;
+    for (u64 i = 0; i < n; i++) {
+        count += values[i] != 0;
+    }
+    assert(omap.count == count);
+    assert(omap.entries.length < 2 * omap.count + MTB_OMAP_MIN_CAPACITY);
+    _test_mtb_omap_check(&omap, keys, values, n);
+
+    // removal while iterating
+    MtbOmapIter it = {0};
+    for (mtb_omap_iter_init(&it, &omap); mtb_omap_iter_has_next(&it);) {
+        u64 k = *(u64 *)mtb_omap_iter_next_key(&it);
+        if (k % 2 == 0) {
+            assert(*(u64 *)mtb_omap_iter_remove(&it) == values[records[k]]);
+            values[records[k]] = 0;
+        }
+    }
+    _test_mtb_omap_check(&omap, keys, values, n);
+
+    mtb_omap_clear(&omap);
+    assert(mtb_omap_is_empty(&omap));
+    assert(!mtb_omap_iter_has_next((mtb_omap_iter_init(&it, &omap), &it)));
+    for (u64 k = 0; k < 1000; k++) {
+        assert(mtb_omap_get(&omap, &k) == nil);
+    }
+}
+
+func void
+_test_mtb_omap_grow_shrink(MtbArena *arena)
+{
+    mtb_arena_temp_scope(arena);
+    MtbOmap omap = {0};
+    mtb_omap_init(&omap, arena, u64, u32, _test_mtb_omap_hash_u64, _test_mtb_omap_is_equal_u64, .capacity = 32);
+    assert(omap.entrySize == 3 * sizeof(u64));
+
+    u64 n = 20000;
+    for (u64 k = 0; k < n; k++) {
+        *(u32 *)mtb_omap_put(&omap, &k) = (u32)k;
+    }
+    assert(omap.capacity == mtb_hmap_calc_capacity(n));
+    for (u64 k = 0; k < n - 10; k++) {
+        assert(mtb_omap_remove(&omap, &k) != nil);
+    }
+
+    // the dead head was compacted away while removing
+    assert(omap.entries.length < 2 * (omap.count + 1) + MTB_OMAP_MIN_CAPACITY);
+    u64 visited = 0;
+    MtbOmapIter it = {0};
+    for (mtb_omap_iter_init(&it, &omap); mtb_omap_iter_has_next(&it); visited++) {
+        assert(*(u32 *)mtb_omap_iter_next_value(&it) == n - 10 + visited);
+    }
+    assert(visited == 10);
+    mtb_omap_put(&omap, &n);
+    for (u64 k = n - 10; k <= n; k++) {
+        assert(mtb_omap_get(&omap, &k) != nil);
+    }
+
+    mtb_omap_grow(&omap, omap.capacity << 1);
+    for (u64 k = n - 10; k <= n; k++) {
+        assert(mtb_omap_get(&omap, &k) != nil);
+    }
+}
+
+// The hash header pads a u32 key to 8 bytes, only 4 may be read from the caller's key.
+func void
+_test_mtb_omap_small_keys(MtbArena *arena)
+{
+    mtb_arena_temp_scope(arena);
+    MtbOmap omap = {0};
+    mtb_omap_init(&omap, arena, u32, u32, _test_mtb_omap_hash_u32, _test_mtb_omap_is_equal_u32);
+    assert(omap.keySize == sizeof(u64) && omap.keyBytes == sizeof(u32));
+    for (u32 k = 0; k < 100; k++) {
+        *(u32 *)mtb_omap_put(&omap, &k) = k + 1;
+    }
+    for (u32 k = 0; k < 100; k++) {
+        bool inserted;
+        assert(*(u32 *)mtb_omap_upsert(&omap, &k, &inserted) == k + 1 && !inserted);
+    }
+    u32 k = 0;
+    MtbOmapIter it = {0};
+    for (mtb_omap_iter_init(&it, &omap); mtb_omap_iter_has_next(&it); k++) {
+        assert(*(u32 *)mtb_omap_entry_key(&omap, mtb_omap_iter_next(&it)) == k);
+    }
+    assert(k == 100);
+}
+
+func void
+_test_mtb_omap(void)
+{
+    MtbArena arena = {0};
+    mtb_arena_init(&arena, mb(4), &MTB_ARENA_DEF_ALLOCATOR);
+
+    _test_mtb_omap_order(&arena);
+    _test_mtb_omap_grow_shrink(&arena);
+    _test_mtb_omap_small_keys(&arena);
+
+    mtb_arena_deinit(&arena);
+}
+
+#endif // MTB_OMAP_TESTS
+
+
+#ifdef MTB_OMAP_BENCH
+
+#include <assert.h>
+
+
+func u64
+_bench_mtb_omap_hash_u64(void *key)
+{
+    return *(u64 *)key * 0x9E3779B97F4A7C15;
+}
+
+func bool
+_bench_mtb_omap_is_equal_u64(void *key1, void *key2)
+{
+    return *(u64 *)key1 == *(u64 *)key2;
+}
+
+// Iteration after the map has grown to n entries and shrunk to n / 1000, then lookups.
+func void
+_bench_mtb_omap_iter(MtbArena *arena, u64 n)
+{
+    mtb_arena_temp_scope(arena);
+    MtbHmap hmap = {0};
+    mtb_hmap_init(&hmap, arena, u64, u64, _bench_mtb_omap_hash_u64, _bench_mtb_omap_is_equal_u64);
+    MtbOmap omap = {0};
+    mtb_omap_init(&omap, arena, u64, u64, _bench_mtb_omap_hash_u64, _bench_mtb_omap_is_equal_u64);
+    for (u64 k = 0; k < n; k++) {
+        *(u64 *)mtb_hmap_put(&hmap, &k) = k;
+        *(u64 *)mtb_omap_put(&omap, &k) = k;
+    }
+    for (u64 k = 0; k < n; k++) {
+        if (k % 1000 != 0) {
+            mtb_hmap_remove(&hmap, &k);
+            mtb_omap_remove(&omap, &k);
+        }
+    }
+    u64 rounds = 100;
+    u64 hmapSum = 0;
+    u64 beg = mtb_perf_cpu_time();
+    for (u64 r = 0; r < rounds; r++) {
+        MtbHmapIter it = {0};
+        for (mtb_hmap_iter_init(&it, &hmap); mtb_hmap_iter_has_next(&it);) {
+            hmapSum += *(u64 *)mtb_hmap_iter_next_value(&it);
+        }
+    }
+    u64 hmapIter = mtb_perf_cpu_time() - beg;
+
+    u64 omapSum = 0;
+    beg = mtb_perf_cpu_time();
+    for (u64 r = 0; r < rounds; r++) {
+        MtbOmapIter it = {0};
+        for (mtb_omap_iter_init(&it, &omap); mtb_omap_iter_has_next(&it);) {
+            omapSum += *(u64 *)mtb_omap_iter_next_value(&it);
+        }
+    }
+    u64 omapIter = mtb_perf_cpu_time() - beg;
+    assert(hmapSum == omapSum);
+
+    beg = mtb_perf_cpu_time();
+    for (u64 i = 0; i < n; i++) {
+        hmapSum += mtb_hmap_get(&hmap, &i) != nil;
+    }
+    u64 hmapGet = mtb_perf_cpu_time() - beg;
+
+    beg = mtb_perf_cpu_time();
+    for (u64 i = 0; i < n; i++) {
+        omapSum += mtb_omap_get(&omap, &i) != nil;
+    }
+    u64 omapGet = mtb_perf_cpu_time() - beg;
+    assert(hmapSum == omapSum);
+
+    printf("%lu -> %lu entries: hmap iter %lu get %lu, omap iter %lu get %lu (cpu time)\n",
+           n,
+           omap.count,
+           hmapIter,
+           hmapGet,
+           omapIter,
+           omapGet);
+}
+
+func void
+_bench_mtb_omap(void)
+{
+    MtbArena arena = {0};
+    mtb_arena_init(&arena, mb(512), &MTB_ARENA_DEF_ALLOCATOR);
+
+    printf("== hmap vs insertion ordered map ==\n");
+    _bench_mtb_omap_iter(&arena, 1 << 16);
+    _bench_mtb_omap_iter(&arena, 1 << 20);
+
+    mtb_arena_deinit(&arena);
+}
+
+#endif // MTB_OMAP_BENCH
@@ -41,6 +41,11 @@ struct mtb_perf_profile
 func void mtb_perf_start();
 func void mtb_perf_print();
 
+// Same layout as the profile blocks, for reports of other modules.
+func void mtb_perf_print_block(const char *name);
+func void mtb_perf_print_u64(const char *label, u64 value);
+func void mtb_perf_print_f64(const char *label, f64 value);
+
 func u64 mtb_perf_cpu_time();
 func u64 mtb_perf_cpu_freq();
 
@@ -103,8 +108,8 @@ mtb_perf_print()
     for (u32 i = 1; i < MTB_PERF_BLOCKS_MAX; i++) {
         MtbPerfBlock *block = &_mtb_perf_global_profile.blocks[i];
         if (block->name) {
-            printf("[%s]\n", block->name);
-            printf("\thits: %lu\n", block->hitCount);
+            mtb_perf_print_block(block->name);
+            mtb_perf_print_u64("hits", block->hitCount);
             printf("\tcpu time: %lu (%.2f%%)\n",
                    block->cpuTimeElapsed,
                    (f32)block->cpuTimeElapsed / (f32)totalCpuTimeElapsed * 100.0f);
@@ -118,6 +123,24 @@ mtb_perf_print()
 #endif
 }
 
+func void
+mtb_perf_print_block(const char *name)
+{
+    printf("[%s]\n", name);
+}
+
+func void
+mtb_perf_print_u64(const char *label, u64 value)
+{
+    printf("\t%s: %lu\n", label, value);
+}
+
+func void
+mtb_perf_print_f64(const char *label, f64 value)
+{
+    printf("\t%s: %.2f\n", label, value);
+}
+
 func u64
 mtb_perf_cpu_time()
 {
@@ -0,0 +1,569 @@
+#ifndef MTB_PHASH_H
+#define MTB_PHASH_H
+
+#ifdef MTB_IMPLEMENTATION
+#define MTB_PHASH_IMPLEMENTATION
+#endif
+
+#ifdef MTB_TESTS
+#define MTB_PHASH_TESTS
+#endif
+
+#ifdef MTB_BENCH
+#define MTB_PHASH_BENCH
+#endif
+
+
+#ifndef MTB_PHASH_DEF_BUCKET_LOAD
+#define MTB_PHASH_DEF_BUCKET_LOAD 4.0f
+#endif
+
+#ifndef MTB_PHASH_MAX_PILOT
+#define MTB_PHASH_MAX_PILOT (1u << 24) // tries per bucket before the build restarts w/ the next seed
+#endif
+
+#define MTB_PHASH_MAGIC 0x3148534148504d4dull // "MMPHASH1"
+
+
+/* Static Minimal Perfect Hash Table */
+
+// CHD style: keys are hashed into buckets of ~MTB_PHASH_DEF_BUCKET_LOAD keys, the biggest
+// buckets are placed first, every bucket gets the first pilot that maps all of its keys to
+// free slots. A lookup is one hash, one pilot load and one key compare.
+//
+// The table is a single blob (this header + data) w/ offsets instead of pointers,
+// phash->size bytes from phash can be written out and loaded back (or mmap-ed) as is.
+typedef struct mtb_phash MtbPhash;
+struct mtb_phash
+{
+    u64 magic;
+    u64 size; // of the whole blob
+    u64 count;
+    u64 bucketCount;
+    u64 seed;
+    u64 keySize; // 0 for MtbStr keys
+
+    // from the start of the blob
+    u64 pilotsOffset;     // u32[bucketCount]
+    u64 indicesOffset;    // u32[count], index of the key in the build input, by slot
+    u64 keyOffsetsOffset; // u32[count + 1], MtbStr keys only
+    u64 keysOffset;       // key bytes, by slot
+};
+
+typedef struct mtb_phash_build_options MtbPhashBuildOptions;
+struct mtb_phash_build_options
+{
+    u64 seed;
+    f32 bucketLoad; // avg keys per bucket, MTB_PHASH_DEF_BUCKET_LOAD if 0, more is smaller but slower to build
+};
+
+
+// The keys must be unique, the blob is bumped from the arena (temporaries go above it).
+func MtbPhash *mtb_phash_build_str_opt(MtbArena *arena, MtbStr *keys, u64 count, MtbPhashBuildOptions opt);
+#define mtb_phash_build_str(arena, keys, count, ...) \
+    mtb_phash_build_str_opt(arena, keys, count, (MtbPhashBuildOptions){ __VA_ARGS__ })
+func MtbPhash *mtb_phash_build_u64_opt(MtbArena *arena, u64 *keys, u64 count, MtbPhashBuildOptions opt);
+#define mtb_phash_build_u64(arena, keys, count, ...) \
+    mtb_phash_build_u64_opt(arena, keys, count, (MtbPhashBuildOptions){ __VA_ARGS__ })
+
+// Returns the index of the key in the build input, U64_MAX if it's not in the table.
+func u64 mtb_phash_get_str(MtbPhash *phash, MtbStr key);
+func u64 mtb_phash_get_u64(MtbPhash *phash, u64 key);
+
+// Validates a serialized table (8 byte aligned), returns nil if it's not one.
+func MtbPhash *mtb_phash_load(void *blob, u64 size);
+
+#endif //MTB_PHASH_H
+
+
+#ifdef MTB_PHASH_IMPLEMENTATION
+
+#include <string.h>
+
+
+#define _mtb_phash_bucket(hash, bucketCount) ((((hash) >> 32) * (bucketCount)) >> 32)
+#define _mtb_phash_data(phash, type, offset) ((type *)((u8 *)(phash) + (phash)->offset))
+
+func u64
+_mtb_phash_slot(u64 hash, u32 pilot, u64 count)
+{
+    u64 h = hash ^ (pilot * u64_lit(0x9E3779B97F4A7C15));
+    h ^= h >> 33;
+    h *= u64_lit(0xff51afd7ed558ccd);
+    h ^= h >> 33;
+    return (u64)(((__uint128_t)h * count) >> 64);
+}
+
+// Either strKeys or u64Keys is given.
+func MtbStr
+_mtb_phash_input_key(MtbStr *strKeys, u64 *u64Keys, u64 index)
+{
+    return strKeys != nil ? strKeys[index] : mtb_str((u8 *)(u64Keys + index), sizeof(u64));
+}
+
+func bool
+_mtb_phash_place(MtbPhash *phash, MtbStr *strKeys, u64 *u64Keys, u64 *hashes, u32 *slotKeys, MtbArena *scratch)
+{
+    u64 count = phash->count;
+    u64 bucketCount = phash->bucketCount;
+    u32 *pilots = _mtb_phash_data(phash, u32, pilotsOffset);
+    mtb_arena_temp_scope(scratch); // released for the next seed
+
+    // keys grouped by bucket (counting sort)
+    u32 *bucketBeg = mtb_arena_bump(scratch, u32, bucketCount + 1);
+    u32 *bucketKeys = mtb_arena_bump(scratch, u32, count, .no_zero = true);
+    for (u64 i = 0; i < count; i++) {
+        MtbStr key = _mtb_phash_input_key(strKeys, u64Keys, i);
+        hashes[i] = mtb_str_hash_bytes(key.bytes, key.length, phash->seed);
+        bucketBeg[_mtb_phash_bucket(hashes[i], bucketCount) + 1]++;
+    }
+    u32 maxBucketSize = 0;
+    for (u64 b = 0; b < bucketCount; b++) {
+        maxBucketSize = bucketBeg[b + 1] > maxBucketSize ? bucketBeg[b + 1] : maxBucketSize;
+        bucketBeg[b + 1] += bucketBeg[b];
+    }
+    u32 *cursor = mtb_arena_bump(scratch, u32, bucketCount, .no_zero = true);
+    memcpy(cursor, bucketBeg, bucketCount * sizeof(u32));
+    for (u64 i = 0; i < count; i++) {
+        bucketKeys[cursor[_mtb_phash_bucket(hashes[i], bucketCount)]++] = (u32)i;
+    }
+
+    // buckets by size, biggest first (counting sort)
+    u32 *sizeBeg = mtb_arena_bump(scratch, u32, maxBucketSize + 2);
+    u32 *order = mtb_arena_bump(scratch, u32, bucketCount, .no_zero = true);
+    for (u64 b = 0; b < bucketCount; b++) {
+        sizeBeg[maxBucketSize - (bucketBeg[b + 1] - bucketBeg[b]) + 1]++;
+    }
+    for (u64 s = 0; s <= maxBucketSize; s++) {
+        sizeBeg[s + 1] += sizeBeg[s];
+    }
+    for (u64 b = 0; b < bucketCount; b++) {
+        order[sizeBeg[maxBucketSize - (bucketBeg[b + 1] - bucketBeg[b])]++] = (u32)b;
+    }
+
+    memset(slotKeys, 0xFF, count * sizeof(u32));
+    u64 *slots = mtb_arena_bump(scratch, u64, maxBucketSize, .no_zero = true);
+    for (u64 i = 0; i < bucketCount; i++) {
+        u32 b = order[i];
+        u32 *bucket = bucketKeys + bucketBeg[b];
+        u32 size = bucketBeg[b + 1] - bucketBeg[b];
+        if (size == 0) {
+            break;
+        }
+
+        // equal hashes never separate, either a duplicate key or a bad seed
+        for (u32 j = 0; j < size; j++) {
+            for (u32 k = j + 1; k < size; k++) {
+                if (hashes[bucket[j]] == hashes[bucket[k]]) {
+                    MtbStr key1 = _mtb_phash_input_key(strKeys, u64Keys, bucket[j]);
+                    MtbStr key2 = _mtb_phash_input_key(strKeys, u64Keys, bucket[k]);
+                    mtb_assert_always(key1.length != key2.length || memcmp(key1.bytes, key2.bytes, key1.length) != 0);
+                    return false;
+                }
+            }
+        }
+
+        u32 pilot = 0;
+        for (;; pilot++) {
+            if (pilot == MTB_PHASH_MAX_PILOT) {
+                return false;
+            }
+            u32 placed = 0;
+            for (; placed < size; placed++) {
+                u64 slot = _mtb_phash_slot(hashes[bucket[placed]], pilot, count);
+                if (slotKeys[slot] != U32_MAX) {
+                    break;
+                }
+                slotKeys[slot] = bucket[placed];
+                slots[placed] = slot;
+            }
+            if (placed == size) {
+                break;
+            }
+            for (u32 j = 0; j < placed; j++) {
+                slotKeys[slots[j]] = U32_MAX;
+            }
+        }
+        pilots[b] = pilot;
+    }
+    return true;
+}
+
+func MtbPhash *
+_mtb_phash_build(MtbArena *arena, MtbStr *strKeys, u64 *u64Keys, u64 keySize, u64 count, MtbPhashBuildOptions opt)
+{
+    mtb_assert_always(count < U32_MAX);
+    mtb_assert_always(0.0f <= opt.bucketLoad);
+
+    f32 bucketLoad = opt.bucketLoad == 0.0f ? MTB_PHASH_DEF_BUCKET_LOAD : opt.bucketLoad;
+    u64 bucketCount = (u64)((f32)count / bucketLoad) + 1;
+    mtb_assert_always(bucketCount < U32_MAX);
+    u64 keyBytes = count * keySize;
+    for (u64 i = 0; keySize == 0 && i < count; i++) {
+        keyBytes += strKeys[i].length;
+    }
+    mtb_assert_always(keyBytes < U32_MAX);
+
+    u64 size = sizeof(MtbPhash);
+    u64 pilotsOffset = size;
+    size += bucketCount * sizeof(u32);
+    u64 indicesOffset = size;
+    size += count * sizeof(u32);
+    u64 keyOffsetsOffset = 0;
+    if (keySize == 0) {
+        keyOffsetsOffset = size;
+        size += (count + 1) * sizeof(u32);
+    }
+    size = mtb_align_pow2(size, mtb_alignof(u64));
+    u64 keysOffset = size;
+    size += keyBytes;
+
+    MtbPhash *phash = mtb_arena_bump_raw(arena, size, .align = mtb_alignof(MtbPhash));
+    *phash = (MtbPhash){
+        .magic = MTB_PHASH_MAGIC,
+        .size = size,
+        .count = count,
+        .bucketCount = bucketCount,
+        .seed = opt.seed,
+        .keySize = keySize,
+        .pilotsOffset = pilotsOffset,
+        .indicesOffset = indicesOffset,
+        .keyOffsetsOffset = keyOffsetsOffset,
+        .keysOffset = keysOffset,
+    };
+
+    MtbArenaTemp scratch = mtb_arena_temp_begin(arena);
+    u32 *slotKeys = nil;
+    if (count > 0) { // an empty table has zero pilots and misses every lookup
+        u64 *hashes = mtb_arena_bump(arena, u64, count, .no_zero = true);
+        slotKeys = mtb_arena_bump(arena, u32, count, .no_zero = true);
+        while (!_mtb_phash_place(phash, strKeys, u64Keys, hashes, slotKeys, arena)) {
+            phash->seed++;
+        }
+    }
+
+    u32 *indices = _mtb_phash_data(phash, u32, indicesOffset);
+    u32 *keyOffsets = _mtb_phash_data(phash, u32, keyOffsetsOffset);
+    u8 *keyData = _mtb_phash_data(phash, u8, keysOffset);
+    u64 keyOffset = 0;
+    for (u64 slot = 0; slot < count; slot++) {
+        MtbStr key = _mtb_phash_input_key(strKeys, u64Keys, slotKeys[slot]);
+        indices[slot] = slotKeys[slot];
+        if (keySize == 0) {
+            keyOffsets[slot] = (u32)keyOffset;
+        }
+        memcpy(keyData + keyOffset, key.bytes, key.length);
+        keyOffset += key.length;
+    }
+    if (keySize == 0) {
+        keyOffsets[count] = (u32)keyOffset;
+    }
+    mtb_arena_temp_end(&scratch);
+    return phash;
+}
+
+func MtbPhash *
+mtb_phash_build_str_opt(MtbArena *arena, MtbStr *keys, u64 count, MtbPhashBuildOptions opt)
+{
+    return _mtb_phash_build(arena, keys, nil, 0, count, opt);
+}
+
+func MtbPhash *
+mtb_phash_build_u64_opt(MtbArena *arena, u64 *keys, u64 count, MtbPhashBuildOptions opt)
+{
+    return _mtb_phash_build(arena, nil, keys, sizeof(u64), count, opt);
+}
+
+func u64
+_mtb_phash_get(MtbPhash *phash, u8 *key, u64 length)
+{
+    if (phash->count == 0) {
+        return U64_MAX;
+    }
+    u64 hash = mtb_str_hash_bytes(key, length, phash->seed);
+    u32 pilot = _mtb_phash_data(phash, u32, pilotsOffset)[_mtb_phash_bucket(hash, phash->bucketCount)];
+    u64 slot = _mtb_phash_slot(hash, pilot, phash->count);
+
+    u8 *slotKey = _mtb_phash_data(phash, u8, keysOffset);
+    u64 slotLength = phash->keySize;
+    if (phash->keySize == 0) {
+        u32 *keyOffsets = _mtb_phash_data(phash, u32, keyOffsetsOffset);
+        slotKey += keyOffsets[slot];
+        slotLength = keyOffsets[slot + 1] - keyOffsets[slot];
+    }
+    else {
+        slotKey += slot * phash->keySize;
+    }
+    if (slotLength != length || memcmp(slotKey, key, length) != 0) {
+        return U64_MAX;
+    }
+    return _mtb_phash_data(phash, u32, indicesOffset)[slot];
+}
+
+func u64
+mtb_phash_get_str(MtbPhash *phash, MtbStr key)
+{
+    mtb_assert(phash->keySize == 0);
+    return _mtb_phash_get(phash, key.bytes, key.length);
+}
+
+func u64
+mtb_phash_get_u64(MtbPhash *phash, u64 key)
+{
+    mtb_assert(phash->keySize == sizeof(u64));
+    return _mtb_phash_get(phash, (u8 *)&key, sizeof(u64));
+}
+
+// n u32s at offset fit in the blob and are aligned, w/o overflowing.
+func bool
+_mtb_phash_fits_u32(MtbPhash *phash, u64 offset, u64 n)
+{
+    return offset <= phash->size && n <= (phash->size - offset) / sizeof(u32) && offset % mtb_alignof(u32) == 0;
+}
+
+func MtbPhash *
+mtb_phash_load(void *blob, u64 size)
+{
+    MtbPhash *phash = blob;
+    if (size < sizeof(MtbPhash) || (u64)blob % mtb_alignof(MtbPhash) != 0) {
+        return nil;
+    }
+    if (phash->magic != MTB_PHASH_MAGIC || phash->size > size || phash->bucketCount == 0) {
+        return nil;
+    }
+    if (phash->keySize != 0 && phash->keySize != sizeof(u64)) {
+        return nil;
+    }
+    if (phash->count >= U32_MAX || phash->bucketCount >= U32_MAX) {
+        return nil;
+    }
+
+    // every array must fit, the key offsets are checked against the key bytes
+    u64 keyBytes = phash->size - mtb_min_u64(phash->keysOffset, phash->size);
+    bool valid = _mtb_phash_fits_u32(phash, phash->pilotsOffset, phash->bucketCount) &&
+                 _mtb_phash_fits_u32(phash, phash->indicesOffset, phash->count) &&
+                 phash->keysOffset <= phash->size;
+    if (valid && phash->keySize == 0) {
+        valid = _mtb_phash_fits_u32(phash, phash->keyOffsetsOffset, phash->count + 1);
+        u32 *keyOffsets = _mtb_phash_data(phash, u32, keyOffsetsOffset);
+        for (u64 i = 0; valid && i < phash->count; i++) {
+            valid = keyOffsets[i] <= keyOffsets[i + 1] && keyOffsets[i + 1] <= keyBytes;
+        }
+    }
+    else if (valid) {
+        valid = phash->count * phash->keySize <= keyBytes;
+    }
+    u32 *indices = _mtb_phash_data(phash, u32, indicesOffset);
+    for (u64 i = 0; valid && i < phash->count; i++) {
+        valid = indices[i] < phash->count;
+    }
+    return valid ? phash : nil;
+}
+
+#endif // MTB_PHASH_IMPLEMENTATION
+
+
+#ifdef MTB_PHASH_TESTS
+
+#include <assert.h>
+
+
+func void
+_test_mtb_phash_str(MtbArena *arena)
+{
+    mtb_arena_temp_scope(arena);
+    char *words[] = {
+        "auto", "break", "case", "char", "const", "continue", "default", "do", "double", "else", "enum",
+        "extern", "float", "for", "goto", "if", "inline", "int", "long", "register", "restrict", "return",
+        "short", "signed", "sizeof", "static", "struct", "switch", "typedef", "union", "unsigned", "void",
+        "volatile", "while", "", "_Bool", "_Complex", "_Imaginary", "an_identifier_longer_than_48_bytes_to_hash",
+    };
+    u64 count = mtb_countof(words);
+    MtbStr *keys = mtb_arena_bump(arena, MtbStr, count);
+    for (u64 i = 0; i < count; i++) {
+        keys[i] = mtb_str((u8 *)words[i], strlen(words[i]));
+    }
+
+    MtbPhash *phash = mtb_phash_build_str(arena, keys, count);
+    assert(phash->count == count);
+    assert((u8 *)phash + phash->size == arena->base + arena->offset); // temporaries were dropped
+    for (u64 i = 0; i < count; i++) {
+        assert(mtb_phash_get_str(phash, keys[i]) == i);
+    }
+    assert(mtb_phash_get_str(phash, mtb_str_lit("main")) == U64_MAX);
+    assert(mtb_phash_get_str(phash, mtb_str_lit("whil")) == U64_MAX);
+    assert(mtb_phash_get_str(phash, mtb_str_lit("while ")) == U64_MAX);
+
+    // serialized copy, then a few broken ones
+    u64 *blob = mtb_arena_bump(arena, u64, phash->size / sizeof(u64) + 1);
+    memcpy(blob, phash, phash->size);
+    MtbPhash *loaded = mtb_phash_load(blob, phash->size);
+    assert(loaded != nil);
+    for (u64 i = 0; i < count; i++) {
+        assert(mtb_phash_get_str(loaded, keys[i]) == i);
+    }
+    assert(mtb_phash_load(blob, phash->size - 1) == nil);
+    assert(mtb_phash_load((u8 *)blob + 1, phash->size) == nil);
+    loaded->keyOffsetsOffset = loaded->size;
+    assert(mtb_phash_load(blob, phash->size) == nil);
+    loaded->keyOffsetsOffset = phash->keyOffsetsOffset;
+    loaded->pilotsOffset = U64_MAX - 3; // wraps around w/ the bucket count
+    assert(mtb_phash_load(blob, phash->size) == nil);
+    loaded->pilotsOffset = phash->pilotsOffset + 1; // misaligned
+    assert(mtb_phash_load(blob, phash->size) == nil);
+    loaded->pilotsOffset = phash->pilotsOffset;
+    loaded->indicesOffset = U64_MAX - sizeof(u32) * phash->count + 1;
+    assert(mtb_phash_load(blob, phash->size) == nil);
+    loaded->indicesOffset = phash->indicesOffset + 2;
+    assert(mtb_phash_load(blob, phash->size) == nil);
+    loaded->indicesOffset = phash->indicesOffset;
+    loaded->keyOffsetsOffset = phash->keyOffsetsOffset + 1;
+    assert(mtb_phash_load(blob, phash->size) == nil);
+    loaded->keyOffsetsOffset = phash->keyOffsetsOffset;
+    assert(mtb_phash_load(blob, phash->size) == loaded);
+    loaded->magic = 0;
+    assert(mtb_phash_load(blob, phash->size) == nil);
+}
+
+func void
+_test_mtb_phash_empty(MtbArena *arena)
+{
+    mtb_arena_temp_scope(arena);
+    MtbPhash *phash = mtb_phash_build_str(arena, nil, 0);
+    assert(phash->count == 0);
+    assert(mtb_phash_get_str(phash, mtb_str_lit("")) == U64_MAX);
+    assert(mtb_phash_get_str(phash, mtb_str_lit("main")) == U64_MAX);
+    assert(mtb_phash_load(phash, phash->size) == phash);
+
+    phash = mtb_phash_build_u64(arena, nil, 0);
+    assert(mtb_phash_get_u64(phash, 0) == U64_MAX);
+    assert(mtb_phash_load(phash, phash->size) == phash);
+}
+
+func void
+_test_mtb_phash_u64(MtbArena *arena, u64 count, f32 bucketLoad)
+{
+    mtb_arena_temp_scope(arena);
+    MtbRng64 rng = {0};
+    mtb_rng64_init(&rng, 7);
+    u64 *keys = mtb_arena_bump(arena, u64, count);
+    for (u64 i = 0; i < count; i++) {
+        keys[i] = mtb_rng64_next(&rng);
+    }
+
+    MtbPhash *phash = mtb_phash_build_u64(arena, keys, count, .seed = 3, .bucketLoad = bucketLoad);
+    assert(phash->size <= sizeof(MtbPhash) + count * (sizeof(u32) + sizeof(u64)) + (phash->bucketCount + 1) * sizeof(u32));
+    for (u64 i = 0; i < count; i++) {
+        assert(mtb_phash_get_u64(phash, keys[i]) == i);
+    }
+    u64 misses = 0;
+    for (u64 i = 0; i < count; i++) {
+        misses += mtb_phash_get_u64(phash, keys[i] + 1) == U64_MAX;
+    }
+    assert(misses == count);
+    assert(mtb_phash_load(phash, phash->size) == phash);
+}
+
+func void
+_test_mtb_phash(void)
+{
+    MtbArena arena = {0};
+    mtb_arena_init(&arena, mb(1), &MTB_ARENA_DEF_ALLOCATOR);
+
+    _test_mtb_phash_str(&arena);
+    _test_mtb_phash_empty(&arena);
+    _test_mtb_phash_u64(&arena, 1, 0.0f);
+    _test_mtb_phash_u64(&arena, 2, 0.0f);
+    _test_mtb_phash_u64(&arena, 1000, 0.0f);
+    _test_mtb_phash_u64(&arena, 10000, 6.0f);
+
+    mtb_arena_deinit(&arena);
+}
+
+#endif // MTB_PHASH_TESTS
+
+
+#ifdef MTB_PHASH_BENCH
+
+#include <assert.h>
+
+
+func u64
+_bench_mtb_phash_hash_u64(void *key)
+{
+    return mtb_str_hash_bytes(key, sizeof(u64), 0);
+}
+
+func bool
+_bench_mtb_phash_is_equal_u64(void *key1, void *key2)
+{
+    return *(u64 *)key1 == *(u64 *)key2;
+}
+
+// Lookups of present keys in random order, phash vs a MtbHmap w/ the same hash function.
+func void
+_bench_mtb_phash_get(MtbArena *arena, u64 count)
+{
+    mtb_arena_temp_scope(arena);
+    MtbRng64 rng = {0};
+    mtb_rng64_init(&rng, 42);
+    u64 *keys = mtb_arena_bump(arena, u64, count);
+    for (u64 i = 0; i < count; i++) {
+        keys[i] = mtb_rng64_next(&rng);
+    }
+    u64 lookupCount = 1 << 22;
+    u64 *lookups = mtb_arena_bump(arena, u64, lookupCount);
+    for (u64 i = 0; i < lookupCount; i++) {
+        lookups[i] = keys[mtb_rng64_next_bounded(&rng, count)];
+    }
+
+    u64 beg = mtb_perf_cpu_time();
+    MtbPhash *phash = mtb_phash_build_u64(arena, keys, count);
+    u64 build = mtb_perf_cpu_time() - beg;
+
+    MtbHmap hmap = {0};
+    mtb_hmap_init(&hmap, arena, u64, u64, _bench_mtb_phash_hash_u64, _bench_mtb_phash_is_equal_u64,
+                  .probing = MTB_HMAP_PROBING_GROUP, .capacity = mtb_hmap_calc_capacity(count));
+    for (u64 i = 0; i < count; i++) {
+        *(u64 *)mtb_hmap_put(&hmap, keys + i) = i;
+    }
+
+    u64 sum = 0;
+    beg = mtb_perf_cpu_time();
+    for (u64 i = 0; i < lookupCount; i++) {
+        sum += *(u64 *)mtb_hmap_get(&hmap, lookups + i);
+    }
+    u64 hmapElapsed = mtb_perf_cpu_time() - beg;
+
+    u64 phashSum = 0;
+    beg = mtb_perf_cpu_time();
+    for (u64 i = 0; i < lookupCount; i++) {
+        phashSum += mtb_phash_get_u64(phash, lookups[i]);
+    }
+    u64 phashElapsed = mtb_perf_cpu_time() - beg;
+
+    assert(sum == phashSum);
+    printf("%lu keys: build %lu, hmap get %lu, phash get %lu (cpu time), %.2f B/key vs %.2f B/key\n",
+           count,
+           build,
+           hmapElapsed,
+           phashElapsed,
+           (f64)phash->size / (f64)count,
+           (f64)(hmap.capacity * (hmap.entrySize + 1)) / (f64)count);
+}
+
+func void
+_bench_mtb_phash(void)
+{
+    MtbArena arena = {0};
+    mtb_arena_init(&arena, mb(256), &MTB_ARENA_DEF_ALLOCATOR);
+
+    printf("== perfect hash vs group probing ==\n");
+    _bench_mtb_phash_get(&arena, 1 << 10);
+    _bench_mtb_phash_get(&arena, 1 << 16);
+    _bench_mtb_phash_get(&arena, 1 << 20);
+
+    mtb_arena_deinit(&arena);
+}
+
+#endif // MTB_PHASH_BENCH
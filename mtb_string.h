@@ -9,8 +9,13 @@
 #define MTB_STRING_TESTS
 #endif
 
+#ifdef MTB_BENCH
+#define MTB_STRING_BENCH
+#endif
+
 
 #include <stdarg.h>
+#include <string.h>
 
 
 /* String */
@@ -144,15 +149,88 @@ func void mtb_str_split_opt(MtbStrList *list, MtbStr str, MtbStr delim, MtbStrSp
 
 /* Hash map utils */
 
+// Based on wyhash: word at a time w/ unaligned loads, 64x64->128 bit multiply-fold mixing.
+#define _mtb_str_hash_secret0 0x2d358dccaa6c78a5ull
+#define _mtb_str_hash_secret1 0x8bb84b93962eacc9ull
+#define _mtb_str_hash_secret2 0x4b33a62ed433d4a3ull
+#define _mtb_str_hash_secret3 0x4d5a2da51de1aa47ull
+
 func u64
-mtb_str_key_hash(void *key)
+_mtb_str_hash_mix(u64 a, u64 b)
 {
-    MtbStr *s = (MtbStr *)key;
-    u64 hash = 0;
-    for (u64 i = 0; i < s->length; i++) {
-        hash = 17000069 * hash + s->chars[i];
+    __uint128_t r = (__uint128_t)a * b;
+    return (u64)r ^ (u64)(r >> 64);
+}
+
+func u64
+_mtb_str_hash_read64(u8 *p)
+{
+    u64 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+func u64
+_mtb_str_hash_read32(u8 *p)
+{
+    u32 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+func u64
+mtb_str_hash_bytes(u8 *bytes, u64 length, u64 seed)
+{
+    u8 *p = bytes;
+    u64 a = 0;
+    u64 b = 0;
+    seed ^= _mtb_str_hash_mix(seed ^ _mtb_str_hash_secret0, _mtb_str_hash_secret1);
+    if (length <= 16) {
+        if (length >= 4) {
+            u64 offset = (length >> 3) << 2; // 0 or 4, the two 8 byte halves overlap for short keys
+            a = (_mtb_str_hash_read32(p) << 32) | _mtb_str_hash_read32(p + offset);
+            b = (_mtb_str_hash_read32(p + length - 4) << 32) | _mtb_str_hash_read32(p + length - 4 - offset);
+        }
+        else if (length > 0) {
+            a = ((u64)p[0] << 16) | ((u64)p[length >> 1] << 8) | p[length - 1];
+        }
     }
-    return hash;
+    else {
+        u64 i = length;
+        if (i > 48) {
+            u64 seed1 = seed;
+            u64 seed2 = seed;
+            do {
+                seed = _mtb_str_hash_mix(_mtb_str_hash_read64(p) ^ _mtb_str_hash_secret1, _mtb_str_hash_read64(p + 8) ^ seed);
+                seed1 = _mtb_str_hash_mix(_mtb_str_hash_read64(p + 16) ^ _mtb_str_hash_secret2, _mtb_str_hash_read64(p + 24) ^ seed1);
+                seed2 = _mtb_str_hash_mix(_mtb_str_hash_read64(p + 32) ^ _mtb_str_hash_secret3, _mtb_str_hash_read64(p + 40) ^ seed2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= seed1 ^ seed2;
+        }
+        while (i > 16) {
+            seed = _mtb_str_hash_mix(_mtb_str_hash_read64(p) ^ _mtb_str_hash_secret1, _mtb_str_hash_read64(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+        a = _mtb_str_hash_read64(p + i - 16);
+        b = _mtb_str_hash_read64(p + i - 8);
+    }
+    __uint128_t r = (__uint128_t)(a ^ _mtb_str_hash_secret1) * (b ^ seed);
+    return _mtb_str_hash_mix((u64)r ^ _mtb_str_hash_secret0 ^ length, (u64)(r >> 64) ^ _mtb_str_hash_secret1);
+}
+
+func u64
+mtb_str_hash(MtbStr str)
+{
+    return mtb_str_hash_bytes(str.bytes, str.length, 0);
+}
+
+func u64
+mtb_str_key_hash(void *key)
+{
+    return mtb_str_hash(*(MtbStr *)key);
 }
 
 func bool
@@ -919,6 +997,49 @@ _test_mtb_str_split(MtbArena arena)
     assert(mtb_str_list_is_empty(&list));
 }
 
+func void
+_test_mtb_str_hash(void)
+{
+    u8 bytes[128 + 8];
+    for (u64 i = 0; i < sizeof(bytes); i++) {
+        bytes[i] = (u8)(i * 7 + 1);
+    }
+    u64 hashes[129];
+    for (u64 length = 0; length <= 128; length++) {
+        hashes[length] = mtb_str_hash(mtb_str(bytes, length));
+        // doesn't depend on alignment
+        u8 copy[128 + 8];
+        for (u64 offset = 1; offset < 8; offset++) {
+            memcpy(copy + offset, bytes, length);
+            assert(mtb_str_hash(mtb_str(copy + offset, length)) == hashes[length]);
+        }
+        // every prefix is different
+        for (u64 prev = 0; prev < length; prev++) {
+            assert(hashes[prev] != hashes[length]);
+        }
+        // every byte counts
+        if (length > 0) {
+            bytes[length / 2] ^= 1;
+            assert(mtb_str_hash(mtb_str(bytes, length)) != hashes[length]);
+            bytes[length / 2] ^= 1;
+        }
+    }
+    assert(mtb_str_hash_bytes(bytes, 16, 1) != mtb_str_hash_bytes(bytes, 16, 2));
+    assert(mtb_str_key_hash(&mtb_str_lit("abc")) == mtb_str_hash(mtb_str_lit("abc")));
+
+    // low bits are well spread, hmap only uses those
+    u8 buckets[256] = {0};
+    for (u32 i = 0; i < 256; i++) {
+        char key[4] = { 'k', 'e', 'y', (char)i };
+        buckets[mtb_str_hash(mtb_str((u8 *)key, sizeof(key))) & 255] = 1;
+    }
+    u32 used = 0;
+    for (u32 i = 0; i < 256; i++) {
+        used += buckets[i];
+    }
+    assert(used > 140); // ~162 expected for random hashes
+}
+
 func void
 _test_mtb_string(void)
 {
@@ -943,8 +1064,120 @@ _test_mtb_string(void)
     _test_mtb_str_suffix();
     _test_mtb_str_join(arena);
     _test_mtb_str_split(arena);
+    _test_mtb_str_hash();
 
     mtb_arena_deinit(&arena);
 }
 
 #endif // MTB_STRING_TESTS
+
+
+#ifdef MTB_STRING_BENCH
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+// The corpus shared by the benches, loaded once by bench.c: data/shakespeare.txt split on whitespace.
+// Separators are overwritten w/ '\0', so the chars of every token are also a C string.
+func MtbStr
+_bench_mtb_corpus_load(MtbArena *arena, MtbDynArr *tokens)
+{
+    FILE *inputFile = fopen("data/shakespeare.txt", "r");
+    if (inputFile == nil) {
+        fprintf(stderr, "fopen() failed\n");
+        exit(1);
+    }
+    fseek(inputFile, 0L, SEEK_END);
+    u64 inputFileSize = ftell(inputFile);
+    fseek(inputFile, 0L, SEEK_SET);
+
+    mtb_arena_init(arena, inputFileSize * 8, &MTB_ARENA_DEF_ALLOCATOR);
+
+    u8 *inputData = mtb_arena_bump(arena, u8, inputFileSize + 1);
+    if (fread(inputData, sizeof(u8), inputFileSize, inputFile) != inputFileSize) {
+        fprintf(stderr, "fread() failed\n");
+        exit(1);
+    }
+    fclose(inputFile);
+    MtbStr corpus = mtb_str(inputData, inputFileSize);
+
+    mtb_dynarr_init(tokens, arena, sizeof(MtbStr));
+    u64 beg = 0;
+    for (u64 i = 0; i <= corpus.length; i++) {
+        if (i == corpus.length || mtb_char_is_space(corpus.chars[i])) {
+            if (i > beg) {
+                *(MtbStr *)mtb_dynarr_push(tokens) = mtb_str_substr(corpus, beg, i);
+            }
+            corpus.chars[i] = '\0';
+            beg = i + 1;
+        }
+    }
+    return corpus;
+}
+
+
+func u64
+_bench_mtb_str_key_hash_mul(void *key)
+{
+    MtbStr *s = (MtbStr *)key;
+    u64 hash = 0;
+    for (u64 i = 0; i < s->length; i++) {
+        hash = 17000069 * hash + s->chars[i];
+    }
+    return hash;
+}
+
+func void
+_bench_mtb_str_hash(MtbArena *arena, MtbDynArr *tokens, MtbStr corpus, u64 (*key_hash)(void *key))
+{
+    mtb_arena_temp_scope(arena);
+    u64 iterationCount = 100;
+    u64 sum = 0;
+
+    u64 beg = mtb_perf_cpu_time();
+    for (u64 i = 0; i < iterationCount; i++) {
+        for (u64 t = 0; t < tokens->length; t++) {
+            sum += key_hash(mtb_dynarr_get(tokens, t));
+        }
+    }
+    u64 tokensTime = mtb_perf_cpu_time() - beg;
+
+    beg = mtb_perf_cpu_time();
+    for (u64 i = 0; i < iterationCount; i++) {
+        sum += key_hash(&corpus);
+    }
+    u64 corpusTime = mtb_perf_cpu_time() - beg;
+
+    beg = mtb_perf_cpu_time();
+    MtbHmap hmap = {0};
+    mtb_hmap_init(&hmap, arena, MtbStr, u64, key_hash, mtb_str_key_equals);
+    for (u64 i = 0; i < iterationCount / 10; i++) {
+        mtb_hmap_clear(&hmap);
+        for (u64 t = 0; t < tokens->length; t++) {
+            bool inserted;
+            *(u64 *)mtb_hmap_upsert(&hmap, mtb_dynarr_get(tokens, t), &inserted) += 1;
+        }
+    }
+    u64 wordCountTime = mtb_perf_cpu_time() - beg;
+
+    printf("tokens: %lu, corpus: %lu, word count: %lu (cpu time, checksum %lu)\n",
+           tokensTime, corpusTime, wordCountTime, sum);
+}
+
+func void
+_bench_mtb_string(MtbStr corpus, MtbDynArr *tokens)
+{
+    MtbArena arena = {0};
+    mtb_arena_init(&arena, mb(64), &MTB_ARENA_DEF_ALLOCATOR);
+
+    printf("== multiplicative string hash ==\n");
+    _bench_mtb_str_hash(&arena, tokens, corpus, _bench_mtb_str_key_hash_mul);
+    printf("== mtb_str_hash ==\n");
+    _bench_mtb_str_hash(&arena, tokens, corpus, mtb_str_key_hash);
+
+    mtb_arena_deinit(&arena);
+}
+
+#endif // MTB_STRING_BENCH
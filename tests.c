@@ -11,6 +11,12 @@ main(void)
     _test_mtb_dynarr();
     _test_mtb_segarr();
     _test_mtb_hmap();
+    _test_mtb_hset();
+    _test_mtb_omap();
+    _test_mtb_cache();
     _test_mtb_string();
+    _test_mtb_phash();
+    _test_mtb_cmap();
+    _test_mtb_intern();
     _test_mtb_rng();
 }